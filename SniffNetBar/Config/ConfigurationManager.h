@@ -41,7 +41,15 @@ extern NSString * const kIpInfoAPITokenIdentifier;
 @property (nonatomic, readonly) NSUInteger maxReconnectAttempts;
 
 // Packet Capture Configuration
-@property (nonatomic, readonly) NSTimeInterval packetPollingInterval;
+@property (nonatomic, readonly) NSUInteger packetBatchMaxPackets;
+@property (nonatomic, readonly) NSTimeInterval packetBatchMaxLatency;
+@property (nonatomic, readonly) BOOL packetRingEnabled;
+@property (nonatomic, readonly) NSUInteger packetRingCapacity;
+// BPF filter, snapshot length and kernel buffer size for live capture
+@property (nonatomic, readonly) NSString *captureFilter;
+@property (nonatomic, readonly) NSUInteger captureSnapshotLength;
+@property (nonatomic, readonly) NSUInteger captureBufferSize;
+@property (nonatomic, readonly) NSArray<NSString *> *localNetworks;
 
 // Location Cache Configuration
 @property (nonatomic, readonly) NSUInteger maxLocationCacheSize;
@@ -81,6 +89,7 @@ extern NSString * const kIpInfoAPITokenIdentifier;
 @property (nonatomic, readonly) NSString *virusTotalAPIKey;
 @property (nonatomic, readonly) NSTimeInterval virusTotalTimeout;
 @property (nonatomic, readonly) NSInteger virusTotalMaxRequestsPerMin;
+@property (nonatomic, readonly) NSInteger virusTotalMaxRequestsPerDay;  // 0 for no daily limit
 @property (nonatomic, readonly) NSTimeInterval virusTotalTTL;
 
 // AbuseIPDB Provider Configuration
@@ -89,6 +98,7 @@ extern NSString * const kIpInfoAPITokenIdentifier;
 @property (nonatomic, readonly) NSString *abuseIPDBAPIKey;
 @property (nonatomic, readonly) NSTimeInterval abuseIPDBTimeout;
 @property (nonatomic, readonly) NSInteger abuseIPDBMaxRequestsPerMin;
+@property (nonatomic, readonly) NSInteger abuseIPDBMaxRequestsPerDay;
 @property (nonatomic, readonly) NSTimeInterval abuseIPDBTTL;
 @property (nonatomic, readonly) NSInteger abuseIPDBMaxAgeInDays;
 
@@ -98,6 +108,7 @@ extern NSString * const kIpInfoAPITokenIdentifier;
 @property (nonatomic, readonly) NSString *greyNoiseAPIKey;
 @property (nonatomic, readonly) NSTimeInterval greyNoiseTimeout;
 @property (nonatomic, readonly) NSInteger greyNoiseMaxRequestsPerMin;
+@property (nonatomic, readonly) NSInteger greyNoiseMaxRequestsPerDay;
 @property (nonatomic, readonly) NSTimeInterval greyNoiseTTL;
 
 // Shodan Provider Configuration
@@ -106,8 +117,16 @@ extern NSString * const kIpInfoAPITokenIdentifier;
 @property (nonatomic, readonly) NSString *shodanAPIKey;
 @property (nonatomic, readonly) NSTimeInterval shodanTimeout;
 @property (nonatomic, readonly) NSInteger shodanMaxRequestsPerMin;
+@property (nonatomic, readonly) NSInteger shodanMaxRequestsPerDay;
 @property (nonatomic, readonly) NSTimeInterval shodanTTL;
 
+// Offline Blocklist Provider Configuration
+@property (nonatomic, readonly) BOOL blocklistEnabled;
+@property (nonatomic, readonly) NSArray<NSString *> *blocklistPaths;     // FireHOL/Spamhaus DROP-style CIDR or IP lists
+@property (nonatomic, readonly) NSTimeInterval blocklistReloadInterval;  // 0 to load once
+@property (nonatomic, readonly) NSInteger blocklistConfidence;          // 0-100, reported for listed addresses
+@property (nonatomic, readonly) NSTimeInterval blocklistTTL;
+
 /**
  * Reload configuration from the plist file
  * Useful if the configuration file is modified at runtime
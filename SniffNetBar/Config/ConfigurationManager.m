@@ -84,7 +84,14 @@ BOOL SNBConfigurationManagerIsInitializing(void) {
         @"MenuFixedWidth": @420.0,
         @"ReconnectDelay": @5.0,
         @"MaxReconnectAttempts": @3,
-        @"PacketPollingInterval": @0.01,
+        @"PacketBatchMaxPackets": @512,
+        @"PacketBatchMaxLatency": @0.05,
+        @"PacketRingEnabled": @YES,
+        @"PacketRingCapacity": @65536,
+        @"CaptureFilter": @"",
+        @"CaptureSnapshotLength": @128,
+        @"CaptureBufferSize": @4194304,
+        @"LocalNetworks": @[],
         @"MaxLocationCacheSize": @500,
         @"LocationCacheExpirationTime": @7200.0,
         @"DefaultMapProvider": @"ipinfo.io",
@@ -105,7 +112,13 @@ BOOL SNBConfigurationManagerIsInitializing(void) {
         @"ShodanAPIKey": @"YOUR_API_KEY_HERE",
         @"ShodanTimeout": @10.0,
         @"ShodanMaxRequestsPerMin": @60,
-        @"ShodanTTL": @86400.0
+        @"ShodanMaxRequestsPerDay": @0,
+        @"ShodanTTL": @86400.0,
+        @"BlocklistEnabled": @NO,
+        @"BlocklistPaths": @[],
+        @"BlocklistReloadInterval": @3600.0,
+        @"BlocklistConfidence": @80,
+        @"BlocklistTTL": @3600.0
     };
     SNBLogConfigInfo("Using default configuration");
     NSError *validationError = nil;
@@ -174,6 +187,9 @@ BOOL SNBConfigurationManagerIsInitializing(void) {
         if (self.virusTotalMaxRequestsPerMin <= 0) {
             [issues addObject:@"VirusTotalMaxRequestsPerMin must be greater than 0."];
         }
+        if (self.virusTotalMaxRequestsPerDay < 0) {
+            [issues addObject:@"VirusTotalMaxRequestsPerDay must not be negative."];
+        }
         if (self.virusTotalTimeout <= 0) {
             [issues addObject:@"VirusTotalTimeout must be greater than 0."];
         }
@@ -189,6 +205,9 @@ BOOL SNBConfigurationManagerIsInitializing(void) {
         if (self.abuseIPDBMaxRequestsPerMin <= 0) {
             [issues addObject:@"AbuseIPDBMaxRequestsPerMin must be greater than 0."];
         }
+        if (self.abuseIPDBMaxRequestsPerDay < 0) {
+            [issues addObject:@"AbuseIPDBMaxRequestsPerDay must not be negative."];
+        }
         if (self.abuseIPDBTimeout <= 0) {
             [issues addObject:@"AbuseIPDBTimeout must be greater than 0."];
         }
@@ -204,11 +223,26 @@ BOOL SNBConfigurationManagerIsInitializing(void) {
         if (self.greyNoiseMaxRequestsPerMin <= 0) {
             [issues addObject:@"GreyNoiseMaxRequestsPerMin must be greater than 0."];
         }
+        if (self.greyNoiseMaxRequestsPerDay < 0) {
+            [issues addObject:@"GreyNoiseMaxRequestsPerDay must not be negative."];
+        }
         if (self.greyNoiseTimeout <= 0) {
             [issues addObject:@"GreyNoiseTimeout must be greater than 0."];
         }
     }
 
+    if (self.blocklistEnabled) {
+        if (self.blocklistPaths.count == 0) {
+            [issues addObject:@"BlocklistPaths must list at least one file when the blocklist is enabled."];
+        }
+        if (self.blocklistReloadInterval < 0) {
+            [issues addObject:@"BlocklistReloadInterval must not be negative."];
+        }
+        if (self.blocklistConfidence < 0 || self.blocklistConfidence > 100) {
+            [issues addObject:@"BlocklistConfidence must be between 0 and 100."];
+        }
+    }
+
     if (issues.count == 0) {
         return YES;
     }
@@ -277,9 +311,56 @@ BOOL SNBConfigurationManagerIsInitializing(void) {
 
 #pragma mark - Packet Capture Configuration
 
-- (NSTimeInterval)packetPollingInterval {
-    NSNumber *value = self.configuration[@"PacketPollingInterval"];
-    return value ? [value doubleValue] : 0.01;
+- (NSUInteger)packetBatchMaxPackets {
+    NSNumber *value = self.configuration[@"PacketBatchMaxPackets"];
+    return value ? MAX((NSUInteger)1, [value unsignedIntegerValue]) : 512;
+}
+
+- (NSTimeInterval)packetBatchMaxLatency {
+    NSNumber *value = self.configuration[@"PacketBatchMaxLatency"];
+    return value ? MAX(0.001, [value doubleValue]) : 0.05;
+}
+
+- (BOOL)packetRingEnabled {
+    NSNumber *value = self.configuration[@"PacketRingEnabled"];
+    return value ? [value boolValue] : YES;
+}
+
+- (NSUInteger)packetRingCapacity {
+    NSNumber *value = self.configuration[@"PacketRingCapacity"];
+    return value ? [value unsignedIntegerValue] : 65536;
+}
+
+- (NSString *)captureFilter {
+    NSString *value = self.configuration[@"CaptureFilter"];
+    if (![value isKindOfClass:[NSString class]]) {
+        return @"";
+    }
+    return [value stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]];
+}
+
+- (NSUInteger)captureSnapshotLength {
+    NSNumber *value = self.configuration[@"CaptureSnapshotLength"];
+    return value ? [value unsignedIntegerValue] : 128;
+}
+
+- (NSUInteger)captureBufferSize {
+    NSNumber *value = self.configuration[@"CaptureBufferSize"];
+    return value ? [value unsignedIntegerValue] : 4194304;
+}
+
+- (NSArray<NSString *> *)localNetworks {
+    NSArray *value = self.configuration[@"LocalNetworks"];
+    if (![value isKindOfClass:[NSArray class]]) {
+        return @[];
+    }
+    NSMutableArray<NSString *> *networks = [NSMutableArray arrayWithCapacity:value.count];
+    for (id entry in value) {
+        if ([entry isKindOfClass:[NSString class]]) {
+            [networks addObject:entry];
+        }
+    }
+    return networks;
 }
 
 #pragma mark - Location Cache Configuration
@@ -458,6 +539,11 @@ BOOL SNBConfigurationManagerIsInitializing(void) {
     return value ? [value integerValue] : 4;
 }
 
+- (NSInteger)virusTotalMaxRequestsPerDay {
+    NSNumber *value = self.configuration[@"VirusTotalMaxRequestsPerDay"];
+    return value ? [value integerValue] : 500;
+}
+
 - (NSTimeInterval)virusTotalTTL {
     NSNumber *value = self.configuration[@"VirusTotalTTL"];
     return value ? [value doubleValue] : 86400.0;
@@ -508,6 +594,11 @@ BOOL SNBConfigurationManagerIsInitializing(void) {
     return value ? [value integerValue] : 60;
 }
 
+- (NSInteger)abuseIPDBMaxRequestsPerDay {
+    NSNumber *value = self.configuration[@"AbuseIPDBMaxRequestsPerDay"];
+    return value ? [value integerValue] : 1000;
+}
+
 - (NSTimeInterval)abuseIPDBTTL {
     NSNumber *value = self.configuration[@"AbuseIPDBTTL"];
     return value ? [value doubleValue] : 86400.0;
@@ -560,6 +651,11 @@ BOOL SNBConfigurationManagerIsInitializing(void) {
     return value ? [value integerValue] : 60;
 }
 
+- (NSInteger)greyNoiseMaxRequestsPerDay {
+    NSNumber *value = self.configuration[@"GreyNoiseMaxRequestsPerDay"];
+    return value ? [value integerValue] : 0;
+}
+
 - (NSTimeInterval)greyNoiseTTL {
     NSNumber *value = self.configuration[@"GreyNoiseTTL"];
     return value ? [value doubleValue] : 86400.0;
@@ -616,11 +712,52 @@ BOOL SNBConfigurationManagerIsInitializing(void) {
     return value ? [value integerValue] : 60;
 }
 
+- (NSInteger)shodanMaxRequestsPerDay {
+    NSNumber *value = self.configuration[@"ShodanMaxRequestsPerDay"];
+    return value ? [value integerValue] : 0;
+}
+
 - (NSTimeInterval)shodanTTL {
     NSNumber *value = self.configuration[@"ShodanTTL"];
     return value ? [value doubleValue] : 86400.0;
 }
 
+#pragma mark - Offline Blocklist Provider Configuration
+
+- (BOOL)blocklistEnabled {
+    NSNumber *value = self.configuration[@"BlocklistEnabled"];
+    return value ? [value boolValue] : NO;
+}
+
+- (NSArray<NSString *> *)blocklistPaths {
+    NSArray *value = self.configuration[@"BlocklistPaths"];
+    if (![value isKindOfClass:[NSArray class]]) {
+        return @[];
+    }
+    NSMutableArray<NSString *> *paths = [NSMutableArray arrayWithCapacity:value.count];
+    for (id entry in value) {
+        if ([entry isKindOfClass:[NSString class]] && [entry length] > 0) {
+            [paths addObject:entry];
+        }
+    }
+    return paths;
+}
+
+- (NSTimeInterval)blocklistReloadInterval {
+    NSNumber *value = self.configuration[@"BlocklistReloadInterval"];
+    return value ? [value doubleValue] : 3600.0;
+}
+
+- (NSInteger)blocklistConfidence {
+    NSNumber *value = self.configuration[@"BlocklistConfidence"];
+    return value ? [value integerValue] : 80;
+}
+
+- (NSTimeInterval)blocklistTTL {
+    NSNumber *value = self.configuration[@"BlocklistTTL"];
+    return value ? [value doubleValue] : 3600.0;
+}
+
 #pragma mark - API Key Management
 
 - (void)setAPIKey:(nullable NSString *)apiKey forIdentifier:(NSString *)identifier {
@@ -8,6 +8,8 @@
 typedef NSString * SNBUserDefaultsKey NS_TYPED_ENUM;
 
 FOUNDATION_EXPORT SNBUserDefaultsKey const SNBUserDefaultsKeySelectedNetworkDevice;
+// Devices captured alongside the selected one (array of device names)
+FOUNDATION_EXPORT SNBUserDefaultsKey const SNBUserDefaultsKeyAdditionalCaptureDevices;
 FOUNDATION_EXPORT SNBUserDefaultsKey const SNBUserDefaultsKeyMapProvider;
 FOUNDATION_EXPORT SNBUserDefaultsKey const SNBUserDefaultsKeyMapProviderURLTemplate;
 FOUNDATION_EXPORT SNBUserDefaultsKey const SNBUserDefaultsKeyMapProviderLatKey;
@@ -21,6 +23,11 @@ FOUNDATION_EXPORT SNBUserDefaultsKey const SNBUserDefaultsKeyShowTopConnections;
 FOUNDATION_EXPORT SNBUserDefaultsKey const SNBUserDefaultsKeyShowMap;
 FOUNDATION_EXPORT SNBUserDefaultsKey const SNBUserDefaultsKeyShowProcessActivity;
 
+// Offline replay, normally passed as launch arguments (-ReplayFile path)
+FOUNDATION_EXPORT SNBUserDefaultsKey const SNBUserDefaultsKeyReplayFile;
+FOUNDATION_EXPORT SNBUserDefaultsKey const SNBUserDefaultsKeyReplayTiming;
+FOUNDATION_EXPORT SNBUserDefaultsKey const SNBUserDefaultsKeyReplayLocalAddresses;
+
 // Section collapse/expand states
 FOUNDATION_EXPORT SNBUserDefaultsKey const SNBUserDefaultsKeySectionThreatsExpanded;
 FOUNDATION_EXPORT SNBUserDefaultsKey const SNBUserDefaultsKeySectionNetworkActivityExpanded;
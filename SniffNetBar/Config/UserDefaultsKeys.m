@@ -6,6 +6,7 @@
 #import "UserDefaultsKeys.h"
 
 SNBUserDefaultsKey const SNBUserDefaultsKeySelectedNetworkDevice = @"SelectedNetworkDevice";
+SNBUserDefaultsKey const SNBUserDefaultsKeyAdditionalCaptureDevices = @"AdditionalCaptureDevices";
 SNBUserDefaultsKey const SNBUserDefaultsKeyMapProvider = @"MapProvider";
 SNBUserDefaultsKey const SNBUserDefaultsKeyMapProviderURLTemplate = @"MapProviderURLTemplate";
 SNBUserDefaultsKey const SNBUserDefaultsKeyMapProviderLatKey = @"MapProviderLatKey";
@@ -19,6 +20,11 @@ SNBUserDefaultsKey const SNBUserDefaultsKeyShowTopConnections = @"ShowTopConnect
 SNBUserDefaultsKey const SNBUserDefaultsKeyShowMap = @"ShowMap";
 SNBUserDefaultsKey const SNBUserDefaultsKeyShowProcessActivity = @"ShowProcessActivity";
 
+// Offline replay
+SNBUserDefaultsKey const SNBUserDefaultsKeyReplayFile = @"ReplayFile";
+SNBUserDefaultsKey const SNBUserDefaultsKeyReplayTiming = @"ReplayTiming";
+SNBUserDefaultsKey const SNBUserDefaultsKeyReplayLocalAddresses = @"ReplayLocalAddresses";
+
 // Section collapse/expand states
 SNBUserDefaultsKey const SNBUserDefaultsKeySectionThreatsExpanded = @"SectionThreatsExpanded";
 SNBUserDefaultsKey const SNBUserDefaultsKeySectionNetworkActivityExpanded = @"SectionNetworkActivityExpanded";
@@ -41,6 +41,7 @@
 - (void)toggleDailyStatistics:(NSMenuItem *)sender;
 - (void)openStatisticsReport:(NSMenuItem *)sender;
 - (void)deviceSelected:(NSMenuItem *)sender;
+- (void)additionalDeviceToggled:(NSMenuItem *)sender;
 
 // Menu delegate methods
 - (void)menuWillOpenWithStats;
@@ -11,7 +11,8 @@
 #import "MenuBuilder.h"
 #import "NetworkDevice.h"
 #import "PacketCaptureManager.h"
-#import "PacketInfo.h"
+#import "PacketBatch.h"
+#import "CaptureStats.h"
 #import "ThreatIntelCoordinator.h"
 #import "Logger.h"
 #import "TrafficStatistics.h"
@@ -22,6 +23,7 @@
 #import "NetworkAssetMonitor.h"
 #import "UserDefaultsKeys.h"
 #import "StatisticsHistory.h"
+#import "IPAddressUtilities.h"
 
 @interface AppCoordinator () <MenuBuilderDelegate>
 @property (nonatomic, strong, readwrite) TrafficStatistics *statistics;
@@ -53,6 +55,11 @@
         _statusMenu = statusMenu;
         _configuration = [ConfigurationManager sharedManager];
 
+        NSError *networksError = nil;
+        if (![IPAddressUtilities setUserNetworks:_configuration.localNetworks error:&networksError]) {
+            SNBLogConfigWarn("Ignoring LocalNetworks: %{public}@", networksError.localizedDescription);
+        }
+
         // Initialize subsystems
         PacketCaptureManager *packetManager = [[PacketCaptureManager alloc] init];
         _statistics = [[TrafficStatistics alloc] init];
@@ -73,21 +80,28 @@
 
         // Set up callback for packet updates
         __weak typeof(self) weakSelf = self;
-        _deviceManager.packetManager.onPacketReceived = ^(PacketInfo *packetInfo) {
-            [weakSelf.statistics processPacket:packetInfo];
-            [weakSelf.anomalyDetector processPacket:packetInfo];
-            [weakSelf.statisticsHistory processPacket:packetInfo];
+        _deviceManager.packetManager.onPacketBatchReceived = ^(SNBPacketBatch *batch, SNBCaptureStats *stats) {
+            __strong typeof(weakSelf) strongSelf = weakSelf;
+            if (!strongSelf) {
+                return;
+            }
+            [strongSelf.statistics processPacketBatch:batch];
+            [strongSelf.anomalyDetector processPacketBatch:batch];
+            [strongSelf.statisticsHistory processPacketBatch:batch];
         };
     }
     return self;
 }
 
-- (void)syncCaptureStartDateForMenuBuilder {
+- (void)syncCaptureStateForMenuBuilder {
     NSDate *packetStart = self.deviceManager.packetManager.captureStartDate;
     if (packetStart && (!self.captureWindowStartDate || [packetStart compare:self.captureWindowStartDate] == NSOrderedDescending)) {
         self.captureWindowStartDate = packetStart;
     }
     self.menuBuilder.captureStartDate = self.captureWindowStartDate;
+    self.menuBuilder.captureStats = self.deviceManager.packetManager.captureStats;
+    self.menuBuilder.additionalCaptureDeviceNames = self.deviceManager.additionalDeviceNames;
+    self.statistics.interfaceNames = self.deviceManager.packetManager.interfaceNames;
 }
 
 - (void)start {
@@ -158,6 +172,12 @@
 }
 
 - (void)startCaptureWithCurrentDevice {
+    NSString *replayPath = [[NSUserDefaults standardUserDefaults] stringForKey:SNBUserDefaultsKeyReplayFile];
+    if (replayPath.length > 0) {
+        [self startReplayFromFile:replayPath];
+        return;
+    }
+
     NSError *error = nil;
     BOOL started = [self.deviceManager startCaptureWithError:&error];
     if (!started) {
@@ -170,6 +190,33 @@
     }
 }
 
+// Launching with `-ReplayFile capture.pcapng` drives every consumer from a
+// recorded file instead of the helper. `-ReplayTiming original` paces it as
+// captured and `-ReplayLocalAddresses a,b` names the capturing host's
+// addresses when the file came from another machine.
+- (void)startReplayFromFile:(NSString *)path {
+    NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+    SNBReplayTiming timing = [[defaults stringForKey:SNBUserDefaultsKeyReplayTiming] isEqualToString:@"original"]
+        ? SNBReplayTimingOriginal
+        : SNBReplayTimingAsFastAsPossible;
+    NSArray<NSString *> *localAddresses = nil;
+    NSString *addressList = [defaults stringForKey:SNBUserDefaultsKeyReplayLocalAddresses];
+    if (addressList.length > 0) {
+        NSCharacterSet *separators = [NSCharacterSet characterSetWithCharactersInString:@", "];
+        localAddresses = [[addressList componentsSeparatedByCharactersInSet:separators]
+                          filteredArrayUsingPredicate:[NSPredicate predicateWithFormat:@"length > 0"]];
+    }
+
+    NSError *error = nil;
+    if (![self.deviceManager.packetManager startReplayFromFile:path
+                                                        timing:timing
+                                                localAddresses:localAddresses
+                                                         error:&error]) {
+        SNBLogWarn("Replay failed to start: %{public}@", error.localizedDescription);
+        self.statusItem.button.title = @"❌";
+    }
+}
+
 - (void)selectDevice:(NetworkDevice *)device {
     NSError *error = nil;
     self.assetMonitor.interfaceName = device.name;
@@ -183,31 +230,38 @@
 }
 
 - (void)updateMenuIfNeeded {
+    // The statistics republish a snapshot every second; reading it does not
+    // queue behind packet accounting
+    TrafficStats *latestStats = self.statistics.latestStats;
+    if (latestStats) {
+        [self updateMenuIfNeededWithStats:latestStats];
+        return;
+    }
+
     __weak typeof(self) weakSelf = self;
     [self.statistics getCurrentStatsWithCompletion:^(TrafficStats *stats) {
-        __strong typeof(weakSelf) strongSelf = weakSelf;
-        if (!strongSelf) {
-            return;
-        }
+        [weakSelf updateMenuIfNeededWithStats:stats];
+    }];
+}
 
-        // Proactively enrich IPs for threat intel (regardless of menu state)
-        [strongSelf enrichStatsForThreatIntel:stats];
+- (void)updateMenuIfNeededWithStats:(TrafficStats *)stats {
+    // Proactively enrich IPs for threat intel (regardless of menu state)
+    [self enrichStatsForThreatIntel:stats];
 
-        [strongSelf syncCaptureStartDateForMenuBuilder];
-        [strongSelf.menuBuilder updateStatusWithStats:stats selectedDevice:strongSelf.deviceManager.selectedDevice];
-        if (strongSelf.menuBuilder.menuIsOpen) {
-            [strongSelf.menuBuilder refreshVisualizationWithStats:stats
-                                             threatIntelEnabled:strongSelf.threatIntelCoordinator.isEnabled
-                                    threatIntelStatusMessage:[strongSelf.threatIntelCoordinator availabilityMessage]
-                                            threatIntelResults:[strongSelf.threatIntelCoordinator resultsSnapshot]
-                                                     cacheStats:[strongSelf.threatIntelCoordinator cacheStats]
-                                           assetMonitorEnabled:strongSelf.assetMonitor.isEnabled
-                                                networkAssets:[strongSelf.assetMonitor assetsSnapshot]
-                                              recentNewAssets:[strongSelf.assetMonitor recentNewAssetsSnapshot]];
-        } else {
-            [strongSelf updateMenuWithStats:stats];
-        }
-    }];
+    [self syncCaptureStateForMenuBuilder];
+    [self.menuBuilder updateStatusWithStats:stats selectedDevice:self.deviceManager.selectedDevice];
+    if (self.menuBuilder.menuIsOpen) {
+        [self.menuBuilder refreshVisualizationWithStats:stats
+                                     threatIntelEnabled:self.threatIntelCoordinator.isEnabled
+                               threatIntelStatusMessage:[self.threatIntelCoordinator availabilityMessage]
+                                     threatIntelResults:[self.threatIntelCoordinator resultsSnapshot]
+                                             cacheStats:[self.threatIntelCoordinator cacheStats]
+                                    assetMonitorEnabled:self.assetMonitor.isEnabled
+                                          networkAssets:[self.assetMonitor assetsSnapshot]
+                                        recentNewAssets:[self.assetMonitor recentNewAssetsSnapshot]];
+    } else {
+        [self updateMenuWithStats:stats];
+    }
 }
 
 - (void)enrichStatsForThreatIntel:(TrafficStats *)stats {
@@ -215,22 +269,20 @@
         return;
     }
 
-    // Get ALL unique destination IPs (not just top connections) for comprehensive threat detection
-    __weak typeof(self) weakSelf = self;
-    [self.statistics getAllDestinationIPsWithCompletion:^(NSSet<NSString *> *destinationIPs) {
-        __strong typeof(weakSelf) strongSelf = weakSelf;
-        if (!strongSelf) {
-            return;
-        }
+    // Enrich ALL unique destination IPs (not just top connections) for comprehensive threat detection
+    // enrichIPIfNeeded skips answered and pending IPs, and the facade queues the
+    // rest behind a bounded window and provider budgets, busiest, most
+    // anomalous and most recently active destinations first
+    NSDictionary<NSString *, NSNumber *> *anomalyScores = [self.anomalyDetector latestScoresByDestination];
 
-        // Enrich every destination IP for threat intelligence
-        // enrichIPIfNeeded uses caching, so this won't overwhelm the API
-        for (NSString *ip in destinationIPs) {
-            [strongSelf.threatIntelCoordinator enrichIPIfNeeded:ip completion:^{
-                [strongSelf scheduleMenuRefresh];
-            }];
-        }
-    }];
+    __weak typeof(self) weakSelf = self;
+    for (NSString *ip in stats.allActiveDestinationIPs) {
+        double priority = [stats lookupPriorityForDestination:ip anomalyScore:anomalyScores[ip].doubleValue];
+        [self.threatIntelCoordinator enrichIPIfNeeded:ip priority:priority completion:^{
+            [weakSelf scheduleMenuRefresh];
+        }];
+    }
+    [self.threatIntelCoordinator cancelEnrichmentsExceptIPs:stats.allActiveDestinationIPs];
 }
 
 - (void)updateMenu {
@@ -245,7 +297,7 @@
 }
 
 - (void)updateMenuWithStats:(TrafficStats *)stats {
-    [self syncCaptureStartDateForMenuBuilder];
+    [self syncCaptureStateForMenuBuilder];
     self.menuBuilder.dailyStatsEnabled = self.statisticsHistory.isEnabled;
     self.menuBuilder.statsReportAvailable = [self.statisticsHistory reportExists];
 
@@ -270,6 +322,20 @@
     }
 }
 
+// Extra interfaces join the running capture; the statistics keep counting
+- (void)additionalDeviceToggled:(NSMenuItem *)sender {
+    NetworkDevice *device = sender.representedObject;
+    if (!device) {
+        return;
+    }
+    BOOL enabled = sender.state != NSControlStateValueOn;
+    NSError *error = nil;
+    if (![self.deviceManager setAdditionalCapture:enabled forDevice:device error:&error] && error) {
+        SNBLogNetworkWarn("Cannot capture on %{public}@: %{public}@", device.name, error.localizedDescription);
+    }
+    [self updateMenu];
+}
+
 - (void)toggleShowTopHosts:(NSMenuItem *)sender {
     self.menuBuilder.showTopHosts = !self.menuBuilder.showTopHosts;
     [self updateMenu];
@@ -317,13 +383,13 @@
 }
 
 - (void)openStatisticsReport:(NSMenuItem *)sender {
-    [self.statisticsHistory generateReport];
-    NSString *path = [self.statisticsHistory reportPath];
-    if ([[NSFileManager defaultManager] fileExistsAtPath:path]) {
-        [[NSWorkspace sharedWorkspace] openFile:path];
-    } else {
-        SNBLogWarn("Statistics report not found at %{public}@", path);
-    }
+    [self.statisticsHistory generateReportWithCompletion:^(NSString *path) {
+        if ([[NSFileManager defaultManager] fileExistsAtPath:path]) {
+            [[NSWorkspace sharedWorkspace] openFile:path];
+        } else {
+            SNBLogWarn("Statistics report not found at %{public}@", path);
+        }
+    }];
 }
 
 - (void)toggleAssetMonitor:(NSMenuItem *)sender {
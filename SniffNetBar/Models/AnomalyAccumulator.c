@@ -0,0 +1,354 @@
+//
+//  AnomalyAccumulator.c
+//  SniffNetBar
+//
+//  Compact per-destination feature state for anomaly windows
+//
+
+#include "AnomalyAccumulator.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Source port sets switch to the bitmap instead of growing past its size
+#define SNB_SOURCE_PORT_SET_MAX (8192 / sizeof(uint16_t))
+#define SNB_SOURCE_PORT_BITMAP_WORDS (65536 / 64)
+
+struct SNBAnomalyArenaChunk {
+    SNBAnomalyArenaChunk *next;
+    size_t size;
+    size_t used;
+    uint64_t bytes[];
+};
+
+// MARK: - Arena
+
+void SNBAnomalyArenaInit(SNBAnomalyArena *arena, size_t chunkSize) {
+    memset(arena, 0, sizeof(*arena));
+    arena->chunkSize = chunkSize;
+}
+
+void SNBAnomalyArenaDestroy(SNBAnomalyArena *arena) {
+    SNBAnomalyArenaChunk *chunk = arena->first;
+    while (chunk) {
+        SNBAnomalyArenaChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    memset(arena, 0, sizeof(*arena));
+}
+
+void SNBAnomalyArenaReset(SNBAnomalyArena *arena) {
+    for (SNBAnomalyArenaChunk *chunk = arena->first; chunk; chunk = chunk->next) {
+        chunk->used = 0;
+    }
+    arena->current = arena->first;
+}
+
+void *SNBAnomalyArenaAllocate(SNBAnomalyArena *arena, size_t size) {
+    size = (size + 7) & ~(size_t)7;
+    SNBAnomalyArenaChunk *chunk = arena->current;
+    // Chunks kept from earlier windows are reused in order before new ones
+    while (chunk && chunk->size - chunk->used < size) {
+        if (!chunk->next || chunk->next->size < size) {
+            chunk = NULL;
+            break;
+        }
+        chunk = chunk->next;
+        arena->current = chunk;
+    }
+    if (!chunk) {
+        size_t chunkSize = size > arena->chunkSize ? size : arena->chunkSize;
+        chunk = malloc(sizeof(SNBAnomalyArenaChunk) + chunkSize);
+        if (!chunk) {
+            return NULL;
+        }
+        chunk->size = chunkSize;
+        chunk->used = 0;
+        if (arena->current) {
+            chunk->next = arena->current->next;
+            arena->current->next = chunk;
+        } else {
+            chunk->next = arena->first;
+            arena->first = chunk;
+        }
+        arena->current = chunk;
+        arena->reservedBytes += chunkSize;
+    }
+
+    void *bytes = (uint8_t *)chunk->bytes + chunk->used;
+    chunk->used += size;
+    memset(bytes, 0, size);
+    return bytes;
+}
+
+// MARK: - Source ports
+
+static inline size_t SNBSourcePortSlot(uint16_t port, uint32_t mask) {
+    return ((uint32_t)port * 2654435761u >> 16) & mask;
+}
+
+// Returns false if the port was already in the set
+static bool SNBSourcePortSetInsert(uint16_t *slots, uint32_t capacity, uint16_t port) {
+    uint32_t mask = capacity - 1;
+    size_t index = SNBSourcePortSlot(port, mask);
+    while (slots[index] != 0) {
+        if (slots[index] == port) {
+            return false;
+        }
+        index = (index + 1) & mask;
+    }
+    slots[index] = port;
+    return true;
+}
+
+static bool SNBSourcePortBitmapInsert(uint64_t *words, uint16_t port) {
+    uint64_t bit = 1ULL << (port & 63);
+    if (words[port >> 6] & bit) {
+        return false;
+    }
+    words[port >> 6] |= bit;
+    return true;
+}
+
+// Moves the ports into a set twice the size, or into the bitmap once the set
+// would be as large as it
+static bool SNBSourcePortsGrow(SNBAnomalyAccumulator *acc, SNBAnomalyArena *arena) {
+    uint32_t capacity = acc->sourcePortCapacity ? acc->sourcePortCapacity * 2 : 16;
+    const uint16_t *old = acc->sourcePortCapacity ? acc->sourcePortSet : acc->sourcePorts;
+    uint32_t oldCapacity = acc->sourcePortCapacity ? acc->sourcePortCapacity : SNB_ANOMALY_INLINE_SOURCE_PORTS;
+
+    if (capacity > SNB_SOURCE_PORT_SET_MAX) {
+        uint64_t *words = SNBAnomalyArenaAllocate(arena, SNB_SOURCE_PORT_BITMAP_WORDS * sizeof(uint64_t));
+        if (!words) {
+            return false;
+        }
+        for (uint32_t i = 0; i < oldCapacity; i++) {
+            if (old[i] != 0) {
+                SNBSourcePortBitmapInsert(words, old[i]);
+            }
+        }
+        acc->sourcePortSet = words;
+        acc->sourcePortCapacity = SNB_ANOMALY_SOURCE_PORT_BITMAP;
+        return true;
+    }
+
+    uint16_t *slots = SNBAnomalyArenaAllocate(arena, capacity * sizeof(uint16_t));
+    if (!slots) {
+        return false;
+    }
+    for (uint32_t i = 0; i < oldCapacity; i++) {
+        if (old[i] != 0) {
+            SNBSourcePortSetInsert(slots, capacity, old[i]);
+        }
+    }
+    acc->sourcePortSet = slots;
+    acc->sourcePortCapacity = capacity;
+    return true;
+}
+
+// Port 0 marks a free slot; callers only pass ports above zero
+static void SNBAnomalyAddSourcePort(SNBAnomalyAccumulator *acc, SNBAnomalyArena *arena, uint16_t port) {
+    if (acc->sourcePortCapacity == SNB_ANOMALY_SOURCE_PORT_BITMAP) {
+        acc->uniqueSrcPorts += SNBSourcePortBitmapInsert(acc->sourcePortSet, port);
+        return;
+    }
+    if (acc->sourcePortCapacity == 0) {
+        for (int i = 0; i < SNB_ANOMALY_INLINE_SOURCE_PORTS; i++) {
+            if (acc->sourcePorts[i] == port) {
+                return;
+            }
+            if (acc->sourcePorts[i] == 0) {
+                acc->sourcePorts[i] = port;
+                acc->uniqueSrcPorts++;
+                return;
+            }
+        }
+    } else {
+        uint16_t *slots = acc->sourcePortSet;
+        uint32_t mask = acc->sourcePortCapacity - 1;
+        size_t index = SNBSourcePortSlot(port, mask);
+        while (slots[index] != 0) {
+            if (slots[index] == port) {
+                return;
+            }
+            index = (index + 1) & mask;
+        }
+        // Keep the load factor at or below 3/4
+        if ((acc->uniqueSrcPorts + 1) * 4 <= acc->sourcePortCapacity * 3) {
+            slots[index] = port;
+            acc->uniqueSrcPorts++;
+            return;
+        }
+    }
+
+    // New port and no room for it
+    if (!SNBSourcePortsGrow(acc, arena)) {
+        return;
+    }
+    bool inserted = acc->sourcePortCapacity == SNB_ANOMALY_SOURCE_PORT_BITMAP
+        ? SNBSourcePortBitmapInsert(acc->sourcePortSet, port)
+        : SNBSourcePortSetInsert(acc->sourcePortSet, acc->sourcePortCapacity, port);
+    acc->uniqueSrcPorts += inserted;
+}
+
+// MARK: - Flows
+
+static inline uint64_t SNBAnomalyMix(uint64_t value) {
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdULL;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53ULL;
+    value ^= value >> 33;
+    return value;
+}
+
+// The destination is implied by the accumulator; the rest of the 5-tuple
+// with the coarse protocol, as the exported features tell flows apart
+static uint64_t SNBAnomalyFlowFingerprint(const SNBPacketRecord *record, int protocolClass) {
+    uint64_t words[2];
+    memcpy(words, record->sourceAddress, sizeof(words));
+    uint64_t tail = (uint64_t)(uint32_t)protocolClass << 40;
+    if (record->flags & SNBPacketRecordFlagHasPorts) {
+        tail |= (1ULL << 32) | ((uint64_t)record->sourcePort << 16) | record->destinationPort;
+    }
+    uint64_t hash = SNBAnomalyMix(0x9e3779b97f4a7c15ULL ^ words[0]);
+    hash = SNBAnomalyMix(hash ^ words[1]);
+    hash = SNBAnomalyMix(hash ^ tail);
+    return hash ? hash : 1;
+}
+
+static SNBAnomalyFlow *SNBFlowSetSlot(SNBAnomalyFlow *slots, uint32_t capacity, uint64_t fingerprint) {
+    uint32_t mask = capacity - 1;
+    size_t index = (size_t)(fingerprint >> 32) & mask;
+    while (slots[index].fingerprint != 0 && slots[index].fingerprint != fingerprint) {
+        index = (index + 1) & mask;
+    }
+    return &slots[index];
+}
+
+static bool SNBFlowsGrow(SNBAnomalyAccumulator *acc, SNBAnomalyArena *arena) {
+    uint32_t capacity = acc->flowCapacity ? acc->flowCapacity * 2 : 8;
+    SNBAnomalyFlow *slots = SNBAnomalyArenaAllocate(arena, capacity * sizeof(SNBAnomalyFlow));
+    if (!slots) {
+        return false;
+    }
+    const SNBAnomalyFlow *old = acc->flowCapacity ? acc->flowSet : acc->flows;
+    uint32_t oldCapacity = acc->flowCapacity ? acc->flowCapacity : SNB_ANOMALY_INLINE_FLOWS;
+    for (uint32_t i = 0; i < oldCapacity; i++) {
+        if (old[i].fingerprint != 0) {
+            *SNBFlowSetSlot(slots, capacity, old[i].fingerprint) = old[i];
+        }
+    }
+    acc->flowSet = slots;
+    acc->flowCapacity = capacity;
+    return true;
+}
+
+// Returns the flow's slot, claiming a free one for a new flow, or NULL if
+// the set could not grow
+static SNBAnomalyFlow *SNBAnomalyFindFlow(SNBAnomalyAccumulator *acc, SNBAnomalyArena *arena, uint64_t fingerprint) {
+    if (acc->flowCapacity == 0) {
+        for (int i = 0; i < SNB_ANOMALY_INLINE_FLOWS; i++) {
+            if (acc->flows[i].fingerprint == fingerprint || acc->flows[i].fingerprint == 0) {
+                return &acc->flows[i];
+            }
+        }
+    } else {
+        SNBAnomalyFlow *slot = SNBFlowSetSlot(acc->flowSet, acc->flowCapacity, fingerprint);
+        if (slot->fingerprint == fingerprint || (acc->flowCount + 1) * 4 <= acc->flowCapacity * 3) {
+            return slot;
+        }
+    }
+    if (!SNBFlowsGrow(acc, arena)) {
+        return NULL;
+    }
+    return SNBFlowSetSlot(acc->flowSet, acc->flowCapacity, fingerprint);
+}
+
+// MARK: - Packets
+
+static void SNBAnomalyCountPort(SNBAnomalyAccumulator *acc, int32_t port) {
+    SNBAnomalyPortCount *smallest = &acc->topPorts[0];
+    for (int i = 0; i < SNB_ANOMALY_TOP_PORTS; i++) {
+        SNBAnomalyPortCount *entry = &acc->topPorts[i];
+        if (entry->count != 0 && entry->port == port) {
+            entry->count++;
+            return;
+        }
+        if (entry->count < smallest->count) {
+            smallest = entry;
+        }
+    }
+    // Space-saving: a new port takes over the smallest count (or a free
+    // slot) and inherits it, so counts only ever overestimate
+    smallest->port = port;
+    smallest->count++;
+}
+
+void SNBAnomalyAccumulatorAddPacket(SNBAnomalyAccumulator *acc,
+                                    SNBAnomalyArena *arena,
+                                    const SNBPacketRecord *record,
+                                    int protocolClass) {
+    if (protocolClass < 0 || protocolClass >= SNB_ANOMALY_PROTOCOL_COUNT) {
+        protocolClass = SNB_ANOMALY_PROTOCOL_COUNT - 1;
+    }
+    bool hasPorts = (record->flags & SNBPacketRecordFlagHasPorts) != 0;
+    double length = (double)record->length;
+
+    acc->totalBytes += record->length;
+    acc->totalPackets++;
+    acc->protoCounts[protocolClass]++;
+    SNBAnomalyCountPort(acc, hasPorts ? (int32_t)record->destinationPort : -1);
+    if (hasPorts && record->sourcePort > 0) {
+        SNBAnomalyAddSourcePort(acc, arena, record->sourcePort);
+    }
+
+    uint64_t fingerprint = SNBAnomalyFlowFingerprint(record, protocolClass);
+    SNBAnomalyFlow *flow = SNBAnomalyFindFlow(acc, arena, fingerprint);
+    if (!flow) {
+        return;
+    }
+    if (flow->fingerprint == 0) {
+        flow->fingerprint = fingerprint;
+        flow->bytes = record->length;
+        acc->flowCount++;
+        double delta = length - acc->flowBytesMean;
+        acc->flowBytesMean += delta / (double)acc->flowCount;
+        acc->flowBytesM2 += delta * (length - acc->flowBytesMean);
+        return;
+    }
+
+    // One existing value x grows by d: with n values and mean m,
+    // M2 += d * (2 * (x - m) + d * (1 - 1/n)) and m += d / n
+    double n = (double)acc->flowCount;
+    double previous = (double)flow->bytes;
+    flow->bytes += record->length;
+    acc->flowBytesM2 += length * (2.0 * (previous - acc->flowBytesMean) + length * (1.0 - 1.0 / n));
+    acc->flowBytesMean += length / n;
+}
+
+void SNBAnomalyAccumulatorSummarize(const SNBAnomalyAccumulator *acc, SNBAnomalyWindowSummary *summary) {
+    memset(summary, 0, sizeof(*summary));
+    summary->totalBytes = acc->totalBytes;
+    summary->totalPackets = acc->totalPackets;
+    summary->uniqueSrcPorts = acc->uniqueSrcPorts;
+    summary->flowCount = acc->flowCount;
+    summary->burstiness = acc->flowCount > 0 ? sqrt(fmax(0.0, acc->flowBytesM2) / (double)acc->flowCount) : 0.0;
+
+    uint32_t bestCount = 0;
+    for (int i = 0; i < SNB_ANOMALY_TOP_PORTS; i++) {
+        if (acc->topPorts[i].count > bestCount) {
+            bestCount = acc->topPorts[i].count;
+            summary->commonPort = acc->topPorts[i].port;
+        }
+    }
+
+    bestCount = 0;
+    for (int protocol = 0; protocol < SNB_ANOMALY_PROTOCOL_COUNT; protocol++) {
+        if (acc->protoCounts[protocol] > bestCount) {
+            bestCount = acc->protoCounts[protocol];
+            summary->protocol = protocol;
+        }
+    }
+}
@@ -0,0 +1,98 @@
+//
+//  AnomalyAccumulator.h
+//  SniffNetBar
+//
+//  Compact per-destination feature state for anomaly windows
+//
+
+#ifndef SNB_ANOMALY_ACCUMULATOR_H
+#define SNB_ANOMALY_ACCUMULATOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "AnomalyFeatureMatrix.h"
+#include "PacketRecord.h"
+
+// Protocol classes counted per destination (PacketProtocol in PacketInfo.h)
+#define SNB_ANOMALY_PROTOCOL_COUNT 5
+#define SNB_ANOMALY_TOP_PORTS 4
+#define SNB_ANOMALY_INLINE_SOURCE_PORTS 4
+#define SNB_ANOMALY_INLINE_FLOWS 2
+// sourcePortCapacity once the ports are kept as a 65536-bit bitmap
+#define SNB_ANOMALY_SOURCE_PORT_BITMAP UINT32_MAX
+
+// Bump allocator for the per-destination sets that outgrow their inline
+// slots. Everything is released at once when the window closes, and the
+// chunks are kept for the next window, so steady-state packets never reach
+// malloc.
+typedef struct SNBAnomalyArenaChunk SNBAnomalyArenaChunk;
+
+typedef struct {
+    SNBAnomalyArenaChunk *first;
+    SNBAnomalyArenaChunk *current;
+    size_t chunkSize;
+    size_t reservedBytes;        // Sum of chunk sizes, for memory accounting
+} SNBAnomalyArena;
+
+void SNBAnomalyArenaInit(SNBAnomalyArena *arena, size_t chunkSize);
+void SNBAnomalyArenaDestroy(SNBAnomalyArena *arena);
+void SNBAnomalyArenaReset(SNBAnomalyArena *arena);
+// 8-byte aligned, zeroed. Returns NULL on allocation failure.
+void *SNBAnomalyArenaAllocate(SNBAnomalyArena *arena, size_t size);
+
+// A flow of the destination: 64-bit fingerprint of source address, ports and
+// protocol class (0 marks a free slot) and its byte total
+typedef struct {
+    uint64_t fingerprint;
+    uint64_t bytes;
+} SNBAnomalyFlow;
+
+typedef struct {
+    int32_t port;                // -1 for packets without ports
+    uint32_t count;
+} SNBAnomalyPortCount;
+
+// Window state of one destination, zeroed on creation, kept inline in the
+// detector's flow table. Small destinations fit entirely in the struct; the
+// source port and flow sets move to the arena when they outgrow it.
+//
+// - Unique source ports are exact: inline slots, then an open-addressing
+//   set, then a bitmap of all ports once the set would be as large.
+// - Flows are keyed by fingerprint; two flows of one destination sharing a
+//   64-bit fingerprint would be merged, which is negligible in practice.
+// - The common destination port is a space-saving top-K, exact up to
+//   SNB_ANOMALY_TOP_PORTS distinct ports and otherwise the port with the
+//   largest guaranteed share.
+// - Mean and M2 of bytes per flow follow every packet (Welford's method,
+//   with the in-place update when an existing flow grows), so closing the
+//   window does not revisit flows.
+typedef struct {
+    uint64_t totalBytes;
+    uint64_t totalPackets;
+    uint32_t uniqueSrcPorts;
+    uint32_t flowCount;
+    uint32_t protoCounts[SNB_ANOMALY_PROTOCOL_COUNT];
+    uint32_t sourcePortCapacity; // 0 while inline
+    uint32_t flowCapacity;       // 0 while inline
+    uint16_t sourcePorts[SNB_ANOMALY_INLINE_SOURCE_PORTS];
+    double flowBytesMean;
+    double flowBytesM2;
+    SNBAnomalyPortCount topPorts[SNB_ANOMALY_TOP_PORTS];
+    void *sourcePortSet;         // uint16_t slots, or uint64_t bitmap words
+    SNBAnomalyFlow *flowSet;
+    SNBAnomalyFlow flows[SNB_ANOMALY_INLINE_FLOWS];
+} SNBAnomalyAccumulator;
+
+// Accounts one packet to its destination's accumulator. protocolClass is
+// the record's PacketProtocol. If the arena cannot grow a set, the packet
+// still counts towards the totals.
+void SNBAnomalyAccumulatorAddPacket(SNBAnomalyAccumulator *acc,
+                                    SNBAnomalyArena *arena,
+                                    const SNBPacketRecord *record,
+                                    int protocolClass);
+
+// The destination's features at window close
+void SNBAnomalyAccumulatorSummarize(const SNBAnomalyAccumulator *acc, SNBAnomalyWindowSummary *summary);
+
+#endif
@@ -13,9 +13,15 @@ NS_ASSUME_NONNULL_BEGIN
 
 - (instancetype)initWithModelPath:(nullable NSString *)modelPath;
 
+@property (nonatomic, assign, readonly, getter=isAvailable) BOOL available;
+
 - (nullable NSNumber *)scoreFeaturePayload:(NSDictionary<NSString *, NSNumber *> *)payload
                                      error:(NSError **)error;
 
+// Scores a whole window with one batch prediction
+- (nullable NSArray<NSNumber *> *)scoreFeaturePayloads:(NSArray<NSDictionary<NSString *, NSNumber *> *> *)payloads
+                                                 error:(NSError **)error;
+
 @end
 
 NS_ASSUME_NONNULL_END
@@ -26,32 +26,50 @@
     return self;
 }
 
+- (BOOL)isAvailable {
+    return self.model != nil;
+}
+
 - (NSNumber *)scoreFeaturePayload:(NSDictionary<NSString *, NSNumber *> *)payload
                             error:(NSError **)error {
+    return [self scoreFeaturePayloads:@[payload] error:error].firstObject;
+}
+
+- (NSArray<NSNumber *> *)scoreFeaturePayloads:(NSArray<NSDictionary<NSString *, NSNumber *> *> *)payloads
+                                        error:(NSError **)error {
     if (!self.model) {
         return nil;
     }
-    NSMutableDictionary<NSString *, MLFeatureValue *> *features = [NSMutableDictionary dictionary];
-    [payload enumerateKeysAndObjectsUsingBlock:^(NSString *key, NSNumber *value, BOOL *stop) {
-        features[key] = [MLFeatureValue featureValueWithDouble:value.doubleValue];
-    }];
-
-    MLDictionaryFeatureProvider *provider =
-        [[MLDictionaryFeatureProvider alloc] initWithDictionary:features error:error];
-    if (!provider) {
-        return nil;
+    NSMutableArray<id<MLFeatureProvider>> *providers = [NSMutableArray arrayWithCapacity:payloads.count];
+    for (NSDictionary<NSString *, NSNumber *> *payload in payloads) {
+        NSMutableDictionary<NSString *, MLFeatureValue *> *features = [NSMutableDictionary dictionary];
+        [payload enumerateKeysAndObjectsUsingBlock:^(NSString *key, NSNumber *value, BOOL *stop) {
+            features[key] = [MLFeatureValue featureValueWithDouble:value.doubleValue];
+        }];
+
+        MLDictionaryFeatureProvider *provider =
+            [[MLDictionaryFeatureProvider alloc] initWithDictionary:features error:error];
+        if (!provider) {
+            return nil;
+        }
+        [providers addObject:provider];
     }
 
-    id<MLFeatureProvider> output = [self.model predictionFromFeatures:provider error:error];
-    if (!output) {
+    MLArrayBatchProvider *batch = [[MLArrayBatchProvider alloc] initWithFeatureProviderArray:providers];
+    id<MLBatchProvider> outputs = [self.model predictionsFromBatch:batch error:error];
+    if (!outputs || outputs.count != (NSInteger)payloads.count) {
         return nil;
     }
 
-    MLFeatureValue *scoreValue = [output featureValueForName:@"score"];
-    if (!scoreValue || scoreValue.type != MLFeatureTypeDouble) {
-        return nil;
+    NSMutableArray<NSNumber *> *scores = [NSMutableArray arrayWithCapacity:payloads.count];
+    for (NSInteger i = 0; i < outputs.count; i++) {
+        MLFeatureValue *scoreValue = [[outputs featuresAtIndex:i] featureValueForName:@"score"];
+        if (!scoreValue || scoreValue.type != MLFeatureTypeDouble) {
+            return nil;
+        }
+        [scores addObject:@(scoreValue.doubleValue)];
     }
-    return @(scoreValue.doubleValue);
+    return scores;
 }
 
 @end
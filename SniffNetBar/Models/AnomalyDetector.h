@@ -7,7 +7,7 @@
 
 #import <Foundation/Foundation.h>
 
-@class PacketInfo;
+@class SNBPacketBatch;
 
 NS_ASSUME_NONNULL_BEGIN
 
@@ -15,9 +15,12 @@ NS_ASSUME_NONNULL_BEGIN
 
 - (instancetype)initWithWindowSeconds:(NSTimeInterval)windowSeconds;
 
-- (void)processPacket:(PacketInfo *)packetInfo;
+// Records must already carry direction flags (see PacketDirection.h)
+- (void)processPacketBatch:(SNBPacketBatch *)batch;
 - (void)flushIfNeeded;
 - (void)reloadModels;
+// Highest score per destination IP in the last closed window. Thread-safe.
+- (NSDictionary<NSString *, NSNumber *> *)latestScoresByDestination;
 
 @end
 
@@ -8,50 +8,44 @@
 #import "AnomalyDetector.h"
 #import "AnomalyPythonScorer.h"
 #import "AnomalyCoreMLScorer.h"
+#import "AnomalyForestScorer.h"
 #import "AnomalyStore.h"
-#import "IPAddressUtilities.h"
+#import "AnomalyAccumulator.h"
+#import "AnomalyFeatureMatrix.h"
+#import "Logger.h"
 #import "PacketInfo.h"
+#import "PacketBatch.h"
+#import "FlowTable.h"
+#import "PacketClock.h"
+#import "PacketDirection.h"
 #import <math.h>
 
-@interface SNBAnomalyFlowStats : NSObject
-@property (nonatomic, assign) uint64_t bytes;
-@property (nonatomic, assign) uint64_t packets;
-@end
-
-@implementation SNBAnomalyFlowStats
-@end
-
-@interface SNBAnomalyAccumulator : NSObject
-@property (nonatomic, assign) uint64_t totalBytes;
-@property (nonatomic, assign) uint64_t totalPackets;
-@property (nonatomic, strong) NSMutableSet<NSNumber *> *uniqueSrcPorts;
-@property (nonatomic, strong) NSMutableDictionary<NSString *, SNBAnomalyFlowStats *> *flows;
-@property (nonatomic, strong) NSMutableDictionary<NSNumber *, NSNumber *> *portCounts;
-@property (nonatomic, strong) NSMutableDictionary<NSNumber *, NSNumber *> *protoCounts;
-@end
-
-@implementation SNBAnomalyAccumulator
-- (instancetype)init {
-    self = [super init];
-    if (self) {
-        _uniqueSrcPorts = [NSMutableSet set];
-        _flows = [NSMutableDictionary dictionary];
-        _portCounts = [NSMutableDictionary dictionary];
-        _protoCounts = [NSMutableDictionary dictionary];
-    }
-    return self;
+_Static_assert((int)PacketProtocolTCP == SNBAnomalyProtocolTCP &&
+               (int)PacketProtocolUDP == SNBAnomalyProtocolUDP &&
+               (int)PacketProtocolICMP == SNBAnomalyProtocolICMP,
+               "Anomaly protocol classes must follow PacketProtocol");
+_Static_assert(PacketProtocolUnknown + 1 == SNB_ANOMALY_PROTOCOL_COUNT,
+               "Accumulators count every PacketProtocol");
+
+@interface SNBAnomalyDetector () {
+    // Capture time the windows run on; owned by workQueue
+    SNBPacketClock _packetClock;
+    // Features of the closing window, reused by every flush
+    SNBAnomalyFeatureMatrix _window;
+    // Source port and flow sets of busy destinations, released per window
+    SNBAnomalyArena _arena;
 }
-@end
-
-@interface SNBAnomalyDetector ()
-@property (nonatomic, strong) NSMutableDictionary<NSString *, SNBAnomalyAccumulator *> *accumulators;
+@property (nonatomic, assign) SNBFlowTable *accumulators;
 @property (nonatomic, assign) NSTimeInterval windowSeconds;
+// Aligned to windowSeconds; zero until the first packet
 @property (nonatomic, assign) NSTimeInterval currentWindowStart;
 @property (nonatomic, assign) NSInteger rareThreshold;
 @property (nonatomic, strong) SNBAnomalyStore *store;
 @property (nonatomic, strong) SNBAnomalyPythonScorer *scorer;
 @property (nonatomic, strong) SNBAnomalyCoreMLScorer *coreMLScorer;
+@property (nonatomic, strong) SNBAnomalyForestScorer *forestScorer;
 @property (nonatomic, strong) dispatch_queue_t workQueue;
+@property (atomic, copy) NSDictionary<NSString *, NSNumber *> *latestScores;
 @end
 
 @implementation SNBAnomalyDetector
@@ -60,67 +54,68 @@
     self = [super init];
     if (self) {
         _windowSeconds = windowSeconds;
-        _currentWindowStart = floor([[NSDate date] timeIntervalSince1970] / windowSeconds) * windowSeconds;
-        _accumulators = [NSMutableDictionary dictionary];
+        _accumulators = SNBFlowTableCreate(sizeof(SNBAnomalyAccumulator), 256);
+        SNBAnomalyArenaInit(&_arena, 64 * 1024);
+        SNBAnomalyFeatureMatrixInit(&_window, 256);
         _rareThreshold = 3;
         _store = [[SNBAnomalyStore alloc] init];
-        NSString *coreMLPath = [SNBAnomalyStore defaultCoreMLModelPath];
-        _coreMLScorer = [[SNBAnomalyCoreMLScorer alloc] initWithModelPath:coreMLPath];
-
-        NSString *scriptPath = [[NSBundle mainBundle] pathForResource:@"anomaly_score" ofType:@"py"];
-        NSString *modelPath = [SNBAnomalyStore defaultModelPath];
-        _scorer = [[SNBAnomalyPythonScorer alloc] initWithScriptPath:scriptPath modelPath:modelPath];
+        [self loadModels];
         _workQueue = dispatch_queue_create("com.sniffnetbar.anomaly", DISPATCH_QUEUE_SERIAL);
+        _latestScores = @{};
     }
     return self;
 }
 
-- (void)processPacket:(PacketInfo *)packetInfo {
-    if (!packetInfo.destinationAddress.length) {
-        return;
-    }
-    if ([IPAddressUtilities isPrivateIPAddress:packetInfo.destinationAddress]) {
+- (NSDictionary<NSString *, NSNumber *> *)latestScoresByDestination {
+    return self.latestScores;
+}
+
+- (void)dealloc {
+    SNBFlowTableDestroy(_accumulators);
+    SNBAnomalyArenaDestroy(&_arena);
+    SNBAnomalyFeatureMatrixDestroy(&_window);
+}
+
+- (void)processPacketBatch:(SNBPacketBatch *)batch {
+    if (batch.count == 0) {
         return;
     }
 
     dispatch_async(self.workQueue, ^{
-        [self flushIfNeededLocked];
-        SNBAnomalyAccumulator *acc = self.accumulators[packetInfo.destinationAddress];
-        if (!acc) {
-            acc = [[SNBAnomalyAccumulator alloc] init];
-            self.accumulators[packetInfo.destinationAddress] = acc;
-        }
-
-        acc.totalBytes += packetInfo.totalBytes;
-        acc.totalPackets += 1;
+        [self processRecordsLocked:batch.records count:batch.count];
+    });
+}
 
-        if (packetInfo.sourcePort > 0) {
-            [acc.uniqueSrcPorts addObject:@(packetInfo.sourcePort)];
+// Runs once per packet; only new destinations can grow the table, and busy
+// destinations draw their sets from the arena, which keeps its chunks.
+// Windows close on the first packet captured after their end, so a replayed
+// capture produces the same windows as the live one.
+- (void)processRecordsLocked:(const SNBPacketRecord *)records count:(NSUInteger)count {
+    NSTimeInterval windowEnd = self.currentWindowStart > 0 ? self.currentWindowStart + self.windowSeconds : -INFINITY;
+    for (NSUInteger i = 0; i < count; i++) {
+        const SNBPacketRecord *record = &records[i];
+        NSTimeInterval timestamp = SNBPacketRecordTime(record);
+        if (timestamp >= windowEnd) {
+            [self advanceWindowToTimestampLocked:timestamp];
+            windowEnd = self.currentWindowStart + self.windowSeconds;
         }
-
-        NSString *flowKey = [NSString stringWithFormat:@"%@:%ld->%@:%ld/%ld",
-                             packetInfo.sourceAddress ?: @"",
-                             (long)packetInfo.sourcePort,
-                             packetInfo.destinationAddress,
-                             (long)packetInfo.destinationPort,
-                             (long)packetInfo.protocol];
-
-        SNBAnomalyFlowStats *flow = acc.flows[flowKey];
-        if (!flow) {
-            flow = [[SNBAnomalyFlowStats alloc] init];
-            acc.flows[flowKey] = flow;
+        if (record->family == SNBAddressFamilyNone) {
+            continue;
+        }
+        if (SNBAddressIsPrivate(record->family, record->destinationAddress)) {
+            continue;
         }
-        flow.bytes += packetInfo.totalBytes;
-        flow.packets += 1;
 
-        NSNumber *portKey = @(packetInfo.destinationPort);
-        NSNumber *portCount = acc.portCounts[portKey] ?: @0;
-        acc.portCounts[portKey] = @(portCount.integerValue + 1);
+        SNBFlowKey key;
+        SNBFlowKeyMakeAddress(&key, record->family, record->destinationAddress);
+        SNBAnomalyAccumulator *acc = SNBFlowTableUpsert(self.accumulators, &key, NULL);
+        if (!acc) {
+            continue;
+        }
 
-        NSNumber *protoKey = @(packetInfo.protocol);
-        NSNumber *protoCount = acc.protoCounts[protoKey] ?: @0;
-        acc.protoCounts[protoKey] = @(protoCount.integerValue + 1);
-    });
+        SNBAnomalyAccumulatorAddPacket(acc, &_arena, record, SNBPacketProtocolFromIPProtocol(record->ipProtocol));
+    }
+    SNBPacketClockAdvance(&_packetClock, records, count, SNBWallClockNs());
 }
 
 - (void)flushIfNeeded {
@@ -131,73 +126,86 @@
 
 - (void)reloadModels {
     dispatch_async(self.workQueue, ^{
-        NSString *coreMLPath = [SNBAnomalyStore defaultCoreMLModelPath];
-        self.coreMLScorer = [[SNBAnomalyCoreMLScorer alloc] initWithModelPath:coreMLPath];
+        [self loadModels];
+    });
+}
 
+- (void)loadModels {
+    NSString *coreMLPath = [SNBAnomalyStore defaultCoreMLModelPath];
+    self.coreMLScorer = [[SNBAnomalyCoreMLScorer alloc] initWithModelPath:coreMLPath];
+    self.forestScorer = [[SNBAnomalyForestScorer alloc] initWithModelPath:[SNBAnomalyStore defaultNativeModelPath]];
+
+    // Python is only the fallback for a bundle trained before the native export
+    self.scorer = nil;
+    if (!self.forestScorer.isAvailable) {
         NSString *scriptPath = [[NSBundle mainBundle] pathForResource:@"anomaly_score" ofType:@"py"];
         NSString *modelPath = [SNBAnomalyStore defaultModelPath];
         self.scorer = [[SNBAnomalyPythonScorer alloc] initWithScriptPath:scriptPath modelPath:modelPath];
-    });
+    }
 }
 
+// Closes the open window once capture time has moved past it, also when no
+// packets arrive to do it. Nothing is open before the first packet.
 - (void)flushIfNeededLocked {
-    NSTimeInterval now = [[NSDate date] timeIntervalSince1970];
-    if (now < self.currentWindowStart + self.windowSeconds) {
-        return;
+    if (self.currentWindowStart > 0) {
+        [self advanceWindowToTimestampLocked:SNBPacketClockNow(&_packetClock)];
     }
+}
 
+- (void)advanceWindowToTimestampLocked:(NSTimeInterval)timestamp {
     NSTimeInterval windowStart = self.currentWindowStart;
-    self.currentWindowStart = floor(now / self.windowSeconds) * self.windowSeconds;
-
-    NSDictionary<NSString *, SNBAnomalyAccumulator *> *snapshot = [self.accumulators copy];
-    [self.accumulators removeAllObjects];
+    if (windowStart > 0 && timestamp < windowStart + self.windowSeconds) {
+        return;
+    }
+    self.currentWindowStart = floor(timestamp / self.windowSeconds) * self.windowSeconds;
+    if (windowStart > 0) {
+        [self flushWindowLockedWithStart:windowStart];
+    }
+}
 
-    for (NSString *dstIP in snapshot) {
-        SNBAnomalyAccumulator *acc = snapshot[dstIP];
-        if (!acc || acc.totalPackets == 0) {
+// Scores the window in three passes over a columnar matrix: derive every
+// destination's features, score all rows with one scorer call, then resolve
+// seen counts with one store query before recording.
+- (void)flushWindowLockedWithStart:(NSTimeInterval)windowStart {
+    SNBAnomalyFeatureMatrix *window = &_window;
+    SNBAnomalyFeatureMatrixClear(window);
+    SNBAnomalyFeatureMatrixReserve(window, SNBFlowTableCount(self.accumulators));
+    size_t cursor = 0;
+    const SNBFlowKey *key = NULL;
+    const SNBAnomalyAccumulator *acc;
+    while ((acc = SNBFlowTableNext(self.accumulators, &cursor, &key)) != NULL) {
+        if (acc->totalPackets == 0) {
             continue;
         }
+        SNBAnomalyWindowSummary summary;
+        SNBAnomalyAccumulatorSummarize(acc, &summary);
+        if (!SNBAnomalyFeatureMatrixAppend(window, key, &summary)) {
+            break;
+        }
+    }
+
+    [self scoreWindowLocked:window];
+
+    NSMutableArray<NSString *> *dstIPs = [NSMutableArray arrayWithCapacity:window->rowCount];
+    for (size_t row = 0; row < window->rowCount; row++) {
+        NSString *dstIP = SNBStringFromPacketAddress(window->keys[row].family, window->keys[row].destinationAddress);
+        [dstIPs addObject:dstIP ?: @""];
+    }
+    NSDictionary<NSString *, NSNumber *> *seenCounts = [self.store seenCountsForIPs:dstIPs];
 
-        NSInteger dstPort = [self mostCommonKeyInCounts:acc.portCounts defaultValue:0];
-        NSInteger proto = [self mostCommonKeyInCounts:acc.protoCounts defaultValue:0];
-
-        double flowCount = (double)acc.flows.count;
-        double avgPktSize = (double)acc.totalBytes / MAX(1.0, (double)acc.totalPackets);
-        double bytesPerFlow = (double)acc.totalBytes / MAX(1.0, flowCount);
-        double pktsPerFlow = (double)acc.totalPackets / MAX(1.0, flowCount);
-        double burstiness = [self burstinessForFlows:acc.flows];
-
-        NSInteger seenCount = [self.store seenCountForIP:dstIP];
-        BOOL isNew = (seenCount == 0);
-        BOOL isRare = (!isNew && seenCount < self.rareThreshold);
-
-        NSDictionary<NSString *, NSNumber *> *payload = @{
-            @"total_bytes": @(acc.totalBytes),
-            @"total_packets": @(acc.totalPackets),
-            @"unique_src_ports": @(acc.uniqueSrcPorts.count),
-            @"flow_count": @(flowCount),
-            @"avg_pkt_size": @(avgPktSize),
-            @"bytes_per_flow": @(bytesPerFlow),
-            @"pkts_per_flow": @(pktsPerFlow),
-            @"burstiness": @(burstiness),
-            @"port_well_known": @((dstPort >= 1 && dstPort <= 1023) ? 1 : 0),
-            @"port_registered": @((dstPort >= 1024 && dstPort <= 49151) ? 1 : 0),
-            @"port_dynamic": @((dstPort >= 49152 && dstPort <= 65535) ? 1 : 0),
-            @"proto_tcp": @(proto == PacketProtocolTCP ? 1 : 0),
-            @"proto_udp": @(proto == PacketProtocolUDP ? 1 : 0),
-            @"proto_icmp": @(proto == PacketProtocolICMP ? 1 : 0),
-            @"proto_other": @((proto != PacketProtocolTCP &&
-                              proto != PacketProtocolUDP &&
-                              proto != PacketProtocolICMP) ? 1 : 0)
-        };
-
-        NSError *scoreError = nil;
-        NSNumber *scoreNumber = [self.coreMLScorer scoreFeaturePayload:payload error:&scoreError];
-        if (!scoreNumber) {
-            scoreNumber = [self.scorer scoreFeaturePayload:payload error:&scoreError];
+    double *const *columns = window->columns;
+    NSMutableDictionary<NSString *, NSNumber *> *latestScores = [NSMutableDictionary dictionaryWithCapacity:window->rowCount];
+    for (size_t row = 0; row < window->rowCount; row++) {
+        NSString *dstIP = dstIPs[row];
+        if (dstIP.length == 0) {
+            continue;
         }
-        BOOL scoringAvailable = (scoreNumber != nil);
-        double score = scoringAvailable ? scoreNumber.doubleValue : 0.0;
+        window->seenCounts[row] = seenCounts[dstIP].longLongValue;
+        BOOL isNew = (window->seenCounts[row] == 0);
+        BOOL isRare = (!isNew && window->seenCounts[row] < self.rareThreshold);
+
+        BOOL scoringAvailable = !isnan(window->scores[row]);
+        double score = scoringAvailable ? window->scores[row] : 0.0;
 
         if (scoringAvailable) {
             if (isNew) {
@@ -209,53 +217,85 @@
 
         [self.store recordWindowForIP:dstIP
                           windowStart:windowStart
-                              dstPort:dstPort
-                                proto:proto
-                           totalBytes:(double)acc.totalBytes
-                         totalPackets:(double)acc.totalPackets
-                      uniqueSrcPorts:(double)acc.uniqueSrcPorts.count
-                            flowCount:flowCount
-                         avgPktSize:avgPktSize
-                      bytesPerFlow:bytesPerFlow
-                        pktsPerFlow:pktsPerFlow
-                          burstiness:burstiness
+                              dstPort:window->dstPorts[row]
+                                proto:window->protocols[row]
+                           totalBytes:columns[SNBAnomalyFeatureTotalBytes][row]
+                         totalPackets:columns[SNBAnomalyFeatureTotalPackets][row]
+                      uniqueSrcPorts:columns[SNBAnomalyFeatureUniqueSrcPorts][row]
+                            flowCount:columns[SNBAnomalyFeatureFlowCount][row]
+                         avgPktSize:columns[SNBAnomalyFeatureAvgPktSize][row]
+                      bytesPerFlow:columns[SNBAnomalyFeatureBytesPerFlow][row]
+                        pktsPerFlow:columns[SNBAnomalyFeaturePktsPerFlow][row]
+                          burstiness:columns[SNBAnomalyFeatureBurstiness][row]
                              isNewDst:isNew
                             isRareDst:isRare
                                score:score];
+        if (score > latestScores[dstIP].doubleValue) {
+            latestScores[dstIP] = @(score);
+        }
     }
+    self.latestScores = latestScores;
+
+    // Keep the allocations for the next window
+    SNBFlowTableClear(self.accumulators);
+    SNBAnomalyArenaReset(&_arena);
 }
 
-- (NSInteger)mostCommonKeyInCounts:(NSDictionary<NSNumber *, NSNumber *> *)counts
-                      defaultValue:(NSInteger)defaultValue {
-    NSInteger bestKey = defaultValue;
-    NSInteger bestCount = -1;
-    for (NSNumber *key in counts) {
-        NSInteger count = counts[key].integerValue;
-        if (count > bestCount) {
-            bestCount = count;
-            bestKey = key.integerValue;
+// One call to the active scorer for the whole window: Core ML when a
+// converted model exists, then the native forest, which reads the matrix
+// columns directly, and the Python script only when no native model exists.
+// Rows stay NaN when nothing could score them.
+- (void)scoreWindowLocked:(SNBAnomalyFeatureMatrix *)window {
+    if (window->rowCount == 0) {
+        return;
+    }
+
+    NSError *error = nil;
+    if (self.coreMLScorer.isAvailable) {
+        NSArray<NSNumber *> *scores = [self.coreMLScorer scoreFeaturePayloads:[self payloadsForWindow:window]
+                                                                        error:&error];
+        if (scores) {
+            [self applyScores:scores toWindow:window];
+            return;
         }
+        SNBLogWarn("Core ML anomaly scoring failed: %{public}@", error.localizedDescription);
+    }
+
+    if (self.forestScorer.isAvailable) {
+        if (![self.forestScorer scoreFeatureMatrix:window error:&error]) {
+            SNBLogWarn("Native anomaly scoring failed: %{public}@", error.localizedDescription);
+        }
+        return;
+    }
+
+    NSArray<NSNumber *> *scores = [self.scorer scoreFeaturePayloads:[self payloadsForWindow:window] error:nil];
+    if (scores) {
+        [self applyScores:scores toWindow:window];
     }
-    return bestKey;
 }
 
-- (double)burstinessForFlows:(NSDictionary<NSString *, SNBAnomalyFlowStats *> *)flows {
-    NSUInteger n = flows.count;
-    if (n == 0) {
-        return 0.0;
+// Rows as the payload dictionaries the Core ML and Python scorers take
+- (NSArray<NSDictionary<NSString *, NSNumber *> *> *)payloadsForWindow:(const SNBAnomalyFeatureMatrix *)window {
+    NSMutableArray<NSString *> *names = [NSMutableArray arrayWithCapacity:SNBAnomalyFeatureCount];
+    for (int feature = 0; feature < SNBAnomalyFeatureCount; feature++) {
+        [names addObject:@(SNBAnomalyFeatureName(feature))];
     }
-    double mean = 0.0;
-    for (SNBAnomalyFlowStats *flow in flows.allValues) {
-        mean += (double)flow.bytes;
+
+    NSMutableArray<NSDictionary<NSString *, NSNumber *> *> *payloads = [NSMutableArray arrayWithCapacity:window->rowCount];
+    for (size_t row = 0; row < window->rowCount; row++) {
+        NSMutableDictionary<NSString *, NSNumber *> *payload = [NSMutableDictionary dictionaryWithCapacity:SNBAnomalyFeatureCount];
+        for (int feature = 0; feature < SNBAnomalyFeatureCount; feature++) {
+            payload[names[feature]] = @(window->columns[feature][row]);
+        }
+        [payloads addObject:payload];
     }
-    mean /= (double)n;
-    double variance = 0.0;
-    for (SNBAnomalyFlowStats *flow in flows.allValues) {
-        double diff = (double)flow.bytes - mean;
-        variance += diff * diff;
+    return payloads;
+}
+
+- (void)applyScores:(NSArray<NSNumber *> *)scores toWindow:(SNBAnomalyFeatureMatrix *)window {
+    for (size_t row = 0; row < window->rowCount && row < scores.count; row++) {
+        window->scores[row] = scores[row].doubleValue;
     }
-    variance /= (double)n;
-    return sqrt(variance);
 }
 
 @end
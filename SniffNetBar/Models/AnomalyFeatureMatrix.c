@@ -0,0 +1,140 @@
+//
+//  AnomalyFeatureMatrix.c
+//  SniffNetBar
+//
+//  Columnar per-window feature matrix for batch anomaly scoring
+//
+
+#include "AnomalyFeatureMatrix.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *const kSNBAnomalyFeatureNames[SNBAnomalyFeatureCount] = {
+    "total_bytes",
+    "total_packets",
+    "unique_src_ports",
+    "flow_count",
+    "avg_pkt_size",
+    "bytes_per_flow",
+    "pkts_per_flow",
+    "burstiness",
+    "port_well_known",
+    "port_registered",
+    "port_dynamic",
+    "proto_tcp",
+    "proto_udp",
+    "proto_icmp",
+    "proto_other",
+};
+
+const char *SNBAnomalyFeatureName(SNBAnomalyFeature feature) {
+    return (feature >= 0 && feature < SNBAnomalyFeatureCount) ? kSNBAnomalyFeatureNames[feature] : "";
+}
+
+int SNBAnomalyFeatureFromName(const char *name) {
+    for (int feature = 0; feature < SNBAnomalyFeatureCount; feature++) {
+        if (strcmp(kSNBAnomalyFeatureNames[feature], name) == 0) {
+            return feature;
+        }
+    }
+    return -1;
+}
+
+// MARK: - Storage
+
+bool SNBAnomalyFeatureMatrixInit(SNBAnomalyFeatureMatrix *matrix, size_t capacity) {
+    memset(matrix, 0, sizeof(*matrix));
+    return SNBAnomalyFeatureMatrixReserve(matrix, capacity ? capacity : 1);
+}
+
+void SNBAnomalyFeatureMatrixDestroy(SNBAnomalyFeatureMatrix *matrix) {
+    for (int feature = 0; feature < SNBAnomalyFeatureCount; feature++) {
+        free(matrix->columns[feature]);
+    }
+    free(matrix->keys);
+    free(matrix->dstPorts);
+    free(matrix->protocols);
+    free(matrix->scores);
+    free(matrix->seenCounts);
+    memset(matrix, 0, sizeof(*matrix));
+}
+
+void SNBAnomalyFeatureMatrixClear(SNBAnomalyFeatureMatrix *matrix) {
+    matrix->rowCount = 0;
+}
+
+static bool SNBGrowArray(void **array, size_t capacity, size_t elementSize) {
+    void *grown = realloc(*array, capacity * elementSize);
+    if (!grown) {
+        return false;
+    }
+    *array = grown;
+    return true;
+}
+
+// Arrays that grew before a failure keep their larger size; capacity only
+// moves once all of them have it
+bool SNBAnomalyFeatureMatrixReserve(SNBAnomalyFeatureMatrix *matrix, size_t capacity) {
+    if (capacity <= matrix->capacity) {
+        return true;
+    }
+    for (int feature = 0; feature < SNBAnomalyFeatureCount; feature++) {
+        if (!SNBGrowArray((void **)&matrix->columns[feature], capacity, sizeof(double))) {
+            return false;
+        }
+    }
+    if (!SNBGrowArray((void **)&matrix->keys, capacity, sizeof(SNBFlowKey)) ||
+        !SNBGrowArray((void **)&matrix->dstPorts, capacity, sizeof(int32_t)) ||
+        !SNBGrowArray((void **)&matrix->protocols, capacity, sizeof(int32_t)) ||
+        !SNBGrowArray((void **)&matrix->scores, capacity, sizeof(double)) ||
+        !SNBGrowArray((void **)&matrix->seenCounts, capacity, sizeof(int64_t))) {
+        return false;
+    }
+    matrix->capacity = capacity;
+    return true;
+}
+
+// MARK: - Rows
+
+bool SNBAnomalyFeatureMatrixAppend(SNBAnomalyFeatureMatrix *matrix,
+                                   const SNBFlowKey *key,
+                                   const SNBAnomalyWindowSummary *summary) {
+    if (matrix->rowCount == matrix->capacity &&
+        !SNBAnomalyFeatureMatrixReserve(matrix, matrix->capacity * 2)) {
+        return false;
+    }
+    size_t row = matrix->rowCount++;
+    double **columns = matrix->columns;
+
+    double totalBytes = (double)summary->totalBytes;
+    double totalPackets = (double)summary->totalPackets;
+    double flowCount = (double)summary->flowCount;
+    int32_t port = summary->commonPort;
+    int32_t protocol = summary->protocol;
+
+    columns[SNBAnomalyFeatureTotalBytes][row] = totalBytes;
+    columns[SNBAnomalyFeatureTotalPackets][row] = totalPackets;
+    columns[SNBAnomalyFeatureUniqueSrcPorts][row] = (double)summary->uniqueSrcPorts;
+    columns[SNBAnomalyFeatureFlowCount][row] = flowCount;
+    columns[SNBAnomalyFeatureAvgPktSize][row] = totalBytes / fmax(1.0, totalPackets);
+    columns[SNBAnomalyFeatureBytesPerFlow][row] = totalBytes / fmax(1.0, flowCount);
+    columns[SNBAnomalyFeaturePktsPerFlow][row] = totalPackets / fmax(1.0, flowCount);
+    columns[SNBAnomalyFeatureBurstiness][row] = summary->burstiness;
+    columns[SNBAnomalyFeaturePortWellKnown][row] = (port >= 1 && port <= 1023) ? 1.0 : 0.0;
+    columns[SNBAnomalyFeaturePortRegistered][row] = (port >= 1024 && port <= 49151) ? 1.0 : 0.0;
+    columns[SNBAnomalyFeaturePortDynamic][row] = (port >= 49152 && port <= 65535) ? 1.0 : 0.0;
+    columns[SNBAnomalyFeatureProtoTCP][row] = protocol == SNBAnomalyProtocolTCP ? 1.0 : 0.0;
+    columns[SNBAnomalyFeatureProtoUDP][row] = protocol == SNBAnomalyProtocolUDP ? 1.0 : 0.0;
+    columns[SNBAnomalyFeatureProtoICMP][row] = protocol == SNBAnomalyProtocolICMP ? 1.0 : 0.0;
+    columns[SNBAnomalyFeatureProtoOther][row] = (protocol != SNBAnomalyProtocolTCP &&
+                                                 protocol != SNBAnomalyProtocolUDP &&
+                                                 protocol != SNBAnomalyProtocolICMP) ? 1.0 : 0.0;
+
+    matrix->keys[row] = *key;
+    matrix->dstPorts[row] = port;
+    matrix->protocols[row] = protocol;
+    matrix->scores[row] = NAN;
+    matrix->seenCounts[row] = 0;
+    return true;
+}
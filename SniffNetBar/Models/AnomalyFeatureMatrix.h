@@ -0,0 +1,85 @@
+//
+//  AnomalyFeatureMatrix.h
+//  SniffNetBar
+//
+//  Columnar per-window feature matrix for batch anomaly scoring
+//
+
+#ifndef SNB_ANOMALY_FEATURE_MATRIX_H
+#define SNB_ANOMALY_FEATURE_MATRIX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "FlowTable.h"
+
+// The features exported for every destination of a window, in the order of
+// anomaly_train.py's cont_cols then extra_cols. Names match the payload keys
+// the scorers and the anomaly_windows columns use.
+typedef enum {
+    SNBAnomalyFeatureTotalBytes = 0,
+    SNBAnomalyFeatureTotalPackets,
+    SNBAnomalyFeatureUniqueSrcPorts,
+    SNBAnomalyFeatureFlowCount,
+    SNBAnomalyFeatureAvgPktSize,
+    SNBAnomalyFeatureBytesPerFlow,
+    SNBAnomalyFeaturePktsPerFlow,
+    SNBAnomalyFeatureBurstiness,
+    SNBAnomalyFeaturePortWellKnown,
+    SNBAnomalyFeaturePortRegistered,
+    SNBAnomalyFeaturePortDynamic,
+    SNBAnomalyFeatureProtoTCP,
+    SNBAnomalyFeatureProtoUDP,
+    SNBAnomalyFeatureProtoICMP,
+    SNBAnomalyFeatureProtoOther,
+    SNBAnomalyFeatureCount
+} SNBAnomalyFeature;
+
+// Coarse protocol classes, numbered like PacketProtocol in PacketInfo.h
+enum {
+    SNBAnomalyProtocolTCP = 0,
+    SNBAnomalyProtocolUDP = 1,
+    SNBAnomalyProtocolICMP = 2,
+};
+
+const char *SNBAnomalyFeatureName(SNBAnomalyFeature feature);
+// Returns -1 for a name that is not a known feature
+int SNBAnomalyFeatureFromName(const char *name);
+
+// What a window knows about one destination when it closes
+typedef struct {
+    uint64_t totalBytes;
+    uint64_t totalPackets;
+    uint64_t uniqueSrcPorts;
+    uint64_t flowCount;
+    double burstiness;
+    int32_t commonPort;          // -1 when the destination saw no ports
+    int32_t protocol;            // Most common protocol class
+} SNBAnomalyWindowSummary;
+
+// One row per destination. Each feature is a contiguous column so scoring
+// reads it sequentially; the per-row outputs sit alongside. Storage is kept
+// across windows and only grows.
+typedef struct {
+    size_t rowCount;
+    size_t capacity;
+    double *columns[SNBAnomalyFeatureCount];
+    SNBFlowKey *keys;            // Destination address per row
+    int32_t *dstPorts;
+    int32_t *protocols;
+    double *scores;              // NaN until scored
+    int64_t *seenCounts;         // Earlier windows that saw the destination
+} SNBAnomalyFeatureMatrix;
+
+bool SNBAnomalyFeatureMatrixInit(SNBAnomalyFeatureMatrix *matrix, size_t capacity);
+void SNBAnomalyFeatureMatrixDestroy(SNBAnomalyFeatureMatrix *matrix);
+void SNBAnomalyFeatureMatrixClear(SNBAnomalyFeatureMatrix *matrix);
+bool SNBAnomalyFeatureMatrixReserve(SNBAnomalyFeatureMatrix *matrix, size_t capacity);
+
+// Derives the feature row for a destination, exactly as the per-IP payload
+// was built before. Returns false if the matrix could not grow.
+bool SNBAnomalyFeatureMatrixAppend(SNBAnomalyFeatureMatrix *matrix,
+                                   const SNBFlowKey *key,
+                                   const SNBAnomalyWindowSummary *summary);
+
+#endif
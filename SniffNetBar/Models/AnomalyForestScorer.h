@@ -0,0 +1,37 @@
+//
+//  AnomalyForestScorer.h
+//  SniffNetBar
+//
+//  Native Isolation Forest scorer for anomaly detection
+//
+
+#import <Foundation/Foundation.h>
+#import "AnomalyFeatureMatrix.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+// Scores with the model exported by anomaly_train.py, loaded once, with the
+// same results as anomaly_score.py and without starting Python.
+@interface SNBAnomalyForestScorer : NSObject
+
+- (instancetype)initWithModelPath:(nullable NSString *)modelPath;
+
+// NO when the model file is missing or malformed
+@property (nonatomic, assign, readonly, getter=isAvailable) BOOL available;
+// Payload keys the model reads, in row order
+@property (nonatomic, copy, readonly) NSArray<NSString *> *columnNames;
+
+- (nullable NSNumber *)scoreFeaturePayload:(NSDictionary<NSString *, NSNumber *> *)payload
+                                     error:(NSError **)error;
+
+// Scores a whole window in one pass over the trees
+- (nullable NSArray<NSNumber *> *)scoreFeaturePayloads:(NSArray<NSDictionary<NSString *, NSNumber *> *> *)payloads
+                                                 error:(NSError **)error;
+
+// Scores every row of the matrix straight from its columns into
+// matrix->scores, without building payloads
+- (BOOL)scoreFeatureMatrix:(SNBAnomalyFeatureMatrix *)matrix error:(NSError **)error;
+
+@end
+
+NS_ASSUME_NONNULL_END
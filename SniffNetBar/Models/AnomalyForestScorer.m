@@ -0,0 +1,140 @@
+//
+//  AnomalyForestScorer.m
+//  SniffNetBar
+//
+//  Native Isolation Forest scorer for anomaly detection
+//
+
+#import "AnomalyForestScorer.h"
+#import "IsolationForest.h"
+#import "Logger.h"
+
+static NSString * const kAnomalyForestErrorDomain = @"AnomalyForestScorer";
+
+@interface SNBAnomalyForestScorer ()
+@property (nonatomic, assign) SNBIsolationForest *forest;
+@property (nonatomic, copy, readwrite) NSArray<NSString *> *columnNames;
+// SNBAnomalyFeature per model column as ints, -1 where the matrix has none
+@property (nonatomic, copy) NSData *matrixFeatures;
+@end
+
+@implementation SNBAnomalyForestScorer
+
+- (instancetype)initWithModelPath:(NSString *)modelPath {
+    self = [super init];
+    if (self) {
+        _columnNames = @[];
+        if (modelPath.length > 0 && [[NSFileManager defaultManager] fileExistsAtPath:modelPath]) {
+            char error[256] = {0};
+            _forest = SNBIsolationForestLoad(modelPath.fileSystemRepresentation, error, sizeof(error));
+            if (_forest) {
+                size_t columnCount = SNBIsolationForestColumnCount(_forest);
+                NSMutableArray<NSString *> *columnNames = [NSMutableArray arrayWithCapacity:columnCount];
+                NSMutableData *matrixFeatures = [NSMutableData dataWithLength:columnCount * sizeof(int)];
+                int *features = matrixFeatures.mutableBytes;
+                for (size_t i = 0; i < columnCount; i++) {
+                    const char *name = SNBIsolationForestColumnName(_forest, i);
+                    [columnNames addObject:@(name)];
+                    features[i] = SNBAnomalyFeatureFromName(name);
+                }
+                _columnNames = [columnNames copy];
+                _matrixFeatures = [matrixFeatures copy];
+            } else {
+                SNBLogWarn("Anomaly model %{public}@ not loaded: %{public}s", modelPath, error);
+            }
+        }
+    }
+    return self;
+}
+
+- (void)dealloc {
+    SNBIsolationForestDestroy(_forest);
+}
+
+- (BOOL)isAvailable {
+    return self.forest != NULL;
+}
+
+- (NSNumber *)scoreFeaturePayload:(NSDictionary<NSString *, NSNumber *> *)payload
+                            error:(NSError **)error {
+    return [self scoreFeaturePayloads:@[payload] error:error].firstObject;
+}
+
+- (NSError *)missingFeatureError:(NSString *)column {
+    // anomaly_score.py fails the same way on a missing feature
+    return [NSError errorWithDomain:kAnomalyForestErrorDomain
+                               code:1
+                           userInfo:@{NSLocalizedDescriptionKey:
+                                          [NSString stringWithFormat:@"Missing feature %@", column]}];
+}
+
+- (NSError *)outOfMemoryError {
+    return [NSError errorWithDomain:kAnomalyForestErrorDomain
+                               code:2
+                           userInfo:@{NSLocalizedDescriptionKey: @"Out of memory"}];
+}
+
+- (NSArray<NSNumber *> *)scoreFeaturePayloads:(NSArray<NSDictionary<NSString *, NSNumber *> *> *)payloads
+                                        error:(NSError **)error {
+    if (!self.forest) {
+        return nil;
+    }
+    NSUInteger columns = self.columnNames.count;
+    NSUInteger count = payloads.count;
+    NSMutableData *rows = [NSMutableData dataWithLength:MAX((NSUInteger)1, count * columns) * sizeof(double)];
+    NSMutableData *scores = [NSMutableData dataWithLength:MAX((NSUInteger)1, count) * sizeof(double)];
+    double *row = rows.mutableBytes;
+    for (NSDictionary<NSString *, NSNumber *> *payload in payloads) {
+        for (NSString *column in self.columnNames) {
+            NSNumber *value = payload[column];
+            if (![value isKindOfClass:[NSNumber class]]) {
+                if (error) {
+                    *error = [self missingFeatureError:column];
+                }
+                return nil;
+            }
+            *row++ = value.doubleValue;
+        }
+    }
+
+    if (!SNBIsolationForestScore(self.forest, rows.bytes, count, scores.mutableBytes, NULL)) {
+        if (error) {
+            *error = [self outOfMemoryError];
+        }
+        return nil;
+    }
+    const double *values = scores.bytes;
+    NSMutableArray<NSNumber *> *results = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger i = 0; i < count; i++) {
+        [results addObject:@(values[i])];
+    }
+    return [results copy];
+}
+
+- (BOOL)scoreFeatureMatrix:(SNBAnomalyFeatureMatrix *)matrix error:(NSError **)error {
+    if (!self.forest) {
+        return NO;
+    }
+    NSUInteger columnCount = self.columnNames.count;
+    const int *features = self.matrixFeatures.bytes;
+    const double *columns[columnCount];
+    for (NSUInteger i = 0; i < columnCount; i++) {
+        if (features[i] < 0) {
+            if (error) {
+                *error = [self missingFeatureError:self.columnNames[i]];
+            }
+            return NO;
+        }
+        columns[i] = matrix->columns[features[i]];
+    }
+
+    if (!SNBIsolationForestScoreColumns(self.forest, columns, matrix->rowCount, matrix->scores, NULL)) {
+        if (error) {
+            *error = [self outOfMemoryError];
+        }
+        return NO;
+    }
+    return YES;
+}
+
+@end
@@ -17,6 +17,10 @@ NS_ASSUME_NONNULL_BEGIN
 - (nullable NSNumber *)scoreFeaturePayload:(NSDictionary<NSString *, NSNumber *> *)payload
                                      error:(NSError **)error;
 
+// Scores a whole window with one run of the script
+- (nullable NSArray<NSNumber *> *)scoreFeaturePayloads:(NSArray<NSDictionary<NSString *, NSNumber *> *> *)payloads
+                                                 error:(NSError **)error;
+
 @end
 
 NS_ASSUME_NONNULL_END
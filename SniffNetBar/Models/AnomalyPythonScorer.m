@@ -28,6 +28,32 @@ static const NSTimeInterval kAnomalyPythonTimeoutSeconds = 5.0;
 
 - (NSNumber *)scoreFeaturePayload:(NSDictionary<NSString *, NSNumber *> *)payload
                             error:(NSError **)error {
+    NSDictionary *result = [self runScriptWithJSONObject:payload error:error];
+    NSNumber *score = result[@"score"];
+    if (![score isKindOfClass:[NSNumber class]]) {
+        return nil;
+    }
+    return score;
+}
+
+- (NSArray<NSNumber *> *)scoreFeaturePayloads:(NSArray<NSDictionary<NSString *, NSNumber *> *> *)payloads
+                                        error:(NSError **)error {
+    NSDictionary *result = [self runScriptWithJSONObject:payloads error:error];
+    NSArray<NSNumber *> *scores = result[@"scores"];
+    if (![scores isKindOfClass:[NSArray class]] || scores.count != payloads.count) {
+        return nil;
+    }
+    for (NSNumber *score in scores) {
+        if (![score isKindOfClass:[NSNumber class]]) {
+            return nil;
+        }
+    }
+    return scores;
+}
+
+// Runs the script once with object as its JSON input and returns its JSON
+// output object
+- (nullable NSDictionary *)runScriptWithJSONObject:(id)object error:(NSError **)error {
     if (self.scriptPath.length == 0 || self.modelPath.length == 0) {
         return nil;
     }
@@ -46,7 +72,7 @@ static const NSTimeInterval kAnomalyPythonTimeoutSeconds = 5.0;
     task.standardOutput = stdoutPipe;
     task.standardError = stdoutPipe;
 
-    NSData *jsonData = [NSJSONSerialization dataWithJSONObject:payload options:0 error:error];
+    NSData *jsonData = [NSJSONSerialization dataWithJSONObject:object options:0 error:error];
     if (!jsonData) {
         return nil;
     }
@@ -83,11 +109,7 @@ static const NSTimeInterval kAnomalyPythonTimeoutSeconds = 5.0;
     if (![result isKindOfClass:[NSDictionary class]]) {
         return nil;
     }
-    NSNumber *score = result[@"score"];
-    if (![score isKindOfClass:[NSNumber class]]) {
-        return nil;
-    }
-    return score;
+    return result;
 }
 
 @end
@@ -26,12 +26,16 @@ NS_ASSUME_NONNULL_BEGIN
 
 + (NSString *)defaultDatabasePath;
 + (NSString *)defaultModelPath;
+// Exported by anomaly_train.py next to the joblib bundle, see IsolationForest.h
++ (NSString *)defaultNativeModelPath;
 + (NSString *)defaultCoreMLModelPath;
 + (NSString *)applicationSupportDirectoryPath;
 
 - (instancetype)init;
 
 - (NSInteger)seenCountForIP:(NSString *)ipAddress;
+// Seen counts for a whole window in one query; IPs never seen are absent
+- (NSDictionary<NSString *, NSNumber *> *)seenCountsForIPs:(NSArray<NSString *> *)ipAddresses;
 
 - (void)recordWindowForIP:(NSString *)ipAddress
               windowStart:(NSTimeInterval)windowStart
@@ -123,6 +123,10 @@ static const NSTimeInterval kBatchFlushInterval = 5.0; // Flush every 5 seconds
     return [[self applicationSupportDirectory] stringByAppendingPathComponent:@"anomaly_model.joblib"];
 }
 
++ (NSString *)defaultNativeModelPath {
+    return [[self applicationSupportDirectory] stringByAppendingPathComponent:@"anomaly_model.iforest"];
+}
+
 + (NSString *)defaultCoreMLModelPath {
     NSString *supportPath = [[self applicationSupportDirectory] stringByAppendingPathComponent:@"anomaly_model.mlmodelc"];
     if ([[NSFileManager defaultManager] fileExistsAtPath:supportPath]) {
@@ -291,6 +295,35 @@ static const NSTimeInterval kBatchFlushInterval = 5.0; // Flush every 5 seconds
     return seenCount;
 }
 
+- (NSDictionary<NSString *, NSNumber *> *)seenCountsForIPs:(NSArray<NSString *> *)ipAddresses {
+    if (!self.db || ipAddresses.count == 0) {
+        return @{};
+    }
+    NSData *json = [NSJSONSerialization dataWithJSONObject:ipAddresses options:0 error:nil];
+    if (!json) {
+        return @{};
+    }
+
+    // The window's IPs travel as one JSON array bound to a single parameter,
+    // so the query plan stays a primary-key probe per IP
+    sqlite3_stmt *stmt = NULL;
+    NSMutableDictionary<NSString *, NSNumber *> *seenCounts = [NSMutableDictionary dictionary];
+    const char *sql =
+        "SELECT s.dst_ip, s.seen_count FROM json_each(?) j "
+        "JOIN anomaly_ip_stats s ON s.dst_ip = j.value;";
+    if (sqlite3_prepare_v2(self.db, sql, -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, json.bytes, (int)json.length, SQLITE_TRANSIENT);
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            const unsigned char *ip = sqlite3_column_text(stmt, 0);
+            if (ip) {
+                seenCounts[@((const char *)ip)] = @(sqlite3_column_int64(stmt, 1));
+            }
+        }
+    }
+    sqlite3_finalize(stmt);
+    return seenCounts;
+}
+
 - (void)recordWindowForIP:(NSString *)ipAddress
               windowStart:(NSTimeInterval)windowStart
                   dstPort:(NSInteger)dstPort
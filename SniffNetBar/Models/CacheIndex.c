@@ -0,0 +1,295 @@
+//
+//  CacheIndex.c
+//  SniffNetBar
+//
+//  Fixed-capacity LRU order and TTL expiry for keyed caches
+//
+
+#include "CacheIndex.h"
+#include <stdlib.h>
+
+// Entries live in one array allocated up front. Each is on two intrusive
+// doubly-linked lists threaded through slot numbers: the recency list (head is
+// the most recently used) and the bucket of the timer wheel for its expiry
+// tick. Free slots are chained through lruNext.
+typedef struct {
+    uint64_t expiresNs;
+    uint32_t lruPrev;
+    uint32_t lruNext;
+    uint32_t timerPrev;
+    uint32_t timerNext;
+    uint32_t bucket;          // SNB_CACHE_INDEX_NO_SLOT when not on the wheel
+    uint32_t inUse;
+} SNBCacheEntry;
+
+_Static_assert(sizeof(SNBCacheEntry) == 32, "SNBCacheEntry must stay 32 bytes");
+
+struct SNBCacheIndex {
+    SNBCacheEntry *entries;
+    uint32_t *buckets;
+    uint32_t capacity;
+    uint32_t count;
+    uint32_t lruHead;
+    uint32_t lruTail;
+    uint32_t freeHead;
+    uint64_t tickNs;
+    uint64_t nextTick;        // First tick whose bucket has not been swept
+    SNBCacheIndexStats stats;
+};
+
+// One revolution; entries further out stay in their bucket until their round
+#define SNB_CACHE_WHEEL_BUCKETS 512u
+
+// MARK: - Lists
+
+static void SNBCacheLRUUnlink(SNBCacheIndex *index, uint32_t slot) {
+    SNBCacheEntry *entry = &index->entries[slot];
+    if (entry->lruPrev != SNB_CACHE_INDEX_NO_SLOT) {
+        index->entries[entry->lruPrev].lruNext = entry->lruNext;
+    } else {
+        index->lruHead = entry->lruNext;
+    }
+    if (entry->lruNext != SNB_CACHE_INDEX_NO_SLOT) {
+        index->entries[entry->lruNext].lruPrev = entry->lruPrev;
+    } else {
+        index->lruTail = entry->lruPrev;
+    }
+}
+
+static void SNBCacheLRUPushHead(SNBCacheIndex *index, uint32_t slot) {
+    SNBCacheEntry *entry = &index->entries[slot];
+    entry->lruPrev = SNB_CACHE_INDEX_NO_SLOT;
+    entry->lruNext = index->lruHead;
+    if (index->lruHead != SNB_CACHE_INDEX_NO_SLOT) {
+        index->entries[index->lruHead].lruPrev = slot;
+    } else {
+        index->lruTail = slot;
+    }
+    index->lruHead = slot;
+}
+
+static void SNBCacheTimerUnlink(SNBCacheIndex *index, uint32_t slot) {
+    SNBCacheEntry *entry = &index->entries[slot];
+    if (entry->bucket == SNB_CACHE_INDEX_NO_SLOT) {
+        return;
+    }
+    if (entry->timerPrev != SNB_CACHE_INDEX_NO_SLOT) {
+        index->entries[entry->timerPrev].timerNext = entry->timerNext;
+    } else {
+        index->buckets[entry->bucket] = entry->timerNext;
+    }
+    if (entry->timerNext != SNB_CACHE_INDEX_NO_SLOT) {
+        index->entries[entry->timerNext].timerPrev = entry->timerPrev;
+    }
+    entry->bucket = SNB_CACHE_INDEX_NO_SLOT;
+}
+
+static void SNBCacheTimerSchedule(SNBCacheIndex *index, uint32_t slot) {
+    SNBCacheEntry *entry = &index->entries[slot];
+    if (entry->expiresNs == SNB_CACHE_INDEX_NEVER) {
+        entry->bucket = SNB_CACHE_INDEX_NO_SLOT;
+        return;
+    }
+    // An expiry in a tick that was already swept goes into the next sweep
+    uint64_t tick = entry->expiresNs / index->tickNs;
+    if (tick < index->nextTick) {
+        tick = index->nextTick;
+    }
+    uint32_t bucket = (uint32_t)(tick % SNB_CACHE_WHEEL_BUCKETS);
+    entry->bucket = bucket;
+    entry->timerPrev = SNB_CACHE_INDEX_NO_SLOT;
+    entry->timerNext = index->buckets[bucket];
+    if (entry->timerNext != SNB_CACHE_INDEX_NO_SLOT) {
+        index->entries[entry->timerNext].timerPrev = slot;
+    }
+    index->buckets[bucket] = slot;
+}
+
+static void SNBCacheFree(SNBCacheIndex *index, uint32_t slot) {
+    SNBCacheLRUUnlink(index, slot);
+    SNBCacheTimerUnlink(index, slot);
+    SNBCacheEntry *entry = &index->entries[slot];
+    entry->inUse = 0;
+    entry->lruNext = index->freeHead;
+    index->freeHead = slot;
+    index->count--;
+}
+
+static void SNBCacheResetSlots(SNBCacheIndex *index) {
+    for (uint32_t i = 0; i < index->capacity; i++) {
+        SNBCacheEntry *entry = &index->entries[i];
+        entry->inUse = 0;
+        entry->bucket = SNB_CACHE_INDEX_NO_SLOT;
+        entry->lruNext = i + 1 < index->capacity ? i + 1 : SNB_CACHE_INDEX_NO_SLOT;
+    }
+    for (uint32_t i = 0; i < SNB_CACHE_WHEEL_BUCKETS; i++) {
+        index->buckets[i] = SNB_CACHE_INDEX_NO_SLOT;
+    }
+    index->freeHead = 0;
+    index->lruHead = SNB_CACHE_INDEX_NO_SLOT;
+    index->lruTail = SNB_CACHE_INDEX_NO_SLOT;
+    index->count = 0;
+}
+
+// MARK: - Lifecycle
+
+SNBCacheIndex *SNBCacheIndexCreate(uint32_t capacity, uint64_t tickNs) {
+    if (capacity == 0 || capacity == SNB_CACHE_INDEX_NO_SLOT) {
+        return NULL;
+    }
+    SNBCacheIndex *index = calloc(1, sizeof(SNBCacheIndex));
+    if (!index) {
+        return NULL;
+    }
+    index->entries = malloc((size_t)capacity * sizeof(SNBCacheEntry));
+    index->buckets = malloc(SNB_CACHE_WHEEL_BUCKETS * sizeof(uint32_t));
+    if (!index->entries || !index->buckets) {
+        SNBCacheIndexDestroy(index);
+        return NULL;
+    }
+    index->capacity = capacity;
+    index->tickNs = tickNs > 0 ? tickNs : 1;
+    index->stats.capacity = capacity;
+    SNBCacheResetSlots(index);
+    return index;
+}
+
+void SNBCacheIndexDestroy(SNBCacheIndex *index) {
+    if (!index) {
+        return;
+    }
+    free(index->entries);
+    free(index->buckets);
+    free(index);
+}
+
+// MARK: - Entries
+
+uint32_t SNBCacheIndexInsert(SNBCacheIndex *index, uint64_t expiresNs, bool *evicted) {
+    uint32_t slot = index->freeHead;
+    bool reused = slot == SNB_CACHE_INDEX_NO_SLOT;
+    if (reused) {
+        slot = index->lruTail;
+        SNBCacheLRUUnlink(index, slot);
+        SNBCacheTimerUnlink(index, slot);
+        index->stats.evictions++;
+    } else {
+        index->freeHead = index->entries[slot].lruNext;
+        index->count++;
+    }
+    if (evicted) {
+        *evicted = reused;
+    }
+
+    SNBCacheEntry *entry = &index->entries[slot];
+    entry->inUse = 1;
+    entry->expiresNs = expiresNs;
+    SNBCacheLRUPushHead(index, slot);
+    SNBCacheTimerSchedule(index, slot);
+    index->stats.insertions++;
+    return slot;
+}
+
+bool SNBCacheIndexTouch(SNBCacheIndex *index, uint32_t slot, uint64_t nowNs) {
+    SNBCacheEntry *entry = &index->entries[slot];
+    if (entry->expiresNs <= nowNs) {
+        SNBCacheFree(index, slot);
+        index->stats.expirations++;
+        index->stats.misses++;
+        return false;
+    }
+    if (index->lruHead != slot) {
+        SNBCacheLRUUnlink(index, slot);
+        SNBCacheLRUPushHead(index, slot);
+    }
+    index->stats.hits++;
+    return true;
+}
+
+void SNBCacheIndexNoteMiss(SNBCacheIndex *index) {
+    index->stats.misses++;
+}
+
+void SNBCacheIndexSetExpiry(SNBCacheIndex *index, uint32_t slot, uint64_t expiresNs) {
+    SNBCacheTimerUnlink(index, slot);
+    index->entries[slot].expiresNs = expiresNs;
+    SNBCacheTimerSchedule(index, slot);
+}
+
+uint64_t SNBCacheIndexExpiry(const SNBCacheIndex *index, uint32_t slot) {
+    return index->entries[slot].expiresNs;
+}
+
+void SNBCacheIndexRemove(SNBCacheIndex *index, uint32_t slot) {
+    if (index->entries[slot].inUse) {
+        SNBCacheFree(index, slot);
+    }
+}
+
+void SNBCacheIndexClear(SNBCacheIndex *index) {
+    SNBCacheResetSlots(index);
+}
+
+// MARK: - Expiry
+
+static size_t SNBCacheSweepBucket(SNBCacheIndex *index, uint32_t bucket, uint64_t nowNs,
+                                  SNBCacheIndexExpireCallback callback, void *context) {
+    size_t expired = 0;
+    uint32_t slot = index->buckets[bucket];
+    while (slot != SNB_CACHE_INDEX_NO_SLOT) {
+        uint32_t next = index->entries[slot].timerNext;
+        // Entries from a later revolution share the bucket and stay
+        if (index->entries[slot].expiresNs <= nowNs) {
+            if (callback) {
+                callback(slot, context);
+            }
+            SNBCacheFree(index, slot);
+            expired++;
+        }
+        slot = next;
+    }
+    return expired;
+}
+
+size_t SNBCacheIndexExpire(SNBCacheIndex *index, uint64_t nowNs,
+                           SNBCacheIndexExpireCallback callback, void *context) {
+    // Only completed ticks are swept, so each bucket is visited once per
+    // tick rather than on every call
+    uint64_t nowTick = nowNs / index->tickNs;
+    if (nowTick <= index->nextTick) {
+        return 0;
+    }
+
+    size_t expired = 0;
+    uint64_t ticks = nowTick - index->nextTick;
+    if (ticks >= SNB_CACHE_WHEEL_BUCKETS) {
+        for (uint32_t bucket = 0; bucket < SNB_CACHE_WHEEL_BUCKETS; bucket++) {
+            expired += SNBCacheSweepBucket(index, bucket, nowNs, callback, context);
+        }
+    } else {
+        for (uint64_t tick = index->nextTick; tick < nowTick; tick++) {
+            uint32_t bucket = (uint32_t)(tick % SNB_CACHE_WHEEL_BUCKETS);
+            expired += SNBCacheSweepBucket(index, bucket, nowNs, callback, context);
+        }
+    }
+    index->nextTick = nowTick;
+    index->stats.expirations += expired;
+    return expired;
+}
+
+// MARK: - Statistics
+
+uint32_t SNBCacheIndexCount(const SNBCacheIndex *index) {
+    return index->count;
+}
+
+SNBCacheIndexStats SNBCacheIndexGetStats(const SNBCacheIndex *index) {
+    SNBCacheIndexStats stats = index->stats;
+    stats.count = index->count;
+    return stats;
+}
+
+size_t SNBCacheIndexMemoryBytes(const SNBCacheIndex *index) {
+    return sizeof(SNBCacheIndex) + (size_t)index->capacity * sizeof(SNBCacheEntry) +
+           SNB_CACHE_WHEEL_BUCKETS * sizeof(uint32_t);
+}
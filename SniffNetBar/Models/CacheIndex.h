@@ -0,0 +1,72 @@
+//
+//  CacheIndex.h
+//  SniffNetBar
+//
+//  Fixed-capacity LRU order and TTL expiry for keyed caches
+//
+
+#ifndef SNB_CACHE_INDEX_H
+#define SNB_CACHE_INDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// The bookkeeping half of a cache: it hands out slot numbers and keeps them on
+// an intrusive recency list and a timer wheel, while the caller keeps the keys
+// and values in arrays indexed by slot and a map from key to slot. Every
+// operation is O(1); expiry costs O(1) per entry and per elapsed tick. Not
+// thread-safe: callers lock around it (LRUCache.h shards several of them).
+
+#define SNB_CACHE_INDEX_NO_SLOT UINT32_MAX
+// Expiry for entries that only leave when evicted or removed
+#define SNB_CACHE_INDEX_NEVER UINT64_MAX
+
+typedef struct SNBCacheIndex SNBCacheIndex;
+
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;          // Lookups that found nothing, or found it expired
+    uint64_t insertions;
+    uint64_t evictions;       // Least recently used entries dropped to make room
+    uint64_t expirations;     // Entries dropped because their TTL ran out
+    uint32_t count;
+    uint32_t capacity;
+} SNBCacheIndexStats;
+
+// Entries expire on the wheel at tickNs granularity (SNBCacheIndexTouch checks
+// the exact time). Returns NULL on allocation failure.
+SNBCacheIndex *SNBCacheIndexCreate(uint32_t capacity, uint64_t tickNs);
+void SNBCacheIndexDestroy(SNBCacheIndex *index);
+
+// Takes a slot for a new most recently used entry. When the index is full the
+// least recently used entry is evicted and its slot reused: *evicted is set
+// and the caller drops the key and value it kept there before storing new ones.
+uint32_t SNBCacheIndexInsert(SNBCacheIndex *index, uint64_t expiresNs, bool *evicted);
+
+// Counts a hit and marks the entry most recently used. Returns false if it
+// expired at nowNs, in which case the slot is freed and counted as a miss.
+bool SNBCacheIndexTouch(SNBCacheIndex *index, uint32_t slot, uint64_t nowNs);
+// Counts a lookup whose key the caller did not find
+void SNBCacheIndexNoteMiss(SNBCacheIndex *index);
+
+// Reschedules an entry, e.g. when its value is replaced
+void SNBCacheIndexSetExpiry(SNBCacheIndex *index, uint32_t slot, uint64_t expiresNs);
+uint64_t SNBCacheIndexExpiry(const SNBCacheIndex *index, uint32_t slot);
+void SNBCacheIndexRemove(SNBCacheIndex *index, uint32_t slot);
+// Frees every slot but keeps the counters
+void SNBCacheIndexClear(SNBCacheIndex *index);
+
+typedef void (*SNBCacheIndexExpireCallback)(uint32_t slot, void *context);
+
+// Frees the entries that expired in the ticks completed by nowNs, calling
+// callback for each before its slot can be reused. Returns how many expired.
+size_t SNBCacheIndexExpire(SNBCacheIndex *index, uint64_t nowNs,
+                           SNBCacheIndexExpireCallback callback, void *context);
+
+uint32_t SNBCacheIndexCount(const SNBCacheIndex *index);
+SNBCacheIndexStats SNBCacheIndexGetStats(const SNBCacheIndex *index);
+// Bytes held by the entry and wheel arrays, for memory accounting
+size_t SNBCacheIndexMemoryBytes(const SNBCacheIndex *index);
+
+#endif
@@ -0,0 +1,40 @@
+//
+//  CaptureOptions.h
+//  SniffNetBar
+//
+//  Kernel-side settings for a live capture session, sent by the app to the
+//  privileged helper
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+// The decoders only read headers, so a short snapshot keeps whole payloads
+// from being copied out of the kernel. 128 bytes covers Ethernet with QinQ
+// or PPPoE, IPv6 with a few extension headers and a TCP header with options.
+extern const int kSNBCaptureDefaultSnapshotLength;
+extern const int kSNBCaptureMinSnapshotLength;
+extern const int kSNBCaptureMaxSnapshotLength;
+// Kernel buffer size in bytes; 0 keeps libpcap's default
+extern const NSUInteger kSNBCaptureDefaultBufferSize;
+extern const NSUInteger kSNBCaptureMaxBufferSize;
+extern const NSUInteger kSNBCaptureMaxFilterLength;
+
+@interface SNBCaptureOptions : NSObject <NSCopying>
+
+// BPF filter expression in pcap-filter(7) syntax, compiled in the helper.
+// Nil or empty captures everything.
+@property (nonatomic, copy, nullable) NSString *filterExpression;
+// Bytes captured per packet, clamped to the min/max above
+@property (nonatomic, assign) int snapshotLength;
+// Kernel buffer size in bytes, clamped to kSNBCaptureMaxBufferSize; 0 keeps
+// the libpcap default
+@property (nonatomic, assign) NSUInteger bufferSize;
+
+// Header-only snapshot, default buffer size, no filter; same as -init
++ (instancetype)defaultOptions;
+
+@end
+
+NS_ASSUME_NONNULL_END
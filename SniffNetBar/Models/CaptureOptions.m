@@ -0,0 +1,54 @@
+//
+//  CaptureOptions.m
+//  SniffNetBar
+//
+//  Kernel-side settings for a live capture session, sent by the app to the
+//  privileged helper
+//
+
+#import "CaptureOptions.h"
+
+const int kSNBCaptureDefaultSnapshotLength = 128;
+const int kSNBCaptureMinSnapshotLength = 96;
+const int kSNBCaptureMaxSnapshotLength = 262144;
+const NSUInteger kSNBCaptureDefaultBufferSize = 4 * 1024 * 1024;
+const NSUInteger kSNBCaptureMaxBufferSize = 256 * 1024 * 1024;
+const NSUInteger kSNBCaptureMaxFilterLength = 4096;
+
+@implementation SNBCaptureOptions
+
++ (instancetype)defaultOptions {
+    return [[self alloc] init];
+}
+
+- (instancetype)init {
+    self = [super init];
+    if (self) {
+        _snapshotLength = kSNBCaptureDefaultSnapshotLength;
+        _bufferSize = kSNBCaptureDefaultBufferSize;
+    }
+    return self;
+}
+
+- (void)setSnapshotLength:(int)snapshotLength {
+    _snapshotLength = MAX(kSNBCaptureMinSnapshotLength, MIN(snapshotLength, kSNBCaptureMaxSnapshotLength));
+}
+
+- (void)setBufferSize:(NSUInteger)bufferSize {
+    _bufferSize = MIN(bufferSize, kSNBCaptureMaxBufferSize);
+}
+
+- (id)copyWithZone:(NSZone *)zone {
+    SNBCaptureOptions *copy = [[[self class] allocWithZone:zone] init];
+    copy.filterExpression = self.filterExpression;
+    copy.snapshotLength = self.snapshotLength;
+    copy.bufferSize = self.bufferSize;
+    return copy;
+}
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"snaplen %d, buffer %lu bytes, filter \"%@\"",
+            self.snapshotLength, (unsigned long)self.bufferSize, self.filterExpression ?: @""];
+}
+
+@end
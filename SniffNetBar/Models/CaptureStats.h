@@ -0,0 +1,47 @@
+//
+//  CaptureStats.h
+//  SniffNetBar
+//
+//  Capture pipeline counters reported by the privileged helper
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@interface SNBCaptureStats : NSObject <NSCopying>
+
+// Packets seen by the kernel filter (pcap_stats ps_recv)
+@property (nonatomic, assign) uint64_t packetsReceived;
+// Packets dropped because the kernel buffer was full (pcap_stats ps_drop)
+@property (nonatomic, assign) uint64_t kernelDropped;
+// Packets dropped by the interface or driver (pcap_stats ps_ifdrop)
+@property (nonatomic, assign) uint64_t interfaceDropped;
+// Packets discarded because the shared-memory ring was full
+@property (nonatomic, assign) uint64_t ringDropped;
+// Packets published to the ring but not yet consumed by the app
+@property (nonatomic, assign) uint64_t ringLag;
+// Packets decoded and handed to the app
+@property (nonatomic, assign) uint64_t packetsDelivered;
+// Packets read from pcap that could not be decoded
+@property (nonatomic, assign) uint64_t packetsUndecoded;
+// Number of batches delivered so far
+@property (nonatomic, assign) uint64_t batchCount;
+// Size of the most recent batch
+@property (nonatomic, assign) NSUInteger lastBatchSize;
+// Packets the app dropped as copies of one already captured on another
+// interface (see PacketDedup.h); never set by the helper
+@property (nonatomic, assign) uint64_t packetsDuplicate;
+// Packets whose remote address is on a loaded blocklist (see Blocklist.h);
+// never set by the helper
+@property (nonatomic, assign) uint64_t packetsBlocklisted;
+
+@property (nonatomic, readonly) uint64_t totalDropped;
+
+// Adds the counters of another session, for totals across interfaces. The
+// last batch size is the largest of the two.
+- (void)addCountersFromStats:(SNBCaptureStats *)stats;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,46 @@
+//
+//  CaptureStats.m
+//  SniffNetBar
+//
+//  Capture pipeline counters reported by the privileged helper
+//
+
+#import "CaptureStats.h"
+
+@implementation SNBCaptureStats
+
+- (uint64_t)totalDropped {
+    return self.kernelDropped + self.interfaceDropped + self.ringDropped;
+}
+
+- (void)addCountersFromStats:(SNBCaptureStats *)stats {
+    self.packetsReceived += stats.packetsReceived;
+    self.kernelDropped += stats.kernelDropped;
+    self.interfaceDropped += stats.interfaceDropped;
+    self.ringDropped += stats.ringDropped;
+    self.ringLag += stats.ringLag;
+    self.packetsDelivered += stats.packetsDelivered;
+    self.packetsUndecoded += stats.packetsUndecoded;
+    self.packetsDuplicate += stats.packetsDuplicate;
+    self.packetsBlocklisted += stats.packetsBlocklisted;
+    self.batchCount += stats.batchCount;
+    self.lastBatchSize = MAX(self.lastBatchSize, stats.lastBatchSize);
+}
+
+- (id)copyWithZone:(NSZone *)zone {
+    SNBCaptureStats *copy = [[[self class] allocWithZone:zone] init];
+    copy.packetsReceived = self.packetsReceived;
+    copy.kernelDropped = self.kernelDropped;
+    copy.interfaceDropped = self.interfaceDropped;
+    copy.ringDropped = self.ringDropped;
+    copy.ringLag = self.ringLag;
+    copy.packetsDelivered = self.packetsDelivered;
+    copy.packetsUndecoded = self.packetsUndecoded;
+    copy.batchCount = self.batchCount;
+    copy.lastBatchSize = self.lastBatchSize;
+    copy.packetsDuplicate = self.packetsDuplicate;
+    copy.packetsBlocklisted = self.packetsBlocklisted;
+    return copy;
+}
+
+@end
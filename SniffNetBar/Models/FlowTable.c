@@ -0,0 +1,277 @@
+//
+//  FlowTable.c
+//  SniffNetBar
+//
+//  Open-addressing hash table keyed by binary flow tuples
+//
+
+#include "FlowTable.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Linear probing with backward-shift deletion, so there are no tombstones and
+// probe lengths stay short under churn. Each slot is a small header followed by
+// the key and the caller's value, laid out contiguously for cache locality.
+typedef struct {
+    uint32_t hash;
+    uint32_t occupied;
+    SNBFlowKey key;
+} SNBFlowSlotHeader;
+
+struct SNBFlowTable {
+    uint8_t *slots;
+    size_t capacity;      // Power of two
+    size_t mask;
+    size_t count;
+    size_t stride;
+    size_t valueSize;
+};
+
+static const size_t kSNBFlowTableMinCapacity = 16;
+
+static inline uint64_t SNBFlowMix(uint64_t value) {
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdULL;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53ULL;
+    value ^= value >> 33;
+    return value;
+}
+
+static inline uint32_t SNBFlowHash(const SNBFlowKey *key) {
+    uint64_t words[5];
+    memcpy(words, key, sizeof(words));
+    uint64_t hash = 0x9e3779b97f4a7c15ULL;
+    for (int i = 0; i < 5; i++) {
+        hash = SNBFlowMix(hash ^ words[i]);
+    }
+    return (uint32_t)hash;
+}
+
+static inline SNBFlowSlotHeader *SNBFlowSlotAt(const SNBFlowTable *table, size_t index) {
+    return (SNBFlowSlotHeader *)(table->slots + index * table->stride);
+}
+
+static inline void *SNBFlowSlotValue(SNBFlowSlotHeader *slot) {
+    return (uint8_t *)slot + sizeof(SNBFlowSlotHeader);
+}
+
+static size_t SNBFlowRoundCapacity(size_t capacity) {
+    size_t rounded = kSNBFlowTableMinCapacity;
+    while (rounded < capacity) {
+        rounded <<= 1;
+    }
+    return rounded;
+}
+
+static bool SNBFlowTableResize(SNBFlowTable *table, size_t newCapacity) {
+    uint8_t *newSlots = calloc(newCapacity, table->stride);
+    if (!newSlots) {
+        return false;
+    }
+
+    uint8_t *oldSlots = table->slots;
+    size_t oldCapacity = table->capacity;
+    table->slots = newSlots;
+    table->capacity = newCapacity;
+    table->mask = newCapacity - 1;
+
+    for (size_t i = 0; i < oldCapacity; i++) {
+        SNBFlowSlotHeader *old = (SNBFlowSlotHeader *)(oldSlots + i * table->stride);
+        if (!old->occupied) {
+            continue;
+        }
+        size_t index = old->hash & table->mask;
+        while (SNBFlowSlotAt(table, index)->occupied) {
+            index = (index + 1) & table->mask;
+        }
+        memcpy(SNBFlowSlotAt(table, index), old, table->stride);
+    }
+    free(oldSlots);
+    return true;
+}
+
+SNBFlowTable *SNBFlowTableCreate(size_t valueSize, size_t initialCapacity) {
+    SNBFlowTable *table = calloc(1, sizeof(SNBFlowTable));
+    if (!table) {
+        return NULL;
+    }
+    table->valueSize = valueSize;
+    table->stride = sizeof(SNBFlowSlotHeader) + ((valueSize + 7) & ~(size_t)7);
+    // Size for the requested entries at the maximum load factor
+    table->capacity = SNBFlowRoundCapacity(initialCapacity + initialCapacity / 3);
+    table->mask = table->capacity - 1;
+    table->slots = calloc(table->capacity, table->stride);
+    if (!table->slots) {
+        free(table);
+        return NULL;
+    }
+    return table;
+}
+
+void SNBFlowTableDestroy(SNBFlowTable *table) {
+    if (!table) {
+        return;
+    }
+    free(table->slots);
+    free(table);
+}
+
+void *SNBFlowTableUpsert(SNBFlowTable *table, const SNBFlowKey *key, bool *inserted) {
+    uint32_t hash = SNBFlowHash(key);
+    size_t index = hash & table->mask;
+    for (;;) {
+        SNBFlowSlotHeader *slot = SNBFlowSlotAt(table, index);
+        if (!slot->occupied) {
+            break;
+        }
+        if (slot->hash == hash && memcmp(&slot->key, key, sizeof(SNBFlowKey)) == 0) {
+            if (inserted) {
+                *inserted = false;
+            }
+            return SNBFlowSlotValue(slot);
+        }
+        index = (index + 1) & table->mask;
+    }
+
+    // Keep the load factor at or below 3/4
+    if ((table->count + 1) * 4 > table->capacity * 3) {
+        if (!SNBFlowTableResize(table, table->capacity * 2)) {
+            return NULL;
+        }
+        index = hash & table->mask;
+        while (SNBFlowSlotAt(table, index)->occupied) {
+            index = (index + 1) & table->mask;
+        }
+    }
+
+    SNBFlowSlotHeader *slot = SNBFlowSlotAt(table, index);
+    slot->hash = hash;
+    slot->occupied = 1;
+    slot->key = *key;
+    memset(SNBFlowSlotValue(slot), 0, table->stride - sizeof(SNBFlowSlotHeader));
+    table->count++;
+    if (inserted) {
+        *inserted = true;
+    }
+    return SNBFlowSlotValue(slot);
+}
+
+static size_t SNBFlowTableIndexOf(const SNBFlowTable *table, const SNBFlowKey *key) {
+    uint32_t hash = SNBFlowHash(key);
+    size_t index = hash & table->mask;
+    for (;;) {
+        SNBFlowSlotHeader *slot = SNBFlowSlotAt(table, index);
+        if (!slot->occupied) {
+            return SIZE_MAX;
+        }
+        if (slot->hash == hash && memcmp(&slot->key, key, sizeof(SNBFlowKey)) == 0) {
+            return index;
+        }
+        index = (index + 1) & table->mask;
+    }
+}
+
+void *SNBFlowTableFind(const SNBFlowTable *table, const SNBFlowKey *key) {
+    size_t index = SNBFlowTableIndexOf(table, key);
+    return index == SIZE_MAX ? NULL : SNBFlowSlotValue(SNBFlowSlotAt(table, index));
+}
+
+static void SNBFlowTableRemoveAtIndex(SNBFlowTable *table, size_t hole) {
+    // Backward shift: pull later members of the probe run into the hole as
+    // long as that does not move them before their home slot.
+    size_t index = hole;
+    for (;;) {
+        index = (index + 1) & table->mask;
+        SNBFlowSlotHeader *slot = SNBFlowSlotAt(table, index);
+        if (!slot->occupied) {
+            break;
+        }
+        size_t home = slot->hash & table->mask;
+        size_t distanceToHole = (hole - home) & table->mask;
+        size_t distanceToSlot = (index - home) & table->mask;
+        if (distanceToHole <= distanceToSlot) {
+            memcpy(SNBFlowSlotAt(table, hole), slot, table->stride);
+            hole = index;
+        }
+    }
+    SNBFlowSlotAt(table, hole)->occupied = 0;
+    table->count--;
+}
+
+bool SNBFlowTableRemove(SNBFlowTable *table, const SNBFlowKey *key) {
+    size_t index = SNBFlowTableIndexOf(table, key);
+    if (index == SIZE_MAX) {
+        return false;
+    }
+    SNBFlowTableRemoveAtIndex(table, index);
+    return true;
+}
+
+void SNBFlowTableClear(SNBFlowTable *table) {
+    if (table->count == 0) {
+        return;
+    }
+    for (size_t i = 0; i < table->capacity; i++) {
+        SNBFlowSlotAt(table, i)->occupied = 0;
+    }
+    table->count = 0;
+}
+
+size_t SNBFlowTableCount(const SNBFlowTable *table) {
+    return table->count;
+}
+
+size_t SNBFlowTableMemoryBytes(const SNBFlowTable *table) {
+    return sizeof(*table) + table->capacity * table->stride;
+}
+
+void *SNBFlowTableNext(const SNBFlowTable *table, size_t *cursor, const SNBFlowKey **key) {
+    for (size_t i = *cursor; i < table->capacity; i++) {
+        SNBFlowSlotHeader *slot = SNBFlowSlotAt(table, i);
+        if (slot->occupied) {
+            *cursor = i + 1;
+            if (key) {
+                *key = &slot->key;
+            }
+            return SNBFlowSlotValue(slot);
+        }
+    }
+    *cursor = table->capacity;
+    return NULL;
+}
+
+void SNBFlowTableRemoveCurrent(SNBFlowTable *table, size_t *cursor) {
+    if (*cursor == 0) {
+        return;
+    }
+    size_t index = *cursor - 1;
+    if (!SNBFlowSlotAt(table, index)->occupied) {
+        return;
+    }
+    SNBFlowTableRemoveAtIndex(table, index);
+    *cursor = index;
+}
+
+void SNBFlowKeyMakeAddress(SNBFlowKey *key, uint8_t family, const uint8_t *address) {
+    memset(key, 0, sizeof(*key));
+    key->family = family;
+    memcpy(key->destinationAddress, address, sizeof(key->destinationAddress));
+}
+
+void SNBFlowKeyMakeRecord(SNBFlowKey *key, const SNBPacketRecord *record) {
+    memset(key, 0, sizeof(*key));
+    key->family = record->family;
+    key->ipProtocol = record->ipProtocol;
+    memcpy(key->sourceAddress, record->sourceAddress, sizeof(key->sourceAddress));
+    memcpy(key->destinationAddress, record->destinationAddress, sizeof(key->destinationAddress));
+    if (record->flags & SNBPacketRecordFlagHasPorts) {
+        key->hasPorts = 1;
+        key->sourcePort = record->sourcePort;
+        key->destinationPort = record->destinationPort;
+    }
+}
+
+uint32_t SNBFlowKeyHash(const SNBFlowKey *key) {
+    return SNBFlowHash(key);
+}
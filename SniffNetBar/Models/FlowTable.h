@@ -0,0 +1,69 @@
+//
+//  FlowTable.h
+//  SniffNetBar
+//
+//  Open-addressing hash table keyed by binary flow tuples
+//
+
+#ifndef SNB_FLOW_TABLE_H
+#define SNB_FLOW_TABLE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "PacketRecord.h"
+
+// Fixed-size key shared by every per-packet table in the app. Host tables only
+// fill family and destinationAddress; unused fields must be zero so keys
+// compare byte-wise.
+typedef struct SNBFlowKey {
+    uint8_t sourceAddress[16];
+    uint8_t destinationAddress[16];
+    uint16_t sourcePort;
+    uint16_t destinationPort;
+    uint8_t family;
+    uint8_t ipProtocol;
+    uint8_t hasPorts;                // Distinguishes "no ports" from port 0
+    uint8_t reserved;
+} SNBFlowKey;
+
+_Static_assert(sizeof(SNBFlowKey) == 40, "SNBFlowKey must stay 40 bytes");
+
+typedef struct SNBFlowTable SNBFlowTable;
+
+// Creates a table whose entries carry valueSize bytes of caller-defined,
+// zero-initialized state. Returns NULL on allocation failure.
+SNBFlowTable *SNBFlowTableCreate(size_t valueSize, size_t initialCapacity);
+void SNBFlowTableDestroy(SNBFlowTable *table);
+
+// Returns the value for key, inserting a zeroed one if needed. Only inserts
+// can allocate (when the table doubles), so steady-state updates never touch
+// the heap. Value pointers stay valid until the next insert or removal.
+// Returns NULL if the table could not grow.
+void *SNBFlowTableUpsert(SNBFlowTable *table, const SNBFlowKey *key, bool *inserted);
+void *SNBFlowTableFind(const SNBFlowTable *table, const SNBFlowKey *key);
+bool SNBFlowTableRemove(SNBFlowTable *table, const SNBFlowKey *key);
+
+// Drops every entry but keeps the allocation for the next window
+void SNBFlowTableClear(SNBFlowTable *table);
+size_t SNBFlowTableCount(const SNBFlowTable *table);
+// Bytes held by the table's slot array and header, for memory accounting
+size_t SNBFlowTableMemoryBytes(const SNBFlowTable *table);
+
+// Iterates entries: start with *cursor = 0 and call until NULL is returned.
+void *SNBFlowTableNext(const SNBFlowTable *table, size_t *cursor, const SNBFlowKey **key);
+// Removes the entry last returned by SNBFlowTableNext and rewinds the cursor
+// so the entry shifted into its slot is not skipped. An entry near the end of
+// the table may be visited twice, never skipped.
+void SNBFlowTableRemoveCurrent(SNBFlowTable *table, size_t *cursor);
+
+// Key builders. The record key is the full 5-tuple as captured; ports are
+// zero when the record carries none.
+void SNBFlowKeyMakeAddress(SNBFlowKey *key, uint8_t family, const uint8_t *address);
+void SNBFlowKeyMakeRecord(SNBFlowKey *key, const SNBPacketRecord *record);
+
+// The table's key hash. Tables index slots by its low bits, so anything that
+// partitions keys across tables should use the high bits.
+uint32_t SNBFlowKeyHash(const SNBFlowKey *key);
+
+#endif
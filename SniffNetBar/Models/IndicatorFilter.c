@@ -0,0 +1,253 @@
+//
+//  IndicatorFilter.c
+//  SniffNetBar
+//
+//  Bloom filter of the indicators held in the threat intel store
+//
+
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+
+#include "IndicatorFilter.h"
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SNB_INDICATOR_FILTER_MAGIC 0x464e4953u        // "SINF" little-endian
+#define SNB_INDICATOR_FILTER_VERSION 1u
+#define SNB_INDICATOR_FILTER_MIN_CAPACITY 1024u
+#define SNB_INDICATOR_FILTER_MAX_HASHES 16u
+// Bit positions are reduced from 32-bit hashes
+#define SNB_INDICATOR_FILTER_MAX_BITS ((uint64_t)1 << 32)
+#define SNB_INDICATOR_FILTER_LN2 0.69314718055994530942
+
+// The saved file is this header followed by the bit array
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t signature;
+    uint64_t bitCount;
+    uint64_t capacity;
+    uint64_t count;
+    uint32_t hashCount;
+    uint32_t reserved;
+} SNBIndicatorFilterHeader;
+
+struct SNBIndicatorFilter {
+    uint64_t *words;
+    uint64_t bitCount;        // A multiple of 64, at most 2^32
+    uint64_t capacity;
+    uint64_t count;
+    uint64_t setBits;
+    uint32_t hashCount;
+};
+
+// MARK: - Lifecycle
+
+static SNBIndicatorFilter *SNBIndicatorFilterAllocate(uint64_t bitCount, uint32_t hashCount, uint64_t capacity) {
+    SNBIndicatorFilter *filter = calloc(1, sizeof(SNBIndicatorFilter));
+    if (!filter) {
+        return NULL;
+    }
+    filter->words = calloc((size_t)(bitCount / 64), sizeof(uint64_t));
+    if (!filter->words) {
+        free(filter);
+        return NULL;
+    }
+    filter->bitCount = bitCount;
+    filter->hashCount = hashCount;
+    filter->capacity = capacity;
+    return filter;
+}
+
+SNBIndicatorFilter *SNBIndicatorFilterCreate(uint64_t capacity, double falsePositiveRate) {
+    if (!(falsePositiveRate > 0.0 && falsePositiveRate < 1.0)) {
+        return NULL;
+    }
+    if (capacity < SNB_INDICATOR_FILTER_MIN_CAPACITY) {
+        capacity = SNB_INDICATOR_FILTER_MIN_CAPACITY;
+    }
+    // m = -n ln p / (ln 2)^2 bits and k = (m / n) ln 2 hashes
+    double bits = ceil(-(double)capacity * log(falsePositiveRate) /
+                       (SNB_INDICATOR_FILTER_LN2 * SNB_INDICATOR_FILTER_LN2));
+    uint64_t bitCount = bits >= (double)SNB_INDICATOR_FILTER_MAX_BITS
+        ? SNB_INDICATOR_FILTER_MAX_BITS
+        : ((uint64_t)bits + 63) & ~(uint64_t)63;
+    double hashes = round((double)bitCount / (double)capacity * SNB_INDICATOR_FILTER_LN2);
+    uint32_t hashCount = hashes < 1.0 ? 1
+        : hashes > SNB_INDICATOR_FILTER_MAX_HASHES ? SNB_INDICATOR_FILTER_MAX_HASHES
+        : (uint32_t)hashes;
+    return SNBIndicatorFilterAllocate(bitCount, hashCount, capacity);
+}
+
+SNBIndicatorFilter *SNBIndicatorFilterCopy(const SNBIndicatorFilter *filter) {
+    SNBIndicatorFilter *copy = SNBIndicatorFilterAllocate(filter->bitCount, filter->hashCount, filter->capacity);
+    if (!copy) {
+        return NULL;
+    }
+    memcpy(copy->words, filter->words, (size_t)(filter->bitCount / 8));
+    copy->count = filter->count;
+    copy->setBits = filter->setBits;
+    return copy;
+}
+
+void SNBIndicatorFilterDestroy(SNBIndicatorFilter *filter) {
+    if (!filter) {
+        return;
+    }
+    free(filter->words);
+    free(filter);
+}
+
+// MARK: - Hashing
+
+uint64_t SNBIndicatorFilterHash(int32_t type, const char *value, size_t length) {
+    // FNV-1a over the type and the value, then a full-avalanche finalizer so
+    // both 32-bit halves are usable as independent hashes
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    uint32_t typeBits = (uint32_t)type;
+    for (int i = 0; i < 4; i++) {
+        hash ^= (uint8_t)(typeBits >> (i * 8));
+        hash *= 0x100000001b3ULL;
+    }
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (uint8_t)value[i];
+        hash *= 0x100000001b3ULL;
+    }
+    hash ^= hash >> 30;
+    hash *= 0xbf58476d1ce4e5b9ULL;
+    hash ^= hash >> 27;
+    hash *= 0x94d049bb133111ebULL;
+    hash ^= hash >> 31;
+    return hash;
+}
+
+// Probe i of hash, by double hashing: (h1 + i h2) reduced onto the bit array
+// with a multiply rather than a division
+static inline uint64_t SNBIndicatorFilterBit(const SNBIndicatorFilter *filter, uint64_t hash, uint32_t probe) {
+    uint32_t h1 = (uint32_t)hash;
+    uint32_t h2 = (uint32_t)(hash >> 32) | 1u;
+    uint32_t mixed = h1 + probe * h2;
+    return ((uint64_t)mixed * filter->bitCount) >> 32;
+}
+
+void SNBIndicatorFilterAdd(SNBIndicatorFilter *filter, uint64_t hash) {
+    for (uint32_t probe = 0; probe < filter->hashCount; probe++) {
+        uint64_t bit = SNBIndicatorFilterBit(filter, hash, probe);
+        uint64_t mask = (uint64_t)1 << (bit & 63);
+        uint64_t *word = &filter->words[bit >> 6];
+        if (!(*word & mask)) {
+            *word |= mask;
+            filter->setBits++;
+        }
+    }
+    filter->count++;
+}
+
+bool SNBIndicatorFilterMayContain(const SNBIndicatorFilter *filter, uint64_t hash) {
+    for (uint32_t probe = 0; probe < filter->hashCount; probe++) {
+        uint64_t bit = SNBIndicatorFilterBit(filter, hash, probe);
+        if (!(filter->words[bit >> 6] & ((uint64_t)1 << (bit & 63)))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// MARK: - Statistics
+
+uint64_t SNBIndicatorFilterCount(const SNBIndicatorFilter *filter) {
+    return filter->count;
+}
+
+uint64_t SNBIndicatorFilterCapacity(const SNBIndicatorFilter *filter) {
+    return filter->capacity;
+}
+
+double SNBIndicatorFilterEstimatedFalsePositiveRate(const SNBIndicatorFilter *filter) {
+    // Every probe of an absent indicator lands on a set bit with this chance
+    return pow((double)filter->setBits / (double)filter->bitCount, (double)filter->hashCount);
+}
+
+size_t SNBIndicatorFilterMemoryBytes(const SNBIndicatorFilter *filter) {
+    return sizeof(SNBIndicatorFilter) + (size_t)(filter->bitCount / 8);
+}
+
+// MARK: - Persistence
+
+bool SNBIndicatorFilterWrite(const SNBIndicatorFilter *filter, const char *path, uint64_t signature) {
+    char temporaryPath[1024];
+    if (snprintf(temporaryPath, sizeof(temporaryPath), "%s.partial", path) >= (int)sizeof(temporaryPath)) {
+        return false;
+    }
+    FILE *file = fopen(temporaryPath, "wb");
+    if (!file) {
+        return false;
+    }
+    SNBIndicatorFilterHeader header = {
+        .magic = SNB_INDICATOR_FILTER_MAGIC,
+        .version = SNB_INDICATOR_FILTER_VERSION,
+        .signature = signature,
+        .bitCount = filter->bitCount,
+        .capacity = filter->capacity,
+        .count = filter->count,
+        .hashCount = filter->hashCount,
+    };
+    size_t wordCount = (size_t)(filter->bitCount / 64);
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                   fwrite(filter->words, sizeof(uint64_t), wordCount, file) == wordCount;
+    written = fclose(file) == 0 && written;
+    if (!written || rename(temporaryPath, path) != 0) {
+        unlink(temporaryPath);
+        return false;
+    }
+    return true;
+}
+
+static bool SNBIndicatorFilterReadFully(int fd, void *buffer, size_t size) {
+    uint8_t *bytes = buffer;
+    while (size > 0) {
+        ssize_t got = read(fd, bytes, size);
+        if (got <= 0) {
+            return false;
+        }
+        bytes += got;
+        size -= (size_t)got;
+    }
+    return true;
+}
+
+SNBIndicatorFilter *SNBIndicatorFilterRead(const char *path, uint64_t signature) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    SNBIndicatorFilterHeader header;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !SNBIndicatorFilterReadFully(fd, &header, sizeof(header)) ||
+        header.magic != SNB_INDICATOR_FILTER_MAGIC || header.version != SNB_INDICATOR_FILTER_VERSION ||
+        header.signature != signature || header.bitCount == 0 || header.bitCount % 64 != 0 ||
+        header.bitCount > SNB_INDICATOR_FILTER_MAX_BITS || header.hashCount == 0 ||
+        header.hashCount > SNB_INDICATOR_FILTER_MAX_HASHES ||
+        (uint64_t)info.st_size != sizeof(header) + header.bitCount / 8) {
+        close(fd);
+        return NULL;
+    }
+    SNBIndicatorFilter *filter = SNBIndicatorFilterAllocate(header.bitCount, header.hashCount, header.capacity);
+    if (!filter || !SNBIndicatorFilterReadFully(fd, filter->words, (size_t)(header.bitCount / 8))) {
+        close(fd);
+        SNBIndicatorFilterDestroy(filter);
+        return NULL;
+    }
+    close(fd);
+    filter->count = header.count;
+    for (uint64_t i = 0; i < header.bitCount / 64; i++) {
+        filter->setBits += (uint64_t)__builtin_popcountll(filter->words[i]);
+    }
+    return filter;
+}
@@ -0,0 +1,53 @@
+//
+//  IndicatorFilter.h
+//  SniffNetBar
+//
+//  Bloom filter of the indicators held in the threat intel store
+//
+
+#ifndef SNB_INDICATOR_FILTER_H
+#define SNB_INDICATOR_FILTER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Answers "definitely not stored" for most indicators without touching SQLite.
+// A positive may be false at roughly the rate the filter was sized for, a
+// negative never is, as long as every stored indicator was added. Bits cannot
+// be cleared, so deleted indicators stay in until the filter is rebuilt. Not
+// thread-safe: callers lock around it.
+
+typedef struct SNBIndicatorFilter SNBIndicatorFilter;
+
+// Sized for capacity indicators at falsePositiveRate (0-1). Returns NULL on
+// allocation failure.
+SNBIndicatorFilter *SNBIndicatorFilterCreate(uint64_t capacity, double falsePositiveRate);
+// Snapshot to save while the original keeps taking additions
+SNBIndicatorFilter *SNBIndicatorFilterCopy(const SNBIndicatorFilter *filter);
+void SNBIndicatorFilterDestroy(SNBIndicatorFilter *filter);
+
+// Hash of an indicator's type and value, computed once and used for both
+// adding and checking
+uint64_t SNBIndicatorFilterHash(int32_t type, const char *value, size_t length);
+
+void SNBIndicatorFilterAdd(SNBIndicatorFilter *filter, uint64_t hash);
+bool SNBIndicatorFilterMayContain(const SNBIndicatorFilter *filter, uint64_t hash);
+
+// Indicators added, counting repeats, and the count the filter was sized for.
+// Past capacity the false-positive rate climbs and the filter should be
+// rebuilt larger.
+uint64_t SNBIndicatorFilterCount(const SNBIndicatorFilter *filter);
+uint64_t SNBIndicatorFilterCapacity(const SNBIndicatorFilter *filter);
+// False-positive rate expected from the share of bits set
+double SNBIndicatorFilterEstimatedFalsePositiveRate(const SNBIndicatorFilter *filter);
+size_t SNBIndicatorFilterMemoryBytes(const SNBIndicatorFilter *filter);
+
+// Saves the filter with a signature of the data it was built from, through a
+// temporary file renamed over path
+bool SNBIndicatorFilterWrite(const SNBIndicatorFilter *filter, const char *path, uint64_t signature);
+// Loads a filter saved with the same signature. Returns NULL if the file is
+// missing, damaged or was saved for other data.
+SNBIndicatorFilter *SNBIndicatorFilterRead(const char *path, uint64_t signature);
+
+#endif
@@ -0,0 +1,360 @@
+//
+//  IsolationForest.c
+//  SniffNetBar
+//
+//  Native evaluator for the exported anomaly Isolation Forest
+//
+
+#include "IsolationForest.h"
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Guards against reading a corrupt header into huge allocations
+#define SNB_ISOLATION_FOREST_MAX_COLUMNS 256
+#define SNB_ISOLATION_FOREST_MAX_TREES 65536
+#define SNB_ISOLATION_FOREST_MAX_NODES (1u << 24)
+
+typedef struct {
+    int32_t left;              // -1 for a leaf
+    int32_t right;
+    int32_t feature;
+    double value;              // Threshold, or the leaf's path length
+} SNBForestNode;
+
+typedef struct {
+    SNBForestNode *nodes;
+    uint32_t nodeCount;
+} SNBForestTree;
+
+struct SNBIsolationForest {
+    uint32_t continuousCount;
+    uint32_t columnCount;
+    double scoreMin;
+    double scoreMax;
+    double normalizer;
+    double *medians;
+    double *iqrs;
+    char **columnNames;
+    SNBForestTree *trees;
+    uint32_t treeCount;
+};
+
+// MARK: - Parsing
+
+typedef struct {
+    const uint8_t *bytes;
+    size_t length;
+    size_t offset;
+} SNBForestReader;
+
+static bool SNBForestRead(SNBForestReader *reader, void *out, size_t size) {
+    if (reader->length - reader->offset < size) {
+        return false;
+    }
+    memcpy(out, reader->bytes + reader->offset, size);
+    reader->offset += size;
+    return true;
+}
+
+static bool SNBForestReadUInt32(SNBForestReader *reader, uint32_t *out) {
+    uint8_t b[4];
+    if (!SNBForestRead(reader, b, sizeof(b))) {
+        return false;
+    }
+    *out = (uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+    return true;
+}
+
+static bool SNBForestReadInt32(SNBForestReader *reader, int32_t *out) {
+    uint32_t value;
+    if (!SNBForestReadUInt32(reader, &value)) {
+        return false;
+    }
+    memcpy(out, &value, sizeof(*out));
+    return true;
+}
+
+static bool SNBForestReadDouble(SNBForestReader *reader, double *out) {
+    uint32_t low, high;
+    if (!SNBForestReadUInt32(reader, &low) || !SNBForestReadUInt32(reader, &high)) {
+        return false;
+    }
+    uint64_t bits = ((uint64_t)high << 32) | low;
+    memcpy(out, &bits, sizeof(*out));
+    return true;
+}
+
+static void SNBForestSetError(char *error, size_t errorLength, const char *format, ...) {
+    if (!error || errorLength == 0) {
+        return;
+    }
+    va_list arguments;
+    va_start(arguments, format);
+    vsnprintf(error, errorLength, format, arguments);
+    va_end(arguments);
+}
+
+// Children always follow their parent in scikit-learn's node arrays, which
+// also guarantees the walk terminates
+static bool SNBForestTreeIsValid(const SNBForestTree *tree, uint32_t columnCount) {
+    for (uint32_t i = 0; i < tree->nodeCount; i++) {
+        const SNBForestNode *node = &tree->nodes[i];
+        if (node->left < 0) {
+            continue;
+        }
+        if ((uint32_t)node->left <= i || (uint32_t)node->left >= tree->nodeCount ||
+            node->right < 0 || (uint32_t)node->right <= i || (uint32_t)node->right >= tree->nodeCount ||
+            node->feature < 0 || (uint32_t)node->feature >= columnCount) {
+            return false;
+        }
+    }
+    return true;
+}
+
+SNBIsolationForest *SNBIsolationForestCreateFromBytes(const void *bytes, size_t length, char *error, size_t errorLength) {
+    SNBForestReader reader = { bytes, length, 0 };
+    char magic[8];
+    uint32_t version = 0, continuousCount = 0, extraCount = 0, treeCount = 0;
+    if (!SNBForestRead(&reader, magic, sizeof(magic)) ||
+        memcmp(magic, SNB_ISOLATION_FOREST_MAGIC, sizeof(magic)) != 0) {
+        SNBForestSetError(error, errorLength, "not an exported isolation forest");
+        return NULL;
+    }
+    if (!SNBForestReadUInt32(&reader, &version) || version != SNB_ISOLATION_FOREST_VERSION) {
+        SNBForestSetError(error, errorLength, "unsupported model version %u", version);
+        return NULL;
+    }
+    if (!SNBForestReadUInt32(&reader, &continuousCount) ||
+        !SNBForestReadUInt32(&reader, &extraCount) ||
+        !SNBForestReadUInt32(&reader, &treeCount) ||
+        continuousCount + (uint64_t)extraCount == 0 ||
+        continuousCount + (uint64_t)extraCount > SNB_ISOLATION_FOREST_MAX_COLUMNS ||
+        treeCount == 0 || treeCount > SNB_ISOLATION_FOREST_MAX_TREES) {
+        SNBForestSetError(error, errorLength, "invalid model header");
+        return NULL;
+    }
+
+    SNBIsolationForest *forest = calloc(1, sizeof(SNBIsolationForest));
+    if (!forest) {
+        SNBForestSetError(error, errorLength, "out of memory");
+        return NULL;
+    }
+    forest->continuousCount = continuousCount;
+    forest->columnCount = continuousCount + extraCount;
+    forest->medians = calloc(continuousCount ? continuousCount : 1, sizeof(double));
+    forest->iqrs = calloc(continuousCount ? continuousCount : 1, sizeof(double));
+    forest->columnNames = calloc(forest->columnCount, sizeof(char *));
+    forest->trees = calloc(treeCount, sizeof(SNBForestTree));
+    if (!forest->medians || !forest->iqrs || !forest->columnNames || !forest->trees) {
+        SNBForestSetError(error, errorLength, "out of memory");
+        SNBIsolationForestDestroy(forest);
+        return NULL;
+    }
+    forest->treeCount = treeCount;
+
+    bool ok = SNBForestReadDouble(&reader, &forest->scoreMin) &&
+              SNBForestReadDouble(&reader, &forest->scoreMax) &&
+              SNBForestReadDouble(&reader, &forest->normalizer);
+    for (uint32_t i = 0; ok && i < continuousCount; i++) {
+        ok = SNBForestReadDouble(&reader, &forest->medians[i]);
+    }
+    for (uint32_t i = 0; ok && i < continuousCount; i++) {
+        ok = SNBForestReadDouble(&reader, &forest->iqrs[i]);
+    }
+    for (uint32_t i = 0; ok && i < forest->columnCount; i++) {
+        uint32_t nameLength = 0;
+        ok = SNBForestReadUInt32(&reader, &nameLength) && nameLength <= reader.length - reader.offset;
+        if (ok) {
+            forest->columnNames[i] = malloc(nameLength + 1u);
+            ok = forest->columnNames[i] && SNBForestRead(&reader, forest->columnNames[i], nameLength);
+            if (ok) {
+                forest->columnNames[i][nameLength] = '\0';
+            }
+        }
+    }
+    if (!ok) {
+        SNBForestSetError(error, errorLength, "truncated model header");
+        SNBIsolationForestDestroy(forest);
+        return NULL;
+    }
+
+    for (uint32_t t = 0; t < treeCount; t++) {
+        SNBForestTree *tree = &forest->trees[t];
+        uint32_t nodeCount = 0;
+        // Each node takes 24 bytes in the file
+        if (!SNBForestReadUInt32(&reader, &nodeCount) || nodeCount == 0 ||
+            nodeCount > SNB_ISOLATION_FOREST_MAX_NODES ||
+            (uint64_t)nodeCount * 24u > reader.length - reader.offset) {
+            SNBForestSetError(error, errorLength, "truncated tree %u", t);
+            SNBIsolationForestDestroy(forest);
+            return NULL;
+        }
+        tree->nodes = malloc(nodeCount * sizeof(SNBForestNode));
+        if (!tree->nodes) {
+            SNBForestSetError(error, errorLength, "out of memory");
+            SNBIsolationForestDestroy(forest);
+            return NULL;
+        }
+        tree->nodeCount = nodeCount;
+        for (uint32_t n = 0; n < nodeCount; n++) {
+            SNBForestNode *node = &tree->nodes[n];
+            uint32_t reserved;
+            SNBForestReadInt32(&reader, &node->left);
+            SNBForestReadInt32(&reader, &node->right);
+            SNBForestReadInt32(&reader, &node->feature);
+            SNBForestReadUInt32(&reader, &reserved);
+            SNBForestReadDouble(&reader, &node->value);
+        }
+        if (!SNBForestTreeIsValid(tree, forest->columnCount)) {
+            SNBForestSetError(error, errorLength, "malformed tree %u", t);
+            SNBIsolationForestDestroy(forest);
+            return NULL;
+        }
+    }
+    return forest;
+}
+
+SNBIsolationForest *SNBIsolationForestLoad(const char *path, char *error, size_t errorLength) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        SNBForestSetError(error, errorLength, "cannot open %s", path);
+        return NULL;
+    }
+    uint8_t *bytes = NULL;
+    long length = -1;
+    if (fseek(file, 0, SEEK_END) == 0) {
+        length = ftell(file);
+    }
+    if (length > 0 && fseek(file, 0, SEEK_SET) == 0) {
+        bytes = malloc((size_t)length);
+    }
+    if (!bytes || fread(bytes, 1, (size_t)length, file) != (size_t)length) {
+        SNBForestSetError(error, errorLength, "cannot read %s", path);
+        free(bytes);
+        fclose(file);
+        return NULL;
+    }
+    fclose(file);
+
+    SNBIsolationForest *forest = SNBIsolationForestCreateFromBytes(bytes, (size_t)length, error, errorLength);
+    free(bytes);
+    return forest;
+}
+
+void SNBIsolationForestDestroy(SNBIsolationForest *forest) {
+    if (!forest) {
+        return;
+    }
+    if (forest->trees) {
+        for (uint32_t t = 0; t < forest->treeCount; t++) {
+            free(forest->trees[t].nodes);
+        }
+    }
+    if (forest->columnNames) {
+        for (uint32_t i = 0; i < forest->columnCount; i++) {
+            free(forest->columnNames[i]);
+        }
+    }
+    free(forest->trees);
+    free(forest->columnNames);
+    free(forest->medians);
+    free(forest->iqrs);
+    free(forest);
+}
+
+size_t SNBIsolationForestColumnCount(const SNBIsolationForest *forest) {
+    return forest->columnCount;
+}
+
+const char *SNBIsolationForestColumnName(const SNBIsolationForest *forest, size_t column) {
+    return column < forest->columnCount ? forest->columnNames[column] : NULL;
+}
+
+size_t SNBIsolationForestTreeCount(const SNBIsolationForest *forest) {
+    return forest->treeCount;
+}
+
+// MARK: - Scoring
+
+// Rows come either row-major in rows or one array per column in columns
+static bool SNBForestScore(const SNBIsolationForest *forest,
+                           const double *rows,
+                           const double *const *columns,
+                           size_t rowCount,
+                           double *scores,
+                           double *rawScores) {
+    if (rowCount == 0) {
+        return true;
+    }
+    size_t columnCount = forest->columnCount;
+    float *features = malloc(rowCount * columnCount * sizeof(float));
+    double *depths = calloc(rowCount, sizeof(double));
+    if (!features || !depths) {
+        free(features);
+        free(depths);
+        return false;
+    }
+
+    // Same arithmetic as anomaly_score.py, then the float32 cast
+    // score_samples applies before walking the trees
+    for (size_t c = 0; c < columnCount; c++) {
+        const double *input = rows ? rows + c : columns[c];
+        size_t stride = rows ? columnCount : 1;
+        float *out = features + c;
+        if (c < forest->continuousCount) {
+            double median = forest->medians[c];
+            double scale = forest->iqrs[c] + 1e-9;
+            for (size_t r = 0; r < rowCount; r++) {
+                out[r * columnCount] = (float)((log1p(input[r * stride]) - median) / scale);
+            }
+        } else {
+            for (size_t r = 0; r < rowCount; r++) {
+                out[r * columnCount] = (float)input[r * stride];
+            }
+        }
+    }
+
+    for (uint32_t t = 0; t < forest->treeCount; t++) {
+        const SNBForestNode *nodes = forest->trees[t].nodes;
+        for (size_t r = 0; r < rowCount; r++) {
+            const float *row = features + r * columnCount;
+            const SNBForestNode *node = nodes;
+            while (node->left >= 0) {
+                node = &nodes[(double)row[node->feature] <= node->value ? node->left : node->right];
+            }
+            depths[r] += node->value;
+        }
+    }
+
+    for (size_t r = 0; r < rowCount; r++) {
+        double raw = -pow(2.0, -(forest->normalizer != 0.0 ? depths[r] / forest->normalizer : 1.0));
+        if (rawScores) {
+            rawScores[r] = raw;
+        }
+        double normalized = (raw - forest->scoreMin) / (forest->scoreMax - forest->scoreMin + 1e-9);
+        scores[r] = 1.0 - fmax(0.0, fmin(1.0, normalized));
+    }
+
+    free(features);
+    free(depths);
+    return true;
+}
+
+bool SNBIsolationForestScore(const SNBIsolationForest *forest,
+                             const double *rows,
+                             size_t rowCount,
+                             double *scores,
+                             double *rawScores) {
+    return SNBForestScore(forest, rows, NULL, rowCount, scores, rawScores);
+}
+
+bool SNBIsolationForestScoreColumns(const SNBIsolationForest *forest,
+                                    const double *const *columns,
+                                    size_t rowCount,
+                                    double *scores,
+                                    double *rawScores) {
+    return SNBForestScore(forest, NULL, columns, rowCount, scores, rawScores);
+}
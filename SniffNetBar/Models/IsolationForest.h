@@ -0,0 +1,70 @@
+//
+//  IsolationForest.h
+//  SniffNetBar
+//
+//  Native evaluator for the exported anomaly Isolation Forest
+//
+
+#ifndef SNB_ISOLATION_FOREST_H
+#define SNB_ISOLATION_FOREST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// File written by Scripts/anomaly_export.py next to the joblib bundle
+#define SNB_ISOLATION_FOREST_MAGIC "SNBIFRST"
+#define SNB_ISOLATION_FOREST_VERSION 1
+
+// A trained scikit-learn IsolationForest plus the scaling it was trained
+// with, loaded once and evaluated without Python. Scores match
+// Scripts/anomaly_score.py: continuous columns go through log1p and
+// median/IQR scaling, the row is cast to float32 for the tree walk like
+// scikit-learn does, and the raw score_samples value is normalized with
+// score_min/score_max into 0 (normal) .. 1 (anomalous).
+//
+// File layout, little-endian:
+//   char     magic[8]                  SNB_ISOLATION_FOREST_MAGIC
+//   uint32   version, continuousCount, extraCount, treeCount
+//   double   scoreMin, scoreMax
+//   double   normalizer                tree count * average path length of max_samples
+//   double   medians[continuousCount], iqrs[continuousCount]
+//   columns  continuous then extra, each uint32 length + UTF-8 name
+//   trees    each uint32 nodeCount + nodes
+//   node     int32 left, int32 right (-1 for leaves), int32 feature,
+//            uint32 reserved, double value (split threshold, or for a
+//            leaf the path length scikit-learn credits a sample there)
+//
+// Immutable once loaded, so one forest can score from several threads.
+typedef struct SNBIsolationForest SNBIsolationForest;
+
+// Returns NULL and fills error when the file is missing or malformed
+SNBIsolationForest *SNBIsolationForestLoad(const char *path, char *error, size_t errorLength);
+SNBIsolationForest *SNBIsolationForestCreateFromBytes(const void *bytes, size_t length, char *error, size_t errorLength);
+void SNBIsolationForestDestroy(SNBIsolationForest *forest);
+
+// Feature columns in the order rows must supply them: continuous first,
+// then the one-hot extras
+size_t SNBIsolationForestColumnCount(const SNBIsolationForest *forest);
+const char *SNBIsolationForestColumnName(const SNBIsolationForest *forest, size_t column);
+size_t SNBIsolationForestTreeCount(const SNBIsolationForest *forest);
+
+// Scores rowCount rows of unscaled feature values, row-major with
+// SNBIsolationForestColumnCount values per row. Each tree is walked for the
+// whole batch before the next one, so a window's rows share a warm tree.
+// rawScores, if not NULL, receives scikit-learn's score_samples values.
+// Returns false only if scratch space cannot be allocated.
+bool SNBIsolationForestScore(const SNBIsolationForest *forest,
+                             const double *rows,
+                             size_t rowCount,
+                             double *scores,
+                             double *rawScores);
+
+// Same, with one array of rowCount values per column, in column order
+bool SNBIsolationForestScoreColumns(const SNBIsolationForest *forest,
+                                    const double *const *columns,
+                                    size_t rowCount,
+                                    double *scores,
+                                    double *rawScores);
+
+#endif
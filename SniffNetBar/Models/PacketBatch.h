@@ -0,0 +1,44 @@
+//
+//  PacketBatch.h
+//  SniffNetBar
+//
+//  Contiguous block of packet records handed from capture to the consumers
+//
+
+#import <Foundation/Foundation.h>
+#import "PacketRecord.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+// One allocation per batch instead of one object per packet. Consumers read
+// the records in place on their own queues; a batch must not be modified
+// once it has been delivered.
+@interface SNBPacketBatch : NSObject
+
+// Empty batch with room reserved for capacity records
++ (instancetype)batchWithCapacity:(NSUInteger)capacity;
+// Copies count records
++ (instancetype)batchWithRecords:(const SNBPacketRecord *)records count:(NSUInteger)count;
+// Wraps packed records received over XPC. Returns nil if the length is not
+// a whole number of records.
++ (nullable instancetype)batchWithData:(NSData *)data;
+
+@property (nonatomic, readonly) const SNBPacketRecord *records;
+@property (nonatomic, readonly) NSUInteger count;
+// Packed records, suitable for XPC
+@property (nonatomic, readonly) NSData *data;
+
+// For the capture layer only, before delivery
+- (void)appendRecords:(const SNBPacketRecord *)records count:(NSUInteger)count;
+- (SNBPacketRecord *)mutableRecords;
+// Drops the records from count on, after a filter has compacted them
+- (void)truncateToCount:(NSUInteger)count;
+
+@end
+
+// Formats a record address at the UI/export boundary
+NSString * _Nullable SNBStringFromPacketAddress(uint8_t family, const uint8_t *address);
+// Parses a formatted address back into record form
+BOOL SNBPacketAddressFromString(NSString *string, uint8_t *family, uint8_t address[_Nonnull 16]);
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,90 @@
+//
+//  PacketBatch.m
+//  SniffNetBar
+//
+//  Contiguous block of packet records handed from capture to the consumers
+//
+
+#import "PacketBatch.h"
+#import <arpa/inet.h>
+
+@interface SNBPacketBatch ()
+@property (nonatomic, strong) NSMutableData *storage;
+@end
+
+@implementation SNBPacketBatch
+
++ (instancetype)batchWithCapacity:(NSUInteger)capacity {
+    SNBPacketBatch *batch = [[self alloc] init];
+    batch.storage = [NSMutableData dataWithCapacity:capacity * sizeof(SNBPacketRecord)];
+    return batch;
+}
+
++ (instancetype)batchWithRecords:(const SNBPacketRecord *)records count:(NSUInteger)count {
+    SNBPacketBatch *batch = [[self alloc] init];
+    batch.storage = [NSMutableData dataWithBytes:records length:count * sizeof(SNBPacketRecord)];
+    return batch;
+}
+
++ (instancetype)batchWithData:(NSData *)data {
+    if (data.length % sizeof(SNBPacketRecord) != 0) {
+        return nil;
+    }
+    SNBPacketBatch *batch = [[self alloc] init];
+    batch.storage = [data mutableCopy];
+    return batch;
+}
+
+- (const SNBPacketRecord *)records {
+    return (const SNBPacketRecord *)self.storage.bytes;
+}
+
+- (NSUInteger)count {
+    return self.storage.length / sizeof(SNBPacketRecord);
+}
+
+- (NSData *)data {
+    return self.storage;
+}
+
+- (void)appendRecords:(const SNBPacketRecord *)records count:(NSUInteger)count {
+    [self.storage appendBytes:records length:count * sizeof(SNBPacketRecord)];
+}
+
+- (SNBPacketRecord *)mutableRecords {
+    return (SNBPacketRecord *)self.storage.mutableBytes;
+}
+
+- (void)truncateToCount:(NSUInteger)count {
+    if (count < self.count) {
+        self.storage.length = count * sizeof(SNBPacketRecord);
+    }
+}
+
+@end
+
+NSString *SNBStringFromPacketAddress(uint8_t family, const uint8_t *address) {
+    char buffer[INET6_ADDRSTRLEN];
+    int af = (family == SNBAddressFamilyIPv6) ? AF_INET6 : AF_INET;
+    if (family == SNBAddressFamilyNone || !inet_ntop(af, address, buffer, sizeof(buffer))) {
+        return nil;
+    }
+    return [NSString stringWithUTF8String:buffer];
+}
+
+BOOL SNBPacketAddressFromString(NSString *string, uint8_t *family, uint8_t address[16]) {
+    memset(address, 0, 16);
+    const char *cString = string.UTF8String;
+    if (!cString) {
+        return NO;
+    }
+    if (inet_pton(AF_INET, cString, address) == 1) {
+        *family = SNBAddressFamilyIPv4;
+        return YES;
+    }
+    if (inet_pton(AF_INET6, cString, address) == 1) {
+        *family = SNBAddressFamilyIPv6;
+        return YES;
+    }
+    return NO;
+}
@@ -0,0 +1,72 @@
+//
+//  PacketClock.h
+//  SniffNetBar
+//
+//  Packet-driven clock shared by the analytics consumers
+//
+
+#ifndef SNB_PACKET_CLOCK_H
+#define SNB_PACKET_CLOCK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include "PacketRecord.h"
+
+// Analytics run on capture time, not on the time the records happen to reach
+// them, so a replayed file produces the same windows, buckets and idle
+// expiries as the live capture it came from. Between packets the clock keeps
+// moving with the wall clock from the last capture time it saw, which lets
+// timers close windows when traffic stops. Before the first packet it is the
+// wall clock. Owned by one queue; not thread-safe.
+typedef struct SNBPacketClock {
+    uint64_t packetNs;   // Latest capture time seen, Unix nanoseconds
+    uint64_t wallNs;     // Wall time when packetNs was last advanced
+} SNBPacketClock;
+
+static inline uint64_t SNBWallClockNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// Moves the clock to timestampNs if that is newer. Capture time never runs
+// backwards, so older timestamps are ignored.
+static inline void SNBPacketClockAdvanceTo(SNBPacketClock *clock, uint64_t timestampNs, uint64_t wallNs) {
+    if (timestampNs > clock->packetNs) {
+        clock->packetNs = timestampNs;
+        clock->wallNs = wallNs;
+    }
+}
+
+// Moves the clock to the newest timestamp in records
+static inline void SNBPacketClockAdvance(SNBPacketClock *clock,
+                                         const SNBPacketRecord *records,
+                                         size_t count,
+                                         uint64_t wallNs) {
+    uint64_t latest = clock->packetNs;
+    for (size_t i = 0; i < count; i++) {
+        if (records[i].timestampNs > latest) {
+            latest = records[i].timestampNs;
+        }
+    }
+    SNBPacketClockAdvanceTo(clock, latest, wallNs);
+}
+
+static inline uint64_t SNBPacketClockNowNs(const SNBPacketClock *clock, uint64_t wallNs) {
+    if (clock->packetNs == 0) {
+        return wallNs;
+    }
+    return clock->packetNs + (wallNs > clock->wallNs ? wallNs - clock->wallNs : 0);
+}
+
+// Unix seconds, the unit the day and window bookkeeping uses
+static inline double SNBPacketClockNow(const SNBPacketClock *clock) {
+    return (double)SNBPacketClockNowNs(clock, SNBWallClockNs()) / 1e9;
+}
+
+static inline double SNBPacketRecordTime(const SNBPacketRecord *record) {
+    return (double)record->timestampNs / 1e9;
+}
+
+#endif
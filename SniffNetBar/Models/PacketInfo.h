@@ -6,6 +6,7 @@
 //
 
 #import <Foundation/Foundation.h>
+#import "PacketRecord.h"
 
 typedef NS_ENUM(NSInteger, PacketProtocol) {
     PacketProtocolTCP,
@@ -15,6 +16,9 @@ typedef NS_ENUM(NSInteger, PacketProtocol) {
     PacketProtocolUnknown
 };
 
+// Maps an IANA protocol number from a packet record
+PacketProtocol SNBPacketProtocolFromIPProtocol(uint8_t ipProtocol);
+
 @interface PacketInfo : NSObject
 
 @property (nonatomic, strong) NSString *sourceAddress;
@@ -24,5 +28,8 @@ typedef NS_ENUM(NSInteger, PacketProtocol) {
 @property (nonatomic, assign) PacketProtocol protocol;
 @property (nonatomic, assign) uint64_t totalBytes;
 
+// Formats the binary record produced by the decoder
++ (instancetype)packetInfoWithRecord:(const SNBPacketRecord *)record;
+
 @end
 
@@ -6,6 +6,22 @@
 //
 
 #import "PacketInfo.h"
+#import "PacketBatch.h"
+#import <netinet/in.h>
+
+PacketProtocol SNBPacketProtocolFromIPProtocol(uint8_t ipProtocol) {
+    switch (ipProtocol) {
+        case IPPROTO_TCP:
+            return PacketProtocolTCP;
+        case IPPROTO_UDP:
+            return PacketProtocolUDP;
+        case IPPROTO_ICMP:
+        case IPPROTO_ICMPV6:
+            return PacketProtocolICMP;
+        default:
+            return PacketProtocolUnknown;
+    }
+}
 
 @implementation PacketInfo
 
@@ -20,5 +36,22 @@
     return self;
 }
 
++ (instancetype)packetInfoWithRecord:(const SNBPacketRecord *)record {
+    PacketInfo *info = [[self alloc] init];
+    info.totalBytes = record->length;
+    if (record->family == SNBAddressFamilyNone) {
+        return info;
+    }
+
+    info.sourceAddress = SNBStringFromPacketAddress(record->family, record->sourceAddress);
+    info.destinationAddress = SNBStringFromPacketAddress(record->family, record->destinationAddress);
+    info.protocol = SNBPacketProtocolFromIPProtocol(record->ipProtocol);
+    if (record->flags & SNBPacketRecordFlagHasPorts) {
+        info.sourcePort = record->sourcePort;
+        info.destinationPort = record->destinationPort;
+    }
+    return info;
+}
+
 @end
 
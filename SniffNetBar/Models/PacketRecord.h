@@ -0,0 +1,63 @@
+//
+//  PacketRecord.h
+//  SniffNetBar
+//
+//  Fixed-size binary packet record shared by the helper and the app
+//
+
+#ifndef SNB_PACKET_RECORD_H
+#define SNB_PACKET_RECORD_H
+
+#include <stdint.h>
+
+// The record is written by the helper into shared memory and read in place by
+// the app, so its layout is part of the helper protocol. Bump the version for
+// any change below.
+#define SNB_PACKET_RECORD_VERSION 3
+
+enum {
+    SNBAddressFamilyNone = 0,
+    SNBAddressFamilyIPv4 = 4,
+    SNBAddressFamilyIPv6 = 6
+};
+
+enum {
+    SNBPacketRecordFlagHasPorts = 1 << 0,
+    // Set by the app (see PacketDirection.h), never by the helper
+    SNBPacketRecordFlagOutgoing = 1 << 1,    // Source is the local side
+    SNBPacketRecordFlagBothLocal = 1 << 2,   // Both endpoints are local addresses
+    // Set by the decoder
+    SNBPacketRecordFlagFragment = 1 << 3,    // Part of a fragmented datagram; only the first has ports
+    SNBPacketRecordFlagHasICMP = 1 << 4,     // icmpType and icmpCode are valid
+    SNBPacketRecordFlagVLAN = 1 << 5,        // vlanID is valid
+    // Set by the app (see Blocklist.h)
+    SNBPacketRecordFlagBlocklisted = 1 << 6  // Remote address is on a loaded blocklist
+};
+
+// Capture interfaces the app tells apart in interfaceIndex; index 0 is an
+// untagged record (a replay or a single-interface build)
+#define SNB_PACKET_MAX_INTERFACES 16
+
+typedef struct SNBPacketRecord {
+    uint64_t timestampNs;            // Capture time in nanoseconds since the Unix epoch
+    uint32_t length;                 // Bytes on the wire
+    uint16_t sourcePort;             // Host byte order, valid with SNBPacketRecordFlagHasPorts
+    uint16_t destinationPort;
+    uint8_t family;                  // SNBAddressFamily*
+    uint8_t ipProtocol;              // IANA protocol number (1 ICMP, 6 TCP, 17 UDP, 58 ICMPv6)
+    uint8_t flags;                   // SNBPacketRecordFlag*
+    uint8_t tcpFlags;                // TCP control bits (FIN 0x01 ... CWR 0x80), 0 otherwise
+    uint8_t icmpType;                // ICMP or ICMPv6 type and code, valid with SNBPacketRecordFlagHasICMP
+    uint8_t icmpCode;
+    uint16_t vlanID;                 // Outermost 802.1Q VLAN ID, valid with SNBPacketRecordFlagVLAN
+    uint8_t sourceAddress[16];       // Network byte order; IPv4 uses the first 4 bytes
+    uint8_t destinationAddress[16];
+    uint8_t interfaceIndex;          // Capture interface, set by the app (see PacketCaptureManager.h); 0 from the helper
+    uint8_t reserved2;
+    uint16_t payloadOffset;          // Frame offset of the UDP or TCP payload, 0 if there is none in the capture
+    uint8_t reserved3[4];
+} SNBPacketRecord;
+
+_Static_assert(sizeof(SNBPacketRecord) == 64, "SNBPacketRecord must stay 64 bytes");
+
+#endif
@@ -0,0 +1,296 @@
+//
+//  RequestScheduler.c
+//  SniffNetBar
+//
+//  Token-bucket budgets and a priority queue for rate-limited lookups
+//
+
+#include "RequestScheduler.h"
+#include <math.h>
+#include <stdlib.h>
+
+#define SNB_NS_PER_MINUTE 60000000000.0
+#define SNB_NS_PER_DAY 86400000000000.0
+
+// MARK: - Budgets
+
+static void SNBTokenBucketInit(SNBTokenBucket *bucket, uint32_t limit, double periodNs, uint64_t nowNs) {
+    bucket->limit = limit;
+    bucket->tokens = limit;
+    bucket->tokensPerNs = limit > 0 ? (double)limit / periodNs : 0.0;
+    bucket->updatedNs = nowNs;
+}
+
+static void SNBTokenBucketRefill(SNBTokenBucket *bucket, uint64_t nowNs) {
+    if (bucket->limit <= 0.0 || nowNs <= bucket->updatedNs) {
+        return;
+    }
+    double tokens = bucket->tokens + (double)(nowNs - bucket->updatedNs) * bucket->tokensPerNs;
+    bucket->tokens = tokens < bucket->limit ? tokens : bucket->limit;
+    bucket->updatedNs = nowNs;
+}
+
+static uint64_t SNBTokenBucketDelayNs(SNBTokenBucket *bucket, uint64_t nowNs) {
+    if (bucket->limit <= 0.0) {
+        return 0;
+    }
+    SNBTokenBucketRefill(bucket, nowNs);
+    if (bucket->tokens >= 1.0) {
+        return 0;
+    }
+    return (uint64_t)ceil((1.0 - bucket->tokens) / bucket->tokensPerNs);
+}
+
+static void SNBTokenBucketSetLimit(SNBTokenBucket *bucket, uint32_t limit, double periodNs, uint64_t nowNs) {
+    if ((double)limit == bucket->limit) {
+        return;
+    }
+    if (bucket->limit <= 0.0) {
+        SNBTokenBucketInit(bucket, limit, periodNs, nowNs);
+        return;
+    }
+    SNBTokenBucketRefill(bucket, nowNs);
+    double spent = bucket->limit - bucket->tokens;
+    SNBTokenBucketInit(bucket, limit, periodNs, nowNs);
+    if (limit > 0) {
+        bucket->tokens = spent < bucket->limit ? bucket->limit - spent : 0.0;
+    }
+}
+
+void SNBRequestBudgetInit(SNBRequestBudget *budget, uint32_t perMinute, uint32_t perDay, uint64_t nowNs) {
+    SNBTokenBucketInit(&budget->minute, perMinute, SNB_NS_PER_MINUTE, nowNs);
+    SNBTokenBucketInit(&budget->day, perDay, SNB_NS_PER_DAY, nowNs);
+}
+
+void SNBRequestBudgetSetLimits(SNBRequestBudget *budget, uint32_t perMinute, uint32_t perDay, uint64_t nowNs) {
+    SNBTokenBucketSetLimit(&budget->minute, perMinute, SNB_NS_PER_MINUTE, nowNs);
+    SNBTokenBucketSetLimit(&budget->day, perDay, SNB_NS_PER_DAY, nowNs);
+}
+
+uint64_t SNBRequestBudgetDelayNs(SNBRequestBudget *budget, uint64_t nowNs) {
+    uint64_t minuteDelay = SNBTokenBucketDelayNs(&budget->minute, nowNs);
+    uint64_t dayDelay = SNBTokenBucketDelayNs(&budget->day, nowNs);
+    return minuteDelay > dayDelay ? minuteDelay : dayDelay;
+}
+
+bool SNBRequestBudgetTryTake(SNBRequestBudget *budget, uint64_t nowNs) {
+    if (SNBRequestBudgetDelayNs(budget, nowNs) > 0) {
+        return false;
+    }
+    if (budget->minute.limit > 0.0) {
+        budget->minute.tokens -= 1.0;
+    }
+    if (budget->day.limit > 0.0) {
+        budget->day.tokens -= 1.0;
+    }
+    return true;
+}
+
+uint32_t SNBRequestBudgetRemainingToday(SNBRequestBudget *budget, uint64_t nowNs) {
+    if (budget->day.limit <= 0.0) {
+        return UINT32_MAX;
+    }
+    SNBTokenBucketRefill(&budget->day, nowNs);
+    return (uint32_t)budget->day.tokens;
+}
+
+// MARK: - Queue
+
+// A binary max-heap of slot numbers with each slot's position recorded, so
+// updates and removals of arbitrary slots are O(log n). Free slots are
+// chained through next.
+struct SNBRequestQueue {
+    uint32_t *heap;
+    uint32_t *position;       // Heap index of each slot, NO_SLOT when free
+    uint32_t *next;           // Free list
+    double *priority;
+    uint64_t *sequence;
+    uint32_t capacity;
+    uint32_t count;
+    uint32_t freeHead;
+    uint64_t nextSequence;
+};
+
+static bool SNBRequestQueueGrow(SNBRequestQueue *queue, uint32_t capacity) {
+    uint32_t *heap = realloc(queue->heap, (size_t)capacity * sizeof(uint32_t));
+    if (heap) {
+        queue->heap = heap;
+    }
+    uint32_t *position = realloc(queue->position, (size_t)capacity * sizeof(uint32_t));
+    if (position) {
+        queue->position = position;
+    }
+    uint32_t *next = realloc(queue->next, (size_t)capacity * sizeof(uint32_t));
+    if (next) {
+        queue->next = next;
+    }
+    double *priority = realloc(queue->priority, (size_t)capacity * sizeof(double));
+    if (priority) {
+        queue->priority = priority;
+    }
+    uint64_t *sequence = realloc(queue->sequence, (size_t)capacity * sizeof(uint64_t));
+    if (sequence) {
+        queue->sequence = sequence;
+    }
+    if (!heap || !position || !next || !priority || !sequence) {
+        return false;
+    }
+
+    // Chain the new slots in ascending order in front of the free list
+    for (uint32_t slot = queue->capacity; slot < capacity; slot++) {
+        queue->position[slot] = SNB_REQUEST_QUEUE_NO_SLOT;
+        queue->next[slot] = slot + 1 < capacity ? slot + 1 : queue->freeHead;
+    }
+    queue->freeHead = queue->capacity;
+    queue->capacity = capacity;
+    return true;
+}
+
+SNBRequestQueue *SNBRequestQueueCreate(uint32_t initialCapacity) {
+    SNBRequestQueue *queue = calloc(1, sizeof(SNBRequestQueue));
+    if (!queue) {
+        return NULL;
+    }
+    queue->freeHead = SNB_REQUEST_QUEUE_NO_SLOT;
+    if (!SNBRequestQueueGrow(queue, initialCapacity > 0 ? initialCapacity : 16)) {
+        SNBRequestQueueDestroy(queue);
+        return NULL;
+    }
+    return queue;
+}
+
+void SNBRequestQueueDestroy(SNBRequestQueue *queue) {
+    if (!queue) {
+        return;
+    }
+    free(queue->heap);
+    free(queue->position);
+    free(queue->next);
+    free(queue->priority);
+    free(queue->sequence);
+    free(queue);
+}
+
+static bool SNBRequestQueueBefore(const SNBRequestQueue *queue, uint32_t a, uint32_t b) {
+    if (queue->priority[a] != queue->priority[b]) {
+        return queue->priority[a] > queue->priority[b];
+    }
+    return queue->sequence[a] < queue->sequence[b];
+}
+
+static void SNBRequestQueuePlace(SNBRequestQueue *queue, uint32_t index, uint32_t slot) {
+    queue->heap[index] = slot;
+    queue->position[slot] = index;
+}
+
+static void SNBRequestQueueSiftUp(SNBRequestQueue *queue, uint32_t index) {
+    uint32_t slot = queue->heap[index];
+    while (index > 0) {
+        uint32_t parent = (index - 1) / 2;
+        if (!SNBRequestQueueBefore(queue, slot, queue->heap[parent])) {
+            break;
+        }
+        SNBRequestQueuePlace(queue, index, queue->heap[parent]);
+        index = parent;
+    }
+    SNBRequestQueuePlace(queue, index, slot);
+}
+
+static void SNBRequestQueueSiftDown(SNBRequestQueue *queue, uint32_t index) {
+    uint32_t slot = queue->heap[index];
+    for (;;) {
+        uint32_t child = 2 * index + 1;
+        if (child >= queue->count) {
+            break;
+        }
+        if (child + 1 < queue->count && SNBRequestQueueBefore(queue, queue->heap[child + 1], queue->heap[child])) {
+            child++;
+        }
+        if (!SNBRequestQueueBefore(queue, queue->heap[child], slot)) {
+            break;
+        }
+        SNBRequestQueuePlace(queue, index, queue->heap[child]);
+        index = child;
+    }
+    SNBRequestQueuePlace(queue, index, slot);
+}
+
+uint32_t SNBRequestQueuePush(SNBRequestQueue *queue, double priority) {
+    if (queue->freeHead == SNB_REQUEST_QUEUE_NO_SLOT) {
+        if (queue->capacity >= UINT32_MAX / 2 || !SNBRequestQueueGrow(queue, queue->capacity * 2)) {
+            return SNB_REQUEST_QUEUE_NO_SLOT;
+        }
+    }
+    uint32_t slot = queue->freeHead;
+    queue->freeHead = queue->next[slot];
+    queue->priority[slot] = isnan(priority) ? 0.0 : priority;
+    queue->sequence[slot] = queue->nextSequence++;
+    uint32_t index = queue->count++;
+    SNBRequestQueuePlace(queue, index, slot);
+    SNBRequestQueueSiftUp(queue, index);
+    return slot;
+}
+
+void SNBRequestQueueUpdate(SNBRequestQueue *queue, uint32_t slot, double priority) {
+    if (!SNBRequestQueueContains(queue, slot)) {
+        return;
+    }
+    double previous = queue->priority[slot];
+    queue->priority[slot] = isnan(priority) ? 0.0 : priority;
+    if (queue->priority[slot] > previous) {
+        SNBRequestQueueSiftUp(queue, queue->position[slot]);
+    } else {
+        SNBRequestQueueSiftDown(queue, queue->position[slot]);
+    }
+}
+
+void SNBRequestQueueRemove(SNBRequestQueue *queue, uint32_t slot) {
+    if (!SNBRequestQueueContains(queue, slot)) {
+        return;
+    }
+    uint32_t index = queue->position[slot];
+    uint32_t last = queue->heap[--queue->count];
+    queue->position[slot] = SNB_REQUEST_QUEUE_NO_SLOT;
+    queue->next[slot] = queue->freeHead;
+    queue->freeHead = slot;
+    if (index == queue->count) {
+        return;
+    }
+    // The last element fills the hole and moves whichever way it belongs
+    SNBRequestQueuePlace(queue, index, last);
+    SNBRequestQueueSiftUp(queue, index);
+    SNBRequestQueueSiftDown(queue, queue->position[last]);
+}
+
+uint32_t SNBRequestQueuePeek(const SNBRequestQueue *queue) {
+    return queue->count > 0 ? queue->heap[0] : SNB_REQUEST_QUEUE_NO_SLOT;
+}
+
+uint32_t SNBRequestQueuePop(SNBRequestQueue *queue) {
+    uint32_t slot = SNBRequestQueuePeek(queue);
+    if (slot != SNB_REQUEST_QUEUE_NO_SLOT) {
+        SNBRequestQueueRemove(queue, slot);
+    }
+    return slot;
+}
+
+bool SNBRequestQueueContains(const SNBRequestQueue *queue, uint32_t slot) {
+    return slot < queue->capacity && queue->position[slot] != SNB_REQUEST_QUEUE_NO_SLOT;
+}
+
+double SNBRequestQueuePriority(const SNBRequestQueue *queue, uint32_t slot) {
+    return SNBRequestQueueContains(queue, slot) ? queue->priority[slot] : 0.0;
+}
+
+uint32_t SNBRequestQueueCount(const SNBRequestQueue *queue) {
+    return queue->count;
+}
+
+// MARK: - Priority
+
+double SNBRequestPriorityScore(uint64_t bytes, double anomalyScore, double idleSeconds) {
+    double anomaly = anomalyScore > 0.0 ? (anomalyScore < 1.0 ? anomalyScore : 1.0) : 0.0;
+    double idle = idleSeconds > 0.0 ? idleSeconds : 0.0;
+    double traffic = 1.0 + log2(1.0 + (double)bytes);
+    return traffic * (1.0 + 4.0 * anomaly) * exp2(-idle / 300.0);
+}
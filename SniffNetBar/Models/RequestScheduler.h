@@ -0,0 +1,85 @@
+//
+//  RequestScheduler.h
+//  SniffNetBar
+//
+//  Token-bucket budgets and a priority queue for rate-limited lookups
+//
+
+#ifndef SNB_REQUEST_SCHEDULER_H
+#define SNB_REQUEST_SCHEDULER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// The building blocks of the threat-intel scheduler (ThreatIntelFacade.m):
+// a budget says when a provider may be called again, and a queue says which
+// waiting lookup goes next. Both are plain data with O(1) or O(log n)
+// operations and no clock of their own; callers pass monotonic nanoseconds.
+// Not thread-safe.
+
+// MARK: - Budgets
+
+// Refills continuously at limit per period, holding at most limit tokens,
+// so a full bucket allows a burst of limit calls and then one call every
+// period / limit. A limit of 0 means unlimited.
+typedef struct {
+    double tokens;
+    double limit;
+    double tokensPerNs;
+    uint64_t updatedNs;
+} SNBTokenBucket;
+
+// A provider's per-minute and per-day allowance. A call spends a token from
+// both buckets or from neither.
+typedef struct {
+    SNBTokenBucket minute;
+    SNBTokenBucket day;
+} SNBRequestBudget;
+
+// Starts with full buckets
+void SNBRequestBudgetInit(SNBRequestBudget *budget, uint32_t perMinute, uint32_t perDay, uint64_t nowNs);
+// Changes the limits, keeping what was already spent in the current period
+void SNBRequestBudgetSetLimits(SNBRequestBudget *budget, uint32_t perMinute, uint32_t perDay, uint64_t nowNs);
+bool SNBRequestBudgetTryTake(SNBRequestBudget *budget, uint64_t nowNs);
+// Nanoseconds until TryTake can succeed; 0 if it can now
+uint64_t SNBRequestBudgetDelayNs(SNBRequestBudget *budget, uint64_t nowNs);
+// Whole calls left today
+uint32_t SNBRequestBudgetRemainingToday(SNBRequestBudget *budget, uint64_t nowNs);
+
+// MARK: - Queue
+
+#define SNB_REQUEST_QUEUE_NO_SLOT UINT32_MAX
+
+typedef struct SNBRequestQueue SNBRequestQueue;
+
+// Like CacheIndex.h, the queue hands out slot numbers and orders them, while
+// the caller keeps what each slot stands for. Highest priority pops first;
+// equal priorities pop in the order they were pushed. Returns NULL on
+// allocation failure.
+SNBRequestQueue *SNBRequestQueueCreate(uint32_t initialCapacity);
+void SNBRequestQueueDestroy(SNBRequestQueue *queue);
+
+// Returns SNB_REQUEST_QUEUE_NO_SLOT if the queue could not grow
+uint32_t SNBRequestQueuePush(SNBRequestQueue *queue, double priority);
+// Moves a queued slot up or down; keeps its place among equal priorities
+void SNBRequestQueueUpdate(SNBRequestQueue *queue, uint32_t slot, double priority);
+void SNBRequestQueueRemove(SNBRequestQueue *queue, uint32_t slot);
+// The slot that would pop next, or SNB_REQUEST_QUEUE_NO_SLOT when empty
+uint32_t SNBRequestQueuePeek(const SNBRequestQueue *queue);
+// Removes and returns the next slot. The number may be handed out again by
+// the next push, so the caller takes its object out first.
+uint32_t SNBRequestQueuePop(SNBRequestQueue *queue);
+bool SNBRequestQueueContains(const SNBRequestQueue *queue, uint32_t slot);
+double SNBRequestQueuePriority(const SNBRequestQueue *queue, uint32_t slot);
+uint32_t SNBRequestQueueCount(const SNBRequestQueue *queue);
+
+// MARK: - Priority
+
+// Orders lookups by how much traffic a destination carries (log-scaled, so
+// a bulk download does not drown everything else), how anomalous it looked
+// (0...1, multiplying the traffic term up to five times) and how recently
+// it was active (halving every five minutes of silence).
+double SNBRequestPriorityScore(uint64_t bytes, double anomalyScore, double idleSeconds);
+
+#endif
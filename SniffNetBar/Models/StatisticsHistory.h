@@ -7,7 +7,8 @@
 
 #import <Foundation/Foundation.h>
 
-@class PacketInfo;
+@class SNBPacketBatch;
+@class ThreatIntelStore;
 
 NS_ASSUME_NONNULL_BEGIN
 
@@ -16,9 +17,19 @@ NS_ASSUME_NONNULL_BEGIN
 @property (nonatomic, assign, getter=isEnabled) BOOL enabled;
 
 - (instancetype)init;
-- (void)processPacket:(PacketInfo *)packetInfo;
+// Keeps the database, the report and its cached fragments in directory
+// rather than Application Support and reads threat scores from
+// threatIntelStore, e.g. for tests. A nil templatePath uses the bundled
+// report template.
+- (instancetype)initWithDirectory:(NSString *)directory
+                 threatIntelStore:(ThreatIntelStore *)threatIntelStore
+                     templatePath:(nullable NSString *)templatePath;
+- (void)processPacketBatch:(SNBPacketBatch *)batch;
 - (void)flush;
+// Reports are written in the background from what has been flushed so far
 - (void)generateReport;
+// Calls completion on the main queue once the report has been written
+- (void)generateReportWithCompletion:(nullable void (^)(NSString *path))completion;
 - (NSString *)reportPath;
 - (BOOL)reportExists;
 
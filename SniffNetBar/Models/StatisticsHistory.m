@@ -6,18 +6,24 @@
 //
 
 #import "StatisticsHistory.h"
-#import "PacketInfo.h"
+#import "PacketBatch.h"
+#import "FlowTable.h"
+#import "PacketClock.h"
+#import "TimeSeries.h"
 #import "ByteFormatter.h"
 #import "Logger.h"
 #import "ThreatIntelModels.h"
 #import "ThreatIntelStore.h"
 #import <sqlite3.h>
+#import <stdatomic.h>
+#import <errno.h>
 #import <ifaddrs.h>
 #import <arpa/inet.h>
 #import <netinet/in.h>
 
 static NSString * const kStatsDatabaseFilename = @"traffic_stats.sqlite";
 static NSString * const kReportFilename = @"traffic_report.html";
+static NSString * const kReportFragmentDirectory = @"report_days";
 static const NSTimeInterval kStatsFlushInterval = 300.0;
 static const NSUInteger kStatsMaxStoredDays = 90;
 
@@ -44,49 +50,186 @@ static NSString * const kMaliciousKeyIndicator = @"indicator";
 static NSString * const kMaliciousKeyResponse = @"response";
 static NSString * const kMaliciousKeyScore = @"score";
 
-@interface SNBConnectionStats : NSObject
-@property (nonatomic, copy) NSString *sourceAddress;
-@property (nonatomic, copy) NSString *destinationAddress;
-@property (nonatomic, assign) NSInteger sourcePort;
-@property (nonatomic, assign) NSInteger destinationPort;
-@property (nonatomic, assign) uint64_t bytes;
-@property (nonatomic, assign) uint64_t packets;
-@end
+// Rows of hosts and connections held between flushes; reaching either
+// starts an early flush, so a day of any size needs the same memory
+static const size_t kStatsPendingRowLimit = 131072;
+
+// Statements every flush runs, prepared on first use and kept until the
+// database closes
+typedef NS_ENUM(NSUInteger, SNBHistoryStatement) {
+    SNBHistoryStatementInsertHost,
+    SNBHistoryStatementUpdateHost,
+    SNBHistoryStatementUpsertConnection,
+    SNBHistoryStatementUpsertDay,
+    SNBHistoryStatementUpsertSeries,
+    SNBHistoryStatementDeleteSeries,
+    SNBHistoryStatementCount
+};
+
+static const char * const kHistoryStatementSQL[SNBHistoryStatementCount] = {
+    // A host is new to the day exactly when the insert goes through, which
+    // keeps the day's host count without counting its rows
+    [SNBHistoryStatementInsertHost] =
+        "INSERT OR IGNORE INTO stats_hosts (day, host, bytes, packets) VALUES (?, ?, ?, ?);",
+    [SNBHistoryStatementUpdateHost] =
+        "UPDATE stats_hosts SET bytes = bytes + ?3, packets = packets + ?4 WHERE day = ?1 AND host = ?2;",
+    [SNBHistoryStatementUpsertConnection] =
+        "INSERT INTO stats_connections (day, src_addr, src_port, dst_addr, dst_port, bytes, packets) "
+        "VALUES (?, ?, ?, ?, ?, ?, ?) "
+        "ON CONFLICT(day, src_addr, src_port, dst_addr, dst_port) DO UPDATE SET "
+        "bytes=stats_connections.bytes + excluded.bytes, packets=stats_connections.packets + excluded.packets;",
+    [SNBHistoryStatementUpsertDay] =
+        "INSERT INTO stats_days "
+        "(day, total_bytes, total_packets, max_rate, max_connections, unique_hosts, first_seen, last_seen, active_seconds) "
+        "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?) "
+        "ON CONFLICT(day) DO UPDATE SET "
+        "total_bytes=excluded.total_bytes, "
+        "total_packets=excluded.total_packets, "
+        "max_rate=excluded.max_rate, "
+        "max_connections=excluded.max_connections, "
+        "unique_hosts=excluded.unique_hosts, "
+        "first_seen=excluded.first_seen, "
+        "last_seen=excluded.last_seen, "
+        "active_seconds=excluded.active_seconds;",
+    [SNBHistoryStatementUpsertSeries] =
+        "INSERT INTO stats_series "
+        "(resolution, bucket_start, bytes_in, bytes_out, packets_in, packets_out, connections_in, connections_out) "
+        "VALUES (?, ?, ?, ?, ?, ?, ?, ?) "
+        "ON CONFLICT(resolution, bucket_start) DO UPDATE SET "
+        "bytes_in=excluded.bytes_in, bytes_out=excluded.bytes_out, "
+        "packets_in=excluded.packets_in, packets_out=excluded.packets_out, "
+        "connections_in=excluded.connections_in, connections_out=excluded.connections_out;",
+    [SNBHistoryStatementDeleteSeries] =
+        "DELETE FROM stats_series WHERE resolution = ? AND bucket_start < ?;",
+};
+
+// Rows written by flushes since launch, to keep an eye on write amplification
+typedef struct {
+    uint64_t flushes;
+    uint64_t hostRows;
+    uint64_t connectionRows;
+    uint64_t seriesRows;
+} SNBHistoryFlushCounters;
+
+// Aggregates of the day being captured. Hosts and connections only live in
+// memory until the next flush, which adds them to the day's rows.
+typedef struct {
+    uint64_t totalBytes;
+    uint64_t totalPackets;
+    uint64_t maxRate;
+    uint64_t maxConnections;
+    uint64_t uniqueHosts;        // Hosts stored for the day as of the last flush
+    NSTimeInterval firstSeen;
+    NSTimeInterval lastSeen;
+    NSTimeInterval activeSeconds;
+} SNBHistoryDay;
+
+// Per-flush counters live inline in flow tables keyed by binary addresses;
+// addresses are only formatted when the deltas are written to the database.
+typedef struct {
+    uint64_t bytes;
+    uint64_t packets;
+} SNBHistoryHostCounters;
+
+typedef struct {
+    uint64_t bytes;
+    uint64_t packets;
+    int64_t lastSecond;          // Second in which the connection was last counted as active
+} SNBHistoryConnectionCounters;
+
+static const char *SNBHistoryFormatAddress(uint8_t family, const uint8_t *address, char *buffer, socklen_t length) {
+    int af = (family == SNBAddressFamilyIPv6) ? AF_INET6 : AF_INET;
+    return inet_ntop(af, address, buffer, length) ?: "";
+}
 
-@implementation SNBConnectionStats
-@end
+static void SNBReportWrite(FILE *file, NSString *string) {
+    const char *utf8 = string.UTF8String;
+    if (utf8) {
+        fputs(utf8, file);
+    }
+}
 
-@interface SNBStatisticsHistory ()
+// Appends a cached fragment; NO if there is none to read
+static BOOL SNBReportCopyFile(NSString *path, FILE *output) {
+    FILE *input = fopen(path.fileSystemRepresentation, "r");
+    if (!input) {
+        return NO;
+    }
+    char buffer[65536];
+    size_t length;
+    while ((length = fread(buffer, 1, sizeof(buffer), input)) > 0) {
+        fwrite(buffer, 1, length, output);
+    }
+    fclose(input);
+    return YES;
+}
+
+@interface SNBStatisticsHistory () {
+    // Capture time the history runs on; owned by statsQueue
+    SNBPacketClock _packetClock;
+    SNBHistoryDay _day;
+    // Traffic by second, minute and hour, across days
+    SNBTimeSeries _series;
+    // Oldest minute and hour bucket the next flush writes
+    int64_t _seriesFlushStart[SNBTimeSeriesResolutionCount];
+    // Set while a report waits on reportQueue
+    atomic_bool _reportQueued;
+    sqlite3_stmt *_statements[SNBHistoryStatementCount];
+    SNBHistoryFlushCounters _flushCounters;
+}
 @property (nonatomic, strong) dispatch_queue_t statsQueue;
+// Builds and writes the report, off statsQueue so packets keep flowing
+@property (nonatomic, strong) dispatch_queue_t reportQueue;
 @property (nonatomic, strong) dispatch_source_t flushTimer;
-@property (nonatomic, strong) NSMutableDictionary *currentDayRecord;
+@property (nonatomic, assign) BOOL hasCurrentDay;
 @property (nonatomic, copy) NSString *currentDayString;
+// Local midnights starting and ending currentDayString, in Unix seconds
+@property (nonatomic, assign) NSTimeInterval currentDayStart;
+@property (nonatomic, assign) NSTimeInterval currentDayEnd;
 @property (nonatomic, assign) NSTimeInterval currentSecond;
-@property (nonatomic, assign) uint64_t bytesThisSecond;
-@property (nonatomic, strong) NSMutableSet<NSString *> *connectionsThisSecond;
-@property (nonatomic, strong) NSMutableSet<NSString *> *uniqueHosts;
-@property (nonatomic, strong) NSMutableDictionary<NSString *, NSNumber *> *hostBytes;
-@property (nonatomic, strong) NSMutableDictionary<NSString *, NSNumber *> *hostPackets;
-@property (nonatomic, strong) NSMutableDictionary<NSString *, SNBConnectionStats *> *connectionStats;
+// Remote hosts and raw source -> destination connections since the last flush
+@property (nonatomic, assign) SNBFlowTable *hostTable;
+@property (nonatomic, assign) SNBFlowTable *connectionTable;
 @property (nonatomic, strong) NSSet<NSString *> *localAddresses;
 @property (nonatomic, assign) sqlite3 *db;
+// Day whose flush last applied the retention limit
+@property (nonatomic, copy) NSString *retentionDay;
+// The report's own connection; owned by reportQueue
+@property (nonatomic, assign) sqlite3 *reportDb;
 @property (nonatomic, strong) ThreatIntelStore *threatIntelStore;
+// Holds the database, the report and the fragment cache
+@property (nonatomic, copy) NSString *directory;
+@property (nonatomic, copy, nullable) NSString *templatePath;
 @end
 
 @implementation SNBStatisticsHistory
 
 - (instancetype)init {
+    return [self initWithDirectory:[[self class] applicationSupportDirectory]
+                  threatIntelStore:[[ThreatIntelStore alloc] initWithTTLSeconds:0]
+                      templatePath:nil];
+}
+
+- (instancetype)initWithDirectory:(NSString *)directory
+                 threatIntelStore:(ThreatIntelStore *)threatIntelStore
+                     templatePath:(NSString *)templatePath {
     self = [super init];
     if (self) {
+        _directory = [directory copy];
+        _templatePath = [templatePath copy];
         _statsQueue = dispatch_queue_create("com.sniffnetbar.stats.history", DISPATCH_QUEUE_SERIAL);
-        _connectionsThisSecond = [NSMutableSet set];
-        _uniqueHosts = [NSMutableSet set];
-        _hostBytes = [NSMutableDictionary dictionary];
-        _hostPackets = [NSMutableDictionary dictionary];
-        _connectionStats = [NSMutableDictionary dictionary];
+        _reportQueue = dispatch_queue_create("com.sniffnetbar.stats.report",
+                                             dispatch_queue_attr_make_with_qos_class(DISPATCH_QUEUE_SERIAL,
+                                                                                     QOS_CLASS_UTILITY, 0));
+        atomic_init(&_reportQueued, false);
+        _hostTable = SNBFlowTableCreate(sizeof(SNBHistoryHostCounters), 1024);
+        _connectionTable = SNBFlowTableCreate(sizeof(SNBHistoryConnectionCounters), 1024);
+        if (!SNBTimeSeriesInit(&_series)) {
+            SNBLogWarn("Failed to allocate the traffic time series");
+        }
         _localAddresses = [self loadLocalAddresses];
         _enabled = YES;
-        _threatIntelStore = [[ThreatIntelStore alloc] initWithTTLSeconds:0];
+        _threatIntelStore = threatIntelStore;
 
         [self openDatabase];
         [self ensureSchema];
@@ -101,17 +244,27 @@ static NSString * const kMaliciousKeyScore = @"score";
     if (_flushTimer) {
         dispatch_source_cancel(_flushTimer);
     }
+    for (NSUInteger i = 0; i < SNBHistoryStatementCount; i++) {
+        sqlite3_finalize(_statements[i]);
+    }
     if (_db) {
         sqlite3_close(_db);
         _db = NULL;
     }
+    if (_reportDb) {
+        sqlite3_close(_reportDb);
+        _reportDb = NULL;
+    }
+    SNBFlowTableDestroy(_hostTable);
+    SNBFlowTableDestroy(_connectionTable);
+    SNBTimeSeriesDestroy(&_series);
 }
 
 - (void)setEnabled:(BOOL)enabled {
     _enabled = enabled;
     dispatch_async(self.statsQueue, ^{
         if (!enabled) {
-            [self finalizeCurrentSecondBucketWithTimestamp:[NSDate date].timeIntervalSince1970];
+            [self finalizeCurrentSecondBucketWithTimestamp:SNBPacketClockNow(&self->_packetClock)];
             [self finalizeCurrentDayIfNeeded];
             [self persistToDatabase];
             [self generateReportLocked];
@@ -119,8 +272,8 @@ static NSString * const kMaliciousKeyScore = @"score";
     });
 }
 
-- (void)processPacket:(PacketInfo *)packetInfo {
-    if (!packetInfo || packetInfo.totalBytes == 0) {
+- (void)processPacketBatch:(SNBPacketBatch *)batch {
+    if (batch.count == 0) {
         return;
     }
     if (!self.enabled) {
@@ -128,31 +281,94 @@ static NSString * const kMaliciousKeyScore = @"score";
     }
 
     dispatch_async(self.statsQueue, ^{
-        NSDate *now = [NSDate date];
-        [self ensureCurrentDayForDate:now];
-        if (!self.currentDayRecord) {
-            [self startNewDayWithDate:now];
+        [self processRecordsLocked:batch.records count:batch.count];
+    });
+}
+
+// Runs once per packet; steady-state traffic never allocates here. Second
+// buckets and days follow the capture timestamps, so a replayed capture lands
+// in the buckets and day records it was recorded in. Day boundaries are local
+// midnights, which are also second boundaries, so one comparison per packet
+// covers both going forward; packets from before the day's start, as from a
+// replay of an older capture, switch back to their own day.
+- (void)processRecordsLocked:(const SNBPacketRecord *)records count:(NSUInteger)count {
+    int64_t second = (int64_t)self.currentSecond;
+    NSTimeInterval nextBoundary = self.hasCurrentDay ? MIN(self.currentSecond + 1, self.currentDayEnd) : -INFINITY;
+    NSTimeInterval dayStart = self.currentDayStart;
+    NSTimeInterval lastSeen = 0;
+    uint64_t bytes = 0;
+    uint64_t packets = 0;
+
+    for (NSUInteger i = 0; i < count; i++) {
+        const SNBPacketRecord *record = &records[i];
+        if (record->length == 0) {
+            continue;
+        }
+        NSTimeInterval timestamp = SNBPacketRecordTime(record);
+        if (timestamp >= nextBoundary || timestamp < dayStart) {
+            [self addBytes:bytes packets:packets lastSeen:lastSeen];
+            bytes = 0;
+            packets = 0;
+            lastSeen = 0;
+            [self advanceToTimestampLocked:timestamp];
+            second = (int64_t)self.currentSecond;
+            nextBoundary = MIN(self.currentSecond + 1, self.currentDayEnd);
+            dayStart = self.currentDayStart;
+        }
+        bytes += record->length;
+        packets++;
+        lastSeen = MAX(lastSeen, timestamp);
+
+        // Late packets count towards the open second, as for the day maxima
+        SNBTrafficDirection direction = (record->flags & SNBPacketRecordFlagOutgoing) ? SNBTrafficOutgoing : SNBTrafficIncoming;
+        SNBTimeSeriesAddTraffic(&_series, second, direction, record->length, 1);
+        if (record->family == SNBAddressFamilyNone) {
+            continue;
         }
 
-        [self updateSecondBucketsWithDate:now packet:packetInfo];
+        // Connections are keyed as captured, without the protocol
+        SNBFlowKey key;
+        SNBFlowKeyMakeRecord(&key, record);
+        key.ipProtocol = 0;
+        SNBHistoryConnectionCounters *connection = SNBFlowTableUpsert(self.connectionTable, &key, NULL);
+        if (connection) {
+            connection->bytes += record->length;
+            connection->packets++;
+            if (connection->lastSecond != second) {
+                SNBTimeSeriesAddConnection(&_series, second, direction, connection->lastSecond);
+                connection->lastSecond = second;
+            }
+        }
 
-        uint64_t totalBytes = [self.currentDayRecord[kStatsKeyTotalBytes] unsignedLongLongValue];
-        totalBytes += packetInfo.totalBytes;
-        self.currentDayRecord[kStatsKeyTotalBytes] = @(totalBytes);
+        // Traffic between two local addresses has no remote host
+        if (record->flags & SNBPacketRecordFlagBothLocal) {
+            continue;
+        }
+        const uint8_t *remote = (record->flags & SNBPacketRecordFlagOutgoing) ? record->destinationAddress : record->sourceAddress;
+        SNBFlowKeyMakeAddress(&key, record->family, remote);
+        SNBHistoryHostCounters *host = SNBFlowTableUpsert(self.hostTable, &key, NULL);
+        if (host) {
+            host->bytes += record->length;
+            host->packets++;
+        }
+    }
 
-        uint64_t totalPackets = [self.currentDayRecord[kStatsKeyTotalPackets] unsignedLongLongValue];
-        totalPackets += 1;
-        self.currentDayRecord[kStatsKeyTotalPackets] = @(totalPackets);
+    [self addBytes:bytes packets:packets lastSeen:lastSeen];
+    SNBPacketClockAdvance(&_packetClock, records, count, SNBWallClockNs());
+}
 
-        self.currentDayRecord[kStatsKeyLastSeen] = @([now timeIntervalSince1970]);
-        [self updateHostStatsForPacket:packetInfo];
-        [self updateConnectionStatsForPacket:packetInfo];
-    });
+- (void)addBytes:(uint64_t)bytes packets:(uint64_t)packets lastSeen:(NSTimeInterval)lastSeen {
+    if (packets == 0 || !self.hasCurrentDay) {
+        return;
+    }
+    _day.totalBytes += bytes;
+    _day.totalPackets += packets;
+    _day.lastSeen = MAX(_day.lastSeen, lastSeen);
 }
 
 - (void)flush {
     dispatch_async(self.statsQueue, ^{
-        [self finalizeCurrentSecondBucketWithTimestamp:[NSDate date].timeIntervalSince1970];
+        [self finalizeCurrentSecondBucketWithTimestamp:SNBPacketClockNow(&self->_packetClock)];
         [self finalizeCurrentDayIfNeeded];
         [self persistToDatabase];
         [self generateReportLocked];
@@ -165,8 +381,16 @@ static NSString * const kMaliciousKeyScore = @"score";
     });
 }
 
+- (void)generateReportWithCompletion:(void (^)(NSString *path))completion {
+    dispatch_async(self.statsQueue, ^{
+        [self refreshCurrentDaySnapshot];
+        [self persistToDatabase];
+        [self scheduleReportWithCompletion:completion];
+    });
+}
+
 - (NSString *)reportPath {
-    return [[self applicationSupportDirectory] stringByAppendingPathComponent:kReportFilename];
+    return [self.directory stringByAppendingPathComponent:kReportFilename];
 }
 
 - (BOOL)reportExists {
@@ -175,170 +399,101 @@ static NSString * const kMaliciousKeyScore = @"score";
 
 #pragma mark - Day and Second Tracking
 
-- (void)ensureCurrentDayForDate:(NSDate *)date {
+// Called when a packet reaches the current second's or day's end, falls
+// before the day's start, or before the first packet, so the formatter and
+// calendar only run at day boundaries
+- (void)advanceToTimestampLocked:(NSTimeInterval)timestamp {
+    if (timestamp >= self.currentDayEnd || timestamp < self.currentDayStart) {
+        [self ensureCurrentDayForTimestamp:timestamp];
+    }
+    if (!self.hasCurrentDay) {
+        [self startNewDayWithDate:[NSDate dateWithTimeIntervalSince1970:timestamp]];
+    }
+    [self advanceSecondBucketToTimestamp:timestamp];
+
+    // A flush folds the pending rows into the database, which keeps a busy
+    // or replayed day within a fixed number of rows in memory
+    if (SNBFlowTableCount(self.connectionTable) >= kStatsPendingRowLimit ||
+        SNBFlowTableCount(self.hostTable) >= kStatsPendingRowLimit) {
+        [self persistToDatabase];
+    }
+}
+
+- (void)ensureCurrentDayForTimestamp:(NSTimeInterval)timestamp {
+    NSDate *date = [NSDate dateWithTimeIntervalSince1970:timestamp];
+    NSCalendar *calendar = [NSCalendar currentCalendar];
+    NSDate *dayStart = [calendar startOfDayForDate:date];
+    NSDate *dayEnd = [calendar dateByAddingUnit:NSCalendarUnitDay value:1 toDate:dayStart options:0];
+    self.currentDayStart = dayStart.timeIntervalSince1970;
+    self.currentDayEnd = dayEnd.timeIntervalSince1970;
+
     NSString *dayString = [self dayStringFromDate:date];
     if (!self.currentDayString) {
         self.currentDayString = dayString;
         return;
     }
     if (![self.currentDayString isEqualToString:dayString]) {
-        [self finalizeCurrentSecondBucketWithTimestamp:date.timeIntervalSince1970];
+        [self finalizeCurrentSecondBucketWithTimestamp:timestamp];
         [self finalizeCurrentDayIfNeeded];
         [self persistToDatabase];
         self.currentDayString = dayString;
-        self.currentDayRecord = nil;
-        [self.uniqueHosts removeAllObjects];
-        [self.hostBytes removeAllObjects];
-        [self.hostPackets removeAllObjects];
-        [self.connectionStats removeAllObjects];
-        [self.connectionsThisSecond removeAllObjects];
-        self.bytesThisSecond = 0;
+        self.hasCurrentDay = NO;
+        SNBFlowTableClear(self.hostTable);
+        SNBFlowTableClear(self.connectionTable);
         self.currentSecond = 0;
     }
 }
 
+// A day already in the database, from before a restart or from an earlier
+// replay of the same capture, carries on from its stored aggregates: flushes
+// write the day row whole, while host and connection rows are added to
 - (void)startNewDayWithDate:(NSDate *)date {
     NSString *dayString = [self dayStringFromDate:date];
+    NSTimeInterval timestamp = date.timeIntervalSince1970;
     self.currentDayString = dayString;
-    NSMutableDictionary *record = [NSMutableDictionary dictionary];
-    record[kStatsKeyDate] = dayString;
-    record[kStatsKeyTotalBytes] = @(0);
-    record[kStatsKeyTotalPackets] = @(0);
-    record[kStatsKeyMaxRate] = @(0);
-    record[kStatsKeyMaxConnections] = @(0);
-    record[kStatsKeyUniqueHosts] = @(0);
-    record[kStatsKeyFirstSeen] = @([date timeIntervalSince1970]);
-    record[kStatsKeyLastSeen] = @([date timeIntervalSince1970]);
-    self.currentDayRecord = record;
+    memset(&_day, 0, sizeof(_day));
+    if ([self loadDayFromDatabase:dayString]) {
+        _day.firstSeen = MIN(_day.firstSeen, timestamp);
+        _day.lastSeen = MAX(_day.lastSeen, timestamp);
+    } else {
+        _day.firstSeen = timestamp;
+        _day.lastSeen = timestamp;
+    }
+    self.hasCurrentDay = YES;
 }
 
+// Folds the open second into the day maxima and opens the one containing
+// timestamp
 - (void)finalizeCurrentSecondBucketWithTimestamp:(NSTimeInterval)timestamp {
-    if (!self.currentDayRecord || self.currentSecond == 0) {
+    if (!self.hasCurrentDay || self.currentSecond == 0) {
         return;
     }
-    if (self.bytesThisSecond > 0) {
-        uint64_t maxRate = [self.currentDayRecord[kStatsKeyMaxRate] unsignedLongLongValue];
-        if (self.bytesThisSecond > maxRate) {
-            self.currentDayRecord[kStatsKeyMaxRate] = @(self.bytesThisSecond);
-        }
-    }
-
-    NSUInteger connectionsCount = self.connectionsThisSecond.count;
-    if (connectionsCount > 0) {
-        NSUInteger maxConnections = [self.currentDayRecord[kStatsKeyMaxConnections] unsignedIntegerValue];
-        if (connectionsCount > maxConnections) {
-            self.currentDayRecord[kStatsKeyMaxConnections] = @(connectionsCount);
-        }
+    const SNBTimeSeriesBucket *bucket = SNBTimeSeriesFind(&_series, SNBTimeSeriesSecond, (int64_t)self.currentSecond);
+    if (bucket) {
+        uint64_t rate = bucket->bytes[SNBTrafficIncoming] + bucket->bytes[SNBTrafficOutgoing];
+        uint64_t connections = (uint64_t)bucket->connections[SNBTrafficIncoming] + bucket->connections[SNBTrafficOutgoing];
+        _day.maxRate = MAX(_day.maxRate, rate);
+        _day.maxConnections = MAX(_day.maxConnections, connections);
     }
-
-    [self.connectionsThisSecond removeAllObjects];
-    self.bytesThisSecond = 0;
     self.currentSecond = floor(timestamp);
 }
 
-- (void)updateSecondBucketsWithDate:(NSDate *)date packet:(PacketInfo *)packet {
-    NSTimeInterval now = [date timeIntervalSince1970];
-    NSTimeInterval second = floor(now);
+- (void)advanceSecondBucketToTimestamp:(NSTimeInterval)timestamp {
+    NSTimeInterval second = floor(timestamp);
     if (self.currentSecond == 0) {
         self.currentSecond = second;
     }
-    if (second != self.currentSecond) {
+    // Late packets count towards the open bucket; buckets never reopen
+    if (second > self.currentSecond) {
         [self finalizeCurrentSecondBucketWithTimestamp:second];
     }
-    self.bytesThisSecond += packet.totalBytes;
-    NSString *connectionKey = [self connectionKeyForPacket:packet];
-    if (connectionKey.length > 0) {
-        [self.connectionsThisSecond addObject:connectionKey];
-    }
 }
 
 - (void)finalizeCurrentDayIfNeeded {
-    if (!self.currentDayRecord) {
+    if (!self.hasCurrentDay) {
         return;
     }
-
-    NSTimeInterval firstSeen = [self.currentDayRecord[kStatsKeyFirstSeen] doubleValue];
-    NSTimeInterval lastSeen = [self.currentDayRecord[kStatsKeyLastSeen] doubleValue];
-    NSTimeInterval activeSeconds = MAX(1.0, lastSeen - firstSeen);
-    self.currentDayRecord[kStatsKeyActiveSeconds] = @(activeSeconds);
-
-    self.currentDayRecord[kStatsKeyUniqueHosts] = @(self.uniqueHosts.count);
-}
-
-- (void)updateHostStatsForPacket:(PacketInfo *)packet {
-    NSString *remoteAddress = [self remoteAddressForPacket:packet];
-    if (remoteAddress.length == 0) {
-        return;
-    }
-
-    [self.uniqueHosts addObject:remoteAddress];
-
-    NSNumber *existing = self.hostBytes[remoteAddress];
-    uint64_t bytes = existing ? existing.unsignedLongLongValue : 0;
-    bytes += packet.totalBytes;
-    self.hostBytes[remoteAddress] = @(bytes);
-    NSNumber *packetExisting = self.hostPackets[remoteAddress];
-    uint64_t packets = packetExisting ? packetExisting.unsignedLongLongValue : 0;
-    packets += 1;
-    self.hostPackets[remoteAddress] = @(packets);
-}
-
-- (void)updateConnectionStatsForPacket:(PacketInfo *)packet {
-    NSString *connectionKey = [self connectionKeyForPacket:packet];
-    if (connectionKey.length == 0) {
-        return;
-    }
-
-    SNBConnectionStats *stats = self.connectionStats[connectionKey];
-    if (!stats) {
-        stats = [[SNBConnectionStats alloc] init];
-        stats.sourceAddress = packet.sourceAddress ?: @"";
-        stats.destinationAddress = packet.destinationAddress ?: @"";
-        stats.sourcePort = packet.sourcePort;
-        stats.destinationPort = packet.destinationPort;
-        self.connectionStats[connectionKey] = stats;
-    }
-
-    stats.bytes += packet.totalBytes;
-    stats.packets += 1;
-}
-
-- (NSString *)remoteAddressForPacket:(PacketInfo *)packet {
-    NSString *source = packet.sourceAddress ?: @"";
-    NSString *destination = packet.destinationAddress ?: @"";
-    if (source.length == 0 && destination.length == 0) {
-        return nil;
-    }
-
-    BOOL isIncoming = [self isLocalAddress:destination];
-    BOOL isOutgoing = [self isLocalAddress:source];
-    if (isIncoming && isOutgoing) {
-        if (packet.sourcePort > 0 && packet.destinationPort > 0) {
-            isIncoming = packet.sourcePort < packet.destinationPort;
-            isOutgoing = !isIncoming;
-        }
-    } else if (!isIncoming && !isOutgoing) {
-        isIncoming = YES;
-        isOutgoing = NO;
-    }
-
-    NSString *remote = isIncoming ? source : destination;
-    if (remote.length == 0) {
-        return nil;
-    }
-    if ([self isLocalAddress:remote]) {
-        return nil;
-    }
-    return remote;
-}
-
-- (NSString *)connectionKeyForPacket:(PacketInfo *)packet {
-    if (packet.sourceAddress.length == 0 || packet.destinationAddress.length == 0) {
-        return nil;
-    }
-    return [NSString stringWithFormat:@"%@:%ld->%@:%ld",
-            packet.sourceAddress, (long)packet.sourcePort,
-            packet.destinationAddress, (long)packet.destinationPort];
+    _day.activeSeconds = MAX(1.0, _day.lastSeen - _day.firstSeen);
 }
 
 #pragma mark - Persistence
@@ -394,7 +549,7 @@ static NSString * const kMaliciousKeyScore = @"score";
         "bytes INTEGER NOT NULL, "
         "packets INTEGER NOT NULL, "
         "PRIMARY KEY (day, host)"
-        ");";
+        ") WITHOUT ROWID;";
     const char *createConnections =
         "CREATE TABLE IF NOT EXISTS stats_connections ("
         "day TEXT NOT NULL, "
@@ -405,198 +560,387 @@ static NSString * const kMaliciousKeyScore = @"score";
         "bytes INTEGER NOT NULL, "
         "packets INTEGER NOT NULL, "
         "PRIMARY KEY (day, src_addr, src_port, dst_addr, dst_port)"
+        ") WITHOUT ROWID;";
+    // Minute and hour buckets; resolution is the bucket width in seconds
+    const char *createSeries =
+        "CREATE TABLE IF NOT EXISTS stats_series ("
+        "resolution INTEGER NOT NULL, "
+        "bucket_start INTEGER NOT NULL, "
+        "bytes_in INTEGER NOT NULL, "
+        "bytes_out INTEGER NOT NULL, "
+        "packets_in INTEGER NOT NULL, "
+        "packets_out INTEGER NOT NULL, "
+        "connections_in INTEGER NOT NULL, "
+        "connections_out INTEGER NOT NULL, "
+        "PRIMARY KEY (resolution, bucket_start)"
         ");";
     sqlite3_exec(self.db, createDays, NULL, NULL, NULL);
-    sqlite3_exec(self.db, createHosts, NULL, NULL, NULL);
-    sqlite3_exec(self.db, createConnections, NULL, NULL, NULL);
-    sqlite3_exec(self.db, "CREATE INDEX IF NOT EXISTS stats_hosts_day_idx ON stats_hosts(day);", NULL, NULL, NULL);
-    sqlite3_exec(self.db, "CREATE INDEX IF NOT EXISTS stats_connections_day_idx ON stats_connections(day);", NULL, NULL, NULL);
+    [self clusterTableByDay:@"stats_hosts" createSQL:createHosts];
+    [self clusterTableByDay:@"stats_connections" createSQL:createConnections];
+    sqlite3_exec(self.db, createSeries, NULL, NULL, NULL);
 }
 
-- (void)loadFromDatabase {
-    if (!self.db) {
-        return;
-    }
-
-    NSString *today = [self dayStringFromDate:[NSDate date]];
-    const char *selectDay =
-        "SELECT total_bytes, total_packets, max_rate, max_connections, unique_hosts, first_seen, last_seen, active_seconds "
-        "FROM stats_days WHERE day = ? LIMIT 1;";
+// Host and connection rows are stored in primary key order, so a day's rows
+// sit together: flushes touch the day's pages only and retention deletes a
+// contiguous range. Databases from before that kept them in rowid tables
+// with a separate day index; those are copied over once.
+- (void)clusterTableByDay:(NSString *)table createSQL:(const char *)createSQL {
     sqlite3_stmt *stmt = NULL;
-    if (sqlite3_prepare_v2(self.db, selectDay, -1, &stmt, NULL) == SQLITE_OK) {
-        sqlite3_bind_text(stmt, 1, today.UTF8String, -1, SQLITE_TRANSIENT);
-        if (sqlite3_step(stmt) == SQLITE_ROW) {
-            NSMutableDictionary *record = [NSMutableDictionary dictionary];
-            record[kStatsKeyDate] = today;
-            record[kStatsKeyTotalBytes] = @((uint64_t)sqlite3_column_int64(stmt, 0));
-            record[kStatsKeyTotalPackets] = @((uint64_t)sqlite3_column_int64(stmt, 1));
-            record[kStatsKeyMaxRate] = @((uint64_t)sqlite3_column_int64(stmt, 2));
-            record[kStatsKeyMaxConnections] = @((uint64_t)sqlite3_column_int64(stmt, 3));
-            record[kStatsKeyUniqueHosts] = @((NSUInteger)sqlite3_column_int64(stmt, 4));
-            record[kStatsKeyFirstSeen] = @((double)sqlite3_column_double(stmt, 5));
-            record[kStatsKeyLastSeen] = @((double)sqlite3_column_double(stmt, 6));
-            record[kStatsKeyActiveSeconds] = @((double)sqlite3_column_double(stmt, 7));
-            self.currentDayRecord = record;
-            self.currentDayString = today;
+    NSString *existingSQL = nil;
+    if (sqlite3_prepare_v2(self.db, "SELECT sql FROM sqlite_master WHERE type = 'table' AND name = ?;",
+                           -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, table.UTF8String, -1, SQLITE_TRANSIENT);
+        if (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_text(stmt, 0)) {
+            existingSQL = [NSString stringWithUTF8String:(const char *)sqlite3_column_text(stmt, 0)];
         }
         sqlite3_finalize(stmt);
     }
+    if (!existingSQL) {
+        sqlite3_exec(self.db, createSQL, NULL, NULL, NULL);
+        return;
+    }
+    if ([existingSQL rangeOfString:@"WITHOUT ROWID" options:NSCaseInsensitiveSearch].location != NSNotFound) {
+        return;
+    }
 
-    if (!self.currentDayRecord) {
+    NSString *migration =
+        [NSString stringWithFormat:
+         @"ALTER TABLE %1$@ RENAME TO %1$@_rowid; %2$s "
+         "INSERT INTO %1$@ SELECT * FROM %1$@_rowid; "
+         "DROP TABLE %1$@_rowid;",
+         table, createSQL];
+    sqlite3_exec(self.db, "BEGIN IMMEDIATE;", NULL, NULL, NULL);
+    char *error = NULL;
+    if (sqlite3_exec(self.db, migration.UTF8String, NULL, NULL, &error) != SQLITE_OK) {
+        SNBLogWarn("Failed to cluster %{public}@ by day (%s)", table, error ?: "unknown error");
+        sqlite3_free(error);
+        sqlite3_exec(self.db, "ROLLBACK;", NULL, NULL, NULL);
         return;
     }
+    sqlite3_exec(self.db, "COMMIT;", NULL, NULL, NULL);
+}
 
-    const char *selectHosts =
-        "SELECT host, bytes, packets FROM stats_hosts WHERE day = ?;";
-    stmt = NULL;
-    if (sqlite3_prepare_v2(self.db, selectHosts, -1, &stmt, NULL) == SQLITE_OK) {
-        sqlite3_bind_text(stmt, 1, today.UTF8String, -1, SQLITE_TRANSIENT);
-        while (sqlite3_step(stmt) == SQLITE_ROW) {
-            const char *host = (const char *)sqlite3_column_text(stmt, 0);
-            uint64_t bytes = (uint64_t)sqlite3_column_int64(stmt, 1);
-            uint64_t packets = (uint64_t)sqlite3_column_int64(stmt, 2);
-            if (host) {
-                NSString *hostString = [NSString stringWithUTF8String:host];
-                self.hostBytes[hostString] = @(bytes);
-                self.hostPackets[hostString] = @(packets);
-                [self.uniqueHosts addObject:hostString];
-            }
+// Prepares the statement the first time a flush needs it; NULL if the
+// database is unavailable or the statement does not compile
+- (sqlite3_stmt *)statement:(SNBHistoryStatement)statement {
+    if (!_statements[statement] && self.db) {
+        if (sqlite3_prepare_v2(self.db, kHistoryStatementSQL[statement], -1, &_statements[statement], NULL) != SQLITE_OK) {
+            SNBLogWarn("Failed to prepare stats statement %lu (%s)", (unsigned long)statement, sqlite3_errmsg(self.db));
+            _statements[statement] = NULL;
         }
-        sqlite3_finalize(stmt);
     }
+    return _statements[statement];
+}
 
-    const char *selectConnections =
-        "SELECT src_addr, src_port, dst_addr, dst_port, bytes, packets FROM stats_connections WHERE day = ?;";
-    stmt = NULL;
-    if (sqlite3_prepare_v2(self.db, selectConnections, -1, &stmt, NULL) == SQLITE_OK) {
-        sqlite3_bind_text(stmt, 1, today.UTF8String, -1, SQLITE_TRANSIENT);
+// Restores today's aggregates and the open minute and hour buckets. Hosts
+// and connections stay in the database; flushes add to their rows.
+- (void)loadFromDatabase {
+    if (!self.db) {
+        return;
+    }
+
+    NSDate *now = [NSDate date];
+    NSString *today = [self dayStringFromDate:now];
+    if ([self loadDayFromDatabase:today]) {
+        self.currentDayString = today;
+        self.hasCurrentDay = YES;
+    }
+
+    if (!_series.rings[SNBTimeSeriesHour].buckets) {
+        return;
+    }
+    const char *selectSeries =
+        "SELECT resolution, bucket_start, bytes_in, bytes_out, packets_in, packets_out, connections_in, connections_out "
+        "FROM stats_series WHERE bucket_start >= ?;";
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(self.db, selectSeries, -1, &stmt, NULL) == SQLITE_OK) {
+        int64_t hourStart = SNBTimeSeriesBucketStart(&_series, SNBTimeSeriesHour, (int64_t)now.timeIntervalSince1970);
+        sqlite3_bind_int64(stmt, 1, hourStart);
         while (sqlite3_step(stmt) == SQLITE_ROW) {
-            const char *src = (const char *)sqlite3_column_text(stmt, 0);
-            const char *dst = (const char *)sqlite3_column_text(stmt, 2);
-            if (!src || !dst) {
-                continue;
+            int resolution = sqlite3_column_int(stmt, 0);
+            SNBTimeSeriesBucket bucket = {
+                .start = sqlite3_column_int64(stmt, 1),
+                .bytes = {(uint64_t)sqlite3_column_int64(stmt, 2), (uint64_t)sqlite3_column_int64(stmt, 3)},
+                .packets = {(uint64_t)sqlite3_column_int64(stmt, 4), (uint64_t)sqlite3_column_int64(stmt, 5)},
+                .connections = {(uint32_t)sqlite3_column_int64(stmt, 6), (uint32_t)sqlite3_column_int64(stmt, 7)},
+            };
+            for (int r = SNBTimeSeriesMinute; r < SNBTimeSeriesResolutionCount; r++) {
+                if ((int)_series.rings[r].width == resolution) {
+                    SNBTimeSeriesMerge(&_series, r, &bucket);
+                }
             }
-            SNBConnectionStats *stats = [[SNBConnectionStats alloc] init];
-            stats.sourceAddress = [NSString stringWithUTF8String:src];
-            stats.destinationAddress = [NSString stringWithUTF8String:dst];
-            stats.sourcePort = sqlite3_column_int(stmt, 1);
-            stats.destinationPort = sqlite3_column_int(stmt, 3);
-            stats.bytes = (uint64_t)sqlite3_column_int64(stmt, 4);
-            stats.packets = (uint64_t)sqlite3_column_int64(stmt, 5);
-            NSString *key = [NSString stringWithFormat:@"%@:%ld->%@:%ld",
-                             stats.sourceAddress, (long)stats.sourcePort,
-                             stats.destinationAddress, (long)stats.destinationPort];
-            self.connectionStats[key] = stats;
         }
         sqlite3_finalize(stmt);
     }
 }
 
+// Reads a stored day's aggregates into _day; NO if the day has no row
+- (BOOL)loadDayFromDatabase:(NSString *)day {
+    if (!self.db) {
+        return NO;
+    }
+    const char *selectDay =
+        "SELECT total_bytes, total_packets, max_rate, max_connections, unique_hosts, first_seen, last_seen, active_seconds "
+        "FROM stats_days WHERE day = ? LIMIT 1;";
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(self.db, selectDay, -1, &stmt, NULL) != SQLITE_OK) {
+        return NO;
+    }
+    sqlite3_bind_text(stmt, 1, day.UTF8String, -1, SQLITE_TRANSIENT);
+    BOOL found = sqlite3_step(stmt) == SQLITE_ROW;
+    if (found) {
+        _day.totalBytes = (uint64_t)sqlite3_column_int64(stmt, 0);
+        _day.totalPackets = (uint64_t)sqlite3_column_int64(stmt, 1);
+        _day.maxRate = (uint64_t)sqlite3_column_int64(stmt, 2);
+        _day.maxConnections = (uint64_t)sqlite3_column_int64(stmt, 3);
+        _day.uniqueHosts = (uint64_t)sqlite3_column_int64(stmt, 4);
+        _day.firstSeen = sqlite3_column_double(stmt, 5);
+        _day.lastSeen = sqlite3_column_double(stmt, 6);
+        _day.activeSeconds = sqlite3_column_double(stmt, 7);
+    }
+    sqlite3_finalize(stmt);
+    return found;
+}
+
+// Appends what changed since the last flush: only hosts and connections
+// that saw packets since then have rows pending, and their deltas are added
+// to the day's rows; the minute and hour buckets touched since are written
+// whole, and the day row carries the running aggregates.
 - (void)persistToDatabase {
-    if (!self.db || !self.currentDayRecord) {
+    if (!self.hasCurrentDay) {
         return;
     }
 
     [self refreshCurrentDaySnapshot];
-    NSString *day = self.currentDayRecord[kStatsKeyDate];
-    if (day.length == 0) {
+    NSString *day = self.currentDayString;
+    if (!self.db || day.length == 0) {
+        // Nowhere to put the deltas; drop them rather than grow without bound
+        SNBFlowTableClear(self.hostTable);
+        [self trimConnectionTableLocked];
         return;
     }
 
     sqlite3_exec(self.db, "BEGIN IMMEDIATE;", NULL, NULL, NULL);
-
-    const char *upsertDay =
-        "INSERT INTO stats_days "
-        "(day, total_bytes, total_packets, max_rate, max_connections, unique_hosts, first_seen, last_seen, active_seconds) "
-        "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?) "
-        "ON CONFLICT(day) DO UPDATE SET "
-        "total_bytes=excluded.total_bytes, "
-        "total_packets=excluded.total_packets, "
-        "max_rate=excluded.max_rate, "
-        "max_connections=excluded.max_connections, "
-        "unique_hosts=excluded.unique_hosts, "
-        "first_seen=excluded.first_seen, "
-        "last_seen=excluded.last_seen, "
-        "active_seconds=excluded.active_seconds;";
-    sqlite3_stmt *stmt = NULL;
-    if (sqlite3_prepare_v2(self.db, upsertDay, -1, &stmt, NULL) == SQLITE_OK) {
-        sqlite3_bind_text(stmt, 1, day.UTF8String, -1, SQLITE_TRANSIENT);
-        sqlite3_bind_int64(stmt, 2, [self.currentDayRecord[kStatsKeyTotalBytes] longLongValue]);
-        sqlite3_bind_int64(stmt, 3, [self.currentDayRecord[kStatsKeyTotalPackets] longLongValue]);
-        sqlite3_bind_int64(stmt, 4, [self.currentDayRecord[kStatsKeyMaxRate] longLongValue]);
-        sqlite3_bind_int64(stmt, 5, [self.currentDayRecord[kStatsKeyMaxConnections] longLongValue]);
-        sqlite3_bind_int64(stmt, 6, [self.currentDayRecord[kStatsKeyUniqueHosts] longLongValue]);
-        sqlite3_bind_double(stmt, 7, [self.currentDayRecord[kStatsKeyFirstSeen] doubleValue]);
-        sqlite3_bind_double(stmt, 8, [self.currentDayRecord[kStatsKeyLastSeen] doubleValue]);
-        sqlite3_bind_double(stmt, 9, [self.currentDayRecord[kStatsKeyActiveSeconds] doubleValue]);
-        sqlite3_step(stmt);
-        sqlite3_finalize(stmt);
+    const char *dayString = day.UTF8String;
+    uint64_t hostRows = 0;
+    uint64_t connectionRows = 0;
+
+    sqlite3_stmt *insertHost = [self statement:SNBHistoryStatementInsertHost];
+    sqlite3_stmt *updateHost = [self statement:SNBHistoryStatementUpdateHost];
+    char sourceBuffer[INET6_ADDRSTRLEN];
+    char destinationBuffer[INET6_ADDRSTRLEN];
+    size_t cursor = 0;
+    const SNBFlowKey *key = NULL;
+    if (insertHost && updateHost) {
+        const SNBHistoryHostCounters *host;
+        while ((host = SNBFlowTableNext(self.hostTable, &cursor, &key)) != NULL) {
+            const char *address = SNBHistoryFormatAddress(key->family, key->destinationAddress,
+                                                          destinationBuffer, sizeof(destinationBuffer));
+            sqlite3_bind_text(insertHost, 1, dayString, -1, SQLITE_STATIC);
+            sqlite3_bind_text(insertHost, 2, address, -1, SQLITE_STATIC);
+            sqlite3_bind_int64(insertHost, 3, (sqlite3_int64)host->bytes);
+            sqlite3_bind_int64(insertHost, 4, (sqlite3_int64)host->packets);
+            if (sqlite3_step(insertHost) == SQLITE_DONE && sqlite3_changes(self.db) > 0) {
+                _day.uniqueHosts++;
+            } else {
+                sqlite3_bind_text(updateHost, 1, dayString, -1, SQLITE_STATIC);
+                sqlite3_bind_text(updateHost, 2, address, -1, SQLITE_STATIC);
+                sqlite3_bind_int64(updateHost, 3, (sqlite3_int64)host->bytes);
+                sqlite3_bind_int64(updateHost, 4, (sqlite3_int64)host->packets);
+                sqlite3_step(updateHost);
+                sqlite3_reset(updateHost);
+            }
+            sqlite3_reset(insertHost);
+            hostRows++;
+        }
+        sqlite3_clear_bindings(insertHost);
+        sqlite3_clear_bindings(updateHost);
+    }
+    SNBFlowTableClear(self.hostTable);
+
+    sqlite3_stmt *upsertConnection = [self statement:SNBHistoryStatementUpsertConnection];
+    if (upsertConnection) {
+        SNBHistoryConnectionCounters *connection;
+        cursor = 0;
+        while ((connection = SNBFlowTableNext(self.connectionTable, &cursor, &key)) != NULL) {
+            // Kept for the open buckets' connection counts, but nothing to write
+            if (connection->packets == 0) {
+                continue;
+            }
+            sqlite3_bind_text(upsertConnection, 1, dayString, -1, SQLITE_STATIC);
+            sqlite3_bind_text(upsertConnection, 2, SNBHistoryFormatAddress(key->family, key->sourceAddress,
+                                                                            sourceBuffer, sizeof(sourceBuffer)),
+                              -1, SQLITE_STATIC);
+            sqlite3_bind_int(upsertConnection, 3, key->hasPorts ? (int)key->sourcePort : -1);
+            sqlite3_bind_text(upsertConnection, 4, SNBHistoryFormatAddress(key->family, key->destinationAddress,
+                                                                            destinationBuffer, sizeof(destinationBuffer)),
+                              -1, SQLITE_STATIC);
+            sqlite3_bind_int(upsertConnection, 5, key->hasPorts ? (int)key->destinationPort : -1);
+            sqlite3_bind_int64(upsertConnection, 6, (sqlite3_int64)connection->bytes);
+            sqlite3_bind_int64(upsertConnection, 7, (sqlite3_int64)connection->packets);
+            sqlite3_step(upsertConnection);
+            sqlite3_reset(upsertConnection);
+            connection->bytes = 0;
+            connection->packets = 0;
+            connectionRows++;
+        }
+        sqlite3_clear_bindings(upsertConnection);
+    }
+    [self trimConnectionTableLocked];
+
+    sqlite3_stmt *upsertDay = [self statement:SNBHistoryStatementUpsertDay];
+    if (upsertDay) {
+        sqlite3_bind_text(upsertDay, 1, dayString, -1, SQLITE_STATIC);
+        sqlite3_bind_int64(upsertDay, 2, (sqlite3_int64)_day.totalBytes);
+        sqlite3_bind_int64(upsertDay, 3, (sqlite3_int64)_day.totalPackets);
+        sqlite3_bind_int64(upsertDay, 4, (sqlite3_int64)_day.maxRate);
+        sqlite3_bind_int64(upsertDay, 5, (sqlite3_int64)_day.maxConnections);
+        sqlite3_bind_int64(upsertDay, 6, (sqlite3_int64)_day.uniqueHosts);
+        sqlite3_bind_double(upsertDay, 7, _day.firstSeen);
+        sqlite3_bind_double(upsertDay, 8, _day.lastSeen);
+        sqlite3_bind_double(upsertDay, 9, _day.activeSeconds);
+        sqlite3_step(upsertDay);
+        sqlite3_reset(upsertDay);
+        sqlite3_clear_bindings(upsertDay);
+    }
+
+    uint64_t seriesRows = [self persistSeriesLocked];
+    [self trimOldSeriesFromDatabase];
+    // Days only age out when a new one starts
+    if (![self.retentionDay isEqualToString:day]) {
+        [self trimOldDaysFromDatabase];
+        self.retentionDay = day;
     }
+    sqlite3_exec(self.db, "COMMIT;", NULL, NULL, NULL);
 
-    const char *upsertHost =
-        "INSERT INTO stats_hosts (day, host, bytes, packets) VALUES (?, ?, ?, ?) "
-        "ON CONFLICT(day, host) DO UPDATE SET bytes=excluded.bytes, packets=excluded.packets;";
-    stmt = NULL;
-    if (sqlite3_prepare_v2(self.db, upsertHost, -1, &stmt, NULL) == SQLITE_OK) {
-        [self.hostBytes enumerateKeysAndObjectsUsingBlock:^(NSString *host, NSNumber *bytes, BOOL *stop) {
-            NSNumber *packets = self.hostPackets[host] ?: @(0);
-            sqlite3_bind_text(stmt, 1, day.UTF8String, -1, SQLITE_TRANSIENT);
-            sqlite3_bind_text(stmt, 2, host.UTF8String, -1, SQLITE_TRANSIENT);
-            sqlite3_bind_int64(stmt, 3, bytes.longLongValue);
-            sqlite3_bind_int64(stmt, 4, packets.longLongValue);
-            sqlite3_step(stmt);
-            sqlite3_reset(stmt);
-        }];
-        sqlite3_finalize(stmt);
+    _flushCounters.flushes++;
+    _flushCounters.hostRows += hostRows;
+    _flushCounters.connectionRows += connectionRows;
+    _flushCounters.seriesRows += seriesRows;
+    SNBLogDebug("History flush wrote %llu host, %llu connection and %llu series rows "
+                "(%.1f rows per flush since launch)",
+                (unsigned long long)hostRows, (unsigned long long)connectionRows, (unsigned long long)seriesRows,
+                (double)(_flushCounters.hostRows + _flushCounters.connectionRows + _flushCounters.seriesRows) /
+                    (double)_flushCounters.flushes);
+}
+
+// Connections idle since before the open hour can no longer change any open
+// bucket's connection count, so only the ones active this hour stay. If that
+// is still too many the table starts over, and connections already counted
+// in the open minute or hour may be counted there again.
+- (void)trimConnectionTableLocked {
+    int64_t hourStart = SNBTimeSeriesBucketStart(&_series, SNBTimeSeriesHour, (int64_t)self.currentSecond);
+    size_t cursor = 0;
+    const SNBHistoryConnectionCounters *connection;
+    while ((connection = SNBFlowTableNext(self.connectionTable, &cursor, NULL)) != NULL) {
+        if (connection->lastSecond < hourStart) {
+            SNBFlowTableRemoveCurrent(self.connectionTable, &cursor);
+        }
+    }
+    if (SNBFlowTableCount(self.connectionTable) >= kStatsPendingRowLimit / 2) {
+        SNBFlowTableClear(self.connectionTable);
     }
+}
 
-    const char *upsertConnection =
-        "INSERT INTO stats_connections (day, src_addr, src_port, dst_addr, dst_port, bytes, packets) "
-        "VALUES (?, ?, ?, ?, ?, ?, ?) "
-        "ON CONFLICT(day, src_addr, src_port, dst_addr, dst_port) DO UPDATE SET "
-        "bytes=excluded.bytes, packets=excluded.packets;";
-    stmt = NULL;
-    if (sqlite3_prepare_v2(self.db, upsertConnection, -1, &stmt, NULL) == SQLITE_OK) {
-        [self.connectionStats enumerateKeysAndObjectsUsingBlock:^(NSString *key, SNBConnectionStats *stats, BOOL *stop) {
-            sqlite3_bind_text(stmt, 1, day.UTF8String, -1, SQLITE_TRANSIENT);
-            sqlite3_bind_text(stmt, 2, stats.sourceAddress.UTF8String, -1, SQLITE_TRANSIENT);
-            sqlite3_bind_int(stmt, 3, (int)stats.sourcePort);
-            sqlite3_bind_text(stmt, 4, stats.destinationAddress.UTF8String, -1, SQLITE_TRANSIENT);
-            sqlite3_bind_int(stmt, 5, (int)stats.destinationPort);
-            sqlite3_bind_int64(stmt, 6, (sqlite3_int64)stats.bytes);
-            sqlite3_bind_int64(stmt, 7, (sqlite3_int64)stats.packets);
+// Writes every minute and hour bucket from the last flush's open bucket up
+// to the current one. Closed buckets are final; the open ones are rewritten
+// by the next flush. Returns the number of rows written.
+- (uint64_t)persistSeriesLocked {
+    sqlite3_stmt *stmt = [self statement:SNBHistoryStatementUpsertSeries];
+    if (!_series.rings[SNBTimeSeriesSecond].buckets || !stmt) {
+        return 0;
+    }
+
+    uint64_t rows = 0;
+    int64_t now = (int64_t)SNBPacketClockNow(&_packetClock);
+    for (int r = SNBTimeSeriesMinute; r < SNBTimeSeriesResolutionCount; r++) {
+        const SNBTimeSeriesRing *ring = &_series.rings[r];
+        int64_t open = SNBTimeSeriesBucketStart(&_series, r, now);
+        int64_t oldest = open - (int64_t)(ring->capacity - 1) * ring->width;
+        for (int64_t start = MAX(_seriesFlushStart[r], oldest); start <= open; start += ring->width) {
+            const SNBTimeSeriesBucket *bucket = SNBTimeSeriesFind(&_series, r, start);
+            if (!bucket || bucket->packets[SNBTrafficIncoming] + bucket->packets[SNBTrafficOutgoing] == 0) {
+                continue;
+            }
+            sqlite3_bind_int(stmt, 1, (int)ring->width);
+            sqlite3_bind_int64(stmt, 2, start);
+            sqlite3_bind_int64(stmt, 3, (sqlite3_int64)bucket->bytes[SNBTrafficIncoming]);
+            sqlite3_bind_int64(stmt, 4, (sqlite3_int64)bucket->bytes[SNBTrafficOutgoing]);
+            sqlite3_bind_int64(stmt, 5, (sqlite3_int64)bucket->packets[SNBTrafficIncoming]);
+            sqlite3_bind_int64(stmt, 6, (sqlite3_int64)bucket->packets[SNBTrafficOutgoing]);
+            sqlite3_bind_int64(stmt, 7, bucket->connections[SNBTrafficIncoming]);
+            sqlite3_bind_int64(stmt, 8, bucket->connections[SNBTrafficOutgoing]);
             sqlite3_step(stmt);
             sqlite3_reset(stmt);
-        }];
-        sqlite3_finalize(stmt);
+            rows++;
+        }
+        _seriesFlushStart[r] = open;
     }
-
-    sqlite3_exec(self.db, "COMMIT;", NULL, NULL, NULL);
-    [self trimOldRecordsFromDatabase];
+    return rows;
 }
 
 - (NSString *)statsDatabasePath {
-    return [[self applicationSupportDirectory] stringByAppendingPathComponent:kStatsDatabaseFilename];
+    return [self.directory stringByAppendingPathComponent:kStatsDatabaseFilename];
 }
 
-- (void)trimOldRecordsFromDatabase {
+// Keeps the newest kStatsMaxStoredDays days. Every table leads its key with
+// the day, so each delete is one range at the front of the table.
+- (void)trimOldDaysFromDatabase {
     if (!self.db) {
         return;
     }
-    NSString *deleteDays =
-        [NSString stringWithFormat:
-         @"DELETE FROM stats_days WHERE day NOT IN "
-         "(SELECT day FROM stats_days ORDER BY day DESC LIMIT %lu);",
-         (unsigned long)kStatsMaxStoredDays];
-    sqlite3_exec(self.db, deleteDays.UTF8String, NULL, NULL, NULL);
-    sqlite3_exec(self.db, "DELETE FROM stats_hosts WHERE day NOT IN (SELECT day FROM stats_days);", NULL, NULL, NULL);
-    sqlite3_exec(self.db, "DELETE FROM stats_connections WHERE day NOT IN (SELECT day FROM stats_days);", NULL, NULL, NULL);
+    NSString *oldestKept = nil;
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(self.db, "SELECT day FROM stats_days ORDER BY day DESC LIMIT 1 OFFSET ?;",
+                           -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_int64(stmt, 1, (sqlite3_int64)kStatsMaxStoredDays - 1);
+        if (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_text(stmt, 0)) {
+            oldestKept = [NSString stringWithUTF8String:(const char *)sqlite3_column_text(stmt, 0)];
+        }
+        sqlite3_finalize(stmt);
+    }
+    if (!oldestKept) {
+        return;
+    }
+    const char *deletes[] = {
+        "DELETE FROM stats_days WHERE day < ?;",
+        "DELETE FROM stats_hosts WHERE day < ?;",
+        "DELETE FROM stats_connections WHERE day < ?;"
+    };
+    for (size_t i = 0; i < sizeof(deletes) / sizeof(deletes[0]); i++) {
+        stmt = NULL;
+        if (sqlite3_prepare_v2(self.db, deletes[i], -1, &stmt, NULL) == SQLITE_OK) {
+            sqlite3_bind_text(stmt, 1, oldestKept.UTF8String, -1, SQLITE_TRANSIENT);
+            sqlite3_step(stmt);
+            sqlite3_finalize(stmt);
+        }
+    }
+}
+
+// Buckets are kept as long as the rings they came from reach back, hours
+// as long as the days
+- (void)trimOldSeriesFromDatabase {
+    sqlite3_stmt *stmt = [self statement:SNBHistoryStatementDeleteSeries];
+    if (!stmt) {
+        return;
+    }
+    int64_t now = (int64_t)SNBPacketClockNow(&_packetClock);
+    const int64_t cutoffs[][2] = {
+        {60, now - SNB_TIME_SERIES_MINUTES * 60},
+        {3600, now - (int64_t)kStatsMaxStoredDays * 86400}
+    };
+    for (size_t i = 0; i < sizeof(cutoffs) / sizeof(cutoffs[0]); i++) {
+        sqlite3_bind_int64(stmt, 1, cutoffs[i][0]);
+        sqlite3_bind_int64(stmt, 2, cutoffs[i][1]);
+        sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+    }
 }
 
 #pragma mark - Report
 
 - (NSString *)reportTemplateHTML {
-    NSString *path = [[NSBundle mainBundle] pathForResource:@"traffic_report_template" ofType:@"html"];
+    NSString *path = self.templatePath ?: [[NSBundle mainBundle] pathForResource:@"traffic_report_template" ofType:@"html"];
     if (!path) {
         SNBLogWarn("Report template not found in bundle resources");
         return nil;
@@ -614,36 +958,120 @@ static NSString * const kMaliciousKeyScore = @"score";
     return templateHTML;
 }
 
+// Brings the database up to date and hands the report to reportQueue
 - (void)generateReportLocked {
     [self refreshCurrentDaySnapshot];
     [self persistToDatabase];
+    [self scheduleReportWithCompletion:nil];
+}
+
+// Requests without a completion that arrive while a report is still queued
+// are covered by it, since it has yet to read the database
+- (void)scheduleReportWithCompletion:(void (^)(NSString *path))completion {
+    BOOL alreadyQueued = atomic_exchange(&_reportQueued, true);
+    if (alreadyQueued && !completion) {
+        return;
+    }
+    NSString *currentDay = self.hasCurrentDay ? self.currentDayString : nil;
+    dispatch_async(self.reportQueue, ^{
+        atomic_store(&self->_reportQueued, false);
+        [self writeReportWithCurrentDay:currentDay];
+        if (completion) {
+            NSString *path = [self reportPath];
+            dispatch_async(dispatch_get_main_queue(), ^{
+                completion(path);
+            });
+        }
+    });
+}
+
+// Streams the template to a partial file and renames it over the report.
+// Past days' host and connection tables come from the fragment cache; the
+// day still being captured, the summaries and the threat scores, which can
+// change for any day, are rebuilt every time.
+- (void)writeReportWithCurrentDay:(NSString *)currentDay {
     NSString *templateHTML = [self reportTemplateHTML];
-    if (templateHTML.length == 0) {
+    if (templateHTML.length == 0 || ![self openReportDatabase]) {
         return;
     }
 
-    NSString *generatedAt = [self formattedDateTime:[NSDate date]];
+    NSString *path = [self reportPath];
+    NSString *partialPath = [path stringByAppendingString:@".partial"];
+    FILE *file = fopen(partialPath.fileSystemRepresentation, "w");
+    if (!file) {
+        SNBLogWarn("Failed to open report at %{public}@ (%s)", partialPath, strerror(errno));
+        return;
+    }
 
+    // One read transaction, so every section sees the same flush
+    sqlite3_exec(self.reportDb, "BEGIN;", NULL, NULL, NULL);
+    NSString *generatedAt = [self formattedDateTime:[NSDate date]];
     NSArray<NSDictionary *> *records = [self dailyRecordsFromDatabase];
     NSDictionary *weekly = [self weeklySummaryFromRecords:records];
-    NSMutableDictionary<NSString *, NSArray<NSDictionary *> *> *maliciousByDay = [NSMutableDictionary dictionary];
-    NSMutableArray<NSDictionary *> *allMalicious = [NSMutableArray array];
-    for (NSDictionary *record in records) {
-        NSString *date = record[kStatsKeyDate] ?: @"";
-        if (date.length == 0) {
-            continue;
+    NSDictionary<NSString *, NSArray<NSDictionary *> *> *maliciousByDay = [self maliciousConnectionsByDay];
+    NSMutableSet<NSString *> *fragments = [NSMutableSet set];
+    NSDictionary<NSString *, dispatch_block_t> *writers = @{
+        @"{{GENERATED_AT}}": ^{
+            SNBReportWrite(file, generatedAt ?: @"");
+        },
+        @"{{WEEKLY_SECTION}}": ^{
+            [self writeWeeklySection:weekly toFile:file];
+        },
+        @"{{DAILY_SECTION}}": ^{
+            [self writeDailySectionForRecords:records
+                               maliciousByDay:maliciousByDay
+                                   currentDay:currentDay
+                                    fragments:fragments
+                                       toFile:file];
+        },
+        @"{{MALICIOUS_SECTION}}": ^{
+            [self writeMaliciousSectionForRecords:records maliciousByDay:maliciousByDay toFile:file];
+        },
+        @"{{DETAILS_SECTION}}": ^{}
+    };
+    [self writeTemplate:templateHTML writers:writers toFile:file];
+    sqlite3_exec(self.reportDb, "COMMIT;", NULL, NULL, NULL);
+
+    BOOL failed = ferror(file) != 0;
+    failed = (fclose(file) != 0) || failed;
+    if (failed || rename(partialPath.fileSystemRepresentation, path.fileSystemRepresentation) != 0) {
+        SNBLogWarn("Failed to write report to %{public}@ (%s)", path, strerror(errno));
+        unlink(partialPath.fileSystemRepresentation);
+        return;
+    }
+    [self removeReportFragmentsExcept:fragments];
+}
+
+// Writes the template's text as it goes, calling the writer of each
+// {{TOKEN}} in its place. Tokens without a writer are left as they are.
+- (void)writeTemplate:(NSString *)templateHTML
+              writers:(NSDictionary<NSString *, dispatch_block_t> *)writers
+               toFile:(FILE *)file {
+    NSUInteger location = 0;
+    NSUInteger length = templateHTML.length;
+    while (location < length) {
+        NSRange open = [templateHTML rangeOfString:@"{{" options:0 range:NSMakeRange(location, length - location)];
+        if (open.location == NSNotFound) {
+            break;
         }
-        NSArray<NSDictionary *> *malicious = [self maliciousConnectionsForDay:date];
-        if (malicious.count > 0) {
-            maliciousByDay[date] = malicious;
-            for (NSDictionary *entry in malicious) {
-                NSMutableDictionary *entryWithDate = [entry mutableCopy];
-                entryWithDate[kStatsKeyDate] = date;
-                [allMalicious addObject:entryWithDate];
-            }
+        NSRange close = [templateHTML rangeOfString:@"}}" options:0
+                                              range:NSMakeRange(NSMaxRange(open), length - NSMaxRange(open))];
+        if (close.location == NSNotFound) {
+            break;
+        }
+        NSRange token = NSMakeRange(open.location, NSMaxRange(close) - open.location);
+        dispatch_block_t writer = writers[[templateHTML substringWithRange:token]];
+        NSUInteger literalEnd = writer ? token.location : NSMaxRange(token);
+        SNBReportWrite(file, [templateHTML substringWithRange:NSMakeRange(location, literalEnd - location)]);
+        if (writer) {
+            writer();
         }
+        location = NSMaxRange(token);
     }
+    SNBReportWrite(file, [templateHTML substringFromIndex:location]);
+}
 
+- (void)writeWeeklySection:(NSDictionary *)weekly toFile:(FILE *)file {
     NSMutableString *weeklySection = [NSMutableString string];
     [weeklySection appendString:@"<details class=\"card\" open>\n"];
     [weeklySection appendString:@"<summary><span>Weekly Overview</span></summary>\n"];
@@ -671,65 +1099,87 @@ static NSString * const kMaliciousKeyScore = @"score";
     }
     [weeklySection appendString:@"</div>\n"];
     [weeklySection appendString:@"</details>\n"];
+    SNBReportWrite(file, weeklySection);
+}
 
+- (void)writeMaliciousSectionForRecords:(NSArray<NSDictionary *> *)records
+                         maliciousByDay:(NSDictionary<NSString *, NSArray<NSDictionary *> *> *)maliciousByDay
+                                 toFile:(FILE *)file {
     NSMutableString *maliciousSection = [NSMutableString string];
     [maliciousSection appendString:@"<details class=\"card\">\n"];
     [maliciousSection appendString:@"<summary><span>Malicious Connections</span></summary>\n"];
     [maliciousSection appendString:@"<div class=\"section-body\">\n"];
-    if (allMalicious.count == 0) {
+    if (maliciousByDay.count == 0) {
         [maliciousSection appendString:@"<p class=\"empty\">No malicious connections detected.</p>\n"];
     } else {
         [maliciousSection appendString:@"<div class=\"table-wrap\">\n"];
         [maliciousSection appendString:@"<table>\n"];
         [maliciousSection appendString:@"<thead><tr><th>Date</th><th>Indicator</th><th>Connection</th><th>Score</th><th>Verdict</th><th>Confidence</th><th>Bytes</th><th>Packets</th><th>Providers</th><th>Explanation</th></tr></thead>\n"];
         [maliciousSection appendString:@"<tbody>\n"];
-        for (NSDictionary *entry in allMalicious) {
-            NSString *date = entry[kStatsKeyDate] ?: @"";
-            NSString *indicator = entry[kMaliciousKeyIndicator] ?: @"";
-            NSString *source = entry[kConnectionKeySource] ?: @"";
-            NSString *destination = entry[kConnectionKeyDestination] ?: @"";
-            NSNumber *sourcePort = entry[kConnectionKeySourcePort] ?: @(0);
-            NSNumber *destinationPort = entry[kConnectionKeyDestinationPort] ?: @(0);
-            uint64_t bytes = [entry[kConnectionKeyBytes] unsignedLongLongValue];
-            uint64_t packets = [entry[kConnectionKeyPackets] unsignedLongLongValue];
-            TIEnrichmentResponse *response = entry[kMaliciousKeyResponse];
-            TIScoringResult *scoring = response.scoringResult;
-            NSInteger score = scoring ? scoring.finalScore : 0;
-            NSString *verdict = scoring ? [scoring verdictString] : @"";
-            NSString *confidence = scoring ? [NSString stringWithFormat:@"%.0f%%", scoring.confidence * 100.0] : @"";
-            NSString *explanation = scoring.explanation.length > 0 ? scoring.explanation : @"";
-            NSString *providersHtml = [self providerDetailsHTMLForResponse:response];
-            NSString *connectionLabel = [NSString stringWithFormat:@"%@:%ld -> %@:%ld",
-                                         source, (long)sourcePort.integerValue,
-                                         destination, (long)destinationPort.integerValue];
-            NSString *scoreClass = @"pill";
-            if (score >= 80) {
-                scoreClass = @"pill pill--danger";
-            } else if (score >= 50) {
-                scoreClass = @"pill pill--warn";
+        for (NSDictionary *record in records) {
+            NSString *date = record[kStatsKeyDate] ?: @"";
+            for (NSDictionary *entry in maliciousByDay[date]) {
+                [maliciousSection appendString:[self maliciousRowHTMLForEntry:entry date:date]];
             }
-            NSString *verdictBadge = verdict.length > 0
-                ? [NSString stringWithFormat:@"<span class=\"%@\">%@</span>", scoreClass, verdict]
-                : @"<span class=\"pill\">-</span>";
-            [maliciousSection appendFormat:@"<tr><td>%@</td><td>%@</td><td>%@</td><td>%ld</td><td>%@</td><td>%@</td>"
-             "<td>%@</td><td>%llu</td><td>%@</td><td class=\"col-explain\">%@</td></tr>\n",
-             date,
-             indicator,
-             connectionLabel,
-             (long)score,
-             verdictBadge,
-             confidence,
-             [SNBByteFormatter stringFromBytes:bytes],
-             (unsigned long long)packets,
-             providersHtml,
-             explanation];
         }
         [maliciousSection appendString:@"</tbody></table>\n"];
         [maliciousSection appendString:@"</div>\n"];
     }
     [maliciousSection appendString:@"</div>\n"];
     [maliciousSection appendString:@"</details>\n"];
+    SNBReportWrite(file, maliciousSection);
+}
 
+// A row of the malicious connection tables; the overview has a date column
+- (NSString *)maliciousRowHTMLForEntry:(NSDictionary *)entry date:(NSString *)date {
+    NSString *indicator = entry[kMaliciousKeyIndicator] ?: @"";
+    NSString *source = entry[kConnectionKeySource] ?: @"";
+    NSString *destination = entry[kConnectionKeyDestination] ?: @"";
+    NSNumber *sourcePort = entry[kConnectionKeySourcePort] ?: @(0);
+    NSNumber *destinationPort = entry[kConnectionKeyDestinationPort] ?: @(0);
+    uint64_t bytes = [entry[kConnectionKeyBytes] unsignedLongLongValue];
+    uint64_t packets = [entry[kConnectionKeyPackets] unsignedLongLongValue];
+    TIEnrichmentResponse *response = entry[kMaliciousKeyResponse];
+    TIScoringResult *scoring = response.scoringResult;
+    NSInteger score = scoring ? scoring.finalScore : 0;
+    NSString *verdict = scoring ? [scoring verdictString] : @"";
+    NSString *confidence = scoring ? [NSString stringWithFormat:@"%.0f%%", scoring.confidence * 100.0] : @"";
+    NSString *explanation = scoring.explanation.length > 0 ? scoring.explanation : @"";
+    NSString *providersHtml = [self providerDetailsHTMLForResponse:response];
+    NSString *connectionLabel = [NSString stringWithFormat:@"%@:%ld -> %@:%ld",
+                                 source, (long)sourcePort.integerValue,
+                                 destination, (long)destinationPort.integerValue];
+    NSString *scoreClass = @"pill";
+    if (score >= 80) {
+        scoreClass = @"pill pill--danger";
+    } else if (score >= 50) {
+        scoreClass = @"pill pill--warn";
+    }
+    NSString *verdictBadge = verdict.length > 0
+        ? [NSString stringWithFormat:@"<span class=\"%@\">%@</span>", scoreClass, verdict]
+        : @"<span class=\"pill\">-</span>";
+    NSString *dateCell = date ? [NSString stringWithFormat:@"<td>%@</td>", date] : @"";
+    return [NSString stringWithFormat:@"<tr>%@<td>%@</td><td>%@</td><td>%ld</td><td>%@</td><td>%@</td>"
+            "<td>%@</td><td>%llu</td><td>%@</td><td class=\"col-explain\">%@</td></tr>\n",
+            dateCell,
+            indicator,
+            connectionLabel,
+            (long)score,
+            verdictBadge,
+            confidence,
+            [SNBByteFormatter stringFromBytes:bytes],
+            (unsigned long long)packets,
+            providersHtml,
+            explanation];
+}
+
+// The day table, then one collapsible card per day, each written out
+// before the next is built
+- (void)writeDailySectionForRecords:(NSArray<NSDictionary *> *)records
+                     maliciousByDay:(NSDictionary<NSString *, NSArray<NSDictionary *> *> *)maliciousByDay
+                         currentDay:(NSString *)currentDay
+                          fragments:(NSMutableSet<NSString *> *)fragments
+                             toFile:(FILE *)file {
     NSMutableString *dailySection = [NSMutableString string];
     [dailySection appendString:@"<details class=\"card\" open>\n"];
     [dailySection appendString:@"<summary><span>Daily Statistics &amp; Details</span></summary>\n"];
@@ -783,161 +1233,204 @@ static NSString * const kMaliciousKeyScore = @"score";
         }
         [dailySection appendString:@"</tbody></table>\n"];
         [dailySection appendString:@"</div>\n"];
+        SNBReportWrite(file, dailySection);
 
-        [records enumerateObjectsUsingBlock:^(NSDictionary *record, NSUInteger idx, BOOL *stop) {
-            NSString *date = record[kStatsKeyDate] ?: @"";
-            uint64_t totalBytes = [record[kStatsKeyTotalBytes] unsignedLongLongValue];
-            NSTimeInterval activeSeconds = [self activeSecondsForRecord:record];
-            uint64_t avgRate = activeSeconds > 0 ? (uint64_t)(totalBytes / activeSeconds) : 0;
-            NSString *detailsId = [NSString stringWithFormat:@"day-%lu", (unsigned long)idx];
-            NSString *hostsTableId = [NSString stringWithFormat:@"hosts-%lu", (unsigned long)idx];
-            NSString *connectionsTableId = [NSString stringWithFormat:@"connections-%lu", (unsigned long)idx];
-            NSArray<NSDictionary *> *hosts = [self hostsForDay:date];
-            NSArray<NSDictionary *> *connections = [self connectionsForDay:date];
-
-            [dailySection appendFormat:@"<details id=\"%@\" class=\"detail-card\">\n", detailsId];
-            [dailySection appendFormat:@"<summary>%@ - %@ total, %@ avg rate</summary>\n",
-             date,
-             [SNBByteFormatter stringFromBytes:totalBytes],
-             [self formattedRate:avgRate]];
-
-            [dailySection appendString:@"<div class=\"controls\">"];
-            [dailySection appendFormat:@"<label>Hosts sort <select data-target=\"%@\">", hostsTableId];
-            [dailySection appendString:@"<option value=\"bytes_desc\" selected>Bytes</option>"];
-            [dailySection appendString:@"<option value=\"packets_desc\">Packets</option>"];
-            [dailySection appendString:@"<option value=\"host_asc\">Host</option>"];
-            [dailySection appendString:@"</select></label>"];
-            [dailySection appendFormat:@"<label>Connections sort <select data-target=\"%@\">", connectionsTableId];
-            [dailySection appendString:@"<option value=\"bytes_desc\" selected>Bytes</option>"];
-            [dailySection appendString:@"<option value=\"packets_desc\">Packets</option>"];
-            [dailySection appendString:@"<option value=\"connection_asc\">Connection</option>"];
-            [dailySection appendString:@"</select></label>"];
-            [dailySection appendString:@"</div>"];
-
-            [dailySection appendString:@"<h3 class=\"section-title\">Hosts</h3>\n"];
-            if (hosts.count == 0) {
-                [dailySection appendString:@"<p class=\"empty\">No host activity recorded.</p>\n"];
-            } else {
-                [dailySection appendFormat:@"<div class=\"table-wrap\"><table id=\"%@\"><thead><tr><th>Host</th><th>Bytes</th><th>Packets</th></tr></thead><tbody>\n", hostsTableId];
-                for (NSDictionary *host in hosts) {
-                    NSString *address = host[kHostKeyAddress] ?: @"";
-                    uint64_t bytes = [host[kHostKeyBytes] unsignedLongLongValue];
-                    uint64_t packets = [host[kHostKeyPackets] unsignedLongLongValue];
-                    [dailySection appendFormat:@"<tr data-host=\"%@\" data-bytes=\"%llu\" data-packets=\"%llu\"><td>%@</td><td>%@</td><td>%llu</td></tr>\n",
-                     address,
-                     (unsigned long long)bytes,
-                     (unsigned long long)packets,
-                     address,
-                     [SNBByteFormatter stringFromBytes:bytes],
-                     (unsigned long long)packets];
-                }
-                [dailySection appendString:@"</tbody></table></div>\n"];
-            }
-
-            NSArray<NSDictionary *> *malicious = maliciousByDay[date] ?: @[];
-            [dailySection appendString:@"<h3 class=\"section-title\">Malicious Connections</h3>\n"];
-            if (malicious.count == 0) {
-                [dailySection appendString:@"<p class=\"empty\">No malicious connections detected.</p>\n"];
-            } else {
-                [dailySection appendString:@"<div class=\"table-wrap\"><table><thead><tr><th>Indicator</th><th>Connection</th><th>Score</th><th>Verdict</th><th>Confidence</th><th>Bytes</th><th>Packets</th><th>Providers</th><th>Explanation</th></tr></thead><tbody>\n"];
-                for (NSDictionary *entry in malicious) {
-                    NSString *indicator = entry[kMaliciousKeyIndicator] ?: @"";
-                    NSString *source = entry[kConnectionKeySource] ?: @"";
-                    NSString *destination = entry[kConnectionKeyDestination] ?: @"";
-                    NSNumber *sourcePort = entry[kConnectionKeySourcePort] ?: @(0);
-                    NSNumber *destinationPort = entry[kConnectionKeyDestinationPort] ?: @(0);
-                    uint64_t bytes = [entry[kConnectionKeyBytes] unsignedLongLongValue];
-                    uint64_t packets = [entry[kConnectionKeyPackets] unsignedLongLongValue];
-                    TIEnrichmentResponse *response = entry[kMaliciousKeyResponse];
-                    TIScoringResult *scoring = response.scoringResult;
-                    NSInteger score = scoring ? scoring.finalScore : 0;
-                    NSString *verdict = scoring ? [scoring verdictString] : @"";
-                    NSString *confidence = scoring ? [NSString stringWithFormat:@"%.0f%%", scoring.confidence * 100.0] : @"";
-                    NSString *explanation = scoring.explanation.length > 0 ? scoring.explanation : @"";
-                    NSString *providersHtml = [self providerDetailsHTMLForResponse:response];
-                    NSString *connectionLabel = [NSString stringWithFormat:@"%@:%ld -> %@:%ld",
-                                                 source, (long)sourcePort.integerValue,
-                                                 destination, (long)destinationPort.integerValue];
-                    NSString *scoreClass = @"pill";
-                    if (score >= 80) {
-                        scoreClass = @"pill pill--danger";
-                    } else if (score >= 50) {
-                        scoreClass = @"pill pill--warn";
-                    }
-                    NSString *verdictBadge = verdict.length > 0
-                        ? [NSString stringWithFormat:@"<span class=\"%@\">%@</span>", scoreClass, verdict]
-                        : @"<span class=\"pill\">-</span>";
-                    [dailySection appendFormat:@"<tr><td>%@</td><td>%@</td><td>%ld</td><td>%@</td><td>%@</td>"
-                     "<td>%@</td><td>%llu</td><td>%@</td><td class=\"col-explain\">%@</td></tr>\n",
-                     indicator,
-                     connectionLabel,
-                     (long)score,
-                     verdictBadge,
-                     confidence,
-                     [SNBByteFormatter stringFromBytes:bytes],
-                     (unsigned long long)packets,
-                     providersHtml,
-                     explanation];
-                }
-                [dailySection appendString:@"</tbody></table></div>\n"];
-            }
-
-            [dailySection appendString:@"<h3 class=\"section-title\">Connections</h3>\n"];
-            if (connections.count == 0) {
-                [dailySection appendString:@"<p class=\"empty\">No connection activity recorded.</p>\n"];
-            } else {
-                [dailySection appendFormat:@"<div class=\"table-wrap\"><table id=\"%@\"><thead><tr><th>Connection</th><th>Bytes</th><th>Packets</th></tr></thead><tbody>\n", connectionsTableId];
-                for (NSDictionary *connection in connections) {
-                    NSString *source = connection[kConnectionKeySource] ?: @"";
-                    NSString *destination = connection[kConnectionKeyDestination] ?: @"";
-                    NSNumber *sourcePort = connection[kConnectionKeySourcePort] ?: @(0);
-                    NSNumber *destinationPort = connection[kConnectionKeyDestinationPort] ?: @(0);
-                    uint64_t bytes = [connection[kConnectionKeyBytes] unsignedLongLongValue];
-                    uint64_t packets = [connection[kConnectionKeyPackets] unsignedLongLongValue];
-                    NSString *connectionLabel = [NSString stringWithFormat:@"%@:%ld -> %@:%ld",
-                                                 source, (long)sourcePort.integerValue,
-                                                 destination, (long)destinationPort.integerValue];
-                    [dailySection appendFormat:@"<tr data-connection=\"%@\" data-bytes=\"%llu\" data-packets=\"%llu\"><td>%@</td><td>%@</td><td>%llu</td></tr>\n",
-                     connectionLabel,
-                     (unsigned long long)bytes,
-                     (unsigned long long)packets,
-                     connectionLabel,
-                     [SNBByteFormatter stringFromBytes:bytes],
-                     (unsigned long long)packets];
-                }
-                [dailySection appendString:@"</tbody></table></div>\n"];
-            }
-
-            [dailySection appendString:@"</details>\n"];
-        }];
+        for (NSDictionary *record in records) {
+            [self writeDayDetails:record
+                        malicious:maliciousByDay[record[kStatsKeyDate]] ?: @[]
+                        cacheable:![record[kStatsKeyDate] isEqualToString:currentDay]
+                        fragments:fragments
+                           toFile:file];
+        }
+        [dailySection setString:@""];
     }
     [dailySection appendString:@"</div>\n"];
     [dailySection appendString:@"</details>\n"];
+    SNBReportWrite(file, dailySection);
+}
 
-    NSMutableString *html = [templateHTML mutableCopy];
-    NSDictionary<NSString *, NSString *> *tokens = @{
-        @"{{GENERATED_AT}}": generatedAt ?: @"",
-        @"{{WEEKLY_SECTION}}": weeklySection,
-        @"{{DAILY_SECTION}}": dailySection,
-        @"{{MALICIOUS_SECTION}}": maliciousSection,
-        @"{{DETAILS_SECTION}}": @""
-    };
-    [tokens enumerateKeysAndObjectsUsingBlock:^(NSString *token, NSString *value, BOOL *stop) {
-        [html replaceOccurrencesOfString:token
-                               withString:value ?: @""
-                                  options:0
-                                    range:NSMakeRange(0, html.length)];
+// Element ids carry the date rather than the day's position, so a cached
+// table stays valid as newer days push it down the list
+- (void)writeDayDetails:(NSDictionary *)record
+              malicious:(NSArray<NSDictionary *> *)malicious
+              cacheable:(BOOL)cacheable
+              fragments:(NSMutableSet<NSString *> *)fragments
+                 toFile:(FILE *)file {
+    NSString *date = record[kStatsKeyDate] ?: @"";
+    uint64_t totalBytes = [record[kStatsKeyTotalBytes] unsignedLongLongValue];
+    NSTimeInterval activeSeconds = [self activeSecondsForRecord:record];
+    uint64_t avgRate = activeSeconds > 0 ? (uint64_t)(totalBytes / activeSeconds) : 0;
+    NSString *detailsId = [NSString stringWithFormat:@"day-%@", date];
+    NSString *hostsTableId = [NSString stringWithFormat:@"hosts-%@", date];
+    NSString *connectionsTableId = [NSString stringWithFormat:@"connections-%@", date];
+
+    NSMutableString *details = [NSMutableString string];
+    [details appendFormat:@"<details id=\"%@\" class=\"detail-card\">\n", detailsId];
+    [details appendFormat:@"<summary>%@ - %@ total, %@ avg rate</summary>\n",
+     date,
+     [SNBByteFormatter stringFromBytes:totalBytes],
+     [self formattedRate:avgRate]];
+
+    [details appendString:@"<div class=\"controls\">"];
+    [details appendFormat:@"<label>Hosts sort <select data-target=\"%@\">", hostsTableId];
+    [details appendString:@"<option value=\"bytes_desc\" selected>Bytes</option>"];
+    [details appendString:@"<option value=\"packets_desc\">Packets</option>"];
+    [details appendString:@"<option value=\"host_asc\">Host</option>"];
+    [details appendString:@"</select></label>"];
+    [details appendFormat:@"<label>Connections sort <select data-target=\"%@\">", connectionsTableId];
+    [details appendString:@"<option value=\"bytes_desc\" selected>Bytes</option>"];
+    [details appendString:@"<option value=\"packets_desc\">Packets</option>"];
+    [details appendString:@"<option value=\"connection_asc\">Connection</option>"];
+    [details appendString:@"</select></label>"];
+    [details appendString:@"</div>"];
+    SNBReportWrite(file, details);
+
+    [self writeReportFragment:@"hosts" forRecord:record cacheable:cacheable fragments:fragments toFile:file builder:^NSString * {
+        return [self hostsHTMLForDay:date tableId:hostsTableId];
+    }];
+
+    [details setString:@"<h3 class=\"section-title\">Malicious Connections</h3>\n"];
+    if (malicious.count == 0) {
+        [details appendString:@"<p class=\"empty\">No malicious connections detected.</p>\n"];
+    } else {
+        [details appendString:@"<div class=\"table-wrap\"><table><thead><tr><th>Indicator</th><th>Connection</th><th>Score</th><th>Verdict</th><th>Confidence</th><th>Bytes</th><th>Packets</th><th>Providers</th><th>Explanation</th></tr></thead><tbody>\n"];
+        for (NSDictionary *entry in malicious) {
+            [details appendString:[self maliciousRowHTMLForEntry:entry date:nil]];
+        }
+        [details appendString:@"</tbody></table></div>\n"];
+    }
+    SNBReportWrite(file, details);
+
+    [self writeReportFragment:@"connections" forRecord:record cacheable:cacheable fragments:fragments toFile:file builder:^NSString * {
+        return [self connectionsHTMLForDay:date tableId:connectionsTableId];
     }];
+    SNBReportWrite(file, @"</details>\n");
+}
+
+- (NSString *)hostsHTMLForDay:(NSString *)date tableId:(NSString *)tableId {
+    NSArray<NSDictionary *> *hosts = [self hostsForDay:date];
+    NSMutableString *html = [NSMutableString stringWithString:@"<h3 class=\"section-title\">Hosts</h3>\n"];
+    if (hosts.count == 0) {
+        [html appendString:@"<p class=\"empty\">No host activity recorded.</p>\n"];
+        return html;
+    }
+    [html appendFormat:@"<div class=\"table-wrap\"><table id=\"%@\"><thead><tr><th>Host</th><th>Bytes</th><th>Packets</th></tr></thead><tbody>\n", tableId];
+    for (NSDictionary *host in hosts) {
+        NSString *address = host[kHostKeyAddress] ?: @"";
+        uint64_t bytes = [host[kHostKeyBytes] unsignedLongLongValue];
+        uint64_t packets = [host[kHostKeyPackets] unsignedLongLongValue];
+        [html appendFormat:@"<tr data-host=\"%@\" data-bytes=\"%llu\" data-packets=\"%llu\"><td>%@</td><td>%@</td><td>%llu</td></tr>\n",
+         address,
+         (unsigned long long)bytes,
+         (unsigned long long)packets,
+         address,
+         [SNBByteFormatter stringFromBytes:bytes],
+         (unsigned long long)packets];
+    }
+    [html appendString:@"</tbody></table></div>\n"];
+    return html;
+}
 
+- (NSString *)connectionsHTMLForDay:(NSString *)date tableId:(NSString *)tableId {
+    NSArray<NSDictionary *> *connections = [self connectionsForDay:date];
+    NSMutableString *html = [NSMutableString stringWithString:@"<h3 class=\"section-title\">Connections</h3>\n"];
+    if (connections.count == 0) {
+        [html appendString:@"<p class=\"empty\">No connection activity recorded.</p>\n"];
+        return html;
+    }
+    [html appendFormat:@"<div class=\"table-wrap\"><table id=\"%@\"><thead><tr><th>Connection</th><th>Bytes</th><th>Packets</th></tr></thead><tbody>\n", tableId];
+    for (NSDictionary *connection in connections) {
+        NSString *source = connection[kConnectionKeySource] ?: @"";
+        NSString *destination = connection[kConnectionKeyDestination] ?: @"";
+        NSNumber *sourcePort = connection[kConnectionKeySourcePort] ?: @(0);
+        NSNumber *destinationPort = connection[kConnectionKeyDestinationPort] ?: @(0);
+        uint64_t bytes = [connection[kConnectionKeyBytes] unsignedLongLongValue];
+        uint64_t packets = [connection[kConnectionKeyPackets] unsignedLongLongValue];
+        NSString *connectionLabel = [NSString stringWithFormat:@"%@:%ld -> %@:%ld",
+                                     source, (long)sourcePort.integerValue,
+                                     destination, (long)destinationPort.integerValue];
+        [html appendFormat:@"<tr data-connection=\"%@\" data-bytes=\"%llu\" data-packets=\"%llu\"><td>%@</td><td>%@</td><td>%llu</td></tr>\n",
+         connectionLabel,
+         (unsigned long long)bytes,
+         (unsigned long long)packets,
+         connectionLabel,
+         [SNBByteFormatter stringFromBytes:bytes],
+         (unsigned long long)packets];
+    }
+    [html appendString:@"</tbody></table></div>\n"];
+    return html;
+}
+
+// A day's host and connection rows only change when a flush adds to them,
+// which also raises the day's packet count, so the cached copy is named
+// after that count and a stale one is simply never asked for again
+- (void)writeReportFragment:(NSString *)part
+                  forRecord:(NSDictionary *)record
+                  cacheable:(BOOL)cacheable
+                  fragments:(NSMutableSet<NSString *> *)fragments
+                     toFile:(FILE *)file
+                    builder:(NSString * (^)(void))builder {
+    if (!cacheable) {
+        SNBReportWrite(file, builder());
+        return;
+    }
+    NSString *name = [NSString stringWithFormat:@"%@-%llu-%@.html",
+                      record[kStatsKeyDate], [record[kStatsKeyTotalPackets] unsignedLongLongValue], part];
+    [fragments addObject:name];
+    NSString *fragmentPath = [[self reportFragmentDirectory] stringByAppendingPathComponent:name];
+    if (SNBReportCopyFile(fragmentPath, file)) {
+        return;
+    }
+
+    NSString *html = builder();
+    SNBReportWrite(file, html);
     NSError *error = nil;
-    [html writeToFile:[self reportPath] atomically:YES encoding:NSUTF8StringEncoding error:&error];
-    if (error) {
-        SNBLogWarn("Failed to write report: %{public}@", error.localizedDescription);
+    if (![html writeToFile:fragmentPath atomically:YES encoding:NSUTF8StringEncoding error:&error]) {
+        SNBLogWarn("Failed to cache report fragment %{public}@: %{public}@", name, error.localizedDescription);
+    }
+}
+
+- (NSString *)reportFragmentDirectory {
+    NSString *directory = [self.directory stringByAppendingPathComponent:kReportFragmentDirectory];
+    NSFileManager *fm = [NSFileManager defaultManager];
+    if (![fm fileExistsAtPath:directory]) {
+        [fm createDirectoryAtPath:directory withIntermediateDirectories:YES attributes:nil error:nil];
     }
+    return directory;
+}
+
+// Drops fragments of days that have left the history or changed since
+- (void)removeReportFragmentsExcept:(NSSet<NSString *> *)fragments {
+    NSString *directory = [self reportFragmentDirectory];
+    NSFileManager *fm = [NSFileManager defaultManager];
+    for (NSString *name in [fm contentsOfDirectoryAtPath:directory error:nil]) {
+        if ([name.pathExtension isEqualToString:@"html"] && ![fragments containsObject:name]) {
+            [fm removeItemAtPath:[directory stringByAppendingPathComponent:name] error:nil];
+        }
+    }
+}
+
+// The report reads through its own connection so that it never waits on,
+// or holds up, the flushes on statsQueue; WAL lets it read while they write.
+// It only ever writes to its temporary tables.
+- (BOOL)openReportDatabase {
+    if (self.reportDb) {
+        return YES;
+    }
+    NSString *path = [self statsDatabasePath];
+    sqlite3 *db = NULL;
+    if (sqlite3_open_v2([path fileSystemRepresentation], &db, SQLITE_OPEN_READWRITE, NULL) != SQLITE_OK) {
+        SNBLogWarn("Failed to open stats database for the report at %{public}@ (%s)", path, sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return NO;
+    }
+    sqlite3_busy_timeout(db, 2000);
+    self.reportDb = db;
+    return YES;
 }
 
 - (NSArray<NSDictionary *> *)dailyRecordsFromDatabase {
-    if (!self.db) {
+    if (!self.reportDb) {
         return @[];
     }
 
@@ -946,7 +1439,7 @@ static NSString * const kMaliciousKeyScore = @"score";
         "SELECT day, total_bytes, total_packets, max_rate, max_connections, unique_hosts, first_seen, last_seen, active_seconds "
         "FROM stats_days ORDER BY day DESC;";
     sqlite3_stmt *stmt = NULL;
-    if (sqlite3_prepare_v2(self.db, sql, -1, &stmt, NULL) == SQLITE_OK) {
+    if (sqlite3_prepare_v2(self.reportDb, sql, -1, &stmt, NULL) == SQLITE_OK) {
         while (sqlite3_step(stmt) == SQLITE_ROW) {
             const char *day = (const char *)sqlite3_column_text(stmt, 0);
             if (!day) {
@@ -970,13 +1463,13 @@ static NSString * const kMaliciousKeyScore = @"score";
 }
 
 - (NSArray<NSDictionary *> *)hostsForDay:(NSString *)day {
-    if (!self.db || day.length == 0) {
+    if (!self.reportDb || day.length == 0) {
         return @[];
     }
     NSMutableArray<NSDictionary *> *hosts = [NSMutableArray array];
     const char *sql = "SELECT host, bytes, packets FROM stats_hosts WHERE day = ? ORDER BY bytes DESC;";
     sqlite3_stmt *stmt = NULL;
-    if (sqlite3_prepare_v2(self.db, sql, -1, &stmt, NULL) == SQLITE_OK) {
+    if (sqlite3_prepare_v2(self.reportDb, sql, -1, &stmt, NULL) == SQLITE_OK) {
         sqlite3_bind_text(stmt, 1, day.UTF8String, -1, SQLITE_TRANSIENT);
         while (sqlite3_step(stmt) == SQLITE_ROW) {
             const char *host = (const char *)sqlite3_column_text(stmt, 0);
@@ -997,7 +1490,7 @@ static NSString * const kMaliciousKeyScore = @"score";
 }
 
 - (NSArray<NSDictionary *> *)connectionsForDay:(NSString *)day {
-    if (!self.db || day.length == 0) {
+    if (!self.reportDb || day.length == 0) {
         return @[];
     }
     NSMutableArray<NSDictionary *> *connections = [NSMutableArray array];
@@ -1005,7 +1498,7 @@ static NSString * const kMaliciousKeyScore = @"score";
         "SELECT src_addr, src_port, dst_addr, dst_port, bytes, packets "
         "FROM stats_connections WHERE day = ? ORDER BY bytes DESC;";
     sqlite3_stmt *stmt = NULL;
-    if (sqlite3_prepare_v2(self.db, sql, -1, &stmt, NULL) == SQLITE_OK) {
+    if (sqlite3_prepare_v2(self.reportDb, sql, -1, &stmt, NULL) == SQLITE_OK) {
         sqlite3_bind_text(stmt, 1, day.UTF8String, -1, SQLITE_TRANSIENT);
         while (sqlite3_step(stmt) == SQLITE_ROW) {
             const char *src = (const char *)sqlite3_column_text(stmt, 0);
@@ -1029,18 +1522,8 @@ static NSString * const kMaliciousKeyScore = @"score";
     return connections;
 }
 
-- (TIEnrichmentResponse *)threatIntelResponseForIP:(NSString *)ip {
-    if (!self.threatIntelStore || ip.length == 0) {
-        return nil;
-    }
-    TIIndicator *indicator = [TIIndicator indicatorWithIP:ip];
-    if (!indicator) {
-        return nil;
-    }
-    return [self.threatIntelStore responseForIndicator:indicator];
-}
-
-- (NSDictionary *)maliciousEntryForConnection:(NSDictionary *)connection {
+- (NSDictionary *)maliciousEntryForConnection:(NSDictionary *)connection
+                                    responses:(NSDictionary<NSString *, TIEnrichmentResponse *> *)responses {
     NSString *source = connection[kConnectionKeySource] ?: @"";
     NSString *destination = connection[kConnectionKeyDestination] ?: @"";
     if (source.length == 0 && destination.length == 0) {
@@ -1077,7 +1560,7 @@ static NSString * const kMaliciousKeyScore = @"score";
     NSString *bestIndicator = nil;
     NSInteger bestScore = 0;
     for (NSString *candidate in candidates) {
-        TIEnrichmentResponse *response = [self threatIntelResponseForIP:candidate];
+        TIEnrichmentResponse *response = responses[candidate];
         TIScoringResult *scoring = response.scoringResult;
         if (!scoring || scoring.finalScore <= 0) {
             continue;
@@ -1099,30 +1582,102 @@ static NSString * const kMaliciousKeyScore = @"score";
     return entry;
 }
 
-- (NSArray<NSDictionary *> *)maliciousConnectionsForDay:(NSString *)day {
-    NSArray<NSDictionary *> *connections = [self connectionsForDay:day];
-    if (connections.count == 0) {
-        return @[];
+// Connections of every stored day that touch an IP with a positive threat
+// score, by day, highest score first. The flagged IPs are copied into a
+// temporary table and joined with stats_connections in one query, so only
+// matching rows leave SQLite, and only the responses of IPs that matched
+// are decoded. Runs inside the report's read transaction.
+- (NSDictionary<NSString *, NSArray<NSDictionary *> *> *)maliciousConnectionsByDay {
+    if (!self.reportDb || !self.threatIntelStore) {
+        return @{};
     }
-    NSMutableArray<NSDictionary *> *malicious = [NSMutableArray array];
-    for (NSDictionary *connection in connections) {
-        NSDictionary *entry = [self maliciousEntryForConnection:connection];
-        if (entry) {
-            [malicious addObject:entry];
+    NSDictionary<NSString *, NSNumber *> *flagged = [self.threatIntelStore scoresForIndicatorsWithMinimumScore:1];
+    if (flagged.count == 0) {
+        return @{};
+    }
+
+    sqlite3_exec(self.reportDb, "CREATE TEMP TABLE IF NOT EXISTS report_flagged (ip TEXT PRIMARY KEY) WITHOUT ROWID;",
+                 NULL, NULL, NULL);
+    sqlite3_exec(self.reportDb, "DELETE FROM temp.report_flagged;", NULL, NULL, NULL);
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(self.reportDb, "INSERT OR IGNORE INTO temp.report_flagged (ip) VALUES (?);", -1, &stmt, NULL) == SQLITE_OK) {
+        for (NSString *ip in flagged) {
+            sqlite3_bind_text(stmt, 1, ip.UTF8String, -1, SQLITE_TRANSIENT);
+            sqlite3_step(stmt);
+            sqlite3_reset(stmt);
         }
+        sqlite3_finalize(stmt);
     }
-    if (malicious.count == 0) {
-        return @[];
+
+    NSMutableArray<NSDictionary *> *matches = [NSMutableArray array];
+    NSMutableArray<NSString *> *matchDays = [NSMutableArray array];
+    NSMutableSet<NSString *> *matchedIPs = [NSMutableSet set];
+    const char *sql =
+        "SELECT day, src_addr, src_port, dst_addr, dst_port, bytes, packets FROM stats_connections "
+        "WHERE dst_addr IN (SELECT ip FROM temp.report_flagged) OR src_addr IN (SELECT ip FROM temp.report_flagged) "
+        "ORDER BY day DESC, bytes DESC;";
+    stmt = NULL;
+    if (sqlite3_prepare_v2(self.reportDb, sql, -1, &stmt, NULL) == SQLITE_OK) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            const char *day = (const char *)sqlite3_column_text(stmt, 0);
+            const char *src = (const char *)sqlite3_column_text(stmt, 1);
+            const char *dst = (const char *)sqlite3_column_text(stmt, 3);
+            if (!day || !src || !dst) {
+                continue;
+            }
+            NSString *source = [NSString stringWithUTF8String:src];
+            NSString *destination = [NSString stringWithUTF8String:dst];
+            if (flagged[source]) {
+                [matchedIPs addObject:source];
+            }
+            if (flagged[destination]) {
+                [matchedIPs addObject:destination];
+            }
+            [matchDays addObject:[NSString stringWithUTF8String:day]];
+            [matches addObject:@{
+                kConnectionKeySource: source,
+                kConnectionKeySourcePort: @(sqlite3_column_int(stmt, 2)),
+                kConnectionKeyDestination: destination,
+                kConnectionKeyDestinationPort: @(sqlite3_column_int(stmt, 4)),
+                kConnectionKeyBytes: @((uint64_t)sqlite3_column_int64(stmt, 5)),
+                kConnectionKeyPackets: @((uint64_t)sqlite3_column_int64(stmt, 6))
+            }];
+        }
+        sqlite3_finalize(stmt);
+    }
+    sqlite3_exec(self.reportDb, "DELETE FROM temp.report_flagged;", NULL, NULL, NULL);
+    if (matches.count == 0) {
+        return @{};
     }
-    [malicious sortUsingComparator:^NSComparisonResult(NSDictionary *obj1, NSDictionary *obj2) {
-        NSInteger score1 = [obj1[kMaliciousKeyScore] integerValue];
-        NSInteger score2 = [obj2[kMaliciousKeyScore] integerValue];
-        if (score1 == score2) {
-            return NSOrderedSame;
+
+    NSDictionary<NSString *, TIEnrichmentResponse *> *responses =
+        [self.threatIntelStore responsesForIPs:matchedIPs minimumScore:1];
+    NSMutableDictionary<NSString *, NSMutableArray<NSDictionary *> *> *maliciousByDay = [NSMutableDictionary dictionary];
+    [matches enumerateObjectsUsingBlock:^(NSDictionary *connection, NSUInteger idx, BOOL *stop) {
+        NSDictionary *entry = [self maliciousEntryForConnection:connection responses:responses];
+        if (!entry) {
+            return;
         }
-        return score1 > score2 ? NSOrderedAscending : NSOrderedDescending;
+        NSString *day = matchDays[idx];
+        NSMutableArray<NSDictionary *> *malicious = maliciousByDay[day];
+        if (!malicious) {
+            malicious = [NSMutableArray array];
+            maliciousByDay[day] = malicious;
+        }
+        [malicious addObject:entry];
     }];
-    return malicious;
+    for (NSMutableArray<NSDictionary *> *malicious in maliciousByDay.allValues) {
+        // Stable, so equal scores keep the busiest connection first
+        [malicious sortWithOptions:NSSortStable usingComparator:^NSComparisonResult(NSDictionary *obj1, NSDictionary *obj2) {
+            NSInteger score1 = [obj1[kMaliciousKeyScore] integerValue];
+            NSInteger score2 = [obj2[kMaliciousKeyScore] integerValue];
+            if (score1 == score2) {
+                return NSOrderedSame;
+            }
+            return score1 > score2 ? NSOrderedAscending : NSOrderedDescending;
+        }];
+    }
+    return maliciousByDay;
 }
 
 - (NSString *)providerDetailsHTMLForResponse:(TIEnrichmentResponse *)response {
@@ -1239,15 +1794,17 @@ static NSString * const kMaliciousKeyScore = @"score";
 #pragma mark - Helpers
 
 - (void)refreshCurrentDaySnapshot {
-    if (!self.currentDayRecord) {
+    if (!self.hasCurrentDay) {
         return;
     }
-    NSTimeInterval now = [NSDate date].timeIntervalSince1970;
-    NSTimeInterval firstSeen = [self.currentDayRecord[kStatsKeyFirstSeen] doubleValue];
-    NSTimeInterval activeSeconds = MAX(1.0, now - firstSeen);
-    self.currentDayRecord[kStatsKeyLastSeen] = @(now);
-    self.currentDayRecord[kStatsKeyActiveSeconds] = @(activeSeconds);
-    self.currentDayRecord[kStatsKeyUniqueHosts] = @(self.uniqueHosts.count);
+    // A day switched back to, or replayed again, may already reach later,
+    // and the clock never runs back to it, so the day's midnight caps it
+    NSTimeInterval now = SNBPacketClockNow(&_packetClock);
+    if (self.currentDayEnd > 0) {
+        now = MIN(now, self.currentDayEnd);
+    }
+    _day.lastSeen = MAX(_day.lastSeen, now);
+    _day.activeSeconds = MAX(1.0, _day.lastSeen - _day.firstSeen);
 }
 
 - (BOOL)isLocalAddress:(NSString *)address {
@@ -1284,7 +1841,7 @@ static NSString * const kMaliciousKeyScore = @"score";
     return [addresses copy];
 }
 
-- (NSString *)applicationSupportDirectory {
++ (NSString *)applicationSupportDirectory {
     NSArray<NSString *> *paths = NSSearchPathForDirectoriesInDomains(NSApplicationSupportDirectory,
                                                                      NSUserDomainMask,
                                                                      YES);
@@ -1340,7 +1897,7 @@ static NSString * const kMaliciousKeyScore = @"score";
         if (!strongSelf || !strongSelf.enabled) {
             return;
         }
-        [strongSelf finalizeCurrentSecondBucketWithTimestamp:[NSDate date].timeIntervalSince1970];
+        [strongSelf finalizeCurrentSecondBucketWithTimestamp:SNBPacketClockNow(&strongSelf->_packetClock)];
         [strongSelf finalizeCurrentDayIfNeeded];
         [strongSelf persistToDatabase];
         [strongSelf generateReportLocked];
@@ -0,0 +1,155 @@
+//
+//  TimeSeries.c
+//  SniffNetBar
+//
+//  Fixed-size traffic rings at one second, one minute and one hour
+//
+
+#include "TimeSeries.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const uint32_t SNBTimeSeriesCapacities[SNBTimeSeriesResolutionCount] = {
+    SNB_TIME_SERIES_SECONDS, SNB_TIME_SERIES_MINUTES, SNB_TIME_SERIES_HOURS,
+};
+static const uint32_t SNBTimeSeriesWidths[SNBTimeSeriesResolutionCount] = {1, 60, 3600};
+
+// MARK: - Lifecycle
+
+bool SNBTimeSeriesInit(SNBTimeSeries *series) {
+    memset(series, 0, sizeof(*series));
+    for (int r = 0; r < SNBTimeSeriesResolutionCount; r++) {
+        SNBTimeSeriesRing *ring = &series->rings[r];
+        ring->capacity = SNBTimeSeriesCapacities[r];
+        ring->width = SNBTimeSeriesWidths[r];
+        ring->buckets = calloc(ring->capacity, sizeof(SNBTimeSeriesBucket));
+        if (!ring->buckets) {
+            SNBTimeSeriesDestroy(series);
+            return false;
+        }
+    }
+    return true;
+}
+
+void SNBTimeSeriesDestroy(SNBTimeSeries *series) {
+    for (int r = 0; r < SNBTimeSeriesResolutionCount; r++) {
+        free(series->rings[r].buckets);
+        series->rings[r].buckets = NULL;
+    }
+}
+
+size_t SNBTimeSeriesMemoryBytes(const SNBTimeSeries *series) {
+    size_t bytes = sizeof(*series);
+    for (int r = 0; r < SNBTimeSeriesResolutionCount; r++) {
+        bytes += (size_t)series->rings[r].capacity * sizeof(SNBTimeSeriesBucket);
+    }
+    return bytes;
+}
+
+// MARK: - Slots
+
+static inline SNBTimeSeriesBucket *SNBTimeSeriesSlot(const SNBTimeSeriesRing *ring, int64_t start) {
+    int64_t step = start / ring->width;
+    int64_t index = step % ring->capacity;
+    if (index < 0) {
+        index += ring->capacity;
+    }
+    return &ring->buckets[index];
+}
+
+// The bucket for start, recycling its slot if it still holds an older one.
+// NULL when the slot already moved on to a newer bucket.
+static inline SNBTimeSeriesBucket *SNBTimeSeriesClaim(SNBTimeSeriesRing *ring, int64_t start) {
+    SNBTimeSeriesBucket *bucket = SNBTimeSeriesSlot(ring, start);
+    if (bucket->start == start) {
+        return bucket;
+    }
+    if (bucket->start > start) {
+        return NULL;
+    }
+    memset(bucket, 0, sizeof(*bucket));
+    bucket->start = start;
+    return bucket;
+}
+
+// MARK: - Recording
+
+void SNBTimeSeriesAddTraffic(SNBTimeSeries *series,
+                             int64_t second,
+                             SNBTrafficDirection direction,
+                             uint64_t bytes,
+                             uint64_t packets) {
+    for (int r = 0; r < SNBTimeSeriesResolutionCount; r++) {
+        SNBTimeSeriesRing *ring = &series->rings[r];
+        SNBTimeSeriesBucket *bucket = SNBTimeSeriesClaim(ring, SNBTimeSeriesBucketStart(series, r, second));
+        if (bucket) {
+            bucket->bytes[direction] += bytes;
+            bucket->packets[direction] += packets;
+        }
+    }
+}
+
+void SNBTimeSeriesAddConnection(SNBTimeSeries *series,
+                                int64_t second,
+                                SNBTrafficDirection direction,
+                                int64_t lastSecond) {
+    // Buckets nest, so once the connection was already active in the
+    // current bucket of one resolution it was in every coarser one too
+    for (int r = 0; r < SNBTimeSeriesResolutionCount; r++) {
+        int64_t start = SNBTimeSeriesBucketStart(series, r, second);
+        if (lastSecond >= start) {
+            return;
+        }
+        SNBTimeSeriesBucket *bucket = SNBTimeSeriesClaim(&series->rings[r], start);
+        if (bucket) {
+            bucket->connections[direction]++;
+        }
+    }
+}
+
+void SNBTimeSeriesMerge(SNBTimeSeries *series,
+                        SNBTimeSeriesResolution resolution,
+                        const SNBTimeSeriesBucket *source) {
+    int64_t start = SNBTimeSeriesBucketStart(series, resolution, source->start);
+    SNBTimeSeriesBucket *bucket = SNBTimeSeriesClaim(&series->rings[resolution], start);
+    if (!bucket) {
+        return;
+    }
+    for (int d = 0; d < SNBTrafficDirectionCount; d++) {
+        bucket->bytes[d] += source->bytes[d];
+        bucket->packets[d] += source->packets[d];
+        bucket->connections[d] += source->connections[d];
+    }
+}
+
+// MARK: - Reading
+
+const SNBTimeSeriesBucket *SNBTimeSeriesFind(const SNBTimeSeries *series,
+                                             SNBTimeSeriesResolution resolution,
+                                             int64_t start) {
+    const SNBTimeSeriesRing *ring = &series->rings[resolution];
+    const SNBTimeSeriesBucket *bucket = SNBTimeSeriesSlot(ring, start);
+    return bucket->start == start ? bucket : NULL;
+}
+
+size_t SNBTimeSeriesCopy(const SNBTimeSeries *series,
+                         SNBTimeSeriesResolution resolution,
+                         int64_t from,
+                         int64_t to,
+                         SNBTimeSeriesBucket *buckets,
+                         size_t maxCount) {
+    int64_t width = series->rings[resolution].width;
+    size_t count = 0;
+    for (int64_t start = SNBTimeSeriesBucketStart(series, resolution, from); start < to && count < maxCount;
+         start += width) {
+        const SNBTimeSeriesBucket *bucket = SNBTimeSeriesFind(series, resolution, start);
+        if (bucket) {
+            buckets[count] = *bucket;
+        } else {
+            memset(&buckets[count], 0, sizeof(buckets[count]));
+            buckets[count].start = start;
+        }
+        count++;
+    }
+    return count;
+}
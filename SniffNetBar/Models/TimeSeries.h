@@ -0,0 +1,108 @@
+//
+//  TimeSeries.h
+//  SniffNetBar
+//
+//  Fixed-size traffic rings at one second, one minute and one hour
+//
+
+#ifndef SNB_TIME_SERIES_H
+#define SNB_TIME_SERIES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Ring lengths: the last hour by second, the last day by minute and the last
+// week by hour, about 250 KB in all however long the capture runs
+#define SNB_TIME_SERIES_SECONDS 3600
+#define SNB_TIME_SERIES_MINUTES 1440
+#define SNB_TIME_SERIES_HOURS 168
+
+typedef enum {
+    SNBTimeSeriesSecond = 0,
+    SNBTimeSeriesMinute,
+    SNBTimeSeriesHour,
+    SNBTimeSeriesResolutionCount
+} SNBTimeSeriesResolution;
+
+typedef enum {
+    SNBTrafficIncoming = 0,
+    SNBTrafficOutgoing,
+    SNBTrafficDirectionCount
+} SNBTrafficDirection;
+
+// One bucket per resolution step, aligned to multiples of its width in Unix
+// seconds. connections counts the distinct connections active in the bucket.
+// A zeroed bucket is empty.
+typedef struct {
+    int64_t start;
+    uint64_t bytes[SNBTrafficDirectionCount];
+    uint64_t packets[SNBTrafficDirectionCount];
+    uint32_t connections[SNBTrafficDirectionCount];
+} SNBTimeSeriesBucket;
+
+typedef struct {
+    SNBTimeSeriesBucket *buckets;
+    uint32_t capacity;
+    uint32_t width;              // Seconds per bucket
+} SNBTimeSeriesRing;
+
+// Each bucket lives in the slot its start maps to, so recording is one
+// index computation per resolution and a slot is recycled the first time a
+// newer bucket lands on it. Traffic older than a slot's current bucket, or
+// than the ring reaches back, is dropped from that resolution only. Owned by
+// one queue; not thread-safe.
+typedef struct {
+    SNBTimeSeriesRing rings[SNBTimeSeriesResolutionCount];
+} SNBTimeSeries;
+
+// Returns false on allocation failure
+bool SNBTimeSeriesInit(SNBTimeSeries *series);
+void SNBTimeSeriesDestroy(SNBTimeSeries *series);
+size_t SNBTimeSeriesMemoryBytes(const SNBTimeSeries *series);
+
+static inline int64_t SNBTimeSeriesBucketStart(const SNBTimeSeries *series,
+                                               SNBTimeSeriesResolution resolution,
+                                               int64_t second) {
+    int64_t width = series->rings[resolution].width;
+    return second - ((second % width) + width) % width;
+}
+
+// Accounts traffic captured during second to every resolution
+void SNBTimeSeriesAddTraffic(SNBTimeSeries *series,
+                             int64_t second,
+                             SNBTrafficDirection direction,
+                             uint64_t bytes,
+                             uint64_t packets);
+
+// Counts a connection active during second in every bucket it was not yet
+// counted in. lastSecond is the second the connection was last active
+// before this one, or 0 for a new connection; the caller keeps it per
+// connection.
+void SNBTimeSeriesAddConnection(SNBTimeSeries *series,
+                                int64_t second,
+                                SNBTrafficDirection direction,
+                                int64_t lastSecond);
+
+// The bucket starting at start, or NULL if the ring no longer (or not yet)
+// holds it
+const SNBTimeSeriesBucket *SNBTimeSeriesFind(const SNBTimeSeries *series,
+                                             SNBTimeSeriesResolution resolution,
+                                             int64_t start);
+
+// Restores a bucket, for example one persisted before a restart. Adds to
+// whatever the ring already holds for that start.
+void SNBTimeSeriesMerge(SNBTimeSeries *series,
+                        SNBTimeSeriesResolution resolution,
+                        const SNBTimeSeriesBucket *bucket);
+
+// Copies the buckets of [from, to) in order, one per step, zero-filling the
+// ones the ring does not hold. Returns the number written, at most maxCount.
+size_t SNBTimeSeriesCopy(const SNBTimeSeries *series,
+                         SNBTimeSeriesResolution resolution,
+                         int64_t from,
+                         int64_t to,
+                         SNBTimeSeriesBucket *buckets,
+                         size_t maxCount);
+
+#endif
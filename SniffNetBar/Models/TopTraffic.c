@@ -0,0 +1,191 @@
+//
+//  TopTraffic.c
+//  SniffNetBar
+//
+//  Incrementally maintained top-K of a traffic table
+//
+
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+
+#include "TopTraffic.h"
+#include <stdlib.h>
+#include <string.h>
+
+bool SNBTopTrafficInit(SNBTopTraffic *top, size_t limit) {
+    memset(top, 0, sizeof(*top));
+    if (limit > SNB_TOP_TRAFFIC_MAX_LIMIT) {
+        limit = SNB_TOP_TRAFFIC_MAX_LIMIT;
+    }
+    top->heap = calloc(limit ? limit : 1, sizeof(SNBTopTrafficEntry));
+    if (!top->heap) {
+        return false;
+    }
+    top->limit = limit;
+    top->complete = true;
+    return true;
+}
+
+void SNBTopTrafficDestroy(SNBTopTraffic *top) {
+    free(top->heap);
+    memset(top, 0, sizeof(*top));
+}
+
+void SNBTopTrafficClear(SNBTopTraffic *top) {
+    top->count = 0;
+    top->complete = true;
+}
+
+// MARK: - Heap
+
+// Writes the entry at index back into its counters' topSlot
+static void SNBTopTrafficPlace(SNBTopTraffic *top, SNBFlowTable *table, size_t index) {
+    SNBTrafficCounters *counters = SNBFlowTableFind(table, &top->heap[index].key);
+    if (counters) {
+        counters->topSlot = (uint16_t)(index + 1);
+    }
+}
+
+static void SNBTopTrafficSwap(SNBTopTraffic *top, SNBFlowTable *table, size_t lhs, size_t rhs) {
+    SNBTopTrafficEntry temporary = top->heap[lhs];
+    top->heap[lhs] = top->heap[rhs];
+    top->heap[rhs] = temporary;
+    SNBTopTrafficPlace(top, table, lhs);
+    SNBTopTrafficPlace(top, table, rhs);
+}
+
+static void SNBTopTrafficSiftUp(SNBTopTraffic *top, SNBFlowTable *table, size_t index) {
+    while (index > 0) {
+        size_t parent = (index - 1) / 2;
+        if (top->heap[parent].bytes <= top->heap[index].bytes) {
+            break;
+        }
+        SNBTopTrafficSwap(top, table, parent, index);
+        index = parent;
+    }
+}
+
+static void SNBTopTrafficSiftDown(SNBTopTraffic *top, SNBFlowTable *table, size_t index) {
+    for (;;) {
+        size_t smallest = index;
+        size_t left = 2 * index + 1;
+        size_t right = left + 1;
+        if (left < top->count && top->heap[left].bytes < top->heap[smallest].bytes) {
+            smallest = left;
+        }
+        if (right < top->count && top->heap[right].bytes < top->heap[smallest].bytes) {
+            smallest = right;
+        }
+        if (smallest == index) {
+            return;
+        }
+        SNBTopTrafficSwap(top, table, index, smallest);
+        index = smallest;
+    }
+}
+
+// MARK: - Updates
+
+void SNBTopTrafficUpdate(SNBTopTraffic *top, SNBFlowTable *table, const SNBFlowKey *key, SNBTrafficCounters *counters) {
+    if (!top->complete || top->limit == 0) {
+        // Rebuilt from the table on the next read
+        return;
+    }
+    if (counters->topSlot != 0) {
+        size_t index = counters->topSlot - 1u;
+        top->heap[index].bytes = counters->bytes;
+        SNBTopTrafficSiftDown(top, table, index);
+        return;
+    }
+    if (top->count < top->limit) {
+        size_t index = top->count++;
+        top->heap[index] = (SNBTopTrafficEntry){ *key, counters->bytes };
+        counters->topSlot = (uint16_t)(index + 1);
+        SNBTopTrafficSiftUp(top, table, index);
+        return;
+    }
+    if (counters->bytes <= top->heap[0].bytes) {
+        return;
+    }
+    // Displace the smallest ranked entry
+    SNBTrafficCounters *displaced = SNBFlowTableFind(table, &top->heap[0].key);
+    if (displaced) {
+        displaced->topSlot = 0;
+    }
+    top->heap[0] = (SNBTopTrafficEntry){ *key, counters->bytes };
+    counters->topSlot = 1;
+    SNBTopTrafficSiftDown(top, table, 0);
+}
+
+void SNBTopTrafficRemove(SNBTopTraffic *top, SNBFlowTable *table, SNBTrafficCounters *counters) {
+    if (counters->topSlot == 0) {
+        return;
+    }
+    size_t index = counters->topSlot - 1u;
+    counters->topSlot = 0;
+    top->complete = false;
+    if (index >= top->count) {
+        return;
+    }
+    size_t last = --top->count;
+    if (index != last) {
+        top->heap[index] = top->heap[last];
+        SNBTopTrafficPlace(top, table, index);
+        SNBTopTrafficSiftDown(top, table, index);
+        SNBTopTrafficSiftUp(top, table, index);
+    }
+}
+
+static void SNBTopTrafficRebuild(SNBTopTraffic *top, SNBFlowTable *table) {
+    top->count = 0;
+    top->complete = true;
+    size_t cursor = 0;
+    const SNBFlowKey *key = NULL;
+    SNBTrafficCounters *counters;
+    while ((counters = SNBFlowTableNext(table, &cursor, &key)) != NULL) {
+        counters->topSlot = 0;
+    }
+    cursor = 0;
+    while ((counters = SNBFlowTableNext(table, &cursor, &key)) != NULL) {
+        SNBTopTrafficUpdate(top, table, key, counters);
+    }
+}
+
+bool SNBTopTrafficSetLimit(SNBTopTraffic *top, SNBFlowTable *table, size_t limit) {
+    if (limit > SNB_TOP_TRAFFIC_MAX_LIMIT) {
+        limit = SNB_TOP_TRAFFIC_MAX_LIMIT;
+    }
+    if (limit == top->limit) {
+        return true;
+    }
+    SNBTopTrafficEntry *heap = realloc(top->heap, (limit ? limit : 1) * sizeof(SNBTopTrafficEntry));
+    if (!heap) {
+        return false;
+    }
+    top->heap = heap;
+    top->limit = limit;
+    SNBTopTrafficRebuild(top, table);
+    return true;
+}
+
+// MARK: - Reading
+
+static int SNBCompareTopEntries(const void *lhs, const void *rhs) {
+    const SNBTopTrafficEntry *left = lhs;
+    const SNBTopTrafficEntry *right = rhs;
+    if (left->bytes != right->bytes) {
+        return left->bytes < right->bytes ? 1 : -1;
+    }
+    // Stable order for equal counts, so the menu does not flicker
+    return memcmp(&left->key, &right->key, sizeof(left->key));
+}
+
+size_t SNBTopTrafficCopySorted(SNBTopTraffic *top, SNBFlowTable *table, SNBTopTrafficEntry *entries) {
+    if (!top->complete) {
+        SNBTopTrafficRebuild(top, table);
+    }
+    memcpy(entries, top->heap, top->count * sizeof(SNBTopTrafficEntry));
+    qsort(entries, top->count, sizeof(SNBTopTrafficEntry), SNBCompareTopEntries);
+    return top->count;
+}
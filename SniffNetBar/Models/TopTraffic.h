@@ -0,0 +1,60 @@
+//
+//  TopTraffic.h
+//  SniffNetBar
+//
+//  Incrementally maintained top-K of a traffic table
+//
+
+#ifndef SNB_TOP_TRAFFIC_H
+#define SNB_TOP_TRAFFIC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "FlowTable.h"
+#include "TrafficShards.h"
+
+// Largest limit a ranking accepts; topSlot is 16 bits wide
+#define SNB_TOP_TRAFFIC_MAX_LIMIT 4096
+
+typedef struct SNBTopTrafficEntry {
+    SNBFlowKey key;
+    uint64_t bytes;
+} SNBTopTrafficEntry;
+
+// The limit entries with the most bytes in one SNBTrafficCounters table, kept
+// as an indexed min-heap: each ranked entry's counters hold its heap position
+// in topSlot, so a counter that grows is re-sifted in O(log K) and an entry
+// that overtakes the smallest ranked one replaces it. Byte counts only grow,
+// which keeps the heap exact under updates. Removing a ranked entry leaves a
+// gap only a rescan can fill, so the ranking is marked incomplete and rebuilt
+// on the next read. Owned by the table's queue; not thread-safe.
+typedef struct SNBTopTraffic {
+    SNBTopTrafficEntry *heap;    // heap[0] has the fewest bytes
+    size_t count;
+    size_t limit;
+    bool complete;
+} SNBTopTraffic;
+
+bool SNBTopTrafficInit(SNBTopTraffic *top, size_t limit);
+void SNBTopTrafficDestroy(SNBTopTraffic *top);
+
+// Changes the limit and rescans table. Returns false on allocation failure,
+// leaving the old limit in place.
+bool SNBTopTrafficSetLimit(SNBTopTraffic *top, SNBFlowTable *table, size_t limit);
+
+// Call after counters->bytes grew, or after the entry was inserted
+void SNBTopTrafficUpdate(SNBTopTraffic *top, SNBFlowTable *table, const SNBFlowKey *key, SNBTrafficCounters *counters);
+
+// Call before the entry with these counters leaves the table
+void SNBTopTrafficRemove(SNBTopTraffic *top, SNBFlowTable *table, SNBTrafficCounters *counters);
+
+// Call after the table was cleared
+void SNBTopTrafficClear(SNBTopTraffic *top);
+
+// Copies the ranking into entries (room for limit) sorted by bytes,
+// descending, and returns the count. Rescans the table first if a ranked
+// entry was removed; otherwise costs O(K log K) whatever the table size.
+size_t SNBTopTrafficCopySorted(SNBTopTraffic *top, SNBFlowTable *table, SNBTopTrafficEntry *entries);
+
+#endif
@@ -0,0 +1,170 @@
+//
+//  TrafficShards.c
+//  SniffNetBar
+//
+//  Sharded per-host and per-connection accounting for the traffic statistics
+//
+
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+
+#include "TrafficShards.h"
+#include <string.h>
+#include "PacketDirection.h"
+
+bool SNBTrafficDeltaInit(SNBTrafficDelta *delta, size_t hostCapacity, size_t connectionCapacity) {
+    memset(delta, 0, sizeof(*delta));
+    delta->hosts = SNBFlowTableCreate(sizeof(SNBTrafficCounters), hostCapacity);
+    delta->connections = SNBFlowTableCreate(sizeof(SNBTrafficCounters), connectionCapacity);
+    if (!delta->hosts || !delta->connections) {
+        SNBTrafficDeltaDestroy(delta);
+        return false;
+    }
+    return true;
+}
+
+void SNBTrafficDeltaDestroy(SNBTrafficDelta *delta) {
+    SNBFlowTableDestroy(delta->hosts);
+    SNBFlowTableDestroy(delta->connections);
+    memset(delta, 0, sizeof(*delta));
+}
+
+void SNBTrafficDeltaReset(SNBTrafficDelta *delta) {
+    SNBFlowTableClear(delta->hosts);
+    SNBFlowTableClear(delta->connections);
+    delta->totalBytes = 0;
+    delta->incomingBytes = 0;
+    delta->totalPackets = 0;
+    memset(delta->interfaceBytes, 0, sizeof(delta->interfaceBytes));
+    memset(delta->interfacePackets, 0, sizeof(delta->interfacePackets));
+    memset(&delta->clock, 0, sizeof(delta->clock));
+}
+
+void SNBTrafficDeltaSwap(SNBTrafficDelta *lhs, SNBTrafficDelta *rhs) {
+    SNBTrafficDelta temporary = *lhs;
+    *lhs = *rhs;
+    *rhs = temporary;
+}
+
+void SNBTrafficConnectionKeyMake(SNBFlowKey *key, const SNBPacketRecord *record) {
+    SNBFlowKeyMakeRecord(key, record);
+    key->ipProtocol = 0;
+    if (!(record->flags & SNBPacketRecordFlagOutgoing)) {
+        memcpy(key->sourceAddress, record->destinationAddress, sizeof(key->sourceAddress));
+        memcpy(key->destinationAddress, record->sourceAddress, sizeof(key->destinationAddress));
+        key->sourcePort = record->destinationPort;
+        key->destinationPort = record->sourcePort;
+    }
+}
+
+void SNBTrafficPartitionRecords(const SNBPacketRecord *records,
+                                size_t count,
+                                unsigned shardCount,
+                                uint8_t *shardIndices) {
+    if (shardCount <= 1) {
+        memset(shardIndices, 0, count);
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        SNBFlowKey key;
+        SNBTrafficConnectionKeyMake(&key, &records[i]);
+        // Multiply-shift keeps the high bits; the shard tables index by the low ones
+        shardIndices[i] = (uint8_t)(((uint64_t)SNBFlowKeyHash(&key) * shardCount) >> 32);
+    }
+}
+
+static inline void SNBTrafficCount(SNBTrafficCounters *counters, const SNBPacketRecord *record) {
+    counters->bytes += record->length;
+    counters->packets++;
+    counters->lastActivityNs = record->timestampNs;
+    counters->interfaceIndex = record->interfaceIndex;
+}
+
+void SNBTrafficDeltaAccount(SNBTrafficDelta *delta,
+                            const SNBPacketRecord *records,
+                            size_t count,
+                            const uint8_t *shardIndices,
+                            unsigned shard,
+                            uint64_t wallNs) {
+    uint64_t latestNs = 0;
+    for (size_t i = 0; i < count; i++) {
+        const SNBPacketRecord *record = &records[i];
+        if ((shardIndices && shardIndices[i] != shard) || record->length == 0) {
+            continue;
+        }
+        delta->totalBytes += record->length;
+        delta->totalPackets++;
+        unsigned interfaceIndex = record->interfaceIndex < SNB_PACKET_MAX_INTERFACES ? record->interfaceIndex : 0;
+        delta->interfaceBytes[interfaceIndex] += record->length;
+        delta->interfacePackets[interfaceIndex]++;
+        if (record->timestampNs > latestNs) {
+            latestNs = record->timestampNs;
+        }
+
+        // Direction was tagged by the capture manager
+        bool outgoing = (record->flags & SNBPacketRecordFlagOutgoing) != 0;
+        if (!outgoing) {
+            delta->incomingBytes += record->length;
+        }
+        if (record->family == SNBAddressFamilyNone) {
+            continue;
+        }
+
+        SNBFlowKey key;
+        SNBFlowKeyMakeAddress(&key, record->family, SNBPacketRecordRemoteAddress(record));
+        SNBTrafficCounters *host = SNBFlowTableUpsert(delta->hosts, &key, NULL);
+        if (host) {
+            SNBTrafficCount(host, record);
+        }
+
+        bool inserted = false;
+        SNBTrafficConnectionKeyMake(&key, record);
+        SNBTrafficCounters *connection = SNBFlowTableUpsert(delta->connections, &key, &inserted);
+        if (connection) {
+            if (inserted && outgoing) {
+                connection->flags |= SNBTrafficCountersFlagOutgoing;
+            }
+            SNBTrafficCount(connection, record);
+        }
+    }
+    SNBPacketClockAdvanceTo(&delta->clock, latestNs, wallNs);
+}
+
+static void SNBTrafficMergeTable(const SNBFlowTable *source,
+                                 SNBFlowTable *target,
+                                 bool isHost,
+                                 SNBTrafficMergeHandler handler,
+                                 void *context) {
+    size_t cursor = 0;
+    const SNBFlowKey *key = NULL;
+    const SNBTrafficCounters *counters;
+    while ((counters = SNBFlowTableNext(source, &cursor, &key)) != NULL) {
+        bool inserted = false;
+        SNBTrafficCounters *merged = SNBFlowTableUpsert(target, key, &inserted);
+        if (!merged) {
+            continue;
+        }
+        merged->bytes += counters->bytes;
+        merged->packets += counters->packets;
+        if (counters->lastActivityNs >= merged->lastActivityNs) {
+            merged->lastActivityNs = counters->lastActivityNs;
+            merged->interfaceIndex = counters->interfaceIndex;
+        }
+        if (inserted) {
+            merged->flags = counters->flags;
+        }
+        if (handler) {
+            handler(context, key, merged, counters, isHost, inserted);
+        }
+    }
+}
+
+void SNBTrafficDeltaMerge(const SNBTrafficDelta *delta,
+                          SNBFlowTable *hosts,
+                          SNBFlowTable *connections,
+                          SNBTrafficMergeHandler handler,
+                          void *context) {
+    SNBTrafficMergeTable(delta->hosts, hosts, true, handler, context);
+    SNBTrafficMergeTable(delta->connections, connections, false, handler, context);
+}
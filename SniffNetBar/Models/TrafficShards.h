@@ -0,0 +1,107 @@
+//
+//  TrafficShards.h
+//  SniffNetBar
+//
+//  Sharded per-host and per-connection accounting for the traffic statistics
+//
+
+#ifndef SNB_TRAFFIC_SHARDS_H
+#define SNB_TRAFFIC_SHARDS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "FlowTable.h"
+#include "PacketClock.h"
+#include "PacketRecord.h"
+
+// Upper bound on worker shards; shard indices fit in a byte
+#define SNB_TRAFFIC_MAX_SHARDS 16
+
+enum {
+    // The first packet of the connection left the local host
+    SNBTrafficCountersFlagOutgoing = 1 << 0,
+};
+
+// Per-host and per-connection counters, stored inline in the flow tables so
+// that counting a packet never allocates. The slots are bookkeeping of the
+// merged tables and stay zero in the shard deltas.
+typedef struct SNBTrafficCounters {
+    uint64_t bytes;
+    uint64_t packets;
+    uint64_t lastActivityNs;     // Capture time of the latest packet, Unix ns
+    uint8_t flags;
+    uint8_t interfaceIndex;      // Interface of the latest packet (SNBPacketRecord.interfaceIndex)
+    uint16_t topSlot;            // 1-based position in the table's top-K heap, 0 when unranked
+    uint32_t processSlot;        // Process the connection is attributed to, 0 when unknown
+} SNBTrafficCounters;
+
+// Traffic counted since the last merge. Each shard owns one and is the only
+// writer, so accounting takes no locks and touches only tables sized for the
+// flows active in one merge interval. Records are assigned to shards by the
+// hash of their oriented connection, so every connection is counted by
+// exactly one shard; a host's traffic may be split across shards and is
+// summed when the deltas are merged.
+typedef struct SNBTrafficDelta {
+    SNBFlowTable *hosts;         // Remote address -> SNBTrafficCounters
+    SNBFlowTable *connections;   // Local -> remote -> SNBTrafficCounters
+    uint64_t totalBytes;
+    uint64_t incomingBytes;
+    uint64_t totalPackets;
+    // Traffic per capture interface, by SNBPacketRecord.interfaceIndex
+    uint64_t interfaceBytes[SNB_PACKET_MAX_INTERFACES];
+    uint64_t interfacePackets[SNB_PACKET_MAX_INTERFACES];
+    SNBPacketClock clock;        // Latest capture time in this delta
+} SNBTrafficDelta;
+
+bool SNBTrafficDeltaInit(SNBTrafficDelta *delta, size_t hostCapacity, size_t connectionCapacity);
+void SNBTrafficDeltaDestroy(SNBTrafficDelta *delta);
+
+// Empties the delta but keeps the table allocations for the next interval
+void SNBTrafficDeltaReset(SNBTrafficDelta *delta);
+
+// Exchanges the contents of two deltas. The merge swaps a shard's delta with
+// an empty spare, so the shard's worker is held only for the exchange.
+void SNBTrafficDeltaSwap(SNBTrafficDelta *lhs, SNBTrafficDelta *rhs);
+
+// Connection key oriented local -> remote, matching how connections are shown.
+// The protocol is left out so a TCP and UDP flow on the same ports merge.
+void SNBTrafficConnectionKeyMake(SNBFlowKey *key, const SNBPacketRecord *record);
+
+// Writes the owning shard of each record into shardIndices. Run once per
+// batch by whoever hands the batch to the shards.
+void SNBTrafficPartitionRecords(const SNBPacketRecord *records,
+                                size_t count,
+                                unsigned shardCount,
+                                uint8_t *shardIndices);
+
+// Hot path: counts the records assigned to shard. A NULL shardIndices means
+// every record belongs to this shard. Does not allocate once the delta's
+// tables have grown to the interval's working set.
+void SNBTrafficDeltaAccount(SNBTrafficDelta *delta,
+                            const SNBPacketRecord *records,
+                            size_t count,
+                            const uint8_t *shardIndices,
+                            unsigned shard,
+                            uint64_t wallNs);
+
+// Called for every host or connection the merge updates, after delta has
+// been added to merged. inserted is true when the merge created the entry,
+// in which case merged carries the delta's flags. The handler may look
+// entries up but must not insert into or remove from the merged tables.
+typedef void (*SNBTrafficMergeHandler)(void *context,
+                                       const SNBFlowKey *key,
+                                       SNBTrafficCounters *merged,
+                                       const SNBTrafficCounters *delta,
+                                       bool isHost,
+                                       bool inserted);
+
+// Folds a delta into the long-lived host and connection tables. Totals,
+// interface totals and the clock are left to the caller.
+void SNBTrafficDeltaMerge(const SNBTrafficDelta *delta,
+                          SNBFlowTable *hosts,
+                          SNBFlowTable *connections,
+                          SNBTrafficMergeHandler handler,
+                          void *context);
+
+#endif
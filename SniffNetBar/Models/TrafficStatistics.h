@@ -8,16 +8,33 @@
 #import <Foundation/Foundation.h>
 #import <sys/types.h>
 
-@class PacketInfo, TrafficStats, HostTraffic, ConnectionTraffic;
+@class SNBPacketBatch, TrafficStats, HostTraffic, ConnectionTraffic, InterfaceTraffic;
 
 @interface TrafficStatistics : NSObject
 
-- (void)processPacket:(PacketInfo *)packetInfo;
+// Counts on one shard per core, up to four
+- (instancetype)init;
+// Connections are spread over shardCount serial queues by a hash of their
+// addresses and ports and merged into the snapshot on demand
+- (instancetype)initWithShardCount:(NSUInteger)shardCount NS_DESIGNATED_INITIALIZER;
+
+// Records must already carry direction flags (see PacketDirection.h)
+- (void)processPacketBatch:(SNBPacketBatch *)batch;
 - (TrafficStats *)getCurrentStats;
 - (void)getCurrentStatsWithCompletion:(void (^)(TrafficStats *stats))completion;
 - (void)getAllDestinationIPsWithCompletion:(void (^)(NSSet<NSString *> *ips))completion;
 - (void)reset;
 
+// Most recent snapshot, republished every second and whenever stats are
+// requested. Readable from any thread without waiting on the statistics
+// queue; a published snapshot is never modified.
+@property (atomic, strong, readonly, nullable) TrafficStats *latestStats;
+
+// Capture interface names by SNBPacketRecord.interfaceIndex, as published by
+// PacketCaptureManager. Read when a snapshot is built; traffic on an index
+// without a name is reported unnamed.
+@property (atomic, copy, nullable) NSArray<NSString *> *interfaceNames;
+
 @end
 
 @class ProcessTrafficSummary;
@@ -33,6 +50,20 @@
 @property (nonatomic, strong) NSArray<ConnectionTraffic *> *topConnections;
 @property (nonatomic, strong) NSSet<NSString *> *allActiveDestinationIPs;
 @property (nonatomic, strong) NSArray<ProcessTrafficSummary *> *processSummaries;
+// Every capture interface that has carried traffic, in interface index order
+@property (nonatomic, strong) NSArray<InterfaceTraffic *> *interfaces;
+// Capture-clock time of the snapshot, on the same clock as the connections'
+// lastActivity, so idle times stay right while a file is replayed
+@property (nonatomic, assign) CFAbsoluteTime captureTime;
+// Bytes and capture-clock last activity of every remote host still counted,
+// by address, so destinations outside the top lists can be ranked too
+@property (nonatomic, strong) NSDictionary<NSString *, NSNumber *> *destinationBytes;
+@property (nonatomic, strong) NSDictionary<NSString *, NSNumber *> *destinationLastActivity;
+
+// Threat intel lookup priority of a destination from its traffic and idle
+// time in this snapshot and its anomaly score (see SNBRequestPriorityScore).
+// A destination without counters is ranked as long idle, not as just active.
+- (double)lookupPriorityForDestination:(NSString *)address anomalyScore:(double)anomalyScore;
 
 @end
 
@@ -56,6 +87,17 @@
 @property (nonatomic, strong, nullable) NSString *processName;
 @property (nonatomic, assign) pid_t processPID;
 @property (nonatomic, assign) CFAbsoluteTime lastActivity;
+// Interface the connection's latest packet was captured on
+@property (nonatomic, copy, nullable) NSString *interfaceName;
+
+@end
+
+@interface InterfaceTraffic : NSObject
+
+@property (nonatomic, copy, nullable) NSString *name;
+@property (nonatomic, assign) uint64_t bytes;
+@property (nonatomic, assign) uint64_t packetCount;
+@property (nonatomic, assign) uint64_t bytesPerSecond;
 
 @end
 
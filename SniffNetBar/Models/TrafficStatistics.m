@@ -6,18 +6,24 @@
 //
 
 #import "TrafficStatistics.h"
-#import "PacketInfo.h"
-#import "ExpiringCache.h"
+#import "PacketBatch.h"
+#import "LRUCache.h"
 #import "Logger.h"
 #import "ProcessLookup.h"
+#import "ReverseDNSResolver.h"
+#import "PassiveDNSCache.h"
 #import "ConfigurationManager.h"
+#import "FlowTable.h"
+#import "PacketClock.h"
+#import "PacketDirection.h"
+#import "RequestScheduler.h"
+#import "TopTraffic.h"
+#import "TrafficShards.h"
 #import <sys/socket.h>
 #import <netinet/in.h>
 #import <arpa/inet.h>
-#import <ifaddrs.h>
 #import <netdb.h>
 #import <SystemConfiguration/SystemConfiguration.h>
-#import <CFNetwork/CFNetwork.h>
 #import <string.h>
 
 // Cache size limits
@@ -27,81 +33,112 @@ static const NSUInteger kMaxHostnameCacheSize = 500;
 static const NSTimeInterval kCacheExpirationTime = 3600; // 1 hour
 static const NSTimeInterval kCleanupInterval = 300; // 5 minutes
 static const NSTimeInterval kConnectionRetentionSeconds = 10.0; // Remove stale connections after 10s of inactivity
-static const NSTimeInterval kDNSLookupTimeout = 5.0; // 5 seconds
-static const long kMaxConcurrentDNSLookups = 8;
 static const NSUInteger kMaxProcessCacheSize = 500;
 static const NSTimeInterval kProcessCacheExpirationTime = 300.0; // 5 minutes
 static const NSUInteger kMaxPortProcessCacheSize = 256;
 static const NSTimeInterval kPortProcessCacheExpirationTime = 120.0; // 2 minutes
-static const NSUInteger kMaxPendingDNSLookups = 100; // Max queued DNS lookups (prevents memory leak)
+static const NSUInteger kMaxProcessLookupBatch = 1024; // Connections per helper round trip
+static const NSUInteger kMaxDefaultTrafficShards = 4;
+static const size_t kTrafficShardInitialCapacity = 256;
+static const uint32_t kUnknownProcessSlot = 0;
+static NSString * const kUnknownProcessName = @"<unknown>";
 
 // Special marker for failed DNS lookups
 static NSString * const kDNSLookupFailedMarker = @"__DNS_FAILED__";
 
-@class SNBConnectionKey;
-
-@interface TrafficStatistics ()
-@property (nonatomic, strong) NSMutableDictionary<NSString *, HostTraffic *> *hostStats;
-@property (nonatomic, strong) NSMutableDictionary *connectionStats;
+@class SNBConnectionKey, SNBProcessAggregate;
+
+@interface TrafficStatistics () {
+    // Capture time the statistics run on; owned by statsQueue
+    SNBPacketClock _packetClock;
+    // One delta per shard, each written only on its shard queue
+    SNBTrafficDelta *_shards;
+    // Empty delta swapped in for a shard's during a merge; owned by statsQueue
+    SNBTrafficDelta _spareDelta;
+    // Rankings kept up to date as the merges grow the counters; owned by statsQueue
+    SNBTopTraffic _topHosts;
+    SNBTopTraffic _topConnections;
+    // Per-interface totals and their sampled rates; owned by statsQueue
+    uint64_t _interfaceBytes[SNB_PACKET_MAX_INTERFACES];
+    uint64_t _interfacePackets[SNB_PACKET_MAX_INTERFACES];
+    uint64_t _interfaceSampleBytes[SNB_PACKET_MAX_INTERFACES];
+    uint64_t _interfaceBytesPerSecond[SNB_PACKET_MAX_INTERFACES];
+}
+// Serial queues the shards count on, one per shard
+@property (nonatomic, copy) NSArray<dispatch_queue_t> *shardQueues;
+// Merged hosts keyed by remote address and connections keyed local -> remote
+@property (nonatomic, assign) SNBFlowTable *hostTable;
+@property (nonatomic, assign) SNBFlowTable *connectionTable;
+@property (nonatomic, strong) NSMutableDictionary<SNBConnectionKey *, ProcessInfo *> *connectionProcesses;
+// Per-process totals indexed by SNBTrafficCounters.processSlot; slot 0 holds
+// connections with no known process. Freed slots are reused.
+@property (nonatomic, strong) NSMutableArray<SNBProcessAggregate *> *processAggregates;
+@property (nonatomic, strong) NSMutableDictionary<NSString *, NSNumber *> *processSlots;
+@property (nonatomic, strong) NSMutableIndexSet *freeProcessSlots;
+// Remote addresses of every host and connection, counted once per entry
+@property (nonatomic, strong) NSCountedSet<NSString *> *activeDestinations;
+@property (nonatomic, strong, nullable) NSSet<NSString *> *cachedDestinationIPs;
+@property (atomic, strong, readwrite, nullable) TrafficStats *latestStats;
 @property (nonatomic, assign) uint64_t totalBytes;
 @property (nonatomic, assign) uint64_t incomingBytes;
 @property (nonatomic, assign) uint64_t outgoingBytes;
 @property (nonatomic, assign) uint64_t totalPackets;
-@property (nonatomic, strong) NSMutableSet<NSString *> *localAddresses;
-@property (nonatomic, strong) SNBExpiringCache<NSString *, NSString *> *hostnameCache;
-@property (nonatomic, strong) SNBExpiringCache<id, id> *processCache;
-@property (nonatomic, strong) SNBExpiringCache<SNBConnectionKey *, ProcessInfo *> *lsofProcessCache;
-@property (nonatomic, strong) SNBExpiringCache<NSNumber *, ProcessInfo *> *portProcessCache;
-@property (nonatomic, strong) NSMutableDictionary<NSString *, NSObject *> *dnsLookupLocks;
-@property (nonatomic, strong) NSMutableDictionary *processLookupLocks;
-@property (nonatomic, strong) dispatch_queue_t dnsLookupQueue;
-@property (nonatomic, strong) dispatch_semaphore_t dnsLookupSemaphore;
+@property (nonatomic, strong) SNBLRUCache<NSString *, NSString *> *hostnameCache;
+@property (nonatomic, strong) SNBLRUCache<id, id> *processCache;
+@property (nonatomic, strong) SNBLRUCache<SNBConnectionKey *, ProcessInfo *> *lsofProcessCache;
+@property (nonatomic, strong) SNBLRUCache<NSNumber *, ProcessInfo *> *portProcessCache;
+// Connections added by the current merge, resolved together once it ends
+@property (nonatomic, strong) NSMutableArray<SNBConnectionKey *> *pendingHelperLookups;
+@property (nonatomic, strong) NSMutableArray<SNBConnectionKey *> *pendingNativeLookups;
+@property (nonatomic, strong) dispatch_queue_t processLookupQueue;
 @property (nonatomic, strong) dispatch_queue_t statsQueue;
 @property (nonatomic, strong) NSDate *lastUpdateTime;
 @property (nonatomic, assign) uint64_t lastTotalBytes;
 @property (nonatomic, strong) NSTimer *cleanupTimer;
 @property (nonatomic, strong) NSArray<HostTraffic *> *cachedTopHosts;
 @property (nonatomic, strong) NSArray<ConnectionTraffic *> *cachedTopConnections;
+@property (nonatomic, strong) NSDictionary<NSString *, NSNumber *> *cachedDestinationBytes;
+@property (nonatomic, strong) NSDictionary<NSString *, NSNumber *> *cachedDestinationLastActivity;
 @property (nonatomic, assign) BOOL statsCacheDirty;
 @property (nonatomic, assign) uint64_t lastSampleTotalBytes;
-@property (nonatomic, strong) NSDate *lastSampleTime;
+@property (nonatomic, assign) CFAbsoluteTime lastSampleTime;
 @property (nonatomic, assign) uint64_t cachedBytesPerSecond;
 @property (nonatomic, strong) NSTimer *samplingTimer;
-@property (nonatomic, assign) NSUInteger pendingDNSLookupCount;
 @property (nonatomic, strong) NSMutableDictionary<SNBConnectionKey *, ProcessInfo *> *pendingHelperProcessInfos;
 @property (nonatomic, strong) NSMutableDictionary<SNBConnectionKey *, ProcessInfo *> *pendingLsofProcessInfos;
 @end
 
+// Object form of a connection flow key, used where connections meet the
+// process lookup caches. Only created for new connections and at the
+// snapshot boundary, never per packet.
 @interface SNBConnectionKey : NSObject <NSCopying>
+@property (nonatomic, assign, readonly) SNBFlowKey flowKey;
 @property (nonatomic, copy) NSString *source;
 @property (nonatomic, copy) NSString *destination;
 @property (nonatomic, assign) NSInteger sourcePort;
 @property (nonatomic, assign) NSInteger destinationPort;
 @property (nonatomic, assign) NSUInteger cachedHash; // Performance: Cache hash value
-- (instancetype)initWithSource:(NSString *)source
-                   sourcePort:(NSInteger)sourcePort
-                   destination:(NSString *)destination
-               destinationPort:(NSInteger)destinationPort;
+- (instancetype)initWithFlowKey:(const SNBFlowKey *)flowKey;
 - (NSString *)stringValue;
 @end
 
 @implementation SNBConnectionKey
 
-- (instancetype)initWithSource:(NSString *)source
-                   sourcePort:(NSInteger)sourcePort
-                   destination:(NSString *)destination
-               destinationPort:(NSInteger)destinationPort {
+- (instancetype)initWithFlowKey:(const SNBFlowKey *)flowKey {
     self = [super init];
     if (self) {
-        _source = [source copy] ?: @"";
-        _destination = [destination copy] ?: @"";
-        _sourcePort = sourcePort;
-        _destinationPort = destinationPort;
-
-        // Performance: Pre-compute and cache hash value since keys are immutable
-        NSUInteger hash = _source.hash ^ _destination.hash;
-        hash ^= (NSUInteger)sourcePort * 16777619u;
-        hash ^= (NSUInteger)destinationPort * 2166136261u;
+        _flowKey = *flowKey;
+        _source = SNBStringFromPacketAddress(flowKey->family, flowKey->sourceAddress) ?: @"";
+        _destination = SNBStringFromPacketAddress(flowKey->family, flowKey->destinationAddress) ?: @"";
+        _sourcePort = flowKey->hasPorts ? flowKey->sourcePort : -1;
+        _destinationPort = flowKey->hasPorts ? flowKey->destinationPort : -1;
+
+        // Performance: Pre-compute and cache hash value since keys are immutable (FNV-1a)
+        const uint8_t *bytes = (const uint8_t *)flowKey;
+        NSUInteger hash = 2166136261u;
+        for (size_t i = 0; i < sizeof(SNBFlowKey); i++) {
+            hash = (hash ^ bytes[i]) * 16777619u;
+        }
         _cachedHash = hash;
     }
     return self;
@@ -117,10 +154,8 @@ static NSString * const kDNSLookupFailedMarker = @"__DNS_FAILED__";
         return NO;
     }
     SNBConnectionKey *other = object;
-    return self.sourcePort == other.sourcePort &&
-        self.destinationPort == other.destinationPort &&
-        [self.source isEqualToString:other.source] &&
-        [self.destination isEqualToString:other.destination];
+    SNBFlowKey otherKey = other.flowKey;
+    return memcmp(&_flowKey, &otherKey, sizeof(SNBFlowKey)) == 0;
 }
 
 - (id)copyWithZone:(NSZone *)zone {
@@ -134,34 +169,40 @@ static NSString * const kDNSLookupFailedMarker = @"__DNS_FAILED__";
 
 @end
 
-@interface ProcessTrafficSummary ()
-@property (nonatomic, strong) NSMutableOrderedSet<NSString *> *mutableDestinations;
+@implementation ProcessTrafficSummary
 @end
 
-@implementation ProcessTrafficSummary
+// Running totals for one process, updated as its connections are merged,
+// attributed, or removed, so a snapshot never walks the connection table.
+@interface SNBProcessAggregate : NSObject
+@property (nonatomic, copy) NSString *processName;
+@property (nonatomic, assign) pid_t processPID;
+@property (nonatomic, assign) uint64_t bytes;
+@property (nonatomic, assign) NSUInteger connectionCount;
+// A destination stays listed while any of the process's connections use it
+@property (nonatomic, strong) NSCountedSet<NSString *> *destinations;
+@end
 
-- (instancetype)init {
+@implementation SNBProcessAggregate
+
+- (instancetype)initWithProcessName:(NSString *)processName pid:(pid_t)pid {
     self = [super init];
     if (self) {
-        _mutableDestinations = [NSMutableOrderedSet orderedSet];
+        _processName = [processName copy];
+        _processPID = pid;
+        _destinations = [NSCountedSet set];
     }
     return self;
 }
 
-- (void)addDestination:(NSString *)destination {
-    if (destination.length > 0) {
-        [self.mutableDestinations addObject:destination];
-    }
-}
-
-- (void)finalizeDestinations {
-    NSArray<NSString *> *destinations = [self.mutableDestinations array];
-    if (destinations.count > 0) {
-        self.destinations = [destinations sortedArrayUsingSelector:@selector(compare:)];
-    } else {
-        self.destinations = @[];
-    }
-    self.mutableDestinations = nil;
+- (ProcessTrafficSummary *)summary {
+    ProcessTrafficSummary *summary = [[ProcessTrafficSummary alloc] init];
+    summary.processName = self.processName;
+    summary.processPID = self.processPID;
+    summary.bytes = self.bytes;
+    summary.connectionCount = self.connectionCount;
+    summary.destinations = [self.destinations.allObjects sortedArrayUsingSelector:@selector(compare:)];
+    return summary;
 }
 
 @end
@@ -171,131 +212,98 @@ typedef NS_ENUM(NSUInteger, SNBProcessLookupSource) {
     SNBProcessLookupSourceLsof
 };
 
-typedef struct {
-    BOOL resolved;
-    CFStringRef name;
-} SNBDNSLookupContext;
-
-static void SNBDNSHostCallback(CFHostRef host,
-                               CFHostInfoType typeInfo,
-                               const CFStreamError *error,
-                               void *info) {
-    SNBDNSLookupContext *context = (SNBDNSLookupContext *)info;
-    if (!context || context->resolved) {
-        return;
-    }
-    Boolean hasResult = false;
-    CFArrayRef names = CFHostGetNames(host, &hasResult);
-    if (hasResult && names && CFArrayGetCount(names) > 0) {
-        CFStringRef name = CFArrayGetValueAtIndex(names, 0);
-        if (name) {
-            context->name = CFRetain(name);
-        }
-    }
-    context->resolved = YES;
-    CFRunLoopStop(CFRunLoopGetCurrent());
+static inline CFAbsoluteTime SNBTrafficLastActivity(const SNBTrafficCounters *counters) {
+    return (double)counters->lastActivityNs / 1e9 - kCFAbsoluteTimeIntervalSince1970;
 }
 
-static NSString *SNBResolveHostname(NSString *address,
-                                    NSTimeInterval timeout,
-                                    BOOL *timedOut) {
-    if (timedOut) {
-        *timedOut = NO;
-    }
-    if (address.length == 0) {
-        return nil;
-    }
-
-    struct sockaddr_in sin;
-    struct sockaddr_in6 sin6;
-    NSData *addressData = nil;
-
-    memset(&sin, 0, sizeof(sin));
-    memset(&sin6, 0, sizeof(sin6));
-    if (inet_pton(AF_INET, address.UTF8String, &sin.sin_addr) == 1) {
-        sin.sin_family = AF_INET;
-        addressData = [NSData dataWithBytes:&sin length:sizeof(sin)];
-    } else if (inet_pton(AF_INET6, address.UTF8String, &sin6.sin6_addr) == 1) {
-        sin6.sin6_family = AF_INET6;
-        addressData = [NSData dataWithBytes:&sin6 length:sizeof(sin6)];
-    } else {
-        return nil;
-    }
+typedef struct {
+    uint64_t bytes;
+    SNBFlowKey key;
+} SNBTrimCandidate;
+
+static int SNBCompareTrimCandidates(const void *lhs, const void *rhs) {
+    uint64_t left = ((const SNBTrimCandidate *)lhs)->bytes;
+    uint64_t right = ((const SNBTrimCandidate *)rhs)->bytes;
+    return (left > right) - (left < right);
+}
 
-    CFHostRef host = CFHostCreateWithAddress(kCFAllocatorDefault, (__bridge CFDataRef)addressData);
-    if (!host) {
-        return nil;
+// Removes the entries with the least traffic until at most limit remain.
+// removing sees each entry just before it leaves the table.
+static NSUInteger SNBTrimTrafficTable(SNBFlowTable *table,
+                                      NSUInteger limit,
+                                      void (^NS_NOESCAPE removing)(const SNBFlowKey *key, SNBTrafficCounters *counters)) {
+    size_t count = SNBFlowTableCount(table);
+    if (count <= limit) {
+        return 0;
     }
-
-    SNBDNSLookupContext context = {0};
-    CFHostClientContext clientContext = {0, &context, NULL, NULL, NULL};
-    CFStreamError streamError = {0};
-    BOOL started = (BOOL)CFHostSetClient(host, SNBDNSHostCallback, &clientContext);
-    if (!started) {
-        CFRelease(host);
-        return nil;
+    SNBTrimCandidate *candidates = malloc(count * sizeof(SNBTrimCandidate));
+    if (!candidates) {
+        return 0;
     }
-
-    CFHostScheduleWithRunLoop(host, CFRunLoopGetCurrent(), kCFRunLoopDefaultMode);
-    Boolean ok = CFHostStartInfoResolution(host, kCFHostNames, &streamError);
-    if (!ok) {
-        CFHostSetClient(host, NULL, NULL);
-        CFHostUnscheduleFromRunLoop(host, CFRunLoopGetCurrent(), kCFRunLoopDefaultMode);
-        CFRelease(host);
-        return nil;
+    size_t index = 0;
+    size_t cursor = 0;
+    const SNBFlowKey *key = NULL;
+    const SNBTrafficCounters *counters;
+    while ((counters = SNBFlowTableNext(table, &cursor, &key)) != NULL && index < count) {
+        candidates[index].bytes = counters->bytes;
+        candidates[index].key = *key;
+        index++;
     }
-
-    CFAbsoluteTime deadline = CFAbsoluteTimeGetCurrent() + timeout;
-    while (!context.resolved) {
-        CFTimeInterval remaining = deadline - CFAbsoluteTimeGetCurrent();
-        if (remaining <= 0) {
-            if (timedOut) {
-                *timedOut = YES;
-            }
-            break;
+    qsort(candidates, index, sizeof(SNBTrimCandidate), SNBCompareTrimCandidates);
+    NSUInteger toRemove = index - limit;
+    for (NSUInteger i = 0; i < toRemove; i++) {
+        SNBTrafficCounters *removed = SNBFlowTableFind(table, &candidates[i].key);
+        if (removed) {
+            removing(&candidates[i].key, removed);
         }
-        CFRunLoopRunInMode(kCFRunLoopDefaultMode, MIN(0.1, remaining), true);
+        SNBFlowTableRemove(table, &candidates[i].key);
     }
-
-    if (!context.resolved) {
-        CFHostCancelInfoResolution(host, kCFHostNames);
-    }
-
-    CFHostSetClient(host, NULL, NULL);
-    CFHostUnscheduleFromRunLoop(host, CFRunLoopGetCurrent(), kCFRunLoopDefaultMode);
-    CFRelease(host);
-
-    if (context.name) {
-        return CFBridgingRelease(context.name);
-    }
-    return nil;
+    free(candidates);
+    return toRemove;
 }
 
 @implementation TrafficStatistics
 
 - (instancetype)init {
+    NSUInteger processors = [NSProcessInfo processInfo].activeProcessorCount;
+    return [self initWithShardCount:MIN(kMaxDefaultTrafficShards, MAX((NSUInteger)1, processors))];
+}
+
+- (instancetype)initWithShardCount:(NSUInteger)shardCount {
     self = [super init];
     if (self) {
-        _hostStats = [NSMutableDictionary dictionary];
-        _connectionStats = [NSMutableDictionary dictionary];
-        _hostnameCache = [[SNBExpiringCache alloc] initWithMaxSize:kMaxHostnameCacheSize
-                                               expirationInterval:kCacheExpirationTime];
-        _processCache = [[SNBExpiringCache alloc] initWithMaxSize:kMaxProcessCacheSize
-                                             expirationInterval:kProcessCacheExpirationTime];
-        _lsofProcessCache = [[SNBExpiringCache alloc] initWithMaxSize:kMaxProcessCacheSize
-                                                 expirationInterval:kProcessCacheExpirationTime];
-        _portProcessCache = [[SNBExpiringCache alloc] initWithMaxSize:kMaxPortProcessCacheSize
-                                                   expirationInterval:kPortProcessCacheExpirationTime];
-        _dnsLookupLocks = [NSMutableDictionary dictionary];
-        _processLookupLocks = [NSMutableDictionary dictionary];
-        _dnsLookupQueue = dispatch_queue_create("com.sniffnetbar.dnslookup", DISPATCH_QUEUE_CONCURRENT);
-        _dnsLookupSemaphore = dispatch_semaphore_create(kMaxConcurrentDNSLookups);
+        shardCount = MIN((NSUInteger)SNB_TRAFFIC_MAX_SHARDS, MAX((NSUInteger)1, shardCount));
+        _shards = calloc(shardCount, sizeof(SNBTrafficDelta));
+        NSMutableArray<dispatch_queue_t> *shardQueues = [NSMutableArray arrayWithCapacity:shardCount];
+        for (NSUInteger i = 0; i < shardCount; i++) {
+            SNBTrafficDeltaInit(&_shards[i], kTrafficShardInitialCapacity, kTrafficShardInitialCapacity);
+            [shardQueues addObject:dispatch_queue_create("com.sniffnetbar.stats.shard", DISPATCH_QUEUE_SERIAL)];
+        }
+        _shardQueues = [shardQueues copy];
+        SNBTrafficDeltaInit(&_spareDelta, kTrafficShardInitialCapacity, kTrafficShardInitialCapacity);
+        _hostTable = SNBFlowTableCreate(sizeof(SNBTrafficCounters), kMaxHostCacheSize);
+        _connectionTable = SNBFlowTableCreate(sizeof(SNBTrafficCounters), kMaxConnectionCacheSize);
+        _connectionProcesses = [NSMutableDictionary dictionary];
+        // Sized on the first snapshot from the configured menu limits
+        SNBTopTrafficInit(&_topHosts, 0);
+        SNBTopTrafficInit(&_topConnections, 0);
+        [self resetProcessAggregatesLocked];
+        _activeDestinations = [NSCountedSet set];
+        _hostnameCache = [[SNBLRUCache alloc] initWithCapacity:kMaxHostnameCacheSize
+                                                    timeToLive:kCacheExpirationTime];
+        _processCache = [[SNBLRUCache alloc] initWithCapacity:kMaxProcessCacheSize
+                                                   timeToLive:kProcessCacheExpirationTime];
+        _lsofProcessCache = [[SNBLRUCache alloc] initWithCapacity:kMaxProcessCacheSize
+                                                       timeToLive:kProcessCacheExpirationTime];
+        _portProcessCache = [[SNBLRUCache alloc] initWithCapacity:kMaxPortProcessCacheSize
+                                                       timeToLive:kPortProcessCacheExpirationTime];
+        _pendingHelperLookups = [NSMutableArray array];
+        _pendingNativeLookups = [NSMutableArray array];
+        _processLookupQueue = dispatch_queue_create("com.sniffnetbar.processlookup", DISPATCH_QUEUE_SERIAL);
         _statsQueue = dispatch_queue_create("com.sniffnetbar.stats", DISPATCH_QUEUE_SERIAL);
         _pendingHelperProcessInfos = [NSMutableDictionary dictionary];
         _pendingLsofProcessInfos = [NSMutableDictionary dictionary];
-        _localAddresses = [NSMutableSet set];
         _statsCacheDirty = YES;
-        [self loadLocalAddresses];
 
         // Set up periodic cleanup timer
         __weak typeof(self) weakSelf = self;
@@ -316,421 +324,416 @@ static NSString *SNBResolveHostname(NSString *address,
 - (void)dealloc {
     [_cleanupTimer invalidate];
     [_samplingTimer invalidate];
+    SNBFlowTableDestroy(_hostTable);
+    SNBFlowTableDestroy(_connectionTable);
+    SNBTopTrafficDestroy(&_topHosts);
+    SNBTopTrafficDestroy(&_topConnections);
+    for (NSUInteger i = 0; i < _shardQueues.count; i++) {
+        SNBTrafficDeltaDestroy(&_shards[i]);
+    }
+    free(_shards);
+    SNBTrafficDeltaDestroy(&_spareDelta);
 }
 
-- (void)loadLocalAddresses {
-    // Get local network interfaces
-    struct ifaddrs *interfaces;
-    if (getifaddrs(&interfaces) == 0) {
-        struct ifaddrs *interface;
-        for (interface = interfaces; interface != NULL; interface = interface->ifa_next) {
-            if (interface->ifa_addr == NULL) continue;
-            
-            if (interface->ifa_addr->sa_family == AF_INET) {
-                struct sockaddr_in *sin = (struct sockaddr_in *)interface->ifa_addr;
-                char addr[INET_ADDRSTRLEN];
-                if (inet_ntop(AF_INET, &sin->sin_addr, addr, INET_ADDRSTRLEN)) {
-                    [self.localAddresses addObject:[NSString stringWithUTF8String:addr]];
-                }
-            } else if (interface->ifa_addr->sa_family == AF_INET6) {
-                struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)interface->ifa_addr;
-                char addr[INET6_ADDRSTRLEN];
-                if (inet_ntop(AF_INET6, &sin6->sin6_addr, addr, INET6_ADDRSTRLEN)) {
-                    [self.localAddresses addObject:[NSString stringWithUTF8String:addr]];
-                }
-            }
-        }
-        freeifaddrs(interfaces);
+- (void)resetProcessAggregatesLocked {
+    SNBProcessAggregate *unknown = [[SNBProcessAggregate alloc] initWithProcessName:kUnknownProcessName pid:0];
+    self.processAggregates = [NSMutableArray arrayWithObject:unknown];
+    self.processSlots = [NSMutableDictionary dictionaryWithObject:@(kUnknownProcessSlot)
+                                                           forKey:[NSString stringWithFormat:@"%@|%d", kUnknownProcessName, 0]];
+    self.freeProcessSlots = [NSMutableIndexSet indexSet];
+}
+
+// Finds or creates the aggregate for a process. Connections are grouped by
+// name and PID, and an attribution without a name counts as unknown.
+- (uint32_t)processSlotForInfo:(ProcessInfo *)processInfo {
+    NSString *processName = processInfo.processName.length > 0 ? processInfo.processName : kUnknownProcessName;
+    pid_t pid = processInfo.pid;
+    NSString *key = [NSString stringWithFormat:@"%@|%d", processName, (int)pid];
+    NSNumber *existing = self.processSlots[key];
+    if (existing) {
+        return existing.unsignedIntValue;
+    }
+
+    SNBProcessAggregate *aggregate = [[SNBProcessAggregate alloc] initWithProcessName:processName pid:pid];
+    NSUInteger slot = self.freeProcessSlots.firstIndex;
+    if (slot != NSNotFound) {
+        [self.freeProcessSlots removeIndex:slot];
+        self.processAggregates[slot] = aggregate;
+    } else {
+        slot = self.processAggregates.count;
+        [self.processAggregates addObject:aggregate];
+    }
+    self.processSlots[key] = @(slot);
+    return (uint32_t)slot;
+}
+
+- (void)addConnectionWithBytes:(uint64_t)bytes
+                   destination:(NSString *)destination
+                 toProcessSlot:(uint32_t)slot {
+    SNBProcessAggregate *aggregate = self.processAggregates[slot];
+    aggregate.bytes += bytes;
+    aggregate.connectionCount++;
+    if (destination.length > 0) {
+        [aggregate.destinations addObject:destination];
     }
-    
-    // Add loopback addresses
-    [self.localAddresses addObject:@"127.0.0.1"];
-    [self.localAddresses addObject:@"::1"];
 }
 
-- (BOOL)isLocalAddress:(NSString *)address {
-    return [self.localAddresses containsObject:address];
+- (void)removeConnectionWithBytes:(uint64_t)bytes
+                      destination:(NSString *)destination
+                  fromProcessSlot:(uint32_t)slot {
+    SNBProcessAggregate *aggregate = self.processAggregates[slot];
+    aggregate.bytes -= MIN(aggregate.bytes, bytes);
+    if (aggregate.connectionCount > 0) {
+        aggregate.connectionCount--;
+    }
+    if (destination.length > 0) {
+        [aggregate.destinations removeObject:destination];
+    }
+    if (aggregate.connectionCount == 0 && slot != kUnknownProcessSlot) {
+        [self.processSlots removeObjectForKey:[NSString stringWithFormat:@"%@|%d", aggregate.processName, (int)aggregate.processPID]];
+        [self.freeProcessSlots addIndex:slot];
+    }
+}
+
+- (void)addActiveDestination:(NSString *)address {
+    if (address.length == 0) {
+        return;
+    }
+    if ([self.activeDestinations countForObject:address] == 0) {
+        self.cachedDestinationIPs = nil;
+    }
+    [self.activeDestinations addObject:address];
+}
+
+- (void)removeActiveDestination:(NSString *)address {
+    if (address.length == 0) {
+        return;
+    }
+    [self.activeDestinations removeObject:address];
+    if ([self.activeDestinations countForObject:address] == 0) {
+        self.cachedDestinationIPs = nil;
+    }
+}
+
+// Attributes a connection to a process, moving its traffic between the
+// process aggregates if it was attributed elsewhere before
+- (void)setProcessInfo:(ProcessInfo *)processInfo forConnectionKey:(SNBConnectionKey *)connectionKey {
+    self.connectionProcesses[connectionKey] = processInfo;
+    SNBFlowKey flowKey = connectionKey.flowKey;
+    SNBTrafficCounters *counters = SNBFlowTableFind(self.connectionTable, &flowKey);
+    if (!counters) {
+        return;
+    }
+    uint32_t slot = [self processSlotForInfo:processInfo];
+    if (slot == counters->processSlot) {
+        return;
+    }
+    [self removeConnectionWithBytes:counters->bytes destination:connectionKey.destination fromProcessSlot:counters->processSlot];
+    [self addConnectionWithBytes:counters->bytes destination:connectionKey.destination toProcessSlot:slot];
+    counters->processSlot = slot;
+    self.statsCacheDirty = YES;
+}
+
+// Call while the connection is still in connectionTable
+- (void)forgetConnectionLocked:(const SNBFlowKey *)flowKey counters:(SNBTrafficCounters *)counters {
+    SNBConnectionKey *key = [[SNBConnectionKey alloc] initWithFlowKey:flowKey];
+    SNBTopTrafficRemove(&_topConnections, self.connectionTable, counters);
+    [self removeConnectionWithBytes:counters->bytes destination:key.destination fromProcessSlot:counters->processSlot];
+    [self removeActiveDestination:key.destination];
+    [self.connectionProcesses removeObjectForKey:key];
+    [self.processCache removeObjectForKey:key];
+    [self.lsofProcessCache removeObjectForKey:key];
+    [self.pendingHelperProcessInfos removeObjectForKey:key];
+    [self.pendingLsofProcessInfos removeObjectForKey:key];
+}
+
+- (CFAbsoluteTime)packetTimeLocked {
+    return SNBPacketClockNow(&_packetClock) - kCFAbsoluteTimeIntervalSince1970;
 }
 
 - (void)removeStaleConnectionsLocked:(CFAbsoluteTime)now {
     if (now <= 0) {
-        now = CFAbsoluteTimeGetCurrent();
+        now = [self packetTimeLocked];
     }
-    NSMutableArray<SNBConnectionKey *> *staleConnections = [NSMutableArray array];
-    [self.connectionStats enumerateKeysAndObjectsUsingBlock:^(SNBConnectionKey *key, ConnectionTraffic *connection, BOOL *stop) {
-        if ((now - connection.lastActivity) > kConnectionRetentionSeconds) {
-            [staleConnections addObject:key];
+    NSUInteger removedCount = 0;
+    size_t cursor = 0;
+    const SNBFlowKey *flowKey = NULL;
+    SNBTrafficCounters *counters;
+    while ((counters = SNBFlowTableNext(self.connectionTable, &cursor, &flowKey)) != NULL) {
+        if ((now - SNBTrafficLastActivity(counters)) <= kConnectionRetentionSeconds) {
+            continue;
         }
-    }];
-    for (SNBConnectionKey *key in staleConnections) {
-        [self.connectionStats removeObjectForKey:key];
-        [self.processCache removeObjectForKey:key];
-        [self.lsofProcessCache removeObjectForKey:key];
-        [self.pendingHelperProcessInfos removeObjectForKey:key];
-        [self.pendingLsofProcessInfos removeObjectForKey:key];
-    }
-    if (staleConnections.count > 0) {
+        [self forgetConnectionLocked:flowKey counters:counters];
+        SNBFlowTableRemoveCurrent(self.connectionTable, &cursor);
+        removedCount++;
+    }
+    if (removedCount > 0) {
         self.statsCacheDirty = YES;
     }
 }
 
 - (void)performCacheCleanup {
     dispatch_async(self.statsQueue, ^{
-        NSUInteger expiredCount = [self.hostnameCache cleanupAndReturnExpiredCount];
-        CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
-
-        // Remove stale TCP records that haven't seen activity recently
-        [self removeStaleConnectionsLocked:now];
+        [self mergeShardsLocked];
+        NSUInteger expiredCount = [self.hostnameCache expireObjects];
 
         // If host stats exceed max, remove entries with least traffic
-        if (self.hostStats.count > kMaxHostCacheSize) {
-            NSArray<HostTraffic *> *sortedHosts = [self.hostStats.allValues sortedArrayUsingComparator:^NSComparisonResult(HostTraffic *obj1, HostTraffic *obj2) {
-                if (obj1.bytes < obj2.bytes) return NSOrderedAscending;
-                if (obj1.bytes > obj2.bytes) return NSOrderedDescending;
-                return NSOrderedSame;
-            }];
-            NSUInteger toRemove = self.hostStats.count - kMaxHostCacheSize;
-            for (NSUInteger i = 0; i < toRemove && i < sortedHosts.count; i++) {
-                [self.hostStats removeObjectForKey:sortedHosts[i].address];
-            }
-            self.statsCacheDirty = YES;
-        }
+        NSUInteger removedHosts = SNBTrimTrafficTable(self.hostTable, kMaxHostCacheSize, ^(const SNBFlowKey *flowKey, SNBTrafficCounters *counters) {
+            SNBTopTrafficRemove(&self->_topHosts, self.hostTable, counters);
+            [self removeActiveDestination:SNBStringFromPacketAddress(flowKey->family, flowKey->destinationAddress)];
+        });
 
         // If connection stats exceed max, remove entries with least traffic
-        if (self.connectionStats.count > kMaxConnectionCacheSize) {
-            NSArray *sortedKeys = [self.connectionStats keysSortedByValueUsingComparator:^NSComparisonResult(ConnectionTraffic *obj1, ConnectionTraffic *obj2) {
-                if (obj1.bytes < obj2.bytes) return NSOrderedAscending;
-                if (obj1.bytes > obj2.bytes) return NSOrderedDescending;
-                return NSOrderedSame;
-            }];
-            NSUInteger toRemove = self.connectionStats.count - kMaxConnectionCacheSize;
-            for (NSUInteger i = 0; i < toRemove && i < sortedKeys.count; i++) {
-                [self.connectionStats removeObjectForKey:sortedKeys[i]];
-            }
+        NSUInteger removedConnections = SNBTrimTrafficTable(self.connectionTable, kMaxConnectionCacheSize, ^(const SNBFlowKey *flowKey, SNBTrafficCounters *counters) {
+            [self forgetConnectionLocked:flowKey counters:counters];
+        });
+        if (removedHosts > 0 || removedConnections > 0) {
             self.statsCacheDirty = YES;
         }
 
         if (expiredCount > 0 || self.statsCacheDirty) {
             SNBLogDebug("Cache cleanup: removed %lu expired hostnames, %lu hosts, %lu connections",
                   (unsigned long)expiredCount,
-                  (unsigned long)MAX(0, (NSInteger)self.hostStats.count - (NSInteger)kMaxHostCacheSize),
-                  (unsigned long)MAX(0, (NSInteger)self.connectionStats.count - (NSInteger)kMaxConnectionCacheSize));
+                  (unsigned long)removedHosts,
+                  (unsigned long)removedConnections);
         }
     });
 }
 
-- (void)processPacket:(PacketInfo *)packetInfo {
-    if (!packetInfo || packetInfo.totalBytes == 0) {
+// Runs on the delivering thread: hashes each record to the shard that owns
+// its connection, then lets every shard count its share on its own queue.
+- (void)processPacketBatch:(SNBPacketBatch *)batch {
+    NSUInteger count = batch.count;
+    if (count == 0) {
         return;
     }
-    
-    dispatch_async(self.statsQueue, ^{
-        self.totalBytes += packetInfo.totalBytes;
-        self.totalPackets++;
-        self.statsCacheDirty = YES;  // Mark cache as dirty
-
-        // Determine traffic direction
-        BOOL isIncoming = [self isLocalAddress:packetInfo.destinationAddress];
-        BOOL isOutgoing = [self isLocalAddress:packetInfo.sourceAddress];
-        
-        // If both are local or neither is local, use port comparison for loopback
-        if (isIncoming && isOutgoing) {
-            // Both local - use port comparison like the Rust code
-            if (packetInfo.sourcePort > 0 && packetInfo.destinationPort > 0) {
-                isIncoming = packetInfo.sourcePort < packetInfo.destinationPort;
-                isOutgoing = !isIncoming;
-            }
-        } else if (!isIncoming && !isOutgoing) {
-            // Neither local (shouldn't happen, but handle it)
-            isIncoming = YES;
-            isOutgoing = NO;
-        }
-        
-        if (isIncoming) {
-            self.incomingBytes += packetInfo.totalBytes;
-        } else {
-            self.outgoingBytes += packetInfo.totalBytes;
-        }
-        
-        // Track host statistics
-        NSString *remoteAddress = isIncoming ? packetInfo.sourceAddress : packetInfo.destinationAddress;
-        if (remoteAddress && remoteAddress.length > 0) {
-            HostTraffic *host = self.hostStats[remoteAddress];
-            if (!host) {
-                host = [[HostTraffic alloc] init];
-                host.address = remoteAddress;
-                NSString *cachedHostname = [self.hostnameCache objectForKey:remoteAddress];
-
-                // Check if we have a cached result (including negative results)
-                if (cachedHostname) {
-                    // If it's a failed lookup marker, don't set hostname (leave it nil)
-                    if (![cachedHostname isEqualToString:kDNSLookupFailedMarker]) {
-                        host.hostname = cachedHostname;
-                    }
-                } else {
-                    // Perform reverse DNS lookup asynchronously
-                    __weak typeof(self) weakSelf = self;
-                    [self performReverseDNSLookup:remoteAddress completion:^(NSString *hostname) {
-                        __strong typeof(weakSelf) strongSelf = weakSelf;
-                        if (!strongSelf) return;
-
-                        dispatch_async(strongSelf.statsQueue, ^{
-                            if (hostname) {
-                                // Cache successful lookup
-                                [strongSelf.hostnameCache setObject:hostname forKey:remoteAddress];
-                                HostTraffic *h = strongSelf.hostStats[remoteAddress];
-                                if (h) {
-                                    h.hostname = hostname;
-                                }
-                            } else {
-                                // Cache negative result to avoid repeated failed lookups
-                                [strongSelf.hostnameCache setObject:kDNSLookupFailedMarker forKey:remoteAddress];
-                            }
-                        });
-                    }];
-                }
-                self.hostStats[remoteAddress] = host;
-            }
-            host.bytes += packetInfo.totalBytes;
-            host.packetCount++;
-        }
 
-        // Track connection statistics (use destination->source for inbound)
-        NSString *connectionSource = isIncoming ? packetInfo.destinationAddress : packetInfo.sourceAddress;
-        NSString *connectionDestination = isIncoming ? packetInfo.sourceAddress : packetInfo.destinationAddress;
-        NSInteger connectionSourcePort = isIncoming ? packetInfo.destinationPort : packetInfo.sourcePort;
-        NSInteger connectionDestinationPort = isIncoming ? packetInfo.sourcePort : packetInfo.destinationPort;
-
-        if (connectionSource.length > 0 && connectionDestination.length > 0) {
-            SNBConnectionKey *connectionKey = [[SNBConnectionKey alloc] initWithSource:connectionSource
-                                                                            sourcePort:connectionSourcePort
-                                                                            destination:connectionDestination
-                                                                        destinationPort:connectionDestinationPort];
-            ConnectionTraffic *connection = self.connectionStats[connectionKey];
-            if (!connection) {
-                connection = [[ConnectionTraffic alloc] init];
-                connection.sourceAddress = connectionSource;
-                connection.destinationAddress = connectionDestination;
-                connection.sourcePort = connectionSourcePort;
-                connection.destinationPort = connectionDestinationPort;
-                self.connectionStats[connectionKey] = connection;
-
-                // Lookup process information asynchronously
-                // Only lookup for outgoing connections (where source is local)
-                if (!isIncoming && connectionSourcePort > 0 && connectionDestinationPort > 0) {
-                    id cachedHelperObj = [self.processCache objectForKey:connectionKey];
-                    ProcessInfo *cachedHelper = (cachedHelperObj == [NSNull null]) ? nil : (ProcessInfo *)cachedHelperObj;
-                    ProcessInfo *cachedLsof = [self.lsofProcessCache objectForKey:connectionKey];
-                    ProcessInfo *finalCached = [self finalProcessInfoFromHelper:cachedHelper fallback:cachedLsof];
-                    if (!finalCached) {
-                        ProcessInfo *cachedByPort = [self cachedProcessInfoForPort:connectionSourcePort];
-                        if (cachedByPort) {
-                            SNBLogDebug("Port cache hit for source port %ld", (long)connectionSourcePort);
-                            [self assignProcessInfo:cachedByPort forConnectionKey:connectionKey];
-                            finalCached = cachedByPort;
-                        }
-                    }
-                    if (finalCached) {
-                        connection.processName = finalCached.processName;
-                        connection.processPID = finalCached.pid;
-                    }
-
-                    BOOL shouldLookupHelper = cachedHelper == nil;
-                    BOOL shouldLookupFallback = cachedLsof == nil;
-
-                    if (shouldLookupHelper) {
-                        SNBLogDebug("Process lookup: %@:%ld -> %@:%ld",
-                              connectionSource, (long)connectionSourcePort,
-                              connectionDestination, (long)connectionDestinationPort);
-                        __weak typeof(self) weakSelf = self;
-                        [self performProcessLookup:connectionSource
-                                        sourcePort:connectionSourcePort
-                                       destination:connectionDestination
-                                   destinationPort:connectionDestinationPort
-                                        lookupKey:connectionKey
-                                         completion:^(ProcessInfo *processInfo) {
-                            __strong typeof(weakSelf) strongSelf = weakSelf;
-                            if (!strongSelf) return;
-
-                            dispatch_async(strongSelf.statsQueue, ^{
-                                [strongSelf handleProcessLookupResult:processInfo
-                                                         connectionKey:connectionKey
-                                                                source:SNBProcessLookupSourceHelper];
-                            });
-                        }];
-                    }
-
-                    if (shouldLookupFallback) {
-                        // For new connections, do immediate synchronous native lookup
-                        // to catch short-lived connections before they close
-                        ProcessInfo *immediateResult = [ProcessLookup lookupUsingNativeAPIForSource:connectionSource
-                                                                                          sourcePort:connectionSourcePort
-                                                                                         destination:connectionDestination
-                                                                                     destinationPort:connectionDestinationPort];
-                        if (immediateResult) {
-                            SNBLogDebug("Immediate native lookup succeeded: %@ (PID %d)", immediateResult.processName, immediateResult.pid);
-                            connection.processName = immediateResult.processName;
-                            connection.processPID = immediateResult.pid;
-                            [self.lsofProcessCache setObject:immediateResult forKey:connectionKey];
-                            [self cacheProcessInfo:immediateResult forSourcePort:connectionSourcePort];
-                        } else {
-                            // If immediate lookup fails, schedule async lookup as backup
-                            [self scheduleNativeLookupForConnectionKey:connectionKey
-                                                                source:connectionSource
-                                                            sourcePort:connectionSourcePort
-                                                           destination:connectionDestination
-                                                      destinationPort:connectionDestinationPort];
-                        }
-                    }
-                } else {
-                    if (isIncoming) {
-                        SNBLogDebug("Skipping process lookup for incoming connection");
-                    }
-                }
-            }
-            connection.bytes += packetInfo.totalBytes;
-            connection.packetCount++;
-            connection.lastActivity = CFAbsoluteTimeGetCurrent();
-        }
-    });
+    NSUInteger shardCount = self.shardQueues.count;
+    NSMutableData *shardIndices = nil;
+    if (shardCount > 1) {
+        shardIndices = [NSMutableData dataWithLength:count];
+        SNBTrafficPartitionRecords(batch.records, count, (unsigned)shardCount, shardIndices.mutableBytes);
+    }
+    for (NSUInteger shard = 0; shard < shardCount; shard++) {
+        dispatch_async(self.shardQueues[shard], ^{
+            [self accountRecords:batch.records count:count shardIndices:shardIndices.bytes shard:shard];
+        });
+    }
 }
 
-- (void)performReverseDNSLookup:(NSString *)address completion:(void (^)(NSString *))completion {
-    // Performance: Limit pending DNS lookup queue depth to prevent memory leak
-    @synchronized(self) {
-        if (self.pendingDNSLookupCount >= kMaxPendingDNSLookups) {
-            SNBLogWarn("DNS lookup queue full (%lu pending), dropping lookup for %{" SNB_IP_PRIVACY "}@",
-                      (unsigned long)self.pendingDNSLookupCount, address);
-            // Cache negative result immediately to prevent repeated attempts
-            [self.hostnameCache setObject:kDNSLookupFailedMarker forKey:address];
-            if (completion) {
-                completion(nil);
-            }
-            return;
+// Hot path, on the shard's queue: counts into the shard's delta and must not
+// allocate once the delta has seen the interval's flows. Name lookups for new
+// hosts and connections happen when the deltas are merged.
+- (void)accountRecords:(const SNBPacketRecord *)records
+                 count:(NSUInteger)count
+          shardIndices:(const uint8_t *)shardIndices
+                 shard:(NSUInteger)shard {
+    SNBTrafficDeltaAccount(&_shards[shard], records, count, shardIndices, (unsigned)shard, SNBWallClockNs());
+}
+
+// Hands every shard's delta to handler in turn. The delta is swapped with the
+// empty spare first, so a shard is only held up for the swap, and handler
+// runs on statsQueue while the shard keeps counting into the spare.
+- (void)drainShardsLocked:(void (^NS_NOESCAPE)(const SNBTrafficDelta *delta))handler {
+    SNBTrafficDelta *spare = &_spareDelta;
+    for (NSUInteger shard = 0; shard < self.shardQueues.count; shard++) {
+        SNBTrafficDelta *delta = &_shards[shard];
+        dispatch_sync(self.shardQueues[shard], ^{
+            SNBTrafficDeltaSwap(delta, spare);
+        });
+        if (spare->totalPackets > 0) {
+            handler(spare);
         }
-        self.pendingDNSLookupCount++;
+        SNBTrafficDeltaReset(spare);
     }
+}
 
-    // Get or create a dedicated lock object for this address
-    NSObject *lock = nil;
-    @synchronized(self.dnsLookupLocks) {
-        lock = self.dnsLookupLocks[address];
-        if (!lock) {
-            lock = [[NSObject alloc] init];
-            self.dnsLookupLocks[address] = lock;
-        }
+- (void)hostAddedLocked:(const SNBFlowKey *)hostKey {
+    // The answer to the user's own lookup usually precedes the first packet;
+    // the snapshot reads it from the passive table
+    if ([[SNBPassiveDNSCache sharedCache] hostnameForFamily:hostKey->family address:hostKey->destinationAddress]) {
+        return;
+    }
+    NSString *remoteAddress = SNBStringFromPacketAddress(hostKey->family, hostKey->destinationAddress);
+    // Cached results include negative ones; the snapshot reads names from the cache
+    if (remoteAddress.length == 0 || [self.hostnameCache objectForKey:remoteAddress]) {
+        return;
     }
 
-    dispatch_async(self.dnsLookupQueue, ^{
-        dispatch_semaphore_wait(self.dnsLookupSemaphore, DISPATCH_TIME_FOREVER);
-        BOOL timedOut = NO;
-        NSString *hostname = SNBResolveHostname(address, kDNSLookupTimeout, &timedOut);
-        dispatch_semaphore_signal(self.dnsLookupSemaphore);
+    // Perform reverse DNS lookup asynchronously
+    __weak typeof(self) weakSelf = self;
+    [self performReverseDNSLookup:remoteAddress completion:^(NSString *hostname) {
+        __strong typeof(weakSelf) strongSelf = weakSelf;
+        if (!strongSelf) return;
 
-        if (timedOut) {
-            SNBLogWarn("DNS lookup timeout (%.0fs) for %{" SNB_IP_PRIVACY "}@", kDNSLookupTimeout, address);
-        }
+        dispatch_async(strongSelf.statsQueue, ^{
+            if (hostname) {
+                // Cache successful lookup
+                [strongSelf.hostnameCache setObject:hostname forKey:remoteAddress];
+                strongSelf.statsCacheDirty = YES;
+            } else {
+                // Cache negative result to avoid repeated failed lookups
+                [strongSelf.hostnameCache setObject:kDNSLookupFailedMarker forKey:remoteAddress];
+            }
+        });
+    }];
+}
 
-        if (completion) {
-            completion(hostname);
+- (void)connectionAddedLocked:(const SNBFlowKey *)flowKey outgoing:(BOOL)isOutgoing {
+    // Lookup process information asynchronously
+    // Only lookup for outgoing connections (where source is local)
+    if (!isOutgoing || !flowKey->hasPorts || flowKey->sourcePort == 0 || flowKey->destinationPort == 0) {
+        if (!isOutgoing) {
+            SNBLogDebug("Skipping process lookup for incoming connection");
         }
+        return;
+    }
 
-        @synchronized(self.dnsLookupLocks) {
-            if (self.dnsLookupLocks[address] == lock) {
-                [self.dnsLookupLocks removeObjectForKey:address];
-            }
+    SNBConnectionKey *connectionKey = [[SNBConnectionKey alloc] initWithFlowKey:flowKey];
+    NSString *connectionSource = connectionKey.source;
+    NSString *connectionDestination = connectionKey.destination;
+    NSInteger connectionSourcePort = connectionKey.sourcePort;
+    NSInteger connectionDestinationPort = connectionKey.destinationPort;
+
+    id cachedHelperObj = [self.processCache objectForKey:connectionKey];
+    ProcessInfo *cachedHelper = (cachedHelperObj == [NSNull null]) ? nil : (ProcessInfo *)cachedHelperObj;
+    ProcessInfo *cachedLsof = [self.lsofProcessCache objectForKey:connectionKey];
+    ProcessInfo *finalCached = [self finalProcessInfoFromHelper:cachedHelper fallback:cachedLsof];
+    if (!finalCached) {
+        ProcessInfo *cachedByPort = [self cachedProcessInfoForPort:connectionSourcePort];
+        if (cachedByPort) {
+            SNBLogDebug("Port cache hit for source port %ld", (long)connectionSourcePort);
+            [self assignProcessInfo:cachedByPort forConnectionKey:connectionKey];
+            finalCached = cachedByPort;
         }
+    }
+    if (finalCached) {
+        [self setProcessInfo:finalCached forConnectionKey:connectionKey];
+    }
 
-        // Decrement pending count
-        @synchronized(self) {
-            if (self.pendingDNSLookupCount > 0) {
-                self.pendingDNSLookupCount--;
-            }
-        }
-    });
+    // Resolved with the rest of the merge's new connections in
+    // flushProcessLookupsLocked; a cached helper miss is not asked again
+    if (cachedHelperObj == nil) {
+        SNBLogDebug("Process lookup: %@:%ld -> %@:%ld",
+              connectionSource, (long)connectionSourcePort,
+              connectionDestination, (long)connectionDestinationPort);
+        [self.pendingHelperLookups addObject:connectionKey];
+    }
+    if (cachedLsof == nil) {
+        [self.pendingNativeLookups addObject:connectionKey];
+    }
 }
 
-- (void)performProcessLookup:(NSString *)sourceAddress
-                  sourcePort:(NSInteger)sourcePort
-                 destination:(NSString *)destinationAddress
-             destinationPort:(NSInteger)destinationPort
-                   lookupKey:(SNBConnectionKey *)lookupKey
-                  completion:(void (^)(ProcessInfo *))completion {
-
-    // Get or create lock for this lookup
-    NSObject *lock = nil;
-    @synchronized(self.processLookupLocks) {
-        lock = self.processLookupLocks[lookupKey];
-        if (!lock) {
-            lock = [[NSObject alloc] init];
-            self.processLookupLocks[lookupKey] = lock;
-        } else {
-            // Lookup already in progress
-            return;
-        }
+static NSData *SNBPackedFlowKeys(NSArray<SNBConnectionKey *> *keys) {
+    NSMutableData *data = [NSMutableData dataWithLength:keys.count * sizeof(SNBFlowKey)];
+    SNBFlowKey *packed = data.mutableBytes;
+    for (NSUInteger i = 0; i < keys.count; i++) {
+        packed[i] = keys[i].flowKey;
     }
+    return data;
+}
 
-    [ProcessLookup lookupProcessForConnectionWithSource:sourceAddress
-                                             sourcePort:sourcePort
-                                            destination:destinationAddress
-                                        destinationPort:destinationPort
-                                             completion:^(ProcessInfo *processInfo) {
-        if (completion) {
-            completion(processInfo);
-        }
-
-        // Clean up lock
-        @synchronized(self.processLookupLocks) {
-            if (self.processLookupLocks[lookupKey] == lock) {
-        [self.processLookupLocks removeObjectForKey:lookupKey];
+// Resolves the connections a merge added: one helper round trip per batch and
+// one pass of the native socket index, instead of a walk of the process
+// table per connection. The native pass runs right after the merge so
+// short-lived connections are still open when it reads the sockets.
+- (void)flushProcessLookupsLocked {
+    __weak typeof(self) weakSelf = self;
+    void (^deliver)(NSArray<SNBConnectionKey *> *, NSArray *, SNBProcessLookupSource) =
+        ^(NSArray<SNBConnectionKey *> *keys, NSArray *processInfos, SNBProcessLookupSource source) {
+        __strong typeof(weakSelf) strongSelf = weakSelf;
+        if (!strongSelf) return;
+        dispatch_async(strongSelf.statsQueue, ^{
+            for (NSUInteger i = 0; i < keys.count; i++) {
+                id info = i < processInfos.count ? processInfos[i] : nil;
+                [strongSelf handleProcessLookupResult:[info isKindOfClass:[ProcessInfo class]] ? info : nil
+                                        connectionKey:keys[i]
+                                               source:source];
             }
-        }
-    }];
+        });
+    };
+
+    NSArray<SNBConnectionKey *> *helperKeys = [self.pendingHelperLookups copy];
+    [self.pendingHelperLookups removeAllObjects];
+    for (NSUInteger start = 0; start < helperKeys.count; start += kMaxProcessLookupBatch) {
+        NSArray<SNBConnectionKey *> *batch =
+            [helperKeys subarrayWithRange:NSMakeRange(start, MIN(kMaxProcessLookupBatch, helperKeys.count - start))];
+        [ProcessLookup lookupProcessesForFlowKeys:SNBPackedFlowKeys(batch) completion:^(NSArray *processInfos) {
+            deliver(batch, processInfos, SNBProcessLookupSourceHelper);
+        }];
+    }
+
+    NSArray<SNBConnectionKey *> *nativeKeys = [self.pendingNativeLookups copy];
+    [self.pendingNativeLookups removeAllObjects];
+    if (nativeKeys.count > 0) {
+        dispatch_async(self.processLookupQueue, ^{
+            NSArray *processInfos = [ProcessLookup lookupUsingNativeAPIForFlowKeys:SNBPackedFlowKeys(nativeKeys)];
+            deliver(nativeKeys, processInfos, SNBProcessLookupSourceLsof);
+        });
+    }
 }
 
-- (void)scheduleNativeLookupForConnectionKey:(SNBConnectionKey *)connectionKey
-                                       source:(NSString *)sourceAddress
-                                   sourcePort:(NSInteger)sourcePort
-                                  destination:(NSString *)destinationAddress
-                              destinationPort:(NSInteger)destinationPort {
-    if (!connectionKey) {
+// Keeps the rankings, process aggregates and destination set in step with
+// every entry a merge touches, so snapshots only read them
+static void SNBTrafficStatisticsMerged(void *context,
+                                       const SNBFlowKey *key,
+                                       SNBTrafficCounters *merged,
+                                       const SNBTrafficCounters *delta,
+                                       bool isHost,
+                                       bool inserted) {
+    TrafficStatistics *statistics = (__bridge TrafficStatistics *)context;
+    if (isHost) {
+        SNBTopTrafficUpdate(&statistics->_topHosts, statistics.hostTable, key, merged);
+        if (inserted) {
+            [statistics addActiveDestination:SNBStringFromPacketAddress(key->family, key->destinationAddress)];
+            [statistics hostAddedLocked:key];
+        }
         return;
     }
-    dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
-        ProcessInfo *nativeInfo = [ProcessLookup lookupUsingNativeAPIForSource:sourceAddress
-                                                                     sourcePort:sourcePort
-                                                                    destination:destinationAddress
-                                                                destinationPort:destinationPort];
-        dispatch_async(self.statsQueue, ^{
-            SNBLogDebug("Native lookup result: %@", nativeInfo ? nativeInfo.processName : @"<nil>");
-            [self handleProcessLookupResult:nativeInfo
-                              connectionKey:connectionKey
-                                     source:SNBProcessLookupSourceLsof];
-        });
-    });
+
+    if (inserted) {
+        // New connections start unattributed; the process lookup may move them
+        NSString *destination = SNBStringFromPacketAddress(key->family, key->destinationAddress);
+        [statistics addConnectionWithBytes:0 destination:destination toProcessSlot:kUnknownProcessSlot];
+        [statistics addActiveDestination:destination];
+    }
+    statistics.processAggregates[merged->processSlot].bytes += delta->bytes;
+    SNBTopTrafficUpdate(&statistics->_topConnections, statistics.connectionTable, key, merged);
+    if (inserted) {
+        [statistics connectionAddedLocked:key outgoing:(merged->flags & SNBTrafficCountersFlagOutgoing) != 0];
+    }
 }
 
-// Keep the old lsof method as a backup fallback option
-- (void)scheduleLsofLookupForConnectionKey:(SNBConnectionKey *)connectionKey
-                                     source:(NSString *)sourceAddress
-                                sourcePort:(NSInteger)sourcePort
-                               destination:(NSString *)destinationAddress
-                          destinationPort:(NSInteger)destinationPort {
-    if (!connectionKey) {
+// Folds what the shards counted since the last merge into the tables the
+// snapshots read. Runs before every snapshot and once a second from the
+// sampling timer.
+- (void)mergeShardsLocked {
+    [self drainShardsLocked:^(const SNBTrafficDelta *delta) {
+        SNBTrafficDeltaMerge(delta, self.hostTable, self.connectionTable,
+                             SNBTrafficStatisticsMerged, (__bridge void *)self);
+        self.totalBytes += delta->totalBytes;
+        self.incomingBytes += delta->incomingBytes;
+        self.outgoingBytes += delta->totalBytes - delta->incomingBytes;
+        self.totalPackets += delta->totalPackets;
+        for (NSUInteger index = 0; index < SNB_PACKET_MAX_INTERFACES; index++) {
+            self->_interfaceBytes[index] += delta->interfaceBytes[index];
+            self->_interfacePackets[index] += delta->interfacePackets[index];
+        }
+        SNBPacketClockAdvanceTo(&self->_packetClock, delta->clock.packetNs, delta->clock.wallNs);
+        self.statsCacheDirty = YES;
+    }];
+    [self flushProcessLookupsLocked];
+}
+
+- (void)performReverseDNSLookup:(NSString *)address completion:(void (^)(NSString *))completion {
+    // Never blocks: queries overlap on the resolver's queue and repeated
+    // addresses share one
+    SNBReverseDNSResolver *resolver = [SNBReverseDNSResolver sharedResolver];
+    if (!resolver) {
+        completion(nil);
         return;
     }
-    dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
-        ProcessInfo *lsofInfo = [ProcessLookup lookupUsingLsofForSource:sourceAddress
-                                                              sourcePort:sourcePort
-                                                             destination:destinationAddress
-                                                        destinationPort:destinationPort];
-        dispatch_async(self.statsQueue, ^{
-            SNBLogDebug("lsof lookup result: %@", lsofInfo ? lsofInfo.processName : @"<nil>");
-            [self handleProcessLookupResult:lsofInfo
-                                 connectionKey:connectionKey
-                                        source:SNBProcessLookupSourceLsof];
-        });
-    });
+    [resolver resolveAddress:address completion:completion];
 }
 
 - (void)handleProcessLookupResult:(ProcessInfo *)processInfo
@@ -799,20 +802,17 @@ static NSString *SNBResolveHostname(NSString *address,
     if (!processInfo || !connectionKey) {
         return;
     }
-    ConnectionTraffic *connection = self.connectionStats[connectionKey];
-    if (!connection) {
+    SNBFlowKey flowKey = connectionKey.flowKey;
+    if (!SNBFlowTableFind(self.connectionTable, &flowKey)) {
         return;
     }
-    if (processInfo.processName.length > 0) {
-        connection.processName = processInfo.processName;
-    }
-    connection.processPID = processInfo.pid;
+    [self setProcessInfo:processInfo forConnectionKey:connectionKey];
 
     [self.processCache setObject:processInfo forKey:connectionKey];
     [self.lsofProcessCache setObject:processInfo forKey:connectionKey];
     self.statsCacheDirty = YES;
-    SNBLogDebug("Process info cached for %@: %@ (%d)", [connectionKey stringValue], connection.processName, connection.processPID);
-    [self cacheProcessInfo:processInfo forSourcePort:connection.sourcePort];
+    SNBLogDebug("Process info cached for %@: %@ (%d)", [connectionKey stringValue], processInfo.processName, processInfo.pid);
+    [self cacheProcessInfo:processInfo forSourcePort:connectionKey.sourcePort];
 }
 
 - (ProcessInfo *)finalProcessInfoFromHelper:(ProcessInfo *)helper fallback:(ProcessInfo *)fallback {
@@ -840,144 +840,133 @@ static NSString *SNBResolveHostname(NSString *address,
 }
 
 
-- (NSArray<HostTraffic *> *)topHostsFromValues:(NSArray<HostTraffic *> *)values limit:(NSUInteger)limit {
-    if (limit == 0 || values.count == 0) {
-        return @[];
+- (HostTraffic *)hostTrafficForKey:(const SNBFlowKey *)key counters:(const SNBTrafficCounters *)counters {
+    HostTraffic *host = [[HostTraffic alloc] init];
+    host.address = SNBStringFromPacketAddress(key->family, key->destinationAddress);
+    host.hostname = [[SNBPassiveDNSCache sharedCache] hostnameForFamily:key->family address:key->destinationAddress];
+    NSString *cachedHostname = host.hostname || !host.address ? nil : [self.hostnameCache objectForKey:host.address];
+    // If it's a failed lookup marker, don't set hostname (leave it nil)
+    if (cachedHostname && ![cachedHostname isEqualToString:kDNSLookupFailedMarker]) {
+        host.hostname = cachedHostname;
     }
+    host.bytes = counters->bytes;
+    host.packetCount = (NSInteger)counters->packets;
+    return host;
+}
 
-    // Optimization: Use min-heap approach for top-K selection
-    // Only sort once at the end instead of on every iteration: O(n log k) instead of O(n² log n)
-    NSMutableArray<HostTraffic *> *top = [NSMutableArray arrayWithCapacity:limit];
-
-    for (HostTraffic *host in values) {
-        if (top.count < limit) {
-            [top addObject:host];
-        } else {
-            // Only replace if current host has more bytes than the minimum in our top list
-            HostTraffic *minHost = top[0]; // Will be minimum after sort
-            if (host.bytes > minHost.bytes) {
-                top[0] = host;
-            } else {
-                continue;
-            }
-        }
+- (NSString *)interfaceNameForIndex:(uint8_t)interfaceIndex names:(NSArray<NSString *> *)names {
+    NSString *name = interfaceIndex < names.count ? names[interfaceIndex] : nil;
+    return name.length > 0 ? name : nil;
+}
 
-        // Only sort when we reach capacity or when we replace an item
-        if (top.count == limit) {
-            // Partial sort: just ensure minimum element is at index 0
-            NSUInteger minIndex = 0;
-            uint64_t minBytes = top[0].bytes;
-            for (NSUInteger i = 1; i < top.count; i++) {
-                if (top[i].bytes < minBytes) {
-                    minBytes = top[i].bytes;
-                    minIndex = i;
-                }
-            }
-            if (minIndex != 0) {
-                [top exchangeObjectAtIndex:0 withObjectAtIndex:minIndex];
-            }
+- (ConnectionTraffic *)connectionTrafficForKey:(const SNBFlowKey *)key
+                                      counters:(const SNBTrafficCounters *)counters
+                                interfaceNames:(NSArray<NSString *> *)interfaceNames {
+    SNBConnectionKey *connectionKey = [[SNBConnectionKey alloc] initWithFlowKey:key];
+    ConnectionTraffic *connection = [[ConnectionTraffic alloc] init];
+    connection.sourceAddress = connectionKey.source;
+    connection.destinationAddress = connectionKey.destination;
+    connection.sourcePort = connectionKey.sourcePort;
+    connection.destinationPort = connectionKey.destinationPort;
+    connection.bytes = counters->bytes;
+    connection.packetCount = (NSInteger)counters->packets;
+    connection.lastActivity = SNBTrafficLastActivity(counters);
+    connection.interfaceName = [self interfaceNameForIndex:counters->interfaceIndex names:interfaceNames];
+    ProcessInfo *processInfo = self.connectionProcesses[connectionKey];
+    if (processInfo) {
+        if (processInfo.processName.length > 0) {
+            connection.processName = processInfo.processName;
         }
+        connection.processPID = processInfo.pid;
     }
-
-    // Final sort only once at the end
-    [top sortUsingComparator:^NSComparisonResult(HostTraffic *obj1, HostTraffic *obj2) {
-        if (obj1.bytes > obj2.bytes) {
-            return NSOrderedAscending;
-        }
-        if (obj1.bytes < obj2.bytes) {
-            return NSOrderedDescending;
-        }
-        return NSOrderedSame;
-    }];
-
-    return [top copy];
+    return connection;
 }
 
-- (NSArray<ConnectionTraffic *> *)topConnectionsFromValues:(NSArray<ConnectionTraffic *> *)values limit:(NSUInteger)limit {
-    if (limit == 0 || values.count == 0) {
-        return @[];
-    }
-
-    // Optimization: Use min-heap approach for top-K selection
-    // Only sort once at the end instead of on every iteration: O(n log k) instead of O(n² log n)
-    NSMutableArray<ConnectionTraffic *> *top = [NSMutableArray arrayWithCapacity:limit];
-
-    for (ConnectionTraffic *connection in values) {
-        if (top.count < limit) {
-            [top addObject:connection];
-        } else {
-            // Only replace if current connection has more bytes than the minimum in our top list
-            ConnectionTraffic *minConnection = top[0]; // Will be minimum after sort
-            if (connection.bytes > minConnection.bytes) {
-                top[0] = connection;
-            } else {
-                continue;
-            }
+- (NSArray<HostTraffic *> *)topHostsLockedWithLimit:(NSUInteger)limit {
+    SNBTopTrafficSetLimit(&_topHosts, self.hostTable, limit);
+    SNBTopTrafficEntry top[MAX((size_t)1, _topHosts.limit)];
+    size_t count = SNBTopTrafficCopySorted(&_topHosts, self.hostTable, top);
+    NSMutableArray<HostTraffic *> *hosts = [NSMutableArray arrayWithCapacity:count];
+    for (size_t i = 0; i < count; i++) {
+        const SNBTrafficCounters *counters = SNBFlowTableFind(self.hostTable, &top[i].key);
+        if (counters) {
+            [hosts addObject:[self hostTrafficForKey:&top[i].key counters:counters]];
         }
+    }
+    return [hosts copy];
+}
 
-        // Only sort when we reach capacity or when we replace an item
-        if (top.count == limit) {
-            // Partial sort: just ensure minimum element is at index 0
-            NSUInteger minIndex = 0;
-            uint64_t minBytes = top[0].bytes;
-            for (NSUInteger i = 1; i < top.count; i++) {
-                if (top[i].bytes < minBytes) {
-                    minBytes = top[i].bytes;
-                    minIndex = i;
-                }
-            }
-            if (minIndex != 0) {
-                [top exchangeObjectAtIndex:0 withObjectAtIndex:minIndex];
-            }
+- (NSArray<ConnectionTraffic *> *)topConnectionsLockedWithLimit:(NSUInteger)limit {
+    SNBTopTrafficSetLimit(&_topConnections, self.connectionTable, limit);
+    SNBTopTrafficEntry top[MAX((size_t)1, _topConnections.limit)];
+    size_t count = SNBTopTrafficCopySorted(&_topConnections, self.connectionTable, top);
+    NSArray<NSString *> *interfaceNames = self.interfaceNames;
+    NSMutableArray<ConnectionTraffic *> *connections = [NSMutableArray arrayWithCapacity:count];
+    for (size_t i = 0; i < count; i++) {
+        const SNBTrafficCounters *counters = SNBFlowTableFind(self.connectionTable, &top[i].key);
+        if (counters) {
+            [connections addObject:[self connectionTrafficForKey:&top[i].key
+                                                        counters:counters
+                                                  interfaceNames:interfaceNames]];
         }
     }
+    return [connections copy];
+}
 
-    // Final sort only once at the end
-    [top sortUsingComparator:^NSComparisonResult(ConnectionTraffic *obj1, ConnectionTraffic *obj2) {
-        if (obj1.bytes > obj2.bytes) {
-            return NSOrderedAscending;
-        }
-        if (obj1.bytes < obj2.bytes) {
-            return NSOrderedDescending;
+- (NSArray<InterfaceTraffic *> *)interfacesLocked {
+    NSArray<NSString *> *interfaceNames = self.interfaceNames;
+    NSMutableArray<InterfaceTraffic *> *interfaces = [NSMutableArray array];
+    for (uint8_t index = 0; index < SNB_PACKET_MAX_INTERFACES; index++) {
+        if (_interfacePackets[index] == 0) {
+            continue;
         }
-        return NSOrderedSame;
-    }];
-
-    return [top copy];
+        InterfaceTraffic *interface = [[InterfaceTraffic alloc] init];
+        interface.name = [self interfaceNameForIndex:index names:interfaceNames];
+        interface.bytes = _interfaceBytes[index];
+        interface.packetCount = _interfacePackets[index];
+        interface.bytesPerSecond = _interfaceBytesPerSecond[index];
+        [interfaces addObject:interface];
+    }
+    return [interfaces copy];
 }
 
-- (NSArray<ProcessTrafficSummary *> *)processSummariesFromConnections:(NSArray<ConnectionTraffic *> *)connections
-                                                               limit:(NSUInteger)limit {
-    if (limit == 0 || connections.count == 0) {
-        return @[];
-    }
-
-    NSMutableDictionary<NSString *, ProcessTrafficSummary *> *summariesDict = [NSMutableDictionary dictionary];
-    for (ConnectionTraffic *connection in connections) {
-        NSString *processName = connection.processName.length > 0 ? connection.processName : @"<unknown>";
-        pid_t pid = connection.processPID;
-        NSString *key = [NSString stringWithFormat:@"%@|%d", processName, (int)pid];
-        ProcessTrafficSummary *summary = summariesDict[key];
-        if (!summary) {
-            summary = [[ProcessTrafficSummary alloc] init];
-            summary.processName = processName;
-            summary.processPID = pid;
-            summariesDict[key] = summary;
-        }
-        summary.bytes += connection.bytes;
-        summary.connectionCount += 1;
-        if (connection.destinationAddress.length > 0) {
-            [summary addDestination:connection.destinationAddress];
+// Every merged host's bytes and last activity, by address. At most
+// kMaxHostCacheSize entries, rebuilt with the top lists.
+- (void)cacheDestinationTrafficLocked {
+    size_t count = SNBFlowTableCount(self.hostTable);
+    NSMutableDictionary<NSString *, NSNumber *> *bytes = [NSMutableDictionary dictionaryWithCapacity:count];
+    NSMutableDictionary<NSString *, NSNumber *> *lastActivity = [NSMutableDictionary dictionaryWithCapacity:count];
+    size_t cursor = 0;
+    const SNBFlowKey *key = NULL;
+    const SNBTrafficCounters *counters;
+    while ((counters = SNBFlowTableNext(self.hostTable, &cursor, &key)) != NULL) {
+        NSString *address = SNBStringFromPacketAddress(key->family, key->destinationAddress);
+        if (!address) {
+            continue;
         }
+        bytes[address] = @(counters->bytes);
+        lastActivity[address] = @(SNBTrafficLastActivity(counters));
     }
+    self.cachedDestinationBytes = bytes;
+    self.cachedDestinationLastActivity = lastActivity;
+}
 
-    NSMutableArray<ProcessTrafficSummary *> *summaries = [NSMutableArray arrayWithCapacity:summariesDict.count];
-    for (ProcessTrafficSummary *summary in summariesDict.allValues) {
-        [summary finalizeDestinations];
-        [summaries addObject:summary];
+// Rebuilt only when an address joins or leaves the active set
+- (NSSet<NSString *> *)allDestinationIPsLocked {
+    if (!self.cachedDestinationIPs) {
+        self.cachedDestinationIPs = [NSSet setWithArray:self.activeDestinations.allObjects];
     }
+    return self.cachedDestinationIPs;
+}
 
-    [summaries sortUsingComparator:^NSComparisonResult(ProcessTrafficSummary *obj1, ProcessTrafficSummary *obj2) {
+- (NSArray<ProcessTrafficSummary *> *)processSummariesLockedWithLimit:(NSUInteger)limit {
+    NSMutableArray<SNBProcessAggregate *> *active = [NSMutableArray array];
+    for (SNBProcessAggregate *aggregate in self.processAggregates) {
+        if (aggregate.connectionCount > 0) {
+            [active addObject:aggregate];
+        }
+    }
+    [active sortUsingComparator:^NSComparisonResult(SNBProcessAggregate *obj1, SNBProcessAggregate *obj2) {
         if (obj1.bytes > obj2.bytes) {
             return NSOrderedAscending;
         }
@@ -987,23 +976,26 @@ static NSString *SNBResolveHostname(NSString *address,
         return NSOrderedSame;
     }];
 
-    if (summaries.count > limit) {
-        [summaries removeObjectsInRange:NSMakeRange(limit, summaries.count - limit)];
+    NSUInteger count = MIN(limit, active.count);
+    NSMutableArray<ProcessTrafficSummary *> *summaries = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger i = 0; i < count; i++) {
+        [summaries addObject:[active[i] summary]];
     }
-
     return [summaries copy];
 }
 
-- (TrafficStats *)currentStatsLocked {
+// Builds a snapshot from the incrementally kept rankings and aggregates: the
+// cost follows the menu limits and the number of processes, plus one pass
+// over the capped host table when traffic changed, not the number of
+// connections. Publishes it as latestStats.
+- (TrafficStats *)snapshotLocked {
     TrafficStats *stats = [[TrafficStats alloc] init];
     stats.totalBytes = self.totalBytes;
     stats.incomingBytes = self.incomingBytes;
     stats.outgoingBytes = self.outgoingBytes;
     stats.totalPackets = self.totalPackets;
     stats.bytesPerSecond = self.cachedBytesPerSecond;
-
-    CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
-    [self removeStaleConnectionsLocked:now];
+    stats.captureTime = [self packetTimeLocked];
 
     ConfigurationManager *config = [ConfigurationManager sharedManager];
     // Use cached results if available and cache is clean
@@ -1011,33 +1003,32 @@ static NSString *SNBResolveHostname(NSString *address,
         NSUInteger hostLimit = MAX(1, config.maxTopHostsToShow);
         NSUInteger connectionLimit = MAX(1, config.maxTopConnectionsToShow);
 
-        self.cachedTopHosts = [self topHostsFromValues:self.hostStats.allValues limit:hostLimit];
-        self.cachedTopConnections = [self topConnectionsFromValues:self.connectionStats.allValues limit:connectionLimit];
+        self.cachedTopHosts = [self topHostsLockedWithLimit:hostLimit];
+        self.cachedTopConnections = [self topConnectionsLockedWithLimit:connectionLimit];
+        [self cacheDestinationTrafficLocked];
         self.statsCacheDirty = NO;
     }
 
     stats.topHosts = self.cachedTopHosts;
     stats.topConnections = self.cachedTopConnections;
     NSUInteger processLimit = MAX(1, config.maxTopConnectionsToShow);
-    stats.processSummaries = [self processSummariesFromConnections:self.connectionStats.allValues limit:processLimit];
+    stats.processSummaries = [self processSummariesLockedWithLimit:processLimit];
+    stats.interfaces = [self interfacesLocked];
 
     // Collect ALL active destination IPs (not just from top connections) for threat intel
-    NSMutableSet<NSString *> *allDestIPs = [NSMutableSet set];
-    for (ConnectionTraffic *conn in self.connectionStats.allValues) {
-        if (conn.destinationAddress.length > 0) {
-            [allDestIPs addObject:conn.destinationAddress];
-        }
-    }
-    for (HostTraffic *host in self.hostStats.allValues) {
-        if (host.address.length > 0) {
-            [allDestIPs addObject:host.address];
-        }
-    }
-    stats.allActiveDestinationIPs = [allDestIPs copy];
+    stats.allActiveDestinationIPs = [self allDestinationIPsLocked];
+    stats.destinationBytes = self.cachedDestinationBytes;
+    stats.destinationLastActivity = self.cachedDestinationLastActivity;
 
+    self.latestStats = stats;
     return stats;
 }
 
+- (TrafficStats *)currentStatsLocked {
+    [self mergeShardsLocked];
+    return [self snapshotLocked];
+}
+
 - (TrafficStats *)getCurrentStats {
     __block TrafficStats *stats = nil;
 
@@ -1078,23 +1069,8 @@ static NSString *SNBResolveHostname(NSString *address,
             return;
         }
 
-        NSMutableSet<NSString *> *destinationIPs = [NSMutableSet set];
-
-        // Collect all unique destination IPs from connections
-        for (ConnectionTraffic *connection in strongSelf.connectionStats.allValues) {
-            if (connection.destinationAddress.length > 0) {
-                [destinationIPs addObject:connection.destinationAddress];
-            }
-        }
-
-        // Also collect from host stats (which tracks remote hosts)
-        for (HostTraffic *host in strongSelf.hostStats.allValues) {
-            if (host.address.length > 0) {
-                [destinationIPs addObject:host.address];
-            }
-        }
-
-        NSSet<NSString *> *result = [destinationIPs copy];
+        [strongSelf mergeShardsLocked];
+        NSSet<NSString *> *result = [strongSelf allDestinationIPsLocked];
         dispatch_async(dispatch_get_main_queue(), ^{
             completion(result);
         });
@@ -1103,41 +1079,74 @@ static NSString *SNBResolveHostname(NSString *address,
 
 - (void)reset {
     dispatch_async(self.statsQueue, ^{
+        // Traffic still in the shards predates the reset; drop it unmerged
+        [self drainShardsLocked:^(const SNBTrafficDelta *delta) {}];
         self.totalBytes = 0;
         self.incomingBytes = 0;
         self.outgoingBytes = 0;
         self.totalPackets = 0;
-        [self.hostStats removeAllObjects];
-        [self.connectionStats removeAllObjects];
+        SNBFlowTableClear(self.hostTable);
+        SNBFlowTableClear(self.connectionTable);
+        SNBTopTrafficClear(&self->_topHosts);
+        SNBTopTrafficClear(&self->_topConnections);
+        [self resetProcessAggregatesLocked];
+        [self.activeDestinations removeAllObjects];
+        self.cachedDestinationIPs = nil;
+        [self.connectionProcesses removeAllObjects];
         self.lastUpdateTime = nil;
         self.lastTotalBytes = 0;
         self.cachedTopHosts = nil;
         self.cachedTopConnections = nil;
+        self.cachedDestinationBytes = nil;
+        self.cachedDestinationLastActivity = nil;
         self.statsCacheDirty = YES;
-        self.lastSampleTime = nil;
+        self.lastSampleTime = 0;
         self.lastSampleTotalBytes = 0;
         self.cachedBytesPerSecond = 0;
+        memset(self->_interfaceBytes, 0, sizeof(self->_interfaceBytes));
+        memset(self->_interfacePackets, 0, sizeof(self->_interfacePackets));
+        memset(self->_interfaceSampleBytes, 0, sizeof(self->_interfaceSampleBytes));
+        memset(self->_interfaceBytesPerSecond, 0, sizeof(self->_interfaceBytesPerSecond));
+        [self snapshotLocked];
     });
 }
 
 - (void)sampleBytesPerSecond {
     dispatch_async(self.statsQueue, ^{
-        NSDate *now = [NSDate date];
-        if (self.lastSampleTime) {
-            NSTimeInterval elapsed = [now timeIntervalSinceDate:self.lastSampleTime];
+        [self mergeShardsLocked];
+        // Sampled on capture time, so a fast replay reports the recorded rate
+        CFAbsoluteTime now = [self packetTimeLocked];
+        if (self.lastSampleTime > 0) {
+            NSTimeInterval elapsed = now - self.lastSampleTime;
             if (elapsed > 0) {
                 uint64_t bytesDiff = self.totalBytes - self.lastSampleTotalBytes;
                 self.cachedBytesPerSecond = (uint64_t)(bytesDiff / elapsed);
+                for (NSUInteger index = 0; index < SNB_PACKET_MAX_INTERFACES; index++) {
+                    uint64_t interfaceDiff = self->_interfaceBytes[index] - self->_interfaceSampleBytes[index];
+                    self->_interfaceBytesPerSecond[index] = (uint64_t)(interfaceDiff / elapsed);
+                }
             }
         }
         self.lastSampleTime = now;
         self.lastSampleTotalBytes = self.totalBytes;
+        memcpy(self->_interfaceSampleBytes, self->_interfaceBytes, sizeof(self->_interfaceBytes));
+
+        // Remove stale connections that haven't seen activity recently
+        [self removeStaleConnectionsLocked:now];
+        [self snapshotLocked];
     });
 }
 
 @end
 
 @implementation TrafficStats
+
+- (double)lookupPriorityForDestination:(NSString *)address anomalyScore:(double)anomalyScore {
+    NSNumber *lastActivity = self.destinationLastActivity[address];
+    double idleSeconds = lastActivity ? self.captureTime - lastActivity.doubleValue : INFINITY;
+    return SNBRequestPriorityScore(self.destinationBytes[address].unsignedLongLongValue, anomalyScore, idleSeconds);
+}
+
 @end
 
 @implementation HostTraffic
@@ -1145,3 +1154,6 @@ static NSString *SNBResolveHostname(NSString *address,
 
 @implementation ConnectionTraffic
 @end
+
+@implementation InterfaceTraffic
+@end
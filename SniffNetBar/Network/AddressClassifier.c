@@ -0,0 +1,244 @@
+//
+//  AddressClassifier.c
+//  SniffNetBar
+//
+//  Prefix table classifying binary IPv4/IPv6 addresses into special ranges
+//
+
+#include "AddressClassifier.h"
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+
+// MARK: - Lifecycle
+
+static bool SNBAddressClassifierGrow(SNBAddressClassifier *classifier) {
+    uint32_t capacity = classifier->nodeCapacity ? classifier->nodeCapacity * 2 : 16;
+    SNBAddressClassifierNode *nodes = realloc(classifier->nodes, (size_t)capacity * sizeof(SNBAddressClassifierNode));
+    if (!nodes) {
+        return false;
+    }
+    classifier->nodes = nodes;
+    classifier->nodeCapacity = capacity;
+    return true;
+}
+
+// Appends a node whose slots all carry classes, the classes of the slot it
+// hangs from. Returns its index, or 0 on allocation failure.
+static uint32_t SNBAddressClassifierAddNode(SNBAddressClassifier *classifier, uint16_t classes) {
+    if (classifier->nodeCount == classifier->nodeCapacity && !SNBAddressClassifierGrow(classifier)) {
+        return 0;
+    }
+    SNBAddressClassifierNode *node = &classifier->nodes[classifier->nodeCount];
+    memset(node, 0, sizeof(*node));
+    for (int i = 0; i < 256; i++) {
+        node->slots[i].classes = classes;
+    }
+    return classifier->nodeCount++;
+}
+
+bool SNBAddressClassifierInit(SNBAddressClassifier *classifier) {
+    memset(classifier, 0, sizeof(*classifier));
+    // The two roots
+    SNBAddressClassifierAddNode(classifier, 0);
+    SNBAddressClassifierAddNode(classifier, 0);
+    if (classifier->nodeCount != 2) {
+        SNBAddressClassifierDestroy(classifier);
+        return false;
+    }
+    return true;
+}
+
+void SNBAddressClassifierDestroy(SNBAddressClassifier *classifier) {
+    free(classifier->nodes);
+    memset(classifier, 0, sizeof(*classifier));
+}
+
+size_t SNBAddressClassifierMemoryBytes(const SNBAddressClassifier *classifier) {
+    return sizeof(*classifier) + (size_t)classifier->nodeCapacity * sizeof(SNBAddressClassifierNode);
+}
+
+// MARK: - Building
+
+// ORs classes into every slot below a node, so a prefix added after a longer
+// one still reaches the addresses that walk past its slot
+static void SNBAddressClassifierPushDown(SNBAddressClassifier *classifier, uint32_t nodeIndex, uint16_t classes) {
+    for (int i = 0; i < 256; i++) {
+        SNBAddressClassifierSlot *slot = &classifier->nodes[nodeIndex].slots[i];
+        slot->classes |= classes;
+        if (slot->child != 0) {
+            SNBAddressClassifierPushDown(classifier, slot->child, classes);
+        }
+    }
+}
+
+bool SNBAddressClassifierAddPrefix(SNBAddressClassifier *classifier,
+                                   uint8_t family,
+                                   const uint8_t *address,
+                                   uint8_t prefixLength,
+                                   uint16_t classes) {
+    if (family != SNBAddressFamilyIPv4 && family != SNBAddressFamilyIPv6) {
+        return false;
+    }
+    unsigned maxLength = family == SNBAddressFamilyIPv6 ? 128 : 32;
+    if (prefixLength > maxLength) {
+        return false;
+    }
+
+    // Walk, creating nodes, down to the byte the prefix ends in
+    uint32_t nodeIndex = family == SNBAddressFamilyIPv6 ? 1 : 0;
+    unsigned depth = 0;
+    while (prefixLength > 8 * (depth + 1)) {
+        uint8_t byte = address[depth];
+        uint32_t child = classifier->nodes[nodeIndex].slots[byte].child;
+        if (child == 0) {
+            child = SNBAddressClassifierAddNode(classifier, classifier->nodes[nodeIndex].slots[byte].classes);
+            if (child == 0) {
+                return false;
+            }
+            classifier->nodes[nodeIndex].slots[byte].child = child;
+        }
+        nodeIndex = child;
+        depth++;
+    }
+
+    // Expand the remaining 0-8 bits over the slots they cover
+    unsigned bits = prefixLength - 8 * depth;
+    unsigned span = 1u << (8 - bits);
+    unsigned first = bits == 0 ? 0 : (address[depth] & (0xffu << (8 - bits)) & 0xffu);
+    for (unsigned i = first; i < first + span; i++) {
+        SNBAddressClassifierSlot *slot = &classifier->nodes[nodeIndex].slots[i];
+        slot->classes |= classes;
+        if (slot->child != 0) {
+            SNBAddressClassifierPushDown(classifier, slot->child, classes);
+        }
+    }
+    return true;
+}
+
+bool SNBAddressClassifierAddCIDR(SNBAddressClassifier *classifier,
+                                 const char *cidr,
+                                 uint16_t classes,
+                                 char *error,
+                                 size_t errorLength) {
+    char text[INET6_ADDRSTRLEN + 8];
+    size_t length = strlen(cidr);
+    if (length == 0 || length >= sizeof(text)) {
+        snprintf(error, errorLength, "Invalid network \"%s\"", cidr);
+        return false;
+    }
+    memcpy(text, cidr, length + 1);
+
+    char *slash = strchr(text, '/');
+    if (slash) {
+        *slash = '\0';
+    }
+    uint8_t address[16] = {0};
+    uint8_t family;
+    unsigned maxLength;
+    if (inet_pton(AF_INET, text, address) == 1) {
+        family = SNBAddressFamilyIPv4;
+        maxLength = 32;
+    } else if (inet_pton(AF_INET6, text, address) == 1) {
+        family = SNBAddressFamilyIPv6;
+        maxLength = 128;
+    } else {
+        snprintf(error, errorLength, "Invalid address in network \"%s\"", cidr);
+        return false;
+    }
+
+    unsigned prefixLength = maxLength;
+    if (slash) {
+        char *end = NULL;
+        unsigned long value = strtoul(slash + 1, &end, 10);
+        if (slash[1] < '0' || slash[1] > '9' || *end != '\0' || value > maxLength) {
+            snprintf(error, errorLength, "Invalid prefix length in network \"%s\"", cidr);
+            return false;
+        }
+        prefixLength = (unsigned)value;
+    }
+
+    if (!SNBAddressClassifierAddPrefix(classifier, family, address, (uint8_t)prefixLength, classes)) {
+        snprintf(error, errorLength, "Out of memory adding network \"%s\"", cidr);
+        return false;
+    }
+    return true;
+}
+
+bool SNBAddressClassifierAddDefaults(SNBAddressClassifier *classifier) {
+    static const struct {
+        uint8_t family;
+        uint8_t prefixLength;
+        uint16_t classes;
+        uint8_t address[16];
+    } ranges[] = {
+        {SNBAddressFamilyIPv4, 8, SNBAddressClassUnspecified, {0}},
+        {SNBAddressFamilyIPv4, 8, SNBAddressClassPrivate, {10}},
+        {SNBAddressFamilyIPv4, 10, SNBAddressClassSharedAddress, {100, 64}},
+        {SNBAddressFamilyIPv4, 8, SNBAddressClassLoopback, {127}},
+        {SNBAddressFamilyIPv4, 16, SNBAddressClassLinkLocal, {169, 254}},
+        {SNBAddressFamilyIPv4, 12, SNBAddressClassPrivate, {172, 16}},
+        {SNBAddressFamilyIPv4, 24, SNBAddressClassDocumentation, {192, 0, 2}},
+        {SNBAddressFamilyIPv4, 16, SNBAddressClassPrivate, {192, 168}},
+        {SNBAddressFamilyIPv4, 24, SNBAddressClassDocumentation, {198, 51, 100}},
+        {SNBAddressFamilyIPv4, 24, SNBAddressClassDocumentation, {203, 0, 113}},
+        {SNBAddressFamilyIPv4, 4, SNBAddressClassMulticast, {224}},
+        {SNBAddressFamilyIPv4, 4, SNBAddressClassReserved, {240}},
+        {SNBAddressFamilyIPv6, 128, SNBAddressClassUnspecified, {0}},
+        {SNBAddressFamilyIPv6, 128, SNBAddressClassLoopback, {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1}},
+        {SNBAddressFamilyIPv6, 32, SNBAddressClassDocumentation, {0x20, 0x01, 0x0d, 0xb8}},
+        {SNBAddressFamilyIPv6, 7, SNBAddressClassUniqueLocal, {0xfc}},
+        {SNBAddressFamilyIPv6, 10, SNBAddressClassLinkLocal, {0xfe, 0x80}},
+        {SNBAddressFamilyIPv6, 8, SNBAddressClassMulticast, {0xff}},
+    };
+    for (size_t i = 0; i < sizeof(ranges) / sizeof(ranges[0]); i++) {
+        if (!SNBAddressClassifierAddPrefix(classifier, ranges[i].family, ranges[i].address,
+                                           ranges[i].prefixLength, ranges[i].classes)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// MARK: - Shared table
+
+static _Atomic(const SNBAddressClassifier *) SNBAddressClassifierCurrent;
+static pthread_once_t SNBAddressClassifierDefaultOnce = PTHREAD_ONCE_INIT;
+
+static void SNBAddressClassifierBuildDefault(void) {
+    static SNBAddressClassifier defaults;
+    // Two empty roots if memory is that short, so lookups still work
+    static SNBAddressClassifierNode emptyRoots[2];
+    if (!SNBAddressClassifierInit(&defaults) || !SNBAddressClassifierAddDefaults(&defaults)) {
+        SNBAddressClassifierDestroy(&defaults);
+        defaults.nodes = emptyRoots;
+        defaults.nodeCount = 2;
+    }
+    const SNBAddressClassifier *expected = NULL;
+    atomic_compare_exchange_strong(&SNBAddressClassifierCurrent, &expected, &defaults);
+}
+
+const SNBAddressClassifier *SNBAddressClassifierShared(void) {
+    const SNBAddressClassifier *classifier = atomic_load_explicit(&SNBAddressClassifierCurrent, memory_order_acquire);
+    if (classifier) {
+        return classifier;
+    }
+    pthread_once(&SNBAddressClassifierDefaultOnce, SNBAddressClassifierBuildDefault);
+    return atomic_load_explicit(&SNBAddressClassifierCurrent, memory_order_acquire);
+}
+
+bool SNBAddressClassifierPublish(SNBAddressClassifier *classifier) {
+    SNBAddressClassifier *published = malloc(sizeof(*published));
+    if (!published) {
+        return false;
+    }
+    *published = *classifier;
+    memset(classifier, 0, sizeof(*classifier));
+    // Build the defaults first so a later first call cannot overwrite this one
+    SNBAddressClassifierShared();
+    atomic_store_explicit(&SNBAddressClassifierCurrent, published, memory_order_release);
+    return true;
+}
@@ -0,0 +1,137 @@
+//
+//  AddressClassifier.h
+//  SniffNetBar
+//
+//  Prefix table classifying binary IPv4/IPv6 addresses into special ranges
+//
+
+#ifndef SNB_ADDRESS_CLASSIFIER_H
+#define SNB_ADDRESS_CLASSIFIER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "PacketRecord.h"
+
+// Ranges an address can fall in. An address gets the union of every prefix
+// that covers it, so 127.0.0.1 inside a user network is loopback and user.
+typedef enum {
+    SNBAddressClassUnspecified = 1 << 0,     // 0.0.0.0/8, ::/128
+    SNBAddressClassLoopback = 1 << 1,        // 127.0.0.0/8, ::1/128
+    SNBAddressClassPrivate = 1 << 2,         // RFC 1918
+    SNBAddressClassLinkLocal = 1 << 3,       // 169.254.0.0/16, fe80::/10
+    SNBAddressClassSharedAddress = 1 << 4,   // 100.64.0.0/10 carrier-grade NAT
+    SNBAddressClassUniqueLocal = 1 << 5,     // fc00::/7
+    SNBAddressClassMulticast = 1 << 6,       // 224.0.0.0/4, ff00::/8
+    SNBAddressClassDocumentation = 1 << 7,   // TEST-NET-1/2/3, 2001:db8::/32
+    SNBAddressClassReserved = 1 << 8,        // 240.0.0.0/4, including broadcast
+    SNBAddressClassUser = 1 << 9,            // Networks added from the configuration
+} SNBAddressClass;
+
+// Addresses that stay on this host or the local network. This is the set
+// the string helpers always treated as private, plus user networks.
+#define SNBAddressClassLocalMask (SNBAddressClassUnspecified | SNBAddressClassLoopback | \
+                                  SNBAddressClassPrivate | SNBAddressClassLinkLocal | \
+                                  SNBAddressClassUniqueLocal | SNBAddressClassUser)
+
+// One slot per value of the next address byte. A slot either ends the walk
+// with the classes of every prefix covering it, or points at the node for
+// the next byte; the classes of shorter prefixes are pushed down into it.
+typedef struct {
+    uint16_t classes;
+    uint16_t reserved;
+    uint32_t child;                  // Node index, 0 when the walk ends here
+} SNBAddressClassifierSlot;
+
+typedef struct {
+    SNBAddressClassifierSlot slots[256];
+} SNBAddressClassifierNode;
+
+// Multibit trie with an 8-bit stride: prefixes whose length is not a
+// multiple of 8 are expanded over the slots they cover, so a lookup is one
+// indexed load per address byte until the first slot without a child.
+// Typical addresses end at the first or second byte. Each prefix costs up
+// to one 2 KB node per whole byte it spans, so the table suits the default
+// ranges plus tens of user networks, not large lists. Nodes 0 and 1 are the
+// IPv4 and IPv6 roots, which is why child 0 can mean "none".
+//
+// Built once and then read-only; lookups on a built table need no locking.
+typedef struct {
+    SNBAddressClassifierNode *nodes;
+    uint32_t nodeCount;
+    uint32_t nodeCapacity;
+} SNBAddressClassifier;
+
+// Returns false on allocation failure
+bool SNBAddressClassifierInit(SNBAddressClassifier *classifier);
+void SNBAddressClassifierDestroy(SNBAddressClassifier *classifier);
+size_t SNBAddressClassifierMemoryBytes(const SNBAddressClassifier *classifier);
+
+// Adds the well-known ranges listed with SNBAddressClass
+bool SNBAddressClassifierAddDefaults(SNBAddressClassifier *classifier);
+
+// Marks address/prefixLength with classes. Bits past the prefix are ignored.
+// Returns false for a bad length or on allocation failure.
+bool SNBAddressClassifierAddPrefix(SNBAddressClassifier *classifier,
+                                   uint8_t family,
+                                   const uint8_t *address,
+                                   uint8_t prefixLength,
+                                   uint16_t classes);
+
+// Parses "192.168.10.0/24", "2001:db8::/32" or a bare address (a host
+// prefix) and adds it. Returns false, with a message in error, if the text
+// is not a valid CIDR.
+bool SNBAddressClassifierAddCIDR(SNBAddressClassifier *classifier,
+                                 const char *cidr,
+                                 uint16_t classes,
+                                 char *error,
+                                 size_t errorLength);
+
+static inline uint16_t SNBAddressClassifierLookup(const SNBAddressClassifier *classifier,
+                                                  uint8_t family,
+                                                  const uint8_t *address) {
+    size_t length = family == SNBAddressFamilyIPv6 ? 16 : 4;
+    const SNBAddressClassifierNode *node = &classifier->nodes[family == SNBAddressFamilyIPv6 ? 1 : 0];
+    for (size_t i = 0; i < length; i++) {
+        const SNBAddressClassifierSlot *slot = &node->slots[address[i]];
+        if (slot->child == 0) {
+            return slot->classes;
+        }
+        node = &classifier->nodes[slot->child];
+    }
+    return 0;
+}
+
+// Classes of a binary address. IPv4-mapped IPv6 addresses (::ffff:a.b.c.d)
+// are classified by their IPv4 part.
+static inline uint16_t SNBAddressClassify(const SNBAddressClassifier *classifier,
+                                          uint8_t family,
+                                          const uint8_t *address) {
+    if (family == SNBAddressFamilyIPv4) {
+        return SNBAddressClassifierLookup(classifier, family, address);
+    }
+    if (family != SNBAddressFamilyIPv6) {
+        return 0;
+    }
+    static const uint8_t mappedPrefix[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+    if (address[0] == 0 && memcmp(address, mappedPrefix, sizeof(mappedPrefix)) == 0) {
+        return SNBAddressClassifierLookup(classifier, SNBAddressFamilyIPv4, address + 12);
+    }
+    return SNBAddressClassifierLookup(classifier, family, address);
+}
+
+// MARK: - Shared table
+
+// The table every caller classifies against: the defaults until a table with
+// user networks is published. Never NULL; safe to call from any thread.
+const SNBAddressClassifier *SNBAddressClassifierShared(void);
+
+// Moves a built classifier into the shared slot, leaving classifier empty.
+// The table it replaces is kept alive, since a reader on another thread may
+// still be walking it; user networks change only when the configuration is
+// edited, so at most a few tables ever pile up. Returns false, leaving
+// classifier untouched, on allocation failure.
+bool SNBAddressClassifierPublish(SNBAddressClassifier *classifier);
+
+#endif
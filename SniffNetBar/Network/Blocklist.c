@@ -0,0 +1,728 @@
+//
+//  Blocklist.c
+//  SniffNetBar
+//
+//  Offline IOC blocklists compiled into sorted address intervals
+//
+
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+
+#include "Blocklist.h"
+#include "PacketDirection.h"
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SNB_BLOCKLIST_VERSION 1
+static const char kBlocklistMagic[8] = {'S', 'N', 'B', 'B', 'L', 'K', '\0', '\0'};
+
+// First bytes of a compiled file and of every in-memory table
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t listCount;
+    uint32_t ipv4Count;
+    uint32_t ipv6Count;
+    uint64_t prefixCount;
+    uint64_t sourceSignature;
+    uint64_t storageSize;
+    uint8_t reserved[16];
+} SNBBlocklistHeader;
+
+_Static_assert(sizeof(SNBBlocklistHeader) == 64, "SNBBlocklistHeader must stay 64 bytes");
+
+// Byte offsets of the arrays behind the header, 8-byte aligned
+typedef struct {
+    size_t names;
+    size_t ipv4Index;
+    size_t ipv4Starts;
+    size_t ipv4Ends;
+    size_t ipv4Lists;
+    size_t ipv6Starts;
+    size_t ipv6Ends;
+    size_t ipv6Lists;
+    size_t total;
+} SNBBlocklistLayout;
+
+static size_t SNBBlocklistAlign(size_t offset) {
+    return (offset + 7) & ~(size_t)7;
+}
+
+static void SNBBlocklistLayoutMake(SNBBlocklistLayout *layout, uint32_t listCount, uint32_t ipv4Count, uint32_t ipv6Count) {
+    layout->names = sizeof(SNBBlocklistHeader);
+    layout->ipv4Index = SNBBlocklistAlign(layout->names + (size_t)listCount * SNB_BLOCKLIST_NAME_LENGTH);
+    layout->ipv4Starts = SNBBlocklistAlign(layout->ipv4Index + SNB_BLOCKLIST_IPV4_INDEX_COUNT * sizeof(uint32_t));
+    layout->ipv4Ends = layout->ipv4Starts + (size_t)ipv4Count * sizeof(uint32_t);
+    layout->ipv4Lists = layout->ipv4Ends + (size_t)ipv4Count * sizeof(uint32_t);
+    layout->ipv6Starts = SNBBlocklistAlign(layout->ipv4Lists + (size_t)ipv4Count * sizeof(uint32_t));
+    layout->ipv6Ends = layout->ipv6Starts + (size_t)ipv6Count * sizeof(SNBBlocklistIPv6);
+    layout->ipv6Lists = layout->ipv6Ends + (size_t)ipv6Count * sizeof(SNBBlocklistIPv6);
+    layout->total = SNBBlocklistAlign(layout->ipv6Lists + (size_t)ipv6Count * sizeof(uint32_t));
+}
+
+// Points the table's arrays into storage after checking the header. The
+// index is checked to be ordered and to end at the interval count, so a
+// damaged file cannot send a lookup outside the arrays.
+static bool SNBBlocklistAttach(SNBBlocklist *blocklist, void *storage, size_t storageSize) {
+    if (storageSize < sizeof(SNBBlocklistHeader)) {
+        return false;
+    }
+    const SNBBlocklistHeader *header = storage;
+    if (memcmp(header->magic, kBlocklistMagic, sizeof(kBlocklistMagic)) != 0 ||
+        header->version != SNB_BLOCKLIST_VERSION ||
+        header->listCount > SNB_BLOCKLIST_MAX_LISTS ||
+        header->storageSize != storageSize) {
+        return false;
+    }
+    SNBBlocklistLayout layout;
+    SNBBlocklistLayoutMake(&layout, header->listCount, header->ipv4Count, header->ipv6Count);
+    if (layout.total != storageSize) {
+        return false;
+    }
+
+    uint8_t *base = storage;
+    const uint32_t *index = (const uint32_t *)(base + layout.ipv4Index);
+    if (index[0] != 0 || index[SNB_BLOCKLIST_IPV4_INDEX_COUNT - 1] != header->ipv4Count) {
+        return false;
+    }
+    for (size_t slot = 1; slot < SNB_BLOCKLIST_IPV4_INDEX_COUNT; slot++) {
+        if (index[slot] < index[slot - 1]) {
+            return false;
+        }
+    }
+    const char (*names)[SNB_BLOCKLIST_NAME_LENGTH] = (const char (*)[SNB_BLOCKLIST_NAME_LENGTH])(base + layout.names);
+    for (uint32_t list = 0; list < header->listCount; list++) {
+        if (names[list][SNB_BLOCKLIST_NAME_LENGTH - 1] != '\0') {
+            return false;
+        }
+    }
+
+    blocklist->ipv4Index = index;
+    blocklist->ipv4Starts = (const uint32_t *)(base + layout.ipv4Starts);
+    blocklist->ipv4Ends = (const uint32_t *)(base + layout.ipv4Ends);
+    blocklist->ipv4Lists = (const uint32_t *)(base + layout.ipv4Lists);
+    blocklist->ipv6Starts = (const SNBBlocklistIPv6 *)(base + layout.ipv6Starts);
+    blocklist->ipv6Ends = (const SNBBlocklistIPv6 *)(base + layout.ipv6Ends);
+    blocklist->ipv6Lists = (const uint32_t *)(base + layout.ipv6Lists);
+    blocklist->listNames = names;
+    blocklist->ipv4Count = header->ipv4Count;
+    blocklist->ipv6Count = header->ipv6Count;
+    blocklist->listCount = header->listCount;
+    blocklist->prefixCount = header->prefixCount;
+    blocklist->sourceSignature = header->sourceSignature;
+    blocklist->storage = storage;
+    blocklist->storageSize = storageSize;
+    return true;
+}
+
+// MARK: - Building
+
+// A prefix becomes two events: its lists start covering addresses at its
+// first address and stop right after its last. IPv4 events pack into one
+// integer, boundary << 6 | start << 5 | list, so they sort as plain numbers;
+// the boundary after 255.255.255.255 is 2^32 and still fits.
+#define SNB_BLOCKLIST_EVENT_START 0x20u
+#define SNB_BLOCKLIST_EVENT_LIST_MASK 0x1fu
+
+typedef struct {
+    SNBBlocklistIPv6 boundary;
+    uint8_t tag;                     // SNB_BLOCKLIST_EVENT_START | list
+} SNBBlocklistIPv6Event;
+
+struct SNBBlocklistBuilder {
+    uint64_t *ipv4Events;
+    size_t ipv4EventCount;
+    size_t ipv4EventCapacity;
+    SNBBlocklistIPv6Event *ipv6Events;
+    size_t ipv6EventCount;
+    size_t ipv6EventCapacity;
+    char names[SNB_BLOCKLIST_MAX_LISTS][SNB_BLOCKLIST_NAME_LENGTH];
+    uint32_t listCount;
+    uint64_t prefixCount;
+};
+
+SNBBlocklistBuilder *SNBBlocklistBuilderCreate(void) {
+    return calloc(1, sizeof(SNBBlocklistBuilder));
+}
+
+void SNBBlocklistBuilderDestroy(SNBBlocklistBuilder *builder) {
+    if (!builder) {
+        return;
+    }
+    free(builder->ipv4Events);
+    free(builder->ipv6Events);
+    free(builder);
+}
+
+int SNBBlocklistBuilderAddList(SNBBlocklistBuilder *builder, const char *name) {
+    if (builder->listCount >= SNB_BLOCKLIST_MAX_LISTS) {
+        return -1;
+    }
+    snprintf(builder->names[builder->listCount], SNB_BLOCKLIST_NAME_LENGTH, "%s", name ? name : "");
+    return (int)builder->listCount++;
+}
+
+static bool SNBBlocklistReserve(void **items, size_t *capacity, size_t needed, size_t itemSize) {
+    if (needed <= *capacity) {
+        return true;
+    }
+    size_t grown = *capacity ? *capacity * 2 : 1024;
+    while (grown < needed) {
+        grown *= 2;
+    }
+    void *resized = realloc(*items, grown * itemSize);
+    if (!resized) {
+        return false;
+    }
+    *items = resized;
+    *capacity = grown;
+    return true;
+}
+
+static bool SNBBlocklistAddIPv4(SNBBlocklistBuilder *builder, unsigned list, uint32_t address, unsigned prefixLength) {
+    if (!SNBBlocklistReserve((void **)&builder->ipv4Events, &builder->ipv4EventCapacity,
+                             builder->ipv4EventCount + 2, sizeof(uint64_t))) {
+        return false;
+    }
+    uint32_t mask = prefixLength == 0 ? 0 : ~(uint32_t)0 << (32 - prefixLength);
+    uint64_t start = address & mask;
+    uint64_t end = (uint64_t)(address | ~mask) + 1;
+    builder->ipv4Events[builder->ipv4EventCount++] = start << 6 | SNB_BLOCKLIST_EVENT_START | list;
+    builder->ipv4Events[builder->ipv4EventCount++] = end << 6 | list;
+    return true;
+}
+
+static bool SNBBlocklistAddIPv6(SNBBlocklistBuilder *builder, unsigned list, SNBBlocklistIPv6 address, unsigned prefixLength) {
+    if (!SNBBlocklistReserve((void **)&builder->ipv6Events, &builder->ipv6EventCapacity,
+                             builder->ipv6EventCount + 2, sizeof(SNBBlocklistIPv6Event))) {
+        return false;
+    }
+    uint64_t highMask = prefixLength == 0 ? 0 : (prefixLength >= 64 ? ~(uint64_t)0 : ~(uint64_t)0 << (64 - prefixLength));
+    uint64_t lowMask = prefixLength <= 64 ? 0 : (prefixLength == 128 ? ~(uint64_t)0 : ~(uint64_t)0 << (128 - prefixLength));
+    SNBBlocklistIPv6 start = {address.high & highMask, address.low & lowMask};
+    SNBBlocklistIPv6 end = {address.high | ~highMask, address.low | ~lowMask};
+    builder->ipv6Events[builder->ipv6EventCount++] = (SNBBlocklistIPv6Event){start, (uint8_t)(SNB_BLOCKLIST_EVENT_START | list)};
+    // A prefix reaching the last address never stops covering
+    if (end.high == UINT64_MAX && end.low == UINT64_MAX) {
+        return true;
+    }
+    end.low++;
+    if (end.low == 0) {
+        end.high++;
+    }
+    builder->ipv6Events[builder->ipv6EventCount++] = (SNBBlocklistIPv6Event){end, (uint8_t)list};
+    return true;
+}
+
+bool SNBBlocklistBuilderAddPrefix(SNBBlocklistBuilder *builder,
+                                  int list,
+                                  uint8_t family,
+                                  const uint8_t *address,
+                                  uint8_t prefixLength) {
+    if (list < 0 || (uint32_t)list >= builder->listCount) {
+        return false;
+    }
+    bool added;
+    if (family == SNBAddressFamilyIPv4) {
+        if (prefixLength > 32) {
+            return false;
+        }
+        uint32_t value = ((uint32_t)address[0] << 24) | ((uint32_t)address[1] << 16) |
+                         ((uint32_t)address[2] << 8) | address[3];
+        added = SNBBlocklistAddIPv4(builder, (unsigned)list, value, prefixLength);
+    } else if (family == SNBAddressFamilyIPv6) {
+        if (prefixLength > 128) {
+            return false;
+        }
+        added = SNBBlocklistAddIPv6(builder, (unsigned)list, SNBBlocklistIPv6FromBytes(address), prefixLength);
+    } else {
+        return false;
+    }
+    if (added) {
+        builder->prefixCount++;
+    }
+    return added;
+}
+
+// Dotted quad without inet_pton, which dominates loading a large list
+static bool SNBBlocklistParseIPv4(const char *text, size_t length, uint8_t *address) {
+    size_t position = 0;
+    for (int part = 0; part < 4; part++) {
+        if (part > 0) {
+            if (position >= length || text[position] != '.') {
+                return false;
+            }
+            position++;
+        }
+        unsigned value = 0;
+        size_t digits = 0;
+        while (position < length && text[position] >= '0' && text[position] <= '9' && digits < 3) {
+            value = value * 10 + (unsigned)(text[position] - '0');
+            position++;
+            digits++;
+        }
+        if (digits == 0 || value > 255) {
+            return false;
+        }
+        address[part] = (uint8_t)value;
+    }
+    return position == length;
+}
+
+// One CIDR or bare address, not NUL-terminated
+static bool SNBBlocklistParseEntry(const char *token, size_t length, uint8_t *family, uint8_t *address, unsigned *prefixLength) {
+    const char *slash = memchr(token, '/', length);
+    size_t addressLength = slash ? (size_t)(slash - token) : length;
+    unsigned maxLength;
+    if (SNBBlocklistParseIPv4(token, addressLength, address)) {
+        *family = SNBAddressFamilyIPv4;
+        maxLength = 32;
+    } else {
+        char text[INET6_ADDRSTRLEN];
+        if (addressLength == 0 || addressLength >= sizeof(text)) {
+            return false;
+        }
+        memcpy(text, token, addressLength);
+        text[addressLength] = '\0';
+        if (inet_pton(AF_INET6, text, address) != 1) {
+            return false;
+        }
+        *family = SNBAddressFamilyIPv6;
+        maxLength = 128;
+    }
+
+    *prefixLength = maxLength;
+    if (slash) {
+        const char *digit = slash + 1;
+        const char *end = token + length;
+        if (digit == end || end - digit > 3) {
+            return false;
+        }
+        unsigned value = 0;
+        for (; digit < end; digit++) {
+            if (*digit < '0' || *digit > '9') {
+                return false;
+            }
+            value = value * 10 + (unsigned)(*digit - '0');
+        }
+        if (value > maxLength) {
+            return false;
+        }
+        *prefixLength = value;
+    }
+    return true;
+}
+
+size_t SNBBlocklistBuilderAddText(SNBBlocklistBuilder *builder,
+                                  int list,
+                                  const char *text,
+                                  size_t length,
+                                  size_t *rejected) {
+    size_t added = 0;
+    size_t bad = 0;
+    size_t position = 0;
+    while (position < length) {
+        const char *newline = memchr(text + position, '\n', length - position);
+        size_t lineEnd = newline ? (size_t)(newline - text) : length;
+
+        while (position < lineEnd && (text[position] == ' ' || text[position] == '\t')) {
+            position++;
+        }
+        size_t tokenEnd = position;
+        while (tokenEnd < lineEnd && text[tokenEnd] != ' ' && text[tokenEnd] != '\t' && text[tokenEnd] != '\r' &&
+               text[tokenEnd] != ';' && text[tokenEnd] != ',' && text[tokenEnd] != '#') {
+            tokenEnd++;
+        }
+        if (tokenEnd > position) {
+            uint8_t family = SNBAddressFamilyNone;
+            uint8_t address[16] = {0};
+            unsigned prefixLength = 0;
+            if (SNBBlocklistParseEntry(text + position, tokenEnd - position, &family, address, &prefixLength) &&
+                SNBBlocklistBuilderAddPrefix(builder, list, family, address, (uint8_t)prefixLength)) {
+                added++;
+            } else {
+                bad++;
+            }
+        }
+        position = lineEnd + 1;
+    }
+    if (rejected) {
+        *rejected = bad;
+    }
+    return added;
+}
+
+bool SNBBlocklistBuilderAddFile(SNBBlocklistBuilder *builder,
+                                int list,
+                                const char *path,
+                                size_t *added,
+                                size_t *rejected) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+        close(fd);
+        return false;
+    }
+    size_t length = (size_t)info.st_size;
+    size_t count = 0;
+    size_t bad = 0;
+    if (length > 0) {
+        void *text = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (text == MAP_FAILED) {
+            close(fd);
+            return false;
+        }
+        count = SNBBlocklistBuilderAddText(builder, list, text, length, &bad);
+        munmap(text, length);
+    }
+    close(fd);
+    if (added) {
+        *added = count;
+    }
+    if (rejected) {
+        *rejected = bad;
+    }
+    return true;
+}
+
+// LSD radix sort on the 39 significant bits of the packed events, a byte per
+// pass. A million prefixes sort several times faster than with qsort.
+static bool SNBBlocklistSortIPv4Events(uint64_t *events, size_t count) {
+    if (count == 0) {
+        return true;
+    }
+    uint64_t *scratch = malloc(count * sizeof(uint64_t));
+    if (!scratch) {
+        return false;
+    }
+    uint64_t *source = events;
+    uint64_t *target = scratch;
+    for (unsigned shift = 0; shift < 40; shift += 8) {
+        size_t offsets[256] = {0};
+        for (size_t i = 0; i < count; i++) {
+            offsets[(source[i] >> shift) & 0xff]++;
+        }
+        size_t total = 0;
+        for (int bucket = 0; bucket < 256; bucket++) {
+            size_t bucketCount = offsets[bucket];
+            offsets[bucket] = total;
+            total += bucketCount;
+        }
+        for (size_t i = 0; i < count; i++) {
+            target[offsets[(source[i] >> shift) & 0xff]++] = source[i];
+        }
+        uint64_t *swap = source;
+        source = target;
+        target = swap;
+    }
+    // An odd number of passes leaves the result in scratch
+    if (source != events) {
+        memcpy(events, source, count * sizeof(uint64_t));
+    }
+    free(scratch);
+    return true;
+}
+
+static int SNBBlocklistCompareIPv6Events(const void *lhs, const void *rhs) {
+    return SNBBlocklistCompareIPv6(((const SNBBlocklistIPv6Event *)lhs)->boundary,
+                                   ((const SNBBlocklistIPv6Event *)rhs)->boundary);
+}
+
+// Receives the swept intervals. With NULL arrays it only counts, which sizes
+// the table before the second sweep fills it.
+typedef struct {
+    uint32_t *starts;
+    uint32_t *ends;
+    uint32_t *lists;
+    uint32_t count;
+} SNBBlocklistIPv4Sink;
+
+typedef struct {
+    SNBBlocklistIPv6 *starts;
+    SNBBlocklistIPv6 *ends;
+    uint32_t *lists;
+    uint32_t count;
+    SNBBlocklistIPv6 lastEnd;
+    uint32_t lastLists;
+} SNBBlocklistIPv6Sink;
+
+static void SNBBlocklistEmitIPv4(SNBBlocklistIPv4Sink *sink, uint32_t *lastEnd, uint32_t *lastLists,
+                                 uint32_t start, uint32_t end, uint32_t lists) {
+    if (sink->count > 0 && *lastLists == lists && *lastEnd + 1 == start) {
+        if (sink->ends) {
+            sink->ends[sink->count - 1] = end;
+        }
+    } else {
+        if (sink->starts) {
+            sink->starts[sink->count] = start;
+            sink->ends[sink->count] = end;
+            sink->lists[sink->count] = lists;
+        }
+        sink->count++;
+    }
+    *lastEnd = end;
+    *lastLists = lists;
+}
+
+// Walks the sorted events keeping a per-list coverage count, and emits the
+// lists covering each stretch between two consecutive boundaries
+static void SNBBlocklistSweepIPv4(const uint64_t *events, size_t count, SNBBlocklistIPv4Sink *sink) {
+    uint32_t coverage[SNB_BLOCKLIST_MAX_LISTS] = {0};
+    uint32_t lists = 0;
+    uint64_t segmentStart = 0;
+    uint32_t lastEnd = 0;
+    uint32_t lastLists = 0;
+    size_t i = 0;
+    while (i < count) {
+        uint64_t boundary = events[i] >> 6;
+        if (lists != 0 && boundary > segmentStart) {
+            SNBBlocklistEmitIPv4(sink, &lastEnd, &lastLists, (uint32_t)segmentStart, (uint32_t)(boundary - 1), lists);
+        }
+        for (; i < count && (events[i] >> 6) == boundary; i++) {
+            unsigned list = events[i] & SNB_BLOCKLIST_EVENT_LIST_MASK;
+            if (events[i] & SNB_BLOCKLIST_EVENT_START) {
+                if (coverage[list]++ == 0) {
+                    lists |= 1u << list;
+                }
+            } else if (--coverage[list] == 0) {
+                lists &= ~(1u << list);
+            }
+        }
+        segmentStart = boundary;
+    }
+}
+
+static void SNBBlocklistEmitIPv6(SNBBlocklistIPv6Sink *sink, SNBBlocklistIPv6 start, SNBBlocklistIPv6 end, uint32_t lists) {
+    SNBBlocklistIPv6 next = sink->lastEnd;
+    next.low++;
+    if (next.low == 0) {
+        next.high++;
+    }
+    if (sink->count > 0 && sink->lastLists == lists && SNBBlocklistCompareIPv6(next, start) == 0) {
+        if (sink->ends) {
+            sink->ends[sink->count - 1] = end;
+        }
+    } else {
+        if (sink->starts) {
+            sink->starts[sink->count] = start;
+            sink->ends[sink->count] = end;
+            sink->lists[sink->count] = lists;
+        }
+        sink->count++;
+    }
+    sink->lastEnd = end;
+    sink->lastLists = lists;
+}
+
+static void SNBBlocklistSweepIPv6(const SNBBlocklistIPv6Event *events, size_t count, SNBBlocklistIPv6Sink *sink) {
+    uint32_t coverage[SNB_BLOCKLIST_MAX_LISTS] = {0};
+    uint32_t lists = 0;
+    SNBBlocklistIPv6 segmentStart = {0, 0};
+    size_t i = 0;
+    while (i < count) {
+        SNBBlocklistIPv6 boundary = events[i].boundary;
+        if (lists != 0 && SNBBlocklistCompareIPv6(boundary, segmentStart) > 0) {
+            SNBBlocklistIPv6 end = boundary;
+            if (end.low == 0) {
+                end.high--;
+            }
+            end.low--;
+            SNBBlocklistEmitIPv6(sink, segmentStart, end, lists);
+        }
+        for (; i < count && SNBBlocklistCompareIPv6(events[i].boundary, boundary) == 0; i++) {
+            unsigned list = events[i].tag & SNB_BLOCKLIST_EVENT_LIST_MASK;
+            if (events[i].tag & SNB_BLOCKLIST_EVENT_START) {
+                if (coverage[list]++ == 0) {
+                    lists |= 1u << list;
+                }
+            } else if (--coverage[list] == 0) {
+                lists &= ~(1u << list);
+            }
+        }
+        segmentStart = boundary;
+    }
+    // Prefixes reaching the last address have no end event
+    if (lists != 0) {
+        SNBBlocklistEmitIPv6(sink, segmentStart, (SNBBlocklistIPv6){UINT64_MAX, UINT64_MAX}, lists);
+    }
+}
+
+SNBBlocklist *SNBBlocklistBuilderCompile(SNBBlocklistBuilder *builder, uint64_t sourceSignature) {
+    if (!SNBBlocklistSortIPv4Events(builder->ipv4Events, builder->ipv4EventCount)) {
+        return NULL;
+    }
+    if (builder->ipv6EventCount > 0) {
+        qsort(builder->ipv6Events, builder->ipv6EventCount, sizeof(SNBBlocklistIPv6Event), SNBBlocklistCompareIPv6Events);
+    }
+
+    SNBBlocklistIPv4Sink ipv4 = {0};
+    SNBBlocklistIPv6Sink ipv6 = {0};
+    SNBBlocklistSweepIPv4(builder->ipv4Events, builder->ipv4EventCount, &ipv4);
+    SNBBlocklistSweepIPv6(builder->ipv6Events, builder->ipv6EventCount, &ipv6);
+
+    SNBBlocklistLayout layout;
+    SNBBlocklistLayoutMake(&layout, builder->listCount, ipv4.count, ipv6.count);
+    SNBBlocklist *blocklist = calloc(1, sizeof(SNBBlocklist));
+    uint8_t *storage = calloc(1, layout.total);
+    if (!blocklist || !storage) {
+        free(blocklist);
+        free(storage);
+        return NULL;
+    }
+
+    SNBBlocklistHeader *header = (SNBBlocklistHeader *)storage;
+    memcpy(header->magic, kBlocklistMagic, sizeof(kBlocklistMagic));
+    header->version = SNB_BLOCKLIST_VERSION;
+    header->listCount = builder->listCount;
+    header->ipv4Count = ipv4.count;
+    header->ipv6Count = ipv6.count;
+    header->prefixCount = builder->prefixCount;
+    header->sourceSignature = sourceSignature;
+    header->storageSize = layout.total;
+    memcpy(storage + layout.names, builder->names, (size_t)builder->listCount * SNB_BLOCKLIST_NAME_LENGTH);
+
+    ipv4 = (SNBBlocklistIPv4Sink){(uint32_t *)(storage + layout.ipv4Starts),
+                                  (uint32_t *)(storage + layout.ipv4Ends),
+                                  (uint32_t *)(storage + layout.ipv4Lists), 0};
+    ipv6 = (SNBBlocklistIPv6Sink){(SNBBlocklistIPv6 *)(storage + layout.ipv6Starts),
+                                  (SNBBlocklistIPv6 *)(storage + layout.ipv6Ends),
+                                  (uint32_t *)(storage + layout.ipv6Lists), 0, {0, 0}, 0};
+    SNBBlocklistSweepIPv4(builder->ipv4Events, builder->ipv4EventCount, &ipv4);
+    SNBBlocklistSweepIPv6(builder->ipv6Events, builder->ipv6EventCount, &ipv6);
+
+    uint32_t *index = (uint32_t *)(storage + layout.ipv4Index);
+    uint32_t interval = 0;
+    for (uint64_t slot = 0; slot < SNB_BLOCKLIST_IPV4_INDEX_COUNT; slot++) {
+        while (interval < ipv4.count && ipv4.starts[interval] < (slot << 16)) {
+            interval++;
+        }
+        index[slot] = interval;
+    }
+
+    if (!SNBBlocklistAttach(blocklist, storage, layout.total)) {
+        free(blocklist);
+        free(storage);
+        return NULL;
+    }
+    return blocklist;
+}
+
+// MARK: - Compiled files
+
+uint64_t SNBBlocklistSignatureAddFile(uint64_t signature, const char *path) {
+    struct stat info;
+    if (stat(path, &info) != 0) {
+        return signature;
+    }
+    // FNV-1a over the path, then the size and modification time
+    uint64_t fields[2] = {(uint64_t)info.st_size, (uint64_t)info.st_mtime};
+    for (const char *c = path; *c; c++) {
+        signature = (signature ^ (uint8_t)*c) * 0x100000001b3ULL;
+    }
+    const uint8_t *bytes = (const uint8_t *)fields;
+    for (size_t i = 0; i < sizeof(fields); i++) {
+        signature = (signature ^ bytes[i]) * 0x100000001b3ULL;
+    }
+    return signature;
+}
+
+bool SNBBlocklistWrite(const SNBBlocklist *blocklist, const char *path) {
+    char temporaryPath[1024];
+    if (snprintf(temporaryPath, sizeof(temporaryPath), "%s.partial", path) >= (int)sizeof(temporaryPath)) {
+        return false;
+    }
+    FILE *file = fopen(temporaryPath, "wb");
+    if (!file) {
+        return false;
+    }
+    bool written = fwrite(blocklist->storage, 1, blocklist->storageSize, file) == blocklist->storageSize;
+    written = fclose(file) == 0 && written;
+    if (!written || rename(temporaryPath, path) != 0) {
+        unlink(temporaryPath);
+        return false;
+    }
+    return true;
+}
+
+SNBBlocklist *SNBBlocklistMap(const char *path, uint64_t sourceSignature) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(SNBBlocklistHeader)) {
+        close(fd);
+        return NULL;
+    }
+    size_t size = (size_t)info.st_size;
+    void *storage = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (storage == MAP_FAILED) {
+        return NULL;
+    }
+    SNBBlocklist *blocklist = calloc(1, sizeof(SNBBlocklist));
+    if (!blocklist || !SNBBlocklistAttach(blocklist, storage, size) || blocklist->sourceSignature != sourceSignature) {
+        free(blocklist);
+        munmap(storage, size);
+        return NULL;
+    }
+    blocklist->mapped = true;
+    return blocklist;
+}
+
+void SNBBlocklistDestroy(SNBBlocklist *blocklist) {
+    if (!blocklist) {
+        return;
+    }
+    if (blocklist->mapped) {
+        munmap(blocklist->storage, blocklist->storageSize);
+    } else {
+        free(blocklist->storage);
+    }
+    free(blocklist);
+}
+
+size_t SNBBlocklistMemoryBytes(const SNBBlocklist *blocklist) {
+    return sizeof(*blocklist) + blocklist->storageSize;
+}
+
+// MARK: - Lookup
+
+size_t SNBPacketRecordsMatchBlocklist(const SNBBlocklist *blocklist, SNBPacketRecord *records, size_t count) {
+    size_t matches = 0;
+    for (size_t i = 0; i < count; i++) {
+        SNBPacketRecord *record = &records[i];
+        record->flags &= (uint8_t)~SNBPacketRecordFlagBlocklisted;
+        if (!blocklist || record->family == SNBAddressFamilyNone) {
+            continue;
+        }
+        if (SNBBlocklistLookup(blocklist, record->family, SNBPacketRecordRemoteAddress(record)) != 0) {
+            record->flags |= SNBPacketRecordFlagBlocklisted;
+            matches++;
+        }
+    }
+    return matches;
+}
+
+// MARK: - Shared table
+
+static _Atomic(SNBBlocklist *) SNBBlocklistCurrent;
+
+const SNBBlocklist *SNBBlocklistShared(void) {
+    return atomic_load_explicit(&SNBBlocklistCurrent, memory_order_acquire);
+}
+
+SNBBlocklist *SNBBlocklistPublish(SNBBlocklist *blocklist) {
+    return atomic_exchange_explicit(&SNBBlocklistCurrent, blocklist, memory_order_acq_rel);
+}
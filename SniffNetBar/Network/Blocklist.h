@@ -0,0 +1,218 @@
+//
+//  Blocklist.h
+//  SniffNetBar
+//
+//  Offline IOC blocklists compiled into sorted address intervals
+//
+
+#ifndef SNB_BLOCKLIST_H
+#define SNB_BLOCKLIST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "PacketRecord.h"
+
+// Source lists a table can tell apart; a match reports one bit per list
+#define SNB_BLOCKLIST_MAX_LISTS 32
+#define SNB_BLOCKLIST_NAME_LENGTH 64
+// Entries of the IPv4 first-level index, one per /16 plus the end
+#define SNB_BLOCKLIST_IPV4_INDEX_COUNT 65537
+
+typedef struct {
+    uint64_t high;                   // First 8 address bytes, big-endian value
+    uint64_t low;
+} SNBBlocklistIPv6;
+
+// Every prefix of every list is flattened into disjoint address intervals,
+// each carrying the bit of every list that covers it, so nested and
+// overlapping prefixes cost nothing at lookup time. Adjacent intervals with
+// the same lists are merged, which folds most of a FireHOL-style list back
+// into a fraction of its lines.
+//
+// IPv4 lookups index the interval arrays by the top 16 bits of the address
+// and binary search only the intervals starting inside that /16: at most a
+// few probes for a million prefixes, against 12 bytes per interval and a
+// fixed 256 KB index. IPv6 lists are short in practice and are searched
+// whole.
+//
+// The arrays live in one buffer laid out exactly like the compiled file
+// (see SNBBlocklistWrite), so a table is either built in memory or mapped
+// read-only from disk with nothing to parse. Read-only once built; lookups
+// need no locking.
+typedef struct {
+    const uint32_t *ipv4Index;       // SNB_BLOCKLIST_IPV4_INDEX_COUNT entries: first interval starting at or after each /16
+    const uint32_t *ipv4Starts;
+    const uint32_t *ipv4Ends;        // Inclusive
+    const uint32_t *ipv4Lists;       // Bit per source list
+    const SNBBlocklistIPv6 *ipv6Starts;
+    const SNBBlocklistIPv6 *ipv6Ends;
+    const uint32_t *ipv6Lists;
+    const char (*listNames)[SNB_BLOCKLIST_NAME_LENGTH];
+    uint32_t ipv4Count;
+    uint32_t ipv6Count;
+    uint32_t listCount;
+    uint64_t prefixCount;            // Entries read from the sources
+    uint64_t sourceSignature;        // See SNBBlocklistSignatureAddFile
+    void *storage;
+    size_t storageSize;
+    bool mapped;
+} SNBBlocklist;
+
+// MARK: - Building
+
+typedef struct SNBBlocklistBuilder SNBBlocklistBuilder;
+
+SNBBlocklistBuilder *SNBBlocklistBuilderCreate(void);
+void SNBBlocklistBuilderDestroy(SNBBlocklistBuilder *builder);
+
+// Registers a source list and returns its index, or -1 once
+// SNB_BLOCKLIST_MAX_LISTS lists were added. Longer names are truncated.
+int SNBBlocklistBuilderAddList(SNBBlocklistBuilder *builder, const char *name);
+
+// Adds address/prefixLength to list. Bits past the prefix are ignored.
+// Returns false for a bad list, family or length, or on allocation failure.
+bool SNBBlocklistBuilderAddPrefix(SNBBlocklistBuilder *builder,
+                                  int list,
+                                  uint8_t family,
+                                  const uint8_t *address,
+                                  uint8_t prefixLength);
+
+// Parses list text: one entry per line, either a CIDR or a bare address.
+// Anything after the first token is ignored, so Spamhaus DROP lines
+// ("1.10.16.0/20 ; SBL256894") and annotated IP lists load as they are;
+// lines starting with '#' or ';' are comments. Returns the entries added
+// and counts lines that hold a token but no valid entry in rejected.
+size_t SNBBlocklistBuilderAddText(SNBBlocklistBuilder *builder,
+                                  int list,
+                                  const char *text,
+                                  size_t length,
+                                  size_t *rejected);
+
+// Reads a list file with SNBBlocklistBuilderAddText. Returns false if the
+// file cannot be read.
+bool SNBBlocklistBuilderAddFile(SNBBlocklistBuilder *builder,
+                                int list,
+                                const char *path,
+                                size_t *added,
+                                size_t *rejected);
+
+// Flattens everything added into a table tagged with sourceSignature.
+// The builder can be destroyed afterwards. Returns NULL on allocation failure.
+SNBBlocklist *SNBBlocklistBuilderCompile(SNBBlocklistBuilder *builder, uint64_t sourceSignature);
+
+// MARK: - Compiled files
+
+// Folds a source file's path, size and modification time into signature.
+// Start from SNB_BLOCKLIST_SIGNATURE_SEED and add every source in order; a
+// compiled file is reused only while the signature matches. Returns the
+// signature unchanged when the file cannot be read.
+#define SNB_BLOCKLIST_SIGNATURE_SEED 0xcbf29ce484222325ULL
+uint64_t SNBBlocklistSignatureAddFile(uint64_t signature, const char *path);
+
+// Writes the table to path through a temporary file and a rename, so a
+// reader never maps a half-written file. The file is in host byte order; it
+// is a cache of the sources, not an interchange format.
+bool SNBBlocklistWrite(const SNBBlocklist *blocklist, const char *path);
+
+// Maps a file written by SNBBlocklistWrite read-only. Returns NULL if it is
+// missing, truncated, from another format version or built from sources
+// with another signature.
+SNBBlocklist *SNBBlocklistMap(const char *path, uint64_t sourceSignature);
+
+void SNBBlocklistDestroy(SNBBlocklist *blocklist);
+size_t SNBBlocklistMemoryBytes(const SNBBlocklist *blocklist);
+
+// MARK: - Lookup
+
+static inline uint32_t SNBBlocklistLookupIPv4(const SNBBlocklist *blocklist, uint32_t address) {
+    uint32_t slot = address >> 16;
+    uint32_t low = blocklist->ipv4Index[slot];
+    uint32_t high = blocklist->ipv4Index[slot + 1];
+    // The interval holding address is the last one starting at or before
+    // it, which is inside this /16 or the one spilling in from below
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (blocklist->ipv4Starts[middle] <= address) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    if (low == 0 || blocklist->ipv4Ends[low - 1] < address) {
+        return 0;
+    }
+    return blocklist->ipv4Lists[low - 1];
+}
+
+static inline int SNBBlocklistCompareIPv6(SNBBlocklistIPv6 lhs, SNBBlocklistIPv6 rhs) {
+    if (lhs.high != rhs.high) {
+        return lhs.high < rhs.high ? -1 : 1;
+    }
+    return lhs.low < rhs.low ? -1 : (lhs.low > rhs.low ? 1 : 0);
+}
+
+static inline SNBBlocklistIPv6 SNBBlocklistIPv6FromBytes(const uint8_t *address) {
+    SNBBlocklistIPv6 value = {0, 0};
+    for (int i = 0; i < 8; i++) {
+        value.high = (value.high << 8) | address[i];
+        value.low = (value.low << 8) | address[8 + i];
+    }
+    return value;
+}
+
+static inline uint32_t SNBBlocklistLookupIPv6(const SNBBlocklist *blocklist, SNBBlocklistIPv6 address) {
+    uint32_t low = 0;
+    uint32_t high = blocklist->ipv6Count;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (SNBBlocklistCompareIPv6(blocklist->ipv6Starts[middle], address) <= 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    if (low == 0 || SNBBlocklistCompareIPv6(blocklist->ipv6Ends[low - 1], address) < 0) {
+        return 0;
+    }
+    return blocklist->ipv6Lists[low - 1];
+}
+
+// Lists containing a binary address, one bit per list index; 0 when none
+// does. IPv4-mapped IPv6 addresses are looked up by their IPv4 part.
+static inline uint32_t SNBBlocklistLookup(const SNBBlocklist *blocklist, uint8_t family, const uint8_t *address) {
+    if (family == SNBAddressFamilyIPv4) {
+        uint32_t value = ((uint32_t)address[0] << 24) | ((uint32_t)address[1] << 16) |
+                         ((uint32_t)address[2] << 8) | address[3];
+        return SNBBlocklistLookupIPv4(blocklist, value);
+    }
+    if (family != SNBAddressFamilyIPv6) {
+        return 0;
+    }
+    static const uint8_t mappedPrefix[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+    if (address[0] == 0 && memcmp(address, mappedPrefix, sizeof(mappedPrefix)) == 0) {
+        return SNBBlocklistLookup(blocklist, SNBAddressFamilyIPv4, address + 12);
+    }
+    return SNBBlocklistLookupIPv6(blocklist, SNBBlocklistIPv6FromBytes(address));
+}
+
+// Sets SNBPacketRecordFlagBlocklisted on every record whose remote address
+// is listed and clears it on the rest. Runs after direction tagging, which
+// decides the remote side. A NULL table clears the flag everywhere. Returns
+// the records flagged.
+size_t SNBPacketRecordsMatchBlocklist(const SNBBlocklist *blocklist, SNBPacketRecord *records, size_t count);
+
+// MARK: - Shared table
+
+// The table the capture path and the blocklist provider read, or NULL until
+// one is published. Safe to call from any thread.
+const SNBBlocklist *SNBBlocklistShared(void);
+
+// Makes blocklist the shared table, or clears it with NULL, and returns the
+// table it replaced. Readers on other threads may still be walking the
+// returned table, so the caller destroys it only once they are done with
+// it, which for the capture path is the batch in flight.
+SNBBlocklist *SNBBlocklistPublish(SNBBlocklist *blocklist);
+
+#endif
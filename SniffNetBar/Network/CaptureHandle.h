@@ -0,0 +1,37 @@
+//
+//  CaptureHandle.h
+//  SniffNetBar
+//
+//  Opens live pcap handles with a snapshot length, kernel buffer size and
+//  BPF filter (SNBCaptureOptions)
+//
+
+#import <Foundation/Foundation.h>
+#import <pcap/pcap.h>
+
+@class SNBCaptureOptions;
+
+NS_ASSUME_NONNULL_BEGIN
+
+extern NSString * const SNBCaptureHandleErrorDomain;
+
+typedef NS_ENUM(NSInteger, SNBCaptureHandleError) {
+    SNBCaptureHandleErrorOpen = 1,      // pcap_create or pcap_activate failed
+    SNBCaptureHandleErrorFilter = 2     // The filter did not compile or could not be installed
+};
+
+// pcap_create/pcap_activate with the options' snapshot length and buffer
+// size, then the filter. The handle is non-blocking and not promiscuous.
+// Returns NULL and fills error on failure; the caller closes the handle.
+pcap_t * _Nullable SNBCaptureHandleOpen(NSString *deviceName,
+                                        SNBCaptureOptions *options,
+                                        NSError * _Nullable * _Nullable error);
+
+// Compiles filterExpression for the handle's link type and installs it in
+// the kernel, so packets it rejects are never copied to userspace. An empty
+// expression clears the filter. Works on offline handles too.
+BOOL SNBCaptureHandleSetFilter(pcap_t *handle,
+                               NSString * _Nullable filterExpression,
+                               NSError * _Nullable * _Nullable error);
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,113 @@
+//
+//  CaptureHandle.m
+//  SniffNetBar
+//
+//  Opens live pcap handles with a snapshot length, kernel buffer size and
+//  BPF filter (SNBCaptureOptions)
+//
+
+#import "CaptureHandle.h"
+#import "CaptureOptions.h"
+
+NSString * const SNBCaptureHandleErrorDomain = @"SNBCaptureHandle";
+
+static const int kCapturePromiscuousMode = 0;
+static const int kCaptureTimeoutMs = 500;
+
+static NSError *SNBCaptureHandleMakeError(SNBCaptureHandleError code, NSString *description) {
+    return [NSError errorWithDomain:SNBCaptureHandleErrorDomain
+                               code:code
+                           userInfo:@{NSLocalizedDescriptionKey: description}];
+}
+
+// pcap_activate reports generic failures through pcap_geterr and specific
+// ones (no such device, permission denied) only through the status code
+static NSString *SNBCaptureHandleActivateMessage(pcap_t *handle, int status) {
+    if (status == PCAP_ERROR || status == PCAP_WARNING) {
+        return [NSString stringWithUTF8String:pcap_geterr(handle)];
+    }
+    const char *detail = pcap_geterr(handle);
+    if (detail && detail[0] != '\0') {
+        return [NSString stringWithFormat:@"%s (%s)", pcap_statustostr(status), detail];
+    }
+    return [NSString stringWithUTF8String:pcap_statustostr(status)];
+}
+
+pcap_t *SNBCaptureHandleOpen(NSString *deviceName, SNBCaptureOptions *options, NSError **error) {
+    char errbuf[PCAP_ERRBUF_SIZE];
+    errbuf[0] = '\0';
+    pcap_t *handle = pcap_create(deviceName.UTF8String, errbuf);
+    if (!handle) {
+        if (error) {
+            *error = SNBCaptureHandleMakeError(SNBCaptureHandleErrorOpen, [NSString stringWithUTF8String:errbuf]);
+        }
+        return NULL;
+    }
+
+    // Settings only fail on an already activated handle
+    pcap_set_snaplen(handle, options.snapshotLength);
+    pcap_set_promisc(handle, kCapturePromiscuousMode);
+    pcap_set_timeout(handle, kCaptureTimeoutMs);
+    if (options.bufferSize > 0) {
+        pcap_set_buffer_size(handle, (int)options.bufferSize);
+    }
+
+    int status = pcap_activate(handle);
+    if (status < 0) {
+        if (error) {
+            *error = SNBCaptureHandleMakeError(SNBCaptureHandleErrorOpen,
+                                               SNBCaptureHandleActivateMessage(handle, status));
+        }
+        pcap_close(handle);
+        return NULL;
+    }
+    if (status > 0) {
+        NSLog(@"Capture on %@ activated with a warning: %@", deviceName,
+              SNBCaptureHandleActivateMessage(handle, status));
+    }
+
+    if (pcap_setnonblock(handle, 1, errbuf) == -1) {
+        NSLog(@"Failed to set non-blocking mode on %@: %s", deviceName, errbuf);
+    }
+
+    if (!SNBCaptureHandleSetFilter(handle, options.filterExpression, error)) {
+        pcap_close(handle);
+        return NULL;
+    }
+    return handle;
+}
+
+BOOL SNBCaptureHandleSetFilter(pcap_t *handle, NSString *filterExpression, NSError **error) {
+    if (filterExpression.length > kSNBCaptureMaxFilterLength) {
+        if (error) {
+            *error = SNBCaptureHandleMakeError(SNBCaptureHandleErrorFilter,
+                                               [NSString stringWithFormat:@"Capture filter longer than %lu characters",
+                                                (unsigned long)kSNBCaptureMaxFilterLength]);
+        }
+        return NO;
+    }
+
+    // An empty program accepts every packet, which also clears a previous filter
+    const char *expression = filterExpression.length > 0 ? filterExpression.UTF8String : "";
+    struct bpf_program program;
+    if (pcap_compile(handle, &program, expression, 1, PCAP_NETMASK_UNKNOWN) == -1) {
+        if (error) {
+            *error = SNBCaptureHandleMakeError(SNBCaptureHandleErrorFilter,
+                                               [NSString stringWithFormat:@"Invalid capture filter \"%@\": %s",
+                                                filterExpression, pcap_geterr(handle)]);
+        }
+        return NO;
+    }
+
+    int result = pcap_setfilter(handle, &program);
+    pcap_freecode(&program);
+    if (result == -1) {
+        if (error) {
+            *error = SNBCaptureHandleMakeError(SNBCaptureHandleErrorFilter,
+                                               [NSString stringWithFormat:@"Cannot install capture filter: %s",
+                                                pcap_geterr(handle)]);
+        }
+        return NO;
+    }
+    return YES;
+}
@@ -0,0 +1,310 @@
+//
+//  DNSMessage.c
+//  SniffNetBar
+//
+//  Minimal DNS wire format: query building and response parsing
+//
+
+#include "DNSMessage.h"
+#include <stdio.h>
+#include <string.h>
+#include "PacketRecord.h"
+
+// Compression pointers followed per name before it is treated as a loop
+#define SNB_DNS_MAX_POINTER_JUMPS 32
+
+static inline uint16_t SNBDNSRead16(const uint8_t *bytes) {
+    return (uint16_t)((bytes[0] << 8) | bytes[1]);
+}
+
+static inline uint32_t SNBDNSRead32(const uint8_t *bytes) {
+    return ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16) | ((uint32_t)bytes[2] << 8) | bytes[3];
+}
+
+static inline char SNBDNSLowercase(uint8_t c) {
+    if (c >= 'A' && c <= 'Z') {
+        return (char)(c - 'A' + 'a');
+    }
+    // A NUL inside a label would cut the presentation name short
+    return c == 0 ? '?' : (char)c;
+}
+
+// Reads the possibly compressed name at *offset into name and moves *offset
+// past the name's bytes at that position
+static bool SNBDNSReadName(const uint8_t *message, size_t length, size_t *offset, char *name) {
+    size_t position = *offset;
+    size_t nameLength = 0;
+    bool jumped = false;
+    unsigned jumps = 0;
+    for (;;) {
+        if (position >= length) {
+            return false;
+        }
+        uint8_t labelLength = message[position];
+        if ((labelLength & 0xc0) == 0xc0) {
+            if (position + 1 >= length) {
+                return false;
+            }
+            size_t pointer = ((size_t)(labelLength & 0x3f) << 8) | message[position + 1];
+            if (!jumped) {
+                *offset = position + 2;
+                jumped = true;
+            }
+            if (++jumps > SNB_DNS_MAX_POINTER_JUMPS || pointer >= length) {
+                return false;
+            }
+            position = pointer;
+            continue;
+        }
+        if (labelLength & 0xc0) {
+            return false;
+        }
+        position++;
+        if (labelLength == 0) {
+            break;
+        }
+        if (position + labelLength > length || nameLength + labelLength + 2 > SNB_DNS_MAX_NAME) {
+            return false;
+        }
+        if (nameLength > 0) {
+            name[nameLength++] = '.';
+        }
+        for (uint8_t i = 0; i < labelLength; i++) {
+            name[nameLength++] = SNBDNSLowercase(message[position + i]);
+        }
+        position += labelLength;
+    }
+    name[nameLength] = '\0';
+    if (!jumped) {
+        *offset = position;
+    }
+    return true;
+}
+
+bool SNBDNSParseMessage(const uint8_t *message,
+                        size_t length,
+                        SNBDNSHeader *header,
+                        SNBDNSRecordHandler handler,
+                        void *context,
+                        bool *complete) {
+    if (complete) {
+        *complete = false;
+    }
+    memset(header, 0, sizeof(*header));
+    if (length < SNB_DNS_HEADER_LENGTH) {
+        return false;
+    }
+    header->id = SNBDNSRead16(message);
+    header->flags = SNBDNSRead16(message + 2);
+    header->questionCount = SNBDNSRead16(message + 4);
+    header->answerCount = SNBDNSRead16(message + 6);
+    header->authorityCount = SNBDNSRead16(message + 8);
+    header->additionalCount = SNBDNSRead16(message + 10);
+
+    size_t offset = SNB_DNS_HEADER_LENGTH;
+    char name[SNB_DNS_MAX_NAME];
+    for (uint16_t i = 0; i < header->questionCount; i++) {
+        if (!SNBDNSReadName(message, length, &offset, i == 0 ? header->question : name) || offset + 4 > length) {
+            header->question[0] = '\0';
+            return false;
+        }
+        if (i == 0) {
+            header->questionType = SNBDNSRead16(message + offset);
+        }
+        offset += 4;
+    }
+
+    char target[SNB_DNS_MAX_NAME];
+    uint32_t total = (uint32_t)header->answerCount + header->authorityCount + header->additionalCount;
+    for (uint32_t i = 0; i < total; i++) {
+        if (!SNBDNSReadName(message, length, &offset, name) || offset + 10 > length) {
+            return true;
+        }
+        SNBDNSRecord record;
+        memset(&record, 0, sizeof(record));
+        record.section = i < header->answerCount ? SNBDNSSectionAnswer
+                       : i < (uint32_t)header->answerCount + header->authorityCount ? SNBDNSSectionAuthority
+                       : SNBDNSSectionAdditional;
+        record.name = name;
+        record.type = SNBDNSRead16(message + offset);
+        record.recordClass = SNBDNSRead16(message + offset + 2);
+        record.ttl = SNBDNSRead32(message + offset + 4);
+        if (record.ttl & 0x80000000u) {
+            record.ttl = 0;          // RFC 2181: a TTL with the top bit set means zero
+        }
+        size_t dataLength = SNBDNSRead16(message + offset + 8);
+        offset += 10;
+        if (offset + dataLength > length) {
+            return true;
+        }
+
+        size_t dataOffset = offset;
+        bool valid = true;
+        switch (record.type) {
+            case SNBDNSTypeA:
+                valid = dataLength == 4;
+                record.address = message + offset;
+                break;
+            case SNBDNSTypeAAAA:
+                valid = dataLength == 16;
+                record.address = message + offset;
+                break;
+            case SNBDNSTypePTR:
+            case SNBDNSTypeCNAME:
+                valid = SNBDNSReadName(message, length, &dataOffset, target);
+                record.target = target;
+                break;
+            case SNBDNSTypeSOA: {
+                char responsible[SNB_DNS_MAX_NAME];
+                valid = SNBDNSReadName(message, length, &dataOffset, target) &&
+                        SNBDNSReadName(message, length, &dataOffset, responsible) &&
+                        dataOffset + 20 <= offset + dataLength;
+                record.target = target;
+                if (valid) {
+                    record.soaMinimum = SNBDNSRead32(message + dataOffset + 16);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+        offset += dataLength;
+        if (!valid) {
+            continue;
+        }
+        if (handler) {
+            handler(context, &record);
+        }
+    }
+    if (complete) {
+        *complete = true;
+    }
+    return true;
+}
+
+size_t SNBDNSBuildQuery(uint8_t *buffer, size_t capacity, uint16_t id, const char *name, uint16_t type) {
+    size_t nameLength = strlen(name);
+    if (nameLength > 0 && name[nameLength - 1] == '.') {
+        nameLength--;
+    }
+    // Header, labels (one length byte per label replaces its dot), root, type, class
+    size_t needed = SNB_DNS_HEADER_LENGTH + nameLength + 2 + 4;
+    if (nameLength > 253 || needed > capacity) {
+        return 0;
+    }
+    memset(buffer, 0, SNB_DNS_HEADER_LENGTH);
+    buffer[0] = (uint8_t)(id >> 8);
+    buffer[1] = (uint8_t)id;
+    buffer[2] = (uint8_t)(SNBDNSFlagRecursionDesired >> 8);
+    buffer[5] = 1;
+
+    size_t offset = SNB_DNS_HEADER_LENGTH;
+    size_t labelStart = 0;
+    while (labelStart < nameLength) {
+        const char *dot = memchr(name + labelStart, '.', nameLength - labelStart);
+        size_t labelLength = (dot ? (size_t)(dot - name) : nameLength) - labelStart;
+        if (labelLength == 0 || labelLength > 63) {
+            return 0;
+        }
+        buffer[offset++] = (uint8_t)labelLength;
+        memcpy(buffer + offset, name + labelStart, labelLength);
+        offset += labelLength;
+        labelStart += labelLength + 1;
+    }
+    buffer[offset++] = 0;
+    buffer[offset++] = (uint8_t)(type >> 8);
+    buffer[offset++] = (uint8_t)type;
+    buffer[offset++] = 0;
+    buffer[offset++] = 1;            // IN
+    return offset;
+}
+
+bool SNBDNSReverseName(uint8_t family, const uint8_t *address, char *name, size_t capacity) {
+    static const char hex[] = "0123456789abcdef";
+    if (family == SNBAddressFamilyIPv4) {
+        int written = snprintf(name, capacity, "%u.%u.%u.%u.in-addr.arpa",
+                               address[3], address[2], address[1], address[0]);
+        return written > 0 && (size_t)written < capacity;
+    }
+    if (family != SNBAddressFamilyIPv6 || capacity < 32 * 2 + sizeof("ip6.arpa")) {
+        return false;
+    }
+    size_t offset = 0;
+    for (int i = 15; i >= 0; i--) {
+        name[offset++] = hex[address[i] & 0x0f];
+        name[offset++] = '.';
+        name[offset++] = hex[address[i] >> 4];
+        name[offset++] = '.';
+    }
+    memcpy(name + offset, "ip6.arpa", sizeof("ip6.arpa"));
+    return true;
+}
+
+static int SNBDNSHexValue(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+static bool SNBDNSHasSuffix(const char *name, size_t length, const char *suffix) {
+    size_t suffixLength = strlen(suffix);
+    if (length < suffixLength) {
+        return false;
+    }
+    for (size_t i = 0; i < suffixLength; i++) {
+        if (SNBDNSLowercase((uint8_t)name[length - suffixLength + i]) != suffix[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SNBDNSAddressFromReverseName(const char *name, uint8_t *family, uint8_t *address) {
+    size_t length = strlen(name);
+    if (length > 0 && name[length - 1] == '.') {
+        length--;
+    }
+    memset(address, 0, 16);
+
+    if (SNBDNSHasSuffix(name, length, ".in-addr.arpa")) {
+        const char *cursor = name;
+        for (int i = 3; i >= 0; i--) {
+            unsigned value = 0;
+            int digits = 0;
+            while (*cursor >= '0' && *cursor <= '9' && digits < 3) {
+                value = value * 10 + (unsigned)(*cursor++ - '0');
+                digits++;
+            }
+            if (digits == 0 || value > 255 || *cursor++ != '.') {
+                return false;
+            }
+            address[i] = (uint8_t)value;
+        }
+        if ((size_t)(cursor - name) != length - strlen("in-addr.arpa")) {
+            return false;
+        }
+        *family = SNBAddressFamilyIPv4;
+        return true;
+    }
+
+    if (SNBDNSHasSuffix(name, length, ".ip6.arpa") && length == 32 * 2 + strlen("ip6.arpa")) {
+        for (int i = 0; i < 32; i++) {
+            int nibble = SNBDNSHexValue(name[i * 2]);
+            if (nibble < 0 || name[i * 2 + 1] != '.') {
+                return false;
+            }
+            int byte = 15 - i / 2;
+            address[byte] |= (uint8_t)((i % 2 == 0) ? nibble : nibble << 4);
+        }
+        *family = SNBAddressFamilyIPv6;
+        return true;
+    }
+    return false;
+}
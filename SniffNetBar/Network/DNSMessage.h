@@ -0,0 +1,103 @@
+//
+//  DNSMessage.h
+//  SniffNetBar
+//
+//  Minimal DNS wire format: query building and response parsing
+//
+
+#ifndef SNB_DNS_MESSAGE_H
+#define SNB_DNS_MESSAGE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SNB_DNS_PORT 53
+#define SNB_DNS_HEADER_LENGTH 12
+// Longest presentation name (253 characters) plus the terminator, rounded up
+#define SNB_DNS_MAX_NAME 256
+// Plain UDP DNS messages without EDNS
+#define SNB_DNS_MAX_UDP_MESSAGE 512
+
+enum {
+    SNBDNSTypeA = 1,
+    SNBDNSTypeCNAME = 5,
+    SNBDNSTypeSOA = 6,
+    SNBDNSTypePTR = 12,
+    SNBDNSTypeAAAA = 28
+};
+
+enum {
+    SNBDNSRcodeNoError = 0,
+    SNBDNSRcodeServFail = 2,
+    SNBDNSRcodeNXDomain = 3
+};
+
+enum {
+    SNBDNSFlagResponse = 0x8000,
+    SNBDNSFlagTruncated = 0x0200,
+    SNBDNSFlagRecursionDesired = 0x0100
+};
+
+typedef enum {
+    SNBDNSSectionAnswer,
+    SNBDNSSectionAuthority,
+    SNBDNSSectionAdditional
+} SNBDNSSection;
+
+typedef struct SNBDNSHeader {
+    uint16_t id;
+    uint16_t flags;                  // SNBDNSFlag*, rcode in the low 4 bits
+    uint16_t questionCount;
+    uint16_t answerCount;
+    uint16_t authorityCount;
+    uint16_t additionalCount;
+    char question[SNB_DNS_MAX_NAME]; // First question, empty if there is none
+    uint16_t questionType;
+} SNBDNSHeader;
+
+static inline uint8_t SNBDNSHeaderRcode(const SNBDNSHeader *header) {
+    return (uint8_t)(header->flags & 0x000f);
+}
+
+// A resource record as handed to SNBDNSRecordHandler. Names are lowercase
+// without the trailing dot and, like address, only valid during the call.
+typedef struct SNBDNSRecord {
+    SNBDNSSection section;
+    const char *name;
+    uint16_t type;
+    uint16_t recordClass;
+    uint32_t ttl;
+    const char *target;              // PTR and CNAME target, SOA primary server; NULL otherwise
+    const uint8_t *address;          // A (4 bytes) or AAAA (16 bytes) data; NULL otherwise
+    uint32_t soaMinimum;             // SOA negative-caching TTL
+} SNBDNSRecord;
+
+typedef void (*SNBDNSRecordHandler)(void *context, const SNBDNSRecord *record);
+
+// Reads the header and first question, then hands every resource record to
+// handler in message order. Returns false if the header or the question
+// cannot be read. A message cut short, as captured packets are by the
+// snapshot length, still yields the records that fit whole; *complete
+// (optional) tells whether every record was read. Compression pointers are
+// followed with a loop guard, and nothing is read past length.
+bool SNBDNSParseMessage(const uint8_t *message,
+                        size_t length,
+                        SNBDNSHeader *header,
+                        SNBDNSRecordHandler handler,
+                        void *context,
+                        bool *complete);
+
+// Writes a recursive query for name and type. Returns the message length, or
+// 0 if the name is malformed or the buffer is too small.
+size_t SNBDNSBuildQuery(uint8_t *buffer, size_t capacity, uint16_t id, const char *name, uint16_t type);
+
+// "4.3.2.1.in-addr.arpa" for 1.2.3.4, nibble form under ip6.arpa for IPv6.
+// family is an SNBAddressFamily value (PacketRecord.h).
+bool SNBDNSReverseName(uint8_t family, const uint8_t *address, char *name, size_t capacity);
+
+// Inverse of SNBDNSReverseName for the complete forms above; address gets 16
+// bytes, IPv4 in the first 4. Case-insensitive.
+bool SNBDNSAddressFromReverseName(const char *name, uint8_t *family, uint8_t *address);
+
+#endif
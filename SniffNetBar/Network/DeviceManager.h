@@ -14,6 +14,10 @@
 @property (nonatomic, strong, readonly) PacketCaptureManager *packetManager;
 @property (nonatomic, strong, readonly) NSArray<NetworkDevice *> *availableDevices;
 @property (nonatomic, strong) NetworkDevice *selectedDevice;
+// Devices captured alongside selectedDevice into the same statistics, e.g. a
+// VPN tunnel next to Wi-Fi. Kept across launches; devices that are not
+// present are picked up when they appear in the device list.
+@property (nonatomic, copy, readonly) NSArray<NSString *> *additionalDeviceNames;
 
 - (instancetype)initWithPacketManager:(PacketCaptureManager *)packetManager
                         configuration:(ConfigurationManager *)configuration;
@@ -22,5 +26,8 @@
 - (void)refreshDeviceList;
 - (BOOL)startCaptureWithError:(NSError **)error;
 - (BOOL)selectDevice:(NetworkDevice *)device error:(NSError **)error;
+// Adds device to or removes it from the additional captures, without
+// interrupting the others
+- (BOOL)setAdditionalCapture:(BOOL)enabled forDevice:(NetworkDevice *)device error:(NSError **)error;
 
 @end
@@ -96,6 +96,7 @@ static BOOL SNBSaveSelectedDeviceInfo(NetworkDevice *device) {
 @property (nonatomic, strong, readwrite) PacketCaptureManager *packetManager;
 @property (nonatomic, strong, readwrite) NSArray<NetworkDevice *> *availableDevices;
 @property (nonatomic, assign) NSUInteger reconnectAttempts;
+@property (nonatomic, copy, readwrite) NSArray<NSString *> *additionalDeviceNames;
 @end
 
 @implementation DeviceManager
@@ -107,6 +108,9 @@ static BOOL SNBSaveSelectedDeviceInfo(NetworkDevice *device) {
         _packetManager = packetManager;
         _configuration = configuration;
         _availableDevices = @[];
+        NSArray *savedNames = [[NSUserDefaults standardUserDefaults] arrayForKey:SNBUserDefaultsKeyAdditionalCaptureDevices];
+        _additionalDeviceNames = [savedNames filteredArrayUsingPredicate:
+                                  [NSPredicate predicateWithFormat:@"self isKindOfClass: %@", [NSString class]]] ?: @[];
     }
     return self;
 }
@@ -218,6 +222,7 @@ static BOOL SNBSaveSelectedDeviceInfo(NetworkDevice *device) {
     }
 
     self.reconnectAttempts = 0;
+    [self startAdditionalCaptures];
 
     // Set up error callback to handle capture failures
     __weak typeof(self) weakSelf = self;
@@ -232,7 +237,73 @@ static BOOL SNBSaveSelectedDeviceInfo(NetworkDevice *device) {
     return YES;
 }
 
+// Starts every additional device that is present and not yet captured. A
+// device that fails, such as a tunnel that is down, is retried on the next
+// device list refresh.
+- (void)startAdditionalCaptures {
+    NSArray<NSString *> *activeNames = self.packetManager.activeDeviceNames;
+    if (activeNames.count == 0) {
+        return;
+    }
+    for (NSString *name in self.additionalDeviceNames) {
+        if ([name isEqualToString:self.selectedDevice.name] || [activeNames containsObject:name] ||
+            ![self isDeviceAvailable:name]) {
+            continue;
+        }
+        NSError *error = nil;
+        if ([self.packetManager startAdditionalCaptureWithDeviceName:name error:&error]) {
+            SNBLogNetworkInfo("Also capturing on %{public}@", name);
+        } else {
+            SNBLogNetworkWarn("Cannot capture on additional device %{public}@: %{public}@",
+                              name, error.localizedDescription);
+        }
+    }
+}
+
+- (BOOL)isDeviceAvailable:(NSString *)name {
+    for (NetworkDevice *device in self.availableDevices) {
+        if ([device.name isEqualToString:name]) {
+            return YES;
+        }
+    }
+    return NO;
+}
+
+- (BOOL)setAdditionalCapture:(BOOL)enabled forDevice:(NetworkDevice *)device error:(NSError **)error {
+    if (device.name.length == 0 || [device.name isEqualToString:self.selectedDevice.name]) {
+        return NO;
+    }
+
+    NSMutableArray<NSString *> *names = [self.additionalDeviceNames mutableCopy];
+    [names removeObject:device.name];
+    if (enabled) {
+        [names addObject:device.name];
+    }
+    self.additionalDeviceNames = names;
+    [[NSUserDefaults standardUserDefaults] setObject:names forKey:SNBUserDefaultsKeyAdditionalCaptureDevices];
+
+    if (!enabled) {
+        SNBLogNetworkInfo("Stopped capturing on additional device %{public}@", device.name);
+        [self.packetManager stopCaptureWithDeviceName:device.name];
+        return YES;
+    }
+    if (self.packetManager.activeDeviceNames.count == 0) {
+        // Picked up with the selected device
+        return YES;
+    }
+    SNBLogNetworkInfo("User added capture device: %{public}@", device.name);
+    return [self.packetManager startAdditionalCaptureWithDeviceName:device.name error:error];
+}
+
 - (void)handleCaptureFailure:(NSError *)error {
+    NSString *deviceName = error.userInfo[SNBPacketCaptureDeviceNameKey];
+    if (deviceName.length > 0 && ![deviceName isEqualToString:self.selectedDevice.name]) {
+        // An additional device going away (a VPN disconnecting) leaves the
+        // other captures alone; it is restarted once it is listed again
+        SNBLogNetworkWarn("Capture on additional device %{public}@ stopped", deviceName);
+        [self.packetManager stopCaptureWithDeviceName:deviceName];
+        return;
+    }
     SNBLogNetworkWarn("Handling capture failure, will attempt reconnection");
     [self scheduleReconnection];
 }
@@ -289,6 +360,8 @@ static BOOL SNBSaveSelectedDeviceInfo(NetworkDevice *device) {
     if (!deviceStillAvailable && self.selectedDevice) {
         SNBLogNetworkWarn("Currently selected device '%{public}@' is no longer available", self.selectedDevice.name);
     }
+
+    [self startAdditionalCaptures];
 }
 
 - (BOOL)selectDevice:(NetworkDevice *)device error:(NSError **)error {
@@ -0,0 +1,61 @@
+//
+//  PacketBatchReader.h
+//  SniffNetBar
+//
+//  Drains a pcap handle in bounded batches (by packet count or latency)
+//
+
+#import <Foundation/Foundation.h>
+#import <pcap/pcap.h>
+#import "PacketRing.h"
+
+@class PacketInfo;
+@class SNBPacketBatch;
+@class SNBCaptureStats;
+
+NS_ASSUME_NONNULL_BEGIN
+
+// Upper bound accepted for a single batch request
+extern const NSUInteger kSNBPacketBatchMaxPackets;
+
+@interface SNBPacketBatchReader : NSObject
+
+// The reader does not take ownership of the handle; the caller closes it.
+- (instancetype)initWithPcapHandle:(pcap_t *)handle NS_DESIGNATED_INITIALIZER;
+- (instancetype)init NS_UNAVAILABLE;
+
+// pcap_datalink() of the handle. Frames of a link type without a decoder
+// (isLinkTypeSupported NO) are all counted as undecoded.
+@property (nonatomic, readonly) int linkType;
+@property (nonatomic, readonly, getter=isLinkTypeSupported) BOOL linkTypeSupported;
+
+// YES once an offline savefile has been fully consumed
+@property (nonatomic, readonly, getter=isExhausted) BOOL exhausted;
+
+// Reads until maxPackets packets are decoded or maxLatency elapses, whichever
+// comes first. Returns an empty batch when nothing arrived in time and nil on
+// a pcap error. Must be called from a single queue.
+- (nullable SNBPacketBatch *)readBatchWithMaxPackets:(NSUInteger)maxPackets
+                                          maxLatency:(NSTimeInterval)maxLatency
+                                               error:(NSError * _Nullable *)error;
+
+// Decodes packets straight into ring slots until maxLatency elapses and
+// publishes them, writing one byte to wakeupDescriptor when the consumer is
+// parked. Kernel counters are mirrored into the ring header. Returns NO on a
+// pcap error.
+- (BOOL)pumpIntoRing:(SNBPacketRing *)ring
+    wakeupDescriptor:(int)wakeupDescriptor
+          maxLatency:(NSTimeInterval)maxLatency
+               error:(NSError * _Nullable *)error;
+
+// Cumulative counters, including kernel drop counts for live handles
+- (SNBCaptureStats *)currentStats;
+
+@end
+
+// Decodes an Ethernet frame into a PacketInfo, or nil if it is not decodable
+PacketInfo * _Nullable SNBPacketInfoFromEthernetFrame(const u_char *packet,
+                                                     uint32_t capturedLength,
+                                                     uint32_t actualLength);
+
+NS_ASSUME_NONNULL_END
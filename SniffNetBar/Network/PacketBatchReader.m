@@ -0,0 +1,253 @@
+//
+//  PacketBatchReader.m
+//  SniffNetBar
+//
+//  Drains a pcap handle in bounded batches (by packet count or latency)
+//
+
+#import "PacketBatchReader.h"
+#import "PacketInfo.h"
+#import "PacketBatch.h"
+#import "PacketDecoder.h"
+#import "CaptureStats.h"
+#import <poll.h>
+#import <time.h>
+
+const NSUInteger kSNBPacketBatchMaxPackets = 4096;
+
+typedef struct {
+    __unsafe_unretained SNBPacketBatch *batch;
+    SNBPacketDecodeFunction decode;
+    uint64_t undecoded;
+} SNBPacketBatchContext;
+
+typedef struct {
+    SNBPacketRing *ring;
+    SNBPacketDecodeFunction decode;
+    uint64_t decoded;
+    uint64_t undecoded;
+} SNBPacketRingContext;
+
+static inline uint64_t SNBTimestampNs(const struct timeval *tv) {
+    return (uint64_t)tv->tv_sec * 1000000000ULL + (uint64_t)tv->tv_usec * 1000ULL;
+}
+
+static void SNBPacketBatchHandler(u_char *user, const struct pcap_pkthdr *header, const u_char *bytes) {
+    SNBPacketBatchContext *context = (SNBPacketBatchContext *)user;
+    SNBPacketRecord record;
+    if (context->decode &&
+        context->decode(bytes, header->caplen, header->len, SNBTimestampNs(&header->ts), &record)) {
+        [context->batch appendRecords:&record count:1];
+    } else {
+        context->undecoded++;
+    }
+}
+
+static void SNBPacketRingHandler(u_char *user, const struct pcap_pkthdr *header, const u_char *bytes) {
+    SNBPacketRingContext *context = (SNBPacketRingContext *)user;
+    SNBPacketRecord *slot = SNBPacketRingClaim(context->ring);
+    if (!slot) {
+        // Counted as a ring overflow by SNBPacketRingClaim
+        return;
+    }
+    if (context->decode &&
+        context->decode(bytes, header->caplen, header->len, SNBTimestampNs(&header->ts), slot)) {
+        SNBPacketRingCommit(context->ring);
+        context->decoded++;
+    } else {
+        context->undecoded++;
+    }
+}
+
+static uint64_t SNBMonotonicMillis(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000ULL + (uint64_t)ts.tv_nsec / 1000000ULL;
+}
+
+@interface SNBPacketBatchReader ()
+@property (nonatomic, assign) pcap_t *handle;
+@property (nonatomic, assign) BOOL offline;
+@property (nonatomic, assign) SNBPacketDecodeFunction decode;
+@property (nonatomic, assign, readwrite) int linkType;
+@property (nonatomic, assign, readwrite, getter=isExhausted) BOOL exhausted;
+@property (nonatomic, assign) uint64_t packetsDelivered;
+@property (nonatomic, assign) uint64_t packetsUndecoded;
+@property (nonatomic, assign) uint64_t batchCount;
+@property (nonatomic, assign) NSUInteger lastBatchSize;
+@end
+
+@implementation SNBPacketBatchReader
+
+- (instancetype)initWithPcapHandle:(pcap_t *)handle {
+    self = [super init];
+    if (self) {
+        _handle = handle;
+        _offline = (pcap_file(handle) != NULL);
+        _linkType = pcap_datalink(handle);
+        _decode = _linkType >= 0 ? SNBPacketDecoderForLinkType((uint32_t)_linkType) : NULL;
+    }
+    return self;
+}
+
+- (BOOL)isLinkTypeSupported {
+    return self.decode != NULL;
+}
+
+- (SNBPacketBatch *)readBatchWithMaxPackets:(NSUInteger)maxPackets
+                                 maxLatency:(NSTimeInterval)maxLatency
+                                      error:(NSError **)error {
+    maxPackets = MAX((NSUInteger)1, MIN(maxPackets, kSNBPacketBatchMaxPackets));
+    uint64_t deadline = SNBMonotonicMillis() + (uint64_t)MAX(0.0, maxLatency * 1000.0);
+
+    SNBPacketBatch *batch = [SNBPacketBatch batchWithCapacity:maxPackets];
+    SNBPacketBatchContext context = { batch, self.decode, 0 };
+    int selectableFD = self.offline ? -1 : pcap_get_selectable_fd(self.handle);
+
+    while (batch.count < maxPackets && !self.exhausted) {
+        int remaining = (int)(maxPackets - batch.count);
+        int result = pcap_dispatch(self.handle, remaining, SNBPacketBatchHandler, (u_char *)&context);
+
+        if (result < 0) {
+            if (result == PCAP_ERROR_BREAK) {
+                break;
+            }
+            if (error) {
+                *error = [NSError errorWithDomain:@"SNBPacketBatchReader"
+                                             code:1
+                                         userInfo:@{NSLocalizedDescriptionKey:
+                                                        [NSString stringWithUTF8String:pcap_geterr(self.handle)]}];
+            }
+            self.packetsUndecoded += context.undecoded;
+            return nil;
+        }
+
+        if (result == 0) {
+            if (self.offline) {
+                self.exhausted = YES;
+                break;
+            }
+
+            uint64_t now = SNBMonotonicMillis();
+            if (now >= deadline) {
+                break;
+            }
+            int waitMs = (int)(deadline - now);
+            if (selectableFD >= 0) {
+                struct pollfd pfd = { .fd = selectableFD, .events = POLLIN, .revents = 0 };
+                poll(&pfd, 1, waitMs);
+            } else {
+                usleep((useconds_t)MIN(waitMs, 1) * 1000);
+            }
+            continue;
+        }
+
+        if (!self.offline && SNBMonotonicMillis() >= deadline) {
+            break;
+        }
+    }
+
+    self.packetsUndecoded += context.undecoded;
+    self.packetsDelivered += batch.count;
+    if (batch.count > 0) {
+        self.batchCount++;
+    }
+    self.lastBatchSize = batch.count;
+    return batch;
+}
+
+- (BOOL)pumpIntoRing:(SNBPacketRing *)ring
+    wakeupDescriptor:(int)wakeupDescriptor
+          maxLatency:(NSTimeInterval)maxLatency
+               error:(NSError **)error {
+    uint64_t deadline = SNBMonotonicMillis() + (uint64_t)MAX(0.0, maxLatency * 1000.0);
+    SNBPacketRingContext context = { ring, self.decode, 0, 0 };
+    int selectableFD = self.offline ? -1 : pcap_get_selectable_fd(self.handle);
+    BOOL success = YES;
+
+    while (!self.exhausted) {
+        uint64_t decodedBefore = context.decoded;
+        int result = pcap_dispatch(self.handle, -1, SNBPacketRingHandler, (u_char *)&context);
+        if (result < 0) {
+            if (result != PCAP_ERROR_BREAK && error) {
+                *error = [NSError errorWithDomain:@"SNBPacketBatchReader"
+                                             code:1
+                                         userInfo:@{NSLocalizedDescriptionKey:
+                                                        [NSString stringWithUTF8String:pcap_geterr(self.handle)]}];
+            }
+            success = (result == PCAP_ERROR_BREAK);
+            break;
+        }
+
+        if (context.decoded != decodedBefore && SNBPacketRingPublish(ring)) {
+            char wake = 1;
+            (void)write(wakeupDescriptor, &wake, 1);
+        }
+
+        if (result == 0 && self.offline) {
+            self.exhausted = YES;
+            break;
+        }
+
+        uint64_t now = SNBMonotonicMillis();
+        if (now >= deadline) {
+            break;
+        }
+        if (result == 0) {
+            if (selectableFD >= 0) {
+                struct pollfd pfd = { .fd = selectableFD, .events = POLLIN, .revents = 0 };
+                poll(&pfd, 1, (int)(deadline - now));
+            } else {
+                usleep(1000);
+            }
+        }
+    }
+
+    if (SNBPacketRingPublish(ring)) {
+        char wake = 1;
+        (void)write(wakeupDescriptor, &wake, 1);
+    }
+
+    self.packetsDelivered += context.decoded;
+    self.packetsUndecoded += context.undecoded;
+    if (context.decoded > 0) {
+        self.batchCount++;
+    }
+    self.lastBatchSize = (NSUInteger)context.decoded;
+
+    SNBCaptureStats *stats = [self currentStats];
+    SNBPacketRingSetCaptureCounters(ring, stats.packetsReceived, stats.kernelDropped, stats.interfaceDropped);
+    return success;
+}
+
+- (SNBCaptureStats *)currentStats {
+    SNBCaptureStats *stats = [[SNBCaptureStats alloc] init];
+    stats.packetsDelivered = self.packetsDelivered;
+    stats.packetsUndecoded = self.packetsUndecoded;
+    stats.batchCount = self.batchCount;
+    stats.lastBatchSize = self.lastBatchSize;
+
+    if (!self.offline) {
+        struct pcap_stat pcapStats;
+        if (pcap_stats(self.handle, &pcapStats) == 0) {
+            stats.packetsReceived = pcapStats.ps_recv;
+            stats.kernelDropped = pcapStats.ps_drop;
+            stats.interfaceDropped = pcapStats.ps_ifdrop;
+        }
+    } else {
+        stats.packetsReceived = self.packetsDelivered + self.packetsUndecoded;
+    }
+    return stats;
+}
+
+@end
+
+PacketInfo *SNBPacketInfoFromEthernetFrame(const u_char *packet,
+                                           uint32_t capturedLength,
+                                           uint32_t actualLength) {
+    SNBPacketRecord record;
+    if (!SNBPacketDecodeEthernet(packet, capturedLength, actualLength, 0, &record)) {
+        return nil;
+    }
+    return [PacketInfo packetInfoWithRecord:&record];
+}
@@ -8,16 +8,66 @@
 #import <Foundation/Foundation.h>
 
 @class PacketInfo;
+@class SNBPacketBatch;
+@class SNBCaptureStats;
+
+typedef NS_ENUM(NSInteger, SNBReplayTiming) {
+    SNBReplayTimingAsFastAsPossible = 0,
+    // Packets are delivered at the pace they were captured
+    SNBReplayTimingOriginal
+};
+
+// Name of the capture device an onCaptureError error came from, in userInfo
+extern NSString * const SNBPacketCaptureDeviceNameKey;
+// Concurrent live sessions, matching the helper's limit
+extern const NSUInteger SNBPacketCaptureMaxSessions;
 
 @interface PacketCaptureManager : NSObject
 
+// Called once per batch on the capture queue with direction flags and the
+// interface index already set on every record, and records whose remote
+// address is on a loaded blocklist flagged (see Blocklist.h). Batches from every captured
+// interface arrive on that one queue, with copies of packets seen on two
+// interfaces removed; stats are the counters of the session that captured
+// the batch. When set, it replaces the per-packet onPacketReceived callback,
+// which formats a PacketInfo for each record.
+@property (nonatomic, copy) void (^onPacketBatchReceived)(SNBPacketBatch *batch, SNBCaptureStats *stats);
 @property (nonatomic, copy) void (^onPacketReceived)(PacketInfo *packetInfo);
 @property (nonatomic, copy) void (^onCaptureError)(NSError *error);
+// The first interface captured, or the replayed file
 @property (nonatomic, strong, readonly) NSString *currentDeviceName;
 @property (nonatomic, strong, readonly) NSDate *captureStartDate;
+// Latest cumulative counters reported by the helper, summed over every session
+@property (atomic, copy, readonly) SNBCaptureStats *captureStats;
+// Device names by SNBPacketRecord.interfaceIndex; index 0 (untagged) is the
+// empty string. A device keeps its index for the manager's lifetime, so
+// statistics never mix up two interfaces.
+@property (atomic, copy, readonly) NSArray<NSString *> *interfaceNames;
+// Devices with a live session, in interface index order
+@property (nonatomic, readonly) NSArray<NSString *> *activeDeviceNames;
+// Called on the main queue when a replay reaches the end of its file
+@property (nonatomic, copy) void (^onReplayFinished)(SNBCaptureStats *stats);
 
+// Live capture through the helper, with the BPF filter, snapshot length and
+// kernel buffer size from the configuration. Stops every running session and
+// captures on deviceName alone.
 - (BOOL)startCaptureWithDeviceName:(NSString *)deviceName error:(NSError **)error;
+// Captures on deviceName alongside the running sessions, each read on its
+// own queue. Returns YES without a new session if the device is already
+// captured; fails once SNBPacketCaptureMaxSessions are running.
+- (BOOL)startAdditionalCaptureWithDeviceName:(NSString *)deviceName error:(NSError **)error;
+// Stops the session on deviceName and leaves the others running
+- (void)stopCaptureWithDeviceName:(NSString *)deviceName;
 - (BOOL)startCaptureWithError:(NSError **)error; // Uses default device
+// Replays a pcap or pcapng file through the same batch path as a live
+// capture, without the helper. Records keep their capture timestamps, which
+// the analytics run on. Direction is tagged against localAddresses, or this
+// host's addresses when nil. Packets of link types without a decoder (see
+// PacketDecoder.h) are counted as undecoded.
+- (BOOL)startReplayFromFile:(NSString *)path
+                     timing:(SNBReplayTiming)timing
+             localAddresses:(NSArray<NSString *> *)localAddresses
+                      error:(NSError **)error;
 - (void)stopCapture;
 
 @end
@@ -7,18 +7,74 @@
 
 #import "PacketCaptureManager.h"
 #import "PacketInfo.h"
+#import "PacketBatch.h"
+#import "PacketDedup.h"
+#import "PacketDirection.h"
+#import "Blocklist.h"
+#import "PacketDecoder.h"
+#import "PcapFileReader.h"
+#import "CaptureStats.h"
+#import "CaptureOptions.h"
+#import "PacketRingConsumer.h"
+#import "PassiveDNSCache.h"
 #import "NetworkDevice.h"
 #import "SNBPrivilegedHelperClient.h"
 #import "Logger.h"
 #import "ConfigurationManager.h"
+#import <time.h>
 
-@interface PacketCaptureManager ()
+NSString * const SNBPacketCaptureDeviceNameKey = @"SNBPacketCaptureDeviceName";
+const NSUInteger SNBPacketCaptureMaxSessions = 4;
+
+// Longest single sleep while pacing a replay, so stopCapture takes effect promptly
+static const uint64_t kReplayMaxSleepNs = 100 * NSEC_PER_MSEC;
+// At most one kernel drop warning per interval and session
+static const NSTimeInterval kDropWarningInterval = 60.0;
+static const size_t kDedupInitialCapacity = 1024;
+
+// One live session in the helper. Its batches are read from the ring or XPC
+// and tagged with the interface on the session's own queue, then merged with
+// the other sessions' on the capture queue.
+@interface SNBCaptureSession : NSObject
+@property (nonatomic, copy) NSString *sessionID;
+@property (nonatomic, copy) NSString *deviceName;
+@property (nonatomic, assign) uint8_t interfaceIndex;
+@property (nonatomic, strong) dispatch_queue_t queue;
+// Cleared when the session is stopped; late replies and batches are ignored
+@property (atomic, assign) BOOL active;
+@property (atomic, strong) SNBPacketRingConsumer *ringConsumer;
+@property (atomic, copy) SNBCaptureStats *captureStats;
+// Kernel and interface drops already logged; guarded by the session
+@property (nonatomic, assign) uint64_t reportedDrops;
+@property (nonatomic, strong) NSDate *lastDropWarningDate;
+@end
+
+@implementation SNBCaptureSession
+@end
+
+@interface PacketCaptureManager () {
+    // Written on start, read on the capture queue
+    SNBLocalAddressSet _localAddresses;
+    // Flows seen on more than one interface; owned by the capture queue
+    SNBPacketDedup _dedup;
+}
 @property (nonatomic, assign) BOOL isCapturing;
+// Every session's batches are delivered on this queue, one at a time
 @property (nonatomic, strong) dispatch_queue_t captureQueue;
 @property (nonatomic, strong, readwrite) NSString *currentDeviceName;
 @property (nonatomic, strong, readwrite) NSDate *captureStartDate;
-@property (nonatomic, strong) NSString *sessionID;
-@property (nonatomic, strong) NSTimer *pollingTimer;
+// Live sessions by device name; guarded by the dictionary
+@property (nonatomic, strong) NSMutableDictionary<NSString *, SNBCaptureSession *> *sessions;
+@property (atomic, copy, readwrite) NSArray<NSString *> *interfaceNames;
+// Set while more than one session runs; read on the capture queue
+@property (atomic, assign) BOOL deduplicating;
+@property (atomic, assign) uint64_t duplicatePackets;
+// Written on the capture queue only
+@property (atomic, assign) uint64_t blocklistedPackets;
+// Identifies the running file replay; cleared to cancel it
+@property (atomic, copy) NSString *replayID;
+@property (nonatomic, strong) dispatch_queue_t replayQueue;
+@property (atomic, copy, readwrite) SNBCaptureStats *captureStats;
 @property (nonatomic, strong) ConfigurationManager *configuration;
 @end
 
@@ -28,14 +84,19 @@
     self = [super init];
     if (self) {
         _captureQueue = dispatch_queue_create("com.sniffnetbar.capture", DISPATCH_QUEUE_SERIAL);
+        _replayQueue = dispatch_queue_create("com.sniffnetbar.capture.replay", DISPATCH_QUEUE_SERIAL);
         _isCapturing = NO;
         _configuration = [ConfigurationManager sharedManager];
+        _sessions = [NSMutableDictionary dictionary];
+        _interfaceNames = @[@""];
+        SNBPacketDedupInit(&_dedup, SNB_PACKET_DEDUP_DEFAULT_WINDOW_NS, kDedupInitialCapacity);
     }
     return self;
 }
 
 - (void)dealloc {
     [self stopCapture];
+    SNBPacketDedupDestroy(&_dedup);
 }
 
 - (BOOL)startCaptureWithError:(NSError **)error {
@@ -70,6 +131,13 @@
     if (self.isCapturing) {
         [self stopCapture];
     }
+    return [self startAdditionalCaptureWithDeviceName:deviceName error:error];
+}
+
+- (BOOL)startAdditionalCaptureWithDeviceName:(NSString *)deviceName error:(NSError **)error {
+    if (self.replayID) {
+        [self stopCapture];
+    }
 
     if (!deviceName || deviceName.length == 0) {
         if (error) {
@@ -80,12 +148,30 @@
         return NO;
     }
 
+    @synchronized (self.sessions) {
+        if (self.sessions[deviceName]) {
+            return YES;
+        }
+        if (self.sessions.count >= SNBPacketCaptureMaxSessions) {
+            if (error) {
+                NSString *description = [NSString stringWithFormat:@"Cannot capture on more than %lu interfaces at once",
+                                         (unsigned long)SNBPacketCaptureMaxSessions];
+                *error = [NSError errorWithDomain:@"PacketCaptureError"
+                                             code:5
+                                         userInfo:@{NSLocalizedDescriptionKey: description}];
+            }
+            return NO;
+        }
+    }
+
     __block BOOL success = NO;
     __block NSError *startError = nil;
     __block NSString *newSessionID = nil;
     dispatch_semaphore_t semaphore = dispatch_semaphore_create(0);
 
+    SNBCaptureOptions *options = [self captureOptionsFromConfiguration];
     [[SNBPrivilegedHelperClient sharedClient] startCaptureOnDevice:deviceName
+                                                           options:options
                                                         completion:^(NSString *sessionID, NSError *err) {
         if (err) {
             startError = err;
@@ -109,16 +195,110 @@
         return NO;
     }
 
-    self.sessionID = newSessionID;
-    self.currentDeviceName = deviceName;
+    SNBCaptureSession *session = [[SNBCaptureSession alloc] init];
+    session.sessionID = newSessionID;
+    session.deviceName = deviceName;
+    session.queue = dispatch_queue_create("com.sniffnetbar.capture.session", DISPATCH_QUEUE_SERIAL);
+    session.active = YES;
+
+    // The new interface's addresses count as local from its first packet
+    dispatch_sync(self.captureQueue, ^{
+        SNBLocalAddressSetLoad(&self->_localAddresses);
+    });
+
+    BOOL firstSession = NO;
+    @synchronized (self.sessions) {
+        session.interfaceIndex = [self interfaceIndexForDeviceName:deviceName];
+        firstSession = self.sessions.count == 0;
+        self.sessions[deviceName] = session;
+        self.deduplicating = self.sessions.count > 1;
+    }
+    if (firstSession) {
+        self.currentDeviceName = deviceName;
+        self.captureStartDate = [NSDate date];
+        self.captureStats = nil;
+        [self attachPassiveDNSTable];
+    }
     self.isCapturing = YES;
-    self.captureStartDate = [NSDate date];
 
-    SNBLogInfo("Capture started with session ID: %{public}@", self.sessionID);
-    [self startPollingForPackets];
+    SNBLogInfo("Capture started on %{public}@ (interface %u) with session ID: %{public}@ (%{public}@)",
+               deviceName, session.interfaceIndex, session.sessionID, options);
+    if (self.configuration.packetRingEnabled) {
+        [self openPacketRingForSession:session];
+    } else {
+        [self requestNextBatchForSession:session];
+    }
     return YES;
 }
 
+// Live names come from the helper's table; a failure only costs hostnames
+// that reverse lookups cannot find
+- (void)attachPassiveDNSTable {
+    SNBPassiveDNSCache *cache = [SNBPassiveDNSCache sharedCache];
+    [cache endReplay];
+    [[SNBPrivilegedHelperClient sharedClient] openPassiveDNSTableWithCompletion:^(NSFileHandle *tableMemory,
+                                                                                  NSError *error) {
+        if (!tableMemory) {
+            SNBLogNetworkWarn("Passive DNS unavailable (%{public}@); hostnames come from reverse lookups only",
+                              error.localizedDescription ?: @"no table");
+            return;
+        }
+        [cache attachTableMemory:tableMemory];
+    }];
+}
+
+// Hands out indices in the order devices are first captured. Past the last
+// index records stay untagged, so their traffic is still counted. Called
+// with the sessions locked.
+- (uint8_t)interfaceIndexForDeviceName:(NSString *)deviceName {
+    NSArray<NSString *> *names = self.interfaceNames;
+    NSUInteger index = [names indexOfObject:deviceName];
+    if (index != NSNotFound) {
+        return (uint8_t)index;
+    }
+    if (names.count >= SNB_PACKET_MAX_INTERFACES) {
+        SNBLogNetworkWarn("No interface index left for %{public}@; its traffic is reported untagged", deviceName);
+        return 0;
+    }
+    self.interfaceNames = [names arrayByAddingObject:deviceName];
+    return (uint8_t)names.count;
+}
+
+- (NSArray<NSString *> *)activeDeviceNames {
+    NSArray<SNBCaptureSession *> *sessions = nil;
+    @synchronized (self.sessions) {
+        sessions = self.sessions.allValues;
+    }
+    NSArray<SNBCaptureSession *> *ordered = [sessions sortedArrayUsingComparator:^NSComparisonResult(SNBCaptureSession *lhs,
+                                                                                                    SNBCaptureSession *rhs) {
+        return [@(lhs.interfaceIndex) compare:@(rhs.interfaceIndex)];
+    }];
+    return [ordered valueForKey:@"deviceName"];
+}
+
+- (void)stopCaptureWithDeviceName:(NSString *)deviceName {
+    SNBCaptureSession *session = nil;
+    NSString *remainingDevice = nil;
+    @synchronized (self.sessions) {
+        session = self.sessions[deviceName];
+        [self.sessions removeObjectForKey:deviceName];
+        self.deduplicating = self.sessions.count > 1;
+        remainingDevice = self.sessions.allKeys.firstObject;
+    }
+    if (!session) {
+        return;
+    }
+
+    [self stopSession:session];
+    if (!remainingDevice) {
+        self.isCapturing = NO;
+        self.captureStartDate = nil;
+    } else if ([self.currentDeviceName isEqualToString:deviceName]) {
+        self.currentDeviceName = remainingDevice;
+    }
+    [self refreshCaptureStats];
+}
+
 - (void)stopCapture {
     if (!self.isCapturing) {
         return;
@@ -126,65 +306,428 @@
 
     self.isCapturing = NO;
     self.captureStartDate = nil;
+    self.replayID = nil;
 
-    [self.pollingTimer invalidate];
-    self.pollingTimer = nil;
+    NSArray<SNBCaptureSession *> *sessions = nil;
+    @synchronized (self.sessions) {
+        sessions = self.sessions.allValues;
+        [self.sessions removeAllObjects];
+        self.deduplicating = NO;
+    }
+    for (SNBCaptureSession *session in sessions) {
+        [self stopSession:session];
+    }
+}
 
-    if (self.sessionID) {
-        [[SNBPrivilegedHelperClient sharedClient] stopCaptureForSession:self.sessionID
-                                                             completion:^(NSError *error) {
-            if (error) {
-                SNBLogWarn("Error stopping capture: %{public}@", error.localizedDescription);
-            }
-        }];
-        self.sessionID = nil;
+- (void)stopSession:(SNBCaptureSession *)session {
+    session.active = NO;
+    [session.ringConsumer cancel];
+    session.ringConsumer = nil;
+
+    NSString *deviceName = session.deviceName;
+    [[SNBPrivilegedHelperClient sharedClient] stopCaptureForSession:session.sessionID
+                                                         completion:^(NSError *error) {
+        if (error) {
+            SNBLogWarn("Error stopping capture on %{public}@: %{public}@", deviceName, error.localizedDescription);
+        }
+    }];
+}
+
+- (SNBCaptureOptions *)captureOptionsFromConfiguration {
+    SNBCaptureOptions *options = [SNBCaptureOptions defaultOptions];
+    NSString *filter = self.configuration.captureFilter;
+    options.filterExpression = filter.length > 0 ? filter : nil;
+    options.snapshotLength = (int)MIN(self.configuration.captureSnapshotLength, (NSUInteger)INT_MAX);
+    options.bufferSize = self.configuration.captureBufferSize;
+    return options;
+}
+
+// Tags a session's failure with its device, so DeviceManager can tell an
+// extra interface going away from the main capture failing
+- (NSError *)captureError:(NSError *)error forSession:(SNBCaptureSession *)session {
+    NSMutableDictionary *userInfo = [error.userInfo mutableCopy] ?: [NSMutableDictionary dictionary];
+    userInfo[SNBPacketCaptureDeviceNameKey] = session.deviceName;
+    return [NSError errorWithDomain:error.domain code:error.code userInfo:userInfo];
+}
+
+- (void)reportCaptureError:(NSError *)error forSession:(SNBCaptureSession *)session {
+    void (^errorHandler)(NSError *) = self.onCaptureError;
+    if (!errorHandler) {
+        return;
+    }
+    NSError *sessionError = [self captureError:error forSession:session];
+    dispatch_async(dispatch_get_main_queue(), ^{
+        errorHandler(sessionError);
+    });
+}
+
+// Publishes the counters of every live session as one total
+- (void)refreshCaptureStats {
+    NSArray<SNBCaptureSession *> *sessions = nil;
+    @synchronized (self.sessions) {
+        sessions = self.sessions.allValues;
+    }
+    SNBCaptureStats *total = nil;
+    for (SNBCaptureSession *session in sessions) {
+        SNBCaptureStats *stats = session.captureStats;
+        if (!stats) {
+            continue;
+        }
+        if (!total) {
+            total = [[SNBCaptureStats alloc] init];
+        }
+        [total addCountersFromStats:stats];
+    }
+    if (total) {
+        total.packetsDuplicate = self.duplicatePackets;
+        total.packetsBlocklisted = self.blocklistedPackets;
+        self.captureStats = total;
     }
 }
 
-- (void)startPollingForPackets {
-    [self.pollingTimer invalidate];
+// Stores a session's latest counters and logs when the kernel or the
+// interface starts dropping packets, which a larger CaptureBufferSize or a
+// narrower CaptureFilter addresses. Called from the XPC reply and session queues.
+- (void)updateCaptureStats:(SNBCaptureStats *)stats forSession:(SNBCaptureSession *)session {
+    session.captureStats = stats;
+    [self refreshCaptureStats];
+
+    uint64_t drops = stats.kernelDropped + stats.interfaceDropped;
+    uint64_t newDrops = 0;
+    @synchronized (session) {
+        if (drops <= session.reportedDrops) {
+            return;
+        }
+        NSDate *now = [NSDate date];
+        if (session.lastDropWarningDate && [now timeIntervalSinceDate:session.lastDropWarningDate] < kDropWarningInterval) {
+            return;
+        }
+        newDrops = drops - session.reportedDrops;
+        session.reportedDrops = drops;
+        session.lastDropWarningDate = now;
+    }
+    SNBLogNetworkWarn("Capture on %{public}@ dropped %llu packets (kernel %llu, interface %llu of %llu received); "
+                      "consider a larger CaptureBufferSize or a CaptureFilter",
+                      session.deviceName, newDrops, stats.kernelDropped, stats.interfaceDropped, stats.packetsReceived);
+}
+
+- (void)openPacketRingForSession:(SNBCaptureSession *)session {
     __weak typeof(self) weakSelf = self;
-    dispatch_async(dispatch_get_main_queue(), ^{
+    [[SNBPrivilegedHelperClient sharedClient] openPacketRingForSession:session.sessionID
+                                                              capacity:self.configuration.packetRingCapacity
+                                                            completion:^(NSFileHandle *ringMemory,
+                                                                         NSFileHandle *wakeup,
+                                                                         NSError *error) {
         __strong typeof(weakSelf) strongSelf = weakSelf;
-        if (!strongSelf) {
+        if (!strongSelf || !session.active) {
+            return;
+        }
+
+        SNBPacketRingConsumer *consumer = nil;
+        if (!error && ringMemory && wakeup) {
+            consumer = [[SNBPacketRingConsumer alloc] initWithMemoryHandle:ringMemory
+                                                              wakeupHandle:wakeup
+                                                                     queue:session.queue];
+        }
+        if (!consumer) {
+            SNBLogNetworkWarn("Shared-memory packet ring unavailable for %{public}@ (%{public}@), using XPC batches",
+                              session.deviceName, error.localizedDescription ?: @"incompatible ring");
+            [strongSelf requestNextBatchForSession:session];
             return;
         }
-        NSTimeInterval pollingInterval = strongSelf.configuration.packetPollingInterval;
-        strongSelf.pollingTimer = [NSTimer timerWithTimeInterval:pollingInterval
-                                                        repeats:YES
-                                                          block:^(NSTimer *timer) {
-            __strong typeof(weakSelf) strongSelf = weakSelf;
-            if (strongSelf) {
-                [strongSelf pollNextPacket];
+
+        consumer.onPacketBatch = ^(SNBPacketBatch *batch, SNBCaptureStats *stats) {
+            __strong typeof(weakSelf) innerSelf = weakSelf;
+            [innerSelf updateCaptureStats:stats forSession:session];
+            [innerSelf deliverBatch:batch stats:stats fromSession:session];
+        };
+        consumer.onClosed = ^{
+            __strong typeof(weakSelf) innerSelf = weakSelf;
+            if (!innerSelf || !session.active) {
+                return;
             }
-        }];
-        [[NSRunLoop mainRunLoop] addTimer:strongSelf.pollingTimer forMode:NSRunLoopCommonModes];
-    });
+            NSError *closedError = [NSError errorWithDomain:@"PacketCaptureError"
+                                                       code:3
+                                                   userInfo:@{NSLocalizedDescriptionKey: @"Helper closed the packet ring"}];
+            [innerSelf reportCaptureError:closedError forSession:session];
+        };
+        session.ringConsumer = consumer;
+        [consumer start];
+        SNBLogNetworkInfo("Streaming packets from %{public}@ through shared-memory ring", session.deviceName);
+    }];
 }
 
-- (void)pollNextPacket {
-    if (!self.isCapturing || !self.sessionID) {
+// Keeps exactly one batch request outstanding per session. The helper returns
+// as soon as the batch fills or the latency budget expires, so the next request
+// is issued from the reply instead of from a timer.
+- (void)requestNextBatchForSession:(SNBCaptureSession *)session {
+    if (!session.active) {
         return;
     }
 
-    [[SNBPrivilegedHelperClient sharedClient] getNextPacketForSession:self.sessionID
-                                                           completion:^(PacketInfo *packet, NSError *error) {
+    NSUInteger maxPackets = self.configuration.packetBatchMaxPackets;
+    NSTimeInterval maxLatency = self.configuration.packetBatchMaxLatency;
+    __weak typeof(self) weakSelf = self;
+    [[SNBPrivilegedHelperClient sharedClient] getPacketBatchForSession:session.sessionID
+                                                            maxPackets:maxPackets
+                                                            maxLatency:maxLatency
+                                                            completion:^(SNBPacketBatch *batch,
+                                                                         SNBCaptureStats *stats,
+                                                                         NSError *error) {
+        __strong typeof(weakSelf) strongSelf = weakSelf;
+        if (!strongSelf || !session.active) {
+            return;
+        }
+
         if (error) {
-            SNBLogWarn("Error getting packet: %{public}@", error.localizedDescription);
-            if (self.onCaptureError) {
-                dispatch_async(dispatch_get_main_queue(), ^{
-                    self.onCaptureError(error);
-                });
-            }
+            SNBLogWarn("Error getting packet batch from %{public}@: %{public}@",
+                       session.deviceName, error.localizedDescription);
+            // The session is unusable after a pcap or XPC error; DeviceManager
+            // restarts capture with a fresh session from onCaptureError.
+            [strongSelf reportCaptureError:error forSession:session];
             return;
         }
 
-        if (packet && self.onPacketReceived) {
-            dispatch_async(self.captureQueue, ^{
-                self.onPacketReceived(packet);
+        if (stats) {
+            [strongSelf updateCaptureStats:stats forSession:session];
+        }
+
+        if (batch.count > 0) {
+            dispatch_async(session.queue, ^{
+                [strongSelf deliverBatch:batch stats:stats fromSession:session];
             });
         }
+
+        [strongSelf requestNextBatchForSession:session];
     }];
 }
 
+- (BOOL)startReplayFromFile:(NSString *)path
+                     timing:(SNBReplayTiming)timing
+             localAddresses:(NSArray<NSString *> *)localAddresses
+                      error:(NSError **)error {
+    if (self.isCapturing) {
+        [self stopCapture];
+    }
+
+    char reason[256];
+    SNBPcapFileReader *reader = SNBPcapFileReaderOpen(path.fileSystemRepresentation, reason, sizeof(reason));
+    if (!reader) {
+        if (error) {
+            NSString *description = [NSString stringWithFormat:@"Cannot open replay file: %s", reason];
+            *error = [NSError errorWithDomain:@"PacketCaptureError"
+                                         code:4
+                                     userInfo:@{NSLocalizedDescriptionKey: description}];
+        }
+        return NO;
+    }
+
+    SNBLocalAddressSet addresses;
+    if (localAddresses) {
+        memset(&addresses, 0, sizeof(addresses));
+        for (NSString *string in localAddresses) {
+            uint8_t family = SNBAddressFamilyNone;
+            uint8_t address[16];
+            if (SNBPacketAddressFromString(string, &family, address)) {
+                SNBLocalAddressSetAdd(&addresses, family, address);
+            } else {
+                SNBLogNetworkWarn("Ignoring invalid replay local address: %{public}@", string);
+            }
+        }
+    } else {
+        SNBLocalAddressSetLoad(&addresses);
+    }
+
+    NSString *replayID = [NSUUID UUID].UUIDString;
+    self.replayID = replayID;
+    self.currentDeviceName = path.lastPathComponent;
+    self.isCapturing = YES;
+    self.captureStartDate = [NSDate date];
+    self.captureStats = nil;
+    dispatch_sync(self.captureQueue, ^{
+        self->_localAddresses = addresses;
+    });
+
+    SNBLogNetworkInfo("Replaying %{public}@ %{public}@", path,
+                      timing == SNBReplayTimingOriginal ? @"at original timing" : @"as fast as possible");
+    NSUInteger batchSize = MAX((NSUInteger)1, self.configuration.packetBatchMaxPackets);
+    [[SNBPassiveDNSCache sharedCache] beginReplay];
+    dispatch_async(self.replayQueue, ^{
+        [self runReplayWithReader:reader replayID:replayID timing:timing batchSize:batchSize];
+        SNBPcapFileReaderClose(reader);
+    });
+    return YES;
+}
+
+// Runs on the replay queue. Batches close when they fill or, at original
+// timing, before waiting for the next packet, so consumers see traffic when
+// it was captured rather than in bursts.
+- (void)runReplayWithReader:(SNBPcapFileReader *)reader
+                   replayID:(NSString *)replayID
+                     timing:(SNBReplayTiming)timing
+                  batchSize:(NSUInteger)batchSize {
+    SNBCaptureStats *stats = [[SNBCaptureStats alloc] init];
+    SNBPacketBatch *batch = [SNBPacketBatch batchWithCapacity:batchSize];
+    uint64_t firstPacketNs = 0;
+    uint64_t replayStartNs = 0;
+    uint64_t packetsRead = 0;
+    uint64_t undecoded = 0;
+    SNBPcapPacket packet;
+    // pcapng interfaces can differ in link type, so the decoder follows each packet's
+    uint32_t decoderLinkType = SNB_LINKTYPE_ETHERNET;
+    SNBPacketDecodeFunction decode = SNBPacketDecodeEthernet;
+    SNBPcapReadResult result;
+    SNBPassiveDNSCache *passiveDNS = [SNBPassiveDNSCache sharedCache];
+
+    while ((result = SNBPcapFileReaderNext(reader, &packet)) == SNBPcapReadPacket) {
+        if (++packetsRead == 1) {
+            firstPacketNs = packet.timestampNs;
+            replayStartNs = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+        }
+
+        if (timing == SNBReplayTimingOriginal) {
+            uint64_t offsetNs = packet.timestampNs > firstPacketNs ? packet.timestampNs - firstPacketNs : 0;
+            uint64_t dueNs = replayStartNs + offsetNs;
+            uint64_t nowNs = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+            if (dueNs > nowNs + NSEC_PER_MSEC && batch.count > 0) {
+                stats.packetsReceived = packetsRead - 1;
+                stats.packetsUndecoded = undecoded;
+                if (![self deliverReplayBatch:batch stats:stats replayID:replayID]) {
+                    return;
+                }
+                batch = [SNBPacketBatch batchWithCapacity:batchSize];
+            }
+            while ((nowNs = clock_gettime_nsec_np(CLOCK_UPTIME_RAW)) < dueNs) {
+                if (![self.replayID isEqualToString:replayID]) {
+                    return;
+                }
+                uint64_t sleepNs = MIN(dueNs - nowNs, kReplayMaxSleepNs);
+                struct timespec delay = { (time_t)(sleepNs / NSEC_PER_SEC), (long)(sleepNs % NSEC_PER_SEC) };
+                nanosleep(&delay, NULL);
+            }
+        }
+
+        SNBPacketRecord record;
+        if (packet.linkType != decoderLinkType) {
+            decoderLinkType = packet.linkType;
+            decode = SNBPacketDecoderForLinkType(decoderLinkType);
+        }
+        if (!decode || !decode(packet.data, packet.capturedLength, packet.wireLength, packet.timestampNs, &record)) {
+            undecoded++;
+            continue;
+        }
+        // Learned before the batch is delivered, so a flow's name is known
+        // by the time the statistics see it
+        [passiveDNS observeReplayRecord:&record frame:packet.data capturedLength:packet.capturedLength];
+        [batch appendRecords:&record count:1];
+        if (batch.count >= batchSize) {
+            stats.packetsReceived = packetsRead;
+            stats.packetsUndecoded = undecoded;
+            if (![self deliverReplayBatch:batch stats:stats replayID:replayID]) {
+                return;
+            }
+            batch = [SNBPacketBatch batchWithCapacity:batchSize];
+        }
+    }
+
+    stats.packetsReceived = packetsRead;
+    stats.packetsUndecoded = undecoded;
+    if (batch.count > 0 && ![self deliverReplayBatch:batch stats:stats replayID:replayID]) {
+        return;
+    }
+    if (result == SNBPcapReadError) {
+        SNBLogNetworkWarn("Replay stopped early: %{public}s", SNBPcapFileReaderError(reader));
+    }
+
+    double elapsed = (double)(clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - replayStartNs) / NSEC_PER_SEC;
+    SNBLogNetworkInfo("Replay finished: %llu packets (%llu undecoded) in %.3f s",
+                      (unsigned long long)packetsRead, (unsigned long long)undecoded, packetsRead > 0 ? elapsed : 0.0);
+
+    SNBCaptureStats *finalStats = [stats copy];
+    dispatch_async(dispatch_get_main_queue(), ^{
+        if (![self.replayID isEqualToString:replayID]) {
+            return;
+        }
+        self.replayID = nil;
+        self.isCapturing = NO;
+        if (self.onReplayFinished) {
+            self.onReplayFinished(finalStats);
+        }
+    });
+}
+
+// Hands a batch to the consumers through the capture queue. Waiting for the
+// capture queue keeps a fast replay from queueing the whole file in memory.
+- (BOOL)deliverReplayBatch:(SNBPacketBatch *)batch stats:(SNBCaptureStats *)stats replayID:(NSString *)replayID {
+    if (![self.replayID isEqualToString:replayID]) {
+        return NO;
+    }
+    stats.packetsDelivered += batch.count;
+    stats.batchCount++;
+    stats.lastBatchSize = batch.count;
+    SNBCaptureStats *snapshot = [stats copy];
+    self.captureStats = snapshot;
+    dispatch_sync(self.captureQueue, ^{
+        [self deliverBatch:batch stats:snapshot];
+    });
+    return YES;
+}
+
+// Runs on the session's queue. Waiting for the capture queue keeps a ring
+// from being drained faster than the consumers keep up.
+- (void)deliverBatch:(SNBPacketBatch *)batch stats:(SNBCaptureStats *)stats fromSession:(SNBCaptureSession *)session {
+    if (!session.active) {
+        return;
+    }
+    SNBPacketRecord *records = [batch mutableRecords];
+    uint8_t interfaceIndex = session.interfaceIndex;
+    for (NSUInteger i = 0; i < batch.count; i++) {
+        records[i].interfaceIndex = interfaceIndex;
+    }
+    dispatch_sync(self.captureQueue, ^{
+        [self deliverBatch:batch stats:stats];
+    });
+}
+
+// Runs on the capture queue for live and replayed batches alike
+- (void)deliverBatch:(SNBPacketBatch *)batch stats:(SNBCaptureStats *)stats {
+    SNBPacketRecordsClassifyDirection(&_localAddresses, [batch mutableRecords], batch.count);
+    if (self.deduplicating) {
+        size_t kept = SNBPacketDedupFilter(&_dedup, [batch mutableRecords], batch.count);
+        if (kept < batch.count) {
+            [batch truncateToCount:kept];
+            self.duplicatePackets = _dedup.duplicates;
+        }
+        if (kept == 0) {
+            return;
+        }
+    } else if (SNBFlowTableCount(_dedup.flows) > 0) {
+        // Back to one interface: owners from the multi-interface period would
+        // hide the flows when a second interface is added again
+        SNBPacketDedupReset(&_dedup);
+    }
+
+    // Checked inline against the offline blocklists, so a listed host is
+    // flagged from its first packet without waiting for a provider
+    size_t listed = SNBPacketRecordsMatchBlocklist(SNBBlocklistShared(), [batch mutableRecords], batch.count);
+    if (listed > 0) {
+        self.blocklistedPackets += listed;
+    }
+
+    void (^batchHandler)(SNBPacketBatch *, SNBCaptureStats *) = self.onPacketBatchReceived;
+    if (batchHandler) {
+        batchHandler(batch, stats);
+        return;
+    }
+
+    void (^packetHandler)(PacketInfo *) = self.onPacketReceived;
+    if (!packetHandler) {
+        return;
+    }
+    const SNBPacketRecord *records = batch.records;
+    for (NSUInteger i = 0; i < batch.count; i++) {
+        packetHandler([PacketInfo packetInfoWithRecord:&records[i]]);
+    }
+}
+
 @end
@@ -0,0 +1,357 @@
+//
+//  PacketDecoder.c
+//  SniffNetBar
+//
+//  Decodes captured link-layer frames into SNBPacketRecord
+//
+
+#include "PacketDecoder.h"
+#include <string.h>
+
+static const uint32_t kEthernetHeaderLength = 14;
+static const uint32_t kIPv4MinimumHeaderLength = 20;
+static const uint32_t kIPv6HeaderLength = 40;
+static const uint16_t kEtherTypeIPv4 = 0x0800;
+static const uint16_t kEtherTypeIPv6 = 0x86DD;
+static const uint16_t kEtherTypePPPoESession = 0x8864;
+static const uint16_t kPPPProtocolIPv4 = 0x0021;
+static const uint16_t kPPPProtocolIPv6 = 0x0057;
+
+// Bounds the IPv6 header chain so a crafted packet cannot keep the walk going
+#define SNB_IPV6_MAX_EXTENSION_HEADERS 8
+// 802.1ad plus 802.1Q is the common stack; more than this is not a real frame
+#define SNB_MAX_VLAN_TAGS 4
+
+static inline uint16_t SNBReadBE16(const uint8_t *bytes) {
+    return (uint16_t)((bytes[0] << 8) | bytes[1]);
+}
+
+static inline void SNBPacketRecordStart(SNBPacketRecord *record, uint32_t wireLength, uint64_t timestampNs) {
+    memset(record, 0, sizeof(*record));
+    record->timestampNs = timestampNs;
+    record->length = wireLength;
+}
+
+// MARK: - Transport
+
+// frame is the start of the captured frame, so the payload can be located in it
+static void SNBDecodeTransport(const uint8_t *frame,
+                               const uint8_t *transport,
+                               uint32_t transportLength,
+                               SNBPacketRecord *record) {
+    uint32_t headerLength;
+    switch (record->ipProtocol) {
+        case 6:  // TCP, needs a full 20-byte header
+            if (transportLength < 20) {
+                return;
+            }
+            record->tcpFlags = transport[13];
+            headerLength = (uint32_t)(transport[12] >> 4) * 4;
+            if (headerLength < 20) {
+                headerLength = 0;        // Bad data offset: ports, but no payload
+            }
+            break;
+        case 17: // UDP
+            if (transportLength < 8) {
+                return;
+            }
+            headerLength = 8;
+            break;
+        case 1:  // ICMP
+        case 58: // ICMPv6, both with type, code and checksum up front
+            if (transportLength >= 4) {
+                record->icmpType = transport[0];
+                record->icmpCode = transport[1];
+                record->flags |= SNBPacketRecordFlagHasICMP;
+            }
+            return;
+        default:
+            return;
+    }
+
+    record->sourcePort = SNBReadBE16(transport);
+    record->destinationPort = SNBReadBE16(transport + 2);
+    record->flags |= SNBPacketRecordFlagHasPorts;
+
+    size_t payloadOffset = (size_t)(transport - frame) + headerLength;
+    if (headerLength > 0 && headerLength < transportLength && payloadOffset <= UINT16_MAX) {
+        record->payloadOffset = (uint16_t)payloadOffset;
+    }
+}
+
+// MARK: - Network
+
+static void SNBDecodeIPv4(const uint8_t *frame, const uint8_t *packet, uint32_t length, SNBPacketRecord *record) {
+    if (length < kIPv4MinimumHeaderLength || (packet[0] >> 4) != 4) {
+        return;
+    }
+    uint32_t headerLength = (uint32_t)(packet[0] & 0x0F) * 4;
+    if (headerLength < kIPv4MinimumHeaderLength || length < headerLength) {
+        return;
+    }
+    // Ethernet pads short frames; the padding is not transport payload
+    uint32_t totalLength = SNBReadBE16(packet + 2);
+    if (totalLength >= headerLength && totalLength < length) {
+        length = totalLength;
+    }
+
+    record->family = SNBAddressFamilyIPv4;
+    record->ipProtocol = packet[9];
+    memcpy(record->sourceAddress, packet + 12, 4);
+    memcpy(record->destinationAddress, packet + 16, 4);
+
+    uint16_t fragment = SNBReadBE16(packet + 6);
+    if (fragment & 0x3FFF) {             // More-fragments bit or a non-zero offset
+        record->flags |= SNBPacketRecordFlagFragment;
+        if (fragment & 0x1FFF) {
+            return;
+        }
+    }
+    SNBDecodeTransport(frame, packet + headerLength, length - headerLength, record);
+}
+
+typedef enum {
+    SNBIPv6HeaderUpperLayer = 0,         // Ends the walk: transport or unknown protocol
+    SNBIPv6HeaderOptions,                // Length in 8-octet units, not counting the first 8
+    SNBIPv6HeaderFragment,               // Fixed 8 bytes
+    SNBIPv6HeaderAuthentication,         // Length in 4-octet units, not counting the first 8
+} SNBIPv6HeaderKind;
+
+// Next-header values indexed directly, so each step of the chain is one load
+static const uint8_t SNBIPv6HeaderKinds[256] = {
+    [0] = SNBIPv6HeaderOptions,          // Hop-by-hop options
+    [43] = SNBIPv6HeaderOptions,         // Routing
+    [44] = SNBIPv6HeaderFragment,
+    [51] = SNBIPv6HeaderAuthentication,
+    [60] = SNBIPv6HeaderOptions,         // Destination options
+    [135] = SNBIPv6HeaderOptions,        // Mobility
+    [139] = SNBIPv6HeaderOptions,        // Host identity protocol
+    [140] = SNBIPv6HeaderOptions,        // Shim6
+};
+
+static void SNBDecodeIPv6(const uint8_t *frame, const uint8_t *packet, uint32_t length, SNBPacketRecord *record) {
+    if (length < kIPv6HeaderLength || (packet[0] >> 4) != 6) {
+        return;
+    }
+    // A zero payload length is a jumbogram; keep what was captured
+    uint32_t payloadLength = SNBReadBE16(packet + 4);
+    if (payloadLength > 0 && payloadLength + kIPv6HeaderLength < length) {
+        length = payloadLength + kIPv6HeaderLength;
+    }
+
+    record->family = SNBAddressFamilyIPv6;
+    memcpy(record->sourceAddress, packet + 8, 16);
+    memcpy(record->destinationAddress, packet + 24, 16);
+
+    uint8_t nextHeader = packet[6];
+    uint32_t offset = kIPv6HeaderLength;
+    for (int i = 0; i < SNB_IPV6_MAX_EXTENSION_HEADERS; i++) {
+        SNBIPv6HeaderKind kind = (SNBIPv6HeaderKind)SNBIPv6HeaderKinds[nextHeader];
+        if (kind == SNBIPv6HeaderUpperLayer) {
+            break;
+        }
+        if (length - offset < 8) {
+            // Truncated inside the chain: report the header it stopped at
+            record->ipProtocol = nextHeader;
+            return;
+        }
+        const uint8_t *header = packet + offset;
+        uint32_t headerLength;
+        switch (kind) {
+            case SNBIPv6HeaderFragment:
+                record->flags |= SNBPacketRecordFlagFragment;
+                if (SNBReadBE16(header + 2) & 0xFFF8) {
+                    // Later fragments carry no transport header
+                    record->ipProtocol = header[0];
+                    return;
+                }
+                headerLength = 8;
+                break;
+            case SNBIPv6HeaderAuthentication:
+                headerLength = ((uint32_t)header[1] + 2) * 4;
+                break;
+            default:
+                headerLength = ((uint32_t)header[1] + 1) * 8;
+                break;
+        }
+        nextHeader = header[0];
+        if (length - offset < headerLength) {
+            record->ipProtocol = nextHeader;
+            return;
+        }
+        offset += headerLength;
+    }
+
+    record->ipProtocol = nextHeader;
+    if (SNBIPv6HeaderKinds[nextHeader] == SNBIPv6HeaderUpperLayer) {
+        SNBDecodeTransport(frame, packet + offset, length - offset, record);
+    }
+}
+
+static inline void SNBDecodeIP(const uint8_t *frame, const uint8_t *packet, uint32_t length, SNBPacketRecord *record) {
+    // Raw and loopback link types say nothing reliable about the version
+    switch (packet[0] >> 4) {
+        case 4:
+            SNBDecodeIPv4(frame, packet, length, record);
+            break;
+        case 6:
+            SNBDecodeIPv6(frame, packet, length, record);
+            break;
+        default:
+            break;
+    }
+}
+
+// Decodes what follows an EtherType at offset, walking VLAN tags and PPPoE
+static void SNBDecodeEtherType(const uint8_t *frame,
+                               uint32_t capturedLength,
+                               uint32_t offset,
+                               uint16_t etherType,
+                               SNBPacketRecord *record) {
+    for (int tags = 0; tags < SNB_MAX_VLAN_TAGS; tags++) {
+        // 802.1Q, 802.1ad and the pre-standard QinQ tag
+        if (etherType != 0x8100 && etherType != 0x88A8 && etherType != 0x9100) {
+            break;
+        }
+        if (capturedLength - offset < 4) {
+            return;
+        }
+        if (!(record->flags & SNBPacketRecordFlagVLAN)) {
+            record->vlanID = SNBReadBE16(frame + offset) & 0x0FFF;
+            record->flags |= SNBPacketRecordFlagVLAN;
+        }
+        etherType = SNBReadBE16(frame + offset + 2);
+        offset += 4;
+    }
+
+    if (etherType == kEtherTypePPPoESession) {
+        // Version/type, code, session ID and length, then the PPP protocol
+        if (capturedLength - offset < 8 || frame[offset] != 0x11 || frame[offset + 1] != 0) {
+            return;
+        }
+        uint16_t pppProtocol = SNBReadBE16(frame + offset + 6);
+        offset += 8;
+        etherType = pppProtocol == kPPPProtocolIPv4 ? kEtherTypeIPv4 :
+            pppProtocol == kPPPProtocolIPv6 ? kEtherTypeIPv6 : 0;
+    }
+
+    if (etherType == kEtherTypeIPv4) {
+        SNBDecodeIPv4(frame, frame + offset, capturedLength - offset, record);
+    } else if (etherType == kEtherTypeIPv6) {
+        SNBDecodeIPv6(frame, frame + offset, capturedLength - offset, record);
+    }
+}
+
+// MARK: - Link layers
+
+bool SNBPacketDecodeEthernet(const uint8_t *frame,
+                             uint32_t capturedLength,
+                             uint32_t wireLength,
+                             uint64_t timestampNs,
+                             SNBPacketRecord *record) {
+    if (capturedLength <= kEthernetHeaderLength) {
+        return false;
+    }
+    SNBPacketRecordStart(record, wireLength, timestampNs);
+    SNBDecodeEtherType(frame, capturedLength, kEthernetHeaderLength, SNBReadBE16(frame + 12), record);
+    return true;
+}
+
+// 4-byte address family. DLT_NULL writes it in the capturing host's byte
+// order and DLT_LOOP in network order; families are small, so the smaller
+// reading is the right one either way.
+static bool SNBPacketDecodeLoopback(const uint8_t *frame,
+                                    uint32_t capturedLength,
+                                    uint32_t wireLength,
+                                    uint64_t timestampNs,
+                                    SNBPacketRecord *record) {
+    if (capturedLength <= 4) {
+        return false;
+    }
+    SNBPacketRecordStart(record, wireLength, timestampNs);
+    uint32_t little = (uint32_t)frame[0] | ((uint32_t)frame[1] << 8) | ((uint32_t)frame[2] << 16) |
+        ((uint32_t)frame[3] << 24);
+    uint32_t big = ((uint32_t)frame[0] << 24) | ((uint32_t)frame[1] << 16) | ((uint32_t)frame[2] << 8) |
+        (uint32_t)frame[3];
+    uint32_t family = little < big ? little : big;
+    switch (family) {
+        case 2:                          // AF_INET everywhere
+            SNBDecodeIPv4(frame, frame + 4, capturedLength - 4, record);
+            break;
+        case 10:                         // AF_INET6 on Linux
+        case 24:                         // NetBSD, OpenBSD
+        case 28:                         // FreeBSD, DragonFly
+        case 30:                         // macOS
+            SNBDecodeIPv6(frame, frame + 4, capturedLength - 4, record);
+            break;
+        default:
+            break;
+    }
+    return true;
+}
+
+static bool SNBPacketDecodeRaw(const uint8_t *frame,
+                               uint32_t capturedLength,
+                               uint32_t wireLength,
+                               uint64_t timestampNs,
+                               SNBPacketRecord *record) {
+    if (capturedLength == 0) {
+        return false;
+    }
+    SNBPacketRecordStart(record, wireLength, timestampNs);
+    SNBDecodeIP(frame, frame, capturedLength, record);
+    return true;
+}
+
+static bool SNBPacketDecodeLinuxCooked(const uint8_t *frame,
+                                       uint32_t capturedLength,
+                                       uint32_t wireLength,
+                                       uint64_t timestampNs,
+                                       SNBPacketRecord *record) {
+    // Packet type, address type and length, 8 address bytes, then the protocol
+    if (capturedLength <= 16) {
+        return false;
+    }
+    SNBPacketRecordStart(record, wireLength, timestampNs);
+    SNBDecodeEtherType(frame, capturedLength, 16, SNBReadBE16(frame + 14), record);
+    return true;
+}
+
+static bool SNBPacketDecodeLinuxCooked2(const uint8_t *frame,
+                                        uint32_t capturedLength,
+                                        uint32_t wireLength,
+                                        uint64_t timestampNs,
+                                        SNBPacketRecord *record) {
+    // Protocol first, then interface index, types and 8 address bytes
+    if (capturedLength <= 20) {
+        return false;
+    }
+    SNBPacketRecordStart(record, wireLength, timestampNs);
+    SNBDecodeEtherType(frame, capturedLength, 20, SNBReadBE16(frame), record);
+    return true;
+}
+
+static const struct {
+    uint32_t linkType;
+    SNBPacketDecodeFunction decode;
+} SNBPacketDecoders[] = {
+    {SNB_LINKTYPE_ETHERNET, SNBPacketDecodeEthernet},
+    {SNB_LINKTYPE_NULL, SNBPacketDecodeLoopback},
+    {SNB_LINKTYPE_LOOP, SNBPacketDecodeLoopback},
+    {SNB_LINKTYPE_DLT_RAW, SNBPacketDecodeRaw},
+    {SNB_LINKTYPE_DLT_RAW_OPENBSD, SNBPacketDecodeRaw},
+    {SNB_LINKTYPE_RAW, SNBPacketDecodeRaw},
+    {SNB_LINKTYPE_IPV4, SNBPacketDecodeRaw},
+    {SNB_LINKTYPE_IPV6, SNBPacketDecodeRaw},
+    {SNB_LINKTYPE_LINUX_SLL, SNBPacketDecodeLinuxCooked},
+    {SNB_LINKTYPE_LINUX_SLL2, SNBPacketDecodeLinuxCooked2},
+};
+
+SNBPacketDecodeFunction SNBPacketDecoderForLinkType(uint32_t linkType) {
+    for (size_t i = 0; i < sizeof(SNBPacketDecoders) / sizeof(SNBPacketDecoders[0]); i++) {
+        if (SNBPacketDecoders[i].linkType == linkType) {
+            return SNBPacketDecoders[i].decode;
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,60 @@
+//
+//  PacketDecoder.h
+//  SniffNetBar
+//
+//  Decodes captured link-layer frames into SNBPacketRecord
+//
+
+#ifndef SNB_PACKET_DECODER_H
+#define SNB_PACKET_DECODER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "PacketRecord.h"
+
+// Link types with a decoder. pcap_datalink() returns DLT_* values and capture
+// files carry LINKTYPE_* values; they agree except for raw IP, so both
+// numbers are listed for it.
+#define SNB_LINKTYPE_NULL 0            // BSD loopback, host byte order family (lo0, utun)
+#define SNB_LINKTYPE_ETHERNET 1
+#define SNB_LINKTYPE_DLT_RAW 12        // DLT_RAW on macOS and Linux
+#define SNB_LINKTYPE_DLT_RAW_OPENBSD 14
+#define SNB_LINKTYPE_RAW 101           // LINKTYPE_RAW in capture files
+#define SNB_LINKTYPE_LOOP 108          // OpenBSD loopback, network byte order family
+#define SNB_LINKTYPE_LINUX_SLL 113     // Linux "any" device
+#define SNB_LINKTYPE_IPV4 228
+#define SNB_LINKTYPE_IPV6 229
+#define SNB_LINKTYPE_LINUX_SLL2 276
+
+// Every decoder fills a zeroed record with the timestamp and wire length, then
+// as much of the network and transport headers as the captured bytes hold:
+//   - Ethernet walks any number of 802.1Q/802.1ad tags (QinQ), keeping the
+//     outermost VLAN ID, and unwraps PPPoE session frames.
+//   - IPv4 and IPv6 fill addresses and the upper-layer protocol; IPv6
+//     hop-by-hop, routing, destination-options, fragment, AH and mobility
+//     headers are walked to reach it.
+//   - Fragments are flagged, and only a datagram's first fragment can carry
+//     ports or ICMP fields.
+//   - TCP gives ports and control bits, UDP ports, ICMP and ICMPv6 type and
+//     code.
+// Non-IP frames still produce a record (family SNBAddressFamilyNone) so byte
+// counters stay complete. A decoder returns false only for frames too short
+// to carry a payload. Decoders never allocate and never read past
+// capturedLength.
+typedef bool (*SNBPacketDecodeFunction)(const uint8_t *frame,
+                                        uint32_t capturedLength,
+                                        uint32_t wireLength,
+                                        uint64_t timestampNs,
+                                        SNBPacketRecord *record);
+
+// The decoder for a DLT_* or LINKTYPE_* value, or NULL if the link type is
+// not supported. Look it up once per capture handle, not per packet.
+SNBPacketDecodeFunction SNBPacketDecoderForLinkType(uint32_t linkType);
+
+bool SNBPacketDecodeEthernet(const uint8_t *frame,
+                             uint32_t capturedLength,
+                             uint32_t wireLength,
+                             uint64_t timestampNs,
+                             SNBPacketRecord *record);
+
+#endif
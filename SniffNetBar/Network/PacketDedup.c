@@ -0,0 +1,93 @@
+//
+//  PacketDedup.c
+//  SniffNetBar
+//
+//  Removes packets captured on more than one interface at the same time
+//
+
+#include "PacketDedup.h"
+#include <string.h>
+
+typedef struct {
+    uint64_t lastNs;                 // Latest packet of the flow on its owner
+    uint8_t interfaceIndex;
+} SNBPacketDedupOwner;
+
+bool SNBPacketDedupInit(SNBPacketDedup *dedup, uint64_t windowNs, size_t initialCapacity) {
+    memset(dedup, 0, sizeof(*dedup));
+    dedup->windowNs = windowNs > 0 ? windowNs : SNB_PACKET_DEDUP_DEFAULT_WINDOW_NS;
+    dedup->flows = SNBFlowTableCreate(sizeof(SNBPacketDedupOwner), initialCapacity);
+    return dedup->flows != NULL;
+}
+
+void SNBPacketDedupDestroy(SNBPacketDedup *dedup) {
+    SNBFlowTableDestroy(dedup->flows);
+    memset(dedup, 0, sizeof(*dedup));
+}
+
+void SNBPacketDedupReset(SNBPacketDedup *dedup) {
+    SNBFlowTableClear(dedup->flows);
+    dedup->latestNs = 0;
+    dedup->nextSweepNs = 0;
+}
+
+// Sessions deliver their batches independently, so a copy can arrive well
+// after the original; owners are kept for a second window to still match it
+static void SNBPacketDedupSweep(SNBPacketDedup *dedup) {
+    uint64_t retentionNs = 2 * dedup->windowNs;
+    uint64_t horizonNs = dedup->latestNs > retentionNs ? dedup->latestNs - retentionNs : 0;
+    size_t cursor = 0;
+    const SNBPacketDedupOwner *owner;
+    while ((owner = SNBFlowTableNext(dedup->flows, &cursor, NULL)) != NULL) {
+        if (owner->lastNs < horizonNs) {
+            SNBFlowTableRemoveCurrent(dedup->flows, &cursor);
+        }
+    }
+    dedup->nextSweepNs = dedup->latestNs + dedup->windowNs;
+}
+
+size_t SNBPacketDedupFilter(SNBPacketDedup *dedup, SNBPacketRecord *records, size_t count) {
+    size_t kept = 0;
+    for (size_t i = 0; i < count; i++) {
+        const SNBPacketRecord *record = &records[i];
+        uint64_t timestampNs = record->timestampNs;
+        if (timestampNs > dedup->latestNs) {
+            dedup->latestNs = timestampNs;
+        }
+
+        bool duplicate = false;
+        if (record->family != SNBAddressFamilyNone) {
+            SNBFlowKey key;
+            SNBFlowKeyMakeRecord(&key, record);
+            bool inserted = false;
+            SNBPacketDedupOwner *owner = SNBFlowTableUpsert(dedup->flows, &key, &inserted);
+            if (!owner) {
+                // Out of memory: counting a copy beats losing the packet
+            } else if (inserted || owner->interfaceIndex == record->interfaceIndex) {
+                owner->interfaceIndex = record->interfaceIndex;
+                if (timestampNs > owner->lastNs) {
+                    owner->lastNs = timestampNs;
+                }
+            } else if (timestampNs <= owner->lastNs + dedup->windowNs) {
+                duplicate = true;
+            } else {
+                owner->interfaceIndex = record->interfaceIndex;
+                owner->lastNs = timestampNs;
+            }
+        }
+
+        if (duplicate) {
+            dedup->duplicates++;
+            continue;
+        }
+        if (kept != i) {
+            records[kept] = *record;
+        }
+        kept++;
+    }
+
+    if (dedup->latestNs >= dedup->nextSweepNs) {
+        SNBPacketDedupSweep(dedup);
+    }
+    return kept;
+}
@@ -0,0 +1,48 @@
+//
+//  PacketDedup.h
+//  SniffNetBar
+//
+//  Removes packets captured on more than one interface at the same time
+//
+
+#ifndef SNB_PACKET_DEDUP_H
+#define SNB_PACKET_DEDUP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "FlowTable.h"
+#include "PacketRecord.h"
+
+// A tunnel that hands its inner packets to the underlay in the clear, a
+// bridge and its member ports, or a VLAN and its parent all show the same
+// packets twice when both interfaces are captured. Each flow (the 5-tuple,
+// per direction) belongs to the interface it was first seen on, and copies
+// from any other interface are dropped while the owner keeps carrying it.
+// A flow that has been quiet on its owner for longer than the window moves
+// to the next interface that carries it, which follows a route change from
+// Wi-Fi to Ethernet.
+#define SNB_PACKET_DEDUP_DEFAULT_WINDOW_NS 1000000000ULL
+
+typedef struct SNBPacketDedup {
+    SNBFlowTable *flows;             // Record 5-tuple -> owning interface
+    uint64_t windowNs;
+    uint64_t latestNs;               // Latest capture time seen
+    uint64_t nextSweepNs;            // Capture time of the next expiry sweep
+    uint64_t duplicates;             // Records dropped so far
+} SNBPacketDedup;
+
+bool SNBPacketDedupInit(SNBPacketDedup *dedup, uint64_t windowNs, size_t initialCapacity);
+void SNBPacketDedupDestroy(SNBPacketDedup *dedup);
+
+// Forgets every flow but keeps the table allocation and the duplicate count
+void SNBPacketDedupReset(SNBPacketDedup *dedup);
+
+// Drops duplicates in place, keeping the order of the remaining records, and
+// returns how many remain. Records must carry their interfaceIndex; records
+// without addresses are always kept. Flows idle for two windows are
+// forgotten as capture time advances, so the table holds only the flows of
+// the last few seconds.
+size_t SNBPacketDedupFilter(SNBPacketDedup *dedup, SNBPacketRecord *records, size_t count);
+
+#endif
@@ -0,0 +1,96 @@
+//
+//  PacketDirection.c
+//  SniffNetBar
+//
+//  Local-address set and in-place direction tagging for packet records
+//
+
+#include "PacketDirection.h"
+#include "AddressClassifier.h"
+#include <arpa/inet.h>
+#include <ifaddrs.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+
+static inline size_t SNBAddressLength(uint8_t family) {
+    return family == SNBAddressFamilyIPv6 ? 16 : 4;
+}
+
+bool SNBLocalAddressSetAdd(SNBLocalAddressSet *set, uint8_t family, const uint8_t *address) {
+    if (SNBLocalAddressSetContains(set, family, address)) {
+        return true;
+    }
+    if (set->count >= SNB_LOCAL_ADDRESS_SET_CAPACITY) {
+        return false;
+    }
+    set->entries[set->count].family = family;
+    memset(set->entries[set->count].address, 0, sizeof(set->entries[set->count].address));
+    memcpy(set->entries[set->count].address, address, SNBAddressLength(family));
+    set->count++;
+    return true;
+}
+
+void SNBLocalAddressSetLoad(SNBLocalAddressSet *set) {
+    memset(set, 0, sizeof(*set));
+
+    struct ifaddrs *interfaces = NULL;
+    if (getifaddrs(&interfaces) == 0) {
+        for (struct ifaddrs *interface = interfaces; interface != NULL; interface = interface->ifa_next) {
+            if (interface->ifa_addr == NULL) {
+                continue;
+            }
+            if (interface->ifa_addr->sa_family == AF_INET) {
+                struct sockaddr_in *sin = (struct sockaddr_in *)interface->ifa_addr;
+                SNBLocalAddressSetAdd(set, SNBAddressFamilyIPv4, (const uint8_t *)&sin->sin_addr);
+            } else if (interface->ifa_addr->sa_family == AF_INET6) {
+                struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)interface->ifa_addr;
+                SNBLocalAddressSetAdd(set, SNBAddressFamilyIPv6, (const uint8_t *)&sin6->sin6_addr);
+            }
+        }
+        freeifaddrs(interfaces);
+    }
+
+    static const uint8_t loopback4[4] = {127, 0, 0, 1};
+    static const uint8_t loopback6[16] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1};
+    SNBLocalAddressSetAdd(set, SNBAddressFamilyIPv4, loopback4);
+    SNBLocalAddressSetAdd(set, SNBAddressFamilyIPv6, loopback6);
+}
+
+bool SNBLocalAddressSetContains(const SNBLocalAddressSet *set, uint8_t family, const uint8_t *address) {
+    size_t length = SNBAddressLength(family);
+    for (size_t i = 0; i < set->count; i++) {
+        if (set->entries[i].family == family && memcmp(set->entries[i].address, address, length) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void SNBPacketRecordsClassifyDirection(const SNBLocalAddressSet *set, SNBPacketRecord *records, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        SNBPacketRecord *record = &records[i];
+        record->flags &= (uint8_t)~(SNBPacketRecordFlagOutgoing | SNBPacketRecordFlagBothLocal);
+        if (record->family == SNBAddressFamilyNone) {
+            continue;
+        }
+
+        bool sourceLocal = SNBLocalAddressSetContains(set, record->family, record->sourceAddress);
+        bool destinationLocal = SNBLocalAddressSetContains(set, record->family, record->destinationAddress);
+        bool outgoing = sourceLocal;
+        if (sourceLocal && destinationLocal) {
+            record->flags |= SNBPacketRecordFlagBothLocal;
+            if ((record->flags & SNBPacketRecordFlagHasPorts) &&
+                record->sourcePort > 0 && record->destinationPort > 0) {
+                outgoing = record->sourcePort >= record->destinationPort;
+            }
+        }
+        if (outgoing) {
+            record->flags |= SNBPacketRecordFlagOutgoing;
+        }
+    }
+}
+
+bool SNBAddressIsPrivate(uint8_t family, const uint8_t *address) {
+    return (SNBAddressClassify(SNBAddressClassifierShared(), family, address) & SNBAddressClassLocalMask) != 0;
+}
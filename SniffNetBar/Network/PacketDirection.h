@@ -0,0 +1,50 @@
+//
+//  PacketDirection.h
+//  SniffNetBar
+//
+//  Local-address set and in-place direction tagging for packet records
+//
+
+#ifndef SNB_PACKET_DIRECTION_H
+#define SNB_PACKET_DIRECTION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "PacketRecord.h"
+
+#define SNB_LOCAL_ADDRESS_SET_CAPACITY 64
+
+// Addresses assigned to this host, kept inline so lookups never allocate
+typedef struct SNBLocalAddressSet {
+    size_t count;
+    struct {
+        uint8_t family;
+        uint8_t address[16];
+    } entries[SNB_LOCAL_ADDRESS_SET_CAPACITY];
+} SNBLocalAddressSet;
+
+// Fills the set from getifaddrs() plus the loopback addresses
+void SNBLocalAddressSetLoad(SNBLocalAddressSet *set);
+bool SNBLocalAddressSetAdd(SNBLocalAddressSet *set, uint8_t family, const uint8_t *address);
+bool SNBLocalAddressSetContains(const SNBLocalAddressSet *set, uint8_t family, const uint8_t *address);
+
+// Sets SNBPacketRecordFlagOutgoing and SNBPacketRecordFlagBothLocal on each
+// record. A record is outgoing when its source is local; when both ends are
+// local the lower port is treated as the server, and traffic between two
+// remote hosts counts as incoming.
+void SNBPacketRecordsClassifyDirection(const SNBLocalAddressSet *set, SNBPacketRecord *records, size_t count);
+
+static inline const uint8_t *SNBPacketRecordRemoteAddress(const SNBPacketRecord *record) {
+    return (record->flags & SNBPacketRecordFlagOutgoing) ? record->destinationAddress : record->sourceAddress;
+}
+
+static inline const uint8_t *SNBPacketRecordLocalAddress(const SNBPacketRecord *record) {
+    return (record->flags & SNBPacketRecordFlagOutgoing) ? record->sourceAddress : record->destinationAddress;
+}
+
+// Private, loopback, link-local, unique-local and user-configured ranges
+// (SNBAddressClassLocalMask) in the shared address classifier
+bool SNBAddressIsPrivate(uint8_t family, const uint8_t *address);
+
+#endif
@@ -0,0 +1,39 @@
+//
+//  PacketRingConsumer.h
+//  SniffNetBar
+//
+//  App side of the shared-memory packet ring handed over by the helper
+//
+
+#import <Foundation/Foundation.h>
+
+@class SNBPacketBatch;
+@class SNBCaptureStats;
+
+NS_ASSUME_NONNULL_BEGIN
+
+@interface SNBPacketRingConsumer : NSObject
+
+// Maps the ring behind memoryHandle and listens for wakeups on wakeupHandle.
+// Returns nil if the mapping does not carry a compatible ring.
+- (nullable instancetype)initWithMemoryHandle:(NSFileHandle *)memoryHandle
+                                wakeupHandle:(NSFileHandle *)wakeupHandle
+                                       queue:(dispatch_queue_t)queue NS_DESIGNATED_INITIALIZER;
+- (instancetype)init NS_UNAVAILABLE;
+
+// Called on the queue with every drained batch. Records are copied out of the
+// ring, so the batch stays valid after the slots are released.
+@property (nonatomic, copy, nullable) void (^onPacketBatch)(SNBPacketBatch *batch, SNBCaptureStats *stats);
+// Called on the queue when the helper closes its end of the wakeup channel
+@property (nonatomic, copy, nullable) void (^onClosed)(void);
+
+- (void)start;
+// Safe to call from any thread; the mapping is released on the queue
+- (void)cancel;
+
+// Latest counters read from the ring header. Call on the queue.
+- (SNBCaptureStats *)currentStats;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,182 @@
+//
+//  PacketRingConsumer.m
+//  SniffNetBar
+//
+//  App side of the shared-memory packet ring handed over by the helper
+//
+
+#import "PacketRingConsumer.h"
+#import "PacketBatch.h"
+#import "PacketRing.h"
+#import "CaptureStats.h"
+#import "Logger.h"
+#import <fcntl.h>
+
+// Records copied out per queue turn before yielding to other work
+static const NSUInteger kSNBRingDrainBudget = 8192;
+
+@interface SNBPacketRingConsumer ()
+@property (nonatomic, assign) SNBPacketRing *ring;
+@property (nonatomic, strong) NSFileHandle *wakeupHandle;
+@property (nonatomic, strong) dispatch_queue_t queue;
+@property (nonatomic, strong) dispatch_source_t wakeupSource;
+@property (atomic, assign) BOOL started;
+@property (nonatomic, assign) uint64_t batchCount;
+@property (nonatomic, assign) NSUInteger lastBatchSize;
+@end
+
+@implementation SNBPacketRingConsumer
+
+- (instancetype)initWithMemoryHandle:(NSFileHandle *)memoryHandle
+                        wakeupHandle:(NSFileHandle *)wakeupHandle
+                               queue:(dispatch_queue_t)queue {
+    self = [super init];
+    if (self) {
+        _ring = SNBPacketRingAttachConsumer(memoryHandle.fileDescriptor);
+        // The mapping outlives the descriptor
+        [memoryHandle closeFile];
+        if (!_ring) {
+            return nil;
+        }
+        _wakeupHandle = wakeupHandle;
+        _queue = queue;
+
+        int wakeupFD = wakeupHandle.fileDescriptor;
+        fcntl(wakeupFD, F_SETFL, fcntl(wakeupFD, F_GETFL) | O_NONBLOCK);
+        _wakeupSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_READ, (uintptr_t)wakeupFD, 0, queue);
+
+        // The cancel handler owns teardown so the ring is never unmapped while
+        // a drain is running on the queue.
+        SNBPacketRing *ring = _ring;
+        NSFileHandle *handle = wakeupHandle;
+        dispatch_source_set_cancel_handler(_wakeupSource, ^{
+            SNBPacketRingDestroy(ring);
+            [handle closeFile];
+        });
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [self cancel];
+}
+
+- (void)start {
+    if (self.started) {
+        return;
+    }
+    self.started = YES;
+    __weak typeof(self) weakSelf = self;
+    dispatch_source_set_event_handler(self.wakeupSource, ^{
+        [weakSelf handleWakeup];
+    });
+    dispatch_resume(self.wakeupSource);
+    dispatch_async(self.queue, ^{
+        [weakSelf drain];
+    });
+}
+
+- (void)cancel {
+    dispatch_source_t source = self.wakeupSource;
+    if (source && !dispatch_source_testcancel(source)) {
+        dispatch_source_cancel(source);
+        if (!self.started) {
+            // A suspended source never runs its cancel handler
+            self.started = YES;
+            dispatch_resume(source);
+        }
+    }
+}
+
+- (BOOL)isCancelled {
+    return dispatch_source_testcancel(self.wakeupSource) != 0;
+}
+
+- (void)handleWakeup {
+    if ([self isCancelled]) {
+        return;
+    }
+
+    char buffer[64];
+    ssize_t bytesRead;
+    BOOL closed = NO;
+    do {
+        bytesRead = read(self.wakeupHandle.fileDescriptor, buffer, sizeof(buffer));
+        if (bytesRead == 0) {
+            closed = YES;
+        }
+    } while (bytesRead > 0);
+
+    [self drain];
+
+    if (closed && ![self isCancelled]) {
+        SNBLogNetworkWarn("Helper closed the packet ring");
+        [self cancel];
+        if (self.onClosed) {
+            self.onClosed();
+        }
+    }
+}
+
+- (void)drain {
+    if ([self isCancelled]) {
+        return;
+    }
+
+    SNBPacketRing *ring = self.ring;
+    SNBPacketBatch *batch = nil;
+    BOOL parked = NO;
+    while (batch.count < kSNBRingDrainBudget) {
+        size_t count = 0;
+        const SNBPacketRecord *records = SNBPacketRingPeek(ring, &count);
+        if (count == 0) {
+            if (SNBPacketRingPrepareToWait(ring)) {
+                parked = YES;
+                break;
+            }
+            continue;
+        }
+
+        if (!batch) {
+            batch = [SNBPacketBatch batchWithCapacity:MIN((NSUInteger)SNBPacketRingGetStats(ring).lag, kSNBRingDrainBudget)];
+        }
+        count = MIN(count, (size_t)(kSNBRingDrainBudget - batch.count));
+        [batch appendRecords:records count:count];
+        SNBPacketRingRelease(ring, count);
+    }
+
+    if (batch.count > 0) {
+        self.batchCount++;
+        self.lastBatchSize = batch.count;
+        if (self.onPacketBatch) {
+            self.onPacketBatch(batch, [self currentStats]);
+        }
+    }
+
+    if (!parked) {
+        // Budget exhausted with records still pending and no wakeup armed
+        __weak typeof(self) weakSelf = self;
+        dispatch_async(self.queue, ^{
+            [weakSelf drain];
+        });
+    }
+}
+
+- (SNBCaptureStats *)currentStats {
+    SNBCaptureStats *stats = [[SNBCaptureStats alloc] init];
+    if ([self isCancelled]) {
+        return stats;
+    }
+    SNBPacketRingStats ringStats = SNBPacketRingGetStats(self.ring);
+    stats.packetsReceived = ringStats.kernelReceived;
+    stats.kernelDropped = ringStats.kernelDropped;
+    stats.interfaceDropped = ringStats.interfaceDropped;
+    stats.ringDropped = ringStats.dropped;
+    stats.ringLag = ringStats.lag;
+    stats.packetsDelivered = ringStats.consumed;
+    stats.batchCount = self.batchCount;
+    stats.lastBatchSize = self.lastBatchSize;
+    return stats;
+}
+
+@end
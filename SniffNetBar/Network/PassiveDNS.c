@@ -0,0 +1,424 @@
+//
+//  PassiveDNS.c
+//  SniffNetBar
+//
+//  Address -> name table learned from DNS answers seen on the wire
+//
+
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+
+#include "PassiveDNS.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "DNSMessage.h"
+
+// Slots an address may occupy, starting at its hash
+#define SNB_PASSIVE_DNS_PROBE 8
+// Times a reader re-reads an entry the writer keeps changing
+#define SNB_PASSIVE_DNS_READ_ATTEMPTS 4
+
+typedef struct SNBPassiveDNSHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t entrySize;
+    uint32_t capacity;
+    uint32_t reserved;
+    _Atomic uint64_t responses;
+    _Atomic uint64_t truncated;
+    _Atomic uint64_t stored;
+    _Atomic uint64_t replaced;
+    _Atomic uint64_t skipped;
+    _Atomic uint64_t occupied;
+} SNBPassiveDNSHeader;
+
+_Static_assert(sizeof(SNBPassiveDNSHeader) == 64, "Passive DNS header layout changed");
+
+typedef struct SNBPassiveDNSBinding {
+    uint32_t expires;                // Unix seconds; 0 in a slot never written
+    uint8_t family;
+    uint8_t source;                  // SNBPassiveDNSSource
+    uint8_t nameLength;
+    uint8_t reserved;
+    uint8_t address[16];
+    char name[SNB_PASSIVE_DNS_MAX_NAME];
+} SNBPassiveDNSBinding;
+
+typedef struct SNBPassiveDNSEntry {
+    _Atomic uint32_t sequence;       // Odd while the writer changes the binding
+    SNBPassiveDNSBinding binding;
+} SNBPassiveDNSEntry;
+
+_Static_assert(sizeof(SNBPassiveDNSEntry) == 128, "Passive DNS entry layout changed");
+
+struct SNBPassiveDNSTable {
+    SNBPassiveDNSHeader *header;
+    SNBPassiveDNSEntry *entries;
+    size_t mappingSize;
+    uint32_t mask;
+};
+
+uint32_t SNBPassiveDNSNormalizeCapacity(uint32_t capacity) {
+    if (capacity < SNB_PASSIVE_DNS_MIN_CAPACITY) {
+        return SNB_PASSIVE_DNS_MIN_CAPACITY;
+    }
+    if (capacity > SNB_PASSIVE_DNS_MAX_CAPACITY) {
+        return SNB_PASSIVE_DNS_MAX_CAPACITY;
+    }
+    uint32_t rounded = SNB_PASSIVE_DNS_MIN_CAPACITY;
+    while (rounded < capacity) {
+        rounded <<= 1;
+    }
+    return rounded;
+}
+
+size_t SNBPassiveDNSMappingSize(uint32_t capacity) {
+    return sizeof(SNBPassiveDNSHeader) + (size_t)capacity * sizeof(SNBPassiveDNSEntry);
+}
+
+// MARK: - Mapping
+
+int SNBPassiveDNSCreateSharedMemory(uint32_t capacity) {
+    static _Atomic uint32_t sequence = 0;
+    capacity = SNBPassiveDNSNormalizeCapacity(capacity);
+
+    char name[32];
+    int fd = -1;
+    for (int attempt = 0; attempt < 8 && fd < 0; attempt++) {
+        snprintf(name, sizeof(name), "/snbdns.%d.%u", (int)getpid(),
+                 (unsigned)atomic_fetch_add(&sequence, 1));
+        fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd < 0 && errno != EEXIST) {
+            return -1;
+        }
+    }
+    if (fd < 0) {
+        return -1;
+    }
+    shm_unlink(name);
+
+    if (ftruncate(fd, (off_t)SNBPassiveDNSMappingSize(capacity)) != 0) {
+        int savedErrno = errno;
+        close(fd);
+        errno = savedErrno;
+        return -1;
+    }
+    return fd;
+}
+
+static SNBPassiveDNSTable *SNBPassiveDNSMap(int fd, size_t size, int protection, int flags) {
+    void *memory = mmap(NULL, size, protection, flags, fd, 0);
+    if (memory == MAP_FAILED) {
+        return NULL;
+    }
+    SNBPassiveDNSTable *table = calloc(1, sizeof(SNBPassiveDNSTable));
+    if (!table) {
+        munmap(memory, size);
+        return NULL;
+    }
+    table->header = (SNBPassiveDNSHeader *)memory;
+    table->entries = (SNBPassiveDNSEntry *)((uint8_t *)memory + sizeof(SNBPassiveDNSHeader));
+    table->mappingSize = size;
+    return table;
+}
+
+// Fresh mappings are zero-filled, so every slot starts empty
+static void SNBPassiveDNSFormat(SNBPassiveDNSTable *table, uint32_t capacity) {
+    SNBPassiveDNSHeader *header = table->header;
+    header->version = SNB_PASSIVE_DNS_VERSION;
+    header->entrySize = (uint16_t)sizeof(SNBPassiveDNSEntry);
+    header->capacity = capacity;
+    // Magic last, so a reader never accepts a half-initialized header
+    atomic_thread_fence(memory_order_release);
+    header->magic = SNB_PASSIVE_DNS_MAGIC;
+    table->mask = capacity - 1;
+}
+
+SNBPassiveDNSTable *SNBPassiveDNSCreateWriter(int fd, uint32_t capacity) {
+    capacity = SNBPassiveDNSNormalizeCapacity(capacity);
+    SNBPassiveDNSTable *table = SNBPassiveDNSMap(fd, SNBPassiveDNSMappingSize(capacity),
+                                                 PROT_READ | PROT_WRITE, MAP_SHARED);
+    if (table) {
+        SNBPassiveDNSFormat(table, capacity);
+    }
+    return table;
+}
+
+SNBPassiveDNSTable *SNBPassiveDNSAttachReader(int fd) {
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(SNBPassiveDNSHeader)) {
+        return NULL;
+    }
+    SNBPassiveDNSTable *headerOnly = SNBPassiveDNSMap(fd, sizeof(SNBPassiveDNSHeader), PROT_READ, MAP_SHARED);
+    if (!headerOnly) {
+        return NULL;
+    }
+    atomic_thread_fence(memory_order_acquire);
+    uint32_t magic = headerOnly->header->magic;
+    uint16_t version = headerOnly->header->version;
+    uint16_t entrySize = headerOnly->header->entrySize;
+    uint32_t capacity = headerOnly->header->capacity;
+    SNBPassiveDNSDestroy(headerOnly);
+
+    if (magic != SNB_PASSIVE_DNS_MAGIC ||
+        version != SNB_PASSIVE_DNS_VERSION ||
+        entrySize != sizeof(SNBPassiveDNSEntry) ||
+        capacity != SNBPassiveDNSNormalizeCapacity(capacity) ||
+        (size_t)info.st_size < SNBPassiveDNSMappingSize(capacity)) {
+        return NULL;
+    }
+    SNBPassiveDNSTable *table = SNBPassiveDNSMap(fd, SNBPassiveDNSMappingSize(capacity), PROT_READ, MAP_SHARED);
+    if (table) {
+        table->mask = capacity - 1;
+    }
+    return table;
+}
+
+SNBPassiveDNSTable *SNBPassiveDNSCreate(uint32_t capacity) {
+    capacity = SNBPassiveDNSNormalizeCapacity(capacity);
+    SNBPassiveDNSTable *table = SNBPassiveDNSMap(-1, SNBPassiveDNSMappingSize(capacity),
+                                                 PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS);
+    if (table) {
+        SNBPassiveDNSFormat(table, capacity);
+    }
+    return table;
+}
+
+void SNBPassiveDNSDestroy(SNBPassiveDNSTable *table) {
+    if (!table) {
+        return;
+    }
+    munmap(table->header, table->mappingSize);
+    free(table);
+}
+
+// MARK: - Slots
+
+static inline uint32_t SNBPassiveDNSHash(uint8_t family, const uint8_t *address) {
+    uint64_t low;
+    uint64_t high;
+    memcpy(&low, address, sizeof(low));
+    memcpy(&high, address + 8, sizeof(high));
+    uint64_t hash = (low ^ (high * 0x9E3779B97F4A7C15ULL) ^ family) * 0xFF51AFD7ED558CCDULL;
+    return (uint32_t)(hash >> 32);
+}
+
+static inline uint32_t SNBPassiveDNSSeconds(uint64_t nowNs) {
+    return (uint32_t)(nowNs / 1000000000ULL);
+}
+
+static inline bool SNBPassiveDNSSameAddress(const SNBPassiveDNSBinding *binding, uint8_t family, const uint8_t *address) {
+    return binding->family == family && memcmp(binding->address, address, sizeof(binding->address)) == 0;
+}
+
+// MARK: - Writer
+
+bool SNBPassiveDNSStore(SNBPassiveDNSTable *table,
+                        uint8_t family,
+                        const uint8_t *address,
+                        const char *name,
+                        uint32_t ttl,
+                        SNBPassiveDNSSource source,
+                        uint64_t nowNs) {
+    SNBPassiveDNSHeader *header = table->header;
+    size_t nameLength = strlen(name);
+    if (nameLength == 0) {
+        return false;
+    }
+    if (nameLength >= SNB_PASSIVE_DNS_MAX_NAME) {
+        atomic_fetch_add_explicit(&header->skipped, 1, memory_order_relaxed);
+        return false;
+    }
+    uint32_t now = SNBPassiveDNSSeconds(nowNs);
+    ttl = ttl < SNB_PASSIVE_DNS_MIN_TTL ? SNB_PASSIVE_DNS_MIN_TTL : (ttl > SNB_PASSIVE_DNS_MAX_TTL ? SNB_PASSIVE_DNS_MAX_TTL : ttl);
+
+    // The writer is the only one changing bindings, so it reads them directly
+    uint32_t start = SNBPassiveDNSHash(family, address);
+    SNBPassiveDNSEntry *target = NULL;
+    SNBPassiveDNSEntry *empty = NULL;
+    SNBPassiveDNSEntry *oldest = NULL;
+    for (uint32_t probe = 0; probe < SNB_PASSIVE_DNS_PROBE; probe++) {
+        SNBPassiveDNSEntry *entry = &table->entries[(start + probe) & table->mask];
+        const SNBPassiveDNSBinding *binding = &entry->binding;
+        if (binding->expires == 0) {
+            empty = empty ? empty : entry;
+            break;
+        }
+        if (SNBPassiveDNSSameAddress(binding, family, address)) {
+            target = entry;
+            break;
+        }
+        if (!oldest || binding->expires < oldest->binding.expires) {
+            oldest = entry;
+        }
+    }
+
+    if (target) {
+        const SNBPassiveDNSBinding *binding = &target->binding;
+        if (source == SNBPassiveDNSSourceReverse && binding->source == SNBPassiveDNSSourceAnswer &&
+            binding->expires > now) {
+            return false;
+        }
+    } else if (empty) {
+        target = empty;
+        atomic_fetch_add_explicit(&header->occupied, 1, memory_order_relaxed);
+    } else {
+        target = oldest;
+        if (target->binding.expires > now) {
+            atomic_fetch_add_explicit(&header->replaced, 1, memory_order_relaxed);
+        }
+    }
+
+    uint32_t sequence = atomic_load_explicit(&target->sequence, memory_order_relaxed);
+    atomic_store_explicit(&target->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    SNBPassiveDNSBinding *binding = &target->binding;
+    binding->expires = now + ttl;
+    binding->family = family;
+    binding->source = (uint8_t)source;
+    binding->nameLength = (uint8_t)nameLength;
+    memcpy(binding->address, address, sizeof(binding->address));
+    memcpy(binding->name, name, nameLength + 1);
+    atomic_store_explicit(&target->sequence, sequence + 2, memory_order_release);
+
+    atomic_fetch_add_explicit(&header->stored, 1, memory_order_relaxed);
+    return true;
+}
+
+typedef struct {
+    SNBPassiveDNSTable *table;
+    const SNBDNSHeader *header;
+    uint64_t nowNs;
+    size_t stored;
+} SNBPassiveDNSLearnContext;
+
+static void SNBPassiveDNSLearnRecord(void *context, const SNBDNSRecord *record) {
+    SNBPassiveDNSLearnContext *learn = context;
+    const SNBDNSHeader *header = learn->header;
+    if (record->section == SNBDNSSectionAuthority) {
+        return;
+    }
+    if ((record->type == SNBDNSTypeA || record->type == SNBDNSTypeAAAA) && record->address) {
+        uint8_t address[16] = {0};
+        memcpy(address, record->address, record->type == SNBDNSTypeA ? 4 : 16);
+        // An answer to a single address question is named after what was asked,
+        // not the CDN name at the end of its CNAME chain. mDNS announcements and
+        // additional records carry their own names.
+        bool askedName = record->section == SNBDNSSectionAnswer && header->questionCount == 1 &&
+            (header->questionType == SNBDNSTypeA || header->questionType == SNBDNSTypeAAAA);
+        if (SNBPassiveDNSStore(learn->table,
+                               record->type == SNBDNSTypeA ? SNBAddressFamilyIPv4 : SNBAddressFamilyIPv6,
+                               address,
+                               askedName ? header->question : record->name,
+                               record->ttl,
+                               SNBPassiveDNSSourceAnswer,
+                               learn->nowNs)) {
+            learn->stored++;
+        }
+    } else if (record->type == SNBDNSTypePTR && record->target && record->section == SNBDNSSectionAnswer) {
+        uint8_t family = SNBAddressFamilyNone;
+        uint8_t address[16];
+        // Service-discovery PTRs do not name an address and are skipped here
+        if (SNBDNSAddressFromReverseName(record->name, &family, address) &&
+            SNBPassiveDNSStore(learn->table, family, address, record->target, record->ttl,
+                               SNBPassiveDNSSourceReverse, learn->nowNs)) {
+            learn->stored++;
+        }
+    }
+}
+
+size_t SNBPassiveDNSLearn(SNBPassiveDNSTable *table, const uint8_t *message, size_t length, uint64_t nowNs) {
+    // Only successful responses; the header is complete before the first record
+    if (length < SNB_DNS_HEADER_LENGTH || !(message[2] & 0x80) || (message[3] & 0x0f) != SNBDNSRcodeNoError) {
+        return 0;
+    }
+    SNBDNSHeader header;
+    SNBPassiveDNSLearnContext context = { table, &header, nowNs, 0 };
+    bool complete = false;
+    if (!SNBDNSParseMessage(message, length, &header, SNBPassiveDNSLearnRecord, &context, &complete)) {
+        return 0;
+    }
+    atomic_fetch_add_explicit(&table->header->responses, 1, memory_order_relaxed);
+    if (!complete) {
+        atomic_fetch_add_explicit(&table->header->truncated, 1, memory_order_relaxed);
+    }
+    return context.stored;
+}
+
+size_t SNBPassiveDNSObserve(SNBPassiveDNSTable *table,
+                            const SNBPacketRecord *record,
+                            const uint8_t *frame,
+                            uint32_t capturedLength) {
+    if (record->ipProtocol != 17 || !(record->flags & SNBPacketRecordFlagHasPorts) ||
+        (record->sourcePort != SNB_DNS_PORT && record->sourcePort != SNB_MDNS_PORT) ||
+        record->payloadOffset == 0 || record->payloadOffset >= capturedLength) {
+        return 0;
+    }
+    return SNBPassiveDNSLearn(table, frame + record->payloadOffset,
+                              capturedLength - record->payloadOffset, record->timestampNs);
+}
+
+// MARK: - Readers
+
+bool SNBPassiveDNSLookup(const SNBPassiveDNSTable *table,
+                         uint8_t family,
+                         const uint8_t *address,
+                         char *name,
+                         size_t nameCapacity,
+                         uint64_t nowNs) {
+    uint32_t now = SNBPassiveDNSSeconds(nowNs);
+    uint32_t start = SNBPassiveDNSHash(family, address);
+    for (uint32_t probe = 0; probe < SNB_PASSIVE_DNS_PROBE; probe++) {
+        SNBPassiveDNSEntry *entry = &table->entries[(start + probe) & table->mask];
+        for (int attempt = 0; attempt < SNB_PASSIVE_DNS_READ_ATTEMPTS; attempt++) {
+            uint32_t before = atomic_load_explicit(&entry->sequence, memory_order_acquire);
+            if (before & 1) {
+                continue;
+            }
+            SNBPassiveDNSBinding binding;
+            memcpy(&binding, &entry->binding, sizeof(binding));
+            atomic_thread_fence(memory_order_acquire);
+            if (atomic_load_explicit(&entry->sequence, memory_order_relaxed) != before) {
+                continue;
+            }
+            if (binding.expires == 0) {
+                // Slots are never emptied, so the address is not further on
+                return false;
+            }
+            if (!SNBPassiveDNSSameAddress(&binding, family, address)) {
+                break;
+            }
+            if (binding.expires <= now || binding.nameLength >= SNB_PASSIVE_DNS_MAX_NAME) {
+                return false;
+            }
+            if (name && nameCapacity > 0) {
+                size_t length = binding.nameLength < nameCapacity - 1 ? binding.nameLength : nameCapacity - 1;
+                memcpy(name, binding.name, length);
+                name[length] = '\0';
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+SNBPassiveDNSStats SNBPassiveDNSGetStats(const SNBPassiveDNSTable *table) {
+    SNBPassiveDNSHeader *header = table->header;
+    SNBPassiveDNSStats stats;
+    stats.responses = atomic_load_explicit(&header->responses, memory_order_relaxed);
+    stats.truncated = atomic_load_explicit(&header->truncated, memory_order_relaxed);
+    stats.stored = atomic_load_explicit(&header->stored, memory_order_relaxed);
+    stats.replaced = atomic_load_explicit(&header->replaced, memory_order_relaxed);
+    stats.skipped = atomic_load_explicit(&header->skipped, memory_order_relaxed);
+    stats.occupied = atomic_load_explicit(&header->occupied, memory_order_relaxed);
+    stats.capacity = header->capacity;
+    return stats;
+}
@@ -0,0 +1,110 @@
+//
+//  PassiveDNS.h
+//  SniffNetBar
+//
+//  Address -> name table learned from DNS answers seen on the wire
+//
+
+#ifndef SNB_PASSIVE_DNS_H
+#define SNB_PASSIVE_DNS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "PacketRecord.h"
+
+// A fixed-size, open-addressed table of the names captured DNS responses
+// gave each address. A and AAAA answers bind their address to the name that
+// was asked for, so traffic to a CDN edge is shown as the site the user
+// reached rather than whatever its PTR record says. PTR answers and mDNS
+// announcements fill in the rest.
+//
+// The table lives in one mapping with no pointers, so the helper can write
+// it in shared memory while the app reads the same pages. There is one
+// writer at a time; readers take no lock and never wait. Each entry carries a
+// sequence number that is odd while the writer changes it, and a reader that
+// sees it change retries a bounded number of times before giving up on the
+// entry. When every slot an address may live in is taken, the binding
+// closest to expiry makes room.
+
+#define SNB_PASSIVE_DNS_MAGIC 0x534E4244u  // "SNBD"
+#define SNB_PASSIVE_DNS_VERSION 1
+#define SNB_PASSIVE_DNS_MIN_CAPACITY 1024u
+#define SNB_PASSIVE_DNS_MAX_CAPACITY (1u << 20)
+#define SNB_PASSIVE_DNS_DEFAULT_CAPACITY 16384u
+// Longest name kept, with its terminator; longer ones are skipped
+#define SNB_PASSIVE_DNS_MAX_NAME 100
+// Bindings outlive short CDN TTLs, since connections do too
+#define SNB_PASSIVE_DNS_MIN_TTL 600
+#define SNB_PASSIVE_DNS_MAX_TTL 86400
+#define SNB_MDNS_PORT 5353
+
+typedef struct SNBPassiveDNSTable SNBPassiveDNSTable;
+
+typedef enum {
+    SNBPassiveDNSSourceAnswer = 1,   // A or AAAA answer
+    SNBPassiveDNSSourceReverse = 2   // PTR answer; never replaces a live answer binding
+} SNBPassiveDNSSource;
+
+typedef struct SNBPassiveDNSStats {
+    uint64_t responses;              // Responses parsed
+    uint64_t truncated;              // Responses cut short by the snapshot length
+    uint64_t stored;                 // Bindings written or refreshed
+    uint64_t replaced;               // Live bindings overwritten to make room
+    uint64_t skipped;                // Names too long to keep
+    uint64_t occupied;               // Slots holding a binding, live or expired
+    uint32_t capacity;
+} SNBPassiveDNSStats;
+
+// Rounds capacity to a power of two within the supported range
+uint32_t SNBPassiveDNSNormalizeCapacity(uint32_t capacity);
+size_t SNBPassiveDNSMappingSize(uint32_t capacity);
+
+// Anonymous shared-memory object sized for capacity entries. Returns a file
+// descriptor or -1 with errno set.
+int SNBPassiveDNSCreateSharedMemory(uint32_t capacity);
+// Maps fd read-write and formats an empty table. Writer side only.
+SNBPassiveDNSTable *SNBPassiveDNSCreateWriter(int fd, uint32_t capacity);
+// Maps fd read-only and validates the header. Returns NULL if the mapping is
+// missing, too small or has an unexpected layout version.
+SNBPassiveDNSTable *SNBPassiveDNSAttachReader(int fd);
+// A private table for a single process, e.g. a file replay
+SNBPassiveDNSTable *SNBPassiveDNSCreate(uint32_t capacity);
+void SNBPassiveDNSDestroy(SNBPassiveDNSTable *table);
+
+// MARK: - Writer
+
+// Binds address to name until nowNs plus ttl (clamped to the TTL bounds above)
+bool SNBPassiveDNSStore(SNBPassiveDNSTable *table,
+                        uint8_t family,
+                        const uint8_t *address,
+                        const char *name,
+                        uint32_t ttl,
+                        SNBPassiveDNSSource source,
+                        uint64_t nowNs);
+
+// Stores the bindings of one DNS or mDNS response. A message cut short keeps
+// the records that fit whole. Returns the number of bindings stored.
+size_t SNBPassiveDNSLearn(SNBPassiveDNSTable *table, const uint8_t *message, size_t length, uint64_t nowNs);
+
+// Learns from a decoded frame when it is a UDP response from port 53 or
+// 5353; any other record returns 0 after a few compares.
+size_t SNBPassiveDNSObserve(SNBPassiveDNSTable *table,
+                            const SNBPacketRecord *record,
+                            const uint8_t *frame,
+                            uint32_t capturedLength);
+
+// MARK: - Readers
+
+// Copies the live name bound to address into name. Safe from any thread or
+// process while the writer runs.
+bool SNBPassiveDNSLookup(const SNBPassiveDNSTable *table,
+                         uint8_t family,
+                         const uint8_t *address,
+                         char *name,
+                         size_t nameCapacity,
+                         uint64_t nowNs);
+
+SNBPassiveDNSStats SNBPassiveDNSGetStats(const SNBPassiveDNSTable *table);
+
+#endif
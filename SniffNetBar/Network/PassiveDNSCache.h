@@ -0,0 +1,44 @@
+//
+//  PassiveDNSCache.h
+//  SniffNetBar
+//
+//  Hostnames from the DNS answers seen in captured traffic
+//
+
+#import <Foundation/Foundation.h>
+#import "PacketRecord.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+// Reads the helper's passive DNS table (PassiveDNS.h) for live captures and a
+// table of its own for file replays. These names are what the user's own
+// lookups returned, so they are preferred over reverse lookups wherever an
+// address is shown. Lookups are lock-free and safe from any thread.
+@interface SNBPassiveDNSCache : NSObject
+
++ (instancetype)sharedCache;
+
+// Maps the helper's table read-only. Returns NO if it has an unexpected
+// layout; a table from a restarted helper replaces the previous one.
+- (BOOL)attachTableMemory:(NSFileHandle *)tableMemory;
+
+// Replays learn into a fresh private table, and names are looked up against
+// the capture's clock rather than the wall clock until endReplay
+- (void)beginReplay;
+// Called by the replay for every decoded frame, from a single queue
+- (void)observeReplayRecord:(const SNBPacketRecord *)record
+                      frame:(const uint8_t *)frame
+             capturedLength:(uint32_t)capturedLength;
+- (void)endReplay;
+
+- (nullable NSString *)hostnameForAddress:(NSString *)address;
+// family is an SNBAddressFamily value; address holds 16 bytes
+- (nullable NSString *)hostnameForFamily:(uint8_t)family address:(const uint8_t *)address;
+
+// Table counters (responses, truncated, stored, replaced, skipped, occupied,
+// capacity) and the lookups answered and missed by this process
+- (NSDictionary<NSString *, NSNumber *> *)statistics;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,151 @@
+//
+//  PassiveDNSCache.m
+//  SniffNetBar
+//
+//  Hostnames from the DNS answers seen in captured traffic
+//
+
+#import "PassiveDNSCache.h"
+#import "PassiveDNS.h"
+#import "PacketBatch.h"
+#import "Logger.h"
+#import <stdatomic.h>
+#import <time.h>
+
+@interface SNBPassiveDNSCache () {
+    _Atomic(SNBPassiveDNSTable *) _liveTable;
+    _Atomic(SNBPassiveDNSTable *) _replayTable;
+    _Atomic uint64_t _replayClockNs;
+    _Atomic uint64_t _hits;
+    _Atomic uint64_t _misses;
+}
+// Tables that were replaced stay mapped: a reader on another thread may still
+// be probing one. There is one per helper restart or replay, 2 MB each.
+@property (nonatomic, strong) NSMutableArray<NSValue *> *retiredTables;
+@end
+
+@implementation SNBPassiveDNSCache
+
++ (instancetype)sharedCache {
+    static SNBPassiveDNSCache *cache = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        cache = [[SNBPassiveDNSCache alloc] init];
+    });
+    return cache;
+}
+
+- (instancetype)init {
+    self = [super init];
+    if (self) {
+        atomic_init(&_liveTable, NULL);
+        atomic_init(&_replayTable, NULL);
+        atomic_init(&_replayClockNs, 0);
+        atomic_init(&_hits, 0);
+        atomic_init(&_misses, 0);
+        _retiredTables = [NSMutableArray array];
+    }
+    return self;
+}
+
+- (void)retireTable:(SNBPassiveDNSTable *)table {
+    if (!table) {
+        return;
+    }
+    @synchronized (self.retiredTables) {
+        [self.retiredTables addObject:[NSValue valueWithPointer:table]];
+    }
+}
+
+- (BOOL)attachTableMemory:(NSFileHandle *)tableMemory {
+    SNBPassiveDNSTable *table = SNBPassiveDNSAttachReader(tableMemory.fileDescriptor);
+    if (!table) {
+        SNBLogNetworkWarn("Passive DNS table from the helper has an unexpected layout; using reverse lookups only");
+        return NO;
+    }
+    // The mapping stays valid after the descriptor is closed
+    [self retireTable:atomic_exchange(&_liveTable, table)];
+    SNBPassiveDNSStats stats = SNBPassiveDNSGetStats(table);
+    SNBLogNetworkInfo("Attached passive DNS table (%u entries, %llu in use)",
+                      stats.capacity, (unsigned long long)stats.occupied);
+    return YES;
+}
+
+#pragma mark - Replay
+
+- (void)beginReplay {
+    SNBPassiveDNSTable *table = SNBPassiveDNSCreate(SNB_PASSIVE_DNS_DEFAULT_CAPACITY);
+    atomic_store(&_replayClockNs, 0);
+    [self retireTable:atomic_exchange(&_replayTable, table)];
+}
+
+- (void)observeReplayRecord:(const SNBPacketRecord *)record
+                      frame:(const uint8_t *)frame
+             capturedLength:(uint32_t)capturedLength {
+    SNBPassiveDNSTable *table = atomic_load_explicit(&_replayTable, memory_order_acquire);
+    if (!table) {
+        return;
+    }
+    if (record->timestampNs > atomic_load_explicit(&_replayClockNs, memory_order_relaxed)) {
+        atomic_store_explicit(&_replayClockNs, record->timestampNs, memory_order_relaxed);
+    }
+    SNBPassiveDNSObserve(table, record, frame, capturedLength);
+}
+
+- (void)endReplay {
+    [self retireTable:atomic_exchange(&_replayTable, NULL)];
+}
+
+#pragma mark - Lookups
+
+- (NSString *)hostnameForAddress:(NSString *)address {
+    uint8_t family = SNBAddressFamilyNone;
+    uint8_t bytes[16];
+    if (!SNBPacketAddressFromString(address, &family, bytes)) {
+        return nil;
+    }
+    return [self hostnameForFamily:family address:bytes];
+}
+
+- (NSString *)hostnameForFamily:(uint8_t)family address:(const uint8_t *)address {
+    SNBPassiveDNSTable *table = atomic_load_explicit(&_replayTable, memory_order_acquire);
+    uint64_t nowNs;
+    if (table) {
+        // Bindings expire on the capture's clock, not at replay speed
+        nowNs = atomic_load_explicit(&_replayClockNs, memory_order_relaxed);
+    } else {
+        table = atomic_load_explicit(&_liveTable, memory_order_acquire);
+        if (!table) {
+            return nil;
+        }
+        nowNs = clock_gettime_nsec_np(CLOCK_REALTIME);
+    }
+
+    char name[SNB_PASSIVE_DNS_MAX_NAME];
+    if (!SNBPassiveDNSLookup(table, family, address, name, sizeof(name), nowNs)) {
+        atomic_fetch_add_explicit(&_misses, 1, memory_order_relaxed);
+        return nil;
+    }
+    atomic_fetch_add_explicit(&_hits, 1, memory_order_relaxed);
+    return [NSString stringWithUTF8String:name];
+}
+
+- (NSDictionary<NSString *, NSNumber *> *)statistics {
+    SNBPassiveDNSTable *table = atomic_load(&_replayTable) ?: atomic_load(&_liveTable);
+    NSMutableDictionary<NSString *, NSNumber *> *statistics = [NSMutableDictionary dictionary];
+    statistics[@"hits"] = @(atomic_load(&_hits));
+    statistics[@"misses"] = @(atomic_load(&_misses));
+    if (table) {
+        SNBPassiveDNSStats stats = SNBPassiveDNSGetStats(table);
+        statistics[@"responses"] = @(stats.responses);
+        statistics[@"truncated"] = @(stats.truncated);
+        statistics[@"stored"] = @(stats.stored);
+        statistics[@"replaced"] = @(stats.replaced);
+        statistics[@"skipped"] = @(stats.skipped);
+        statistics[@"occupied"] = @(stats.occupied);
+        statistics[@"capacity"] = @(stats.capacity);
+    }
+    return statistics;
+}
+
+@end
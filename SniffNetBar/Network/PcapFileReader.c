@@ -0,0 +1,451 @@
+//
+//  PcapFileReader.c
+//  SniffNetBar
+//
+//  Dependency-free reader for pcap and pcapng capture files
+//
+
+#include "PcapFileReader.h"
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// MARK: - Format constants
+
+static const uint32_t kSNBPcapMagicMicro = 0xa1b2c3d4;
+static const uint32_t kSNBPcapMagicNano = 0xa1b23c4d;
+
+static const uint32_t kSNBPcapngSectionHeader = 0x0a0d0d0a;
+static const uint32_t kSNBPcapngByteOrderMagic = 0x1a2b3c4d;
+static const uint32_t kSNBPcapngInterfaceDescription = 0x00000001;
+static const uint32_t kSNBPcapngObsoletePacket = 0x00000002;
+static const uint32_t kSNBPcapngSimplePacket = 0x00000003;
+static const uint32_t kSNBPcapngEnhancedPacket = 0x00000006;
+
+static const uint16_t kSNBPcapngOptionEnd = 0;
+static const uint16_t kSNBPcapngOptionTimestampResolution = 9;
+static const uint16_t kSNBPcapngOptionTimestampOffset = 14;
+
+// Larger blocks are treated as corruption rather than allocated
+static const uint32_t kSNBPcapMaxBlockLength = 64 * 1024 * 1024;
+
+typedef struct {
+    uint32_t linkType;
+    uint32_t snapLength;
+    uint64_t unitsPerSecond;   // Timestamp resolution
+    int64_t offsetSeconds;     // if_tsoffset
+} SNBPcapngInterface;
+
+struct SNBPcapFileReader {
+    FILE *file;
+    bool pcapng;
+    bool swapped;             // File byte order differs from the host's
+    bool failed;
+
+    // Classic pcap
+    uint32_t linkType;
+    uint32_t fractionsPerSecond;
+
+    // pcapng, per section
+    SNBPcapngInterface *interfaces;
+    size_t interfaceCount;
+    size_t interfaceCapacity;
+    uint64_t lastTimestampNs;
+
+    uint8_t *buffer;
+    size_t bufferCapacity;
+    char error[128];
+};
+
+// MARK: - Helpers
+
+static inline uint16_t SNBPcapRead16(const SNBPcapFileReader *reader, const uint8_t *bytes) {
+    uint16_t value;
+    memcpy(&value, bytes, sizeof(value));
+    return reader->swapped ? __builtin_bswap16(value) : value;
+}
+
+static inline uint32_t SNBPcapRead32(const SNBPcapFileReader *reader, const uint8_t *bytes) {
+    uint32_t value;
+    memcpy(&value, bytes, sizeof(value));
+    return reader->swapped ? __builtin_bswap32(value) : value;
+}
+
+static inline uint64_t SNBPcapRead64(const SNBPcapFileReader *reader, const uint8_t *bytes) {
+    uint64_t value;
+    memcpy(&value, bytes, sizeof(value));
+    return reader->swapped ? __builtin_bswap64(value) : value;
+}
+
+static SNBPcapReadResult SNBPcapFail(SNBPcapFileReader *reader, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    vsnprintf(reader->error, sizeof(reader->error), format, args);
+    va_end(args);
+    reader->failed = true;
+    return SNBPcapReadError;
+}
+
+static bool SNBPcapReserve(SNBPcapFileReader *reader, size_t length) {
+    if (length <= reader->bufferCapacity) {
+        return true;
+    }
+    size_t capacity = reader->bufferCapacity ? reader->bufferCapacity : 65536;
+    while (capacity < length) {
+        capacity *= 2;
+    }
+    uint8_t *buffer = realloc(reader->buffer, capacity);
+    if (!buffer) {
+        return false;
+    }
+    reader->buffer = buffer;
+    reader->bufferCapacity = capacity;
+    return true;
+}
+
+// Reads exactly length bytes. Returns SNBPcapReadEnd only for a clean end of
+// file before the first byte; a short read mid-record is an error.
+static SNBPcapReadResult SNBPcapReadExact(SNBPcapFileReader *reader, void *into, size_t length) {
+    size_t got = fread(into, 1, length, reader->file);
+    if (got == length) {
+        return SNBPcapReadPacket;
+    }
+    if (got == 0 && feof(reader->file)) {
+        return SNBPcapReadEnd;
+    }
+    if (ferror(reader->file)) {
+        return SNBPcapFail(reader, "read failed: %s", strerror(errno));
+    }
+    return SNBPcapFail(reader, "truncated capture file");
+}
+
+static uint64_t SNBPcapUnitsToNs(uint64_t units, uint64_t unitsPerSecond) {
+    uint64_t seconds = units / unitsPerSecond;
+    uint64_t remainder = units % unitsPerSecond;
+    uint64_t fraction;
+    if (unitsPerSecond <= 1000000000ULL && 1000000000ULL % unitsPerSecond == 0) {
+        fraction = remainder * (1000000000ULL / unitsPerSecond);
+    } else {
+        fraction = (uint64_t)(((unsigned __int128)remainder * 1000000000ULL) / unitsPerSecond);
+    }
+    return seconds * 1000000000ULL + fraction;
+}
+
+// MARK: - Classic pcap
+
+static SNBPcapReadResult SNBPcapReadClassic(SNBPcapFileReader *reader, SNBPcapPacket *packet) {
+    uint8_t header[16];
+    SNBPcapReadResult result = SNBPcapReadExact(reader, header, sizeof(header));
+    if (result != SNBPcapReadPacket) {
+        return result;
+    }
+
+    uint32_t seconds = SNBPcapRead32(reader, header);
+    uint32_t fraction = SNBPcapRead32(reader, header + 4);
+    uint32_t capturedLength = SNBPcapRead32(reader, header + 8);
+    uint32_t wireLength = SNBPcapRead32(reader, header + 12);
+    if (capturedLength > kSNBPcapMaxBlockLength) {
+        return SNBPcapFail(reader, "packet of %u bytes exceeds the record limit", capturedLength);
+    }
+    if (!SNBPcapReserve(reader, capturedLength)) {
+        return SNBPcapFail(reader, "out of memory");
+    }
+    if (capturedLength > 0) {
+        result = SNBPcapReadExact(reader, reader->buffer, capturedLength);
+        if (result != SNBPcapReadPacket) {
+            return result == SNBPcapReadEnd ? SNBPcapFail(reader, "truncated capture file") : result;
+        }
+    }
+
+    packet->data = reader->buffer;
+    packet->capturedLength = capturedLength;
+    packet->wireLength = wireLength;
+    packet->timestampNs = (uint64_t)seconds * 1000000000ULL +
+        SNBPcapUnitsToNs(fraction, reader->fractionsPerSecond);
+    packet->linkType = reader->linkType;
+    return SNBPcapReadPacket;
+}
+
+// MARK: - pcapng
+
+static SNBPcapReadResult SNBPcapngParseInterface(SNBPcapFileReader *reader, const uint8_t *body, uint32_t length) {
+    if (length < 8) {
+        return SNBPcapFail(reader, "short interface description block");
+    }
+    if (reader->interfaceCount == reader->interfaceCapacity) {
+        size_t capacity = reader->interfaceCapacity ? reader->interfaceCapacity * 2 : 4;
+        SNBPcapngInterface *interfaces = realloc(reader->interfaces, capacity * sizeof(SNBPcapngInterface));
+        if (!interfaces) {
+            return SNBPcapFail(reader, "out of memory");
+        }
+        reader->interfaces = interfaces;
+        reader->interfaceCapacity = capacity;
+    }
+
+    SNBPcapngInterface *interface = &reader->interfaces[reader->interfaceCount++];
+    interface->linkType = SNBPcapRead16(reader, body);
+    interface->snapLength = SNBPcapRead32(reader, body + 4);
+    interface->unitsPerSecond = 1000000;
+    interface->offsetSeconds = 0;
+
+    uint32_t offset = 8;
+    while (offset + 4 <= length) {
+        uint16_t code = SNBPcapRead16(reader, body + offset);
+        uint16_t optionLength = SNBPcapRead16(reader, body + offset + 2);
+        offset += 4;
+        if (code == kSNBPcapngOptionEnd || offset + optionLength > length) {
+            break;
+        }
+        if (code == kSNBPcapngOptionTimestampResolution && optionLength >= 1) {
+            uint8_t resolution = body[offset];
+            uint8_t exponent = resolution & 0x7f;
+            uint64_t units = 1;
+            if (resolution & 0x80) {
+                if (exponent > 63) {
+                    return SNBPcapFail(reader, "unsupported timestamp resolution 2^-%u", exponent);
+                }
+                units = 1ULL << exponent;
+            } else {
+                if (exponent > 19) {
+                    return SNBPcapFail(reader, "unsupported timestamp resolution 10^-%u", exponent);
+                }
+                for (uint8_t i = 0; i < exponent; i++) {
+                    units *= 10;
+                }
+            }
+            interface->unitsPerSecond = units;
+        } else if (code == kSNBPcapngOptionTimestampOffset && optionLength >= 8) {
+            interface->offsetSeconds = (int64_t)SNBPcapRead64(reader, body + offset);
+        }
+        offset += (optionLength + 3u) & ~3u;
+    }
+    return SNBPcapReadPacket;
+}
+
+static uint64_t SNBPcapngTimestamp(const SNBPcapngInterface *interface, uint32_t high, uint32_t low) {
+    uint64_t ns = SNBPcapUnitsToNs(((uint64_t)high << 32) | low, interface->unitsPerSecond);
+    int64_t offsetNs = interface->offsetSeconds * 1000000000LL;
+    if (offsetNs < 0 && (uint64_t)(-offsetNs) > ns) {
+        return 0;
+    }
+    return ns + (uint64_t)offsetNs;
+}
+
+static SNBPcapReadResult SNBPcapngReadSectionHeader(SNBPcapFileReader *reader, const uint8_t *prefix) {
+    // The byte-order magic follows the block type and length, and decides how
+    // both of them (and the rest of the section) are read
+    uint32_t magic;
+    memcpy(&magic, prefix + 8, sizeof(magic));
+    if (magic == kSNBPcapngByteOrderMagic) {
+        reader->swapped = false;
+    } else if (magic == __builtin_bswap32(kSNBPcapngByteOrderMagic)) {
+        reader->swapped = true;
+    } else {
+        return SNBPcapFail(reader, "bad pcapng byte-order magic");
+    }
+
+    uint32_t totalLength = SNBPcapRead32(reader, prefix + 4);
+    if (totalLength < 28 || totalLength % 4 != 0 || totalLength > kSNBPcapMaxBlockLength) {
+        return SNBPcapFail(reader, "bad section header length %u", totalLength);
+    }
+    // Skip version, section length, options and the trailing length
+    uint32_t remaining = totalLength - 12;
+    if (!SNBPcapReserve(reader, remaining)) {
+        return SNBPcapFail(reader, "out of memory");
+    }
+    SNBPcapReadResult result = SNBPcapReadExact(reader, reader->buffer, remaining);
+    if (result != SNBPcapReadPacket) {
+        return result == SNBPcapReadEnd ? SNBPcapFail(reader, "truncated capture file") : result;
+    }
+    reader->interfaceCount = 0;
+    return SNBPcapReadPacket;
+}
+
+static SNBPcapReadResult SNBPcapReadPcapng(SNBPcapFileReader *reader, SNBPcapPacket *packet) {
+    for (;;) {
+        uint8_t prefix[12];
+        SNBPcapReadResult result = SNBPcapReadExact(reader, prefix, 8);
+        if (result != SNBPcapReadPacket) {
+            return result;
+        }
+
+        uint32_t type;
+        memcpy(&type, prefix, sizeof(type));
+        if (type == kSNBPcapngSectionHeader) {
+            result = SNBPcapReadExact(reader, prefix + 8, 4);
+            if (result != SNBPcapReadPacket) {
+                return result == SNBPcapReadEnd ? SNBPcapFail(reader, "truncated capture file") : result;
+            }
+            result = SNBPcapngReadSectionHeader(reader, prefix);
+            if (result != SNBPcapReadPacket) {
+                return result;
+            }
+            continue;
+        }
+
+        type = SNBPcapRead32(reader, prefix);
+        uint32_t totalLength = SNBPcapRead32(reader, prefix + 4);
+        if (totalLength < 12 || totalLength % 4 != 0 || totalLength > kSNBPcapMaxBlockLength) {
+            return SNBPcapFail(reader, "bad block length %u", totalLength);
+        }
+        uint32_t bodyLength = totalLength - 12;
+        if (!SNBPcapReserve(reader, bodyLength + 4)) {
+            return SNBPcapFail(reader, "out of memory");
+        }
+        result = SNBPcapReadExact(reader, reader->buffer, bodyLength + 4);
+        if (result != SNBPcapReadPacket) {
+            return result == SNBPcapReadEnd ? SNBPcapFail(reader, "truncated capture file") : result;
+        }
+        const uint8_t *body = reader->buffer;
+
+        if (type == kSNBPcapngInterfaceDescription) {
+            result = SNBPcapngParseInterface(reader, body, bodyLength);
+            if (result != SNBPcapReadPacket) {
+                return result;
+            }
+            continue;
+        }
+
+        uint32_t interfaceID;
+        uint32_t capturedLength;
+        uint32_t wireLength;
+        uint32_t dataOffset;
+        uint64_t timestampNs = reader->lastTimestampNs;
+        if (type == kSNBPcapngEnhancedPacket || type == kSNBPcapngObsoletePacket) {
+            if (bodyLength < 20) {
+                return SNBPcapFail(reader, "short packet block");
+            }
+            interfaceID = (type == kSNBPcapngEnhancedPacket) ? SNBPcapRead32(reader, body) : SNBPcapRead16(reader, body);
+            capturedLength = SNBPcapRead32(reader, body + 12);
+            wireLength = SNBPcapRead32(reader, body + 16);
+            dataOffset = 20;
+            if (interfaceID >= reader->interfaceCount) {
+                return SNBPcapFail(reader, "packet for undeclared interface %u", interfaceID);
+            }
+            timestampNs = SNBPcapngTimestamp(&reader->interfaces[interfaceID],
+                                             SNBPcapRead32(reader, body + 4),
+                                             SNBPcapRead32(reader, body + 8));
+        } else if (type == kSNBPcapngSimplePacket) {
+            // No timestamp: the packet is placed at the previous one's time
+            if (bodyLength < 4 || reader->interfaceCount == 0) {
+                return SNBPcapFail(reader, "bad simple packet block");
+            }
+            interfaceID = 0;
+            wireLength = SNBPcapRead32(reader, body);
+            dataOffset = 4;
+            capturedLength = wireLength;
+            uint32_t snapLength = reader->interfaces[0].snapLength;
+            if (snapLength > 0 && capturedLength > snapLength) {
+                capturedLength = snapLength;
+            }
+            if (capturedLength > bodyLength - dataOffset) {
+                capturedLength = bodyLength - dataOffset;
+            }
+        } else {
+            continue;
+        }
+
+        if (capturedLength > bodyLength - dataOffset) {
+            return SNBPcapFail(reader, "packet data overruns its block");
+        }
+        reader->lastTimestampNs = timestampNs;
+        packet->data = body + dataOffset;
+        packet->capturedLength = capturedLength;
+        packet->wireLength = wireLength;
+        packet->timestampNs = timestampNs;
+        packet->linkType = reader->interfaces[interfaceID].linkType;
+        return SNBPcapReadPacket;
+    }
+}
+
+// MARK: - Public API
+
+SNBPcapFileReader *SNBPcapFileReaderOpen(const char *path, char *error, size_t errorLength) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        if (error && errorLength > 0) {
+            snprintf(error, errorLength, "%s: %s", path, strerror(errno));
+        }
+        return NULL;
+    }
+
+    SNBPcapFileReader *reader = calloc(1, sizeof(SNBPcapFileReader));
+    if (!reader) {
+        fclose(file);
+        if (error && errorLength > 0) {
+            snprintf(error, errorLength, "out of memory");
+        }
+        return NULL;
+    }
+    reader->file = file;
+    setvbuf(file, NULL, _IOFBF, 1 << 20);
+
+    uint8_t header[24];
+    const char *failure = NULL;
+    if (fread(header, 1, sizeof(header), file) != sizeof(header)) {
+        failure = "file is too short to be a capture";
+    } else {
+        uint32_t magic;
+        memcpy(&magic, header, sizeof(magic));
+        if (magic == kSNBPcapngSectionHeader) {
+            // Sections are parsed as ordinary blocks, so start again from the
+            // first one once the byte-order magic checks out
+            uint32_t byteOrder;
+            memcpy(&byteOrder, header + 8, sizeof(byteOrder));
+            reader->pcapng = true;
+            if (byteOrder != kSNBPcapngByteOrderMagic && byteOrder != __builtin_bswap32(kSNBPcapngByteOrderMagic)) {
+                failure = "bad pcapng byte-order magic";
+            } else if (fseek(file, 0, SEEK_SET) != 0) {
+                failure = "capture file is not seekable";
+            }
+        } else if (magic == kSNBPcapMagicMicro || magic == kSNBPcapMagicNano) {
+            reader->fractionsPerSecond = magic == kSNBPcapMagicNano ? 1000000000 : 1000000;
+        } else if (magic == __builtin_bswap32(kSNBPcapMagicMicro) || magic == __builtin_bswap32(kSNBPcapMagicNano)) {
+            reader->swapped = true;
+            reader->fractionsPerSecond = magic == __builtin_bswap32(kSNBPcapMagicNano) ? 1000000000 : 1000000;
+        } else {
+            failure = "not a pcap or pcapng file";
+        }
+        if (!reader->pcapng && !failure) {
+            reader->linkType = SNBPcapRead32(reader, header + 20);
+        }
+    }
+
+    if (failure) {
+        if (error && errorLength > 0) {
+            snprintf(error, errorLength, "%s: %s", path, failure);
+        }
+        SNBPcapFileReaderClose(reader);
+        return NULL;
+    }
+    return reader;
+}
+
+void SNBPcapFileReaderClose(SNBPcapFileReader *reader) {
+    if (!reader) {
+        return;
+    }
+    if (reader->file) {
+        fclose(reader->file);
+    }
+    free(reader->interfaces);
+    free(reader->buffer);
+    free(reader);
+}
+
+SNBPcapReadResult SNBPcapFileReaderNext(SNBPcapFileReader *reader, SNBPcapPacket *packet) {
+    if (reader->failed) {
+        return SNBPcapReadError;
+    }
+    return reader->pcapng ? SNBPcapReadPcapng(reader, packet) : SNBPcapReadClassic(reader, packet);
+}
+
+const char *SNBPcapFileReaderError(const SNBPcapFileReader *reader) {
+    return reader->error;
+}
+
+bool SNBPcapFileReaderIsPcapng(const SNBPcapFileReader *reader) {
+    return reader->pcapng;
+}
@@ -0,0 +1,53 @@
+//
+//  PcapFileReader.h
+//  SniffNetBar
+//
+//  Dependency-free reader for pcap and pcapng capture files
+//
+
+#ifndef SNB_PCAP_FILE_READER_H
+#define SNB_PCAP_FILE_READER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// LINKTYPE_ETHERNET; PacketDecoder.h lists every link type with a decoder
+#define SNB_PCAP_LINKTYPE_ETHERNET 1
+
+// Replays recorded traffic without libpcap, so the record pipeline can be
+// driven from a file on machines that have no capture stack (CI runners,
+// benchmarks). Handles classic pcap in either byte order with microsecond or
+// nanosecond timestamps, and pcapng sections with any number of interfaces,
+// per-interface timestamp resolution and offset, and enhanced, simple and
+// obsolete packet blocks. Other pcapng blocks are skipped.
+typedef struct SNBPcapFileReader SNBPcapFileReader;
+
+typedef struct SNBPcapPacket {
+    const uint8_t *data;       // Captured bytes, valid until the next read
+    uint32_t capturedLength;
+    uint32_t wireLength;
+    uint64_t timestampNs;      // Unix nanoseconds
+    uint32_t linkType;         // LINKTYPE_* of the capturing interface
+} SNBPcapPacket;
+
+typedef enum {
+    SNBPcapReadError = -1,
+    SNBPcapReadEnd = 0,
+    SNBPcapReadPacket = 1
+} SNBPcapReadResult;
+
+// Returns NULL and fills error when the file is missing or is not a capture
+SNBPcapFileReader *SNBPcapFileReaderOpen(const char *path, char *error, size_t errorLength);
+void SNBPcapFileReaderClose(SNBPcapFileReader *reader);
+
+// Reads the next packet. The packet buffer is reused, so steady-state reading
+// does not allocate. After SNBPcapReadError the reader is unusable and
+// SNBPcapFileReaderError() describes the problem.
+SNBPcapReadResult SNBPcapFileReaderNext(SNBPcapFileReader *reader, SNBPcapPacket *packet);
+const char *SNBPcapFileReaderError(const SNBPcapFileReader *reader);
+
+// True for pcapng input, false for classic pcap
+bool SNBPcapFileReaderIsPcapng(const SNBPcapFileReader *reader);
+
+#endif
@@ -0,0 +1,130 @@
+//
+//  ProcessSocketEnumerator.c
+//  SniffNetBar
+//
+//  Feeds a SocketProcessIndex from the live process table (macOS, libproc)
+//
+
+#include "ProcessSocketEnumerator.h"
+#include <libproc.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/proc_info.h>
+
+// Room for processes and descriptors created between sizing and reading
+static const size_t kSNBProcessSlack = 64;
+static const size_t kSNBDescriptorSlack = 16;
+
+void SNBProcessSocketEnumeratorDestroy(SNBProcessSocketEnumerator *enumerator) {
+    free(enumerator->pids);
+    free(enumerator->descriptors);
+    memset(enumerator, 0, sizeof(*enumerator));
+}
+
+static void SNBProcessSocketAdd(SNBSocketProcessIndex *index, pid_t pid, const struct socket_fdinfo *socketInfo) {
+    const struct in_sockinfo *inInfo;
+    uint8_t protocol;
+    if (socketInfo->psi.soi_kind == SOCKINFO_TCP) {
+        inInfo = &socketInfo->psi.soi_proto.pri_tcp.tcpsi_ini;
+        protocol = IPPROTO_TCP;
+    } else if (socketInfo->psi.soi_kind == SOCKINFO_IN && socketInfo->psi.soi_protocol == IPPROTO_UDP) {
+        inInfo = &socketInfo->psi.soi_proto.pri_in;
+        protocol = IPPROTO_UDP;
+    } else {
+        return;
+    }
+
+    SNBFlowKey key;
+    memset(&key, 0, sizeof(key));
+    key.ipProtocol = protocol;
+    key.sourcePort = ntohs((uint16_t)inInfo->insi_lport);
+    key.destinationPort = ntohs((uint16_t)inInfo->insi_fport);
+    if (key.sourcePort == 0) {
+        return;
+    }
+
+    // A dual-stack socket carries both flags and is indexed under both families
+    if (inInfo->insi_vflag & INI_IPV4) {
+        key.family = SNBAddressFamilyIPv4;
+        memcpy(key.sourceAddress, &inInfo->insi_laddr.ina_46.i46a_addr4, 4);
+        memcpy(key.destinationAddress, &inInfo->insi_faddr.ina_46.i46a_addr4, 4);
+        SNBSocketProcessIndexAdd(index, &key, pid);
+    }
+    if (inInfo->insi_vflag & INI_IPV6) {
+        key.family = SNBAddressFamilyIPv6;
+        memcpy(key.sourceAddress, &inInfo->insi_laddr.ina_6, 16);
+        memcpy(key.destinationAddress, &inInfo->insi_faddr.ina_6, 16);
+        SNBSocketProcessIndexAdd(index, &key, pid);
+    }
+}
+
+static bool SNBProcessSocketListPids(SNBProcessSocketEnumerator *enumerator, size_t *count) {
+    int bytes = proc_listpids(PROC_ALL_PIDS, 0, NULL, 0);
+    if (bytes <= 0) {
+        return false;
+    }
+    size_t needed = (size_t)bytes / sizeof(pid_t) + kSNBProcessSlack;
+    if (needed > enumerator->pidCapacity) {
+        pid_t *pids = realloc(enumerator->pids, needed * sizeof(pid_t));
+        if (!pids) {
+            return false;
+        }
+        enumerator->pids = pids;
+        enumerator->pidCapacity = needed;
+    }
+    bytes = proc_listpids(PROC_ALL_PIDS, 0, enumerator->pids, (int)(enumerator->pidCapacity * sizeof(pid_t)));
+    if (bytes <= 0) {
+        return false;
+    }
+    *count = (size_t)bytes / sizeof(pid_t);
+    return true;
+}
+
+static size_t SNBProcessSocketListDescriptors(SNBProcessSocketEnumerator *enumerator, pid_t pid) {
+    int bytes = proc_pidinfo(pid, PROC_PIDLISTFDS, 0, NULL, 0);
+    if (bytes <= 0) {
+        return 0;
+    }
+    size_t needed = (size_t)bytes + kSNBDescriptorSlack * sizeof(struct proc_fdinfo);
+    if (needed > enumerator->descriptorBytes) {
+        void *descriptors = realloc(enumerator->descriptors, needed);
+        if (!descriptors) {
+            return 0;
+        }
+        enumerator->descriptors = descriptors;
+        enumerator->descriptorBytes = needed;
+    }
+    bytes = proc_pidinfo(pid, PROC_PIDLISTFDS, 0, enumerator->descriptors, (int)enumerator->descriptorBytes);
+    return bytes > 0 ? (size_t)bytes / sizeof(struct proc_fdinfo) : 0;
+}
+
+bool SNBProcessSocketEnumerate(void *context, SNBSocketProcessIndex *index) {
+    SNBProcessSocketEnumerator *enumerator = context;
+    size_t pidCount = 0;
+    if (!SNBProcessSocketListPids(enumerator, &pidCount)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < pidCount; i++) {
+        pid_t pid = enumerator->pids[i];
+        if (pid <= 0) {
+            continue;
+        }
+        // Processes that exit or are not ours to inspect simply list nothing
+        size_t descriptorCount = SNBProcessSocketListDescriptors(enumerator, pid);
+        const struct proc_fdinfo *descriptors = enumerator->descriptors;
+        for (size_t f = 0; f < descriptorCount; f++) {
+            if (descriptors[f].proc_fdtype != PROX_FDTYPE_SOCKET) {
+                continue;
+            }
+            struct socket_fdinfo socketInfo;
+            int size = proc_pidfdinfo(pid, descriptors[f].proc_fd, PROC_PIDFDSOCKETINFO,
+                                      &socketInfo, sizeof(socketInfo));
+            if (size == (int)sizeof(socketInfo)) {
+                SNBProcessSocketAdd(index, pid, &socketInfo);
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,32 @@
+//
+//  ProcessSocketEnumerator.h
+//  SniffNetBar
+//
+//  Feeds a SocketProcessIndex from the live process table (macOS, libproc)
+//
+
+#ifndef SNB_PROCESS_SOCKET_ENUMERATOR_H
+#define SNB_PROCESS_SOCKET_ENUMERATOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include "SocketProcessIndex.h"
+
+// Scratch buffers kept between rebuilds so a rebuild does not allocate once
+// they have grown to the size of the process table
+typedef struct SNBProcessSocketEnumerator {
+    pid_t *pids;
+    size_t pidCapacity;
+    void *descriptors;               // struct proc_fdinfo[]
+    size_t descriptorBytes;
+} SNBProcessSocketEnumerator;
+
+void SNBProcessSocketEnumeratorDestroy(SNBProcessSocketEnumerator *enumerator);
+
+// SNBSocketEnumerator for SNBSocketProcessIndexInit; context is a zeroed
+// SNBProcessSocketEnumerator. Adds the TCP and UDP sockets of every process
+// the caller may inspect: all of them as root, the caller's own otherwise.
+bool SNBProcessSocketEnumerate(void *context, SNBSocketProcessIndex *index);
+
+#endif
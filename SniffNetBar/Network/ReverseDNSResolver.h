@@ -0,0 +1,36 @@
+//
+//  ReverseDNSResolver.h
+//  SniffNetBar
+//
+//  Asynchronous reverse-DNS lookups driven by dispatch sources
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@interface SNBReverseDNSResolver : NSObject
+
+// Asks the nameservers listed in /etc/resolv.conf. nil if there are none.
++ (nullable instancetype)sharedResolver;
+
+// Asks the given numeric addresses in order; nil if none can be used
+- (nullable instancetype)initWithServers:(NSArray<NSString *> *)servers port:(uint16_t)port NS_DESIGNATED_INITIALIZER;
+- (instancetype)init NS_UNAVAILABLE;
+
+// Never blocks. The completion runs on the resolver's queue with the name, or
+// nil when the address has none, the servers did not answer or too many
+// lookups are waiting. Lookups of an address already being resolved share
+// its query.
+- (void)resolveAddress:(NSString *)address completion:(void (^)(NSString * _Nullable hostname))completion;
+
+// Caches the PTR, A and AAAA answers of a DNS response seen on the wire
+- (void)learnFromResponse:(NSData *)message;
+
+// Engine counters (lookups, cacheHits, coalesced, queriesSent, ...) and the
+// pending and cached entry counts. Waits for the resolver's queue.
+- (NSDictionary<NSString *, NSNumber *> *)statistics;
+
+@end
+
+NS_ASSUME_NONNULL_END
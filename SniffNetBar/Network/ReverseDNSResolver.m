@@ -0,0 +1,225 @@
+//
+//  ReverseDNSResolver.m
+//  SniffNetBar
+//
+//  Asynchronous reverse-DNS lookups driven by dispatch sources
+//
+
+#import "ReverseDNSResolver.h"
+#import "ReverseResolver.h"
+#import "PacketBatch.h"
+#import "Logger.h"
+#import <time.h>
+
+static NSString * const kSNBResolvConfPath = @"/etc/resolv.conf";
+
+typedef void (^SNBReverseDNSCompletion)(NSString * _Nullable hostname);
+
+// TTLs keep running while the machine sleeps
+static inline uint64_t SNBReverseDNSNowNs(void) {
+    return clock_gettime_nsec_np(CLOCK_MONOTONIC);
+}
+
+@interface SNBReverseDNSResolver ()
+@property (nonatomic, assign) SNBReverseResolver *resolver;
+@property (nonatomic, strong) dispatch_queue_t queue;
+@property (nonatomic, strong) NSArray<dispatch_source_t> *readSources;
+@property (nonatomic, strong) dispatch_source_t timer;
+@property (nonatomic, assign) uint64_t timerDeadlineNs;
+// Completions waiting on each pending address; owned by the queue
+@property (nonatomic, strong) NSMutableDictionary<NSString *, NSMutableArray<SNBReverseDNSCompletion> *> *waiters;
+- (void)finishAddress:(NSString *)address hostname:(nullable NSString *)hostname;
+@end
+
+static void SNBReverseDNSHandler(void *context, uint8_t family, const uint8_t *address, const char *name) {
+    SNBReverseDNSResolver *resolver = (__bridge SNBReverseDNSResolver *)context;
+    NSString *addressString = SNBStringFromPacketAddress(family, address);
+    if (addressString) {
+        [resolver finishAddress:addressString hostname:name ? @(name) : nil];
+    }
+}
+
+@implementation SNBReverseDNSResolver
+
++ (instancetype)sharedResolver {
+    static SNBReverseDNSResolver *sharedResolver = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        SNBReverseResolverConfig config;
+        SNBReverseResolverConfigInit(&config);
+        if (SNBReverseResolverConfigLoadResolvConf(&config, kSNBResolvConfPath.fileSystemRepresentation) == 0) {
+            SNBLogNetworkWarn("No nameservers in %{public}@, reverse DNS is disabled", kSNBResolvConfPath);
+            return;
+        }
+        sharedResolver = [[self alloc] initWithConfig:&config];
+    });
+    return sharedResolver;
+}
+
+- (instancetype)initWithServers:(NSArray<NSString *> *)servers port:(uint16_t)port {
+    SNBReverseResolverConfig config;
+    SNBReverseResolverConfigInit(&config);
+    for (NSString *server in servers) {
+        if (!SNBReverseResolverConfigAddServer(&config, server.UTF8String, port)) {
+            SNBLogNetworkWarn("Ignoring nameserver %{public}@", server);
+        }
+    }
+    return [self initWithConfig:&config];
+}
+
+- (instancetype)initWithConfig:(const SNBReverseResolverConfig *)config {
+    self = [super init];
+    if (self) {
+        _resolver = SNBReverseResolverCreate(config, SNBReverseDNSHandler, (__bridge void *)self);
+        if (!_resolver) {
+            return nil;
+        }
+        _queue = dispatch_queue_create("com.sniffnetbar.reversedns", DISPATCH_QUEUE_SERIAL);
+        _waiters = [NSMutableDictionary dictionary];
+        _timerDeadlineNs = UINT64_MAX;
+
+        int descriptors[2];
+        size_t descriptorCount = SNBReverseResolverDescriptors(_resolver, descriptors, 2);
+        NSMutableArray<dispatch_source_t> *readSources = [NSMutableArray array];
+        for (size_t i = 0; i < descriptorCount; i++) {
+            [readSources addObject:dispatch_source_create(DISPATCH_SOURCE_TYPE_READ,
+                                                          (uintptr_t)descriptors[i], 0, _queue)];
+        }
+        _readSources = [readSources copy];
+        _timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, _queue);
+        dispatch_source_set_timer(_timer, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, 0);
+
+        // The sockets close with the engine, which must outlive every source
+        // watching them: the last cancel handler to run destroys it.
+        SNBReverseResolver *engine = _resolver;
+        __block NSUInteger liveSources = _readSources.count + 1;
+        dispatch_block_t cancelHandler = ^{
+            if (--liveSources == 0) {
+                SNBReverseResolverDestroy(engine);
+            }
+        };
+        __weak typeof(self) weakSelf = self;
+        for (dispatch_source_t source in _readSources) {
+            dispatch_source_set_event_handler(source, ^{
+                [weakSelf process];
+            });
+            dispatch_source_set_cancel_handler(source, cancelHandler);
+            dispatch_resume(source);
+        }
+        dispatch_source_set_event_handler(_timer, ^{
+            [weakSelf process];
+        });
+        dispatch_source_set_cancel_handler(_timer, cancelHandler);
+        dispatch_resume(_timer);
+    }
+    return self;
+}
+
+- (void)dealloc {
+    for (dispatch_source_t source in _readSources) {
+        dispatch_source_cancel(source);
+    }
+    if (_timer) {
+        dispatch_source_cancel(_timer);
+    }
+}
+
+#pragma mark - Lookups
+
+- (void)resolveAddress:(NSString *)address completion:(void (^)(NSString * _Nullable))completion {
+    dispatch_async(self.queue, ^{
+        uint8_t family = 0;
+        uint8_t bytes[16];
+        if (!SNBPacketAddressFromString(address, &family, bytes)) {
+            completion(nil);
+            return;
+        }
+        char name[SNB_DNS_MAX_NAME];
+        switch (SNBReverseResolverLookup(self.resolver, family, bytes, name, sizeof(name), SNBReverseDNSNowNs())) {
+            case SNBReverseLookupCached:
+                completion(name[0] != '\0' ? @(name) : nil);
+                return;
+            case SNBReverseLookupRejected:
+                SNBLogNetworkDebug("Reverse DNS queue full, skipping %{" SNB_IP_PRIVACY "}@", address);
+                completion(nil);
+                return;
+            case SNBReverseLookupPending:
+                break;
+        }
+        // Keyed by the canonical form the handler reports
+        NSString *key = SNBStringFromPacketAddress(family, bytes) ?: address;
+        NSMutableArray<SNBReverseDNSCompletion> *waiting = self.waiters[key];
+        if (!waiting) {
+            waiting = [NSMutableArray array];
+            self.waiters[key] = waiting;
+        }
+        [waiting addObject:[completion copy]];
+        [self rescheduleTimer];
+    });
+}
+
+- (void)learnFromResponse:(NSData *)message {
+    dispatch_async(self.queue, ^{
+        SNBReverseResolverLearn(self.resolver, message.bytes, message.length, SNBReverseDNSNowNs());
+    });
+}
+
+- (void)finishAddress:(NSString *)address hostname:(NSString *)hostname {
+    NSMutableArray<SNBReverseDNSCompletion> *waiting = self.waiters[address];
+    if (!waiting) {
+        return;
+    }
+    [self.waiters removeObjectForKey:address];
+    for (SNBReverseDNSCompletion completion in waiting) {
+        completion(hostname);
+    }
+}
+
+#pragma mark - Event loop
+
+- (void)process {
+    SNBReverseResolverProcess(self.resolver, SNBReverseDNSNowNs());
+    [self rescheduleTimer];
+}
+
+- (void)rescheduleTimer {
+    uint64_t deadlineNs = SNBReverseResolverNextDeadline(self.resolver);
+    if (deadlineNs == self.timerDeadlineNs) {
+        return;
+    }
+    self.timerDeadlineNs = deadlineNs;
+    if (deadlineNs == UINT64_MAX) {
+        dispatch_source_set_timer(self.timer, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, 0);
+        return;
+    }
+    uint64_t nowNs = SNBReverseDNSNowNs();
+    int64_t delayNs = deadlineNs > nowNs ? (int64_t)(deadlineNs - nowNs) : 0;
+    dispatch_source_set_timer(self.timer, dispatch_time(DISPATCH_TIME_NOW, delayNs),
+                              DISPATCH_TIME_FOREVER, 10 * NSEC_PER_MSEC);
+}
+
+#pragma mark - Statistics
+
+- (NSDictionary<NSString *, NSNumber *> *)statistics {
+    __block NSDictionary<NSString *, NSNumber *> *statistics = nil;
+    dispatch_sync(self.queue, ^{
+        SNBReverseResolverStats stats = SNBReverseResolverGetStats(self.resolver);
+        statistics = @{
+            @"lookups": @(stats.lookups),
+            @"cacheHits": @(stats.cacheHits),
+            @"coalesced": @(stats.coalesced),
+            @"rejected": @(stats.rejected),
+            @"queriesSent": @(stats.queriesSent),
+            @"answers": @(stats.answers),
+            @"negatives": @(stats.negatives),
+            @"timeouts": @(stats.timeouts),
+            @"learned": @(stats.learned),
+            @"evictions": @(stats.evictions),
+            @"pending": @(SNBReverseResolverPendingCount(self.resolver)),
+            @"cached": @(SNBReverseResolverCacheCount(self.resolver))
+        };
+    });
+    return statistics;
+}
+
+@end
@@ -0,0 +1,684 @@
+//
+//  ReverseResolver.c
+//  SniffNetBar
+//
+//  Non-blocking reverse-DNS engine: many PTR queries in flight on one queue
+//
+
+#include "ReverseResolver.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "FlowTable.h"
+
+#define SNB_REVERSE_SLOT_BITS 10
+#define SNB_REVERSE_SLOT_MASK ((1u << SNB_REVERSE_SLOT_BITS) - 1)
+// Answers and CNAME hops looked at per response
+#define SNB_REVERSE_MAX_ANSWERS 8
+// EDNS is not offered, but some servers answer with more than 512 bytes
+#define SNB_REVERSE_RECEIVE_BUFFER 1500
+
+typedef struct {
+    uint64_t expiresNs;
+    uint8_t negative;
+    char name[SNB_DNS_MAX_NAME];
+} SNBReverseCacheEntry;
+
+typedef struct {
+    bool active;
+    uint16_t id;
+    unsigned attempt;
+    uint64_t deadlineNs;
+    SNBFlowKey key;                  // The address, as a host key
+} SNBReverseQuery;
+
+typedef struct {
+    int32_t slot;                    // In-flight slot, -1 while queued
+} SNBReversePending;
+
+struct SNBReverseResolver {
+    SNBReverseResolverConfig config;
+    SNBReverseResolverHandler handler;
+    void *context;
+    int sockets[2];                  // For IPv4 and IPv6 servers, -1 if unused
+    SNBFlowTable *cache;             // Address -> SNBReverseCacheEntry
+    SNBFlowTable *pending;           // Address -> SNBReversePending
+    SNBReverseQuery *queries;
+    int32_t *freeSlots;
+    size_t freeCount;
+    SNBFlowKey *queue;               // Ring of lookups waiting for a slot
+    size_t queueHead;
+    size_t queueCount;
+    uint32_t random;
+    SNBReverseResolverStats stats;
+};
+
+// MARK: - Configuration
+
+void SNBReverseResolverConfigInit(SNBReverseResolverConfig *config) {
+    memset(config, 0, sizeof(*config));
+    config->attemptTimeoutNs = 1500000000ULL;
+    config->attempts = 3;
+    config->maxInFlight = 128;
+    config->maxQueued = 4096;
+    config->cacheCapacity = 4096;
+    config->minTTL = 60;
+    config->maxTTL = 86400;
+    config->negativeTTL = 900;
+    config->failureTTL = 60;
+}
+
+bool SNBReverseResolverConfigAddServer(SNBReverseResolverConfig *config, const char *address, uint16_t port) {
+    if (config->serverCount >= SNB_REVERSE_RESOLVER_MAX_SERVERS) {
+        return false;
+    }
+    char service[8];
+    snprintf(service, sizeof(service), "%u", port);
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV;
+    struct addrinfo *result = NULL;
+    if (getaddrinfo(address, service, &hints, &result) != 0 || !result) {
+        return false;
+    }
+    bool added = false;
+    if (result->ai_addrlen <= sizeof(struct sockaddr_storage)) {
+        memcpy(&config->servers[config->serverCount], result->ai_addr, result->ai_addrlen);
+        config->serverLengths[config->serverCount] = (socklen_t)result->ai_addrlen;
+        config->serverCount++;
+        added = true;
+    }
+    freeaddrinfo(result);
+    return added;
+}
+
+size_t SNBReverseResolverConfigLoadResolvConf(SNBReverseResolverConfig *config, const char *path) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return 0;
+    }
+    size_t added = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), file)) {
+        char address[128];
+        if (sscanf(line, " nameserver %127s", address) == 1 &&
+            SNBReverseResolverConfigAddServer(config, address, SNB_DNS_PORT)) {
+            added++;
+        }
+    }
+    fclose(file);
+    return added;
+}
+
+// MARK: - Lifecycle
+
+static int SNBReverseOpenSocket(int family) {
+    int descriptor = socket(family, SOCK_DGRAM, 0);
+    if (descriptor < 0) {
+        return -1;
+    }
+    int flags = fcntl(descriptor, F_GETFL, 0);
+    if (flags < 0 || fcntl(descriptor, F_SETFL, flags | O_NONBLOCK) < 0 ||
+        fcntl(descriptor, F_SETFD, FD_CLOEXEC) < 0) {
+        close(descriptor);
+        return -1;
+    }
+    return descriptor;
+}
+
+static int SNBReverseSocketIndex(int family) {
+    return family == AF_INET6 ? 1 : 0;
+}
+
+static uint32_t SNBReverseSeed(const void *salt) {
+    uint32_t seed = 0;
+    FILE *urandom = fopen("/dev/urandom", "rb");
+    if (urandom) {
+        if (fread(&seed, sizeof(seed), 1, urandom) != 1) {
+            seed = 0;
+        }
+        fclose(urandom);
+    }
+    seed ^= (uint32_t)(uintptr_t)salt ^ (uint32_t)getpid();
+    return seed != 0 ? seed : 0x9e3779b9u;
+}
+
+static uint32_t SNBReverseNextRandom(SNBReverseResolver *resolver) {
+    uint32_t x = resolver->random;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    resolver->random = x;
+    return x;
+}
+
+SNBReverseResolver *SNBReverseResolverCreate(const SNBReverseResolverConfig *config,
+                                             SNBReverseResolverHandler handler,
+                                             void *context) {
+    if (config->serverCount == 0) {
+        return NULL;
+    }
+    SNBReverseResolver *resolver = calloc(1, sizeof(*resolver));
+    if (!resolver) {
+        return NULL;
+    }
+    resolver->config = *config;
+    SNBReverseResolverConfig *settings = &resolver->config;
+    if (settings->maxInFlight == 0 || settings->maxInFlight > SNB_REVERSE_RESOLVER_MAX_IN_FLIGHT) {
+        settings->maxInFlight = SNB_REVERSE_RESOLVER_MAX_IN_FLIGHT;
+    }
+    settings->attempts = settings->attempts > 0 ? settings->attempts : 1;
+    settings->cacheCapacity = settings->cacheCapacity > 0 ? settings->cacheCapacity : 1;
+    resolver->handler = handler;
+    resolver->context = context;
+    resolver->sockets[0] = -1;
+    resolver->sockets[1] = -1;
+    resolver->random = SNBReverseSeed(resolver);
+
+    resolver->cache = SNBFlowTableCreate(sizeof(SNBReverseCacheEntry), settings->cacheCapacity);
+    resolver->pending = SNBFlowTableCreate(sizeof(SNBReversePending), settings->maxInFlight);
+    resolver->queries = calloc(settings->maxInFlight, sizeof(SNBReverseQuery));
+    resolver->freeSlots = calloc(settings->maxInFlight, sizeof(int32_t));
+    resolver->queue = settings->maxQueued > 0 ? calloc(settings->maxQueued, sizeof(SNBFlowKey)) : NULL;
+    if (!resolver->cache || !resolver->pending || !resolver->queries || !resolver->freeSlots ||
+        (settings->maxQueued > 0 && !resolver->queue)) {
+        SNBReverseResolverDestroy(resolver);
+        return NULL;
+    }
+    for (size_t i = 0; i < settings->maxInFlight; i++) {
+        resolver->freeSlots[resolver->freeCount++] = (int32_t)(settings->maxInFlight - 1 - i);
+    }
+
+    for (size_t i = 0; i < settings->serverCount; i++) {
+        int family = settings->servers[i].ss_family;
+        int index = SNBReverseSocketIndex(family);
+        if (resolver->sockets[index] < 0) {
+            resolver->sockets[index] = SNBReverseOpenSocket(family);
+            if (resolver->sockets[index] < 0) {
+                SNBReverseResolverDestroy(resolver);
+                return NULL;
+            }
+        }
+    }
+    return resolver;
+}
+
+void SNBReverseResolverDestroy(SNBReverseResolver *resolver) {
+    if (!resolver) {
+        return;
+    }
+    for (int i = 0; i < 2; i++) {
+        if (resolver->sockets[i] >= 0) {
+            close(resolver->sockets[i]);
+        }
+    }
+    SNBFlowTableDestroy(resolver->cache);
+    SNBFlowTableDestroy(resolver->pending);
+    free(resolver->queries);
+    free(resolver->freeSlots);
+    free(resolver->queue);
+    free(resolver);
+}
+
+// MARK: - Cache
+
+static uint64_t SNBReverseExpiry(uint64_t nowNs, uint32_t ttlSeconds) {
+    return nowNs + (uint64_t)ttlSeconds * 1000000000ULL;
+}
+
+static uint32_t SNBReverseClampTTL(uint32_t ttl, uint32_t minimum, uint32_t maximum) {
+    return ttl < minimum ? minimum : (ttl > maximum ? maximum : ttl);
+}
+
+// Drops expired entries, then every other entry until a quarter of the
+// capacity is free, so a full cache costs one pass per capacity/4 inserts
+static void SNBReverseCacheMakeRoom(SNBReverseResolver *resolver, uint64_t nowNs) {
+    size_t cursor = 0;
+    const SNBReverseCacheEntry *entry;
+    while ((entry = SNBFlowTableNext(resolver->cache, &cursor, NULL)) != NULL) {
+        if (entry->expiresNs <= nowNs) {
+            SNBFlowTableRemoveCurrent(resolver->cache, &cursor);
+        }
+    }
+    size_t target = resolver->config.cacheCapacity - resolver->config.cacheCapacity / 4;
+    bool drop = false;
+    cursor = 0;
+    while (SNBFlowTableCount(resolver->cache) > target &&
+           (entry = SNBFlowTableNext(resolver->cache, &cursor, NULL)) != NULL) {
+        drop = !drop;
+        if (drop) {
+            SNBFlowTableRemoveCurrent(resolver->cache, &cursor);
+            resolver->stats.evictions++;
+        }
+    }
+}
+
+static void SNBReverseCacheStore(SNBReverseResolver *resolver,
+                                 const SNBFlowKey *key,
+                                 const char *name,
+                                 uint32_t ttlSeconds,
+                                 uint64_t nowNs) {
+    if (SNBFlowTableCount(resolver->cache) >= resolver->config.cacheCapacity &&
+        !SNBFlowTableFind(resolver->cache, key)) {
+        SNBReverseCacheMakeRoom(resolver, nowNs);
+    }
+    SNBReverseCacheEntry *entry = SNBFlowTableUpsert(resolver->cache, key, NULL);
+    if (!entry) {
+        return;
+    }
+    entry->expiresNs = SNBReverseExpiry(nowNs, ttlSeconds);
+    entry->negative = name == NULL;
+    snprintf(entry->name, sizeof(entry->name), "%s", name ? name : "");
+}
+
+// MARK: - Queries
+
+static void SNBReverseSendQuery(SNBReverseResolver *resolver, int32_t slot, uint64_t nowNs) {
+    SNBReverseQuery *query = &resolver->queries[slot];
+    query->id = (uint16_t)((SNBReverseNextRandom(resolver) & ~SNB_REVERSE_SLOT_MASK) | (uint32_t)slot);
+    query->deadlineNs = nowNs + resolver->config.attemptTimeoutNs;
+
+    char name[SNB_DNS_MAX_NAME];
+    uint8_t message[SNB_DNS_MAX_UDP_MESSAGE];
+    if (!SNBDNSReverseName(query->key.family, query->key.destinationAddress, name, sizeof(name))) {
+        return;
+    }
+    size_t length = SNBDNSBuildQuery(message, sizeof(message), query->id, name, SNBDNSTypePTR);
+    size_t server = query->attempt % resolver->config.serverCount;
+    const struct sockaddr_storage *address = &resolver->config.servers[server];
+    int descriptor = resolver->sockets[SNBReverseSocketIndex(address->ss_family)];
+    // A failed send is retried like a lost answer when the deadline passes
+    if (length > 0 && descriptor >= 0 &&
+        sendto(descriptor, message, length, 0, (const struct sockaddr *)address,
+               resolver->config.serverLengths[server]) >= 0) {
+        resolver->stats.queriesSent++;
+    }
+}
+
+static void SNBReverseStartQuery(SNBReverseResolver *resolver, const SNBFlowKey *key, SNBReversePending *pending, uint64_t nowNs) {
+    int32_t slot = resolver->freeSlots[--resolver->freeCount];
+    SNBReverseQuery *query = &resolver->queries[slot];
+    memset(query, 0, sizeof(*query));
+    query->active = true;
+    query->key = *key;
+    pending->slot = slot;
+    SNBReverseSendQuery(resolver, slot, nowNs);
+}
+
+// Caches the outcome, frees the lookup's slot if it has one and tells the
+// handler. State is consistent before the handler runs, so it may look up
+// more addresses.
+static void SNBReverseFinish(SNBReverseResolver *resolver,
+                             const SNBFlowKey *lookupKey,
+                             const char *name,
+                             uint32_t ttlSeconds,
+                             uint64_t nowNs) {
+    SNBFlowKey key = *lookupKey;
+    SNBReverseCacheStore(resolver, &key, name, ttlSeconds, nowNs);
+    SNBReversePending *pending = SNBFlowTableFind(resolver->pending, &key);
+    if (pending) {
+        if (pending->slot >= 0) {
+            resolver->queries[pending->slot].active = false;
+            resolver->freeSlots[resolver->freeCount++] = pending->slot;
+        }
+        SNBFlowTableRemove(resolver->pending, &key);
+    }
+    if (name) {
+        resolver->stats.answers++;
+    } else {
+        resolver->stats.negatives++;
+    }
+    if (resolver->handler) {
+        resolver->handler(resolver->context, key.family, key.destinationAddress, name);
+    }
+}
+
+SNBReverseLookupStatus SNBReverseResolverLookup(SNBReverseResolver *resolver,
+                                                uint8_t family,
+                                                const uint8_t *address,
+                                                char *name,
+                                                size_t nameCapacity,
+                                                uint64_t nowNs) {
+    if (name && nameCapacity > 0) {
+        name[0] = '\0';
+    }
+    SNBFlowKey key;
+    SNBFlowKeyMakeAddress(&key, family, address);
+    resolver->stats.lookups++;
+
+    const SNBReverseCacheEntry *entry = SNBFlowTableFind(resolver->cache, &key);
+    if (entry && entry->expiresNs > nowNs) {
+        resolver->stats.cacheHits++;
+        if (!entry->negative && name && nameCapacity > 0) {
+            snprintf(name, nameCapacity, "%s", entry->name);
+        }
+        return SNBReverseLookupCached;
+    }
+    if (entry) {
+        SNBFlowTableRemove(resolver->cache, &key);
+    }
+
+    if (SNBFlowTableFind(resolver->pending, &key)) {
+        resolver->stats.coalesced++;
+        return SNBReverseLookupPending;
+    }
+    if (resolver->freeCount == 0 && resolver->queueCount >= resolver->config.maxQueued) {
+        resolver->stats.rejected++;
+        return SNBReverseLookupRejected;
+    }
+    SNBReversePending *pending = SNBFlowTableUpsert(resolver->pending, &key, NULL);
+    if (!pending) {
+        resolver->stats.rejected++;
+        return SNBReverseLookupRejected;
+    }
+    if (resolver->freeCount > 0) {
+        SNBReverseStartQuery(resolver, &key, pending, nowNs);
+    } else {
+        pending->slot = -1;
+        resolver->queue[(resolver->queueHead + resolver->queueCount) % resolver->config.maxQueued] = key;
+        resolver->queueCount++;
+    }
+    return SNBReverseLookupPending;
+}
+
+// MARK: - Responses
+
+typedef struct {
+    struct {
+        char owner[SNB_DNS_MAX_NAME];
+        char target[SNB_DNS_MAX_NAME];
+        uint16_t type;
+        uint32_t ttl;
+    } answers[SNB_REVERSE_MAX_ANSWERS];
+    size_t answerCount;
+    bool hasSOA;
+    uint32_t soaTTL;
+} SNBReverseAnswerSet;
+
+static void SNBReverseCollectAnswer(void *context, const SNBDNSRecord *record) {
+    SNBReverseAnswerSet *set = context;
+    if (record->section == SNBDNSSectionAuthority && record->type == SNBDNSTypeSOA) {
+        // RFC 2308: negative answers live for the lesser of the SOA TTL and minimum
+        set->hasSOA = true;
+        set->soaTTL = record->ttl < record->soaMinimum ? record->ttl : record->soaMinimum;
+        return;
+    }
+    if (record->section != SNBDNSSectionAnswer || !record->target ||
+        (record->type != SNBDNSTypePTR && record->type != SNBDNSTypeCNAME) ||
+        set->answerCount >= SNB_REVERSE_MAX_ANSWERS) {
+        return;
+    }
+    size_t index = set->answerCount++;
+    snprintf(set->answers[index].owner, SNB_DNS_MAX_NAME, "%s", record->name);
+    snprintf(set->answers[index].target, SNB_DNS_MAX_NAME, "%s", record->target);
+    set->answers[index].type = record->type;
+    set->answers[index].ttl = record->ttl;
+}
+
+// Follows CNAMEs from the question (RFC 2317 classless delegation) to a PTR
+static const char *SNBReversePTRTarget(const SNBReverseAnswerSet *set, const char *question, uint32_t *ttl) {
+    const char *current = question;
+    *ttl = UINT32_MAX;
+    for (size_t hop = 0; hop < SNB_REVERSE_MAX_ANSWERS; hop++) {
+        const char *next = NULL;
+        for (size_t i = 0; i < set->answerCount; i++) {
+            if (strcmp(set->answers[i].owner, current) != 0) {
+                continue;
+            }
+            if (set->answers[i].ttl < *ttl) {
+                *ttl = set->answers[i].ttl;
+            }
+            if (set->answers[i].type == SNBDNSTypePTR) {
+                return set->answers[i].target;
+            }
+            next = set->answers[i].target;
+        }
+        if (!next) {
+            return NULL;
+        }
+        current = next;
+    }
+    return NULL;
+}
+
+static bool SNBReverseFromServer(const SNBReverseResolver *resolver, const struct sockaddr_storage *from) {
+    for (size_t i = 0; i < resolver->config.serverCount; i++) {
+        const struct sockaddr_storage *server = &resolver->config.servers[i];
+        if (server->ss_family != from->ss_family) {
+            continue;
+        }
+        if (from->ss_family == AF_INET) {
+            const struct sockaddr_in *a = (const struct sockaddr_in *)server;
+            const struct sockaddr_in *b = (const struct sockaddr_in *)from;
+            if (a->sin_port == b->sin_port && a->sin_addr.s_addr == b->sin_addr.s_addr) {
+                return true;
+            }
+        } else if (from->ss_family == AF_INET6) {
+            const struct sockaddr_in6 *a = (const struct sockaddr_in6 *)server;
+            const struct sockaddr_in6 *b = (const struct sockaddr_in6 *)from;
+            if (a->sin6_port == b->sin6_port && memcmp(&a->sin6_addr, &b->sin6_addr, sizeof(a->sin6_addr)) == 0) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static void SNBReverseHandleResponse(SNBReverseResolver *resolver, const uint8_t *message, size_t length, uint64_t nowNs) {
+    SNBDNSHeader header;
+    SNBReverseAnswerSet set;
+    memset(&set, 0, sizeof(set));
+    if (!SNBDNSParseMessage(message, length, &header, SNBReverseCollectAnswer, &set, NULL) ||
+        !(header.flags & SNBDNSFlagResponse)) {
+        return;
+    }
+    int32_t slot = (int32_t)(header.id & SNB_REVERSE_SLOT_MASK);
+    if ((size_t)slot >= resolver->config.maxInFlight) {
+        return;
+    }
+    SNBReverseQuery *query = &resolver->queries[slot];
+    char expected[SNB_DNS_MAX_NAME];
+    // Late answers to a retried query carry the old ID and are dropped
+    if (!query->active || query->id != header.id ||
+        !SNBDNSReverseName(query->key.family, query->key.destinationAddress, expected, sizeof(expected)) ||
+        strcmp(expected, header.question) != 0) {
+        return;
+    }
+
+    uint8_t rcode = SNBDNSHeaderRcode(&header);
+    const SNBReverseResolverConfig *config = &resolver->config;
+    if (rcode == SNBDNSRcodeNoError || rcode == SNBDNSRcodeNXDomain) {
+        uint32_t ttl = 0;
+        const char *name = rcode == SNBDNSRcodeNoError ? SNBReversePTRTarget(&set, header.question, &ttl) : NULL;
+        if (name) {
+            char answer[SNB_DNS_MAX_NAME];
+            snprintf(answer, sizeof(answer), "%s", name);
+            SNBReverseFinish(resolver, &query->key, answer, SNBReverseClampTTL(ttl, config->minTTL, config->maxTTL), nowNs);
+            return;
+        }
+        if (!(header.flags & SNBDNSFlagTruncated)) {
+            uint32_t negativeTTL = set.hasSOA ? set.soaTTL : config->negativeTTL;
+            SNBReverseFinish(resolver, &query->key, NULL,
+                             SNBReverseClampTTL(negativeTTL, config->failureTTL, config->maxTTL), nowNs);
+            return;
+        }
+    }
+
+    // Server failure, refusal or a truncated answer: ask the next server
+    query->attempt++;
+    if (query->attempt < config->attempts) {
+        SNBReverseSendQuery(resolver, slot, nowNs);
+    } else {
+        SNBReverseFinish(resolver, &query->key, NULL, config->failureTTL, nowNs);
+    }
+}
+
+static void SNBReverseReadResponses(SNBReverseResolver *resolver, uint64_t nowNs) {
+    uint8_t message[SNB_REVERSE_RECEIVE_BUFFER];
+    for (int i = 0; i < 2; i++) {
+        int descriptor = resolver->sockets[i];
+        if (descriptor < 0) {
+            continue;
+        }
+        for (;;) {
+            struct sockaddr_storage from;
+            socklen_t fromLength = sizeof(from);
+            ssize_t received = recvfrom(descriptor, message, sizeof(message), 0, (struct sockaddr *)&from, &fromLength);
+            if (received < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                break;
+            }
+            if (SNBReverseFromServer(resolver, &from)) {
+                SNBReverseHandleResponse(resolver, message, (size_t)received, nowNs);
+            }
+        }
+    }
+}
+
+void SNBReverseResolverProcess(SNBReverseResolver *resolver, uint64_t nowNs) {
+    SNBReverseReadResponses(resolver, nowNs);
+
+    const SNBReverseResolverConfig *config = &resolver->config;
+    for (size_t slot = 0; slot < config->maxInFlight; slot++) {
+        SNBReverseQuery *query = &resolver->queries[slot];
+        if (!query->active || query->deadlineNs > nowNs) {
+            continue;
+        }
+        resolver->stats.timeouts++;
+        query->attempt++;
+        if (query->attempt < config->attempts) {
+            SNBReverseSendQuery(resolver, (int32_t)slot, nowNs);
+        } else {
+            SNBReverseFinish(resolver, &query->key, NULL, config->failureTTL, nowNs);
+        }
+    }
+
+    while (resolver->queueCount > 0 && resolver->freeCount > 0) {
+        SNBFlowKey key = resolver->queue[resolver->queueHead];
+        resolver->queueHead = (resolver->queueHead + 1) % config->maxQueued;
+        resolver->queueCount--;
+        // Lookups answered from a captured response have left the pending table
+        SNBReversePending *pending = SNBFlowTableFind(resolver->pending, &key);
+        if (pending && pending->slot < 0) {
+            SNBReverseStartQuery(resolver, &key, pending, nowNs);
+        }
+    }
+}
+
+size_t SNBReverseResolverDescriptors(const SNBReverseResolver *resolver, int *descriptors, size_t capacity) {
+    size_t count = 0;
+    for (int i = 0; i < 2 && count < capacity; i++) {
+        if (resolver->sockets[i] >= 0) {
+            descriptors[count++] = resolver->sockets[i];
+        }
+    }
+    return count;
+}
+
+uint64_t SNBReverseResolverNextDeadline(const SNBReverseResolver *resolver) {
+    uint64_t deadline = UINT64_MAX;
+    for (size_t slot = 0; slot < resolver->config.maxInFlight; slot++) {
+        const SNBReverseQuery *query = &resolver->queries[slot];
+        if (query->active && query->deadlineNs < deadline) {
+            deadline = query->deadlineNs;
+        }
+    }
+    return deadline;
+}
+
+// MARK: - Captured responses
+
+typedef struct {
+    SNBReverseResolver *resolver;
+    const SNBDNSHeader *header;
+    uint64_t nowNs;
+} SNBReverseLearnContext;
+
+static void SNBReverseRemember(SNBReverseResolver *resolver,
+                               uint8_t family,
+                               const uint8_t *address,
+                               const char *name,
+                               uint32_t ttl,
+                               uint64_t nowNs) {
+    if (name[0] == '\0') {
+        return;
+    }
+    SNBFlowKey key;
+    SNBFlowKeyMakeAddress(&key, family, address);
+    const SNBReverseResolverConfig *config = &resolver->config;
+    ttl = SNBReverseClampTTL(ttl, config->minTTL, config->maxTTL);
+
+    // A live name is kept, so addresses shared by many names do not flap
+    const SNBReverseCacheEntry *entry = SNBFlowTableFind(resolver->cache, &key);
+    if (entry && !entry->negative && entry->expiresNs > nowNs && strcmp(entry->name, name) != 0) {
+        return;
+    }
+    resolver->stats.learned++;
+    if (SNBFlowTableFind(resolver->pending, &key)) {
+        SNBReverseFinish(resolver, &key, name, ttl, nowNs);
+    } else {
+        SNBReverseCacheStore(resolver, &key, name, ttl, nowNs);
+    }
+}
+
+static void SNBReverseLearnRecord(void *context, const SNBDNSRecord *record) {
+    SNBReverseLearnContext *learn = context;
+    if (record->section != SNBDNSSectionAnswer) {
+        return;
+    }
+    const SNBDNSHeader *header = learn->header;
+    if (record->type == SNBDNSTypePTR && record->target) {
+        uint8_t family = SNBAddressFamilyNone;
+        uint8_t address[16];
+        if (SNBDNSAddressFromReverseName(record->name, &family, address)) {
+            SNBReverseRemember(learn->resolver, family, address, record->target, record->ttl, learn->nowNs);
+        }
+    } else if ((record->type == SNBDNSTypeA || record->type == SNBDNSTypeAAAA) && record->address) {
+        uint8_t address[16] = {0};
+        memcpy(address, record->address, record->type == SNBDNSTypeA ? 4 : 16);
+        // The name that was asked for, not the CDN name at the end of the chain
+        bool askedForAddress = header->question[0] != '\0' &&
+            (header->questionType == SNBDNSTypeA || header->questionType == SNBDNSTypeAAAA);
+        SNBReverseRemember(learn->resolver,
+                           record->type == SNBDNSTypeA ? SNBAddressFamilyIPv4 : SNBAddressFamilyIPv6,
+                           address,
+                           askedForAddress ? header->question : record->name,
+                           record->ttl,
+                           learn->nowNs);
+    }
+}
+
+void SNBReverseResolverLearn(SNBReverseResolver *resolver, const uint8_t *message, size_t length, uint64_t nowNs) {
+    // The header is complete before the first record reaches the handler
+    SNBDNSHeader header;
+    if (length < SNB_DNS_HEADER_LENGTH) {
+        return;
+    }
+    uint16_t flags = (uint16_t)((message[2] << 8) | message[3]);
+    if (!(flags & SNBDNSFlagResponse) || (flags & 0x000f) != SNBDNSRcodeNoError) {
+        return;
+    }
+    SNBReverseLearnContext context = { resolver, &header, nowNs };
+    SNBDNSParseMessage(message, length, &header, SNBReverseLearnRecord, &context, NULL);
+}
+
+SNBReverseResolverStats SNBReverseResolverGetStats(const SNBReverseResolver *resolver) {
+    return resolver->stats;
+}
+
+size_t SNBReverseResolverPendingCount(const SNBReverseResolver *resolver) {
+    return SNBFlowTableCount(resolver->pending);
+}
+
+size_t SNBReverseResolverCacheCount(const SNBReverseResolver *resolver) {
+    return SNBFlowTableCount(resolver->cache);
+}
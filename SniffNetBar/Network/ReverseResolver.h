@@ -0,0 +1,108 @@
+//
+//  ReverseResolver.h
+//  SniffNetBar
+//
+//  Non-blocking reverse-DNS engine: many PTR queries in flight on one queue
+//
+
+#ifndef SNB_REVERSE_RESOLVER_H
+#define SNB_REVERSE_RESOLVER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include "DNSMessage.h"
+
+// Sends PTR queries over non-blocking UDP sockets and matches the answers as
+// they arrive, so hundreds of lookups cost no threads while they wait. An
+// address already cached, in flight or queued never causes a second query.
+// Answers are cached for their TTL, and failures for the zone's negative TTL
+// (NXDOMAIN, no PTR) or a short retry interval (timeouts, SERVFAIL). DNS
+// responses captured off the wire can be fed in to fill the cache and finish
+// pending lookups without asking. The caller owns the thread: it polls the
+// descriptors, calls SNBReverseResolverProcess when one is readable or the
+// next deadline passes, and makes every call from that thread.
+#define SNB_REVERSE_RESOLVER_MAX_SERVERS 4
+// Query IDs carry the in-flight slot in their low bits
+#define SNB_REVERSE_RESOLVER_MAX_IN_FLIGHT 1024
+
+typedef struct SNBReverseResolverConfig {
+    struct sockaddr_storage servers[SNB_REVERSE_RESOLVER_MAX_SERVERS];
+    socklen_t serverLengths[SNB_REVERSE_RESOLVER_MAX_SERVERS];
+    size_t serverCount;
+    uint64_t attemptTimeoutNs;       // Wait per query before the next server is tried
+    unsigned attempts;               // Queries per lookup, rotating through the servers
+    size_t maxInFlight;
+    size_t maxQueued;                // Lookups waiting for an in-flight slot
+    size_t cacheCapacity;
+    uint32_t minTTL;                 // Bounds for answer TTLs, in seconds
+    uint32_t maxTTL;
+    uint32_t negativeTTL;            // No name and no SOA to say for how long
+    uint32_t failureTTL;             // Timeouts and server failures
+} SNBReverseResolverConfig;
+
+// Defaults with no servers
+void SNBReverseResolverConfigInit(SNBReverseResolverConfig *config);
+// Numeric IPv4 or IPv6 address, with an optional %scope for link-local ones
+bool SNBReverseResolverConfigAddServer(SNBReverseResolverConfig *config, const char *address, uint16_t port);
+// Adds the nameserver lines of a resolv.conf file; returns how many were added
+size_t SNBReverseResolverConfigLoadResolvConf(SNBReverseResolverConfig *config, const char *path);
+
+typedef struct SNBReverseResolver SNBReverseResolver;
+
+// Called once per lookup that did not complete from the cache, with the name
+// or NULL when the address has none (or the servers did not answer)
+typedef void (*SNBReverseResolverHandler)(void *context, uint8_t family, const uint8_t *address, const char *name);
+
+typedef enum {
+    SNBReverseLookupCached,          // name holds the answer; empty when the address has no name
+    SNBReverseLookupPending,         // The handler will be called
+    SNBReverseLookupRejected         // No servers, or the queue is full
+} SNBReverseLookupStatus;
+
+typedef struct SNBReverseResolverStats {
+    uint64_t lookups;
+    uint64_t cacheHits;
+    uint64_t coalesced;              // Lookups joined to one already pending
+    uint64_t rejected;
+    uint64_t queriesSent;
+    uint64_t answers;                // Lookups finished with a name
+    uint64_t negatives;              // Lookups finished without one
+    uint64_t timeouts;               // Queries that got no answer in time
+    uint64_t learned;                // Names taken from captured responses
+    uint64_t evictions;
+} SNBReverseResolverStats;
+
+// Returns NULL if the config has no servers or the sockets cannot be opened
+SNBReverseResolver *SNBReverseResolverCreate(const SNBReverseResolverConfig *config,
+                                             SNBReverseResolverHandler handler,
+                                             void *context);
+void SNBReverseResolverDestroy(SNBReverseResolver *resolver);
+
+SNBReverseLookupStatus SNBReverseResolverLookup(SNBReverseResolver *resolver,
+                                                uint8_t family,
+                                                const uint8_t *address,
+                                                char *name,
+                                                size_t nameCapacity,
+                                                uint64_t nowNs);
+
+// Sockets to wait on for reads; returns how many were written to descriptors
+size_t SNBReverseResolverDescriptors(const SNBReverseResolver *resolver, int *descriptors, size_t capacity);
+// Earliest query deadline, UINT64_MAX when nothing is in flight
+uint64_t SNBReverseResolverNextDeadline(const SNBReverseResolver *resolver);
+// Reads every waiting response, retries or fails queries past their deadline
+// and sends queued lookups into the freed slots
+void SNBReverseResolverProcess(SNBReverseResolver *resolver, uint64_t nowNs);
+
+// Takes PTR, A and AAAA answers from a DNS response seen on the wire. A PTR
+// answer names its address; an A or AAAA answer names its address with the
+// name that was asked for. Pending lookups for those addresses finish at
+// once. Truncated messages give what they hold.
+void SNBReverseResolverLearn(SNBReverseResolver *resolver, const uint8_t *message, size_t length, uint64_t nowNs);
+
+SNBReverseResolverStats SNBReverseResolverGetStats(const SNBReverseResolver *resolver);
+size_t SNBReverseResolverPendingCount(const SNBReverseResolver *resolver);
+size_t SNBReverseResolverCacheCount(const SNBReverseResolver *resolver);
+
+#endif
@@ -0,0 +1,113 @@
+//
+//  SocketProcessIndex.c
+//  SniffNetBar
+//
+//  Socket -> process index rebuilt from the process table in one pass
+//
+
+#include "SocketProcessIndex.h"
+#include <string.h>
+
+bool SNBSocketProcessIndexInit(SNBSocketProcessIndex *index,
+                               SNBSocketEnumerator enumerate,
+                               void *context,
+                               size_t initialCapacity) {
+    memset(index, 0, sizeof(*index));
+    index->enumerate = enumerate;
+    index->context = context;
+    index->minIntervalNs = SNB_SOCKET_INDEX_DEFAULT_MIN_INTERVAL_NS;
+    index->maxAgeNs = SNB_SOCKET_INDEX_DEFAULT_MAX_AGE_NS;
+    index->sockets = SNBFlowTableCreate(sizeof(int32_t), initialCapacity);
+    return index->sockets != NULL;
+}
+
+void SNBSocketProcessIndexDestroy(SNBSocketProcessIndex *index) {
+    SNBFlowTableDestroy(index->sockets);
+    memset(index, 0, sizeof(*index));
+}
+
+void SNBSocketProcessIndexAdd(SNBSocketProcessIndex *index, const SNBFlowKey *socketKey, int32_t pid) {
+    if (pid <= 0) {
+        return;
+    }
+    SNBFlowKey key = *socketKey;
+    key.hasPorts = 1;
+    key.reserved = 0;
+    bool inserted = false;
+    int32_t *owner = SNBFlowTableUpsert(index->sockets, &key, &inserted);
+    if (owner && inserted) {
+        *owner = pid;
+    }
+}
+
+bool SNBSocketProcessIndexRebuild(SNBSocketProcessIndex *index, uint64_t nowNs) {
+    SNBFlowTableClear(index->sockets);
+    index->builtNs = nowNs;
+    index->rebuilds++;
+    return index->enumerate ? index->enumerate(index->context, index) : false;
+}
+
+static bool SNBSocketProcessIndexMayRebuild(const SNBSocketProcessIndex *index, uint64_t nowNs) {
+    return index->rebuilds == 0 || nowNs >= index->builtNs + index->minIntervalNs;
+}
+
+static int32_t SNBSocketProcessIndexFind(const SNBSocketProcessIndex *index, const SNBFlowKey *connection) {
+    SNBFlowKey key = *connection;
+    key.hasPorts = 1;
+    key.reserved = 0;
+    const int32_t *pid = SNBFlowTableFind(index->sockets, &key);
+    if (pid) {
+        return *pid;
+    }
+
+    // Unconnected sockets send to any peer from their local endpoint
+    memset(key.destinationAddress, 0, sizeof(key.destinationAddress));
+    key.destinationPort = 0;
+    pid = SNBFlowTableFind(index->sockets, &key);
+    if (pid) {
+        return *pid;
+    }
+
+    memset(key.sourceAddress, 0, sizeof(key.sourceAddress));
+    pid = SNBFlowTableFind(index->sockets, &key);
+    return pid ? *pid : 0;
+}
+
+size_t SNBSocketProcessIndexResolve(SNBSocketProcessIndex *index,
+                                    const SNBFlowKey *keys,
+                                    size_t count,
+                                    int32_t *pids,
+                                    uint64_t nowNs) {
+    if (count == 0) {
+        return 0;
+    }
+    bool stale = index->rebuilds == 0 || nowNs >= index->builtNs + index->maxAgeNs;
+    if (stale && SNBSocketProcessIndexMayRebuild(index, nowNs)) {
+        SNBSocketProcessIndexRebuild(index, nowNs);
+    }
+
+    size_t resolved = 0;
+    for (size_t i = 0; i < count; i++) {
+        pids[i] = SNBSocketProcessIndexFind(index, &keys[i]);
+        resolved += pids[i] != 0;
+    }
+
+    // Connections opened since the last rebuild: one more pass serves them all
+    if (resolved < count && SNBSocketProcessIndexMayRebuild(index, nowNs)) {
+        SNBSocketProcessIndexRebuild(index, nowNs);
+        for (size_t i = 0; i < count; i++) {
+            if (pids[i] == 0) {
+                pids[i] = SNBSocketProcessIndexFind(index, &keys[i]);
+                resolved += pids[i] != 0;
+            }
+        }
+    }
+
+    index->lookups += count;
+    index->misses += count - resolved;
+    return resolved;
+}
+
+size_t SNBSocketProcessIndexCount(const SNBSocketProcessIndex *index) {
+    return SNBFlowTableCount(index->sockets);
+}
@@ -0,0 +1,74 @@
+//
+//  SocketProcessIndex.h
+//  SniffNetBar
+//
+//  Socket -> process index rebuilt from the process table in one pass
+//
+
+#ifndef SNB_SOCKET_PROCESS_INDEX_H
+#define SNB_SOCKET_PROCESS_INDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "FlowTable.h"
+
+// Walking the process table costs one call per process and one per socket,
+// so doing it per connection turns a burst of new flows into a CPU storm.
+// The index walks it once, keeps every socket keyed by its 5-tuple (local
+// endpoint as the source), and answers lookups from the table. A lookup
+// that misses rebuilds the index, at most once per minimum interval; an
+// index older than the maximum age is rebuilt before it is read so reused
+// ports are not attributed to the process that had them before.
+#define SNB_SOCKET_INDEX_DEFAULT_MIN_INTERVAL_NS 250000000ULL
+#define SNB_SOCKET_INDEX_DEFAULT_MAX_AGE_NS      5000000000ULL
+
+typedef struct SNBSocketProcessIndex SNBSocketProcessIndex;
+
+// Adds every socket of every process with SNBSocketProcessIndexAdd. Returns
+// false if the process table could not be read; sockets added before the
+// failure stay in the index.
+typedef bool (*SNBSocketEnumerator)(void *context, SNBSocketProcessIndex *index);
+
+struct SNBSocketProcessIndex {
+    SNBFlowTable *sockets;           // Socket 5-tuple -> owning pid (int32_t)
+    SNBSocketEnumerator enumerate;
+    void *context;
+    uint64_t minIntervalNs;
+    uint64_t maxAgeNs;
+    uint64_t builtNs;                // Time of the last rebuild, valid once rebuilds > 0
+    uint64_t rebuilds;
+    uint64_t lookups;
+    uint64_t misses;                 // Lookups still unresolved after any rebuild
+};
+
+bool SNBSocketProcessIndexInit(SNBSocketProcessIndex *index,
+                               SNBSocketEnumerator enumerate,
+                               void *context,
+                               size_t initialCapacity);
+void SNBSocketProcessIndexDestroy(SNBSocketProcessIndex *index);
+
+// Called by the enumerator for each socket. The key holds the socket's local
+// address and port as the source and its peer as the destination; sockets
+// with no peer (unconnected UDP, listeners) leave the destination zero, and
+// sockets bound to every address leave the source address zero too. The
+// first process seen owning a socket keeps it.
+void SNBSocketProcessIndexAdd(SNBSocketProcessIndex *index, const SNBFlowKey *socketKey, int32_t pid);
+
+// Rebuilds now, regardless of the rate limit
+bool SNBSocketProcessIndexRebuild(SNBSocketProcessIndex *index, uint64_t nowNs);
+
+// Resolves count connections, their local endpoint as the source, into pids
+// (0 when no process owns the connection) and returns how many resolved.
+// Connections match an exact socket first, then an unconnected socket on
+// the local address and port, then one bound to every address. The whole
+// batch shares at most one rebuild.
+size_t SNBSocketProcessIndexResolve(SNBSocketProcessIndex *index,
+                                    const SNBFlowKey *keys,
+                                    size_t count,
+                                    int32_t *pids,
+                                    uint64_t nowNs);
+
+size_t SNBSocketProcessIndexCount(const SNBSocketProcessIndex *index);
+
+#endif
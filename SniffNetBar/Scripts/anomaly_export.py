@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+"""Export the anomaly model bundle to the native evaluator's tree format.
+
+The layout is documented in Models/IsolationForest.h. Leaves carry the path
+length scikit-learn credits a sample that lands there, computed here with
+scikit-learn's own helpers, so the app only sums and normalizes.
+"""
+import argparse
+import struct
+
+MAGIC = b"SNBIFRST"
+VERSION = 1
+TREE_LEAF = -1
+
+
+def forest_trees(model):
+    """Flattens a fitted IsolationForest into per-tree node tuples."""
+    from sklearn.ensemble._iforest import _average_path_length
+    import numpy as np
+
+    n_features = model.n_features_in_
+    subsample_features = model._max_features != n_features
+    trees = []
+    for estimator, features in zip(model.estimators_, model.estimators_features_):
+        tree = estimator.tree_
+        left = tree.children_left
+        right = tree.children_right
+
+        # Depth counted the way decision_path counts it: the root is 1
+        depths = np.zeros(tree.node_count, dtype=np.int64)
+        depths[0] = 1
+        for node in range(tree.node_count):
+            if left[node] != TREE_LEAF:
+                depths[left[node]] = depths[node] + 1
+                depths[right[node]] = depths[node] + 1
+        path_lengths = depths + _average_path_length(tree.n_node_samples) - 1.0
+
+        nodes = []
+        for node in range(tree.node_count):
+            if left[node] == TREE_LEAF:
+                nodes.append((TREE_LEAF, TREE_LEAF, 0, float(path_lengths[node])))
+            else:
+                feature = int(tree.feature[node])
+                if subsample_features:
+                    feature = int(features[feature])
+                nodes.append((int(left[node]), int(right[node]), feature, float(tree.threshold[node])))
+        trees.append(nodes)
+
+    normalizer = float(len(model.estimators_) * _average_path_length([model.max_samples_])[0])
+    return trees, normalizer
+
+
+def write_model(path, cont_cols, extra_cols, medians, iqrs, score_min, score_max, normalizer, trees):
+    with open(path, "wb") as out:
+        out.write(MAGIC)
+        out.write(struct.pack("<IIII", VERSION, len(cont_cols), len(extra_cols), len(trees)))
+        out.write(struct.pack("<ddd", score_min, score_max, normalizer))
+        out.write(struct.pack("<%dd" % len(medians), *medians))
+        out.write(struct.pack("<%dd" % len(iqrs), *iqrs))
+        for name in list(cont_cols) + list(extra_cols):
+            encoded = name.encode("utf-8")
+            out.write(struct.pack("<I", len(encoded)))
+            out.write(encoded)
+        for nodes in trees:
+            out.write(struct.pack("<I", len(nodes)))
+            for left, right, feature, value in nodes:
+                out.write(struct.pack("<iiiId", left, right, feature, 0, value))
+
+
+def export_bundle(bundle, path):
+    trees, normalizer = forest_trees(bundle["model"])
+    write_model(
+        path,
+        bundle["cont_cols"],
+        bundle.get("extra_cols", []),
+        [float(v) for v in bundle["medians"]],
+        [float(v) for v in bundle["iqrs"]],
+        float(bundle.get("score_min", -0.5)),
+        float(bundle.get("score_max", 0.5)),
+        normalizer,
+        trees,
+    )
+
+
+def main():
+    import joblib
+
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--model", required=True, help="joblib bundle from anomaly_train.py")
+    parser.add_argument("--out", required=True, help="Output .iforest path")
+    args = parser.parse_args()
+    export_bundle(joblib.load(args.model), args.out)
+
+
+if __name__ == "__main__":
+    main()
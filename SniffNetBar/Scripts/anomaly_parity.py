@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+"""Checks the native evaluator against anomaly_score.py on the same bundle.
+
+Exports the bundle, scores rows from the anomaly database (or synthetic rows
+spanning the training scale) with both, and fails if any score differs by
+more than --tolerance.
+"""
+import argparse
+import os
+import random
+import subprocess
+import sys
+import tempfile
+
+import joblib
+
+from anomaly_export import export_bundle
+from anomaly_score import score_payloads
+from anomaly_train import load_rows
+
+
+def synthetic_rows(cont_cols, extra_cols, count, seed):
+    rng = random.Random(seed)
+    rows = []
+    for _ in range(count):
+        row = {c: float(int(10 ** rng.uniform(0, 7))) for c in cont_cols}
+        row["burstiness"] = rng.uniform(0, 5000)
+        port = rng.randrange(3)
+        proto = rng.randrange(4)
+        for index, name in enumerate(extra_cols):
+            if name.startswith("port_"):
+                row[name] = 1.0 if index == port else 0.0
+            else:
+                row[name] = 1.0 if index - 3 == proto else 0.0
+        rows.append(row)
+    return rows
+
+
+def database_rows(db_path, cols, limit):
+    _, data = load_rows(db_path)
+    return [dict(zip(cols, values)) for values in data[:limit].tolist()]
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--model", required=True, help="joblib bundle from anomaly_train.py")
+    parser.add_argument("--scorer", required=True, help="Path to anomaly_score_native")
+    parser.add_argument("--db", help="Score rows from this anomaly database")
+    parser.add_argument("--rows", type=int, default=2000)
+    parser.add_argument("--tolerance", type=float, default=1e-9)
+    args = parser.parse_args()
+
+    bundle = joblib.load(args.model)
+    cont_cols = bundle["cont_cols"]
+    extra_cols = bundle.get("extra_cols", [])
+    cols = list(cont_cols) + list(extra_cols)
+    if args.db and os.path.exists(args.db):
+        rows = database_rows(args.db, cols, args.rows)
+    else:
+        rows = synthetic_rows(cont_cols, extra_cols, args.rows, seed=7)
+
+    expected = score_payloads(bundle, rows)
+
+    with tempfile.TemporaryDirectory() as workdir:
+        native_model = os.path.join(workdir, "anomaly_model.iforest")
+        export_bundle(bundle, native_model)
+        csv = "".join(",".join(repr(float(row[c])) for c in cols) + "\n" for row in rows)
+        output = subprocess.run([args.scorer, native_model], input=csv, capture_output=True,
+                                text=True, check=True).stdout
+    actual = [float(line) for line in output.split()]
+
+    if len(actual) != len(expected):
+        print("native scorer returned %d scores for %d rows" % (len(actual), len(expected)))
+        return 1
+    worst = max(range(len(rows)), key=lambda i: abs(actual[i] - expected[i]))
+    difference = abs(actual[worst] - expected[worst])
+    print("%d rows, max |native - python| = %.3g (row %d)" % (len(rows), difference, worst))
+    if difference > args.tolerance:
+        print("python %.17g, native %.17g for %r" % (expected[worst], actual[worst], rows[worst]))
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
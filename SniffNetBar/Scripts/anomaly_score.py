@@ -6,14 +6,7 @@ import joblib
 import numpy as np
 
 
-def main():
-    if len(sys.argv) < 2:
-        print(json.dumps({"error": "missing model path"}))
-        return 1
-
-    model_path = sys.argv[1]
-    bundle = joblib.load(model_path)
-
+def score_payloads(bundle, payloads):
     model = bundle["model"]
     medians = np.array(bundle["medians"], dtype=np.float64)
     iqrs = np.array(bundle["iqrs"], dtype=np.float64)
@@ -21,21 +14,40 @@ def main():
     score_min = float(bundle.get("score_min", -0.5))
     score_max = float(bundle.get("score_max", 0.5))
 
-    payload = json.load(sys.stdin)
-
-    cont_values = np.array([payload[c] for c in cont_cols], dtype=np.float64)
+    cont_values = np.array([[p[c] for c in cont_cols] for p in payloads], dtype=np.float64)
     cont_values = np.log1p(cont_values)
     cont_values = (cont_values - medians) / (iqrs + 1e-9)
 
     extra_cols = bundle.get("extra_cols", [])
-    extra_values = np.array([payload[c] for c in extra_cols], dtype=np.float64)
+    extra_values = np.array([[p[c] for c in extra_cols] for p in payloads], dtype=np.float64)
+    extra_values = extra_values.reshape(len(payloads), len(extra_cols))
 
-    features = np.concatenate([cont_values, extra_values])
-    raw = model.score_samples([features])[0]
+    features = np.concatenate([cont_values, extra_values], axis=1)
+    raw = model.score_samples(features)
 
     norm = (raw - score_min) / (score_max - score_min + 1e-9)
-    score = 1.0 - max(0.0, min(1.0, norm))
+    return [1.0 - max(0.0, min(1.0, float(n))) for n in norm]
+
+
+def score_payload(bundle, payload):
+    return score_payloads(bundle, [payload])[0]
+
+
+def main():
+    if len(sys.argv) < 2:
+        print(json.dumps({"error": "missing model path"}))
+        return 1
+
+    model_path = sys.argv[1]
+    bundle = joblib.load(model_path)
+
+    payload = json.load(sys.stdin)
+    if isinstance(payload, list):
+        # A whole window scored in one call
+        print(json.dumps({"scores": score_payloads(bundle, payload) if payload else []}))
+        return 0
 
+    score = score_payload(bundle, payload)
     print(json.dumps({"score": float(score)}))
     return 0
 
@@ -1,11 +1,14 @@
 #!/usr/bin/env python3
 import argparse
+import os
 import sqlite3
 
 import joblib
 import numpy as np
 from sklearn.ensemble import IsolationForest
 
+from anomaly_export import export_bundle
+
 
 CONT_COLS = [
     "total_bytes",
@@ -54,6 +57,7 @@ def main():
     parser = argparse.ArgumentParser()
     parser.add_argument("--db", required=True)
     parser.add_argument("--out", required=True)
+    parser.add_argument("--native-out", help="Native model path (default: --out with .iforest)")
     args = parser.parse_args()
 
     cols, data = load_rows(args.db)
@@ -84,18 +88,20 @@ def main():
     score_min = float(raw_scores.min())
     score_max = float(raw_scores.max())
 
-    joblib.dump(
-        {
-            "model": model,
-            "medians": medians.tolist(),
-            "iqrs": iqrs.tolist(),
-            "cont_cols": CONT_COLS,
-            "extra_cols": EXTRA_COLS,
-            "score_min": score_min,
-            "score_max": score_max,
-        },
-        args.out,
-    )
+    bundle = {
+        "model": model,
+        "medians": medians.tolist(),
+        "iqrs": iqrs.tolist(),
+        "cont_cols": CONT_COLS,
+        "extra_cols": EXTRA_COLS,
+        "score_min": score_min,
+        "score_max": score_max,
+    }
+    joblib.dump(bundle, args.out)
+
+    # The app scores with the native evaluator; the bundle stays the source of truth
+    native_out = args.native_out or os.path.splitext(args.out)[0] + ".iforest"
+    export_bundle(bundle, native_out)
 
 
 if __name__ == "__main__":
@@ -0,0 +1,171 @@
+//
+//  AnomalyAccumulatorTests.m
+//  SniffNetBar
+//
+//  Compact window accumulators must produce the features of a full recount
+//
+
+#import <XCTest/XCTest.h>
+#import <math.h>
+#import <netinet/in.h>
+#import "AnomalyAccumulator.h"
+#import "PacketInfo.h"
+
+@interface AnomalyAccumulatorTests : XCTestCase
+@end
+
+@implementation AnomalyAccumulatorTests
+
+#pragma mark - Helpers
+
+static SNBPacketRecord SNBAccumulatorTestRecord(uint32_t source, uint16_t sourcePort, uint16_t destinationPort,
+                                                uint8_t ipProtocol, uint32_t length) {
+    SNBPacketRecord record;
+    memset(&record, 0, sizeof(record));
+    record.family = SNBAddressFamilyIPv4;
+    record.ipProtocol = ipProtocol;
+    record.length = length;
+    record.sourceAddress[0] = 10;
+    record.sourceAddress[1] = (uint8_t)(source >> 16);
+    record.sourceAddress[2] = (uint8_t)(source >> 8);
+    record.sourceAddress[3] = (uint8_t)source;
+    record.destinationAddress[0] = 93;
+    record.destinationAddress[3] = 1;
+    if (ipProtocol == IPPROTO_TCP || ipProtocol == IPPROTO_UDP) {
+        record.flags = SNBPacketRecordFlagHasPorts;
+        record.sourcePort = sourcePort;
+        record.destinationPort = destinationPort;
+    }
+    return record;
+}
+
+static void SNBAccumulatorTestAdd(SNBAnomalyAccumulator *acc, SNBAnomalyArena *arena, const SNBPacketRecord *record) {
+    SNBAnomalyAccumulatorAddPacket(acc, arena, record, (int)SNBPacketProtocolFromIPProtocol(record->ipProtocol));
+}
+
+#pragma mark - Tests
+
+- (void)testSmallDestinationStaysInline {
+    SNBAnomalyArena arena;
+    SNBAnomalyArenaInit(&arena, 4096);
+    SNBAnomalyAccumulator acc;
+    memset(&acc, 0, sizeof(acc));
+
+    SNBPacketRecord first = SNBAccumulatorTestRecord(1, 50000, 443, IPPROTO_TCP, 100);
+    SNBPacketRecord second = SNBAccumulatorTestRecord(2, 50001, 443, IPPROTO_TCP, 300);
+    SNBAccumulatorTestAdd(&acc, &arena, &first);
+    SNBAccumulatorTestAdd(&acc, &arena, &first);
+    SNBAccumulatorTestAdd(&acc, &arena, &second);
+
+    SNBAnomalyWindowSummary summary;
+    SNBAnomalyAccumulatorSummarize(&acc, &summary);
+    XCTAssertEqual(summary.totalBytes, 500u);
+    XCTAssertEqual(summary.totalPackets, 3u);
+    XCTAssertEqual(summary.uniqueSrcPorts, 2u);
+    XCTAssertEqual(summary.flowCount, 2u);
+    // Flows of 200 and 300 bytes
+    XCTAssertEqualWithAccuracy(summary.burstiness, 50.0, 1e-9);
+    XCTAssertEqual(summary.commonPort, 443);
+    XCTAssertEqual(summary.protocol, (int32_t)PacketProtocolTCP);
+    XCTAssertEqual(arena.reservedBytes, 0u);
+    SNBAnomalyArenaDestroy(&arena);
+}
+
+- (void)testCountsMatchRecountAcrossSetAndBitmap {
+    SNBAnomalyArena arena;
+    SNBAnomalyArenaInit(&arena, 64 * 1024);
+    for (NSUInteger window = 0; window < 2; window++) {
+        SNBAnomalyAccumulator acc;
+        memset(&acc, 0, sizeof(acc));
+        NSMutableSet<NSNumber *> *ports = [NSMutableSet set];
+        NSMutableDictionary<NSNumber *, NSNumber *> *flowBytes = [NSMutableDictionary dictionary];
+        uint64_t state = 7 + window;
+        // Enough source ports to pass through the inline slots, the set and the bitmap
+        for (NSUInteger i = 0; i < 40000; i++) {
+            state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+            uint16_t port = (uint16_t)(1 + (state >> 33) % 9000);
+            uint32_t length = 60 + (uint32_t)((state >> 17) % 1400);
+            SNBPacketRecord record = SNBAccumulatorTestRecord(1, port, 443, IPPROTO_UDP, length);
+            SNBAccumulatorTestAdd(&acc, &arena, &record);
+            [ports addObject:@(port)];
+            flowBytes[@(port)] = @(flowBytes[@(port)].unsignedLongLongValue + length);
+        }
+
+        double mean = 0.0;
+        double m2 = 0.0;
+        NSUInteger samples = 0;
+        for (NSNumber *bytes in flowBytes.allValues) {
+            samples++;
+            double delta = bytes.doubleValue - mean;
+            mean += delta / (double)samples;
+            m2 += delta * (bytes.doubleValue - mean);
+        }
+
+        SNBAnomalyWindowSummary summary;
+        SNBAnomalyAccumulatorSummarize(&acc, &summary);
+        XCTAssertEqual(summary.uniqueSrcPorts, (uint64_t)ports.count);
+        XCTAssertEqual(summary.flowCount, (uint64_t)flowBytes.count);
+        XCTAssertEqualWithAccuracy(summary.burstiness, sqrt(m2 / (double)samples), 1e-6);
+        XCTAssertEqual(summary.commonPort, 443);
+        XCTAssertEqual(summary.protocol, (int32_t)PacketProtocolUDP);
+        SNBAnomalyArenaReset(&arena);
+    }
+    SNBAnomalyArenaDestroy(&arena);
+}
+
+- (void)testTopPortAndPortlessPackets {
+    SNBAnomalyArena arena;
+    SNBAnomalyArenaInit(&arena, 4096);
+    SNBAnomalyAccumulator acc;
+    memset(&acc, 0, sizeof(acc));
+
+    // One dominant port among more distinct ports than the top-K holds
+    for (uint16_t port = 1; port <= 12; port++) {
+        SNBPacketRecord record = SNBAccumulatorTestRecord(1, 40000, port, IPPROTO_TCP, 60);
+        SNBAccumulatorTestAdd(&acc, &arena, &record);
+    }
+    for (NSUInteger i = 0; i < 20; i++) {
+        SNBPacketRecord record = SNBAccumulatorTestRecord(1, 40000, 8080, IPPROTO_TCP, 60);
+        SNBAccumulatorTestAdd(&acc, &arena, &record);
+    }
+    SNBAnomalyWindowSummary summary;
+    SNBAnomalyAccumulatorSummarize(&acc, &summary);
+    XCTAssertEqual(summary.commonPort, 8080);
+
+    // Packets without ports count towards port -1 and no source port
+    SNBAnomalyAccumulator icmp;
+    memset(&icmp, 0, sizeof(icmp));
+    for (NSUInteger i = 0; i < 3; i++) {
+        SNBPacketRecord record = SNBAccumulatorTestRecord((uint32_t)i, 0, 0, IPPROTO_ICMP, 84);
+        SNBAccumulatorTestAdd(&icmp, &arena, &record);
+    }
+    SNBAnomalyAccumulatorSummarize(&icmp, &summary);
+    XCTAssertEqual(summary.commonPort, -1);
+    XCTAssertEqual(summary.uniqueSrcPorts, 0u);
+    XCTAssertEqual(summary.flowCount, 3u);
+    XCTAssertEqual(summary.burstiness, 0.0);
+    XCTAssertEqual(summary.protocol, (int32_t)PacketProtocolICMP);
+    SNBAnomalyArenaDestroy(&arena);
+}
+
+- (void)testArenaKeepsChunksAcrossResets {
+    SNBAnomalyArena arena;
+    SNBAnomalyArenaInit(&arena, 1024);
+    for (NSUInteger i = 0; i < 8; i++) {
+        uint8_t *block = SNBAnomalyArenaAllocate(&arena, 700);
+        XCTAssertTrue(block != NULL);
+        XCTAssertEqual(((uintptr_t)block) % 8, 0u);
+        XCTAssertEqual(block[0] | block[699], 0);
+        memset(block, 0xff, 700);
+    }
+    size_t reserved = arena.reservedBytes;
+    SNBAnomalyArenaReset(&arena);
+    for (NSUInteger i = 0; i < 8; i++) {
+        uint8_t *block = SNBAnomalyArenaAllocate(&arena, 700);
+        XCTAssertEqual(block[0] | block[699], 0);
+    }
+    XCTAssertEqual(arena.reservedBytes, reserved);
+    SNBAnomalyArenaDestroy(&arena);
+}
+
+@end
@@ -0,0 +1,124 @@
+//
+//  AnomalyFeatureMatrixTests.m
+//  SniffNetBar
+//
+//  Window feature rows must match the per-IP payloads they replaced
+//
+
+#import <XCTest/XCTest.h>
+#import <math.h>
+#import "AnomalyFeatureMatrix.h"
+#import "PacketInfo.h"
+
+@interface AnomalyFeatureMatrixTests : XCTestCase
+@end
+
+@implementation AnomalyFeatureMatrixTests
+
+#pragma mark - Helpers
+
+static void SNBMakeMatrixTestKey(SNBFlowKey *key, NSUInteger host) {
+    const uint8_t address[16] = {93, (uint8_t)(host >> 16), (uint8_t)(host >> 8), (uint8_t)host};
+    SNBFlowKeyMakeAddress(key, SNBAddressFamilyIPv4, address);
+}
+
+static double SNBMatrixValue(const SNBAnomalyFeatureMatrix *matrix, SNBAnomalyFeature feature, size_t row) {
+    return matrix->columns[feature][row];
+}
+
+#pragma mark - Tests
+
+- (void)testFeatureNamesRoundTrip {
+    for (int feature = 0; feature < SNBAnomalyFeatureCount; feature++) {
+        XCTAssertEqual(SNBAnomalyFeatureFromName(SNBAnomalyFeatureName(feature)), feature);
+    }
+    XCTAssertEqualObjects(@(SNBAnomalyFeatureName(SNBAnomalyFeatureTotalBytes)), @"total_bytes");
+    XCTAssertEqualObjects(@(SNBAnomalyFeatureName(SNBAnomalyFeatureProtoOther)), @"proto_other");
+    XCTAssertEqual(SNBAnomalyFeatureFromName("bytes"), -1);
+}
+
+- (void)testDerivesPayloadFeatures {
+    SNBAnomalyFeatureMatrix matrix;
+    XCTAssertTrue(SNBAnomalyFeatureMatrixInit(&matrix, 1));
+    SNBFlowKey key;
+    SNBMakeMatrixTestKey(&key, 1);
+    SNBAnomalyWindowSummary summary = {
+        .totalBytes = 9000, .totalPackets = 12, .uniqueSrcPorts = 3, .flowCount = 4,
+        .burstiness = 17.5, .commonPort = 443, .protocol = PacketProtocolTCP,
+    };
+    XCTAssertTrue(SNBAnomalyFeatureMatrixAppend(&matrix, &key, &summary));
+
+    XCTAssertEqual(matrix.rowCount, 1u);
+    XCTAssertEqual(SNBMatrixValue(&matrix, SNBAnomalyFeatureTotalBytes, 0), 9000.0);
+    XCTAssertEqual(SNBMatrixValue(&matrix, SNBAnomalyFeatureTotalPackets, 0), 12.0);
+    XCTAssertEqual(SNBMatrixValue(&matrix, SNBAnomalyFeatureUniqueSrcPorts, 0), 3.0);
+    XCTAssertEqual(SNBMatrixValue(&matrix, SNBAnomalyFeatureFlowCount, 0), 4.0);
+    XCTAssertEqual(SNBMatrixValue(&matrix, SNBAnomalyFeatureAvgPktSize, 0), 750.0);
+    XCTAssertEqual(SNBMatrixValue(&matrix, SNBAnomalyFeatureBytesPerFlow, 0), 2250.0);
+    XCTAssertEqual(SNBMatrixValue(&matrix, SNBAnomalyFeaturePktsPerFlow, 0), 3.0);
+    XCTAssertEqual(SNBMatrixValue(&matrix, SNBAnomalyFeatureBurstiness, 0), 17.5);
+    XCTAssertEqual(SNBMatrixValue(&matrix, SNBAnomalyFeaturePortWellKnown, 0), 1.0);
+    XCTAssertEqual(SNBMatrixValue(&matrix, SNBAnomalyFeaturePortRegistered, 0), 0.0);
+    XCTAssertEqual(SNBMatrixValue(&matrix, SNBAnomalyFeaturePortDynamic, 0), 0.0);
+    XCTAssertEqual(SNBMatrixValue(&matrix, SNBAnomalyFeatureProtoTCP, 0), 1.0);
+    XCTAssertEqual(SNBMatrixValue(&matrix, SNBAnomalyFeatureProtoOther, 0), 0.0);
+    XCTAssertEqual(memcmp(&matrix.keys[0], &key, sizeof(key)), 0);
+    XCTAssertEqual(matrix.dstPorts[0], 443);
+    XCTAssertEqual(matrix.protocols[0], (int32_t)PacketProtocolTCP);
+    XCTAssertTrue(isnan(matrix.scores[0]));
+    SNBAnomalyFeatureMatrixDestroy(&matrix);
+}
+
+- (void)testPortlessAndUnknownProtocolRows {
+    SNBAnomalyFeatureMatrix matrix;
+    XCTAssertTrue(SNBAnomalyFeatureMatrixInit(&matrix, 1));
+    SNBFlowKey key;
+    SNBMakeMatrixTestKey(&key, 2);
+    SNBAnomalyWindowSummary summary = {
+        .totalBytes = 84, .totalPackets = 1, .flowCount = 0,
+        .commonPort = -1, .protocol = PacketProtocolUnknown,
+    };
+    XCTAssertTrue(SNBAnomalyFeatureMatrixAppend(&matrix, &key, &summary));
+
+    // No flows divides by one, and port -1 falls in no range
+    XCTAssertEqual(SNBMatrixValue(&matrix, SNBAnomalyFeatureBytesPerFlow, 0), 84.0);
+    XCTAssertEqual(SNBMatrixValue(&matrix, SNBAnomalyFeaturePktsPerFlow, 0), 1.0);
+    XCTAssertEqual(SNBMatrixValue(&matrix, SNBAnomalyFeaturePortWellKnown, 0) +
+                   SNBMatrixValue(&matrix, SNBAnomalyFeaturePortRegistered, 0) +
+                   SNBMatrixValue(&matrix, SNBAnomalyFeaturePortDynamic, 0), 0.0);
+    XCTAssertEqual(SNBMatrixValue(&matrix, SNBAnomalyFeatureProtoTCP, 0), 0.0);
+    XCTAssertEqual(SNBMatrixValue(&matrix, SNBAnomalyFeatureProtoUDP, 0), 0.0);
+    XCTAssertEqual(SNBMatrixValue(&matrix, SNBAnomalyFeatureProtoICMP, 0), 0.0);
+    XCTAssertEqual(SNBMatrixValue(&matrix, SNBAnomalyFeatureProtoOther, 0), 1.0);
+    SNBAnomalyFeatureMatrixDestroy(&matrix);
+}
+
+- (void)testGrowsAndKeepsStorageAcrossWindows {
+    SNBAnomalyFeatureMatrix matrix;
+    XCTAssertTrue(SNBAnomalyFeatureMatrixInit(&matrix, 2));
+    const NSUInteger count = 10000;
+    for (NSUInteger window = 0; window < 2; window++) {
+        SNBAnomalyFeatureMatrixClear(&matrix);
+        for (NSUInteger i = 0; i < count; i++) {
+            SNBFlowKey key;
+            SNBMakeMatrixTestKey(&key, i);
+            SNBAnomalyWindowSummary summary = {
+                .totalBytes = i * 100 + window, .totalPackets = i + 1, .flowCount = 1,
+                .commonPort = (int32_t)(i % 65536), .protocol = (int32_t)(i % 5),
+            };
+            XCTAssertTrue(SNBAnomalyFeatureMatrixAppend(&matrix, &key, &summary));
+        }
+        XCTAssertEqual(matrix.rowCount, count);
+        XCTAssertGreaterThanOrEqual(matrix.capacity, count);
+        for (NSUInteger i = 0; i < count; i += 997) {
+            SNBFlowKey key;
+            SNBMakeMatrixTestKey(&key, i);
+            XCTAssertEqual(memcmp(&matrix.keys[i], &key, sizeof(key)), 0);
+            XCTAssertEqual(SNBMatrixValue(&matrix, SNBAnomalyFeatureTotalBytes, i), (double)(i * 100 + window));
+            XCTAssertEqual(matrix.dstPorts[i], (int32_t)(i % 65536));
+        }
+    }
+    SNBAnomalyFeatureMatrixDestroy(&matrix);
+}
+
+@end
@@ -0,0 +1,100 @@
+//
+//  IndicatorFilterTests.m
+//  SniffNetBar
+//
+//  The filter must never turn away an indicator it was given, pass others at
+//  about the rate it was sized for, and load back only for the same contents
+//
+
+#import <XCTest/XCTest.h>
+#import "IndicatorFilter.h"
+
+@interface IndicatorFilterTests : XCTestCase
+@end
+
+@implementation IndicatorFilterTests
+
+static uint64_t SNBIndicatorFilterTestHash(int32_t type, NSString *value) {
+    const char *text = value.UTF8String;
+    return SNBIndicatorFilterHash(type, text, strlen(text));
+}
+
+static NSString *SNBIndicatorFilterTestAddress(uint32_t address) {
+    return [NSString stringWithFormat:@"%u.%u.%u.%u", address >> 24, (address >> 16) & 0xff,
+            (address >> 8) & 0xff, address & 0xff];
+}
+
+- (void)testNoFalseNegativesAndFalsePositivesNearTarget {
+    enum { kStored = 20000, kProbes = 200000 };
+    SNBIndicatorFilter *filter = SNBIndicatorFilterCreate(kStored, 0.01);
+    XCTAssertTrue(filter != NULL);
+    for (uint32_t i = 0; i < kStored; i++) {
+        SNBIndicatorFilterAdd(filter, SNBIndicatorFilterTestHash(0, SNBIndicatorFilterTestAddress(0x0a000000u + i)));
+    }
+    XCTAssertEqual(SNBIndicatorFilterCount(filter), (uint64_t)kStored);
+    for (uint32_t i = 0; i < kStored; i++) {
+        XCTAssertTrue(SNBIndicatorFilterMayContain(filter, SNBIndicatorFilterTestHash(0, SNBIndicatorFilterTestAddress(0x0a000000u + i))));
+    }
+
+    NSUInteger falsePositives = 0;
+    for (uint32_t i = 0; i < kProbes; i++) {
+        falsePositives += SNBIndicatorFilterMayContain(filter, SNBIndicatorFilterTestHash(0, SNBIndicatorFilterTestAddress(0xc0000000u + i)));
+    }
+    double observed = (double)falsePositives / kProbes;
+    XCTAssertLessThan(observed, 0.015);
+    XCTAssertEqualWithAccuracy(SNBIndicatorFilterEstimatedFalsePositiveRate(filter), 0.01, 0.003);
+
+    // The same value under another indicator type is a different key
+    NSUInteger otherType = 0;
+    for (uint32_t i = 0; i < 10000; i++) {
+        otherType += SNBIndicatorFilterMayContain(filter, SNBIndicatorFilterTestHash(1, SNBIndicatorFilterTestAddress(0x0a000000u + i)));
+    }
+    XCTAssertLessThan(otherType, 150u);
+    SNBIndicatorFilterDestroy(filter);
+}
+
+- (void)testFalsePositivesClimbPastCapacity {
+    SNBIndicatorFilter *filter = SNBIndicatorFilterCreate(2000, 0.01);
+    for (uint32_t i = 0; i < 2000; i++) {
+        SNBIndicatorFilterAdd(filter, SNBIndicatorFilterTestHash(0, SNBIndicatorFilterTestAddress(i)));
+    }
+    double atCapacity = SNBIndicatorFilterEstimatedFalsePositiveRate(filter);
+    for (uint32_t i = 2000; i < 8000; i++) {
+        SNBIndicatorFilterAdd(filter, SNBIndicatorFilterTestHash(0, SNBIndicatorFilterTestAddress(i)));
+    }
+    XCTAssertGreaterThan(SNBIndicatorFilterCount(filter), SNBIndicatorFilterCapacity(filter));
+    XCTAssertGreaterThan(SNBIndicatorFilterEstimatedFalsePositiveRate(filter), atCapacity * 10);
+    SNBIndicatorFilterDestroy(filter);
+}
+
+- (void)testSavedFilterLoadsOnlyForItsSignature {
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:
+                      [NSString stringWithFormat:@"snb-filter-%@", [NSUUID UUID].UUIDString]];
+    SNBIndicatorFilter *filter = SNBIndicatorFilterCreate(5000, 0.01);
+    for (uint32_t i = 0; i < 3000; i++) {
+        SNBIndicatorFilterAdd(filter, SNBIndicatorFilterTestHash(0, SNBIndicatorFilterTestAddress(i * 7)));
+    }
+    XCTAssertTrue(SNBIndicatorFilterWrite(filter, path.fileSystemRepresentation, 42));
+
+    SNBIndicatorFilter *loaded = SNBIndicatorFilterRead(path.fileSystemRepresentation, 42);
+    XCTAssertTrue(loaded != NULL);
+    XCTAssertEqual(SNBIndicatorFilterCount(loaded), SNBIndicatorFilterCount(filter));
+    XCTAssertEqual(SNBIndicatorFilterMemoryBytes(loaded), SNBIndicatorFilterMemoryBytes(filter));
+    XCTAssertEqual(SNBIndicatorFilterEstimatedFalsePositiveRate(loaded), SNBIndicatorFilterEstimatedFalsePositiveRate(filter));
+    for (uint32_t i = 0; i < 30000; i++) {
+        uint64_t hash = SNBIndicatorFilterTestHash(0, SNBIndicatorFilterTestAddress(i));
+        XCTAssertEqual(SNBIndicatorFilterMayContain(loaded, hash), SNBIndicatorFilterMayContain(filter, hash));
+    }
+
+    XCTAssertTrue(SNBIndicatorFilterRead(path.fileSystemRepresentation, 43) == NULL);
+    // A truncated file is refused rather than loaded with missing bits
+    NSData *data = [NSData dataWithContentsOfFile:path];
+    [[data subdataWithRange:NSMakeRange(0, data.length - 8)] writeToFile:path atomically:YES];
+    XCTAssertTrue(SNBIndicatorFilterRead(path.fileSystemRepresentation, 42) == NULL);
+
+    SNBIndicatorFilterDestroy(loaded);
+    SNBIndicatorFilterDestroy(filter);
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+}
+
+@end
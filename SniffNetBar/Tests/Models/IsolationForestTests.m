@@ -0,0 +1,257 @@
+//
+//  IsolationForestTests.m
+//  SniffNetBar
+//
+//  The native evaluator must score exactly like anomaly_score.py
+//
+
+#import <XCTest/XCTest.h>
+#import <math.h>
+#import "AnomalyFeatureMatrix.h"
+#import "AnomalyForestScorer.h"
+#import "IsolationForest.h"
+
+static const double kForestTestMedian = 1.0;
+static const double kForestTestIQR = 2.0;
+static const double kForestTestScoreMin = -0.8;
+static const double kForestTestScoreMax = -0.3;
+static const double kForestTestNormalizer = 4.0;
+static const double kForestTestThreshold = 0.5;
+
+@interface IsolationForestTests : XCTestCase
+@end
+
+@implementation IsolationForestTests
+
+#pragma mark - Helpers
+
+static void SNBAppendUInt32(NSMutableData *data, uint32_t value) {
+    [data appendBytes:&value length:sizeof(value)];
+}
+
+static void SNBAppendDouble(NSMutableData *data, double value) {
+    [data appendBytes:&value length:sizeof(value)];
+}
+
+static void SNBAppendNode(NSMutableData *data, int32_t left, int32_t right, int32_t feature, double value) {
+    int32_t fields[3] = {left, right, feature};
+    [data appendBytes:fields length:sizeof(fields)];
+    SNBAppendUInt32(data, 0);
+    SNBAppendDouble(data, value);
+}
+
+static void SNBAppendName(NSMutableData *data, const char *name) {
+    SNBAppendUInt32(data, (uint32_t)strlen(name));
+    [data appendBytes:name length:strlen(name)];
+}
+
+// Columns bytesColumn (continuous) and "proto_tcp" (extra). The first tree
+// splits the bytes at kForestTestThreshold into leaves crediting 2 and 3, the
+// second is a single leaf crediting 1.
+static NSData *SNBForestTestModelWithBytesColumn(const char *bytesColumn) {
+    NSMutableData *data = [NSMutableData data];
+    [data appendBytes:SNB_ISOLATION_FOREST_MAGIC length:8];
+    SNBAppendUInt32(data, SNB_ISOLATION_FOREST_VERSION);
+    SNBAppendUInt32(data, 1);
+    SNBAppendUInt32(data, 1);
+    SNBAppendUInt32(data, 2);
+    SNBAppendDouble(data, kForestTestScoreMin);
+    SNBAppendDouble(data, kForestTestScoreMax);
+    SNBAppendDouble(data, kForestTestNormalizer);
+    SNBAppendDouble(data, kForestTestMedian);
+    SNBAppendDouble(data, kForestTestIQR);
+    SNBAppendName(data, bytesColumn);
+    SNBAppendName(data, "proto_tcp");
+
+    SNBAppendUInt32(data, 3);
+    SNBAppendNode(data, 1, 2, 0, kForestTestThreshold);
+    SNBAppendNode(data, -1, -1, 0, 2.0);
+    SNBAppendNode(data, -1, -1, 0, 3.0);
+
+    SNBAppendUInt32(data, 1);
+    SNBAppendNode(data, -1, -1, 0, 1.0);
+    return data;
+}
+
+static NSData *SNBForestTestModel(void) {
+    return SNBForestTestModelWithBytesColumn("bytes");
+}
+
+static NSString *SNBForestTestWriteModel(NSData *model) {
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:
+                      [NSString stringWithFormat:@"snb-forest-%@.iforest", [NSUUID UUID].UUIDString]];
+    return [model writeToFile:path atomically:YES] ? path : nil;
+}
+
+// anomaly_score.py, written out for the test model
+static double SNBForestTestExpectedScore(double bytes) {
+    float scaled = (float)((log1p(bytes) - kForestTestMedian) / (kForestTestIQR + 1e-9));
+    double depth = ((double)scaled <= kForestTestThreshold ? 2.0 : 3.0) + 1.0;
+    double raw = -pow(2.0, -(depth / kForestTestNormalizer));
+    double normalized = (raw - kForestTestScoreMin) / (kForestTestScoreMax - kForestTestScoreMin + 1e-9);
+    normalized = fmin(1.0, fmax(0.0, normalized));
+    return 1.0 - normalized;
+}
+
+- (SNBIsolationForest *)createTestForest {
+    NSData *model = SNBForestTestModel();
+    char error[256] = {0};
+    SNBIsolationForest *forest = SNBIsolationForestCreateFromBytes(model.bytes, model.length, error, sizeof(error));
+    XCTAssertTrue(forest != NULL, @"%s", error);
+    return forest;
+}
+
+#pragma mark - Tests
+
+- (void)testLoadsColumnsAndTrees {
+    SNBIsolationForest *forest = [self createTestForest];
+    XCTAssertEqual(SNBIsolationForestColumnCount(forest), 2u);
+    XCTAssertEqualObjects(@(SNBIsolationForestColumnName(forest, 0)), @"bytes");
+    XCTAssertEqualObjects(@(SNBIsolationForestColumnName(forest, 1)), @"proto_tcp");
+    XCTAssertEqual(SNBIsolationForestTreeCount(forest), 2u);
+    SNBIsolationForestDestroy(forest);
+}
+
+- (void)testScoresMatchPythonFormula {
+    SNBIsolationForest *forest = [self createTestForest];
+    // log1p(e^2 - 1) scales to exactly the threshold and must go left
+    const double values[] = {0.0, 3.0, exp(2.0) - 1.0, 10.0, 1500.0, 1e7};
+    const size_t count = sizeof(values) / sizeof(values[0]);
+    double rows[count * 2];
+    for (size_t i = 0; i < count; i++) {
+        rows[i * 2] = values[i];
+        rows[i * 2 + 1] = 1.0;
+    }
+
+    double scores[count];
+    double rawScores[count];
+    XCTAssertTrue(SNBIsolationForestScore(forest, rows, count, scores, rawScores));
+    for (size_t i = 0; i < count; i++) {
+        XCTAssertEqual(scores[i], SNBForestTestExpectedScore(values[i]), @"bytes %g", values[i]);
+        XCTAssertLessThan(rawScores[i], 0.0);
+    }
+    XCTAssertGreaterThan(scores[0], scores[count - 1]);
+    SNBIsolationForestDestroy(forest);
+}
+
+- (void)testBatchMatchesSingleRows {
+    SNBIsolationForest *forest = [self createTestForest];
+    const size_t count = 257;
+    double rows[count * 2];
+    for (size_t i = 0; i < count; i++) {
+        rows[i * 2] = pow(10.0, (double)(i % 8)) + (double)i;
+        rows[i * 2 + 1] = (double)(i & 1);
+    }
+
+    double batch[count];
+    XCTAssertTrue(SNBIsolationForestScore(forest, rows, count, batch, NULL));
+    for (size_t i = 0; i < count; i++) {
+        double single = 0;
+        XCTAssertTrue(SNBIsolationForestScore(forest, &rows[i * 2], 1, &single, NULL));
+        XCTAssertEqual(batch[i], single, @"Row %zu", i);
+    }
+    SNBIsolationForestDestroy(forest);
+}
+
+- (void)testColumnsMatchRows {
+    SNBIsolationForest *forest = [self createTestForest];
+    const size_t count = 100;
+    double rows[count * 2];
+    double bytes[count];
+    double tcp[count];
+    for (size_t i = 0; i < count; i++) {
+        bytes[i] = rows[i * 2] = pow(3.0, (double)(i % 15));
+        tcp[i] = rows[i * 2 + 1] = (double)(i % 3 == 0);
+    }
+    const double *columns[2] = {bytes, tcp};
+
+    double fromRows[count];
+    double fromColumns[count];
+    XCTAssertTrue(SNBIsolationForestScore(forest, rows, count, fromRows, NULL));
+    XCTAssertTrue(SNBIsolationForestScoreColumns(forest, columns, count, fromColumns, NULL));
+    XCTAssertEqual(memcmp(fromRows, fromColumns, sizeof(fromRows)), 0);
+    SNBIsolationForestDestroy(forest);
+}
+
+- (void)testRejectsTruncatedAndCorruptModels {
+    NSData *model = SNBForestTestModel();
+    char error[256];
+    for (NSUInteger length = 0; length < model.length; length++) {
+        error[0] = '\0';
+        SNBIsolationForest *forest = SNBIsolationForestCreateFromBytes(model.bytes, length, error, sizeof(error));
+        XCTAssertTrue(forest == NULL, @"Accepted %lu of %lu bytes", (unsigned long)length, (unsigned long)model.length);
+        XCTAssertTrue(strlen(error) > 0);
+        SNBIsolationForestDestroy(forest);
+    }
+
+    // A child pointing back at the root would loop forever
+    NSMutableData *cyclic = [model mutableCopy];
+    NSUInteger firstNode = model.length - 4 - 24 - 3 * 24;
+    int32_t root = 0;
+    [cyclic replaceBytesInRange:NSMakeRange(firstNode, sizeof(root)) withBytes:&root];
+    XCTAssertTrue(SNBIsolationForestCreateFromBytes(cyclic.bytes, cyclic.length, error, sizeof(error)) == NULL);
+
+    NSMutableData *badMagic = [model mutableCopy];
+    ((char *)badMagic.mutableBytes)[0] = 'X';
+    XCTAssertTrue(SNBIsolationForestCreateFromBytes(badMagic.bytes, badMagic.length, error, sizeof(error)) == NULL);
+}
+
+- (void)testScorerMapsPayloadsAndReportsMissingFeatures {
+    NSString *path = SNBForestTestWriteModel(SNBForestTestModel());
+    XCTAssertNotNil(path);
+
+    SNBAnomalyForestScorer *scorer = [[SNBAnomalyForestScorer alloc] initWithModelPath:path];
+    XCTAssertTrue(scorer.isAvailable);
+    XCTAssertEqualObjects(scorer.columnNames, (@[@"bytes", @"proto_tcp"]));
+
+    NSError *error = nil;
+    NSArray<NSNumber *> *scores = [scorer scoreFeaturePayloads:@[@{@"bytes": @0, @"proto_tcp": @1},
+                                                                 @{@"bytes": @1e7, @"proto_tcp": @0, @"unused": @5}]
+                                                         error:&error];
+    XCTAssertNil(error);
+    XCTAssertEqual(scores.count, 2u);
+    XCTAssertEqual(scores[0].doubleValue, SNBForestTestExpectedScore(0));
+    XCTAssertEqual(scores[1].doubleValue, SNBForestTestExpectedScore(1e7));
+
+    XCTAssertNil([scorer scoreFeaturePayload:@{@"bytes": @10} error:&error]);
+    XCTAssertEqualObjects(error.domain, @"AnomalyForestScorer");
+
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+    XCTAssertFalse([[SNBAnomalyForestScorer alloc] initWithModelPath:path].isAvailable);
+}
+
+- (void)testScorerReadsFeatureMatrixColumns {
+    SNBAnomalyFeatureMatrix matrix;
+    XCTAssertTrue(SNBAnomalyFeatureMatrixInit(&matrix, 4));
+    const uint64_t totalBytes[] = {0, 5, 1500, 10000000};
+    for (size_t i = 0; i < 4; i++) {
+        const uint8_t address[16] = {93, 184, 216, (uint8_t)i};
+        SNBFlowKey key;
+        SNBFlowKeyMakeAddress(&key, SNBAddressFamilyIPv4, address);
+        SNBAnomalyWindowSummary summary = {
+            .totalBytes = totalBytes[i], .totalPackets = 1, .flowCount = 1,
+            .commonPort = 443, .protocol = SNBAnomalyProtocolTCP,
+        };
+        XCTAssertTrue(SNBAnomalyFeatureMatrixAppend(&matrix, &key, &summary));
+    }
+
+    NSString *path = SNBForestTestWriteModel(SNBForestTestModelWithBytesColumn("total_bytes"));
+    SNBAnomalyForestScorer *scorer = [[SNBAnomalyForestScorer alloc] initWithModelPath:path];
+    NSError *error = nil;
+    XCTAssertTrue([scorer scoreFeatureMatrix:&matrix error:&error], @"%@", error);
+    for (size_t i = 0; i < 4; i++) {
+        XCTAssertEqual(matrix.scores[i], SNBForestTestExpectedScore((double)totalBytes[i]), @"Row %zu", i);
+    }
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+
+    // A model column the matrix does not carry fails like a missing payload key
+    path = SNBForestTestWriteModel(SNBForestTestModel());
+    scorer = [[SNBAnomalyForestScorer alloc] initWithModelPath:path];
+    XCTAssertFalse([scorer scoreFeatureMatrix:&matrix error:&error]);
+    XCTAssertEqualObjects(error.domain, @"AnomalyForestScorer");
+    XCTAssertEqual(error.code, 1);
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+    SNBAnomalyFeatureMatrixDestroy(&matrix);
+}
+
+@end
@@ -0,0 +1,216 @@
+//
+//  PacketRecordAllocationTests.m
+//  SniffNetBar
+//
+//  Proves the per-packet analytics paths do not touch the heap
+//
+
+#import <XCTest/XCTest.h>
+#import <pcap/pcap.h>
+#import <pthread.h>
+#import <stdatomic.h>
+#import "PacketBatchReader.h"
+#import "PacketBatch.h"
+#import "PacketDirection.h"
+#import "TrafficStatistics.h"
+#import "StatisticsHistory.h"
+#import "AnomalyDetector.h"
+
+static const NSUInteger kReplayPacketCount = 100000;
+static const NSUInteger kReplayFlowCount = 256;
+
+// libmalloc calls this hook for every allocation event when it is set; it is
+// how the allocation instruments observe a process.
+typedef void (SNBMallocLogger)(uint32_t type, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3,
+                               uintptr_t result, uint32_t numHotFramesToSkip);
+extern SNBMallocLogger *malloc_logger;
+
+static const uint32_t kSNBMallocLogTypeAllocate = 2;
+static pthread_t gCountingThread;
+static atomic_ullong gAllocationCount;
+
+static void SNBCountAllocations(uint32_t type, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3,
+                                uintptr_t result, uint32_t numHotFramesToSkip) {
+    if ((type & kSNBMallocLogTypeAllocate) && pthread_equal(pthread_self(), gCountingThread)) {
+        atomic_fetch_add_explicit(&gAllocationCount, 1, memory_order_relaxed);
+    }
+}
+
+// The hot paths are private and run on each consumer's own queue
+@interface TrafficStatistics (AllocationTesting)
+- (NSArray<dispatch_queue_t> *)shardQueues;
+- (void)accountRecords:(const SNBPacketRecord *)records
+                 count:(NSUInteger)count
+          shardIndices:(const uint8_t *)shardIndices
+                 shard:(NSUInteger)shard;
+@end
+
+@interface SNBStatisticsHistory (AllocationTesting)
+- (dispatch_queue_t)statsQueue;
+- (void)processRecordsLocked:(const SNBPacketRecord *)records count:(NSUInteger)count;
+@end
+
+@interface SNBAnomalyDetector (AllocationTesting)
+- (dispatch_queue_t)workQueue;
+- (void)processRecordsLocked:(const SNBPacketRecord *)records count:(NSUInteger)count;
+@end
+
+@interface PacketRecordAllocationTests : XCTestCase
+@property (nonatomic, copy) NSString *pcapPath;
+@property (nonatomic, strong) NSArray<SNBPacketBatch *> *batches;
+@property (nonatomic, assign) NSUInteger packetCount;
+@end
+
+@implementation PacketRecordAllocationTests
+
+- (void)setUp {
+    [super setUp];
+    self.pcapPath = [NSTemporaryDirectory() stringByAppendingPathComponent:
+                     [NSString stringWithFormat:@"snb-alloc-%@.pcap", [NSUUID UUID].UUIDString]];
+    [self writeSyntheticPcapToPath:self.pcapPath];
+    [self loadBatches];
+}
+
+- (void)tearDown {
+    [[NSFileManager defaultManager] removeItemAtPath:self.pcapPath error:nil];
+    self.pcapPath = nil;
+    self.batches = nil;
+    [super tearDown];
+}
+
+#pragma mark - Helpers
+
+// Ethernet/IPv4 TCP and UDP frames from a local address to public hosts,
+// captured over the last 100 seconds so the history lands in today's record
+- (void)writeSyntheticPcapToPath:(NSString *)path {
+    FILE *file = fopen(path.fileSystemRepresentation, "wb");
+    XCTAssertTrue(file != NULL, @"Should create pcap file");
+
+    uint32_t globalHeader[6] = { 0xa1b2c3d4, 0x00040002, 0, 0, 65535, DLT_EN10MB };
+    fwrite(globalHeader, sizeof(globalHeader), 1, file);
+
+    uint8_t frame[54] = {0};
+    frame[12] = 0x08; // EtherType IPv4
+    frame[14] = 0x45; // Version 4, IHL 5
+    frame[22] = 64;   // TTL
+    frame[26] = 192; frame[27] = 168; frame[28] = 1; frame[29] = 10;
+    frame[30] = 93;  frame[31] = 184;
+
+    uint32_t startSeconds = (uint32_t)time(NULL) - (uint32_t)(kReplayPacketCount / 1000);
+    for (NSUInteger i = 0; i < kReplayPacketCount; i++) {
+        NSUInteger flow = i % kReplayFlowCount;
+        BOOL tcp = (flow % 2) == 0;
+        frame[23] = tcp ? 6 : 17;
+        frame[32] = (uint8_t)(flow / 64);
+        frame[33] = (uint8_t)(flow % 64);
+        uint16_t srcPort = (uint16_t)(49152 + flow);
+        uint16_t dstPort = tcp ? 443 : 53;
+        frame[34] = (uint8_t)(srcPort >> 8); frame[35] = (uint8_t)srcPort;
+        frame[36] = (uint8_t)(dstPort >> 8); frame[37] = (uint8_t)dstPort;
+
+        uint32_t wireLength = 54 + (uint32_t)(i % 1400);
+        uint32_t recordHeader[4] = { (uint32_t)(startSeconds + i / 1000), (uint32_t)((i % 1000) * 1000),
+                                     sizeof(frame), wireLength };
+        fwrite(recordHeader, sizeof(recordHeader), 1, file);
+        fwrite(frame, sizeof(frame), 1, file);
+    }
+    fclose(file);
+}
+
+// Reads the replay the way the helper does and tags direction the way the
+// capture manager does
+- (void)loadBatches {
+    char errbuf[PCAP_ERRBUF_SIZE];
+    pcap_t *handle = pcap_open_offline(self.pcapPath.fileSystemRepresentation, errbuf);
+    XCTAssertTrue(handle != NULL, @"Should open replay file: %s", errbuf);
+    SNBPacketBatchReader *reader = [[SNBPacketBatchReader alloc] initWithPcapHandle:handle];
+
+    SNBLocalAddressSet localAddresses;
+    memset(&localAddresses, 0, sizeof(localAddresses));
+    const uint8_t local[4] = {192, 168, 1, 10};
+    SNBLocalAddressSetAdd(&localAddresses, SNBAddressFamilyIPv4, local);
+
+    NSMutableArray<SNBPacketBatch *> *batches = [NSMutableArray array];
+    NSUInteger packetCount = 0;
+    while (!reader.isExhausted) {
+        SNBPacketBatch *batch = [reader readBatchWithMaxPackets:512 maxLatency:0.05 error:nil];
+        if (batch.count == 0) {
+            continue;
+        }
+        SNBPacketRecordsClassifyDirection(&localAddresses, [batch mutableRecords], batch.count);
+        [batches addObject:batch];
+        packetCount += batch.count;
+    }
+    pcap_close(handle);
+
+    self.batches = batches;
+    self.packetCount = packetCount;
+    XCTAssertEqual(packetCount, kReplayPacketCount, @"Every packet should decode");
+}
+
+// Runs one warm-up pass so every flow exists, then counts allocations made by
+// a second pass over the same packets on the calling thread
+- (unsigned long long)allocationsForSteadyStatePass:(void (^NS_NOESCAPE)(SNBPacketBatch *batch))pass {
+    for (SNBPacketBatch *batch in self.batches) {
+        pass(batch);
+    }
+
+    gCountingThread = pthread_self();
+    atomic_store(&gAllocationCount, 0);
+    malloc_logger = SNBCountAllocations;
+    for (SNBPacketBatch *batch in self.batches) {
+        pass(batch);
+    }
+    malloc_logger = NULL;
+    return atomic_load(&gAllocationCount);
+}
+
+- (void)assertAllocations:(unsigned long long)allocations consumer:(NSString *)consumer {
+    NSLog(@"%@: %llu allocations over %lu packets in %lu batches",
+          consumer, allocations, (unsigned long)self.packetCount, (unsigned long)self.batches.count);
+    // Anything proportional to the packet count would be in the tens of thousands
+    XCTAssertLessThan(allocations, (unsigned long long)self.batches.count,
+                      @"%@ should not allocate per packet", consumer);
+}
+
+#pragma mark - Consumers
+
+- (void)testTrafficStatisticsSteadyStateDoesNotAllocate {
+    TrafficStatistics *statistics = [[TrafficStatistics alloc] initWithShardCount:1];
+    __block unsigned long long allocations = 0;
+    dispatch_sync([statistics shardQueues][0], ^{
+        allocations = [self allocationsForSteadyStatePass:^(SNBPacketBatch *batch) {
+            [statistics accountRecords:batch.records count:batch.count shardIndices:NULL shard:0];
+        }];
+    });
+    [self assertAllocations:allocations consumer:@"TrafficStatistics"];
+
+    TrafficStats *stats = [statistics getCurrentStats];
+    XCTAssertEqual(stats.totalPackets, (uint64_t)(2 * kReplayPacketCount));
+    XCTAssertEqual(stats.outgoingBytes, stats.totalBytes, @"Every packet leaves the local address");
+    XCTAssertEqual(stats.allActiveDestinationIPs.count, kReplayFlowCount);
+}
+
+- (void)testStatisticsHistorySteadyStateDoesNotAllocate {
+    SNBStatisticsHistory *history = [[SNBStatisticsHistory alloc] init];
+    __block unsigned long long allocations = 0;
+    dispatch_sync([history statsQueue], ^{
+        allocations = [self allocationsForSteadyStatePass:^(SNBPacketBatch *batch) {
+            [history processRecordsLocked:batch.records count:batch.count];
+        }];
+    });
+    [self assertAllocations:allocations consumer:@"SNBStatisticsHistory"];
+}
+
+- (void)testAnomalyDetectorSteadyStateDoesNotAllocate {
+    SNBAnomalyDetector *detector = [[SNBAnomalyDetector alloc] initWithWindowSeconds:3600];
+    __block unsigned long long allocations = 0;
+    dispatch_sync([detector workQueue], ^{
+        allocations = [self allocationsForSteadyStatePass:^(SNBPacketBatch *batch) {
+            [detector processRecordsLocked:batch.records count:batch.count];
+        }];
+    });
+    [self assertAllocations:allocations consumer:@"SNBAnomalyDetector"];
+}
+
+@end
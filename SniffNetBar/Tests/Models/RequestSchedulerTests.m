@@ -0,0 +1,127 @@
+//
+//  RequestSchedulerTests.m
+//  SniffNetBar
+//
+//  Budgets must pace calls to their limits and the queue must pop in priority order
+//
+
+#import <XCTest/XCTest.h>
+#import "RequestScheduler.h"
+
+@interface RequestSchedulerTests : XCTestCase
+@end
+
+@implementation RequestSchedulerTests
+
+static const uint64_t kSchedulerTestStart = 1000;
+
+- (void)testMinuteBudgetAllowsBurstThenPacesCalls {
+    SNBRequestBudget budget;
+    SNBRequestBudgetInit(&budget, 4, 500, kSchedulerTestStart);
+    for (int i = 0; i < 4; i++) {
+        XCTAssertTrue(SNBRequestBudgetTryTake(&budget, kSchedulerTestStart));
+    }
+    XCTAssertFalse(SNBRequestBudgetTryTake(&budget, kSchedulerTestStart));
+
+    // Four a minute refill one token every fifteen seconds
+    uint64_t delay = SNBRequestBudgetDelayNs(&budget, kSchedulerTestStart);
+    XCTAssertEqualWithAccuracy((double)delay / NSEC_PER_SEC, 15.0, 0.001);
+    XCTAssertFalse(SNBRequestBudgetTryTake(&budget, kSchedulerTestStart + delay - NSEC_PER_SEC));
+    XCTAssertTrue(SNBRequestBudgetTryTake(&budget, kSchedulerTestStart + delay));
+    XCTAssertFalse(SNBRequestBudgetTryTake(&budget, kSchedulerTestStart + delay));
+    XCTAssertEqual(SNBRequestBudgetRemainingToday(&budget, kSchedulerTestStart + delay), 495u);
+}
+
+- (void)testDailyBudgetHoldsCallsOnceSpent {
+    SNBRequestBudget budget;
+    SNBRequestBudgetInit(&budget, 0, 3, 0);
+    for (int i = 0; i < 3; i++) {
+        XCTAssertTrue(SNBRequestBudgetTryTake(&budget, 0));
+    }
+    XCTAssertFalse(SNBRequestBudgetTryTake(&budget, 0));
+    XCTAssertEqualWithAccuracy((double)SNBRequestBudgetDelayNs(&budget, 0) / NSEC_PER_SEC, 86400.0 / 3, 1.0);
+
+    // Raising the limit keeps what was spent
+    SNBRequestBudgetSetLimits(&budget, 0, 6, 0);
+    XCTAssertEqual(SNBRequestBudgetRemainingToday(&budget, 0), 3u);
+
+    SNBRequestBudgetInit(&budget, 0, 0, 0);
+    for (int i = 0; i < 1000; i++) {
+        XCTAssertTrue(SNBRequestBudgetTryTake(&budget, 0));
+    }
+    XCTAssertEqual(SNBRequestBudgetRemainingToday(&budget, 0), UINT32_MAX);
+}
+
+- (void)testQueueMatchesSortedModel {
+    enum { kSlots = 4096 };
+    static double priorities[kSlots];
+    static uint64_t sequences[kSlots];
+    static bool live[kSlots];
+    SNBRequestQueue *queue = SNBRequestQueueCreate(2);
+    XCTAssertTrue(queue != NULL);
+
+    srand(7);
+    uint64_t sequence = 0;
+    uint32_t count = 0;
+    for (int step = 0; step < 100000; step++) {
+        int op = rand() % 5;
+        if (op <= 1 || count == 0) {
+            double priority = rand() % 50;
+            uint32_t slot = SNBRequestQueuePush(queue, priority);
+            XCTAssertTrue(slot < kSlots && !live[slot]);
+            live[slot] = true;
+            priorities[slot] = priority;
+            sequences[slot] = sequence++;
+            count++;
+        } else if (op == 2) {
+            // Highest priority, oldest first among equals
+            int expected = -1;
+            for (int i = 0; i < kSlots; i++) {
+                if (live[i] && (expected < 0 || priorities[i] > priorities[expected] ||
+                                (priorities[i] == priorities[expected] && sequences[i] < sequences[expected]))) {
+                    expected = i;
+                }
+            }
+            uint32_t slot = SNBRequestQueuePop(queue);
+            XCTAssertEqual((int)slot, expected);
+            live[slot] = false;
+            count--;
+        } else {
+            uint32_t slot = (uint32_t)(rand() % kSlots);
+            if (!live[slot]) {
+                continue;
+            }
+            if (op == 3) {
+                priorities[slot] = rand() % 50;
+                SNBRequestQueueUpdate(queue, slot, priorities[slot]);
+                XCTAssertEqual(SNBRequestQueuePriority(queue, slot), priorities[slot]);
+            } else {
+                SNBRequestQueueRemove(queue, slot);
+                XCTAssertFalse(SNBRequestQueueContains(queue, slot));
+                live[slot] = false;
+                count--;
+            }
+        }
+        XCTAssertEqual(SNBRequestQueueCount(queue), count);
+        if (count > 2000) {
+            while (count > 100) {
+                live[SNBRequestQueuePop(queue)] = false;
+                count--;
+            }
+        }
+    }
+    SNBRequestQueueDestroy(queue);
+}
+
+- (void)testPriorityFavoursTrafficAnomaliesAndRecency {
+    double quiet = SNBRequestPriorityScore(0, 0.0, 0.0);
+    double busy = SNBRequestPriorityScore(1 << 20, 0.0, 0.0);
+    double anomalous = SNBRequestPriorityScore(1 << 20, 1.0, 0.0);
+    double idle = SNBRequestPriorityScore(1 << 20, 0.0, 300.0);
+    XCTAssertEqualWithAccuracy(quiet, 1.0, 1e-9);
+    XCTAssertGreaterThan(busy, quiet);
+    XCTAssertEqualWithAccuracy(anomalous, busy * 5.0, 1e-9);
+    XCTAssertEqualWithAccuracy(idle, busy / 2.0, 1e-9);
+}
+
+@end
@@ -0,0 +1,450 @@
+//
+//  StatisticsHistoryTests.m
+//  SniffNetBar
+//
+//  Stored days must add up whichever order and however often their traffic
+//  arrives
+//
+
+#import <XCTest/XCTest.h>
+#import <netinet/in.h>
+#import <sqlite3.h>
+#import "StatisticsHistory.h"
+#import "PacketBatch.h"
+#import "ThreatIntelStore.h"
+
+@interface StatisticsHistoryTests : XCTestCase
+@property (nonatomic, copy) NSString *directory;
+@property (nonatomic, copy) NSString *templatePath;
+@property (nonatomic, strong) ThreatIntelStore *store;
+@end
+
+@implementation StatisticsHistoryTests
+
+- (void)setUp {
+    [super setUp];
+    self.directory = [NSTemporaryDirectory() stringByAppendingPathComponent:
+                      [NSString stringWithFormat:@"snb-history-%@", [NSUUID UUID].UUIDString]];
+    [[NSFileManager defaultManager] createDirectoryAtPath:self.directory
+                              withIntermediateDirectories:YES
+                                               attributes:nil
+                                                    error:nil];
+    self.store = [[ThreatIntelStore alloc] initWithPath:[self.directory stringByAppendingPathComponent:@"threat_intel.sqlite"]
+                                             TTLSeconds:3600.0];
+    self.templatePath = [self.directory stringByAppendingPathComponent:@"template.html"];
+    [@"<html>{{GENERATED_AT}}{{WEEKLY_SECTION}}{{DAILY_SECTION}}{{MALICIOUS_SECTION}}{{DETAILS_SECTION}}</html>"
+        writeToFile:self.templatePath atomically:YES encoding:NSUTF8StringEncoding error:nil];
+}
+
+- (void)tearDown {
+    self.store = nil;
+    [[NSFileManager defaultManager] removeItemAtPath:self.directory error:nil];
+    [super tearDown];
+}
+
+#pragma mark - Helpers
+
+- (SNBStatisticsHistory *)makeHistory {
+    return [[SNBStatisticsHistory alloc] initWithDirectory:self.directory
+                                          threatIntelStore:self.store
+                                              templatePath:self.templatePath];
+}
+
+// Local time on the given day, so the day string does not depend on the zone
+static NSTimeInterval SNBHistoryTestTime(NSInteger day, NSInteger hour, NSInteger second) {
+    NSDateComponents *components = [[NSDateComponents alloc] init];
+    components.year = 2025;
+    components.month = 3;
+    components.day = day;
+    components.hour = hour;
+    components.second = second;
+    return [[NSCalendar currentCalendar] dateFromComponents:components].timeIntervalSince1970;
+}
+
+// An outgoing TCP packet from a local address to 203.0.113.remote
+static SNBPacketRecord SNBHistoryTestRecord(NSTimeInterval time, uint8_t remote, uint32_t length) {
+    SNBPacketRecord record;
+    memset(&record, 0, sizeof(record));
+    record.timestampNs = (uint64_t)(time * 1e9);
+    record.length = length;
+    record.family = SNBAddressFamilyIPv4;
+    record.ipProtocol = IPPROTO_TCP;
+    record.flags = SNBPacketRecordFlagHasPorts | SNBPacketRecordFlagOutgoing;
+    record.sourcePort = 50000;
+    record.destinationPort = 443;
+    const uint8_t source[] = {192, 168, 1, 10};
+    const uint8_t destination[] = {203, 0, 113, remote};
+    memcpy(record.sourceAddress, source, sizeof(source));
+    memcpy(record.destinationAddress, destination, sizeof(destination));
+    return record;
+}
+
+// Hands the records over and waits until they are in the database
+- (void)replayRecords:(const SNBPacketRecord *)records count:(NSUInteger)count into:(SNBStatisticsHistory *)history {
+    [history processPacketBatch:[SNBPacketBatch batchWithRecords:records count:count]];
+    [self waitForFlushOf:history];
+}
+
+- (void)waitForFlushOf:(SNBStatisticsHistory *)history {
+    XCTestExpectation *written = [self expectationWithDescription:@"Flushed and reported"];
+    [history generateReportWithCompletion:^(NSString *path) {
+        [written fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+}
+
+- (NSString *)dayString:(NSTimeInterval)time {
+    NSDateFormatter *formatter = [[NSDateFormatter alloc] init];
+    formatter.locale = [NSLocale localeWithLocaleIdentifier:@"en_US_POSIX"];
+    formatter.timeZone = [NSTimeZone localTimeZone];
+    formatter.dateFormat = @"yyyy-MM-dd";
+    return [formatter stringFromDate:[NSDate dateWithTimeIntervalSince1970:time]];
+}
+
+- (NSString *)databasePath {
+    return [self.directory stringByAppendingPathComponent:@"traffic_stats.sqlite"];
+}
+
+// First column of the first row of sql with ?1 bound to argument, a string
+// or a number, or -1
+- (int64_t)valueOf:(const char *)sql argument:(id)argument {
+    sqlite3 *db = NULL;
+    int64_t value = -1;
+    if (sqlite3_open_v2(self.databasePath.fileSystemRepresentation, &db, SQLITE_OPEN_READONLY, NULL) == SQLITE_OK) {
+        sqlite3_stmt *stmt = NULL;
+        if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) == SQLITE_OK) {
+            if ([argument isKindOfClass:[NSNumber class]]) {
+                sqlite3_bind_int64(stmt, 1, [argument longLongValue]);
+            } else if (argument) {
+                sqlite3_bind_text(stmt, 1, [argument UTF8String], -1, SQLITE_TRANSIENT);
+            }
+            if (sqlite3_step(stmt) == SQLITE_ROW) {
+                value = sqlite3_column_int64(stmt, 0);
+            }
+            sqlite3_finalize(stmt);
+        }
+    }
+    sqlite3_close(db);
+    return value;
+}
+
+- (int64_t)valueOf:(const char *)sql day:(NSString *)day {
+    return [self valueOf:sql argument:day];
+}
+
+// Runs sql on a connection of the test's own, next to the history's
+- (void)execute:(NSString *)sql {
+    sqlite3 *db = NULL;
+    XCTAssertEqual(sqlite3_open_v2(self.databasePath.fileSystemRepresentation, &db, SQLITE_OPEN_READWRITE, NULL), SQLITE_OK);
+    sqlite3_busy_timeout(db, 2000);
+    char *error = NULL;
+    XCTAssertEqual(sqlite3_exec(db, sql.UTF8String, NULL, NULL, &error), SQLITE_OK, @"%s", error ?: "");
+    sqlite3_free(error);
+    sqlite3_close(db);
+}
+
+// Adds count stored days ending the day before lastDay, each with one host
+- (void)storeDays:(NSUInteger)count before:(NSTimeInterval)lastDay {
+    NSMutableString *sql = [NSMutableString stringWithString:@"BEGIN;"];
+    for (NSUInteger i = 1; i <= count; i++) {
+        NSString *day = [self dayString:lastDay - (NSTimeInterval)i * 86400.0];
+        [sql appendFormat:@"INSERT INTO stats_days VALUES ('%@', 1, 1, 0, 0, 1, 0, 0, 1);"
+                          "INSERT INTO stats_hosts VALUES ('%@', '198.51.100.1', 1, 1);", day, day];
+    }
+    [sql appendString:@"COMMIT;"];
+    [self execute:sql];
+}
+
+- (void)assertDay:(NSString *)day bytes:(int64_t)bytes packets:(int64_t)packets hosts:(int64_t)hosts {
+    XCTAssertEqual([self valueOf:"SELECT total_bytes FROM stats_days WHERE day = ?1;" day:day], bytes, @"%@", day);
+    XCTAssertEqual([self valueOf:"SELECT total_packets FROM stats_days WHERE day = ?1;" day:day], packets, @"%@", day);
+    XCTAssertEqual([self valueOf:"SELECT unique_hosts FROM stats_days WHERE day = ?1;" day:day], hosts, @"%@", day);
+    // The day row and the rows it sums must agree
+    XCTAssertEqual([self valueOf:"SELECT SUM(bytes) FROM stats_hosts WHERE day = ?1;" day:day], bytes, @"%@", day);
+    XCTAssertEqual([self valueOf:"SELECT SUM(packets) FROM stats_connections WHERE day = ?1;" day:day], packets, @"%@", day);
+    XCTAssertEqual([self valueOf:"SELECT COUNT(*) FROM stats_hosts WHERE day = ?1;" day:day], hosts, @"%@", day);
+}
+
+#pragma mark - Days
+
+- (void)testReplayingADayTwiceAddsToItsStoredTotals {
+    SNBPacketRecord records[] = {
+        SNBHistoryTestRecord(SNBHistoryTestTime(10, 10, 0), 1, 100),
+        SNBHistoryTestRecord(SNBHistoryTestTime(10, 10, 1), 2, 200),
+        SNBHistoryTestRecord(SNBHistoryTestTime(10, 10, 2), 1, 300),
+    };
+    NSString *day = [self dayString:SNBHistoryTestTime(10, 10, 0)];
+
+    SNBStatisticsHistory *history = [self makeHistory];
+    [self replayRecords:records count:3 into:history];
+    [self assertDay:day bytes:600 packets:3 hosts:2];
+
+    // The same capture again in the same run goes back into the open day
+    [self replayRecords:records count:3 into:history];
+    [self assertDay:day bytes:1200 packets:6 hosts:2];
+
+    // After a restart the day is picked up from its stored row
+    history = nil;
+    history = [self makeHistory];
+    [self replayRecords:records count:3 into:history];
+    [self assertDay:day bytes:1800 packets:9 hosts:2];
+}
+
+- (void)testOlderDayAfterNewerOneIsStoredUnderItsOwnDate {
+    SNBPacketRecord records[] = {
+        SNBHistoryTestRecord(SNBHistoryTestTime(12, 9, 0), 1, 1000),
+        SNBHistoryTestRecord(SNBHistoryTestTime(12, 9, 1), 2, 1000),
+        // Replayed from an older capture while the newer day is open
+        SNBHistoryTestRecord(SNBHistoryTestTime(11, 15, 0), 3, 40),
+        SNBHistoryTestRecord(SNBHistoryTestTime(11, 15, 1), 3, 60),
+    };
+    NSString *newer = [self dayString:SNBHistoryTestTime(12, 9, 0)];
+    NSString *older = [self dayString:SNBHistoryTestTime(11, 15, 0)];
+
+    SNBStatisticsHistory *history = [self makeHistory];
+    [self replayRecords:records count:4 into:history];
+    [self assertDay:newer bytes:2000 packets:2 hosts:2];
+    [self assertDay:older bytes:100 packets:2 hosts:1];
+
+    // Switching back to the newer day carries on from its row
+    [self replayRecords:records count:2 into:history];
+    [self assertDay:newer bytes:4000 packets:4 hosts:2];
+    [self assertDay:older bytes:100 packets:2 hosts:1];
+}
+
+#pragma mark - Flushes
+
+- (void)testTwoFlushesAddUpToTheDayTotals {
+    SNBPacketRecord first[] = {
+        SNBHistoryTestRecord(SNBHistoryTestTime(10, 10, 0), 1, 100),
+        SNBHistoryTestRecord(SNBHistoryTestTime(10, 10, 1), 2, 200),
+    };
+    SNBPacketRecord second[] = {
+        SNBHistoryTestRecord(SNBHistoryTestTime(10, 10, 2), 1, 300),
+        SNBHistoryTestRecord(SNBHistoryTestTime(10, 10, 3), 3, 50),
+    };
+    NSString *day = [self dayString:SNBHistoryTestTime(10, 10, 0)];
+
+    SNBStatisticsHistory *history = [self makeHistory];
+    [self replayRecords:first count:2 into:history];
+    [self replayRecords:second count:2 into:history];
+    [self assertDay:day bytes:650 packets:4 hosts:3];
+    XCTAssertEqual([self valueOf:"SELECT bytes FROM stats_hosts WHERE host = ?1;" argument:@"203.0.113.1"], 400);
+    XCTAssertEqual([self valueOf:"SELECT packets FROM stats_hosts WHERE host = ?1;" argument:@"203.0.113.1"], 2);
+    XCTAssertEqual([self valueOf:"SELECT packets FROM stats_connections WHERE dst_addr = ?1;" argument:@"203.0.113.1"], 2);
+}
+
+- (void)testFlushLeavesUntouchedRowsAlone {
+    SNBPacketRecord first[] = {
+        SNBHistoryTestRecord(SNBHistoryTestTime(10, 10, 0), 1, 100),
+        SNBHistoryTestRecord(SNBHistoryTestTime(10, 10, 1), 2, 200),
+    };
+    SNBPacketRecord second[] = {
+        SNBHistoryTestRecord(SNBHistoryTestTime(10, 10, 2), 1, 300),
+    };
+
+    SNBStatisticsHistory *history = [self makeHistory];
+    [self replayRecords:first count:2 into:history];
+    [self execute:@"CREATE TABLE test_writes (host TEXT NOT NULL);"
+                   "CREATE TRIGGER test_host_writes AFTER UPDATE ON stats_hosts "
+                   "BEGIN INSERT INTO test_writes VALUES (new.host); END;"
+                   "CREATE TRIGGER test_connection_writes AFTER UPDATE ON stats_connections "
+                   "BEGIN INSERT INTO test_writes VALUES (new.dst_addr); END;"];
+
+    [self replayRecords:second count:1 into:history];
+    XCTAssertEqual([self valueOf:"SELECT COUNT(*) FROM test_writes WHERE host = ?1;" argument:@"203.0.113.1"], 2);
+    XCTAssertEqual([self valueOf:"SELECT COUNT(*) FROM test_writes WHERE host = ?1;" argument:@"203.0.113.2"], 0);
+    XCTAssertEqual([self valueOf:"SELECT bytes FROM stats_hosts WHERE host = ?1;" argument:@"203.0.113.2"], 200);
+
+    // A flush without traffic has no host or connection rows to write
+    [self waitForFlushOf:history];
+    XCTAssertEqual([self valueOf:"SELECT COUNT(*) FROM test_writes;" argument:nil], 2);
+}
+
+- (void)testOldDaysAreTrimmedOncePerDay {
+    NSTimeInterval firstDay = SNBHistoryTestTime(10, 10, 0);
+    SNBPacketRecord first[] = { SNBHistoryTestRecord(firstDay, 1, 100) };
+    SNBPacketRecord later[] = { SNBHistoryTestRecord(SNBHistoryTestTime(10, 11, 0), 1, 100) };
+    SNBPacketRecord nextDay[] = { SNBHistoryTestRecord(SNBHistoryTestTime(11, 10, 0), 1, 100) };
+
+    SNBStatisticsHistory *history = [self makeHistory];
+    [self storeDays:95 before:firstDay];
+    [self replayRecords:first count:1 into:history];
+    // The newest 90 days stay, with their hosts
+    XCTAssertEqual([self valueOf:"SELECT COUNT(*) FROM stats_days;" argument:nil], 90);
+    XCTAssertEqual([self valueOf:"SELECT COUNT(*) FROM stats_hosts WHERE day = ?1;"
+                             day:[self dayString:firstDay - 89 * 86400.0]], 1);
+    XCTAssertEqual([self valueOf:"SELECT COUNT(*) FROM stats_hosts WHERE day = ?1;"
+                             day:[self dayString:firstDay - 90 * 86400.0]], 0);
+
+    // Later flushes of the same day leave retention alone
+    [self storeDays:5 before:firstDay - 100 * 86400.0];
+    [self replayRecords:later count:1 into:history];
+    XCTAssertEqual([self valueOf:"SELECT COUNT(*) FROM stats_days;" argument:nil], 95);
+
+    [self replayRecords:nextDay count:1 into:history];
+    XCTAssertEqual([self valueOf:"SELECT COUNT(*) FROM stats_days;" argument:nil], 90);
+    XCTAssertEqual([self valueOf:"SELECT COUNT(*) FROM stats_hosts WHERE day < ?1;"
+                             day:[self dayString:firstDay - 88 * 86400.0]], 0);
+}
+
+- (void)testConnectionIdleForAnHourIsCountedAgainWhenItReturns {
+    NSTimeInterval returned = SNBHistoryTestTime(10, 12, 31 * 60);
+    SNBPacketRecord first[] = { SNBHistoryTestRecord(SNBHistoryTestTime(10, 10, 0), 1, 100) };
+    SNBPacketRecord other[] = { SNBHistoryTestRecord(SNBHistoryTestTime(10, 12, 30 * 60), 2, 100) };
+    SNBPacketRecord back[] = { SNBHistoryTestRecord(returned, 1, 100) };
+
+    SNBStatisticsHistory *history = [self makeHistory];
+    [self replayRecords:first count:1 into:history];
+    // This flush drops the first connection from the pending rows
+    [self replayRecords:other count:1 into:history];
+    [self replayRecords:back count:1 into:history];
+
+    XCTAssertEqual([self valueOf:"SELECT packets FROM stats_connections WHERE dst_addr = ?1;" argument:@"203.0.113.1"], 2);
+    XCTAssertEqual([self valueOf:"SELECT bytes FROM stats_connections WHERE dst_addr = ?1;" argument:@"203.0.113.1"], 200);
+    int64_t minute = (int64_t)returned / 60 * 60;
+    int64_t hour = (int64_t)returned / 3600 * 3600;
+    XCTAssertEqual([self valueOf:"SELECT connections_out FROM stats_series WHERE resolution = 60 AND bucket_start = ?1;"
+                        argument:@(minute)], 1);
+    XCTAssertEqual([self valueOf:"SELECT connections_out FROM stats_series WHERE resolution = 3600 AND bucket_start = ?1;"
+                        argument:@(hour)], 2);
+}
+
+#pragma mark - Report
+
+- (NSArray<NSString *> *)fragmentNames {
+    NSString *directory = [self.directory stringByAppendingPathComponent:@"report_days"];
+    NSArray<NSString *> *names = [[NSFileManager defaultManager] contentsOfDirectoryAtPath:directory error:nil];
+    return [names sortedArrayUsingSelector:@selector(compare:)];
+}
+
+- (void)testPastDayFragmentIsReusedUntilItsPacketsChange {
+    NSTimeInterval past = SNBHistoryTestTime(10, 10, 0);
+    NSString *pastDay = [self dayString:past];
+    SNBPacketRecord records[] = {
+        SNBHistoryTestRecord(past, 1, 100),
+        SNBHistoryTestRecord(SNBHistoryTestTime(11, 10, 0), 2, 100),
+    };
+    SNBPacketRecord laterPast[] = {
+        SNBHistoryTestRecord(SNBHistoryTestTime(10, 11, 0), 3, 100),
+        SNBHistoryTestRecord(SNBHistoryTestTime(11, 11, 0), 2, 100),
+    };
+
+    SNBStatisticsHistory *history = [self makeHistory];
+    [self replayRecords:records count:2 into:history];
+    // Only the day no longer being captured is cached
+    NSArray<NSString *> *expected = @[
+        [NSString stringWithFormat:@"%@-1-connections.html", pastDay],
+        [NSString stringWithFormat:@"%@-1-hosts.html", pastDay],
+    ];
+    XCTAssertEqualObjects([self fragmentNames], expected);
+
+    NSString *hostsPath = [[self.directory stringByAppendingPathComponent:@"report_days"]
+                           stringByAppendingPathComponent:expected[1]];
+    [@"<p>cached hosts</p>" writeToFile:hostsPath atomically:YES encoding:NSUTF8StringEncoding error:nil];
+    [self waitForFlushOf:history];
+    NSString *report = [NSString stringWithContentsOfFile:history.reportPath encoding:NSUTF8StringEncoding error:nil];
+    XCTAssertTrue([report containsString:@"<p>cached hosts</p>"]);
+
+    // More packets for the day name new fragments; the old ones go
+    [self replayRecords:laterPast count:2 into:history];
+    expected = @[
+        [NSString stringWithFormat:@"%@-2-connections.html", pastDay],
+        [NSString stringWithFormat:@"%@-2-hosts.html", pastDay],
+    ];
+    XCTAssertEqualObjects([self fragmentNames], expected);
+    report = [NSString stringWithContentsOfFile:history.reportPath encoding:NSUTF8StringEncoding error:nil];
+    XCTAssertFalse([report containsString:@"<p>cached hosts</p>"]);
+    XCTAssertTrue([report containsString:@"203.0.113.3"]);
+}
+
+- (void)testFailedReportLeavesNoPartialFile {
+    SNBPacketRecord records[] = { SNBHistoryTestRecord(SNBHistoryTestTime(10, 10, 0), 1, 100) };
+    SNBStatisticsHistory *history = [self makeHistory];
+    // A directory in the report's place makes the final rename fail
+    NSString *blocker = [history.reportPath stringByAppendingPathComponent:@"keep"];
+    [[NSFileManager defaultManager] createDirectoryAtPath:blocker withIntermediateDirectories:YES attributes:nil error:nil];
+
+    [self replayRecords:records count:1 into:history];
+    NSString *partialPath = [history.reportPath stringByAppendingString:@".partial"];
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:partialPath]);
+    BOOL isDirectory = NO;
+    XCTAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:history.reportPath isDirectory:&isDirectory]);
+    XCTAssertTrue(isDirectory);
+
+    // Once the way is clear the next report goes through
+    [[NSFileManager defaultManager] removeItemAtPath:history.reportPath error:nil];
+    [self waitForFlushOf:history];
+    XCTAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:history.reportPath isDirectory:&isDirectory]);
+    XCTAssertFalse(isDirectory);
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:partialPath]);
+}
+
+- (void)storeScore:(NSInteger)score forIP:(NSString *)ip {
+    TIEnrichmentResponse *response = [[TIEnrichmentResponse alloc] init];
+    response.indicator = [[TIIndicator alloc] initWithType:TIIndicatorTypeIPv4 value:ip];
+    response.providerResults = @[];
+    TIScoringResult *scoring = [[TIScoringResult alloc] init];
+    scoring.indicator = response.indicator;
+    scoring.finalScore = score;
+    scoring.evaluatedAt = [NSDate date];
+    response.scoringResult = scoring;
+    [self.store storeResponse:response];
+}
+
+// Captures of every match of pattern in string, joined by spaces
+static NSArray<NSString *> *SNBHistoryTestMatches(NSString *pattern, NSString *string) {
+    NSRegularExpression *expression = [NSRegularExpression regularExpressionWithPattern:pattern options:0 error:nil];
+    NSMutableArray<NSString *> *rows = [NSMutableArray array];
+    for (NSTextCheckingResult *match in [expression matchesInString:string options:0 range:NSMakeRange(0, string.length)]) {
+        NSMutableArray<NSString *> *captures = [NSMutableArray array];
+        for (NSUInteger i = 1; i < match.numberOfRanges; i++) {
+            [captures addObject:[string substringWithRange:[match rangeAtIndex:i]]];
+        }
+        [rows addObject:[captures componentsJoinedByString:@" "]];
+    }
+    return rows;
+}
+
+- (void)testMaliciousRowsCoverFlaggedIndicatorsOfEveryDay {
+    NSString *day10 = [self dayString:SNBHistoryTestTime(10, 10, 0)];
+    NSString *day11 = [self dayString:SNBHistoryTestTime(11, 10, 0)];
+    NSString *day12 = [self dayString:SNBHistoryTestTime(12, 10, 0)];
+    SNBPacketRecord records[] = {
+        SNBHistoryTestRecord(SNBHistoryTestTime(10, 10, 0), 1, 100),
+        SNBHistoryTestRecord(SNBHistoryTestTime(10, 10, 1), 2, 100),
+        SNBHistoryTestRecord(SNBHistoryTestTime(11, 10, 0), 3, 100),
+        SNBHistoryTestRecord(SNBHistoryTestTime(11, 10, 1), 4, 100),
+        SNBHistoryTestRecord(SNBHistoryTestTime(12, 10, 0), 3, 100),
+        SNBHistoryTestRecord(SNBHistoryTestTime(12, 10, 1), 1, 200),
+    };
+    [self storeScore:90 forIP:@"203.0.113.1"];
+    // Stored without a positive score, so never flagged; .4 is not stored
+    [self storeScore:0 forIP:@"203.0.113.2"];
+    [self storeScore:60 forIP:@"203.0.113.3"];
+
+    SNBStatisticsHistory *history = [self makeHistory];
+    [self replayRecords:records count:6 into:history];
+    NSString *report = [NSString stringWithContentsOfFile:history.reportPath encoding:NSUTF8StringEncoding error:nil];
+    XCTAssertNotNil(report);
+
+    // Newest day first, and within a day the highest score first
+    NSArray<NSString *> *rows = SNBHistoryTestMatches(@"<tr><td>([0-9-]+)</td><td>([^<]*)</td><td>([^<]*)</td><td>([0-9]+)</td>", report);
+    NSArray<NSString *> *expected = @[
+        [NSString stringWithFormat:@"%@ 203.0.113.1 192.168.1.10:50000 -> 203.0.113.1:443 90", day12],
+        [NSString stringWithFormat:@"%@ 203.0.113.3 192.168.1.10:50000 -> 203.0.113.3:443 60", day12],
+        [NSString stringWithFormat:@"%@ 203.0.113.3 192.168.1.10:50000 -> 203.0.113.3:443 60", day11],
+        [NSString stringWithFormat:@"%@ 203.0.113.1 192.168.1.10:50000 -> 203.0.113.1:443 90", day10],
+    ];
+    XCTAssertEqualObjects(rows, expected);
+
+    NSArray<NSString *> *counts = SNBHistoryTestMatches(@"<tr data-date=\"([0-9-]+)\"[^>]* data-malicious=\"([0-9]+)\">", report);
+    expected = @[
+        [NSString stringWithFormat:@"%@ 2", day12],
+        [NSString stringWithFormat:@"%@ 1", day11],
+        [NSString stringWithFormat:@"%@ 1", day10],
+    ];
+    XCTAssertEqualObjects(counts, expected);
+}
+
+@end
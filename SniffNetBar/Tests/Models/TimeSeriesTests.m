@@ -0,0 +1,118 @@
+//
+//  TimeSeriesTests.m
+//  SniffNetBar
+//
+//  Traffic rings must match a recount and stay within their fixed size
+//
+
+#import <XCTest/XCTest.h>
+#import "TimeSeries.h"
+
+@interface TimeSeriesTests : XCTestCase
+@end
+
+@implementation TimeSeriesTests
+
+static const int64_t kSeriesTestStart = 1700000000;   // 2023-11-14 22:13:20 UTC
+
+- (void)testBucketsNestByResolution {
+    SNBTimeSeries series;
+    XCTAssertTrue(SNBTimeSeriesInit(&series));
+    for (int64_t second = kSeriesTestStart; second < kSeriesTestStart + 7200; second++) {
+        SNBTimeSeriesAddTraffic(&series, second, SNBTrafficIncoming, 100, 1);
+        SNBTimeSeriesAddTraffic(&series, second, SNBTrafficOutgoing, 10, 2);
+    }
+
+    const SNBTimeSeriesBucket *secondBucket = SNBTimeSeriesFind(&series, SNBTimeSeriesSecond, kSeriesTestStart + 7000);
+    XCTAssertTrue(secondBucket != NULL);
+    XCTAssertEqual(secondBucket->bytes[SNBTrafficIncoming], 100u);
+    XCTAssertEqual(secondBucket->packets[SNBTrafficOutgoing], 2u);
+
+    int64_t minute = SNBTimeSeriesBucketStart(&series, SNBTimeSeriesMinute, kSeriesTestStart + 3600);
+    const SNBTimeSeriesBucket *minuteBucket = SNBTimeSeriesFind(&series, SNBTimeSeriesMinute, minute);
+    XCTAssertTrue(minuteBucket != NULL);
+    XCTAssertEqual(minuteBucket->bytes[SNBTrafficIncoming], 6000u);
+    XCTAssertEqual(minuteBucket->bytes[SNBTrafficOutgoing], 600u);
+
+    int64_t hour = SNBTimeSeriesBucketStart(&series, SNBTimeSeriesHour, kSeriesTestStart + 3600);
+    XCTAssertEqual(hour % 3600, 0);
+    const SNBTimeSeriesBucket *hourBucket = SNBTimeSeriesFind(&series, SNBTimeSeriesHour, hour);
+    XCTAssertTrue(hourBucket != NULL);
+    XCTAssertEqual(hourBucket->packets[SNBTrafficIncoming], 3600u);
+    SNBTimeSeriesDestroy(&series);
+}
+
+- (void)testRingsRecycleSlotsAndDropOlderTraffic {
+    SNBTimeSeries series;
+    XCTAssertTrue(SNBTimeSeriesInit(&series));
+    size_t memory = SNBTimeSeriesMemoryBytes(&series);
+    for (int64_t second = kSeriesTestStart; second < kSeriesTestStart + 2 * SNB_TIME_SERIES_SECONDS; second++) {
+        SNBTimeSeriesAddTraffic(&series, second, SNBTrafficIncoming, 1, 1);
+    }
+    XCTAssertEqual(SNBTimeSeriesMemoryBytes(&series), memory);
+
+    int64_t newest = kSeriesTestStart + 2 * SNB_TIME_SERIES_SECONDS - 1;
+    XCTAssertTrue(SNBTimeSeriesFind(&series, SNBTimeSeriesSecond, newest - SNB_TIME_SERIES_SECONDS + 1) != NULL);
+    XCTAssertTrue(SNBTimeSeriesFind(&series, SNBTimeSeriesSecond, newest - SNB_TIME_SERIES_SECONDS) == NULL);
+
+    // A late packet older than the second ring reaches only the coarser rings
+    int64_t late = kSeriesTestStart + 10;
+    int64_t lateHour = SNBTimeSeriesBucketStart(&series, SNBTimeSeriesHour, late);
+    uint64_t hourBytes = SNBTimeSeriesFind(&series, SNBTimeSeriesHour, lateHour)->bytes[SNBTrafficIncoming];
+    SNBTimeSeriesAddTraffic(&series, late, SNBTrafficIncoming, 5, 1);
+    XCTAssertTrue(SNBTimeSeriesFind(&series, SNBTimeSeriesSecond, late) == NULL);
+    XCTAssertEqual(SNBTimeSeriesFind(&series, SNBTimeSeriesHour, lateHour)->bytes[SNBTrafficIncoming], hourBytes + 5);
+
+    SNBTimeSeriesBucket buckets[8];
+    size_t count = SNBTimeSeriesCopy(&series, SNBTimeSeriesSecond, newest - 2, newest + 3, buckets, 8);
+    XCTAssertEqual(count, 5u);
+    XCTAssertEqual(buckets[0].start, newest - 2);
+    XCTAssertEqual(buckets[2].packets[SNBTrafficIncoming], 1u);
+    XCTAssertEqual(buckets[3].start, newest + 1);
+    XCTAssertEqual(buckets[3].packets[SNBTrafficIncoming], 0u);
+    SNBTimeSeriesDestroy(&series);
+}
+
+- (void)testConnectionsCountOncePerBucket {
+    SNBTimeSeries series;
+    XCTAssertTrue(SNBTimeSeriesInit(&series));
+    int64_t hour = SNBTimeSeriesBucketStart(&series, SNBTimeSeriesHour, kSeriesTestStart) + 3600;
+
+    // One connection active in seconds 0, 1 and 61 of the hour, another in second 1
+    int64_t lastSecond = 0;
+    const int64_t activeSeconds[] = {hour, hour + 1, hour + 61};
+    for (int i = 0; i < 3; i++) {
+        SNBTimeSeriesAddConnection(&series, activeSeconds[i], SNBTrafficOutgoing, lastSecond);
+        lastSecond = activeSeconds[i];
+    }
+    SNBTimeSeriesAddConnection(&series, hour + 1, SNBTrafficIncoming, 0);
+
+    XCTAssertEqual(SNBTimeSeriesFind(&series, SNBTimeSeriesSecond, hour + 1)->connections[SNBTrafficOutgoing], 1u);
+    XCTAssertEqual(SNBTimeSeriesFind(&series, SNBTimeSeriesSecond, hour + 1)->connections[SNBTrafficIncoming], 1u);
+    XCTAssertEqual(SNBTimeSeriesFind(&series, SNBTimeSeriesMinute, hour)->connections[SNBTrafficOutgoing], 1u);
+    XCTAssertEqual(SNBTimeSeriesFind(&series, SNBTimeSeriesMinute, hour + 60)->connections[SNBTrafficOutgoing], 1u);
+    XCTAssertEqual(SNBTimeSeriesFind(&series, SNBTimeSeriesHour, hour)->connections[SNBTrafficOutgoing], 1u);
+    XCTAssertEqual(SNBTimeSeriesFind(&series, SNBTimeSeriesHour, hour)->connections[SNBTrafficIncoming], 1u);
+    SNBTimeSeriesDestroy(&series);
+}
+
+- (void)testMergeRestoresPersistedBucket {
+    SNBTimeSeries series;
+    XCTAssertTrue(SNBTimeSeriesInit(&series));
+    int64_t minute = SNBTimeSeriesBucketStart(&series, SNBTimeSeriesMinute, kSeriesTestStart);
+    SNBTimeSeriesBucket stored = {
+        .start = minute, .bytes = {1000, 200}, .packets = {10, 2}, .connections = {3, 1},
+    };
+    SNBTimeSeriesMerge(&series, SNBTimeSeriesMinute, &stored);
+    SNBTimeSeriesAddTraffic(&series, minute + 30, SNBTrafficIncoming, 500, 5);
+
+    const SNBTimeSeriesBucket *bucket = SNBTimeSeriesFind(&series, SNBTimeSeriesMinute, minute);
+    XCTAssertTrue(bucket != NULL);
+    XCTAssertEqual(bucket->bytes[SNBTrafficIncoming], 1500u);
+    XCTAssertEqual(bucket->packets[SNBTrafficIncoming], 15u);
+    XCTAssertEqual(bucket->connections[SNBTrafficIncoming], 3u);
+    XCTAssertEqual(bucket->bytes[SNBTrafficOutgoing], 200u);
+    SNBTimeSeriesDestroy(&series);
+}
+
+@end
@@ -0,0 +1,224 @@
+//
+//  TopTrafficTests.m
+//  SniffNetBar
+//
+//  The incrementally kept top-K must match a full sort of the table
+//
+
+#import <XCTest/XCTest.h>
+#import "PacketBatch.h"
+#import "TopTraffic.h"
+#import "TrafficStatistics.h"
+
+static const NSUInteger kTopTestHostCount = 200;
+static const NSUInteger kTopTestIterations = 20000;
+static const uint64_t kTopTestStartNs = 1700000000ULL * 1000000000ULL;
+
+@interface TopTrafficTests : XCTestCase
+@end
+
+@implementation TopTrafficTests
+
+#pragma mark - Helpers
+
+static void SNBMakeTopTestKey(SNBFlowKey *key, NSUInteger host) {
+    const uint8_t address[16] = {10, 0, (uint8_t)(host / 256), (uint8_t)(host % 256)};
+    SNBFlowKeyMakeAddress(key, SNBAddressFamilyIPv4, address);
+}
+
+static int SNBCompareBytesDescending(const void *lhs, const void *rhs) {
+    uint64_t left = *(const uint64_t *)lhs;
+    uint64_t right = *(const uint64_t *)rhs;
+    return (left < right) - (left > right);
+}
+
+// Every ranked entry must point back at its heap position, and the ranking
+// must hold the largest byte counts in the table
+- (void)assertRanking:(SNBTopTraffic *)top matchesTable:(SNBFlowTable *)table {
+    SNBTopTrafficEntry entries[top->limit];
+    size_t count = SNBTopTrafficCopySorted(top, table, entries);
+
+    size_t tableCount = SNBFlowTableCount(table);
+    uint64_t *allBytes = malloc(MAX((size_t)1, tableCount) * sizeof(uint64_t));
+    size_t index = 0;
+    size_t ranked = 0;
+    size_t cursor = 0;
+    const SNBFlowKey *key = NULL;
+    const SNBTrafficCounters *counters;
+    while ((counters = SNBFlowTableNext(table, &cursor, &key)) != NULL) {
+        allBytes[index++] = counters->bytes;
+        if (counters->topSlot != 0) {
+            ranked++;
+            XCTAssertEqual(memcmp(&top->heap[counters->topSlot - 1].key, key, sizeof(*key)), 0);
+        }
+    }
+    qsort(allBytes, tableCount, sizeof(uint64_t), SNBCompareBytesDescending);
+
+    XCTAssertEqual(ranked, top->count);
+    XCTAssertEqual(count, MIN(tableCount, top->limit));
+    for (size_t i = 0; i < count; i++) {
+        XCTAssertEqual(entries[i].bytes, allBytes[i], @"Rank %zu", i);
+    }
+    free(allBytes);
+}
+
+#pragma mark - Ranking
+
+- (void)testRankingMatchesFullSortUnderUpdatesAndRemovals {
+    SNBFlowTable *table = SNBFlowTableCreate(sizeof(SNBTrafficCounters), 16);
+    SNBTopTraffic top;
+    XCTAssertTrue(SNBTopTrafficInit(&top, 10));
+
+    srand48(42);
+    for (NSUInteger i = 0; i < kTopTestIterations; i++) {
+        SNBFlowKey key;
+        SNBMakeTopTestKey(&key, (NSUInteger)(lrand48() % kTopTestHostCount));
+        if (lrand48() % 10 == 0) {
+            SNBTrafficCounters *counters = SNBFlowTableFind(table, &key);
+            if (counters) {
+                SNBTopTrafficRemove(&top, table, counters);
+                SNBFlowTableRemove(table, &key);
+            }
+        } else {
+            SNBTrafficCounters *counters = SNBFlowTableUpsert(table, &key, NULL);
+            counters->bytes += 1 + (uint64_t)(lrand48() % 1500);
+            SNBTopTrafficUpdate(&top, table, &key, counters);
+        }
+        if (i % 1000 == 0) {
+            [self assertRanking:&top matchesTable:table];
+        }
+    }
+
+    XCTAssertTrue(SNBTopTrafficSetLimit(&top, table, 3));
+    [self assertRanking:&top matchesTable:table];
+    XCTAssertTrue(SNBTopTrafficSetLimit(&top, table, 25));
+    [self assertRanking:&top matchesTable:table];
+
+    SNBTopTrafficDestroy(&top);
+    SNBFlowTableDestroy(table);
+}
+
+- (void)testEqualCountsRankInKeyOrder {
+    SNBFlowTable *table = SNBFlowTableCreate(sizeof(SNBTrafficCounters), 16);
+    SNBTopTraffic top;
+    XCTAssertTrue(SNBTopTrafficInit(&top, 4));
+    for (NSUInteger host = 4; host > 0; host--) {
+        SNBFlowKey key;
+        SNBMakeTopTestKey(&key, host);
+        SNBTrafficCounters *counters = SNBFlowTableUpsert(table, &key, NULL);
+        counters->bytes = 100;
+        SNBTopTrafficUpdate(&top, table, &key, counters);
+    }
+
+    SNBTopTrafficEntry entries[4];
+    XCTAssertEqual(SNBTopTrafficCopySorted(&top, table, entries), (size_t)4);
+    for (NSUInteger i = 0; i < 4; i++) {
+        XCTAssertEqual(entries[i].key.destinationAddress[3], (uint8_t)(i + 1), @"Ties should not reorder between snapshots");
+    }
+
+    SNBTopTrafficDestroy(&top);
+    SNBFlowTableDestroy(table);
+}
+
+#pragma mark - Snapshots
+
+- (void)testSnapshotIsPublishedForReadersOffTheStatsQueue {
+    const NSUInteger packetCount = 3000;
+    NSMutableData *data = [NSMutableData dataWithLength:packetCount * sizeof(SNBPacketRecord)];
+    SNBPacketRecord *records = data.mutableBytes;
+    const uint8_t local[4] = {192, 168, 1, 10};
+    for (NSUInteger i = 0; i < packetCount; i++) {
+        // Host n sends n * 10 packets' worth of traffic, so the ranking is known
+        NSUInteger host = 1 + (i % 30);
+        const uint8_t remote[4] = {93, 184, 0, (uint8_t)host};
+        records[i].timestampNs = kTopTestStartNs + i * 1000;
+        records[i].length = (uint32_t)(host * 10);
+        records[i].family = SNBAddressFamilyIPv4;
+        records[i].ipProtocol = 6;
+        records[i].flags = SNBPacketRecordFlagHasPorts | SNBPacketRecordFlagOutgoing;
+        memcpy(records[i].sourceAddress, local, 4);
+        memcpy(records[i].destinationAddress, remote, 4);
+        records[i].sourcePort = (uint16_t)(49152 + host);
+        records[i].destinationPort = 443;
+    }
+
+    TrafficStatistics *statistics = [[TrafficStatistics alloc] initWithShardCount:2];
+    XCTAssertNil(statistics.latestStats);
+    [statistics processPacketBatch:[SNBPacketBatch batchWithRecords:records count:packetCount]];
+
+    TrafficStats *stats = [statistics getCurrentStats];
+    XCTAssertEqual(statistics.latestStats, stats, @"Requesting stats should publish them");
+    XCTAssertGreaterThan(stats.topHosts.count, (NSUInteger)0);
+    XCTAssertEqualObjects(stats.topHosts.firstObject.address, @"93.184.0.30");
+    for (NSUInteger i = 1; i < stats.topHosts.count; i++) {
+        XCTAssertGreaterThanOrEqual(stats.topHosts[i - 1].bytes, stats.topHosts[i].bytes);
+    }
+    XCTAssertEqualObjects(stats.topConnections.firstObject.destinationAddress, @"93.184.0.30");
+    XCTAssertEqual(stats.allActiveDestinationIPs.count, (NSUInteger)30);
+
+    uint64_t processBytes = 0;
+    NSUInteger processConnections = 0;
+    for (ProcessTrafficSummary *summary in stats.processSummaries) {
+        processBytes += summary.bytes;
+        processConnections += summary.connectionCount;
+    }
+    if (stats.processSummaries.count == 1) {
+        // Nothing was attributed in the test runner, so every connection is unknown
+        XCTAssertEqual(processBytes, stats.totalBytes);
+        XCTAssertEqual(processConnections, (NSUInteger)30);
+        XCTAssertEqual(stats.processSummaries.firstObject.destinations.count, (NSUInteger)30);
+    }
+}
+
+#pragma mark - Lookup priority
+
+- (void)testBusyDestinationOutsideTheTopListsOutranksAQuietOne {
+    const NSUInteger packetCount = 3000;
+    NSMutableData *data = [NSMutableData dataWithLength:packetCount * sizeof(SNBPacketRecord)];
+    SNBPacketRecord *records = data.mutableBytes;
+    const uint8_t local[4] = {192, 168, 1, 10};
+    for (NSUInteger i = 0; i < packetCount; i++) {
+        // Host n sends n * 10 bytes per packet, all of them until the end
+        NSUInteger host = 1 + (i % 30);
+        const uint8_t remote[4] = {93, 184, 0, (uint8_t)host};
+        records[i].timestampNs = kTopTestStartNs + i * 1000;
+        records[i].length = (uint32_t)(host * 10);
+        records[i].family = SNBAddressFamilyIPv4;
+        records[i].ipProtocol = 6;
+        records[i].flags = SNBPacketRecordFlagHasPorts | SNBPacketRecordFlagOutgoing;
+        memcpy(records[i].sourceAddress, local, 4);
+        memcpy(records[i].destinationAddress, remote, 4);
+        records[i].sourcePort = (uint16_t)(49152 + host);
+        records[i].destinationPort = 443;
+    }
+
+    TrafficStatistics *statistics = [[TrafficStatistics alloc] initWithShardCount:2];
+    [statistics processPacketBatch:[SNBPacketBatch batchWithRecords:records count:packetCount]];
+    TrafficStats *stats = [statistics getCurrentStats];
+
+    NSString *busy = @"93.184.0.24";
+    NSString *quiet = @"93.184.0.1";
+    XCTAssertLessThan(stats.topHosts.count, (NSUInteger)7);
+    for (HostTraffic *host in stats.topHosts) {
+        XCTAssertNotEqualObjects(host.address, busy, @"The busy destination must be outside the top lists");
+    }
+    for (ConnectionTraffic *connection in stats.topConnections) {
+        XCTAssertNotEqualObjects(connection.destinationAddress, busy);
+    }
+    XCTAssertEqual(stats.destinationBytes.count, (NSUInteger)30);
+    XCTAssertEqual(stats.destinationBytes[busy].unsignedLongLongValue, 100ULL * 240);
+    XCTAssertEqual(stats.destinationBytes[quiet].unsignedLongLongValue, 100ULL * 10);
+    XCTAssertNotNil(stats.destinationLastActivity[busy]);
+    XCTAssertLessThanOrEqual(stats.destinationLastActivity[busy].doubleValue, stats.captureTime);
+
+    for (NSNumber *anomalyScore in @[@0.0, @0.8]) {
+        double busyPriority = [stats lookupPriorityForDestination:busy anomalyScore:anomalyScore.doubleValue];
+        double quietPriority = [stats lookupPriorityForDestination:quiet anomalyScore:anomalyScore.doubleValue];
+        double unknownPriority = [stats lookupPriorityForDestination:@"198.51.100.7"
+                                                        anomalyScore:anomalyScore.doubleValue];
+        XCTAssertGreaterThan(busyPriority, quietPriority);
+        XCTAssertLessThan(unknownPriority, quietPriority, @"A destination without counters must rank as stale");
+    }
+}
+
+@end
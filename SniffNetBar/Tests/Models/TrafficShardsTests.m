@@ -0,0 +1,185 @@
+//
+//  TrafficShardsTests.m
+//  SniffNetBar
+//
+//  Sharded traffic accounting must add up to the unsharded result
+//
+
+#import <XCTest/XCTest.h>
+#import "PacketBatch.h"
+#import "TrafficShards.h"
+#import "TrafficStatistics.h"
+
+static const NSUInteger kShardTestPacketCount = 20000;
+static const NSUInteger kShardTestFlowCount = 300;
+static const uint64_t kShardTestStartNs = 1700000000ULL * 1000000000ULL;
+
+@interface TrafficShardsTests : XCTestCase
+@end
+
+@implementation TrafficShardsTests
+
+#pragma mark - Helpers
+
+// TCP between 192.168.1.10 and 300 public hosts, both directions, already
+// tagged the way the capture manager tags them
+static void SNBMakeShardTestRecord(SNBPacketRecord *record, NSUInteger index) {
+    NSUInteger flow = (index * 7919) % kShardTestFlowCount;
+    BOOL outgoing = (index % 3) != 0;
+    const uint8_t local[4] = {192, 168, 1, 10};
+    const uint8_t remote[4] = {93, 184, (uint8_t)(flow / 256), (uint8_t)(flow % 256)};
+    uint16_t localPort = (uint16_t)(49152 + flow);
+
+    memset(record, 0, sizeof(*record));
+    record->timestampNs = kShardTestStartNs + index * 1000;
+    record->length = (uint32_t)(60 + index % 1400);
+    record->family = SNBAddressFamilyIPv4;
+    record->ipProtocol = 6;
+    record->flags = SNBPacketRecordFlagHasPorts | (outgoing ? SNBPacketRecordFlagOutgoing : 0);
+    memcpy(record->sourceAddress, outgoing ? local : remote, 4);
+    memcpy(record->destinationAddress, outgoing ? remote : local, 4);
+    record->sourcePort = outgoing ? localPort : 443;
+    record->destinationPort = outgoing ? 443 : localPort;
+}
+
+- (NSData *)records {
+    NSMutableData *data = [NSMutableData dataWithLength:kShardTestPacketCount * sizeof(SNBPacketRecord)];
+    SNBPacketRecord *records = data.mutableBytes;
+    for (NSUInteger i = 0; i < kShardTestPacketCount; i++) {
+        SNBMakeShardTestRecord(&records[i], i);
+    }
+    return data;
+}
+
+- (NSDictionary<NSString *, NSNumber *> *)bytesByAddress:(NSArray<HostTraffic *> *)hosts {
+    NSMutableDictionary<NSString *, NSNumber *> *bytes = [NSMutableDictionary dictionary];
+    for (HostTraffic *host in hosts) {
+        bytes[host.address] = @(host.bytes);
+    }
+    return bytes;
+}
+
+#pragma mark - Partitioning
+
+- (void)testBothDirectionsOfAConnectionLandOnOneShard {
+    SNBPacketRecord records[2];
+    SNBMakeShardTestRecord(&records[0], 1);  // Outgoing
+    records[1] = records[0];
+    records[1].flags = SNBPacketRecordFlagHasPorts;
+    memcpy(records[1].sourceAddress, records[0].destinationAddress, 16);
+    memcpy(records[1].destinationAddress, records[0].sourceAddress, 16);
+    records[1].sourcePort = records[0].destinationPort;
+    records[1].destinationPort = records[0].sourcePort;
+
+    uint8_t shards[2];
+    SNBTrafficPartitionRecords(records, 2, 4, shards);
+    XCTAssertLessThan(shards[0], 4);
+    XCTAssertEqual(shards[0], shards[1], @"A reply must be counted by the shard that owns the connection");
+}
+
+- (void)testPartitionSpreadsConnections {
+    NSData *data = [self records];
+    uint8_t *shards = malloc(kShardTestPacketCount);
+    SNBTrafficPartitionRecords(data.bytes, kShardTestPacketCount, 4, shards);
+    NSUInteger perShard[4] = {0};
+    for (NSUInteger i = 0; i < kShardTestPacketCount; i++) {
+        perShard[shards[i]]++;
+    }
+    free(shards);
+    for (NSUInteger shard = 0; shard < 4; shard++) {
+        XCTAssertGreaterThan(perShard[shard], kShardTestPacketCount / 8, @"Shard %lu is starved", (unsigned long)shard);
+    }
+}
+
+#pragma mark - Merging
+
+- (void)testShardedDeltasMergeToTheUnshardedResult {
+    NSData *data = [self records];
+    const SNBPacketRecord *records = data.bytes;
+
+    SNBTrafficDelta single;
+    XCTAssertTrue(SNBTrafficDeltaInit(&single, 16, 16));
+    SNBTrafficDeltaAccount(&single, records, kShardTestPacketCount, NULL, 0, 0);
+
+    SNBFlowTable *hosts = SNBFlowTableCreate(sizeof(SNBTrafficCounters), 16);
+    SNBFlowTable *connections = SNBFlowTableCreate(sizeof(SNBTrafficCounters), 16);
+    uint8_t *shardIndices = malloc(kShardTestPacketCount);
+    SNBTrafficPartitionRecords(records, kShardTestPacketCount, 4, shardIndices);
+    uint64_t totalBytes = 0;
+    for (unsigned shard = 0; shard < 4; shard++) {
+        SNBTrafficDelta delta;
+        XCTAssertTrue(SNBTrafficDeltaInit(&delta, 16, 16));
+        SNBTrafficDeltaAccount(&delta, records, kShardTestPacketCount, shardIndices, shard, 0);
+        SNBTrafficDeltaMerge(&delta, hosts, connections, NULL, NULL);
+        totalBytes += delta.totalBytes;
+        SNBTrafficDeltaDestroy(&delta);
+    }
+    free(shardIndices);
+
+    XCTAssertEqual(totalBytes, single.totalBytes);
+    XCTAssertEqual(SNBFlowTableCount(hosts), kShardTestFlowCount);
+    XCTAssertEqual(SNBFlowTableCount(connections), SNBFlowTableCount(single.connections));
+
+    size_t cursor = 0;
+    const SNBFlowKey *key = NULL;
+    const SNBTrafficCounters *expected;
+    while ((expected = SNBFlowTableNext(single.hosts, &cursor, &key)) != NULL) {
+        const SNBTrafficCounters *merged = SNBFlowTableFind(hosts, key);
+        XCTAssertTrue(merged != NULL);
+        XCTAssertEqual(merged->bytes, expected->bytes);
+        XCTAssertEqual(merged->packets, expected->packets);
+        XCTAssertEqual(merged->lastActivityNs, expected->lastActivityNs);
+    }
+
+    SNBFlowTableDestroy(hosts);
+    SNBFlowTableDestroy(connections);
+    SNBTrafficDeltaDestroy(&single);
+}
+
+- (void)testStatisticsSnapshotIsIndependentOfShardCount {
+    NSData *data = [self records];
+    TrafficStatistics *single = [[TrafficStatistics alloc] initWithShardCount:1];
+    TrafficStatistics *sharded = [[TrafficStatistics alloc] initWithShardCount:4];
+    for (NSUInteger offset = 0; offset < kShardTestPacketCount; offset += 512) {
+        NSUInteger count = MIN((NSUInteger)512, kShardTestPacketCount - offset);
+        SNBPacketBatch *batch = [SNBPacketBatch batchWithRecords:(const SNBPacketRecord *)data.bytes + offset
+                                                            count:count];
+        [single processPacketBatch:batch];
+        [sharded processPacketBatch:batch];
+    }
+
+    TrafficStats *expected = [single getCurrentStats];
+    TrafficStats *stats = [sharded getCurrentStats];
+    XCTAssertEqual(stats.totalPackets, (uint64_t)kShardTestPacketCount);
+    XCTAssertEqual(stats.totalBytes, expected.totalBytes);
+    XCTAssertEqual(stats.incomingBytes, expected.incomingBytes);
+    XCTAssertEqual(stats.allActiveDestinationIPs.count, kShardTestFlowCount);
+    XCTAssertEqualObjects([self bytesByAddress:stats.topHosts], [self bytesByAddress:expected.topHosts]);
+}
+
+- (void)testTrafficIsTotalledPerInterface {
+    NSMutableData *data = [[self records] mutableCopy];
+    SNBPacketRecord *records = data.mutableBytes;
+    uint64_t expectedBytes[3] = {0};
+    for (NSUInteger i = 0; i < kShardTestPacketCount; i++) {
+        records[i].interfaceIndex = (uint8_t)(1 + i % 2);
+        expectedBytes[records[i].interfaceIndex] += records[i].length;
+    }
+
+    TrafficStatistics *statistics = [[TrafficStatistics alloc] initWithShardCount:4];
+    statistics.interfaceNames = @[@"", @"en0", @"utun4"];
+    [statistics processPacketBatch:[SNBPacketBatch batchWithRecords:records count:kShardTestPacketCount]];
+    TrafficStats *stats = [statistics getCurrentStats];
+
+    XCTAssertEqual(stats.interfaces.count, 2u);
+    XCTAssertEqualObjects(stats.interfaces[0].name, @"en0");
+    XCTAssertEqual(stats.interfaces[0].bytes, expectedBytes[1]);
+    XCTAssertEqualObjects(stats.interfaces[1].name, @"utun4");
+    XCTAssertEqual(stats.interfaces[1].bytes, expectedBytes[2]);
+    XCTAssertEqual(stats.interfaces[0].bytes + stats.interfaces[1].bytes, stats.totalBytes);
+    for (ConnectionTraffic *connection in stats.topConnections) {
+        XCTAssertNotNil(connection.interfaceName);
+    }
+}
+
+@end
@@ -0,0 +1,172 @@
+//
+//  AddressClassifierTests.m
+//  SniffNetBar
+//
+//  The prefix table must agree with a bit-by-bit prefix match and classify
+//  addresses by value, not by how they are written
+//
+
+#import <XCTest/XCTest.h>
+#import <arpa/inet.h>
+#import "AddressClassifier.h"
+#import "IPAddressUtilities.h"
+
+@interface AddressClassifierTests : XCTestCase
+@end
+
+@implementation AddressClassifierTests
+
+- (void)tearDown {
+    [IPAddressUtilities setUserNetworks:@[] error:NULL];
+    [super tearDown];
+}
+
+#pragma mark - Helpers
+
+typedef struct {
+    uint8_t family;
+    uint8_t prefixLength;
+    uint16_t classes;
+    uint8_t address[16];
+} SNBClassifierTestPrefix;
+
+static BOOL SNBClassifierTestCovers(const SNBClassifierTestPrefix *prefix, uint8_t family, const uint8_t *address) {
+    if (prefix->family != family) {
+        return NO;
+    }
+    for (unsigned bit = 0; bit < prefix->prefixLength; bit++) {
+        uint8_t mask = (uint8_t)(0x80 >> (bit % 8));
+        if ((prefix->address[bit / 8] & mask) != (address[bit / 8] & mask)) {
+            return NO;
+        }
+    }
+    return YES;
+}
+
+static uint16_t SNBClassifierTestClasses(NSString *ip) {
+    return [IPAddressUtilities addressClassesForIPAddress:ip];
+}
+
+#pragma mark - Tests
+
+- (void)testDefaultRanges {
+    XCTAssertEqual(SNBClassifierTestClasses(@"10.20.30.40"), SNBAddressClassPrivate);
+    XCTAssertEqual(SNBClassifierTestClasses(@"172.31.255.255"), SNBAddressClassPrivate);
+    XCTAssertEqual(SNBClassifierTestClasses(@"172.32.0.1"), 0);
+    XCTAssertEqual(SNBClassifierTestClasses(@"100.64.0.1"), SNBAddressClassSharedAddress);
+    XCTAssertEqual(SNBClassifierTestClasses(@"100.128.0.1"), 0);
+    XCTAssertEqual(SNBClassifierTestClasses(@"127.0.0.1"), SNBAddressClassLoopback);
+    XCTAssertEqual(SNBClassifierTestClasses(@"169.254.1.1"), SNBAddressClassLinkLocal);
+    XCTAssertEqual(SNBClassifierTestClasses(@"198.51.100.7"), SNBAddressClassDocumentation);
+    XCTAssertEqual(SNBClassifierTestClasses(@"239.255.255.250"), SNBAddressClassMulticast);
+    XCTAssertEqual(SNBClassifierTestClasses(@"255.255.255.255"), SNBAddressClassReserved);
+    XCTAssertEqual(SNBClassifierTestClasses(@"::"), SNBAddressClassUnspecified);
+    XCTAssertEqual(SNBClassifierTestClasses(@"::1"), SNBAddressClassLoopback);
+    XCTAssertEqual(SNBClassifierTestClasses(@"2001:db8::5"), SNBAddressClassDocumentation);
+    XCTAssertEqual(SNBClassifierTestClasses(@"fe80::1"), SNBAddressClassLinkLocal);
+    XCTAssertEqual(SNBClassifierTestClasses(@"febf::1"), SNBAddressClassLinkLocal);
+    XCTAssertEqual(SNBClassifierTestClasses(@"::ffff:192.168.1.1"), SNBAddressClassPrivate);
+
+    XCTAssertTrue([IPAddressUtilities isPublicIPAddress:@"8.8.8.8"]);
+    XCTAssertTrue([IPAddressUtilities isPublicIPAddress:@"2606:4700::1111"]);
+    XCTAssertFalse([IPAddressUtilities isPublicIPAddress:@"100.64.0.1"]);
+    XCTAssertFalse([IPAddressUtilities isPublicIPAddress:@"not an address"]);
+}
+
+- (void)testIPv6IsClassifiedByValueNotText {
+    // Text prefixes the old string checks matched: 0fcb::/16 and 00ff::/16
+    // are ordinary addresses, and fec0:: lies outside fe80::/10
+    XCTAssertTrue([IPAddressUtilities isPublicIPAddress:@"fcb::1"]);
+    XCTAssertFalse([IPAddressUtilities isPrivateIPv6Address:@"fdd::1"]);
+    XCTAssertFalse([IPAddressUtilities isMulticastAddress:@"ff::1"]);
+    XCTAssertFalse([IPAddressUtilities isLinkLocalAddress:@"fec0::1"]);
+
+    XCTAssertTrue([IPAddressUtilities isPrivateIPv6Address:@"FD12:3456::1"]);
+    XCTAssertTrue([IPAddressUtilities isMulticastAddress:@"ff02::fb"]);
+    XCTAssertTrue([IPAddressUtilities isLoopbackAddress:@"0:0:0:0:0:0:0:1"]);
+}
+
+- (void)testUserNetworksArePrivate {
+    XCTAssertTrue([IPAddressUtilities isPublicIPAddress:@"203.0.114.9"]);
+    NSError *error = nil;
+    XCTAssertTrue([IPAddressUtilities setUserNetworks:@[@"203.0.114.0/23", @"2a01:4f8::/32"] error:&error]);
+    XCTAssertNil(error);
+    XCTAssertTrue([IPAddressUtilities isPrivateIPAddress:@"203.0.115.200"]);
+    XCTAssertTrue([IPAddressUtilities isPrivateIPAddress:@"2a01:4f8:1::1"]);
+    XCTAssertFalse([IPAddressUtilities isPublicIPAddress:@"203.0.114.9"]);
+    // The documentation range next to the user network is untouched
+    XCTAssertEqual(SNBClassifierTestClasses(@"203.0.113.1"), SNBAddressClassDocumentation);
+
+    uint8_t address[4] = {203, 0, 114, 1};
+    XCTAssertNotEqual(SNBAddressClassify(SNBAddressClassifierShared(), SNBAddressFamilyIPv4, address) &
+                      SNBAddressClassUser, 0);
+
+    // A bad entry is reported and leaves the published table alone
+    XCTAssertFalse([IPAddressUtilities setUserNetworks:@[@"10.0.0.0/33"] error:&error]);
+    XCTAssertNotNil(error);
+    XCTAssertTrue([IPAddressUtilities isPrivateIPAddress:@"203.0.115.200"]);
+}
+
+- (void)testTableMatchesPrefixScan {
+    SNBAddressClassifier classifier;
+    XCTAssertTrue(SNBAddressClassifierInit(&classifier));
+    SNBClassifierTestPrefix prefixes[300];
+    uint64_t state = 0x2545f4914f6cdd1dULL;
+    for (NSUInteger i = 0; i < 300; i++) {
+        SNBClassifierTestPrefix *prefix = &prefixes[i];
+        memset(prefix, 0, sizeof(*prefix));
+        for (NSUInteger j = 0; j < 16; j++) {
+            state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+            prefix->address[j] = (uint8_t)(state >> 56);
+        }
+        // Share leading bytes so prefixes nest and overlap
+        prefix->address[0] = (uint8_t)(prefix->address[0] & 0x03);
+        prefix->family = (i % 2) ? SNBAddressFamilyIPv6 : SNBAddressFamilyIPv4;
+        prefix->prefixLength = (uint8_t)((state >> 24) % ((prefix->family == SNBAddressFamilyIPv6 ? 64 : 32) + 1));
+        prefix->classes = (uint16_t)(1u << (state % 10));
+        XCTAssertTrue(SNBAddressClassifierAddPrefix(&classifier, prefix->family, prefix->address,
+                                                    prefix->prefixLength, prefix->classes));
+    }
+
+    for (NSUInteger i = 0; i < 20000; i++) {
+        uint8_t address[16];
+        for (NSUInteger j = 0; j < 16; j++) {
+            state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+            address[j] = (uint8_t)(state >> 56);
+        }
+        address[0] &= 0x03;
+        const SNBClassifierTestPrefix *near = &prefixes[(state >> 20) % 300];
+        memcpy(address, near->address, near->prefixLength / 8);
+        uint8_t family = near->family;
+
+        uint16_t expected = 0;
+        for (NSUInteger p = 0; p < 300; p++) {
+            if (SNBClassifierTestCovers(&prefixes[p], family, address)) {
+                expected |= prefixes[p].classes;
+            }
+        }
+        XCTAssertEqual(SNBAddressClassifierLookup(&classifier, family, address), expected);
+    }
+    SNBAddressClassifierDestroy(&classifier);
+}
+
+- (void)testCIDRParsing {
+    SNBAddressClassifier classifier;
+    XCTAssertTrue(SNBAddressClassifierInit(&classifier));
+    char error[128];
+    XCTAssertTrue(SNBAddressClassifierAddCIDR(&classifier, "192.0.2.77", SNBAddressClassUser, error, sizeof(error)));
+    XCTAssertTrue(SNBAddressClassifierAddCIDR(&classifier, "0.0.0.0/0", SNBAddressClassReserved, error, sizeof(error)));
+    XCTAssertFalse(SNBAddressClassifierAddCIDR(&classifier, "192.0.2.0/", 0, error, sizeof(error)));
+    XCTAssertFalse(SNBAddressClassifierAddCIDR(&classifier, "192.0.2.0/-1", 0, error, sizeof(error)));
+    XCTAssertFalse(SNBAddressClassifierAddCIDR(&classifier, "fe80::/129", 0, error, sizeof(error)));
+    XCTAssertFalse(SNBAddressClassifierAddCIDR(&classifier, "example.com/24", 0, error, sizeof(error)));
+
+    uint8_t host[4] = {192, 0, 2, 77};
+    uint8_t neighbour[4] = {192, 0, 2, 78};
+    XCTAssertEqual(SNBAddressClassifierLookup(&classifier, SNBAddressFamilyIPv4, host),
+                   SNBAddressClassUser | SNBAddressClassReserved);
+    XCTAssertEqual(SNBAddressClassifierLookup(&classifier, SNBAddressFamilyIPv4, neighbour), SNBAddressClassReserved);
+    SNBAddressClassifierDestroy(&classifier);
+}
+
+@end
@@ -0,0 +1,216 @@
+//
+//  BlocklistTests.m
+//  SniffNetBar
+//
+//  The interval table must agree with a bit-by-bit prefix match, read list
+//  files as published, and map back exactly what it compiled
+//
+
+#import <XCTest/XCTest.h>
+#import <arpa/inet.h>
+#import "Blocklist.h"
+#import "PacketDirection.h"
+
+@interface BlocklistTests : XCTestCase
+@end
+
+@implementation BlocklistTests
+
+#pragma mark - Helpers
+
+typedef struct {
+    uint8_t family;
+    uint8_t prefixLength;
+    int list;
+    uint8_t address[16];
+} SNBBlocklistTestPrefix;
+
+static BOOL SNBBlocklistTestCovers(const SNBBlocklistTestPrefix *prefix, uint8_t family, const uint8_t *address) {
+    if (prefix->family != family) {
+        return NO;
+    }
+    for (unsigned bit = 0; bit < prefix->prefixLength; bit++) {
+        uint8_t mask = (uint8_t)(0x80 >> (bit % 8));
+        if ((prefix->address[bit / 8] & mask) != (address[bit / 8] & mask)) {
+            return NO;
+        }
+    }
+    return YES;
+}
+
+// Addresses from a narrow space, so random prefixes nest and overlap often
+static void SNBBlocklistTestRandomAddress(uint8_t family, uint8_t *address) {
+    memset(address, 0, 16);
+    if (family == SNBAddressFamilyIPv4) {
+        address[0] = (uint8_t)(arc4random_uniform(4) + (arc4random_uniform(40) == 0 ? 252 : 0));
+        address[1] = (uint8_t)arc4random_uniform(8);
+        address[2] = (uint8_t)arc4random_uniform(256);
+        address[3] = (uint8_t)arc4random_uniform(256);
+    } else {
+        address[0] = arc4random_uniform(2) ? 0xff : 0x20;
+        for (int i = 1; i < 16; i++) {
+            address[i] = (uint8_t)arc4random_uniform(3);
+        }
+    }
+}
+
+static uint32_t SNBBlocklistTestLookupText(const SNBBlocklist *blocklist, const char *text) {
+    uint8_t address[16] = {0};
+    if (inet_pton(AF_INET, text, address) == 1) {
+        return SNBBlocklistLookup(blocklist, SNBAddressFamilyIPv4, address);
+    }
+    inet_pton(AF_INET6, text, address);
+    return SNBBlocklistLookup(blocklist, SNBAddressFamilyIPv6, address);
+}
+
+#pragma mark - Tests
+
+- (void)testMatchesBitwiseModel {
+    enum { kPrefixes = 2000 };
+    static SNBBlocklistTestPrefix prefixes[kPrefixes];
+    for (int round = 0; round < 10; round++) {
+        SNBBlocklistBuilder *builder = SNBBlocklistBuilderCreate();
+        int listCount = 1 + (int)arc4random_uniform(5);
+        for (int list = 0; list < listCount; list++) {
+            XCTAssertEqual(SNBBlocklistBuilderAddList(builder, "list"), list);
+        }
+        for (int i = 0; i < kPrefixes; i++) {
+            SNBBlocklistTestPrefix *prefix = &prefixes[i];
+            prefix->family = arc4random_uniform(4) == 0 ? SNBAddressFamilyIPv6 : SNBAddressFamilyIPv4;
+            prefix->list = (int)arc4random_uniform((uint32_t)listCount);
+            prefix->prefixLength = (uint8_t)arc4random_uniform(prefix->family == SNBAddressFamilyIPv6 ? 129 : 33);
+            SNBBlocklistTestRandomAddress(prefix->family, prefix->address);
+            XCTAssertTrue(SNBBlocklistBuilderAddPrefix(builder, prefix->list, prefix->family,
+                                                       prefix->address, prefix->prefixLength));
+        }
+        SNBBlocklist *blocklist = SNBBlocklistBuilderCompile(builder, 0);
+        SNBBlocklistBuilderDestroy(builder);
+        XCTAssertTrue(blocklist != NULL);
+
+        for (int probe = 0; probe < 20000; probe++) {
+            uint8_t family = arc4random_uniform(3) == 0 ? SNBAddressFamilyIPv6 : SNBAddressFamilyIPv4;
+            uint8_t address[16];
+            SNBBlocklistTestRandomAddress(family, address);
+            uint32_t expected = 0;
+            for (int i = 0; i < kPrefixes; i++) {
+                if (SNBBlocklistTestCovers(&prefixes[i], family, address)) {
+                    expected |= 1u << prefixes[i].list;
+                }
+            }
+            XCTAssertEqual(SNBBlocklistLookup(blocklist, family, address), expected);
+        }
+        SNBBlocklistDestroy(blocklist);
+    }
+}
+
+- (void)testReadsPublishedListFormats {
+    SNBBlocklistBuilder *builder = SNBBlocklistBuilderCreate();
+    int drop = SNBBlocklistBuilderAddList(builder, "drop.txt");
+    int firehol = SNBBlocklistBuilderAddList(builder, "firehol_level1.netset");
+    const char *dropText = "; Spamhaus DROP List 2026/10/16\n"
+                           "; Last-Modified: Fri, 16 Oct 2026 10:00:00 GMT\n"
+                           "1.10.16.0/20 ; SBL256894\n"
+                           "2.56.192.0/22 ; SBL459831\r\n";
+    const char *fireholText = "#\n# firehol_level1\n#\n"
+                              "  1.10.20.0/24\n"
+                              "5.6.7.8\t# single address\n"
+                              "2001:db8::/32\n"
+                              "10.0.0.300\n"
+                              "8.8.8.0/33\n";
+    size_t rejected = 0;
+    XCTAssertEqual(SNBBlocklistBuilderAddText(builder, drop, dropText, strlen(dropText), &rejected), 2u);
+    XCTAssertEqual(rejected, 0u);
+    XCTAssertEqual(SNBBlocklistBuilderAddText(builder, firehol, fireholText, strlen(fireholText), &rejected), 3u);
+    XCTAssertEqual(rejected, 2u);
+    SNBBlocklist *blocklist = SNBBlocklistBuilderCompile(builder, 0);
+    SNBBlocklistBuilderDestroy(builder);
+
+    XCTAssertEqual(blocklist->prefixCount, 5u);
+    XCTAssertEqual(SNBBlocklistTestLookupText(blocklist, "1.10.16.1"), 1u << drop);
+    XCTAssertEqual(SNBBlocklistTestLookupText(blocklist, "1.10.20.9"), (1u << drop) | (1u << firehol));
+    XCTAssertEqual(SNBBlocklistTestLookupText(blocklist, "1.10.32.0"), 0u);
+    XCTAssertEqual(SNBBlocklistTestLookupText(blocklist, "2.56.195.255"), 1u << drop);
+    XCTAssertEqual(SNBBlocklistTestLookupText(blocklist, "5.6.7.8"), 1u << firehol);
+    XCTAssertEqual(SNBBlocklistTestLookupText(blocklist, "5.6.7.9"), 0u);
+    XCTAssertEqual(SNBBlocklistTestLookupText(blocklist, "2001:db8:ffff::1"), 1u << firehol);
+    // IPv4-mapped addresses are looked up as IPv4
+    XCTAssertEqual(SNBBlocklistTestLookupText(blocklist, "::ffff:5.6.7.8"), 1u << firehol);
+    XCTAssertEqualObjects(@(blocklist->listNames[firehol]), @"firehol_level1.netset");
+    SNBBlocklistDestroy(blocklist);
+}
+
+- (void)testCompiledFileMapsOnlyForItsSources {
+    NSString *directory = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSUUID UUID].UUIDString];
+    [[NSFileManager defaultManager] createDirectoryAtPath:directory withIntermediateDirectories:YES attributes:nil error:nil];
+    NSString *listPath = [directory stringByAppendingPathComponent:@"list.netset"];
+    NSString *compiledPath = [directory stringByAppendingPathComponent:@"blocklist.compiled"];
+    [@"198.51.100.0/24\n203.0.113.7\n2001:db8::1\n" writeToFile:listPath atomically:YES encoding:NSUTF8StringEncoding error:nil];
+
+    uint64_t signature = SNBBlocklistSignatureAddFile(SNB_BLOCKLIST_SIGNATURE_SEED, listPath.fileSystemRepresentation);
+    XCTAssertNotEqual(signature, SNB_BLOCKLIST_SIGNATURE_SEED);
+    SNBBlocklistBuilder *builder = SNBBlocklistBuilderCreate();
+    size_t added = 0;
+    XCTAssertTrue(SNBBlocklistBuilderAddFile(builder, SNBBlocklistBuilderAddList(builder, "list"),
+                                             listPath.fileSystemRepresentation, &added, NULL));
+    XCTAssertEqual(added, 3u);
+    SNBBlocklist *compiled = SNBBlocklistBuilderCompile(builder, signature);
+    SNBBlocklistBuilderDestroy(builder);
+    XCTAssertTrue(SNBBlocklistWrite(compiled, compiledPath.fileSystemRepresentation));
+
+    SNBBlocklist *mapped = SNBBlocklistMap(compiledPath.fileSystemRepresentation, signature);
+    XCTAssertTrue(mapped != NULL);
+    XCTAssertTrue(mapped->mapped);
+    XCTAssertEqual(mapped->storageSize, compiled->storageSize);
+    XCTAssertEqual(memcmp(mapped->storage, compiled->storage, compiled->storageSize), 0);
+    XCTAssertEqual(SNBBlocklistTestLookupText(mapped, "198.51.100.200"), 1u);
+    XCTAssertEqual(SNBBlocklistTestLookupText(mapped, "2001:db8::1"), 1u);
+    XCTAssertEqual(SNBBlocklistTestLookupText(mapped, "2001:db8::2"), 0u);
+
+    XCTAssertTrue(SNBBlocklistMap(compiledPath.fileSystemRepresentation, signature + 1) == NULL);
+    // A truncated file is refused rather than read past its end
+    NSData *data = [NSData dataWithContentsOfFile:compiledPath];
+    [[data subdataWithRange:NSMakeRange(0, data.length / 2)] writeToFile:compiledPath atomically:YES];
+    XCTAssertTrue(SNBBlocklistMap(compiledPath.fileSystemRepresentation, signature) == NULL);
+
+    SNBBlocklistDestroy(mapped);
+    SNBBlocklistDestroy(compiled);
+    [[NSFileManager defaultManager] removeItemAtPath:directory error:nil];
+}
+
+- (void)testFlagsRecordsByRemoteAddress {
+    SNBBlocklistBuilder *builder = SNBBlocklistBuilderCreate();
+    const char *text = "203.0.113.0/24\n";
+    SNBBlocklistBuilderAddText(builder, SNBBlocklistBuilderAddList(builder, "list"), text, strlen(text), NULL);
+    SNBBlocklist *blocklist = SNBBlocklistBuilderCompile(builder, 0);
+    SNBBlocklistBuilderDestroy(builder);
+
+    SNBPacketRecord records[3];
+    memset(records, 0, sizeof(records));
+    const uint8_t listed[4] = {203, 0, 113, 5};
+    const uint8_t local[4] = {192, 168, 1, 10};
+    // Outgoing to a listed host
+    records[0].family = SNBAddressFamilyIPv4;
+    records[0].flags = SNBPacketRecordFlagOutgoing;
+    memcpy(records[0].sourceAddress, local, 4);
+    memcpy(records[0].destinationAddress, listed, 4);
+    // Incoming from it
+    records[1].family = SNBAddressFamilyIPv4;
+    memcpy(records[1].sourceAddress, listed, 4);
+    memcpy(records[1].destinationAddress, local, 4);
+    // Outgoing from it: the remote side is the unlisted destination
+    records[2].family = SNBAddressFamilyIPv4;
+    records[2].flags = SNBPacketRecordFlagOutgoing | SNBPacketRecordFlagBlocklisted;
+    memcpy(records[2].sourceAddress, listed, 4);
+    memcpy(records[2].destinationAddress, local, 4);
+
+    XCTAssertEqual(SNBPacketRecordsMatchBlocklist(blocklist, records, 3), 2u);
+    XCTAssertTrue(records[0].flags & SNBPacketRecordFlagBlocklisted);
+    XCTAssertTrue(records[1].flags & SNBPacketRecordFlagBlocklisted);
+    XCTAssertFalse(records[2].flags & SNBPacketRecordFlagBlocklisted);
+
+    XCTAssertEqual(SNBPacketRecordsMatchBlocklist(NULL, records, 3), 0u);
+    XCTAssertFalse(records[0].flags & SNBPacketRecordFlagBlocklisted);
+    SNBBlocklistDestroy(blocklist);
+}
+
+@end
@@ -0,0 +1,155 @@
+//
+//  CaptureHandleTests.m
+//  SniffNetBar
+//
+//  Capture options and BPF filters, checked on offline handles since live
+//  capture needs the helper's privileges
+//
+
+#import <XCTest/XCTest.h>
+#import <pcap/pcap.h>
+#import "CaptureHandle.h"
+#import "CaptureOptions.h"
+#import "CaptureOptions+Serialization.h"
+#import "PacketBatchReader.h"
+#import "PacketBatch.h"
+
+static const NSUInteger kFilterPacketCount = 1000;
+
+@interface CaptureHandleTests : XCTestCase
+@property (nonatomic, copy) NSString *pcapPath;
+@end
+
+@implementation CaptureHandleTests
+
+- (void)setUp {
+    [super setUp];
+    self.pcapPath = [NSTemporaryDirectory() stringByAppendingPathComponent:
+                     [NSString stringWithFormat:@"snb-filter-%@.pcap", [NSUUID UUID].UUIDString]];
+    [self writePcapToPath:self.pcapPath];
+}
+
+- (void)tearDown {
+    [[NSFileManager defaultManager] removeItemAtPath:self.pcapPath error:nil];
+    self.pcapPath = nil;
+    [super tearDown];
+}
+
+#pragma mark - Helpers
+
+// Ethernet/IPv4 frames alternating TCP to port 443 and UDP to port 53
+- (void)writePcapToPath:(NSString *)path {
+    FILE *file = fopen(path.fileSystemRepresentation, "wb");
+    XCTAssertTrue(file != NULL, @"Should create pcap file");
+
+    uint32_t globalHeader[6] = { 0xa1b2c3d4, 0x00040002, 0, 0, 65535, DLT_EN10MB };
+    fwrite(globalHeader, sizeof(globalHeader), 1, file);
+
+    uint8_t frame[54] = {0};
+    frame[12] = 0x08;
+    frame[14] = 0x45;
+    frame[17] = 40;   // IPv4 total length
+    frame[22] = 64;
+    frame[26] = 192; frame[27] = 168; frame[28] = 1; frame[29] = 10;
+    frame[30] = 93;  frame[31] = 184; frame[32] = 216; frame[33] = 34;
+    frame[34] = 0xc0;
+    for (NSUInteger i = 0; i < kFilterPacketCount; i++) {
+        BOOL tcp = (i % 2) == 0;
+        frame[23] = tcp ? 6 : 17;
+        frame[36] = tcp ? 0x01 : 0;  // 443 or 53
+        frame[37] = tcp ? 0xbb : 53;
+        frame[46] = tcp ? 0x50 : 0;
+        uint32_t recordHeader[4] = { (uint32_t)(1700000000 + i), 0, sizeof(frame), sizeof(frame) };
+        fwrite(recordHeader, sizeof(recordHeader), 1, file);
+        fwrite(frame, sizeof(frame), 1, file);
+    }
+    fclose(file);
+}
+
+- (NSUInteger)countPacketsWithFilter:(NSString *)filter protocol:(uint8_t)protocol {
+    char errbuf[PCAP_ERRBUF_SIZE];
+    pcap_t *handle = pcap_open_offline(self.pcapPath.fileSystemRepresentation, errbuf);
+    XCTAssertTrue(handle != NULL, @"Should open replay file: %s", errbuf);
+    NSError *error = nil;
+    XCTAssertTrue(SNBCaptureHandleSetFilter(handle, filter, &error), @"%@", error);
+
+    SNBPacketBatchReader *reader = [[SNBPacketBatchReader alloc] initWithPcapHandle:handle];
+    NSUInteger matching = 0;
+    NSUInteger total = 0;
+    while (!reader.exhausted) {
+        SNBPacketBatch *batch = [reader readBatchWithMaxPackets:256 maxLatency:0.05 error:nil];
+        for (NSUInteger i = 0; i < batch.count; i++) {
+            matching += batch.records[i].ipProtocol == protocol;
+        }
+        total += batch.count;
+    }
+    pcap_close(handle);
+    XCTAssertEqual(matching, total, @"Filter \"%@\" should only pass protocol %u", filter, protocol);
+    return total;
+}
+
+#pragma mark - Filters
+
+- (void)testFilterRunsBeforeDecoding {
+    XCTAssertEqual([self countPacketsWithFilter:@"udp port 53" protocol:17], kFilterPacketCount / 2);
+    XCTAssertEqual([self countPacketsWithFilter:@"tcp and dst port 443" protocol:6], kFilterPacketCount / 2);
+    XCTAssertEqual([self countPacketsWithFilter:@"icmp" protocol:1], 0);
+}
+
+- (void)testEmptyFilterPassesEverything {
+    char errbuf[PCAP_ERRBUF_SIZE];
+    pcap_t *handle = pcap_open_offline(self.pcapPath.fileSystemRepresentation, errbuf);
+    XCTAssertTrue(SNBCaptureHandleSetFilter(handle, @"udp", nil));
+    XCTAssertTrue(SNBCaptureHandleSetFilter(handle, @"", nil));
+    SNBPacketBatchReader *reader = [[SNBPacketBatchReader alloc] initWithPcapHandle:handle];
+    SNBPacketBatch *batch = [reader readBatchWithMaxPackets:kFilterPacketCount maxLatency:0.05 error:nil];
+    XCTAssertEqual(batch.count, kFilterPacketCount);
+    pcap_close(handle);
+}
+
+- (void)testInvalidFilterIsReported {
+    char errbuf[PCAP_ERRBUF_SIZE];
+    pcap_t *handle = pcap_open_offline(self.pcapPath.fileSystemRepresentation, errbuf);
+    NSError *error = nil;
+    XCTAssertFalse(SNBCaptureHandleSetFilter(handle, @"tcp and (port", &error));
+    XCTAssertEqualObjects(error.domain, SNBCaptureHandleErrorDomain);
+    XCTAssertEqual(error.code, SNBCaptureHandleErrorFilter);
+    XCTAssertTrue([error.localizedDescription containsString:@"tcp and (port"]);
+
+    NSString *overlong = [@"" stringByPaddingToLength:kSNBCaptureMaxFilterLength + 1 withString:@"x" startingAtIndex:0];
+    error = nil;
+    XCTAssertFalse(SNBCaptureHandleSetFilter(handle, overlong, &error));
+    XCTAssertEqual(error.code, SNBCaptureHandleErrorFilter);
+    pcap_close(handle);
+}
+
+#pragma mark - Options
+
+- (void)testOptionsAreClampedAndSurviveSerialization {
+    SNBCaptureOptions *options = [SNBCaptureOptions defaultOptions];
+    XCTAssertEqual(options.snapshotLength, kSNBCaptureDefaultSnapshotLength);
+    XCTAssertNil(options.filterExpression);
+
+    options.snapshotLength = 20;
+    XCTAssertEqual(options.snapshotLength, kSNBCaptureMinSnapshotLength);
+    options.snapshotLength = INT_MAX;
+    XCTAssertEqual(options.snapshotLength, kSNBCaptureMaxSnapshotLength);
+    options.bufferSize = NSUIntegerMax;
+    XCTAssertEqual(options.bufferSize, kSNBCaptureMaxBufferSize);
+
+    options.snapshotLength = 256;
+    options.bufferSize = 8 * 1024 * 1024;
+    options.filterExpression = @"not port 22";
+    SNBCaptureOptions *decoded = [SNBCaptureOptions fromDictionary:[options toDictionary]];
+    XCTAssertEqual(decoded.snapshotLength, 256);
+    XCTAssertEqual(decoded.bufferSize, 8u * 1024 * 1024);
+    XCTAssertEqualObjects(decoded.filterExpression, @"not port 22");
+
+    // Values from the app are not trusted by the helper
+    decoded = [SNBCaptureOptions fromDictionary:@{@"snapshotLength": @1, @"filterExpression": @42}];
+    XCTAssertEqual(decoded.snapshotLength, kSNBCaptureMinSnapshotLength);
+    XCTAssertNil(decoded.filterExpression);
+    XCTAssertEqual(decoded.bufferSize, kSNBCaptureDefaultBufferSize);
+}
+
+@end
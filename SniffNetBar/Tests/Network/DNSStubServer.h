@@ -0,0 +1,43 @@
+//
+//  DNSStubServer.h
+//  SniffNetBar
+//
+//  Local UDP nameserver answering PTR queries for resolver tests
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@interface DNSStubServer : NSObject
+
+// Bound to 127.0.0.1 on a free port; nil if the socket cannot be opened
+- (nullable instancetype)init;
+
+@property (nonatomic, assign, readonly) uint16_t port;
+
+// Test control properties
+// Addresses with a name get a PTR answer; others get NXDOMAIN with an SOA
+// whose TTL and minimum are negativeTTL
+- (void)setName:(nullable NSString *)name forAddress:(NSString *)address;
+@property (atomic, assign) uint32_t answerTTL;
+@property (atomic, assign) uint32_t negativeTTL;
+@property (atomic, assign) NSTimeInterval responseDelay;
+@property (atomic, assign) BOOL dropQueries;
+@property (atomic, assign, readonly) NSInteger queryCount;
+
+// Wire form of a name, for PTR and CNAME record data
++ (NSData *)encodedName:(NSString *)name;
+// A response answering question with one record of type per data item, as
+// captured traffic would carry it
++ (NSData *)responseWithID:(uint16_t)identifier
+                  question:(NSString *)question
+                      type:(uint16_t)type
+                   answers:(NSArray<NSData *> *)answerData
+                       ttl:(uint32_t)ttl;
+
+- (void)stop;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,204 @@
+//
+//  DNSStubServer.m
+//  SniffNetBar
+//
+//  Local UDP nameserver answering PTR queries for resolver tests
+//
+
+#import "DNSStubServer.h"
+#import "DNSMessage.h"
+#import "PacketBatch.h"
+#import <arpa/inet.h>
+#import <fcntl.h>
+#import <netinet/in.h>
+#import <sys/socket.h>
+#import <unistd.h>
+
+@interface DNSStubServer ()
+@property (nonatomic, assign) int socketFD;
+@property (nonatomic, strong) dispatch_queue_t queue;
+@property (nonatomic, strong) dispatch_source_t readSource;
+@property (nonatomic, strong) NSMutableDictionary<NSString *, NSString *> *names;
+@property (atomic, assign, readwrite) NSInteger queryCount;
+@end
+
+static void SNBStubAppend16(NSMutableData *data, uint16_t value) {
+    uint8_t bytes[2] = { (uint8_t)(value >> 8), (uint8_t)value };
+    [data appendBytes:bytes length:2];
+}
+
+static void SNBStubAppend32(NSMutableData *data, uint32_t value) {
+    SNBStubAppend16(data, (uint16_t)(value >> 16));
+    SNBStubAppend16(data, (uint16_t)value);
+}
+
+// Header and question; answers refer to the question name at offset 12
+static NSMutableData *SNBStubResponseHeader(uint16_t identifier, uint16_t flags, NSString *question, uint16_t type,
+                                            uint16_t answerCount, uint16_t authorityCount) {
+    NSMutableData *data = [NSMutableData data];
+    SNBStubAppend16(data, identifier);
+    SNBStubAppend16(data, flags);
+    SNBStubAppend16(data, 1);
+    SNBStubAppend16(data, answerCount);
+    SNBStubAppend16(data, authorityCount);
+    SNBStubAppend16(data, 0);
+    [data appendData:[DNSStubServer encodedName:question]];
+    SNBStubAppend16(data, type);
+    SNBStubAppend16(data, 1);
+    return data;
+}
+
+static void SNBStubAppendRecord(NSMutableData *data, uint16_t type, uint32_t ttl, NSData *recordData) {
+    SNBStubAppend16(data, 0xc00c);
+    SNBStubAppend16(data, type);
+    SNBStubAppend16(data, 1);
+    SNBStubAppend32(data, ttl);
+    SNBStubAppend16(data, (uint16_t)recordData.length);
+    [data appendData:recordData];
+}
+
+@implementation DNSStubServer
+
+- (instancetype)init {
+    self = [super init];
+    if (self) {
+        _socketFD = socket(AF_INET, SOCK_DGRAM, 0);
+        if (_socketFD < 0) {
+            return nil;
+        }
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_len = sizeof(address);
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t length = sizeof(address);
+        if (bind(_socketFD, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+            getsockname(_socketFD, (struct sockaddr *)&address, &length) != 0) {
+            close(_socketFD);
+            return nil;
+        }
+        fcntl(_socketFD, F_SETFL, fcntl(_socketFD, F_GETFL) | O_NONBLOCK);
+        _port = ntohs(address.sin_port);
+        _answerTTL = 3600;
+        _negativeTTL = 300;
+        _names = [NSMutableDictionary dictionary];
+        _queue = dispatch_queue_create("com.sniffnetbar.tests.dnsstub", DISPATCH_QUEUE_SERIAL);
+
+        int socketFD = _socketFD;
+        _readSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_READ, (uintptr_t)socketFD, 0, _queue);
+        __weak typeof(self) weakSelf = self;
+        dispatch_source_set_event_handler(_readSource, ^{
+            [weakSelf readQueries];
+        });
+        dispatch_source_set_cancel_handler(_readSource, ^{
+            close(socketFD);
+        });
+        dispatch_resume(_readSource);
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [self stop];
+}
+
+- (void)stop {
+    if (self.readSource && !dispatch_source_testcancel(self.readSource)) {
+        dispatch_source_cancel(self.readSource);
+    }
+}
+
+- (void)setName:(NSString *)name forAddress:(NSString *)address {
+    @synchronized(self.names) {
+        self.names[address] = name;
+    }
+}
+
++ (NSData *)encodedName:(NSString *)name {
+    NSMutableData *data = [NSMutableData data];
+    for (NSString *label in [name componentsSeparatedByString:@"."]) {
+        NSData *bytes = [label dataUsingEncoding:NSUTF8StringEncoding];
+        if (bytes.length == 0) {
+            continue;
+        }
+        uint8_t length = (uint8_t)bytes.length;
+        [data appendBytes:&length length:1];
+        [data appendData:bytes];
+    }
+    uint8_t root = 0;
+    [data appendBytes:&root length:1];
+    return data;
+}
+
++ (NSData *)responseWithID:(uint16_t)identifier
+                  question:(NSString *)question
+                      type:(uint16_t)type
+                   answers:(NSArray<NSData *> *)answerData
+                       ttl:(uint32_t)ttl {
+    NSMutableData *data = SNBStubResponseHeader(identifier, SNBDNSFlagResponse | SNBDNSFlagRecursionDesired | 0x0080,
+                                                question, type, (uint16_t)answerData.count, 0);
+    for (NSData *recordData in answerData) {
+        SNBStubAppendRecord(data, type, ttl, recordData);
+    }
+    return data;
+}
+
+#pragma mark - Serving
+
+- (void)readQueries {
+    uint8_t buffer[SNB_DNS_MAX_UDP_MESSAGE];
+    for (;;) {
+        struct sockaddr_storage from;
+        socklen_t fromLength = sizeof(from);
+        ssize_t received = recvfrom(self.socketFD, buffer, sizeof(buffer), 0, (struct sockaddr *)&from, &fromLength);
+        if (received < 0) {
+            return;
+        }
+        self.queryCount++;
+        SNBDNSHeader header;
+        if (self.dropQueries || !SNBDNSParseMessage(buffer, (size_t)received, &header, NULL, NULL, NULL)) {
+            continue;
+        }
+        NSData *response = [self responseToQuery:&header];
+        NSData *client = [NSData dataWithBytes:&from length:fromLength];
+        int socketFD = self.socketFD;
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(self.responseDelay * NSEC_PER_SEC)), self.queue, ^{
+            sendto(socketFD, response.bytes, response.length, 0, client.bytes, (socklen_t)client.length);
+        });
+    }
+}
+
+- (NSData *)responseToQuery:(const SNBDNSHeader *)header {
+    NSString *question = @(header->question);
+    uint8_t family = 0;
+    uint8_t address[16];
+    NSString *name = nil;
+    if (header->questionType == SNBDNSTypePTR && SNBDNSAddressFromReverseName(header->question, &family, address)) {
+        @synchronized(self.names) {
+            name = self.names[SNBStringFromPacketAddress(family, address) ?: @""];
+        }
+    }
+    if (name) {
+        return [DNSStubServer responseWithID:header->id
+                                    question:question
+                                        type:SNBDNSTypePTR
+                                     answers:@[[DNSStubServer encodedName:name]]
+                                         ttl:self.answerTTL];
+    }
+
+    NSMutableData *data = SNBStubResponseHeader(header->id,
+                                                SNBDNSFlagResponse | SNBDNSFlagRecursionDesired | 0x0080 | SNBDNSRcodeNXDomain,
+                                                question, header->questionType, 0, 1);
+    NSMutableData *soa = [NSMutableData data];
+    [soa appendData:[DNSStubServer encodedName:@"ns.stub.test"]];
+    [soa appendData:[DNSStubServer encodedName:@"hostmaster.stub.test"]];
+    SNBStubAppend32(soa, 1);                 // Serial
+    SNBStubAppend32(soa, 3600);              // Refresh
+    SNBStubAppend32(soa, 600);               // Retry
+    SNBStubAppend32(soa, 86400);             // Expire
+    SNBStubAppend32(soa, self.negativeTTL);  // Minimum
+    SNBStubAppendRecord(data, SNBDNSTypeSOA, self.negativeTTL, soa);
+    return data;
+}
+
+@end
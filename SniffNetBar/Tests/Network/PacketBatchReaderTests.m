@@ -0,0 +1,176 @@
+//
+//  PacketBatchReaderTests.m
+//  SniffNetBar
+//
+//  Replay tests for batched packet delivery
+//
+
+#import <XCTest/XCTest.h>
+#import <pcap/pcap.h>
+#import "PacketBatchReader.h"
+#import "PacketBatch.h"
+#import "PacketInfo.h"
+#import "CaptureStats.h"
+#import "CaptureStats+Serialization.h"
+
+static const NSUInteger kReplayPacketCount = 200000;
+static const double kMinimumPacketsPerSecond = 100000.0;
+
+@interface PacketBatchReaderTests : XCTestCase
+@property (nonatomic, copy) NSString *pcapPath;
+@end
+
+@implementation PacketBatchReaderTests
+
+- (void)setUp {
+    [super setUp];
+    self.pcapPath = [NSTemporaryDirectory() stringByAppendingPathComponent:
+                     [NSString stringWithFormat:@"snb-batch-%@.pcap", [NSUUID UUID].UUIDString]];
+    [self writeSyntheticPcapWithPacketCount:kReplayPacketCount toPath:self.pcapPath];
+}
+
+- (void)tearDown {
+    [[NSFileManager defaultManager] removeItemAtPath:self.pcapPath error:nil];
+    self.pcapPath = nil;
+    [super tearDown];
+}
+
+#pragma mark - Helpers
+
+// Writes Ethernet/IPv4 frames alternating TCP and UDP across 64 flows
+- (void)writeSyntheticPcapWithPacketCount:(NSUInteger)count toPath:(NSString *)path {
+    FILE *file = fopen(path.fileSystemRepresentation, "wb");
+    XCTAssertTrue(file != NULL, @"Should create pcap file");
+
+    uint32_t globalHeader[6] = { 0xa1b2c3d4, 0x00040002, 0, 0, 65535, DLT_EN10MB };
+    fwrite(globalHeader, sizeof(globalHeader), 1, file);
+
+    uint8_t frame[54] = {0};
+    frame[12] = 0x08; // EtherType IPv4
+    frame[14] = 0x45; // Version 4, IHL 5
+    frame[22] = 64;   // TTL
+    frame[26] = 192; frame[27] = 168; frame[28] = 1; frame[29] = 10;
+    frame[30] = 93;  frame[31] = 184; frame[32] = 216;
+
+    for (NSUInteger i = 0; i < count; i++) {
+        BOOL tcp = (i % 2) == 0;
+        frame[23] = tcp ? 6 : 17;
+        frame[33] = (uint8_t)(i % 64);
+        uint16_t srcPort = (uint16_t)(49152 + (i % 64));
+        uint16_t dstPort = tcp ? 443 : 53;
+        frame[34] = (uint8_t)(srcPort >> 8); frame[35] = (uint8_t)srcPort;
+        frame[36] = (uint8_t)(dstPort >> 8); frame[37] = (uint8_t)dstPort;
+
+        uint32_t wireLength = 54 + (uint32_t)(i % 1400);
+        uint32_t recordHeader[4] = { (uint32_t)(1700000000 + i / 1000), (uint32_t)((i % 1000) * 1000),
+                                     sizeof(frame), wireLength };
+        fwrite(recordHeader, sizeof(recordHeader), 1, file);
+        fwrite(frame, sizeof(frame), 1, file);
+    }
+    fclose(file);
+}
+
+- (pcap_t *)openReplayHandle {
+    char errbuf[PCAP_ERRBUF_SIZE];
+    pcap_t *handle = pcap_open_offline(self.pcapPath.fileSystemRepresentation, errbuf);
+    XCTAssertTrue(handle != NULL, @"Should open replay file: %s", errbuf);
+    return handle;
+}
+
+#pragma mark - Batching
+
+- (void)testBatchRespectsMaxPackets {
+    pcap_t *handle = [self openReplayHandle];
+    SNBPacketBatchReader *reader = [[SNBPacketBatchReader alloc] initWithPcapHandle:handle];
+
+    SNBPacketBatch *batch = [reader readBatchWithMaxPackets:100 maxLatency:0.05 error:nil];
+    XCTAssertEqual(batch.count, 100, @"Batch should stop at maxPackets");
+
+    PacketInfo *first = [PacketInfo packetInfoWithRecord:&batch.records[0]];
+    XCTAssertEqualObjects(first.sourceAddress, @"192.168.1.10");
+    XCTAssertEqualObjects(first.destinationAddress, @"93.184.216.0");
+    XCTAssertEqual(first.protocol, PacketProtocolTCP);
+    XCTAssertEqual(first.destinationPort, 443);
+    XCTAssertEqual(batch.records[1].ipProtocol, 17);
+
+    SNBCaptureStats *stats = [reader currentStats];
+    XCTAssertEqual(stats.packetsDelivered, 100ULL);
+    XCTAssertEqual(stats.batchCount, 1ULL);
+    XCTAssertEqual(stats.totalDropped, 0ULL, @"Offline replay should not report drops");
+    pcap_close(handle);
+}
+
+- (void)testOversizedBatchRequestIsClamped {
+    pcap_t *handle = [self openReplayHandle];
+    SNBPacketBatchReader *reader = [[SNBPacketBatchReader alloc] initWithPcapHandle:handle];
+
+    SNBPacketBatch *batch = [reader readBatchWithMaxPackets:NSUIntegerMax maxLatency:0.05 error:nil];
+    XCTAssertEqual(batch.count, kSNBPacketBatchMaxPackets, @"Batch size should be capped");
+    pcap_close(handle);
+}
+
+- (void)testStatsSurviveSerialization {
+    SNBCaptureStats *stats = [[SNBCaptureStats alloc] init];
+    stats.packetsReceived = 1000;
+    stats.kernelDropped = 7;
+    stats.interfaceDropped = 3;
+    stats.packetsDelivered = 990;
+    stats.batchCount = 4;
+    stats.lastBatchSize = 250;
+
+    SNBCaptureStats *decoded = [SNBCaptureStats fromDictionary:[stats toDictionary]];
+    XCTAssertEqual(decoded.packetsReceived, 1000ULL);
+    XCTAssertEqual(decoded.totalDropped, 10ULL);
+    XCTAssertEqual(decoded.packetsDelivered, 990ULL);
+    XCTAssertEqual(decoded.batchCount, 4ULL);
+    XCTAssertEqual(decoded.lastBatchSize, 250);
+}
+
+#pragma mark - Throughput
+
+// Replays the whole file through the same path the helper and app use:
+// batch read, packed records over XPC, unwrapping, then delivery on a
+// serial capture queue.
+- (void)testReplayThroughputExceedsTarget {
+    pcap_t *handle = [self openReplayHandle];
+    SNBPacketBatchReader *reader = [[SNBPacketBatchReader alloc] initWithPcapHandle:handle];
+    dispatch_queue_t captureQueue = dispatch_queue_create("com.sniffnetbar.tests.capture", DISPATCH_QUEUE_SERIAL);
+    __block uint64_t deliveredPackets = 0;
+    __block uint64_t deliveredBytes = 0;
+
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    while (!reader.isExhausted) {
+        NSError *error = nil;
+        SNBPacketBatch *batch = [reader readBatchWithMaxPackets:512 maxLatency:0.05 error:&error];
+        XCTAssertNil(error);
+        if (batch.count == 0) {
+            continue;
+        }
+
+        NSData *wire = [batch.data copy];
+        SNBPacketBatch *decoded = [SNBPacketBatch batchWithData:wire];
+        XCTAssertNotNil(decoded);
+
+        dispatch_async(captureQueue, ^{
+            const SNBPacketRecord *records = decoded.records;
+            for (NSUInteger i = 0; i < decoded.count; i++) {
+                deliveredPackets++;
+                deliveredBytes += records[i].length;
+            }
+        });
+    }
+    dispatch_sync(captureQueue, ^{});
+    CFAbsoluteTime elapsed = CFAbsoluteTimeGetCurrent() - start;
+    pcap_close(handle);
+
+    double packetsPerSecond = deliveredPackets / MAX(elapsed, 0.000001);
+    NSLog(@"Replayed %llu packets (%llu bytes) in %.3fs: %.0f pkts/s",
+          deliveredPackets, deliveredBytes, elapsed, packetsPerSecond);
+
+    XCTAssertEqual(deliveredPackets, (uint64_t)kReplayPacketCount, @"Every packet should be delivered");
+    XCTAssertEqual([reader currentStats].batchCount, (uint64_t)((kReplayPacketCount + 511) / 512));
+    XCTAssertGreaterThanOrEqual(packetsPerSecond, kMinimumPacketsPerSecond,
+                                @"Batched replay should sustain at least 100k packets/s");
+}
+
+@end
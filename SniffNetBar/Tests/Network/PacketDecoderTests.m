@@ -0,0 +1,201 @@
+//
+//  PacketDecoderTests.m
+//  SniffNetBar
+//
+//  Hand-built frames for each link type and header chain the decoders
+//  understand, and truncations of them that must never read past the
+//  captured bytes
+//
+
+#import <XCTest/XCTest.h>
+#import "PacketDecoder.h"
+
+@interface PacketDecoderTests : XCTestCase
+@end
+
+@implementation PacketDecoderTests
+
+#pragma mark - Helpers
+
+static NSData *SNBDecoderTestFrame(NSString *hex) {
+    NSString *digits = [hex stringByReplacingOccurrencesOfString:@" " withString:@""];
+    NSMutableData *data = [NSMutableData dataWithCapacity:digits.length / 2];
+    for (NSUInteger i = 0; i + 1 < digits.length; i += 2) {
+        unsigned value = 0;
+        [[NSScanner scannerWithString:[digits substringWithRange:NSMakeRange(i, 2)]] scanHexInt:&value];
+        uint8_t byte = (uint8_t)value;
+        [data appendBytes:&byte length:1];
+    }
+    return data;
+}
+
+static BOOL SNBDecoderTestDecode(uint32_t linkType, NSData *frame, SNBPacketRecord *record) {
+    SNBPacketDecodeFunction decode = SNBPacketDecoderForLinkType(linkType);
+    if (!decode) {
+        return NO;
+    }
+    return decode(frame.bytes, (uint32_t)frame.length, (uint32_t)frame.length, 7, record);
+}
+
+static NSString *const kEthernetHeader = @"020000000001 020000000002";
+
+#pragma mark - Tests
+
+- (void)testEthernetIPv4TCP {
+    NSData *frame = SNBDecoderTestFrame([kEthernetHeader stringByAppendingString:
+        @"0800 4500002800000000400600000a000001 08080808 c0000050000000000000000050120000 00000000"]);
+    SNBPacketRecord record;
+    XCTAssertTrue(SNBDecoderTestDecode(SNB_LINKTYPE_ETHERNET, frame, &record));
+    XCTAssertEqual(record.family, SNBAddressFamilyIPv4);
+    XCTAssertEqual(record.ipProtocol, 6);
+    XCTAssertEqual(record.sourcePort, 49152);
+    XCTAssertEqual(record.destinationPort, 80);
+    XCTAssertEqual(record.tcpFlags, 0x12);
+    XCTAssertEqual(record.flags, SNBPacketRecordFlagHasPorts);
+    XCTAssertEqual(record.destinationAddress[0], 8);
+    XCTAssertEqual(record.length, frame.length);
+    XCTAssertEqual(record.timestampNs, 7u);
+    XCTAssertEqual(record.payloadOffset, 0, @"Ethernet padding is not payload");
+}
+
+- (void)testPayloadOffsetFollowsHeaders {
+    // Two VLAN tags, IPv4 and UDP, then four payload bytes
+    NSData *frame = SNBDecoderTestFrame([kEthernetHeader stringByAppendingString:
+        @"88a8 0064 8100 2007 0800 45000020000000004011000001020304 05060708 0035c350000c0000 deadbeef"]);
+    SNBPacketRecord record;
+    XCTAssertTrue(SNBDecoderTestDecode(SNB_LINKTYPE_ETHERNET, frame, &record));
+    XCTAssertEqual(record.payloadOffset, 50);
+    XCTAssertEqual(((const uint8_t *)frame.bytes)[record.payloadOffset], 0xde);
+
+    // TCP options count as header
+    frame = SNBDecoderTestFrame([kEthernetHeader stringByAppendingString:
+        @"0800 4500002d00000000400600000a000001 08080808 c0000050000000000000000060180000 00000000 020405b4 41"]);
+    XCTAssertTrue(SNBDecoderTestDecode(SNB_LINKTYPE_ETHERNET, frame, &record));
+    XCTAssertEqual(record.payloadOffset, 14 + 20 + 24);
+}
+
+- (void)testStackedVLANTagsKeepTheOuterID {
+    NSData *frame = SNBDecoderTestFrame([kEthernetHeader stringByAppendingString:
+        @"88a8 0064 8100 2007 0800 4500001c000000004011000001020304 05060708 1f90005000080000"]);
+    SNBPacketRecord record;
+    XCTAssertTrue(SNBDecoderTestDecode(SNB_LINKTYPE_ETHERNET, frame, &record));
+    XCTAssertEqual(record.flags & SNBPacketRecordFlagVLAN, SNBPacketRecordFlagVLAN);
+    XCTAssertEqual(record.vlanID, 100);
+    XCTAssertEqual(record.ipProtocol, 17);
+    XCTAssertEqual(record.sourcePort, 8080);
+}
+
+- (void)testPPPoESession {
+    NSData *frame = SNBDecoderTestFrame([kEthernetHeader stringByAppendingString:
+        @"8864 1100000100200021 4500001c000000004011000001020304 05060708 1f90005000080000"]);
+    SNBPacketRecord record;
+    XCTAssertTrue(SNBDecoderTestDecode(SNB_LINKTYPE_ETHERNET, frame, &record));
+    XCTAssertEqual(record.family, SNBAddressFamilyIPv4);
+    XCTAssertEqual(record.destinationPort, 80);
+
+    // Discovery frames are not IP
+    frame = SNBDecoderTestFrame([kEthernetHeader stringByAppendingString:@"8863 1109000000000000"]);
+    XCTAssertTrue(SNBDecoderTestDecode(SNB_LINKTYPE_ETHERNET, frame, &record));
+    XCTAssertEqual(record.family, SNBAddressFamilyNone);
+}
+
+- (void)testIPv6ExtensionHeaders {
+    // Hop-by-hop, then destination options, then TCP
+    NSData *frame = SNBDecoderTestFrame([kEthernetHeader stringByAppendingString:
+        @"86dd 6000000000240040 fd000000000000000000000000000001 fd000000000000000000000000000002"
+        @"3c00000000000000 0600000000000000 c0000050000000000000000050020000 00000000"]);
+    SNBPacketRecord record;
+    XCTAssertTrue(SNBDecoderTestDecode(SNB_LINKTYPE_ETHERNET, frame, &record));
+    XCTAssertEqual(record.family, SNBAddressFamilyIPv6);
+    XCTAssertEqual(record.ipProtocol, 6);
+    XCTAssertEqual(record.destinationPort, 80);
+    XCTAssertEqual(record.tcpFlags, 0x02);
+}
+
+- (void)testFragmentsCarryPortsOnlyWhenFirst {
+    NSString *first = [kEthernetHeader stringByAppendingString:
+        @"86dd 6000000000102c40 fd000000000000000000000000000001 fd000000000000000000000000000002"
+        @"1100000100000001 0035003500080000"];
+    SNBPacketRecord record;
+    XCTAssertTrue(SNBDecoderTestDecode(SNB_LINKTYPE_ETHERNET, SNBDecoderTestFrame(first), &record));
+    XCTAssertEqual(record.flags, SNBPacketRecordFlagFragment | SNBPacketRecordFlagHasPorts);
+    XCTAssertEqual(record.ipProtocol, 17);
+
+    // The same fragment header with offset 185
+    NSString *later = [first stringByReplacingOccurrencesOfString:@"1100000100000001" withString:@"110005c800000001"];
+    XCTAssertTrue(SNBDecoderTestDecode(SNB_LINKTYPE_ETHERNET, SNBDecoderTestFrame(later), &record));
+    XCTAssertEqual(record.flags, SNBPacketRecordFlagFragment);
+    XCTAssertEqual(record.ipProtocol, 17);
+    XCTAssertEqual(record.sourcePort, 0);
+
+    // An IPv4 fragment at offset 113
+    NSData *ipv4 = SNBDecoderTestFrame([kEthernetHeader stringByAppendingString:
+        @"0800 450000200000007140010000c0a80001 c0a80002 0800000000000000"]);
+    XCTAssertTrue(SNBDecoderTestDecode(SNB_LINKTYPE_ETHERNET, ipv4, &record));
+    XCTAssertEqual(record.flags, SNBPacketRecordFlagFragment);
+    XCTAssertEqual(record.ipProtocol, 1);
+}
+
+- (void)testICMPv6 {
+    NSData *frame = SNBDecoderTestFrame([kEthernetHeader stringByAppendingString:
+        @"86dd 6000000000083aff fe800000000000000000000000000001 ff0200000000000000000001ff000002"
+        @"8700000000000000"]);
+    SNBPacketRecord record;
+    XCTAssertTrue(SNBDecoderTestDecode(SNB_LINKTYPE_ETHERNET, frame, &record));
+    XCTAssertEqual(record.ipProtocol, 58);
+    XCTAssertEqual(record.flags, SNBPacketRecordFlagHasICMP);
+    XCTAssertEqual(record.icmpType, 135);
+    XCTAssertEqual(record.icmpCode, 0);
+}
+
+- (void)testLoopbackRawAndCookedLinkTypes {
+    NSString *ipv4 = @"4500001c000000004011000001020304 05060708 1f90005000080000";
+    SNBPacketRecord record;
+
+    // utun on macOS: host byte order AF_INET6
+    NSData *null6 = SNBDecoderTestFrame(@"1e000000 6000000000080640 fd000000000000000000000000000001"
+                                        @"fd000000000000000000000000000002 0000000000000000");
+    XCTAssertTrue(SNBDecoderTestDecode(SNB_LINKTYPE_NULL, null6, &record));
+    XCTAssertEqual(record.family, SNBAddressFamilyIPv6);
+    XCTAssertTrue(SNBDecoderTestDecode(SNB_LINKTYPE_LOOP,
+                                       SNBDecoderTestFrame([@"00000002" stringByAppendingString:ipv4]), &record));
+    XCTAssertEqual(record.family, SNBAddressFamilyIPv4);
+    XCTAssertEqual(record.sourcePort, 8080);
+
+    for (NSNumber *linkType in @[@(SNB_LINKTYPE_DLT_RAW), @(SNB_LINKTYPE_RAW), @(SNB_LINKTYPE_IPV4)]) {
+        XCTAssertTrue(SNBDecoderTestDecode(linkType.unsignedIntValue, SNBDecoderTestFrame(ipv4), &record));
+        XCTAssertEqual(record.family, SNBAddressFamilyIPv4);
+    }
+    XCTAssertTrue(SNBDecoderTestDecode(SNB_LINKTYPE_LINUX_SLL,
+        SNBDecoderTestFrame([@"00000001000600000000000000000800" stringByAppendingString:ipv4]), &record));
+    XCTAssertEqual(record.destinationPort, 80);
+    XCTAssertTrue(SNBDecoderTestDecode(SNB_LINKTYPE_LINUX_SLL2,
+        SNBDecoderTestFrame([@"08000000000000010001060000000000 00000000" stringByAppendingString:ipv4]), &record));
+    XCTAssertEqual(record.destinationPort, 80);
+
+    // 802.11 radiotap is not decoded
+    XCTAssertTrue(SNBPacketDecoderForLinkType(127) == NULL);
+}
+
+- (void)testTruncatedFramesStayInBounds {
+    NSData *frame = SNBDecoderTestFrame([kEthernetHeader stringByAppendingString:
+        @"88a8 0064 8100 0007 86dd 6000000000240040 fd000000000000000000000000000001"
+        @"fd000000000000000000000000000002 3c00000000000000 0600000000000000"
+        @"c0000050000000000000000050020000 00000000"]);
+    for (NSUInteger length = 0; length <= frame.length; length++) {
+        // An exact-size copy, so a read past the end trips the address sanitizer
+        uint8_t *bytes = malloc(length ? length : 1);
+        memcpy(bytes, frame.bytes, length);
+        SNBPacketRecord record;
+        BOOL decoded = SNBPacketDecodeEthernet(bytes, (uint32_t)length, (uint32_t)frame.length, 0, &record);
+        free(bytes);
+        XCTAssertEqual(decoded, length > 14);
+        if (decoded) {
+            // Ports need the whole 20-byte TCP header at offset 78
+            XCTAssertEqual((record.flags & SNBPacketRecordFlagHasPorts) != 0, length >= 98);
+            XCTAssertEqual(record.vlanID, length >= 18 ? 100 : 0);
+        }
+    }
+}
+
+@end
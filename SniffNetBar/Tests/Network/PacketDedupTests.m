@@ -0,0 +1,97 @@
+//
+//  PacketDedupTests.m
+//  SniffNetBar
+//
+//  Packets captured on two interfaces at once are counted on one of them
+//
+
+#import <XCTest/XCTest.h>
+#import "PacketDedup.h"
+
+static const uint64_t kDedupTestStartNs = 1700000000ULL * 1000000000ULL;
+
+@interface PacketDedupTests : XCTestCase
+@end
+
+@implementation PacketDedupTests
+
+#pragma mark - Helpers
+
+// TCP from 10.8.0.2 to 1.1.1.1:443, as a VPN tunnel and its underlay both show it
+static SNBPacketRecord SNBDedupTestRecord(uint8_t interfaceIndex, uint64_t offsetNs, uint16_t sourcePort) {
+    SNBPacketRecord record;
+    memset(&record, 0, sizeof(record));
+    record.timestampNs = kDedupTestStartNs + offsetNs;
+    record.length = 100;
+    record.family = SNBAddressFamilyIPv4;
+    record.ipProtocol = 6;
+    record.flags = SNBPacketRecordFlagHasPorts;
+    const uint8_t source[4] = {10, 8, 0, 2};
+    const uint8_t destination[4] = {1, 1, 1, 1};
+    memcpy(record.sourceAddress, source, 4);
+    memcpy(record.destinationAddress, destination, 4);
+    record.sourcePort = sourcePort;
+    record.destinationPort = 443;
+    record.interfaceIndex = interfaceIndex;
+    return record;
+}
+
+#pragma mark - Tests
+
+- (void)testCopiesOnASecondInterfaceAreDropped {
+    SNBPacketDedup dedup;
+    XCTAssertTrue(SNBPacketDedupInit(&dedup, 0, 16));
+    SNBPacketRecord records[] = {
+        SNBDedupTestRecord(1, 0, 50000),
+        SNBDedupTestRecord(2, 20000, 50000),
+        SNBDedupTestRecord(1, 1000000, 50000),
+        SNBDedupTestRecord(2, 1020000, 50000),
+        // A different flow first seen on the other interface belongs to it
+        SNBDedupTestRecord(2, 2000000, 50001),
+        SNBDedupTestRecord(1, 2020000, 50001),
+    };
+    size_t kept = SNBPacketDedupFilter(&dedup, records, 6);
+    XCTAssertEqual(kept, 3u);
+    XCTAssertEqual(dedup.duplicates, 3u);
+    XCTAssertEqual(records[0].interfaceIndex, 1);
+    XCTAssertEqual(records[1].interfaceIndex, 1);
+    XCTAssertEqual(records[2].interfaceIndex, 2);
+    XCTAssertEqual(records[2].sourcePort, 50001);
+
+    // A copy delivered late by a slower session still matches
+    SNBPacketRecord late = SNBDedupTestRecord(2, 500000, 50000);
+    XCTAssertEqual(SNBPacketDedupFilter(&dedup, &late, 1), 0u);
+    SNBPacketDedupDestroy(&dedup);
+}
+
+- (void)testQuietFlowsMoveToTheNewInterface {
+    SNBPacketDedup dedup;
+    XCTAssertTrue(SNBPacketDedupInit(&dedup, 0, 16));
+    SNBPacketRecord first = SNBDedupTestRecord(1, 0, 50000);
+    XCTAssertEqual(SNBPacketDedupFilter(&dedup, &first, 1), 1u);
+
+    // Wi-Fi to Ethernet: the flow reappears after the window on interface 2
+    SNBPacketRecord moved = SNBDedupTestRecord(2, SNB_PACKET_DEDUP_DEFAULT_WINDOW_NS + 1, 50000);
+    XCTAssertEqual(SNBPacketDedupFilter(&dedup, &moved, 1), 1u);
+    SNBPacketRecord stale = SNBDedupTestRecord(1, SNB_PACKET_DEDUP_DEFAULT_WINDOW_NS + 2, 50000);
+    XCTAssertEqual(SNBPacketDedupFilter(&dedup, &stale, 1), 0u);
+
+    // Idle flows are forgotten as capture time moves on
+    SNBPacketRecord later = SNBDedupTestRecord(3, 10 * SNB_PACKET_DEDUP_DEFAULT_WINDOW_NS, 50002);
+    SNBPacketDedupFilter(&dedup, &later, 1);
+    XCTAssertEqual(SNBFlowTableCount(dedup.flows), 1u);
+    SNBPacketDedupDestroy(&dedup);
+}
+
+- (void)testRecordsWithoutAddressesAreKept {
+    SNBPacketDedup dedup;
+    XCTAssertTrue(SNBPacketDedupInit(&dedup, 0, 16));
+    SNBPacketRecord records[2];
+    memset(records, 0, sizeof(records));
+    records[0].interfaceIndex = 1;
+    records[1].interfaceIndex = 2;
+    XCTAssertEqual(SNBPacketDedupFilter(&dedup, records, 2), 2u);
+    SNBPacketDedupDestroy(&dedup);
+}
+
+@end
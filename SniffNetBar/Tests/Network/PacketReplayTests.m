@@ -0,0 +1,190 @@
+//
+//  PacketReplayTests.m
+//  SniffNetBar
+//
+//  Offline replay through the capture manager's batch path
+//
+
+#import <XCTest/XCTest.h>
+#import <stdatomic.h>
+#import "PacketCaptureManager.h"
+#import "PacketBatch.h"
+#import "PcapFileReader.h"
+#import "CaptureStats.h"
+#import "TrafficStatistics.h"
+
+static const uint64_t kReplayStartNs = 1700000000ULL * 1000000000ULL;
+
+@interface PacketReplayTests : XCTestCase
+@property (nonatomic, copy) NSString *capturePath;
+@end
+
+@implementation PacketReplayTests
+
+- (void)setUp {
+    [super setUp];
+    self.capturePath = [NSTemporaryDirectory() stringByAppendingPathComponent:
+                        [NSString stringWithFormat:@"snb-replay-%@.pcapng", [NSUUID UUID].UUIDString]];
+}
+
+- (void)tearDown {
+    [[NSFileManager defaultManager] removeItemAtPath:self.capturePath error:nil];
+    self.capturePath = nil;
+    [super tearDown];
+}
+
+#pragma mark - Helpers
+
+// pcapng with one nanosecond-resolution Ethernet interface. Every packet is a
+// TCP segment from 192.168.1.10 to one of four public hosts.
+- (void)writeCaptureWithPacketCount:(NSUInteger)count startNs:(uint64_t)startNs spacingNs:(uint64_t)spacingNs {
+    FILE *file = fopen(self.capturePath.fileSystemRepresentation, "wb");
+    XCTAssertTrue(file != NULL, @"Should create capture file");
+
+    uint32_t section[7] = { 0x0a0d0d0a, 28, 0x1a2b3c4d, 0x00000001, 0xffffffff, 0xffffffff, 28 };
+    uint32_t interface[7] = { 0x00000001, 28, SNB_PCAP_LINKTYPE_ETHERNET, 65535, 0x00010009, 9, 28 };
+    fwrite(section, sizeof(section), 1, file);
+    fwrite(interface, sizeof(interface), 1, file);
+
+    uint8_t frame[56] = {0};
+    frame[12] = 0x08; // EtherType IPv4
+    frame[14] = 0x45; // Version 4, IHL 5
+    frame[22] = 64;   // TTL
+    frame[23] = 6;    // TCP
+    frame[26] = 192; frame[27] = 168; frame[28] = 1; frame[29] = 10;
+    frame[30] = 93;  frame[31] = 184; frame[32] = 216;
+    frame[36] = 0x01; frame[37] = 0xbb; // Port 443
+    frame[46] = 0x50; // Data offset 5
+
+    for (NSUInteger i = 0; i < count; i++) {
+        frame[33] = (uint8_t)(i % 4);
+        uint16_t srcPort = (uint16_t)(49152 + (i % 4));
+        frame[34] = (uint8_t)(srcPort >> 8); frame[35] = (uint8_t)srcPort;
+
+        uint64_t timestampNs = startNs + i * spacingNs;
+        uint32_t block[7] = { 0x00000006, 32 + sizeof(frame), 0, (uint32_t)(timestampNs >> 32),
+                              (uint32_t)timestampNs, sizeof(frame), 100 };
+        uint32_t trailer = block[1];
+        fwrite(block, sizeof(block), 1, file);
+        fwrite(frame, sizeof(frame), 1, file);
+        fwrite(&trailer, sizeof(trailer), 1, file);
+    }
+    fclose(file);
+}
+
+- (PacketCaptureManager *)replayManagerFinishing:(XCTestExpectation *)finished
+                                      finalStats:(NSMutableArray<SNBCaptureStats *> *)finalStats {
+    PacketCaptureManager *manager = [[PacketCaptureManager alloc] init];
+    manager.onReplayFinished = ^(SNBCaptureStats *stats) {
+        [finalStats addObject:stats];
+        [finished fulfill];
+    };
+    return manager;
+}
+
+#pragma mark - Replay
+
+- (void)testFastReplayDeliversEveryPacketWithItsCaptureTime {
+    const NSUInteger count = 5000;
+    [self writeCaptureWithPacketCount:count startNs:kReplayStartNs spacingNs:1000000];
+
+    XCTestExpectation *finished = [self expectationWithDescription:@"Replay finished"];
+    NSMutableArray<SNBCaptureStats *> *finishedStats = [NSMutableArray array];
+    PacketCaptureManager *manager = [self replayManagerFinishing:finished finalStats:finishedStats];
+
+    __block NSUInteger delivered = 0;
+    __block NSUInteger outgoing = 0;
+    __block uint64_t previousNs = 0;
+    __block BOOL ordered = YES;
+    manager.onPacketBatchReceived = ^(SNBPacketBatch *batch, SNBCaptureStats *stats) {
+        for (NSUInteger i = 0; i < batch.count; i++) {
+            const SNBPacketRecord *record = &batch.records[i];
+            ordered = ordered && record->timestampNs == kReplayStartNs + (delivered + i) * 1000000;
+            outgoing += (record->flags & SNBPacketRecordFlagOutgoing) ? 1 : 0;
+            previousNs = record->timestampNs;
+        }
+        delivered += batch.count;
+    };
+
+    NSError *error = nil;
+    XCTAssertTrue([manager startReplayFromFile:self.capturePath
+                                        timing:SNBReplayTimingAsFastAsPossible
+                                localAddresses:@[@"192.168.1.10"]
+                                         error:&error], @"%@", error);
+    [self waitForExpectationsWithTimeout:10.0 handler:nil];
+
+    XCTAssertEqual(delivered, count);
+    XCTAssertTrue(ordered, @"Records should carry the capture timestamps in file order");
+    XCTAssertEqual(previousNs, kReplayStartNs + (count - 1) * 1000000);
+    XCTAssertEqual(outgoing, count, @"Direction should be tagged against the replay's local addresses");
+    XCTAssertEqual(finishedStats.firstObject.packetsReceived, (uint64_t)count);
+    XCTAssertEqual(finishedStats.firstObject.packetsDelivered, (uint64_t)count);
+    XCTAssertEqual(finishedStats.firstObject.packetsUndecoded, (uint64_t)0);
+}
+
+- (void)testOriginalTimingPacesDelivery {
+    // Eleven packets half a second of capture time apart
+    [self writeCaptureWithPacketCount:11 startNs:kReplayStartNs spacingNs:50 * NSEC_PER_MSEC];
+
+    XCTestExpectation *finished = [self expectationWithDescription:@"Replay finished"];
+    NSMutableArray<SNBCaptureStats *> *finishedStats = [NSMutableArray array];
+    PacketCaptureManager *manager = [self replayManagerFinishing:finished finalStats:finishedStats];
+    __block atomic_uint batches = 0;
+    manager.onPacketBatchReceived = ^(SNBPacketBatch *batch, SNBCaptureStats *stats) {
+        atomic_fetch_add(&batches, 1);
+    };
+
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    XCTAssertTrue([manager startReplayFromFile:self.capturePath
+                                        timing:SNBReplayTimingOriginal
+                                localAddresses:@[@"192.168.1.10"]
+                                         error:nil]);
+    [self waitForExpectationsWithTimeout:10.0 handler:nil];
+    CFTimeInterval elapsed = CFAbsoluteTimeGetCurrent() - start;
+
+    XCTAssertGreaterThanOrEqual(elapsed, 0.45, @"Replay should take as long as the capture did");
+    XCTAssertEqual(finishedStats.firstObject.packetsDelivered, (uint64_t)11);
+    XCTAssertGreaterThan(atomic_load(&batches), 1u, @"Packets should arrive as they become due, not in one batch");
+}
+
+- (void)testStatisticsRunOnCaptureTime {
+    // Captured an hour ago: on wall time every connection would already be idle
+    uint64_t startNs = (uint64_t)(([NSDate date].timeIntervalSince1970 - 3600) * 1e9);
+    [self writeCaptureWithPacketCount:800 startNs:startNs spacingNs:1000000];
+
+    XCTestExpectation *finished = [self expectationWithDescription:@"Replay finished"];
+    NSMutableArray<SNBCaptureStats *> *finishedStats = [NSMutableArray array];
+    PacketCaptureManager *manager = [self replayManagerFinishing:finished finalStats:finishedStats];
+    TrafficStatistics *statistics = [[TrafficStatistics alloc] init];
+    manager.onPacketBatchReceived = ^(SNBPacketBatch *batch, SNBCaptureStats *stats) {
+        [statistics processPacketBatch:batch];
+    };
+
+    XCTAssertTrue([manager startReplayFromFile:self.capturePath
+                                        timing:SNBReplayTimingAsFastAsPossible
+                                localAddresses:@[@"192.168.1.10"]
+                                         error:nil]);
+    [self waitForExpectationsWithTimeout:10.0 handler:nil];
+
+    TrafficStats *stats = [statistics getCurrentStats];
+    XCTAssertEqual(stats.totalPackets, (uint64_t)800);
+    XCTAssertEqual(stats.topConnections.count, (NSUInteger)4, @"Connections idle only in wall time should be kept");
+    CFAbsoluteTime lastCaptured = (double)(startNs + 799 * 1000000) / 1e9 - kCFAbsoluteTimeIntervalSince1970;
+    for (ConnectionTraffic *connection in stats.topConnections) {
+        XCTAssertEqualWithAccuracy(connection.lastActivity, lastCaptured, 0.005,
+                                   @"Activity should be the capture time of the connection's last packet");
+    }
+}
+
+- (void)testMissingFileFails {
+    PacketCaptureManager *manager = [[PacketCaptureManager alloc] init];
+    NSError *error = nil;
+    XCTAssertFalse([manager startReplayFromFile:@"/nonexistent/capture.pcap"
+                                         timing:SNBReplayTimingAsFastAsPossible
+                                 localAddresses:nil
+                                          error:&error]);
+    XCTAssertEqualObjects(error.domain, @"PacketCaptureError");
+    XCTAssertEqual(error.code, 4);
+}
+
+@end
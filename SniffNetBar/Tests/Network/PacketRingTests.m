@@ -0,0 +1,147 @@
+//
+//  PacketRingTests.m
+//  SniffNetBar
+//
+//  Tests for the shared-memory packet ring
+//
+
+#import <XCTest/XCTest.h>
+#import "PacketRing.h"
+#import "PacketInfo.h"
+
+@interface PacketRingTests : XCTestCase
+@property (nonatomic, assign) int memoryFD;
+@property (nonatomic, assign) SNBPacketRing *producer;
+@property (nonatomic, assign) SNBPacketRing *consumer;
+@end
+
+@implementation PacketRingTests
+
+- (void)setUp {
+    [super setUp];
+    self.memoryFD = SNBPacketRingCreateSharedMemory(SNB_PACKET_RING_MIN_CAPACITY);
+    XCTAssertGreaterThanOrEqual(self.memoryFD, 0, @"Should create shared memory");
+    self.producer = SNBPacketRingCreateProducer(self.memoryFD, SNB_PACKET_RING_MIN_CAPACITY);
+    self.consumer = SNBPacketRingAttachConsumer(self.memoryFD);
+    XCTAssertTrue(self.producer != NULL && self.consumer != NULL, @"Both sides should map the ring");
+}
+
+- (void)tearDown {
+    SNBPacketRingDestroy(self.consumer);
+    SNBPacketRingDestroy(self.producer);
+    close(self.memoryFD);
+    [super tearDown];
+}
+
+#pragma mark - Helpers
+
+- (void)produceRecords:(NSUInteger)count {
+    for (NSUInteger i = 0; i < count; i++) {
+        SNBPacketRecord *slot = SNBPacketRingClaim(self.producer);
+        if (!slot) {
+            continue;
+        }
+        memset(slot, 0, sizeof(*slot));
+        slot->length = (uint32_t)(100 + i);
+        slot->family = SNBAddressFamilyIPv4;
+        slot->ipProtocol = 6;
+        slot->flags = SNBPacketRecordFlagHasPorts;
+        slot->sourcePort = 50000;
+        slot->destinationPort = 443;
+        uint8_t source[4] = {10, 0, 0, 1};
+        uint8_t destination[4] = {1, 1, 1, 1};
+        memcpy(slot->sourceAddress, source, 4);
+        memcpy(slot->destinationAddress, destination, 4);
+        SNBPacketRingCommit(self.producer);
+    }
+    SNBPacketRingPublish(self.producer);
+}
+
+- (NSUInteger)consumeAll {
+    NSUInteger total = 0;
+    size_t count = 0;
+    do {
+        SNBPacketRingPeek(self.consumer, &count);
+        SNBPacketRingRelease(self.consumer, count);
+        total += count;
+    } while (count > 0);
+    return total;
+}
+
+#pragma mark - Layout
+
+- (void)testRecordLayoutIsStable {
+    XCTAssertEqual(sizeof(SNBPacketRecord), 64);
+    XCTAssertEqual(offsetof(SNBPacketRecord, timestampNs), 0);
+    XCTAssertEqual(offsetof(SNBPacketRecord, length), 8);
+    XCTAssertEqual(offsetof(SNBPacketRecord, sourcePort), 12);
+    XCTAssertEqual(offsetof(SNBPacketRecord, family), 16);
+    XCTAssertEqual(offsetof(SNBPacketRecord, sourceAddress), 24);
+    XCTAssertEqual(offsetof(SNBPacketRecord, destinationAddress), 40);
+}
+
+- (void)testCapacityIsNormalized {
+    XCTAssertEqual(SNBPacketRingNormalizeCapacity(0), SNB_PACKET_RING_MIN_CAPACITY);
+    XCTAssertEqual(SNBPacketRingNormalizeCapacity(5000), 8192u);
+    XCTAssertEqual(SNBPacketRingNormalizeCapacity(UINT32_MAX), SNB_PACKET_RING_MAX_CAPACITY);
+}
+
+#pragma mark - Transport
+
+- (void)testRecordsArriveInPlaceAndFormatAtBoundary {
+    [self produceRecords:3];
+
+    size_t count = 0;
+    const SNBPacketRecord *records = SNBPacketRingPeek(self.consumer, &count);
+    XCTAssertEqual(count, 3);
+    XCTAssertEqual(records[2].length, 102u);
+
+    PacketInfo *info = [PacketInfo packetInfoWithRecord:&records[0]];
+    XCTAssertEqualObjects(info.sourceAddress, @"10.0.0.1");
+    XCTAssertEqualObjects(info.destinationAddress, @"1.1.1.1");
+    XCTAssertEqual(info.protocol, PacketProtocolTCP);
+    XCTAssertEqual(info.destinationPort, 443);
+    SNBPacketRingRelease(self.consumer, count);
+
+    SNBPacketRingStats stats = SNBPacketRingGetStats(self.consumer);
+    XCTAssertEqual(stats.produced, 3ULL);
+    XCTAssertEqual(stats.consumed, 3ULL);
+    XCTAssertEqual(stats.lag, 0ULL);
+}
+
+- (void)testOverflowIsCountedAsDrops {
+    NSUInteger offered = SNB_PACKET_RING_MIN_CAPACITY + 100;
+    [self produceRecords:offered];
+
+    SNBPacketRingStats stats = SNBPacketRingGetStats(self.consumer);
+    XCTAssertEqual(stats.dropped, 100ULL, @"Records beyond capacity should be dropped, not overwrite");
+    XCTAssertEqual(stats.lag, (uint64_t)SNB_PACKET_RING_MIN_CAPACITY);
+
+    XCTAssertEqual([self consumeAll], (NSUInteger)SNB_PACKET_RING_MIN_CAPACITY);
+    [self produceRecords:10];
+    XCTAssertEqual([self consumeAll], 10, @"Ring should accept records again once drained");
+}
+
+- (void)testWakeupOnlyWhenConsumerParked {
+    [self produceRecords:1];
+    XCTAssertFalse(SNBPacketRingPrepareToWait(self.consumer), @"Pending records should prevent parking");
+    [self consumeAll];
+
+    XCTAssertTrue(SNBPacketRingPrepareToWait(self.consumer));
+    SNBPacketRecord *slot = SNBPacketRingClaim(self.producer);
+    memset(slot, 0, sizeof(*slot));
+    SNBPacketRingCommit(self.producer);
+    XCTAssertTrue(SNBPacketRingPublish(self.producer), @"Parked consumer should be woken");
+
+    XCTAssertTrue(SNBPacketRingClaim(self.producer) != NULL);
+    SNBPacketRingCommit(self.producer);
+    XCTAssertFalse(SNBPacketRingPublish(self.producer), @"Wakeup should be sent once per park");
+}
+
+- (void)testAttachRejectsForeignMapping {
+    int fd = SNBPacketRingCreateSharedMemory(SNB_PACKET_RING_MIN_CAPACITY);
+    XCTAssertTrue(SNBPacketRingAttachConsumer(fd) == NULL, @"Uninitialized mapping should be rejected");
+    close(fd);
+}
+
+@end
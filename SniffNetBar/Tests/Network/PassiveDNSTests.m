@@ -0,0 +1,297 @@
+//
+//  PassiveDNSTests.m
+//  SniffNetBar
+//
+//  Address -> name bindings learned from replayed DNS responses
+//
+
+#import <XCTest/XCTest.h>
+#import <stdatomic.h>
+#import "DNSStubServer.h"
+#import "DNSMessage.h"
+#import "PacketDecoder.h"
+#import "PassiveDNS.h"
+#import "PassiveDNSCache.h"
+
+static const uint64_t kCaptureStartNs = 1700000000ULL * 1000000000ULL;
+
+@interface PassiveDNSTests : XCTestCase
+@end
+
+@implementation PassiveDNSTests
+
+#pragma mark - Helpers
+
+// Ethernet, IPv4 and UDP or TCP headers around payload
+static NSData *SNBTestFrame(const uint8_t source[4], const uint8_t destination[4], uint8_t protocol,
+                            uint16_t sourcePort, uint16_t destinationPort, NSData *payload) {
+    uint32_t transportLength = protocol == 17 ? 8 : 20;
+    uint32_t ipLength = 20 + transportLength + (uint32_t)payload.length;
+    NSMutableData *frame = [NSMutableData dataWithLength:14 + 20 + transportLength];
+    uint8_t *bytes = frame.mutableBytes;
+    bytes[12] = 0x08;                    // EtherType IPv4
+    bytes[14] = 0x45;
+    bytes[16] = (uint8_t)(ipLength >> 8);
+    bytes[17] = (uint8_t)ipLength;
+    bytes[22] = 64;
+    bytes[23] = protocol;
+    memcpy(bytes + 26, source, 4);
+    memcpy(bytes + 30, destination, 4);
+    uint8_t *transport = bytes + 34;
+    transport[0] = (uint8_t)(sourcePort >> 8);
+    transport[1] = (uint8_t)sourcePort;
+    transport[2] = (uint8_t)(destinationPort >> 8);
+    transport[3] = (uint8_t)destinationPort;
+    if (protocol == 17) {
+        transport[4] = (uint8_t)((8 + payload.length) >> 8);
+        transport[5] = (uint8_t)(8 + payload.length);
+    } else {
+        transport[12] = 0x50;            // Data offset 5
+        transport[13] = 0x02;            // SYN
+    }
+    [frame appendData:payload];
+    return frame;
+}
+
+static void SNBTestAddress(NSUInteger index, uint8_t address[4]) {
+    address[0] = 93;
+    address[1] = (uint8_t)(index >> 16);
+    address[2] = (uint8_t)(index >> 8);
+    address[3] = (uint8_t)index;
+}
+
+static size_t SNBTestObserve(SNBPassiveDNSTable *table, NSData *frame, uint32_t capturedLength, uint64_t timestampNs) {
+    SNBPacketRecord record;
+    if (!SNBPacketDecodeEthernet(frame.bytes, capturedLength, (uint32_t)frame.length, timestampNs, &record)) {
+        return 0;
+    }
+    return SNBPassiveDNSObserve(table, &record, frame.bytes, capturedLength);
+}
+
+// A capture where every connection follows the lookup of its site, the way
+// a browser makes them. Returns the fraction of connections whose
+// destination is named after the site that was looked up.
+- (double)replayLookupsForHostCount:(NSUInteger)hostCount
+                         tableCapacity:(uint32_t)capacity
+                                 stats:(SNBPassiveDNSStats *)stats
+                        nsPerResponse:(double *)nsPerResponse {
+    const uint8_t client[4] = {192, 168, 1, 10};
+    const uint8_t resolver[4] = {192, 168, 1, 1};
+    NSMutableArray<NSData *> *responses = [NSMutableArray arrayWithCapacity:hostCount];
+    NSMutableArray<NSData *> *connections = [NSMutableArray arrayWithCapacity:hostCount];
+    for (NSUInteger i = 0; i < hostCount; i++) {
+        uint8_t address[4];
+        SNBTestAddress(i, address);
+        NSData *message = [DNSStubServer responseWithID:(uint16_t)i
+                                               question:[NSString stringWithFormat:@"site%lu.example", (unsigned long)i]
+                                                   type:SNBDNSTypeA
+                                                answers:@[[NSData dataWithBytes:address length:4]]
+                                                    ttl:300];
+        [responses addObject:SNBTestFrame(resolver, client, 17, SNB_DNS_PORT, (uint16_t)(40000 + i % 20000), message)];
+        [connections addObject:SNBTestFrame(client, address, 6, (uint16_t)(50000 + i % 10000), 443, [NSData data])];
+    }
+
+    SNBPassiveDNSTable *table = SNBPassiveDNSCreate(capacity);
+    XCTAssertTrue(table != NULL);
+    uint64_t timestampNs = kCaptureStartNs;
+    uint64_t learnNs = 0;
+    NSUInteger named = 0;
+    for (NSUInteger i = 0; i < hostCount; i++) {
+        timestampNs += 10 * NSEC_PER_MSEC;
+        NSData *response = responses[i];
+        uint64_t startNs = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+        XCTAssertEqual(SNBTestObserve(table, response, (uint32_t)response.length, timestampNs), 1u);
+        learnNs += clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - startNs;
+
+        // Connections a little later; the older ones are still open
+        NSUInteger flow = i >= 8 ? i - 8 : i;
+        SNBPacketRecord record;
+        NSData *connection = connections[flow];
+        XCTAssertTrue(SNBPacketDecodeEthernet(connection.bytes, (uint32_t)connection.length,
+                                              (uint32_t)connection.length, timestampNs, &record));
+        XCTAssertEqual(SNBTestObserve(table, connection, (uint32_t)connection.length, timestampNs), 0u);
+        char name[SNB_PASSIVE_DNS_MAX_NAME];
+        NSString *expected = [NSString stringWithFormat:@"site%lu.example", (unsigned long)flow];
+        if (SNBPassiveDNSLookup(table, record.family, record.destinationAddress, name, sizeof(name), timestampNs) &&
+            [@(name) isEqualToString:expected]) {
+            named++;
+        }
+    }
+
+    *stats = SNBPassiveDNSGetStats(table);
+    *nsPerResponse = (double)learnNs / hostCount;
+    SNBPassiveDNSDestroy(table);
+    return (double)named / hostCount;
+}
+
+#pragma mark - Tests
+
+- (void)testReplayedLookupsNameTheirConnections {
+    SNBPassiveDNSStats stats;
+    double nsPerResponse = 0;
+    double accuracy = [self replayLookupsForHostCount:20000
+                                        tableCapacity:SNB_PASSIVE_DNS_DEFAULT_CAPACITY * 2
+                                                stats:&stats
+                                        nsPerResponse:&nsPerResponse];
+    NSLog(@"%@: accuracy %.4f, %.0f ns per response, %llu of %u slots",
+          self.name, accuracy, nsPerResponse, (unsigned long long)stats.occupied, stats.capacity);
+    XCTAssertEqualWithAccuracy(accuracy, 1.0, 0.0001);
+    XCTAssertEqual(stats.responses, 20000u);
+    XCTAssertEqual(stats.stored, 20000u);
+    XCTAssertEqual(stats.truncated, 0u);
+    // Parsing and storing stays far below the cost of the packet it rode in on
+    XCTAssertLessThan(nsPerResponse, 5000.0);
+}
+
+- (void)testFullTableKeepsTheNewestBindings {
+    // Twice as many sites as slots: the oldest give way, recent ones survive
+    SNBPassiveDNSStats stats;
+    double nsPerResponse = 0;
+    double accuracy = [self replayLookupsForHostCount:SNB_PASSIVE_DNS_MIN_CAPACITY * 2
+                                        tableCapacity:SNB_PASSIVE_DNS_MIN_CAPACITY
+                                                stats:&stats
+                                        nsPerResponse:&nsPerResponse];
+    XCTAssertGreaterThan(accuracy, 0.95);
+    XCTAssertGreaterThan(stats.replaced, 0u);
+    XCTAssertLessThanOrEqual(stats.occupied, (uint64_t)SNB_PASSIVE_DNS_MIN_CAPACITY);
+}
+
+- (void)testAnswersNameTheQuestionAndOutrankPTRs {
+    SNBPassiveDNSTable *table = SNBPassiveDNSCreate(SNB_PASSIVE_DNS_MIN_CAPACITY);
+    const uint8_t address[16] = {0x20, 0x01, 0x0d, 0xb8, [15] = 0x01};
+    NSData *response = [DNSStubServer responseWithID:1
+                                            question:@"www.example.com"
+                                                type:SNBDNSTypeAAAA
+                                             answers:@[[NSData dataWithBytes:address length:16]]
+                                                 ttl:60];
+    XCTAssertEqual(SNBPassiveDNSLearn(table, response.bytes, response.length, kCaptureStartNs), 1u);
+    XCTAssertFalse(SNBPassiveDNSStore(table, SNBAddressFamilyIPv6, address, "edge-1.cdn.example", 3600,
+                                      SNBPassiveDNSSourceReverse, kCaptureStartNs));
+
+    char name[SNB_PASSIVE_DNS_MAX_NAME];
+    XCTAssertTrue(SNBPassiveDNSLookup(table, SNBAddressFamilyIPv6, address, name, sizeof(name), kCaptureStartNs));
+    XCTAssertEqualObjects(@(name), @"www.example.com");
+    // Short TTLs are stretched to the floor, then the binding expires
+    uint64_t laterNs = kCaptureStartNs + (uint64_t)(SNB_PASSIVE_DNS_MIN_TTL - 1) * NSEC_PER_SEC;
+    XCTAssertTrue(SNBPassiveDNSLookup(table, SNBAddressFamilyIPv6, address, name, sizeof(name), laterNs));
+    laterNs += 2 * NSEC_PER_SEC;
+    XCTAssertFalse(SNBPassiveDNSLookup(table, SNBAddressFamilyIPv6, address, name, sizeof(name), laterNs));
+
+    // Failed lookups bind nothing
+    NSMutableData *failure = [response mutableCopy];
+    ((uint8_t *)failure.mutableBytes)[3] |= SNBDNSRcodeNXDomain;
+    XCTAssertEqual(SNBPassiveDNSLearn(table, failure.bytes, failure.length, kCaptureStartNs), 0u);
+    SNBPassiveDNSDestroy(table);
+}
+
+- (void)testResponsesCutBySnapshotKeepWholeRecords {
+    SNBPassiveDNSTable *table = SNBPassiveDNSCreate(SNB_PASSIVE_DNS_MIN_CAPACITY);
+    const uint8_t client[4] = {192, 168, 1, 10};
+    const uint8_t resolver[4] = {192, 168, 1, 1};
+    const uint8_t first[4] = {203, 0, 113, 1};
+    const uint8_t second[4] = {203, 0, 113, 2};
+    NSData *message = [DNSStubServer responseWithID:7
+                                           question:@"mirror.example.org"
+                                               type:SNBDNSTypeA
+                                            answers:@[[NSData dataWithBytes:first length:4],
+                                                      [NSData dataWithBytes:second length:4]]
+                                                ttl:3600];
+    NSData *frame = SNBTestFrame(resolver, client, 17, SNB_DNS_PORT, 53000, message);
+
+    // The second answer loses its last bytes
+    XCTAssertEqual(SNBTestObserve(table, frame, (uint32_t)frame.length - 2, kCaptureStartNs), 1u);
+    SNBPassiveDNSStats stats = SNBPassiveDNSGetStats(table);
+    XCTAssertEqual(stats.truncated, 1u);
+    uint8_t address[16] = {203, 0, 113, 1};
+    XCTAssertTrue(SNBPassiveDNSLookup(table, SNBAddressFamilyIPv4, address, NULL, 0, kCaptureStartNs));
+    address[3] = 2;
+    XCTAssertFalse(SNBPassiveDNSLookup(table, SNBAddressFamilyIPv4, address, NULL, 0, kCaptureStartNs));
+
+    // Cut inside the UDP header: no payload, nothing parsed
+    XCTAssertEqual(SNBTestObserve(table, frame, 14 + 20 + 6, kCaptureStartNs), 0u);
+    SNBPassiveDNSDestroy(table);
+}
+
+- (void)testReadersNeverSeeHalfWrittenBindings {
+    int descriptor = SNBPassiveDNSCreateSharedMemory(SNB_PASSIVE_DNS_MIN_CAPACITY);
+    XCTAssertGreaterThanOrEqual(descriptor, 0);
+    SNBPassiveDNSTable *writer = SNBPassiveDNSCreateWriter(descriptor, SNB_PASSIVE_DNS_MIN_CAPACITY);
+    SNBPassiveDNSTable *reader = SNBPassiveDNSAttachReader(descriptor);
+    XCTAssertTrue(writer != NULL && reader != NULL);
+
+    // The writer keeps renaming 2048 addresses in a 1024-slot table; a name
+    // read for an address must always be one written for that address
+    const NSUInteger hostCount = 2048;
+    atomic_bool done = false;
+    atomic_ulong mismatches = 0;
+    atomic_ulong hits = 0;
+    atomic_bool *donePointer = &done;
+    atomic_ulong *mismatchesPointer = &mismatches;
+    atomic_ulong *hitsPointer = &hits;
+    dispatch_group_t group = dispatch_group_create();
+    for (int thread = 0; thread < 3; thread++) {
+        dispatch_group_async(group, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+            char name[SNB_PASSIVE_DNS_MAX_NAME];
+            while (!atomic_load(donePointer)) {
+                for (NSUInteger i = 0; i < hostCount; i++) {
+                    uint8_t address[16] = {0};
+                    SNBTestAddress(i, address);
+                    if (!SNBPassiveDNSLookup(reader, SNBAddressFamilyIPv4, address, name, sizeof(name), kCaptureStartNs)) {
+                        continue;
+                    }
+                    unsigned long host = 0;
+                    unsigned long round = 0;
+                    if (sscanf(name, "host%lu-%lu.example", &host, &round) != 2 || host != i) {
+                        atomic_fetch_add(mismatchesPointer, 1);
+                    }
+                    atomic_fetch_add(hitsPointer, 1);
+                }
+            }
+        });
+    }
+    for (NSUInteger round = 0; round < 100; round++) {
+        for (NSUInteger i = 0; i < hostCount; i++) {
+            uint8_t address[16] = {0};
+            SNBTestAddress(i, address);
+            char name[64];
+            snprintf(name, sizeof(name), "host%lu-%lu.example", (unsigned long)i, (unsigned long)round);
+            SNBPassiveDNSStore(writer, SNBAddressFamilyIPv4, address, name, (uint32_t)(600 + i), SNBPassiveDNSSourceAnswer,
+                               kCaptureStartNs - NSEC_PER_SEC);
+        }
+    }
+    atomic_store(&done, true);
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+
+    XCTAssertEqual(atomic_load(&mismatches), 0ul);
+    XCTAssertGreaterThan(atomic_load(&hits), 0ul);
+    SNBPassiveDNSDestroy(reader);
+    SNBPassiveDNSDestroy(writer);
+    close(descriptor);
+}
+
+- (void)testReplayNamesExpireOnTheCaptureClock {
+    // A capture from years ago still names its hosts while it is replayed
+    SNBPassiveDNSCache *cache = [SNBPassiveDNSCache sharedCache];
+    [cache beginReplay];
+    const uint8_t client[4] = {192, 168, 1, 10};
+    const uint8_t resolver[4] = {192, 168, 1, 1};
+    const uint8_t address[4] = {198, 51, 100, 7};
+    NSData *message = [DNSStubServer responseWithID:9
+                                           question:@"files.example.net"
+                                               type:SNBDNSTypeA
+                                            answers:@[[NSData dataWithBytes:address length:4]]
+                                                ttl:3600];
+    NSData *frame = SNBTestFrame(resolver, client, 17, SNB_DNS_PORT, 53001, message);
+    SNBPacketRecord record;
+    XCTAssertTrue(SNBPacketDecodeEthernet(frame.bytes, (uint32_t)frame.length, (uint32_t)frame.length,
+                                          kCaptureStartNs, &record));
+    [cache observeReplayRecord:&record frame:frame.bytes capturedLength:(uint32_t)frame.length];
+
+    XCTAssertEqualObjects([cache hostnameForAddress:@"198.51.100.7"], @"files.example.net");
+    XCTAssertNil([cache hostnameForAddress:@"198.51.100.8"]);
+    XCTAssertEqual(cache.statistics[@"stored"].unsignedIntegerValue, 1u);
+    [cache endReplay];
+    XCTAssertNil([cache hostnameForAddress:@"198.51.100.7"]);
+}
+
+@end
@@ -0,0 +1,164 @@
+//
+//  ReverseDNSResolverTests.m
+//  SniffNetBar
+//
+//  Reverse-DNS lookups against a local stub nameserver
+//
+
+#import <XCTest/XCTest.h>
+#import <poll.h>
+#import "DNSStubServer.h"
+#import "ReverseDNSResolver.h"
+#import "ReverseResolver.h"
+
+@interface ReverseDNSResolverTests : XCTestCase
+@property (nonatomic, strong) DNSStubServer *server;
+@property (nonatomic, strong) SNBReverseDNSResolver *resolver;
+@end
+
+@implementation ReverseDNSResolverTests
+
+- (void)setUp {
+    [super setUp];
+    self.server = [[DNSStubServer alloc] init];
+    XCTAssertNotNil(self.server, @"Should bind the stub nameserver");
+    self.resolver = [[SNBReverseDNSResolver alloc] initWithServers:@[@"127.0.0.1"] port:self.server.port];
+    XCTAssertNotNil(self.resolver);
+}
+
+- (void)tearDown {
+    [self.server stop];
+    [super tearDown];
+}
+
+#pragma mark - Helpers
+
+- (NSString *)resolve:(NSString *)address {
+    XCTestExpectation *expectation = [self expectationWithDescription:address];
+    __block NSString *result = nil;
+    [self.resolver resolveAddress:address completion:^(NSString *hostname) {
+        result = hostname;
+        [expectation fulfill];
+    }];
+    [self waitForExpectations:@[expectation] timeout:5.0];
+    return result;
+}
+
+#pragma mark - Tests
+
+- (void)testSlowAnswersOverlapAndShareQueriesPerAddress {
+    // Each answer takes 200ms; eight blocking lookups at a time would need 10s
+    self.server.responseDelay = 0.2;
+    NSUInteger addressCount = 400;
+    for (NSUInteger i = 0; i < addressCount; i++) {
+        NSString *address = [NSString stringWithFormat:@"10.0.%lu.%lu", (unsigned long)(i / 256), (unsigned long)(i % 256)];
+        [self.server setName:[NSString stringWithFormat:@"host-%lu.lan", (unsigned long)i] forAddress:address];
+    }
+
+    NSMutableArray<XCTestExpectation *> *expectations = [NSMutableArray array];
+    __block NSUInteger answered = 0;
+    NSDate *start = [NSDate date];
+    for (NSUInteger round = 0; round < 2; round++) {
+        for (NSUInteger i = 0; i < addressCount; i++) {
+            NSString *address = [NSString stringWithFormat:@"10.0.%lu.%lu", (unsigned long)(i / 256), (unsigned long)(i % 256)];
+            NSString *expected = [NSString stringWithFormat:@"host-%lu.lan", (unsigned long)i];
+            XCTestExpectation *expectation = [self expectationWithDescription:address];
+            [expectations addObject:expectation];
+            [self.resolver resolveAddress:address completion:^(NSString *hostname) {
+                if ([hostname isEqualToString:expected]) {
+                    answered++;
+                }
+                [expectation fulfill];
+            }];
+        }
+    }
+    [self waitForExpectations:expectations timeout:5.0];
+
+    XCTAssertEqual(answered, addressCount * 2);
+    XCTAssertLessThan([[NSDate date] timeIntervalSinceDate:start], 3.0);
+    XCTAssertEqual(self.server.queryCount, (NSInteger)addressCount, @"One query per address");
+    XCTAssertEqual(self.resolver.statistics[@"coalesced"].unsignedIntegerValue, addressCount);
+    XCTAssertEqual(self.resolver.statistics[@"pending"].unsignedIntegerValue, 0u);
+}
+
+- (void)testAnswersAndNegativeAnswersAreCached {
+    [self.server setName:@"printer.lan" forAddress:@"192.168.1.20"];
+    XCTAssertEqualObjects([self resolve:@"192.168.1.20"], @"printer.lan");
+    XCTAssertNil([self resolve:@"192.168.1.21"]);
+
+    XCTAssertEqualObjects([self resolve:@"192.168.1.20"], @"printer.lan");
+    XCTAssertNil([self resolve:@"192.168.1.21"]);
+    XCTAssertEqual(self.server.queryCount, 2);
+    NSDictionary<NSString *, NSNumber *> *statistics = self.resolver.statistics;
+    XCTAssertEqual(statistics[@"cacheHits"].unsignedIntegerValue, 2u);
+    XCTAssertEqual(statistics[@"negatives"].unsignedIntegerValue, 1u);
+}
+
+- (void)testIPv6AddressesUseNibbleNames {
+    [self.server setName:@"router.lan" forAddress:@"2001:db8::1"];
+    XCTAssertEqualObjects([self resolve:@"2001:db8::1"], @"router.lan");
+    XCTAssertEqualObjects([self resolve:@"2001:0db8:0000::0001"], @"router.lan");
+    XCTAssertEqual(self.server.queryCount, 1);
+}
+
+- (void)testCapturedAnswersFinishPendingLookups {
+    self.server.dropQueries = YES;
+    XCTestExpectation *expectation = [self expectationWithDescription:@"learned"];
+    __block NSString *result = nil;
+    [self.resolver resolveAddress:@"93.184.216.34" completion:^(NSString *hostname) {
+        result = hostname;
+        [expectation fulfill];
+    }];
+
+    // The answer to the browser's own lookup, as seen on the wire
+    const uint8_t address[4] = {93, 184, 216, 34};
+    NSData *response = [DNSStubServer responseWithID:0x1234
+                                            question:@"www.example.com"
+                                                type:SNBDNSTypeA
+                                             answers:@[[NSData dataWithBytes:address length:4]]
+                                                 ttl:300];
+    [self.resolver learnFromResponse:response];
+    [self waitForExpectations:@[expectation] timeout:1.0];
+
+    XCTAssertEqualObjects(result, @"www.example.com");
+    XCTAssertEqual(self.resolver.statistics[@"learned"].unsignedIntegerValue, 1u);
+}
+
+- (void)testUnansweredQueriesAreRetriedThenFail {
+    // Driven through the engine so the timeout can be short
+    self.server.dropQueries = YES;
+    SNBReverseResolverConfig config;
+    SNBReverseResolverConfigInit(&config);
+    XCTAssertTrue(SNBReverseResolverConfigAddServer(&config, "127.0.0.1", self.server.port));
+    config.attemptTimeoutNs = 50 * NSEC_PER_MSEC;
+    config.attempts = 2;
+    SNBReverseResolver *engine = SNBReverseResolverCreate(&config, NULL, NULL);
+    XCTAssertTrue(engine != NULL);
+
+    const uint8_t address[16] = {10, 9, 8, 7};
+    char name[SNB_DNS_MAX_NAME];
+    uint64_t nowNs = clock_gettime_nsec_np(CLOCK_MONOTONIC);
+    XCTAssertEqual(SNBReverseResolverLookup(engine, SNBAddressFamilyIPv4, address, name, sizeof(name), nowNs),
+                   SNBReverseLookupPending);
+    while (SNBReverseResolverPendingCount(engine) > 0) {
+        uint64_t deadlineNs = SNBReverseResolverNextDeadline(engine);
+        nowNs = clock_gettime_nsec_np(CLOCK_MONOTONIC);
+        int descriptor = 0;
+        SNBReverseResolverDescriptors(engine, &descriptor, 1);
+        struct pollfd poller = { descriptor, POLLIN, 0 };
+        poll(&poller, 1, deadlineNs > nowNs ? (int)((deadlineNs - nowNs) / NSEC_PER_MSEC) + 1 : 0);
+        SNBReverseResolverProcess(engine, clock_gettime_nsec_np(CLOCK_MONOTONIC));
+    }
+
+    SNBReverseResolverStats stats = SNBReverseResolverGetStats(engine);
+    XCTAssertEqual(stats.queriesSent, 2u);
+    XCTAssertEqual(stats.timeouts, 2u);
+    XCTAssertEqual(stats.negatives, 1u);
+    // Failures are kept briefly so the address is not asked again at once
+    XCTAssertEqual(SNBReverseResolverLookup(engine, SNBAddressFamilyIPv4, address, name, sizeof(name), nowNs),
+                   SNBReverseLookupCached);
+    XCTAssertEqual(name[0], '\0');
+    SNBReverseResolverDestroy(engine);
+}
+
+@end
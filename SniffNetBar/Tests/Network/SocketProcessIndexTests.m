@@ -0,0 +1,186 @@
+//
+//  SocketProcessIndexTests.m
+//  SniffNetBar
+//
+//  Socket -> process indexing, checked against a synthetic process table
+//  since the live one needs macOS and the helper's privileges
+//
+
+#import <XCTest/XCTest.h>
+#import <arpa/inet.h>
+#import <netinet/in.h>
+#import "SocketProcessIndex.h"
+
+static const uint64_t kIndexTestStartNs = 1000000000ULL;
+
+typedef struct {
+    int32_t pid;
+    uint8_t protocol;
+    const char *localAddress;       // NULL when bound to every address
+    uint16_t localPort;
+    const char *remoteAddress;      // NULL when unconnected
+    uint16_t remotePort;
+} SNBSyntheticSocket;
+
+typedef struct {
+    const SNBSyntheticSocket *sockets;
+    size_t count;
+    NSUInteger enumerations;
+} SNBSyntheticProcessTable;
+
+static uint8_t SNBSyntheticParseAddress(const char *text, uint8_t *bytes) {
+    if (inet_pton(AF_INET, text, bytes) == 1) {
+        return SNBAddressFamilyIPv4;
+    }
+    return inet_pton(AF_INET6, text, bytes) == 1 ? SNBAddressFamilyIPv6 : SNBAddressFamilyNone;
+}
+
+static SNBFlowKey SNBSyntheticKey(uint8_t protocol,
+                                  const char *localAddress, uint16_t localPort,
+                                  const char *remoteAddress, uint16_t remotePort) {
+    SNBFlowKey key;
+    memset(&key, 0, sizeof(key));
+    key.ipProtocol = protocol;
+    key.hasPorts = 1;
+    key.sourcePort = localPort;
+    key.destinationPort = remotePort;
+    if (localAddress) {
+        key.family = SNBSyntheticParseAddress(localAddress, key.sourceAddress);
+    }
+    if (remoteAddress) {
+        key.family = SNBSyntheticParseAddress(remoteAddress, key.destinationAddress);
+    }
+    return key;
+}
+
+static bool SNBSyntheticEnumerate(void *context, SNBSocketProcessIndex *index) {
+    SNBSyntheticProcessTable *table = context;
+    table->enumerations++;
+    for (size_t i = 0; i < table->count; i++) {
+        const SNBSyntheticSocket *socket = &table->sockets[i];
+        SNBFlowKey key = SNBSyntheticKey(socket->protocol, socket->localAddress, socket->localPort,
+                                         socket->remoteAddress, socket->remotePort);
+        if (key.family == SNBAddressFamilyNone) {
+            // Bound to every address: listed once per family, as dual-stack sockets are
+            key.family = SNBAddressFamilyIPv4;
+            SNBSocketProcessIndexAdd(index, &key, socket->pid);
+            key.family = SNBAddressFamilyIPv6;
+        }
+        SNBSocketProcessIndexAdd(index, &key, socket->pid);
+    }
+    return true;
+}
+
+@interface SocketProcessIndexTests : XCTestCase
+@end
+
+@implementation SocketProcessIndexTests
+
+- (void)testConnectionsResolveToTheirProcessInOnePass {
+    const SNBSyntheticSocket sockets[] = {
+        { 101, IPPROTO_TCP, "192.168.1.10", 50000, "93.184.216.34", 443 },      // curl
+        { 202, IPPROTO_TCP, "2001:db8::10", 50001, "2606:4700::6810:84e5", 443 }, // Safari
+        { 303, IPPROTO_UDP, NULL, 5353, NULL, 0 },                              // mDNSResponder
+        { 404, IPPROTO_UDP, "192.168.1.10", 60000, NULL, 0 },                   // DNS client
+        { 505, IPPROTO_TCP, NULL, 8080, NULL, 0 },                              // Listener
+    };
+    SNBSyntheticProcessTable table = { sockets, 5, 0 };
+    SNBSocketProcessIndex index;
+    XCTAssertTrue(SNBSocketProcessIndexInit(&index, SNBSyntheticEnumerate, &table, 16));
+
+    SNBFlowKey connections[] = {
+        SNBSyntheticKey(IPPROTO_TCP, "192.168.1.10", 50000, "93.184.216.34", 443),
+        SNBSyntheticKey(IPPROTO_TCP, "2001:db8::10", 50001, "2606:4700::6810:84e5", 443),
+        SNBSyntheticKey(IPPROTO_UDP, "192.168.1.10", 5353, "224.0.0.251", 5353),
+        SNBSyntheticKey(IPPROTO_UDP, "192.168.1.10", 60000, "1.1.1.1", 53),
+        // Same ports, other protocol or peer: not these sockets
+        SNBSyntheticKey(IPPROTO_UDP, "192.168.1.10", 50000, "93.184.216.34", 443),
+        SNBSyntheticKey(IPPROTO_TCP, "192.168.1.10", 8080, "10.0.0.9", 40000),
+    };
+    int32_t pids[6];
+    size_t resolved = SNBSocketProcessIndexResolve(&index, connections, 6, pids, kIndexTestStartNs);
+
+    XCTAssertEqual(resolved, 5u);
+    XCTAssertEqual(pids[0], 101);
+    XCTAssertEqual(pids[1], 202);
+    XCTAssertEqual(pids[2], 303);
+    XCTAssertEqual(pids[3], 404);
+    XCTAssertEqual(pids[4], 0);
+    XCTAssertEqual(pids[5], 505);
+    // The unresolved connection may not walk the table again so soon
+    XCTAssertEqual(table.enumerations, 1u);
+    XCTAssertEqual(index.misses, 1u);
+    SNBSocketProcessIndexDestroy(&index);
+}
+
+- (void)testMissesRebuildAtABoundedRate {
+    SNBSyntheticSocket sockets[] = {
+        { 101, IPPROTO_TCP, "192.168.1.10", 50000, "93.184.216.34", 443 },
+        { 0, 0, NULL, 0, NULL, 0 },
+    };
+    SNBSyntheticProcessTable table = { sockets, 1, 0 };
+    SNBSocketProcessIndex index;
+    XCTAssertTrue(SNBSocketProcessIndexInit(&index, SNBSyntheticEnumerate, &table, 16));
+    SNBFlowKey first = SNBSyntheticKey(IPPROTO_TCP, "192.168.1.10", 50000, "93.184.216.34", 443);
+    SNBFlowKey later = SNBSyntheticKey(IPPROTO_TCP, "192.168.1.10", 50002, "93.184.216.34", 443);
+    int32_t pid = 0;
+    SNBSocketProcessIndexResolve(&index, &first, 1, &pid, kIndexTestStartNs);
+    XCTAssertEqual(pid, 101);
+
+    // A connection opened after the rebuild
+    sockets[1] = (SNBSyntheticSocket){ 606, IPPROTO_TCP, "192.168.1.10", 50002, "93.184.216.34", 443 };
+    table.count = 2;
+    for (uint64_t step = 1; step <= 100; step++) {
+        SNBSocketProcessIndexResolve(&index, &later, 1, &pid, kIndexTestStartNs + step * 1000000ULL);
+        XCTAssertEqual(pid, 0);
+    }
+    XCTAssertEqual(table.enumerations, 1u);
+
+    SNBSocketProcessIndexResolve(&index, &later, 1, &pid, kIndexTestStartNs + index.minIntervalNs);
+    XCTAssertEqual(pid, 606);
+    XCTAssertEqual(table.enumerations, 2u);
+    SNBSocketProcessIndexDestroy(&index);
+}
+
+- (void)testReusedPortsMoveToTheNewProcessOnceTheIndexAges {
+    SNBSyntheticSocket sockets[] = {
+        { 101, IPPROTO_UDP, "192.168.1.10", 60000, NULL, 0 },
+    };
+    SNBSyntheticProcessTable table = { sockets, 1, 0 };
+    SNBSocketProcessIndex index;
+    XCTAssertTrue(SNBSocketProcessIndexInit(&index, SNBSyntheticEnumerate, &table, 16));
+    SNBFlowKey connection = SNBSyntheticKey(IPPROTO_UDP, "192.168.1.10", 60000, "8.8.8.8", 53);
+    int32_t pid = 0;
+    SNBSocketProcessIndexResolve(&index, &connection, 1, &pid, kIndexTestStartNs);
+    XCTAssertEqual(pid, 101);
+
+    // The port is closed and bound again by another process; hits keep
+    // answering from the index until it is too old to trust
+    sockets[0].pid = 707;
+    SNBSocketProcessIndexResolve(&index, &connection, 1, &pid, kIndexTestStartNs + index.maxAgeNs - 1);
+    XCTAssertEqual(pid, 101);
+    SNBSocketProcessIndexResolve(&index, &connection, 1, &pid, kIndexTestStartNs + index.maxAgeNs);
+    XCTAssertEqual(pid, 707);
+    XCTAssertEqual(table.enumerations, 2u);
+    SNBSocketProcessIndexDestroy(&index);
+}
+
+- (void)testInheritedSocketsBelongToTheFirstProcessListed {
+    const SNBSyntheticSocket sockets[] = {
+        { 101, IPPROTO_TCP, "192.168.1.10", 50000, "93.184.216.34", 443 },
+        { 102, IPPROTO_TCP, "192.168.1.10", 50000, "93.184.216.34", 443 },
+    };
+    SNBSyntheticProcessTable table = { sockets, 2, 0 };
+    SNBSocketProcessIndex index;
+    XCTAssertTrue(SNBSocketProcessIndexInit(&index, SNBSyntheticEnumerate, &table, 16));
+    XCTAssertTrue(SNBSocketProcessIndexRebuild(&index, kIndexTestStartNs));
+    XCTAssertEqual(SNBSocketProcessIndexCount(&index), 1u);
+
+    SNBFlowKey connection = SNBSyntheticKey(IPPROTO_TCP, "192.168.1.10", 50000, "93.184.216.34", 443);
+    int32_t pid = 0;
+    XCTAssertEqual(SNBSocketProcessIndexResolve(&index, &connection, 1, &pid, kIndexTestStartNs), 1u);
+    XCTAssertEqual(pid, 101);
+    SNBSocketProcessIndexDestroy(&index);
+}
+
+@end
@@ -22,6 +22,9 @@ NS_ASSUME_NONNULL_BEGIN
 @property (nonatomic, assign) NSTimeInterval simulatedDelay;
 @property (nonatomic, assign) BOOL isHealthy;
 @property (nonatomic, assign) NSInteger callCount;
+@property (nonatomic, strong, readonly) NSMutableArray<NSString *> *calledValues;
+@property (nonatomic, assign) NSInteger maxRequestsPerMin;
+@property (nonatomic, assign) NSInteger maxRequestsPerDay;
 
 // Configure mock responses
 - (instancetype)initWithName:(NSString *)name;
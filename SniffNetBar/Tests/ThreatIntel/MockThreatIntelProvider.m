@@ -25,6 +25,7 @@
         _simulatedDelay = 0.0;
         _isHealthy = YES;
         _callCount = 0;
+        _calledValues = [NSMutableArray array];
         _mockResults = [NSMutableDictionary dictionary];
         _mockScores = [NSMutableDictionary dictionary];
     }
@@ -48,7 +49,10 @@
 
 - (void)enrichIndicator:(TIIndicator *)indicator
              completion:(void (^)(TIResult * _Nullable, NSError * _Nullable))completion {
-    self.callCount++;
+    @synchronized(self) {
+        self.callCount++;
+        [self.calledValues addObject:indicator.value];
+    }
 
     dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(self.simulatedDelay * NSEC_PER_SEC)),
                    dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
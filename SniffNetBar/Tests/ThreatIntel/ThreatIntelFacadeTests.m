@@ -8,9 +8,25 @@
 #import <XCTest/XCTest.h>
 #import "ThreatIntelFacade.h"
 #import "ThreatIntelModels.h"
+#import "ThreatIntelStore.h"
 #import "MockThreatIntelProvider.h"
+#import <mach/mach.h>
+
+static NSUInteger SNBCurrentThreadCount(void) {
+    thread_act_array_t threads = NULL;
+    mach_msg_type_number_t count = 0;
+    if (task_threads(mach_task_self(), &threads, &count) != KERN_SUCCESS) {
+        return 0;
+    }
+    for (mach_msg_type_number_t i = 0; i < count; i++) {
+        mach_port_deallocate(mach_task_self(), threads[i]);
+    }
+    vm_deallocate(mach_task_self(), (vm_address_t)threads, count * sizeof(thread_act_t));
+    return count;
+}
 
 @interface ThreatIntelFacadeTests : XCTestCase
+@property (nonatomic, copy) NSString *storePath;
 @property (nonatomic, strong) ThreatIntelFacade *facade;
 @property (nonatomic, strong) MockThreatIntelProvider *mockProvider1;
 @property (nonatomic, strong) MockThreatIntelProvider *mockProvider2;
@@ -21,8 +37,12 @@
 - (void)setUp {
     [super setUp];
 
-    // Create fresh facade instance for each test
-    self.facade = [[ThreatIntelFacade alloc] init];
+    // Create fresh facade instance for each test, with its own store so
+    // answers persisted by earlier runs do not stand in for provider calls
+    self.storePath = [NSTemporaryDirectory() stringByAppendingPathComponent:
+                      [NSString stringWithFormat:@"snb-ti-%@.sqlite", [NSUUID UUID].UUIDString]];
+    ThreatIntelStore *store = [[ThreatIntelStore alloc] initWithPath:self.storePath TTLSeconds:3600.0];
+    self.facade = [[ThreatIntelFacade alloc] initWithStore:store];
     self.facade.enabled = YES;
 
     // Create mock providers
@@ -36,6 +56,9 @@
     self.facade = nil;
     self.mockProvider1 = nil;
     self.mockProvider2 = nil;
+    for (NSString *suffix in @[@"", @"-wal", @"-shm", @"-filter"]) {
+        [[NSFileManager defaultManager] removeItemAtPath:[self.storePath stringByAppendingString:suffix] error:nil];
+    }
     [super tearDown];
 }
 
@@ -264,6 +287,78 @@
     XCTAssertNotNil(stats, @"Should still return stats after clear");
 }
 
+- (void)testStoredAnswerIsReadWithoutQueryingProviders {
+    [self.facade addProvider:self.mockProvider1];
+    [self.mockProvider1 setMockScore:70 forIndicatorValue:@"192.0.2.50"];
+
+    XCTestExpectation *first = [self expectationWithDescription:@"Answered by the provider"];
+    [self.facade enrichIP:@"192.0.2.50" completion:^(TIEnrichmentResponse *response, NSError *error) {
+        [first fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:2.0 handler:nil];
+
+    // With the memory cache cleared the answer comes from the store, read
+    // off the enrichment queue
+    [self.facade clearCache];
+    XCTestExpectation *second = [self expectationWithDescription:@"Answered by the store"];
+    [self.facade enrichIP:@"192.0.2.50" completion:^(TIEnrichmentResponse *response, NSError *error) {
+        XCTAssertNil(error);
+        XCTAssertEqual(response.providerResults.count, 1u);
+        XCTAssertEqualObjects(response.providerResults.firstObject.providerName, @"MockProvider1");
+        [second fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:2.0 handler:nil];
+    XCTAssertEqualObjects(self.mockProvider1.calledValues, @[@"192.0.2.50"]);
+}
+
+- (void)testStoreFilterSkipsUnstoredIndicators {
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:
+                      [NSString stringWithFormat:@"snb-ti-%@.sqlite", [NSUUID UUID].UUIDString]];
+    TIEnrichmentResponse *response = [[TIEnrichmentResponse alloc] init];
+    response.indicator = [[TIIndicator alloc] initWithType:TIIndicatorTypeIPv4 value:@"203.0.113.9"];
+    response.providerResults = @[];
+    TIEnrichmentResponse *later = [[TIEnrichmentResponse alloc] init];
+    later.indicator = [[TIIndicator alloc] initWithType:TIIndicatorTypeIPv4 value:@"203.0.113.10"];
+    later.providerResults = @[];
+
+    @autoreleasepool {
+        ThreatIntelStore *store = [[ThreatIntelStore alloc] initWithPath:path TTLSeconds:3600.0];
+        [store storeResponse:response];
+        [store loadIndicatorFilter];
+        // Store calls run in order on its queue, so this one waits for the load
+        [store getAllProviderStatuses];
+        XCTAssertEqualObjects([store indicatorFilterStats][@"storeFilterLoaded"], @YES);
+
+        XCTAssertNotNil([store responseForIndicator:response.indicator]);
+        for (NSUInteger i = 0; i < 200; i++) {
+            NSString *value = [NSString stringWithFormat:@"198.51.100.%lu", (unsigned long)i];
+            XCTAssertNil([store responseForIndicator:[[TIIndicator alloc] initWithType:TIIndicatorTypeIPv4 value:value]]);
+        }
+        NSDictionary<NSString *, NSNumber *> *stats = [store indicatorFilterStats];
+        XCTAssertEqual(stats[@"storeFilterChecks"].unsignedIntegerValue, 201u);
+        XCTAssertEqual(stats[@"storeFilterStoredHits"].unsignedIntegerValue, 1u);
+        XCTAssertEqual(stats[@"storeFilterSkipped"].unsignedIntegerValue + stats[@"storeFilterFalsePositives"].unsignedIntegerValue, 200u);
+        XCTAssertGreaterThan(stats[@"storeFilterSkipped"].unsignedIntegerValue, 190u);
+
+        // Indicators stored after the load are added as they are written, and
+        // the filter saved when the store goes away is loaded by the next one
+        [store storeResponse:later];
+        XCTAssertNotNil([store responseForIndicator:later.indicator]);
+    }
+    XCTAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:[path stringByAppendingString:@"-filter"]]);
+
+    ThreatIntelStore *reopened = [[ThreatIntelStore alloc] initWithPath:path TTLSeconds:3600.0];
+    [reopened loadIndicatorFilter];
+    [reopened getAllProviderStatuses];
+    XCTAssertNotNil([reopened responseForIndicator:response.indicator]);
+    XCTAssertNotNil([reopened responseForIndicator:later.indicator]);
+    XCTAssertEqualObjects([reopened indicatorFilterStats][@"storeFilterStoredHits"], @2);
+    reopened = nil;
+    for (NSString *suffix in @[@"", @"-wal", @"-shm", @"-filter"]) {
+        [[NSFileManager defaultManager] removeItemAtPath:[path stringByAppendingString:suffix] error:nil];
+    }
+}
+
 #pragma mark - Performance Tests
 
 - (void)testConcurrentEnrichment {
@@ -291,4 +386,240 @@
     [self waitForExpectationsWithTimeout:3.0 handler:nil];
 }
 
+#pragma mark - Enrichment Engine Tests
+
+- (void)testCoalescesRequestsForSameIndicator {
+    [self.facade addProvider:self.mockProvider1];
+    self.mockProvider1.simulatedDelay = 0.1;
+    TIIndicator *indicator = [[TIIndicator alloc] initWithType:TIIndicatorTypeIPv4 value:@"1.2.3.4"];
+
+    XCTestExpectation *first = [self expectationWithDescription:@"First request"];
+    XCTestExpectation *second = [self expectationWithDescription:@"Second request"];
+    [self.facade enrichIndicator:indicator completion:^(TIEnrichmentResponse *response, NSError *error) {
+        XCTAssertNotNil(response);
+        [first fulfill];
+    }];
+    [self.facade enrichIndicator:indicator completion:^(TIEnrichmentResponse *response, NSError *error) {
+        XCTAssertNotNil(response);
+        [second fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:2.0 handler:nil];
+
+    XCTAssertEqual(self.mockProvider1.callCount, 1, @"Both requests should share one provider call");
+    XCTAssertEqualObjects([self.facade cacheStats][@"enrichmentCoalesced"], @1);
+}
+
+- (void)testTimeoutCompletesWithoutWaitingForProvider {
+    [self.facade addProvider:self.mockProvider1];
+    self.mockProvider1.simulatedDelay = 5.0;
+    self.facade.enrichmentTimeout = 0.2;
+    TIIndicator *indicator = [[TIIndicator alloc] initWithType:TIIndicatorTypeIPv4 value:@"1.2.3.4"];
+
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Timed out"];
+    [self.facade enrichIndicator:indicator completion:^(TIEnrichmentResponse *response, NSError *error) {
+        XCTAssertEqual(error.code, TIErrorCodeTimeout);
+        XCTAssertEqual(response.providerResults.count, 0);
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:2.0 handler:nil];
+
+    NSDictionary *stats = [self.facade cacheStats];
+    XCTAssertEqualObjects(stats[@"enrichmentTimedOut"], @1);
+    XCTAssertEqualObjects(stats[@"enrichmentInFlight"], @0, @"A timed out task should free its slot");
+}
+
+- (void)testRejectsRequestsWhenQueueIsFull {
+    [self.facade addProvider:self.mockProvider1];
+    self.mockProvider1.simulatedDelay = 0.2;
+    self.facade.maxConcurrentEnrichments = 1;
+    self.facade.maxQueuedEnrichments = 1;
+
+    NSArray<NSString *> *values = @[@"1.1.1.1", @"2.2.2.2", @"3.3.3.3"];
+    NSMutableDictionary<NSString *, NSError *> *errors = [NSMutableDictionary dictionary];
+    XCTestExpectation *expectation = [self expectationWithDescription:@"All requests answered"];
+    expectation.expectedFulfillmentCount = values.count;
+    for (NSString *value in values) {
+        TIIndicator *indicator = [[TIIndicator alloc] initWithType:TIIndicatorTypeIPv4 value:value];
+        [self.facade enrichIndicator:indicator completion:^(TIEnrichmentResponse *response, NSError *error) {
+            if (error) {
+                errors[value] = error;
+            }
+            [expectation fulfill];
+        }];
+    }
+    [self waitForExpectationsWithTimeout:3.0 handler:nil];
+
+    // The first runs, the second waits and the third finds the queue full
+    XCTAssertNil(errors[@"1.1.1.1"]);
+    XCTAssertNil(errors[@"2.2.2.2"]);
+    XCTAssertEqual(errors[@"3.3.3.3"].code, TIErrorCodeQueueFull);
+    XCTAssertEqual(self.mockProvider1.callCount, 2);
+    XCTAssertEqualObjects([self.facade cacheStats][@"enrichmentRejected"], @1);
+}
+
+- (void)testManyQueuedIndicatorsUseConstantThreads {
+    static const NSUInteger kIndicatorCount = 10000;
+    [self.facade addProvider:self.mockProvider1];
+    self.mockProvider1.simulatedDelay = 0.01;
+    self.facade.maxConcurrentEnrichments = 64;
+    self.facade.maxQueuedEnrichments = kIndicatorCount;
+
+    NSUInteger baselineThreads = SNBCurrentThreadCount();
+    __block NSUInteger peakThreads = baselineThreads;
+    __block NSUInteger answered = 0;
+    XCTestExpectation *expectation = [self expectationWithDescription:@"All indicators enriched"];
+    expectation.expectedFulfillmentCount = kIndicatorCount;
+
+    for (NSUInteger i = 0; i < kIndicatorCount; i++) {
+        NSString *value = [NSString stringWithFormat:@"198.%lu.%lu.%lu",
+                           (unsigned long)(18 + i / 65536), (unsigned long)((i / 256) % 256), (unsigned long)(i % 256)];
+        TIIndicator *indicator = [[TIIndicator alloc] initWithType:TIIndicatorTypeIPv4 value:value];
+        [self.facade enrichIndicator:indicator completion:^(TIEnrichmentResponse *response, NSError *error) {
+            if (response && !error) {
+                answered++;
+            }
+            if (answered % 100 == 0) {
+                peakThreads = MAX(peakThreads, SNBCurrentThreadCount());
+            }
+            [expectation fulfill];
+        }];
+    }
+    [self waitForExpectationsWithTimeout:60.0 handler:nil];
+
+    XCTAssertEqual(answered, kIndicatorCount);
+    XCTAssertEqual(self.mockProvider1.callCount, (NSInteger)kIndicatorCount);
+    // Blocking one worker per indicator would grow towards GCD's thread
+    // limit; callbacks only need the workers that run the provider timers
+    NSUInteger allowance = [NSProcessInfo processInfo].activeProcessorCount + 8;
+    XCTAssertLessThanOrEqual(peakThreads, baselineThreads + allowance,
+                             @"Thread count grew from %lu to %lu", (unsigned long)baselineThreads, (unsigned long)peakThreads);
+
+    NSDictionary *stats = [self.facade cacheStats];
+    XCTAssertEqualObjects(stats[@"enrichmentCompleted"], @(kIndicatorCount));
+    XCTAssertEqualObjects(stats[@"enrichmentQueued"], @0);
+    XCTAssertEqualObjects(stats[@"enrichmentInFlight"], @0);
+    XCTAssertGreaterThan([stats[@"enrichmentPeakQueued"] unsignedIntegerValue], 64u);
+}
+
+- (void)testDefersLookupsBeyondProviderBudget {
+    [self.facade addProvider:self.mockProvider1];
+    self.mockProvider1.maxRequestsPerDay = 2;
+
+    NSMutableDictionary<NSString *, NSError *> *errors = [NSMutableDictionary dictionary];
+    for (NSString *value in @[@"1.1.1.1", @"2.2.2.2", @"3.3.3.3"]) {
+        XCTestExpectation *expectation = [self expectationWithDescription:value];
+        [self.facade enrichIP:value completion:^(TIEnrichmentResponse *response, NSError *error) {
+            if (error) {
+                errors[value] = error;
+            }
+            [expectation fulfill];
+        }];
+        [self waitForExpectationsWithTimeout:2.0 handler:nil];
+    }
+
+    // The third lookup waits for tomorrow's budget instead of holding a slot
+    XCTAssertNil(errors[@"2.2.2.2"]);
+    XCTAssertEqual(errors[@"3.3.3.3"].code, TIErrorCodeRateLimited);
+    XCTAssertEqualObjects(errors[@"3.3.3.3"].userInfo[@"deferredProviders"], @[@"MockProvider1"]);
+    XCTAssertEqual(self.mockProvider1.callCount, 2);
+
+    NSDictionary *stats = [self.facade cacheStats];
+    XCTAssertEqualObjects(stats[@"enrichmentInFlight"], @0);
+    XCTAssertEqualObjects(stats[@"providerQueued"], @1);
+    NSDictionary *lane = stats[@"providerQueues"][@"MockProvider1"];
+    XCTAssertEqualObjects(lane[@"queued"], @1);
+    XCTAssertEqualObjects(lane[@"remainingToday"], @0);
+}
+
+- (void)testDeferredLookupsRunHighestPriorityFirst {
+    static const NSInteger kBurst = 120;
+    [self.facade addProvider:self.mockProvider1];
+    // A full bucket allows the burst, then one call every half second
+    self.mockProvider1.maxRequestsPerMin = kBurst;
+
+    XCTestExpectation *burst = [self expectationWithDescription:@"Burst answered"];
+    burst.expectedFulfillmentCount = kBurst;
+    for (NSInteger i = 0; i < kBurst; i++) {
+        NSString *value = [NSString stringWithFormat:@"198.18.0.%ld", (long)i];
+        [self.facade enrichIP:value completion:^(TIEnrichmentResponse *response, NSError *error) {
+            [burst fulfill];
+        }];
+    }
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    XCTAssertEqual(self.mockProvider1.callCount, kBurst);
+
+    __block NSInteger notified = 0;
+    [self expectationForNotification:TIDeferredLookupDidCompleteNotification object:self.facade handler:^BOOL(NSNotification *notification) {
+        return ++notified == 3;
+    }];
+    NSDictionary<NSString *, NSNumber *> *priorities = @{@"203.0.113.1": @1.0, @"203.0.113.2": @2.0, @"203.0.113.3": @3.0};
+    for (NSString *value in @[@"203.0.113.1", @"203.0.113.2", @"203.0.113.3"]) {
+        [self.facade enrichIP:value priority:priorities[value].doubleValue completion:^(TIEnrichmentResponse *response, NSError *error) {
+            XCTAssertEqual(error.code, TIErrorCodeRateLimited);
+        }];
+    }
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+
+    NSArray<NSString *> *calls = self.mockProvider1.calledValues;
+    NSArray<NSString *> *deferredOrder = [calls subarrayWithRange:NSMakeRange(calls.count - 3, 3)];
+    XCTAssertEqualObjects(deferredOrder, (@[@"203.0.113.3", @"203.0.113.2", @"203.0.113.1"]));
+
+    // The answers are cached, so asking again needs no provider call
+    XCTestExpectation *cached = [self expectationWithDescription:@"Cached"];
+    [self.facade enrichIP:@"203.0.113.1" completion:^(TIEnrichmentResponse *response, NSError *error) {
+        XCTAssertNil(error);
+        XCTAssertEqual(response.cacheHits, 1);
+        [cached fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:2.0 handler:nil];
+    XCTAssertEqual(self.mockProvider1.callCount, kBurst + 3);
+}
+
+- (void)testCancelsQueuedIndicatorsThatAreNoLongerActive {
+    [self.facade addProvider:self.mockProvider1];
+    self.mockProvider1.simulatedDelay = 0.2;
+    self.facade.maxConcurrentEnrichments = 1;
+
+    NSArray<NSString *> *values = @[@"1.1.1.1", @"2.2.2.2", @"3.3.3.3"];
+    NSMutableDictionary<NSString *, NSError *> *errors = [NSMutableDictionary dictionary];
+    XCTestExpectation *expectation = [self expectationWithDescription:@"All requests answered"];
+    expectation.expectedFulfillmentCount = values.count;
+    for (NSString *value in values) {
+        [self.facade enrichIP:value completion:^(TIEnrichmentResponse *response, NSError *error) {
+            if (error) {
+                errors[value] = error;
+            }
+            [expectation fulfill];
+        }];
+    }
+    [self.facade cancelEnrichmentsExceptIndicatorValues:[NSSet setWithObjects:@"1.1.1.1", @"3.3.3.3", nil]];
+    [self waitForExpectationsWithTimeout:3.0 handler:nil];
+
+    XCTAssertNil(errors[@"1.1.1.1"]);
+    XCTAssertEqual(errors[@"2.2.2.2"].code, TIErrorCodeCancelled);
+    XCTAssertNil(errors[@"3.3.3.3"]);
+    XCTAssertEqualObjects(self.mockProvider1.calledValues, (@[@"1.1.1.1", @"3.3.3.3"]));
+    XCTAssertEqualObjects([self.facade cacheStats][@"enrichmentCancelled"], @1);
+}
+
+- (void)testQueuedIndicatorsStartByPriority {
+    [self.facade addProvider:self.mockProvider1];
+    self.mockProvider1.simulatedDelay = 0.1;
+    self.facade.maxConcurrentEnrichments = 1;
+
+    XCTestExpectation *expectation = [self expectationWithDescription:@"All requests answered"];
+    expectation.expectedFulfillmentCount = 4;
+    NSArray<NSNumber *> *priorities = @[@0.0, @1.0, @5.0, @2.0];
+    for (NSUInteger i = 0; i < priorities.count; i++) {
+        NSString *value = [NSString stringWithFormat:@"192.0.2.%lu", (unsigned long)i + 1];
+        [self.facade enrichIP:value priority:priorities[i].doubleValue completion:^(TIEnrichmentResponse *response, NSError *error) {
+            [expectation fulfill];
+        }];
+    }
+    [self waitForExpectationsWithTimeout:3.0 handler:nil];
+
+    // The first starts at once; the rest wait and start busiest first
+    XCTAssertEqualObjects(self.mockProvider1.calledValues, (@[@"192.0.2.1", @"192.0.2.3", @"192.0.2.4", @"192.0.2.2"]));
+}
+
 @end
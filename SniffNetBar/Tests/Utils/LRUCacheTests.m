@@ -0,0 +1,248 @@
+//
+//  LRUCacheTests.m
+//  SniffNetBar
+//
+//  LRU order, expiry and counters of the cache and the index under it
+//
+
+#import <XCTest/XCTest.h>
+#import "CacheIndex.h"
+#import "LRUCache.h"
+
+static const uint32_t kIndexTestCapacity = 64;
+static const uint32_t kIndexTestKeys = 200;
+static const NSUInteger kIndexTestIterations = 200000;
+
+@interface LRUCacheTests : XCTestCase
+@end
+
+@implementation LRUCacheTests
+
+#pragma mark - Index
+
+// Reference model state for the index: which key each slot holds, plus the
+// recency and expiry of each key
+typedef struct {
+    int32_t slotKey[kIndexTestCapacity];
+    int32_t keySlot[kIndexTestKeys];
+    uint64_t lastUse[kIndexTestKeys];
+    uint64_t expiresNs[kIndexTestKeys];
+} SNBIndexTestModel;
+
+static void SNBIndexTestUnmap(uint32_t slot, void *context) {
+    SNBIndexTestModel *model = context;
+    model->keySlot[model->slotKey[slot]] = -1;
+    model->slotKey[slot] = -1;
+}
+
+static uint32_t SNBIndexTestCount(const SNBIndexTestModel *model) {
+    uint32_t count = 0;
+    for (uint32_t key = 0; key < kIndexTestKeys; key++) {
+        count += model->keySlot[key] >= 0;
+    }
+    return count;
+}
+
+- (void)testIndexMatchesReferenceModel {
+    SNBCacheIndex *index = SNBCacheIndexCreate(kIndexTestCapacity, 10);
+    XCTAssertTrue(index != NULL);
+    SNBIndexTestModel model;
+    memset(model.slotKey, 0xff, sizeof(model.slotKey));
+    memset(model.keySlot, 0xff, sizeof(model.keySlot));
+
+    uint64_t nowNs = 1000;
+    uint64_t sequence = 0;
+    uint64_t state = 0x9e3779b97f4a7c15ULL;
+    for (NSUInteger i = 0; i < kIndexTestIterations; i++) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        uint32_t draw = (uint32_t)(state >> 33);
+        uint32_t key = draw % kIndexTestKeys;
+        uint32_t operation = (draw >> 8) % 100;
+        nowNs += (draw >> 16) % 3;
+        int32_t slot = model.keySlot[key];
+
+        if (operation < 70) {
+            sequence++;
+            if (slot >= 0) {
+                BOOL live = SNBCacheIndexTouch(index, (uint32_t)slot, nowNs);
+                XCTAssertEqual(live, model.expiresNs[key] > nowNs);
+                if (live) {
+                    model.lastUse[key] = sequence;
+                    continue;
+                }
+                SNBIndexTestUnmap((uint32_t)slot, &model);
+            }
+            // The model's victim is the key used longest ago
+            int32_t victim = -1;
+            for (uint32_t other = 0; other < kIndexTestKeys; other++) {
+                if (model.keySlot[other] >= 0 && (victim < 0 || model.lastUse[other] < model.lastUse[victim])) {
+                    victim = (int32_t)other;
+                }
+            }
+            BOOL full = SNBIndexTestCount(&model) == kIndexTestCapacity;
+            uint64_t expiresNs = (draw >> 20) % 10 == 0 ? SNB_CACHE_INDEX_NEVER : nowNs + (draw >> 12) % 8000;
+            bool evicted = false;
+            uint32_t inserted = SNBCacheIndexInsert(index, expiresNs, &evicted);
+            XCTAssertEqual((BOOL)evicted, full);
+            if (evicted) {
+                XCTAssertEqual(model.slotKey[inserted], victim);
+                SNBIndexTestUnmap(inserted, &model);
+            }
+            model.slotKey[inserted] = (int32_t)key;
+            model.keySlot[key] = (int32_t)inserted;
+            model.lastUse[key] = sequence;
+            model.expiresNs[key] = expiresNs;
+        } else if (operation < 80) {
+            if (slot >= 0) {
+                SNBCacheIndexRemove(index, (uint32_t)slot);
+                SNBIndexTestUnmap((uint32_t)slot, &model);
+            }
+        } else if (operation < 90) {
+            if (slot >= 0) {
+                model.expiresNs[key] = nowNs + (draw >> 12) % 5000;
+                SNBCacheIndexSetExpiry(index, (uint32_t)slot, model.expiresNs[key]);
+            }
+        } else {
+            SNBCacheIndexExpire(index, nowNs, SNBIndexTestUnmap, &model);
+            // Everything due before the last completed tick is gone
+            for (uint32_t other = 0; other < kIndexTestKeys; other++) {
+                if (model.keySlot[other] >= 0) {
+                    XCTAssertGreaterThanOrEqual(model.expiresNs[other], nowNs / 10 * 10);
+                }
+            }
+        }
+        XCTAssertEqual(SNBCacheIndexCount(index), SNBIndexTestCount(&model));
+    }
+
+    // A jump past a whole revolution of the wheel leaves only entries without a lifetime
+    SNBCacheIndexExpire(index, nowNs + 1000000, SNBIndexTestUnmap, &model);
+    for (uint32_t key = 0; key < kIndexTestKeys; key++) {
+        if (model.keySlot[key] >= 0) {
+            XCTAssertEqual(model.expiresNs[key], SNB_CACHE_INDEX_NEVER);
+        }
+    }
+    SNBCacheIndexStats stats = SNBCacheIndexGetStats(index);
+    XCTAssertGreaterThan(stats.evictions, 0u);
+    XCTAssertGreaterThan(stats.expirations, 0u);
+    SNBCacheIndexDestroy(index);
+}
+
+#pragma mark - Cache
+
+- (void)testEvictsLeastRecentlyUsed {
+    SNBLRUCache<NSString *, NSNumber *> *cache = [[SNBLRUCache alloc] initWithCapacity:3 timeToLive:0];
+    [cache setObject:@1 forKey:@"a"];
+    [cache setObject:@2 forKey:@"b"];
+    [cache setObject:@3 forKey:@"c"];
+    XCTAssertEqualObjects([cache objectForKey:@"a"], @1);
+
+    [cache setObject:@4 forKey:@"d"];
+    XCTAssertNil([cache objectForKey:@"b"], @"b was used longest ago");
+    XCTAssertEqualObjects([cache objectForKey:@"a"], @1);
+    XCTAssertEqualObjects([cache objectForKey:@"c"], @3);
+    XCTAssertEqualObjects([cache objectForKey:@"d"], @4);
+    XCTAssertEqual(cache.count, 3u);
+
+    NSDictionary<NSString *, NSNumber *> *statistics = cache.statistics;
+    XCTAssertEqual(statistics[@"hits"].unsignedIntegerValue, 4u);
+    XCTAssertEqual(statistics[@"misses"].unsignedIntegerValue, 1u);
+    XCTAssertEqual(statistics[@"evictions"].unsignedIntegerValue, 1u);
+    XCTAssertEqual(statistics[@"insertions"].unsignedIntegerValue, 4u);
+}
+
+- (void)testReplacingKeepsOneEntry {
+    SNBLRUCache<NSString *, NSNumber *> *cache = [[SNBLRUCache alloc] initWithCapacity:2 timeToLive:0];
+    [cache setObject:@1 forKey:@"a"];
+    [cache setObject:@2 forKey:@"b"];
+    [cache setObject:@3 forKey:@"a"];
+    XCTAssertEqual(cache.count, 2u);
+    XCTAssertEqualObjects([cache objectForKey:@"a"], @3);
+    XCTAssertEqualObjects([cache objectForKey:@"b"], @2);
+    XCTAssertEqual(cache.statistics[@"evictions"].unsignedIntegerValue, 0u);
+}
+
+- (void)testEntriesExpire {
+    SNBLRUCache<NSString *, NSNumber *> *cache = [[SNBLRUCache alloc] initWithCapacity:16 timeToLive:0.2];
+    [cache setObject:@1 forKey:@"short"];
+    [cache setObject:@2 forKey:@"long" timeToLive:60];
+    [cache setObject:@3 forKey:@"forever" timeToLive:0];
+    XCTAssertEqualObjects([cache objectForKey:@"short"], @1);
+    XCTAssertGreaterThan([cache timeToLiveRemainingForKey:@"long"], 59.0);
+    XCTAssertEqual([cache timeToLiveRemainingForKey:@"forever"], HUGE_VAL);
+    XCTAssertEqual([cache timeToLiveRemainingForKey:@"missing"], 0.0);
+
+    [NSThread sleepForTimeInterval:0.3];
+    XCTAssertEqual([cache timeToLiveRemainingForKey:@"short"], 0.0);
+    XCTAssertEqual([cache expireObjects], 1u);
+    XCTAssertNil([cache objectForKey:@"short"]);
+    XCTAssertEqualObjects([cache objectForKey:@"long"], @2);
+    XCTAssertEqualObjects([cache objectForKey:@"forever"], @3);
+    XCTAssertEqual(cache.statistics[@"expirations"].unsignedIntegerValue, 1u);
+}
+
+- (void)testExpiredLookupCountsAsMiss {
+    SNBLRUCache<NSString *, NSNumber *> *cache = [[SNBLRUCache alloc] initWithCapacity:4 timeToLive:0.05];
+    [cache setObject:@1 forKey:@"a"];
+    [NSThread sleepForTimeInterval:0.1];
+    XCTAssertNil([cache objectForKey:@"a"]);
+    XCTAssertEqual(cache.count, 0u);
+    XCTAssertEqual(cache.statistics[@"misses"].unsignedIntegerValue, 1u);
+    XCTAssertEqual(cache.statistics[@"expirations"].unsignedIntegerValue, 1u);
+}
+
+- (void)testRemoveObjectsPassingTest {
+    SNBLRUCache<NSString *, NSNumber *> *cache = [[SNBLRUCache alloc] initWithCapacity:1000 timeToLive:0 shardCount:4];
+    for (NSUInteger i = 0; i < 100; i++) {
+        [cache setObject:@(i) forKey:[NSString stringWithFormat:@"%@:%lu", i % 2 ? @"odd" : @"even", (unsigned long)i]];
+    }
+    NSUInteger removed = [cache removeObjectsPassingTest:^BOOL(NSString *key, NSNumber *object) {
+        return [key hasPrefix:@"odd:"];
+    }];
+    XCTAssertEqual(removed, 50u);
+    XCTAssertEqual(cache.count, 50u);
+    XCTAssertNil([cache objectForKey:@"odd:1"]);
+    XCTAssertEqualObjects([cache objectForKey:@"even:2"], @2);
+
+    [cache removeObjectForKey:@"even:2"];
+    XCTAssertNil([cache objectForKey:@"even:2"]);
+    [cache removeAllObjects];
+    XCTAssertEqual(cache.count, 0u);
+}
+
+- (void)testMutableKeysAreCopied {
+    SNBLRUCache<NSString *, NSNumber *> *cache = [[SNBLRUCache alloc] initWithCapacity:4 timeToLive:0];
+    NSMutableString *key = [NSMutableString stringWithString:@"host"];
+    [cache setObject:@1 forKey:key];
+    [key appendString:@"-renamed"];
+    XCTAssertEqualObjects([cache objectForKey:@"host"], @1);
+    XCTAssertNil([cache objectForKey:key]);
+}
+
+- (void)testShardsStayWithinCapacityUnderConcurrency {
+    const NSUInteger capacity = 100000;
+    SNBLRUCache<NSNumber *, NSNumber *> *cache = [[SNBLRUCache alloc] initWithCapacity:capacity timeToLive:60 shardCount:8];
+    for (NSUInteger i = 0; i < capacity; i++) {
+        [cache setObject:@(i) forKey:@(i)];
+    }
+    XCTAssertEqual(cache.count, capacity);
+
+    // Readers hit every shard while writers push in keys that do not fit
+    dispatch_apply(8, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t worker) {
+        for (NSUInteger i = 0; i < 50000; i++) {
+            NSUInteger value = worker % 2 ? i : capacity + worker * 50000 + i;
+            if (worker % 2) {
+                NSNumber *object = [cache objectForKey:@(value)];
+                XCTAssertTrue(object == nil || object.unsignedIntegerValue == value);
+            } else {
+                [cache setObject:@(value) forKey:@(value)];
+            }
+        }
+    });
+
+    NSDictionary<NSString *, NSNumber *> *statistics = cache.statistics;
+    XCTAssertLessThanOrEqual(cache.count, capacity);
+    XCTAssertEqual(statistics[@"hits"].unsignedIntegerValue + statistics[@"misses"].unsignedIntegerValue, 4u * 50000u);
+    XCTAssertEqual(statistics[@"evictions"].unsignedIntegerValue + cache.count, capacity + 4u * 50000u);
+}
+
+@end
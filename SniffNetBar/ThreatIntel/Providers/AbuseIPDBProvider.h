@@ -23,6 +23,8 @@ NS_ASSUME_NONNULL_BEGIN
 @property (nonatomic, copy, readonly) NSString *name;
 @property (nonatomic, assign, readonly) NSTimeInterval defaultTTL;
 @property (nonatomic, assign, readonly) NSTimeInterval negativeCacheTTL;
+/// Daily lookup allowance, 0 for none (default: 1000)
+@property (nonatomic, assign) NSInteger maxRequestsPerDay;
 
 /**
  * Initialize with custom TTL values and maxAgeInDays
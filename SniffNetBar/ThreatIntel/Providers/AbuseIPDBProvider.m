@@ -21,10 +21,6 @@ static NSInteger const kDefaultMaxAgeInDays = 90;
 @property (nonatomic, assign) NSTimeInterval ttl;
 @property (nonatomic, assign) NSTimeInterval negTTL;
 @property (nonatomic, assign) NSInteger maxAgeInDays;
-
-// Rate limiting
-@property (nonatomic, strong) dispatch_queue_t rateLimitQueue;
-@property (nonatomic, strong) NSMutableArray<NSDate *> *requestTimestamps;
 @end
 
 @implementation AbuseIPDBProvider
@@ -41,10 +37,9 @@ static NSInteger const kDefaultMaxAgeInDays = 90;
         _ttl = ttl;
         _negTTL = negativeTTL;
         _maxAgeInDays = maxAgeInDays;
-        _rateLimitQueue = dispatch_queue_create("com.sniffnetbar.abuseipdb.ratelimit", DISPATCH_QUEUE_SERIAL);
-        _requestTimestamps = [NSMutableArray array];
         _timeout = 10.0;
         _maxRequestsPerMin = 60;
+        _maxRequestsPerDay = 1000;  // Free plan: 1,000 checks a day
     }
     return self;
 }
@@ -132,10 +127,8 @@ static NSInteger const kDefaultMaxAgeInDays = 90;
         return;
     }
 
-    // Apply rate limiting
-    [self waitForRateLimitThenExecute:^{
-        [self performEnrichment:indicator completion:completion];
-    }];
+    // Rate limiting happens in the facade, which only calls in within budget
+    [self performEnrichment:indicator completion:completion];
 }
 
 - (void)shutdown {
@@ -143,44 +136,6 @@ static NSInteger const kDefaultMaxAgeInDays = 90;
     self.session = nil;
 }
 
-#pragma mark - Rate Limiting
-
-- (void)waitForRateLimitThenExecute:(void (^)(void))block {
-    dispatch_async(self.rateLimitQueue, ^{
-        // Clean up old timestamps (older than 1 minute)
-        NSDate *oneMinuteAgo = [NSDate dateWithTimeIntervalSinceNow:-60.0];
-        [self.requestTimestamps filterUsingPredicate:[NSPredicate predicateWithBlock:^BOOL(NSDate *timestamp, NSDictionary *bindings) {
-            return [timestamp compare:oneMinuteAgo] == NSOrderedDescending;
-        }]];
-
-        // Check if we're at rate limit
-        if (self.requestTimestamps.count >= self.maxRequestsPerMin) {
-            // Calculate how long to wait
-            NSDate *oldestTimestamp = self.requestTimestamps.firstObject;
-            NSTimeInterval waitTime = 60.0 - [[NSDate date] timeIntervalSinceDate:oldestTimestamp];
-
-            if (waitTime > 0) {
-                SNBLogThreatIntelDebug("Rate limit reached, waiting %.1f seconds", waitTime);
-                dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(waitTime * NSEC_PER_SEC)),
-                               self.rateLimitQueue, ^{
-                    if (self.requestTimestamps.count > 0) {
-                        [self.requestTimestamps removeObjectAtIndex:0];
-                    }
-                    [self.requestTimestamps addObject:[NSDate date]];
-                    if (block) block();
-                });
-                return;
-            }
-        }
-
-        // Record this request
-        [self.requestTimestamps addObject:[NSDate date]];
-
-        // Execute the block
-        if (block) block();
-    });
-}
-
 #pragma mark - API Request
 
 - (void)performEnrichment:(TIIndicator *)indicator
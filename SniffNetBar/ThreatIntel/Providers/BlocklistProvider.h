@@ -0,0 +1,43 @@
+//
+//  BlocklistProvider.h
+//  SniffNetBar
+//
+//  Offline IOC blocklists answered locally, without an API or a quota
+//
+
+#import <Foundation/Foundation.h>
+#import "ThreatIntelProvider.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ * Answers from FireHOL- or Spamhaus DROP-style list files on disk. The lists
+ * are compiled into the shared table the capture path flags packets against
+ * (Blocklist.h), so an address is checked in memory and no request or
+ * provider budget is spent on it.
+ */
+@interface BlocklistProvider : NSObject <ThreatIntelProvider>
+
+/// Confidence reported for a listed address, 0-100 (default: 80)
+@property (nonatomic, assign) NSInteger confidence;
+
+- (instancetype)initWithTTL:(NSTimeInterval)ttl
+                negativeTTL:(NSTimeInterval)negativeTTL;
+
+/**
+ * Loads the lists at paths on a background queue and publishes the table.
+ * The compiled table is saved to cachePath and mapped from there on later
+ * starts while the sources are unchanged. Every reloadInterval seconds (0 to
+ * never) the sources are checked again, and a changed set is recompiled and
+ * swapped in without pausing lookups. completion runs on the load queue.
+ */
+- (void)loadListsAtPaths:(NSArray<NSString *> *)paths
+               cachePath:(NSString *)cachePath
+          reloadInterval:(NSTimeInterval)reloadInterval
+              completion:(nullable void (^)(NSError * _Nullable error))completion;
+
++ (NSString *)defaultCachePath;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,298 @@
+//
+//  BlocklistProvider.m
+//  SniffNetBar
+//
+//  Offline IOC blocklists answered locally, without an API or a quota
+//
+
+#import "BlocklistProvider.h"
+#import "Blocklist.h"
+#import "Logger.h"
+#import <arpa/inet.h>
+#import <time.h>
+
+static const NSTimeInterval kDefaultTTL = 3600;
+static const NSTimeInterval kDefaultNegativeTTL = 3600;
+static const NSInteger kDefaultConfidence = 80;
+// A reader holds a table for one batch or one answer; a replaced table is
+// freed well after the last of them
+static const NSTimeInterval kRetiredTableLifetime = 60;
+
+@interface BlocklistProvider ()
+@property (nonatomic, assign) NSTimeInterval ttl;
+@property (nonatomic, assign) NSTimeInterval negTTL;
+// Loads, reloads and frees tables, one at a time
+@property (nonatomic, strong) dispatch_queue_t loadQueue;
+@property (nonatomic, strong, nullable) dispatch_source_t reloadTimer;
+@property (nonatomic, copy) NSArray<NSString *> *paths;
+@property (nonatomic, copy) NSString *cachePath;
+@end
+
+@implementation BlocklistProvider
+
+- (instancetype)init {
+    return [self initWithTTL:kDefaultTTL negativeTTL:kDefaultNegativeTTL];
+}
+
+- (instancetype)initWithTTL:(NSTimeInterval)ttl negativeTTL:(NSTimeInterval)negativeTTL {
+    self = [super init];
+    if (self) {
+        _ttl = ttl > 0 ? ttl : kDefaultTTL;
+        _negTTL = negativeTTL > 0 ? negativeTTL : kDefaultNegativeTTL;
+        _confidence = kDefaultConfidence;
+        _loadQueue = dispatch_queue_create("com.sniffnetbar.blocklist", DISPATCH_QUEUE_SERIAL);
+        _paths = @[];
+        _cachePath = [[self class] defaultCachePath];
+    }
+    return self;
+}
+
++ (NSString *)defaultCachePath {
+    NSArray<NSString *> *paths = NSSearchPathForDirectoriesInDomains(NSApplicationSupportDirectory,
+                                                                     NSUserDomainMask,
+                                                                     YES);
+    NSString *baseDir = paths.firstObject ?: NSTemporaryDirectory();
+    NSString *appDir = [baseDir stringByAppendingPathComponent:@"SniffNetBar"];
+    NSFileManager *fm = [NSFileManager defaultManager];
+    if (![fm fileExistsAtPath:appDir]) {
+        [fm createDirectoryAtPath:appDir withIntermediateDirectories:YES attributes:nil error:nil];
+    }
+    return [appDir stringByAppendingPathComponent:@"blocklist.compiled"];
+}
+
+#pragma mark - ThreatIntelProvider
+
+- (NSString *)name {
+    return @"Blocklist";
+}
+
+- (NSTimeInterval)defaultTTL {
+    return self.ttl;
+}
+
+- (NSTimeInterval)negativeCacheTTL {
+    return self.negTTL;
+}
+
+// Lookups are in memory: no key, and no rate limits for the facade to pace
+- (void)configureWithAPIKey:(NSString *)apiKey
+                    timeout:(NSTimeInterval)timeout
+          maxRequestsPerMin:(NSInteger)maxRequestsPerMin
+                 completion:(void (^)(NSError *))completion {
+    if (completion) completion(nil);
+}
+
+- (void)isHealthyWithCompletion:(void (^)(BOOL))completion {
+    if (completion) completion(SNBBlocklistShared() != NULL);
+}
+
+- (BOOL)supportsIndicatorType:(TIIndicatorType)type {
+    return (type == TIIndicatorTypeIPv4 || type == TIIndicatorTypeIPv6);
+}
+
+- (void)enrichIndicator:(TIIndicator *)indicator
+             completion:(void (^)(TIResult *, NSError *))completion {
+    uint8_t address[16] = {0};
+    uint8_t family = SNBAddressFamilyNone;
+    const char *value = indicator.value.UTF8String;
+    if (value && inet_pton(AF_INET, value, address) == 1) {
+        family = SNBAddressFamilyIPv4;
+    } else if (value && inet_pton(AF_INET6, value, address) == 1) {
+        family = SNBAddressFamilyIPv6;
+    }
+    if (![self supportsIndicatorType:indicator.type] || family == SNBAddressFamilyNone) {
+        NSError *error = [NSError errorWithDomain:@"BlocklistProvider"
+                                             code:1002
+                                         userInfo:@{NSLocalizedDescriptionKey: @"Unsupported indicator type"}];
+        if (completion) completion(nil, error);
+        return;
+    }
+
+    const SNBBlocklist *blocklist = SNBBlocklistShared();
+    if (!blocklist) {
+        NSError *error = [NSError errorWithDomain:@"BlocklistProvider"
+                                             code:1001
+                                         userInfo:@{NSLocalizedDescriptionKey: @"No blocklist loaded"}];
+        if (completion) completion(nil, error);
+        return;
+    }
+
+    uint32_t lists = SNBBlocklistLookup(blocklist, family, address);
+    NSMutableArray<NSString *> *listNames = [NSMutableArray array];
+    for (uint32_t list = 0; list < blocklist->listCount; list++) {
+        if (lists & (1u << list)) {
+            [listNames addObject:@(blocklist->listNames[list])];
+        }
+    }
+    if (completion) completion([self resultForIndicator:indicator listNames:listNames], nil);
+}
+
+- (void)shutdown {
+    dispatch_sync(self.loadQueue, ^{
+        if (self.reloadTimer) {
+            dispatch_source_cancel(self.reloadTimer);
+            self.reloadTimer = nil;
+        }
+        [self retireTable:SNBBlocklistPublish(NULL)];
+    });
+}
+
+#pragma mark - Loading
+
+- (void)loadListsAtPaths:(NSArray<NSString *> *)paths
+               cachePath:(NSString *)cachePath
+          reloadInterval:(NSTimeInterval)reloadInterval
+              completion:(void (^)(NSError *))completion {
+    dispatch_async(self.loadQueue, ^{
+        NSMutableArray<NSString *> *expanded = [NSMutableArray arrayWithCapacity:paths.count];
+        for (NSString *path in paths) {
+            [expanded addObject:path.stringByExpandingTildeInPath];
+        }
+        self.paths = expanded;
+        self.cachePath = cachePath;
+
+        NSError *error = nil;
+        [self reloadIfChanged:&error];
+        [self scheduleReloadEvery:reloadInterval];
+        if (completion) completion(error);
+    });
+}
+
+- (void)scheduleReloadEvery:(NSTimeInterval)interval {
+    if (self.reloadTimer) {
+        dispatch_source_cancel(self.reloadTimer);
+        self.reloadTimer = nil;
+    }
+    if (interval <= 0) {
+        return;
+    }
+    dispatch_source_t timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, self.loadQueue);
+    uint64_t intervalNs = (uint64_t)(interval * NSEC_PER_SEC);
+    dispatch_source_set_timer(timer, dispatch_time(DISPATCH_TIME_NOW, (int64_t)intervalNs), intervalNs, intervalNs / 10);
+    __weak typeof(self) weakSelf = self;
+    dispatch_source_set_event_handler(timer, ^{
+        [weakSelf reloadIfChanged:NULL];
+    });
+    self.reloadTimer = timer;
+    dispatch_resume(timer);
+}
+
+// Runs on loadQueue. The sources' paths, sizes and modification times decide
+// whether the published table, then the compiled file, is still current;
+// only when neither is are the lists parsed again.
+- (BOOL)reloadIfChanged:(NSError **)error {
+    uint64_t signature = SNB_BLOCKLIST_SIGNATURE_SEED;
+    for (NSString *path in self.paths) {
+        signature = SNBBlocklistSignatureAddFile(signature, path.fileSystemRepresentation);
+    }
+    const SNBBlocklist *current = SNBBlocklistShared();
+    if (current && current->sourceSignature == signature) {
+        return YES;
+    }
+
+    uint64_t startNs = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+    SNBBlocklist *blocklist = SNBBlocklistMap(self.cachePath.fileSystemRepresentation, signature);
+    if (blocklist) {
+        SNBLogThreatIntelInfo("Mapped compiled blocklist: %llu prefixes in %u intervals, %.1f ms",
+                              (unsigned long long)blocklist->prefixCount,
+                              blocklist->ipv4Count + blocklist->ipv6Count,
+                              (double)(clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - startNs) / 1e6);
+    } else {
+        blocklist = [self compileWithSignature:signature error:error];
+        if (!blocklist) {
+            return NO;
+        }
+        SNBLogThreatIntelInfo("Compiled blocklist: %llu prefixes in %u intervals (%.1f MB), %.1f ms",
+                              (unsigned long long)blocklist->prefixCount,
+                              blocklist->ipv4Count + blocklist->ipv6Count,
+                              (double)SNBBlocklistMemoryBytes(blocklist) / (1024.0 * 1024.0),
+                              (double)(clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - startNs) / 1e6);
+        if (!SNBBlocklistWrite(blocklist, self.cachePath.fileSystemRepresentation)) {
+            SNBLogThreatIntelWarn("Could not save the compiled blocklist to %{public}@", self.cachePath);
+        }
+    }
+    [self retireTable:SNBBlocklistPublish(blocklist)];
+    return YES;
+}
+
+- (SNBBlocklist *)compileWithSignature:(uint64_t)signature error:(NSError **)error {
+    SNBBlocklistBuilder *builder = SNBBlocklistBuilderCreate();
+    if (!builder) {
+        if (error) {
+            *error = [NSError errorWithDomain:@"BlocklistProvider"
+                                         code:1003
+                                     userInfo:@{NSLocalizedDescriptionKey: @"Out of memory compiling the blocklists"}];
+        }
+        return NULL;
+    }
+    for (NSString *path in self.paths) {
+        int list = SNBBlocklistBuilderAddList(builder, path.lastPathComponent.UTF8String);
+        if (list < 0) {
+            SNBLogThreatIntelWarn("Skipping blocklist %{public}@: at most %d lists are loaded",
+                                  path, SNB_BLOCKLIST_MAX_LISTS);
+            continue;
+        }
+        size_t added = 0;
+        size_t rejected = 0;
+        if (!SNBBlocklistBuilderAddFile(builder, list, path.fileSystemRepresentation, &added, &rejected)) {
+            SNBLogThreatIntelWarn("Could not read blocklist %{public}@", path);
+            continue;
+        }
+        if (rejected > 0) {
+            SNBLogThreatIntelWarn("Blocklist %{public}@: %lu entries loaded, %lu lines not understood",
+                                  path, (unsigned long)added, (unsigned long)rejected);
+        } else {
+            SNBLogThreatIntelDebug("Blocklist %{public}@: %lu entries loaded", path, (unsigned long)added);
+        }
+    }
+    SNBBlocklist *blocklist = SNBBlocklistBuilderCompile(builder, signature);
+    SNBBlocklistBuilderDestroy(builder);
+    if (!blocklist && error) {
+        *error = [NSError errorWithDomain:@"BlocklistProvider"
+                                     code:1003
+                                 userInfo:@{NSLocalizedDescriptionKey: @"Out of memory compiling the blocklists"}];
+    }
+    return blocklist;
+}
+
+// The capture queue or an answer may still be reading a replaced table
+- (void)retireTable:(SNBBlocklist *)blocklist {
+    if (!blocklist) {
+        return;
+    }
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(kRetiredTableLifetime * NSEC_PER_SEC)), self.loadQueue, ^{
+        SNBBlocklistDestroy(blocklist);
+    });
+}
+
+#pragma mark - Results
+
+- (TIResult *)resultForIndicator:(TIIndicator *)indicator listNames:(NSArray<NSString *> *)listNames {
+    BOOL listed = listNames.count > 0;
+
+    TIVerdict *verdict = [[TIVerdict alloc] init];
+    verdict.hit = listed;
+    verdict.confidence = listed ? self.confidence : 0;
+    verdict.categories = listed ? @[@"blocklist"] : @[];
+    verdict.tags = [listNames copy];
+    verdict.lastSeen = nil;
+    verdict.evidence = listed ? @{@"lists": [listNames componentsJoinedByString:@", "]} : @{};
+
+    TIMetadata *metadata = [[TIMetadata alloc] init];
+    metadata.sourceURL = nil;
+    metadata.fetchedAt = [NSDate date];
+    metadata.ttlSeconds = listed ? self.ttl : self.negTTL;
+    metadata.expiresAt = [NSDate dateWithTimeIntervalSinceNow:metadata.ttlSeconds];
+    metadata.rateLimitRemaining = -1;
+
+    TIResult *result = [[TIResult alloc] init];
+    result.indicator = indicator;
+    result.providerName = self.name;
+    result.verdict = verdict;
+    result.metadata = metadata;
+    result.error = nil;
+
+    return result;
+}
+
+@end
@@ -16,6 +16,9 @@ NS_ASSUME_NONNULL_BEGIN
  */
 @interface GreyNoiseProvider : NSObject <ThreatIntelProvider>
 
+/// Daily lookup allowance, 0 for none (default: 0)
+@property (nonatomic, assign) NSInteger maxRequestsPerDay;
+
 - (instancetype)initWithTTL:(NSTimeInterval)ttl
                 negativeTTL:(NSTimeInterval)negativeTTL;
 
@@ -9,6 +9,9 @@ NS_ASSUME_NONNULL_BEGIN
 
 @interface ShodanProvider : NSObject <ThreatIntelProvider>
 
+/// Daily lookup allowance, 0 for none (default: 0)
+@property (nonatomic, assign) NSInteger maxRequestsPerDay;
+
 - (instancetype)initWithTTL:(NSTimeInterval)ttl negativeTTL:(NSTimeInterval)negativeTTL;
 
 - (void)configureWithBaseURL:(NSString *)baseURL
@@ -19,9 +19,6 @@ static NSTimeInterval const kDefaultNegativeTTL = 3600.0;  // 1 hour
 @property (nonatomic, assign) NSInteger maxRequestsPerMin;
 @property (nonatomic, assign) NSTimeInterval ttl;
 @property (nonatomic, assign) NSTimeInterval negTTL;
-
-@property (nonatomic, strong) dispatch_queue_t rateLimitQueue;
-@property (nonatomic, strong) NSMutableArray<NSDate *> *requestTimestamps;
 @end
 
 @implementation ShodanProvider
@@ -37,8 +34,7 @@ static NSTimeInterval const kDefaultNegativeTTL = 3600.0;  // 1 hour
         _negTTL = negativeTTL;
         _timeout = 10.0;
         _maxRequestsPerMin = 60;
-        _rateLimitQueue = dispatch_queue_create("com.sniffnetbar.shodan.ratelimit", DISPATCH_QUEUE_SERIAL);
-        _requestTimestamps = [NSMutableArray array];
+        _maxRequestsPerDay = 0;  // No daily limit
     }
     return self;
 }
@@ -133,9 +129,7 @@ static NSTimeInterval const kDefaultNegativeTTL = 3600.0;  // 1 hour
         return;
     }
 
-    [self waitForRateLimitThenExecute:^{
-        [self performEnrichment:indicator completion:completion];
-    }];
+    [self performEnrichment:indicator completion:completion];
 }
 
 - (void)shutdown {
@@ -143,38 +137,6 @@ static NSTimeInterval const kDefaultNegativeTTL = 3600.0;  // 1 hour
     self.session = nil;
 }
 
-#pragma mark - Rate Limiting
-
-- (void)waitForRateLimitThenExecute:(void (^)(void))block {
-    dispatch_async(self.rateLimitQueue, ^{
-        NSDate *oneMinuteAgo = [NSDate dateWithTimeIntervalSinceNow:-60.0];
-        [self.requestTimestamps filterUsingPredicate:[NSPredicate predicateWithBlock:^BOOL(NSDate *timestamp, NSDictionary *bindings) {
-            return [timestamp compare:oneMinuteAgo] == NSOrderedDescending;
-        }]];
-
-        if (self.requestTimestamps.count >= self.maxRequestsPerMin) {
-            NSDate *oldestTimestamp = self.requestTimestamps.firstObject;
-            NSTimeInterval waitTime = 60.0 - [[NSDate date] timeIntervalSinceDate:oldestTimestamp];
-
-            if (waitTime > 0) {
-                SNBLogThreatIntelDebug("Rate limit reached, waiting %.1f seconds", waitTime);
-                dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(waitTime * NSEC_PER_SEC)),
-                               self.rateLimitQueue, ^{
-                    if (self.requestTimestamps.count > 0) {
-                        [self.requestTimestamps removeObjectAtIndex:0];
-                    }
-                    [self.requestTimestamps addObject:[NSDate date]];
-                    if (block) block();
-                });
-                return;
-            }
-        }
-
-        [self.requestTimestamps addObject:[NSDate date]];
-        if (block) block();
-    });
-}
-
 #pragma mark - API Request
 
 - (void)performEnrichment:(TIIndicator *)indicator
@@ -14,7 +14,7 @@ NS_ASSUME_NONNULL_BEGIN
  * VirusTotal API v3 provider for IP address reputation checks
  *
  * Supports IPv4 and IPv6 address lookups via VirusTotal's public API.
- * Implements rate limiting and caching as per the ThreatIntelProvider protocol.
+ * Calls are paced by the facade within maxRequestsPerMin and maxRequestsPerDay.
  *
  * API Documentation: https://developers.virustotal.com/reference/ip-info
  */
@@ -23,6 +23,8 @@ NS_ASSUME_NONNULL_BEGIN
 @property (nonatomic, copy, readonly) NSString *name;
 @property (nonatomic, assign, readonly) NSTimeInterval defaultTTL;
 @property (nonatomic, assign, readonly) NSTimeInterval negativeCacheTTL;
+/// Daily lookup allowance, 0 for none (default: 500)
+@property (nonatomic, assign) NSInteger maxRequestsPerDay;
 
 /**
  * Initialize with custom TTL values
@@ -19,10 +19,6 @@ static NSTimeInterval const kDefaultNegativeTTL = 3600.0;  // 1 hour
 @property (nonatomic, assign) NSInteger maxRequestsPerMin;
 @property (nonatomic, assign) NSTimeInterval ttl;
 @property (nonatomic, assign) NSTimeInterval negTTL;
-
-// Rate limiting
-@property (nonatomic, strong) dispatch_queue_t rateLimitQueue;
-@property (nonatomic, strong) NSMutableArray<NSDate *> *requestTimestamps;
 @end
 
 @implementation VirusTotalProvider
@@ -36,10 +32,9 @@ static NSTimeInterval const kDefaultNegativeTTL = 3600.0;  // 1 hour
     if (self) {
         _ttl = ttl;
         _negTTL = negativeTTL;
-        _rateLimitQueue = dispatch_queue_create("com.sniffnetbar.virustotal.ratelimit", DISPATCH_QUEUE_SERIAL);
-        _requestTimestamps = [NSMutableArray array];
         _timeout = 10.0;
         _maxRequestsPerMin = 4;  // Free API tier limit
+        _maxRequestsPerDay = 500;  // Free API tier: 500 lookups a day
     }
     return self;
 }
@@ -128,10 +123,8 @@ static NSTimeInterval const kDefaultNegativeTTL = 3600.0;  // 1 hour
         return;
     }
 
-    // Apply rate limiting
-    [self waitForRateLimitThenExecute:^{
-        [self performEnrichment:indicator completion:completion];
-    }];
+    // The facade's scheduler has already spent this call's request budget
+    [self performEnrichment:indicator completion:completion];
 }
 
 - (void)shutdown {
@@ -139,40 +132,6 @@ static NSTimeInterval const kDefaultNegativeTTL = 3600.0;  // 1 hour
     self.session = nil;
 }
 
-#pragma mark - Rate Limiting
-
-- (void)waitForRateLimitThenExecute:(void (^)(void))block {
-    dispatch_async(self.rateLimitQueue, ^{
-        // Clean up old timestamps (older than 1 minute)
-        NSDate *oneMinuteAgo = [NSDate dateWithTimeIntervalSinceNow:-60.0];
-        [self.requestTimestamps filterUsingPredicate:[NSPredicate predicateWithBlock:^BOOL(NSDate *timestamp, NSDictionary *bindings) {
-            return [timestamp compare:oneMinuteAgo] == NSOrderedDescending;
-        }]];
-
-        // Check if we're at rate limit
-        if (self.requestTimestamps.count >= self.maxRequestsPerMin) {
-            NSDate *oldestTimestamp = self.requestTimestamps.firstObject;
-            NSTimeInterval waitTime = 60.0 - [[NSDate date] timeIntervalSinceDate:oldestTimestamp];
-
-            if (waitTime > 0) {
-                SNBLogThreatIntelDebug("Rate limit reached, waiting %.1f seconds", waitTime);
-                dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(waitTime * NSEC_PER_SEC)),
-                               self.rateLimitQueue, ^{
-                    if (self.requestTimestamps.count > 0) {
-                        [self.requestTimestamps removeObjectAtIndex:0];
-                    }
-                    [self.requestTimestamps addObject:[NSDate date]];
-                    if (block) block();
-                });
-                return;
-            }
-        }
-
-        [self.requestTimestamps addObject:[NSDate date]];
-        if (block) block();
-    });
-}
-
 #pragma mark - API Request
 
 - (void)performEnrichment:(TIIndicator *)indicator
@@ -2,7 +2,7 @@
 //  ThreatIntelCache.h
 //  SniffNetBar
 //
-//  Simple TTL-based cache for threat intel results
+//  Bounded LRU cache for threat intel results, each kept until it expires
 //
 
 #import <Foundation/Foundation.h>
@@ -33,7 +33,7 @@ NS_ASSUME_NONNULL_BEGIN
 /// Clear all
 - (void)clear;
 
-/// Stats
+/// Stats. The snapshot has size, hitRate, hits, misses, evictions, expirations and capacity
 - (NSInteger)size;
 - (double)hitRate;
 - (NSDictionary *)statsSnapshot;
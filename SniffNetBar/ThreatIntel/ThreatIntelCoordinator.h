@@ -21,5 +21,11 @@
 - (NSDictionary *)cacheStats;
 - (NSString * _Nullable)availabilityMessage;
 - (void)enrichIPIfNeeded:(NSString *)ipAddress completion:(dispatch_block_t)completion;
+// Higher priorities are looked up first when provider budgets run short
+// (see SNBRequestPriorityScore). If a provider had no budget left, the
+// completion runs again once its deferred answer arrives.
+- (void)enrichIPIfNeeded:(NSString *)ipAddress priority:(double)priority completion:(dispatch_block_t)completion;
+// Drops waiting lookups for destinations that are gone from the traffic
+- (void)cancelEnrichmentsExceptIPs:(NSSet<NSString *> *)activeIPs;
 
 @end
@@ -12,12 +12,18 @@
 #import "AbuseIPDBProvider.h"
 #import "GreyNoiseProvider.h"
 #import "ShodanProvider.h"
+#import "BlocklistProvider.h"
 #import "IPAddressUtilities.h"
 #import "Logger.h"
 
 @interface ThreatIntelCoordinator ()
 @property (nonatomic, strong) ConfigurationManager *configuration;
 @property (nonatomic, strong) NSMutableDictionary<NSString *, TIEnrichmentResponse *> *results;
+// IPs handed to the facade and not answered yet, so the once-a-second stats
+// pass does not queue the same destination again while it waits
+@property (nonatomic, strong) NSMutableSet<NSString *> *pendingIPs;
+// Completions to run again when a lookup deferred for provider budget lands
+@property (nonatomic, strong) NSMutableDictionary<NSString *, dispatch_block_t> *deferredCompletions;
 @end
 
 @implementation ThreatIntelCoordinator
@@ -28,12 +34,22 @@
         _configuration = configuration;
         _facade = [ThreatIntelFacade sharedInstance];
         _results = [NSMutableDictionary dictionary];
+        _pendingIPs = [NSMutableSet set];
+        _deferredCompletions = [NSMutableDictionary dictionary];
         [self loadEnabledState];
         [self configureProviders];
+        [[NSNotificationCenter defaultCenter] addObserver:self
+                                                 selector:@selector(deferredLookupDidComplete:)
+                                                     name:TIDeferredLookupDidCompleteNotification
+                                                   object:self.facade];
     }
     return self;
 }
 
+- (void)dealloc {
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+}
+
 - (void)loadEnabledState {
     BOOL enabled = [[NSUserDefaults standardUserDefaults] boolForKey:SNBUserDefaultsKeyThreatIntelEnabled];
     self.facade.enabled = enabled;
@@ -57,6 +73,7 @@
                 SNBLogThreatIntelInfo("VirusTotal provider configured successfully");
             }
         }];
+        vtProvider.maxRequestsPerDay = config.virusTotalMaxRequestsPerDay;
         [self.facade addProvider:vtProvider];
         SNBLogThreatIntelDebug("VirusTotal provider added");
         [self logProviderHealth:vtProvider];
@@ -81,6 +98,7 @@
                 SNBLogThreatIntelInfo("AbuseIPDB provider configured successfully");
             }
         }];
+        abuseProvider.maxRequestsPerDay = config.abuseIPDBMaxRequestsPerDay;
         [self.facade addProvider:abuseProvider];
         SNBLogThreatIntelDebug("AbuseIPDB provider added");
         [self logProviderHealth:abuseProvider];
@@ -104,6 +122,7 @@
                 SNBLogThreatIntelInfo("GreyNoise provider configured successfully");
             }
         }];
+        greyNoiseProvider.maxRequestsPerDay = config.greyNoiseMaxRequestsPerDay;
         [self.facade addProvider:greyNoiseProvider];
         SNBLogThreatIntelDebug("GreyNoise provider added");
         [self logProviderHealth:greyNoiseProvider];
@@ -127,6 +146,7 @@
                 SNBLogThreatIntelInfo("Shodan provider configured successfully");
             }
         }];
+        shodanProvider.maxRequestsPerDay = config.shodanMaxRequestsPerDay;
         [self.facade addProvider:shodanProvider];
         SNBLogThreatIntelDebug("Shodan provider added");
         [self logProviderHealth:shodanProvider];
@@ -136,6 +156,28 @@
                                config.shodanAPIKey.length > 0 ? @"YES" : @"NO");
     }
 
+    if (config.blocklistEnabled && config.blocklistPaths.count > 0) {
+        BlocklistProvider *blocklistProvider = [[BlocklistProvider alloc] initWithTTL:config.blocklistTTL
+                                                                          negativeTTL:config.blocklistTTL];
+        blocklistProvider.confidence = config.blocklistConfidence;
+        [blocklistProvider loadListsAtPaths:config.blocklistPaths
+                                  cachePath:[BlocklistProvider defaultCachePath]
+                             reloadInterval:config.blocklistReloadInterval
+                                 completion:^(NSError *error) {
+            if (error) {
+                SNBLogThreatIntelError("Failed to load blocklists: %{public}@", error.localizedDescription);
+            } else {
+                SNBLogThreatIntelInfo("Blocklist provider loaded %lu lists", (unsigned long)config.blocklistPaths.count);
+            }
+        }];
+        [self.facade addProvider:blocklistProvider];
+        SNBLogThreatIntelDebug("Blocklist provider added");
+    } else {
+        SNBLogThreatIntelDebug("Blocklist provider disabled (enabled: %{public}@, lists: %lu)",
+                               config.blocklistEnabled ? @"YES" : @"NO",
+                               (unsigned long)config.blocklistPaths.count);
+    }
+
     SNBLogThreatIntelInfo("Threat Intelligence initialized (enabled: %{public}@)", self.isEnabled ? @"YES" : @"NO");
 }
 
@@ -161,6 +203,7 @@
 
     if (!enabled) {
         [self.results removeAllObjects];
+        [self.deferredCompletions removeAllObjects];
     }
 }
 
@@ -180,6 +223,10 @@
 }
 
 - (void)enrichIPIfNeeded:(NSString *)ipAddress completion:(dispatch_block_t)completion {
+    [self enrichIPIfNeeded:ipAddress priority:0.0 completion:completion];
+}
+
+- (void)enrichIPIfNeeded:(NSString *)ipAddress priority:(double)priority completion:(dispatch_block_t)completion {
     if (!self.isEnabled) {
         return;
     }
@@ -187,11 +234,44 @@
         SNBLogThreatIntelDebug("Skipping threat intel for private/local IP: %{" SNB_IP_PRIVACY "}@", ipAddress);
         return;
     }
-    if (self.results[ipAddress]) {
+    if (self.results[ipAddress] || [self.pendingIPs containsObject:ipAddress]) {
+        return;
+    }
+    [self requestEnrichmentForIP:ipAddress priority:priority completion:completion];
+}
+
+- (void)cancelEnrichmentsExceptIPs:(NSSet<NSString *> *)activeIPs {
+    if (!self.isEnabled) {
         return;
     }
+    for (NSString *ipAddress in self.deferredCompletions.allKeys) {
+        if (![activeIPs containsObject:ipAddress]) {
+            [self.deferredCompletions removeObjectForKey:ipAddress];
+        }
+    }
+    [self.facade cancelEnrichmentsExceptIndicatorValues:activeIPs];
+}
 
-    [self.facade enrichIP:ipAddress completion:^(TIEnrichmentResponse *response, NSError *error) {
+- (void)deferredLookupDidComplete:(NSNotification *)notification {
+    TIIndicator *indicator = notification.userInfo[TIIndicatorUserInfoKey];
+    NSString *ipAddress = indicator.value;
+    dispatch_block_t completion = ipAddress ? self.deferredCompletions[ipAddress] : nil;
+    if (!completion || !self.isEnabled || [self.pendingIPs containsObject:ipAddress]) {
+        return;
+    }
+    // The provider's answer is cached now, so this completes without a call
+    [self.deferredCompletions removeObjectForKey:ipAddress];
+    [self requestEnrichmentForIP:ipAddress priority:0.0 completion:completion];
+}
+
+- (void)requestEnrichmentForIP:(NSString *)ipAddress priority:(double)priority completion:(dispatch_block_t)completion {
+    [self.pendingIPs addObject:ipAddress];
+    [self.facade enrichIP:ipAddress priority:priority completion:^(TIEnrichmentResponse *response, NSError *error) {
+        [self.pendingIPs removeObject:ipAddress];
+        NSArray<NSString *> *deferredProviders = response.deferredProviders ?: error.userInfo[@"deferredProviders"];
+        if (deferredProviders.count > 0 && completion) {
+            self.deferredCompletions[ipAddress] = completion;
+        }
         if (response && response.scoringResult) {
             self.results[ipAddress] = response;
 
@@ -219,6 +299,14 @@
                     completion();
                 });
             }
+        } else if (error.code == TIErrorCodeQueueFull && [error.domain isEqualToString:TIErrorDomain]) {
+            // Backpressure: the next stats pass asks again
+            SNBLogThreatIntelDebug("Threat intel queue full, deferring %{" SNB_IP_PRIVACY "}@", ipAddress);
+        } else if (error.code == TIErrorCodeRateLimited && [error.domain isEqualToString:TIErrorDomain]) {
+            SNBLogThreatIntelDebug("Threat intel lookup for %{" SNB_IP_PRIVACY "}@ waiting for %{public}@",
+                                   ipAddress, [deferredProviders componentsJoinedByString:@", "]);
+        } else if (error.code == TIErrorCodeCancelled && [error.domain isEqualToString:TIErrorDomain]) {
+            SNBLogThreatIntelDebug("Threat intel lookup for %{" SNB_IP_PRIVACY "}@ cancelled", ipAddress);
         } else if (error) {
             NSString *provider = [self providerNameFromError:error];
             if (provider.length > 0) {
@@ -247,6 +335,9 @@
     if ([error.domain isEqualToString:@"ShodanProvider"]) {
         return @"Shodan";
     }
+    if ([error.domain isEqualToString:@"BlocklistProvider"]) {
+        return @"Blocklist";
+    }
     NSArray<NSError *> *providerErrors = error.userInfo[@"providerErrors"];
     if ([providerErrors isKindOfClass:[NSArray class]] && providerErrors.count > 0) {
         NSMutableSet<NSString *> *names = [NSMutableSet set];
@@ -11,16 +11,40 @@
 
 NS_ASSUME_NONNULL_BEGIN
 
+@class ThreatIntelStore;
+
 typedef void (^TIEnrichmentCompletion)(TIEnrichmentResponse * _Nullable response, NSError * _Nullable error);
 
+/// Posted on the main queue when a lookup that waited for a provider's
+/// request budget has been answered and cached. Enriching the indicator
+/// again picks the answer up. userInfo[TIIndicatorUserInfoKey] is the TIIndicator.
+extern NSNotificationName const TIDeferredLookupDidCompleteNotification;
+extern NSString *const TIIndicatorUserInfoKey;
+
 @interface ThreatIntelFacade : NSObject
 
 /// Singleton instance
 + (instancetype)sharedInstance;
 
+/// Uses the given persistent store instead of the one in Application Support
+- (instancetype)initWithStore:(ThreatIntelStore *)store NS_DESIGNATED_INITIALIZER;
+
 /// Enable/disable threat intel
 @property (nonatomic, assign, getter=isEnabled) BOOL enabled;
 
+/// Indicators whose providers are queried at the same time; the rest wait,
+/// highest priority first. Provider calls never block a thread, so this
+/// bounds the outstanding API requests rather than the number of threads.
+@property (nonatomic, assign) NSUInteger maxConcurrentEnrichments;
+
+/// Indicators allowed to wait for a slot. Further requests complete at once
+/// with TIErrorCodeQueueFull, so callers can simply retry later.
+@property (nonatomic, assign) NSUInteger maxQueuedEnrichments;
+
+/// How long an indicator waits for its providers before it completes with
+/// whatever results have arrived and TIErrorCodeTimeout
+@property (nonatomic, assign) NSTimeInterval enrichmentTimeout;
+
 /// Configure with providers
 - (void)configureWithProviders:(NSArray<id<ThreatIntelProvider>> *)providers;
 
@@ -31,15 +55,34 @@ typedef void (^TIEnrichmentCompletion)(TIEnrichmentResponse * _Nullable response
 - (void)enrichIndicator:(TIIndicator *)indicator
              completion:(TIEnrichmentCompletion)completion;
 
+/// Enrich a single indicator, ahead of queued ones with a lower priority
+/// (see SNBRequestPriorityScore). Providers whose per-minute or per-day
+/// budget is spent are not waited for: their lookups queue by the same
+/// priority and the response lists them in deferredProviders. When no
+/// provider could answer yet, the completion gets TIErrorCodeRateLimited
+/// with the names under userInfo[@"deferredProviders"].
+- (void)enrichIndicator:(TIIndicator *)indicator
+               priority:(double)priority
+             completion:(TIEnrichmentCompletion)completion;
+
 /// Enrich IP address (convenience)
 - (void)enrichIP:(NSString *)ipAddress
       completion:(TIEnrichmentCompletion)completion;
+- (void)enrichIP:(NSString *)ipAddress
+        priority:(double)priority
+      completion:(TIEnrichmentCompletion)completion;
+
+/// Drops queued enrichments and deferred lookups for indicators that are
+/// not in activeValues; their callers get TIErrorCodeCancelled
+- (void)cancelEnrichmentsExceptIndicatorValues:(NSSet<NSString *> *)activeValues;
 
 /// Enrich multiple indicators (batch)
 - (void)enrichIndicators:(NSArray<TIIndicator *> *)indicators
               completion:(void (^)(NSArray<TIEnrichmentResponse *> *responses))completion;
 
-/// Get cache stats
+/// Cache counters, the enrichment queue's depth, window and outcomes,
+/// per-provider lookup queues and budgets under "providerQueues", and the
+/// store's indicator filter skip and false-positive rates ("storeFilter...")
 - (NSDictionary *)cacheStats;
 
 /// Check if any providers are available
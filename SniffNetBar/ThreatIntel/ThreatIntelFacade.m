@@ -9,14 +9,120 @@
 #import "ConfigurationManager.h"
 #import "IPAddressUtilities.h"
 #import "Logger.h"
+#import "RequestScheduler.h"
 #import <math.h>
 
-@interface ThreatIntelFacade ()
+NSNotificationName const TIDeferredLookupDidCompleteNotification = @"TIDeferredLookupDidCompleteNotification";
+NSString *const TIIndicatorUserInfoKey = @"indicator";
+
+typedef NS_ENUM(NSInteger, TIEnrichmentTaskState) {
+    TIEnrichmentTaskStateQueued,
+    TIEnrichmentTaskStateQuerying,
+    TIEnrichmentTaskStateFinished
+};
+
+// One indicator's trip through the engine. Only touched on enrichmentQueue.
+@interface TIEnrichmentTask : NSObject
+@property (nonatomic, strong) TIIndicator *indicator;
+@property (nonatomic, copy) NSString *key;
+@property (nonatomic, assign) TIEnrichmentTaskState state;
+@property (nonatomic, strong) NSMutableArray<TIEnrichmentCompletion> *callbacks;
+@property (nonatomic, strong) NSMutableArray<TIResult *> *results;
+@property (nonatomic, strong) NSMutableArray<NSError *> *errors;
+@property (nonatomic, strong) NSMutableArray<NSString *> *deferredProviders;
+@property (nonatomic, assign) NSInteger cacheHits;
+@property (nonatomic, assign) double priority;
+@property (nonatomic, assign) uint32_t queueSlot;
+@property (nonatomic, assign) NSUInteger pendingProviders;
+@property (nonatomic, assign) uint64_t enqueuedNs;
+@property (nonatomic, assign) uint64_t startedNs;
+@property (nonatomic, strong, nullable) dispatch_source_t timeoutTimer;
+@end
+
+@implementation TIEnrichmentTask
+@end
+
+// A provider lookup waiting for budget. It is not tied to a task: the
+// answer goes to the cache and TIDeferredLookupDidCompleteNotification.
+@interface TIDeferredLookup : NSObject
+@property (nonatomic, strong) TIIndicator *indicator;
+@property (nonatomic, copy) NSString *key;
+@property (nonatomic, assign) uint64_t enqueuedNs;
+@end
+
+@implementation TIDeferredLookup
+@end
+
+// One provider's budget and its queue of deferred lookups. Only touched on
+// enrichmentQueue.
+@interface TIProviderLane : NSObject {
+    SNBRequestBudget _budget;
+}
+@property (nonatomic, strong) id<ThreatIntelProvider> provider;
+@property (nonatomic, assign) SNBRequestQueue *queue;
+@property (nonatomic, strong) NSMutableDictionary<NSNumber *, TIDeferredLookup *> *lookupsBySlot;
+@property (nonatomic, strong) NSMutableDictionary<NSString *, NSNumber *> *slotsByKey;
+@property (nonatomic, strong, nullable) dispatch_source_t timer;
+@property (nonatomic, assign) uint64_t immediateCount;
+@property (nonatomic, assign) uint64_t deferredCount;
+@property (nonatomic, assign) uint64_t dispatchedDeferredCount;
+@property (nonatomic, assign) uint64_t totalDeferredWaitNs;
+- (SNBRequestBudget *)budget;
+@end
+
+@implementation TIProviderLane
+
+- (instancetype)initWithProvider:(id<ThreatIntelProvider>)provider nowNs:(uint64_t)nowNs {
+    self = [super init];
+    if (self) {
+        _provider = provider;
+        _queue = SNBRequestQueueCreate(64);
+        if (!_queue) {
+            return nil;
+        }
+        _lookupsBySlot = [NSMutableDictionary dictionary];
+        _slotsByKey = [NSMutableDictionary dictionary];
+        SNBRequestBudgetInit(&_budget, 0, 0, nowNs);
+    }
+    return self;
+}
+
+- (void)dealloc {
+    if (_timer) {
+        dispatch_source_cancel(_timer);
+    }
+    SNBRequestQueueDestroy(_queue);
+}
+
+- (SNBRequestBudget *)budget {
+    return &_budget;
+}
+
+@end
+
+@interface ThreatIntelFacade () {
+    // Engine counters, guarded by enrichmentQueue
+    uint64_t _submittedCount;
+    uint64_t _coalescedCount;
+    uint64_t _rejectedCount;
+    uint64_t _completedCount;
+    uint64_t _timedOutCount;
+    uint64_t _cancelledCount;
+    uint64_t _totalWaitNs;
+    uint64_t _totalQueryNs;
+    NSUInteger _peakQueued;
+    NSUInteger _inFlightCount;
+    BOOL _pumping;
+    // Tasks waiting for a slot, highest priority first
+    SNBRequestQueue *_taskQueue;
+}
 @property (nonatomic, strong) NSMutableArray<id<ThreatIntelProvider>> *providers;
 @property (nonatomic, strong) ThreatIntelCache *cache;
 @property (nonatomic, strong) ThreatIntelStore *store;
 @property (nonatomic, strong) dispatch_queue_t enrichmentQueue;
-@property (nonatomic, strong) NSMutableDictionary<NSString *, NSMutableArray *> *inFlightRequests;
+@property (nonatomic, strong) NSMutableDictionary<NSString *, TIEnrichmentTask *> *tasksByKey;
+@property (nonatomic, strong) NSMutableDictionary<NSNumber *, TIEnrichmentTask *> *queuedTasksBySlot;
+@property (nonatomic, strong) NSMutableDictionary<NSString *, TIProviderLane *> *lanes;
 @property (nonatomic, strong) NSMutableDictionary<NSString *, NSDate *> *providerDisabledUntil;
 @property (nonatomic, strong) NSMutableDictionary<NSString *, NSString *> *providerDisableReasons;
 @end
@@ -28,6 +134,13 @@ static NSTimeInterval const kProviderRateLimitCooldown = 3600.0;
 static NSTimeInterval const kProviderQuotaCooldown = 86400.0;  // 24 hours for quota exceeded
 static NSTimeInterval const kProviderAuthCooldown = 3600.0;
 static NSString *const kProviderRetryAfterKey = @"retry_after";
+static NSUInteger const kDefaultMaxConcurrentEnrichments = 8;
+static NSUInteger const kDefaultMaxQueuedEnrichments = 4096;
+static NSTimeInterval const kDefaultEnrichmentTimeout = 10.0;
+
+static uint64_t TIMonotonicNs(void) {
+    return clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+}
 
 + (instancetype)sharedInstance {
     static ThreatIntelFacade *instance = nil;
@@ -39,24 +152,44 @@ static NSString *const kProviderRetryAfterKey = @"retry_after";
 }
 
 - (instancetype)init {
+    ConfigurationManager *config = [ConfigurationManager sharedManager];
+    NSTimeInterval ttlSeconds = MAX(0.0, config.threatIntelPersistenceTTLHours) * 3600.0;
+    return [self initWithStore:[[ThreatIntelStore alloc] initWithTTLSeconds:ttlSeconds]];
+}
+
+- (instancetype)initWithStore:(ThreatIntelStore *)store {
     self = [super init];
     if (self) {
         _providers = [NSMutableArray array];
         _cache = [[ThreatIntelCache alloc] initWithMaxSize:5000];
-        ConfigurationManager *config = [ConfigurationManager sharedManager];
-        NSTimeInterval ttlSeconds = MAX(0.0, config.threatIntelPersistenceTTLHours) * 3600.0;
-        _store = [[ThreatIntelStore alloc] initWithTTLSeconds:ttlSeconds];
-        _enrichmentQueue = dispatch_queue_create("com.sniffnetbar.threatintel.enrichment", DISPATCH_QUEUE_CONCURRENT);
-        _inFlightRequests = [NSMutableDictionary dictionary];
+        _store = store;
+        // Serial: it owns the task table and queue, and only ever does
+        // short non-blocking steps, so one thread serves any number of tasks
+        _enrichmentQueue = dispatch_queue_create("com.sniffnetbar.threatintel.enrichment", DISPATCH_QUEUE_SERIAL);
+        _tasksByKey = [NSMutableDictionary dictionary];
+        _taskQueue = SNBRequestQueueCreate(256);
+        if (!_taskQueue) {
+            return nil;
+        }
+        _queuedTasksBySlot = [NSMutableDictionary dictionary];
+        _lanes = [NSMutableDictionary dictionary];
+        _maxConcurrentEnrichments = kDefaultMaxConcurrentEnrichments;
+        _maxQueuedEnrichments = kDefaultMaxQueuedEnrichments;
+        _enrichmentTimeout = kDefaultEnrichmentTimeout;
         _providerDisabledUntil = [NSMutableDictionary dictionary];
         _providerDisableReasons = [NSMutableDictionary dictionary];
         _enabled = NO;
         [self loadProviderStatusesFromStore];
         [self.store clearExpiredProviderStatuses];
+        [self.store loadIndicatorFilter];
     }
     return self;
 }
 
+- (void)dealloc {
+    SNBRequestQueueDestroy(_taskQueue);
+}
+
 - (void)configureWithProviders:(NSArray<id<ThreatIntelProvider>> *)providers {
     [self.providers removeAllObjects];
     [self.providers addObjectsFromArray:providers];
@@ -68,7 +201,19 @@ static NSString *const kProviderRetryAfterKey = @"retry_after";
     SNBLogThreatIntelDebug("Added provider %{public}@", provider.name);
 }
 
+- (void)setMaxConcurrentEnrichments:(NSUInteger)maxConcurrentEnrichments {
+    _maxConcurrentEnrichments = MAX((NSUInteger)1, maxConcurrentEnrichments);
+    // A wider window can start waiting tasks right away
+    dispatch_async(self.enrichmentQueue, ^{
+        [self startQueuedTasks];
+    });
+}
+
 - (void)enrichIP:(NSString *)ipAddress completion:(TIEnrichmentCompletion)completion {
+    [self enrichIP:ipAddress priority:0.0 completion:completion];
+}
+
+- (void)enrichIP:(NSString *)ipAddress priority:(double)priority completion:(TIEnrichmentCompletion)completion {
     TIIndicatorType type = TIIndicatorTypeIPv4;
     if (![self isValidIPAddress:ipAddress detectedType:&type]) {
         if (completion) {
@@ -80,10 +225,16 @@ static NSString *const kProviderRetryAfterKey = @"retry_after";
         return;
     }
     TIIndicator *indicator = [[TIIndicator alloc] initWithType:type value:ipAddress];
-    [self enrichIndicator:indicator completion:completion];
+    [self enrichIndicator:indicator priority:priority completion:completion];
 }
 
 - (void)enrichIndicator:(TIIndicator *)indicator completion:(TIEnrichmentCompletion)completion {
+    [self enrichIndicator:indicator priority:0.0 completion:completion];
+}
+
+- (void)enrichIndicator:(TIIndicator *)indicator
+               priority:(double)priority
+             completion:(TIEnrichmentCompletion)completion {
     if (!self.enabled) {
         if (completion) {
             NSError *error = [NSError errorWithDomain:TIErrorDomain
@@ -94,40 +245,116 @@ static NSString *const kProviderRetryAfterKey = @"retry_after";
         return;
     }
 
-    // Check for in-flight requests (single-flight pattern)
+    TIEnrichmentCompletion callback = [completion copy];
+    dispatch_async(self.enrichmentQueue, ^{
+        [self submitIndicator:indicator priority:priority completion:callback];
+    });
+}
+
+- (void)cancelEnrichmentsExceptIndicatorValues:(NSSet<NSString *> *)activeValues {
+    NSSet<NSString *> *values = [activeValues copy];
+    dispatch_async(self.enrichmentQueue, ^{
+        [self cancelIndicatorsNotIn:values];
+    });
+}
+
+// MARK: - Enrichment Engine
+
+// Every step below runs on enrichmentQueue and returns without waiting: the
+// stored-answer read, provider completions and the timeout timer re-enter
+// the queue, and each task moves Queued -> Querying -> Finished exactly once.
+
+- (void)submitIndicator:(TIIndicator *)indicator
+               priority:(double)priority
+             completion:(TIEnrichmentCompletion)completion {
+    _submittedCount++;
     NSString *key = [self keyForIndicator:indicator];
 
-    @synchronized(self.inFlightRequests) {
-        NSMutableArray *callbacks = self.inFlightRequests[key];
-        if (callbacks) {
-            // Already in flight, add callback if provided
-            if (completion) {
-                [callbacks addObject:[completion copy]];
-            }
-            SNBLogThreatIntelDebug("Coalescing request for %{" SNB_IP_PRIVACY "}@", indicator.value);
-            return;
+    // Single flight: later requests for a queued or in-flight indicator
+    // wait for the same answer
+    TIEnrichmentTask *existing = self.tasksByKey[key];
+    if (existing) {
+        if (completion) {
+            [existing.callbacks addObject:completion];
+        }
+        if (existing.state == TIEnrichmentTaskStateQueued && priority > existing.priority) {
+            existing.priority = priority;
+            SNBRequestQueueUpdate(_taskQueue, existing.queueSlot, priority);
         }
+        _coalescedCount++;
+        SNBLogThreatIntelDebug("Coalescing request for %{" SNB_IP_PRIVACY "}@", indicator.value);
+        return;
+    }
 
-        // Start new request
-        NSMutableArray *newCallbacks = [NSMutableArray array];
+    uint32_t slot = SNB_REQUEST_QUEUE_NO_SLOT;
+    if (SNBRequestQueueCount(_taskQueue) < self.maxQueuedEnrichments) {
+        slot = SNBRequestQueuePush(_taskQueue, priority);
+    }
+    if (slot == SNB_REQUEST_QUEUE_NO_SLOT) {
+        _rejectedCount++;
         if (completion) {
-            [newCallbacks addObject:[completion copy]];
+            NSError *error = [self errorQueueFull];
+            dispatch_async(dispatch_get_main_queue(), ^{
+                completion(nil, error);
+            });
         }
-        self.inFlightRequests[key] = newCallbacks;
+        return;
+    }
 
-        // Execute enrichment inside synchronized block to prevent race condition
-        // where request could complete and remove key before other threads check
-        dispatch_async(self.enrichmentQueue, ^{
-            [self performEnrichmentForIndicator:indicator];
-        });
+    TIEnrichmentTask *task = [[TIEnrichmentTask alloc] init];
+    task.indicator = indicator;
+    task.key = key;
+    task.state = TIEnrichmentTaskStateQueued;
+    task.callbacks = [NSMutableArray array];
+    if (completion) {
+        [task.callbacks addObject:completion];
     }
+    task.results = [NSMutableArray array];
+    task.errors = [NSMutableArray array];
+    task.deferredProviders = [NSMutableArray array];
+    task.priority = priority;
+    task.queueSlot = slot;
+    task.enqueuedNs = TIMonotonicNs();
+    self.tasksByKey[key] = task;
+    self.queuedTasksBySlot[@(slot)] = task;
+    _peakQueued = MAX(_peakQueued, (NSUInteger)SNBRequestQueueCount(_taskQueue));
+
+    [self startQueuedTasks];
 }
 
-- (void)performEnrichmentForIndicator:(TIIndicator *)indicator {
-    NSDate *startTime = [NSDate date];
-    NSString *key = [self keyForIndicator:indicator];
+- (void)startQueuedTasks {
+    // Tasks that finish while this loop runs call back in here; the outer
+    // loop picks up the freed slots instead
+    if (_pumping) {
+        return;
+    }
+    _pumping = YES;
+    while (_inFlightCount < self.maxConcurrentEnrichments && SNBRequestQueueCount(_taskQueue) > 0) {
+        NSNumber *slot = @(SNBRequestQueuePop(_taskQueue));
+        TIEnrichmentTask *task = self.queuedTasksBySlot[slot];
+        [self.queuedTasksBySlot removeObjectForKey:slot];
+        [self startTask:task];
+    }
+    _pumping = NO;
+}
 
-    TIEnrichmentResponse *storedResponse = [self.store responseForIndicator:indicator];
+- (void)startTask:(TIEnrichmentTask *)task {
+    task.state = TIEnrichmentTaskStateQuerying;
+    task.startedNs = TIMonotonicNs();
+    _totalWaitNs += task.startedNs - task.enqueuedNs;
+    _inFlightCount++;
+
+    // The stored answer is read on the store's queue, so a slow disk holds up
+    // this task only, not the tasks, timers and lanes served by this queue
+    [self.store responseForIndicator:task.indicator
+                               queue:self.enrichmentQueue
+                          completion:^(TIEnrichmentResponse *storedResponse) {
+        [self task:task didLoadStoredResponse:storedResponse];
+    }];
+}
+
+- (void)task:(TIEnrichmentTask *)task didLoadStoredResponse:(TIEnrichmentResponse *)storedResponse {
+    TIIndicator *indicator = task.indicator;
     if (storedResponse) {
         for (TIResult *result in storedResponse.providerResults) {
             [self.cache setResult:result];
@@ -139,22 +366,15 @@ static NSString *const kProviderRetryAfterKey = @"retry_after";
 
     if (applicableProviders.count == 0) {
         if (storedResponse) {
-            [self completeEnrichmentForKey:key response:storedResponse error:nil];
+            [self completeTask:task response:storedResponse error:nil];
         } else {
-            [self completeEnrichmentForKey:key response:nil error:[self errorNoProviders]];
+            [self completeTask:task response:nil error:[self errorNoProviders]];
         }
         return;
     }
 
-    // Create dispatch group for concurrent provider queries
-    dispatch_group_t group = dispatch_group_create();
-    NSMutableArray<TIResult *> *results = [NSMutableArray array];
-    NSMutableArray<NSError *> *errors = [NSMutableArray array];
     NSMutableSet<NSString *> *existingProviders = [NSMutableSet set];
-    __block NSInteger cacheHits = 0;
-    __block BOOL timedOut = NO;
     NSDate *now = [NSDate date];
-    __block NSInteger availableCount = 0;
     NSMutableArray<id<ThreatIntelProvider>> *providersToQuery = [NSMutableArray array];
 
     if (storedResponse) {
@@ -162,7 +382,7 @@ static NSString *const kProviderRetryAfterKey = @"retry_after";
             if (result.providerName.length > 0) {
                 [existingProviders addObject:result.providerName];
             }
-            [results addObject:result];
+            [task.results addObject:result];
         }
     }
 
@@ -174,20 +394,15 @@ static NSString *const kProviderRetryAfterKey = @"retry_after";
         TIResult *cachedResult = [self.cache getResultForProvider:provider.name indicator:indicator];
 
         if (cachedResult) {
-            @synchronized(results) {
-                [results addObject:cachedResult];
-                cacheHits++;
-            }
+            [task.results addObject:cachedResult];
+            task.cacheHits++;
             continue;
         }
 
         BOOL isAvailable = [self isProviderAvailable:provider now:now];
         if (!isAvailable) {
-            NSError *unavailable = [self errorProviderUnavailableForProvider:provider];
-            @synchronized(results) {
-                [errors addObject:unavailable];
-            }
-            @synchronized(self.providerDisableReasons) {
+            [task.errors addObject:[self errorProviderUnavailableForProvider:provider]];
+            @synchronized(self.providerDisabledUntil) {
                 NSString *reason = self.providerDisableReasons[provider.name];
                 SNBLogThreatIntelWarn("Provider %{public}@ unavailable for %{" SNB_IP_PRIVACY "}@ (%{public}@)",
                                       provider.name,
@@ -197,34 +412,26 @@ static NSString *const kProviderRetryAfterKey = @"retry_after";
             continue;
         }
 
-        availableCount += 1;
+        // Spent budgets do not hold the task up: the lookup waits in the
+        // provider's queue and answers a later enrichment from the cache
+        if (![self takeRequestBudgetForProvider:provider priority:task.priority key:task.key]) {
+            if ([self deferLookupForIndicator:indicator key:task.key provider:provider priority:task.priority]) {
+                [task.deferredProviders addObject:provider.name];
+            } else {
+                [task.errors addObject:[self errorQueueFull]];
+            }
+            continue;
+        }
+
         [providersToQuery addObject:provider];
     }
 
     if (providersToQuery.count == 0) {
-        if (results.count == 0) {
-            [self completeEnrichmentForKey:key response:nil error:[self errorNoProviders]];
+        if (task.results.count == 0 && task.deferredProviders.count == 0) {
+            [self completeTask:task response:nil error:[self errorNoProviders]];
             return;
         }
-
-        TIScoringResult *scoringResult = [self calculateScoringForResults:[results copy] indicator:indicator];
-
-        TIEnrichmentResponse *response = [[TIEnrichmentResponse alloc] init];
-        response.indicator = indicator;
-        response.providerResults = [results copy];
-        response.scoringResult = scoringResult;
-        response.duration = [[NSDate date] timeIntervalSinceDate:startTime];
-        response.cacheHits = cacheHits;
-
-        SNBLogThreatIntelDebug("Enrichment completed for %{" SNB_IP_PRIVACY "}@ - %lu providers, %ld hits, score=%ld, verdict=%{public}@",
-               indicator.value, (unsigned long)results.count, (long)cacheHits,
-               (long)scoringResult.finalScore, [scoringResult verdictString]);
-
-        if (response.scoringResult && response.providerResults.count > 0) {
-            [self.store storeResponse:response];
-        }
-
-        [self completeEnrichmentForKey:key response:response error:nil];
+        [self finishQueryingTask:task timedOut:NO];
         return;
     }
 
@@ -254,72 +461,86 @@ static NSString *const kProviderRetryAfterKey = @"retry_after";
                               querySummary);
     }
 
-    for (id<ThreatIntelProvider> provider in providersToQuery) {
-        dispatch_group_enter(group);
+    // The timeout is a timer on this queue rather than a thread parked in
+    // dispatch_group_wait
+    task.pendingProviders = providersToQuery.count;
+    dispatch_source_t timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, self.enrichmentQueue);
+    int64_t timeoutNs = (int64_t)(MAX(0.0, self.enrichmentTimeout) * NSEC_PER_SEC);
+    dispatch_source_set_timer(timer, dispatch_time(DISPATCH_TIME_NOW, timeoutNs), DISPATCH_TIME_FOREVER, NSEC_PER_SEC / 10);
+    __weak TIEnrichmentTask *weakTask = task;
+    dispatch_source_set_event_handler(timer, ^{
+        TIEnrichmentTask *strongTask = weakTask;
+        if (strongTask && strongTask.state == TIEnrichmentTaskStateQuerying) {
+            self->_timedOutCount++;
+            [self finishQueryingTask:strongTask timedOut:YES];
+        }
+    });
+    task.timeoutTimer = timer;
+    dispatch_resume(timer);
 
-        // Query provider
+    for (id<ThreatIntelProvider> provider in providersToQuery) {
         [provider enrichIndicator:indicator completion:^(TIResult *result, NSError *error) {
             if (result) {
                 // Cache result even if this request times out to help future queries.
                 [self.cache setResult:result];
-                @synchronized(results) {
-                    if (!timedOut) {
-                        [results addObject:result];
-                    }
-                }
             } else if (error) {
                 [self markProviderUnavailable:provider error:error];
-                @synchronized(results) {
-                    if (!timedOut) {
-                        [errors addObject:error];
-                    }
-                }
             }
-            dispatch_group_leave(group);
+            dispatch_async(self.enrichmentQueue, ^{
+                [self task:task didReceiveResult:result error:error];
+            });
         }];
     }
+}
 
-    if (availableCount == 0 && results.count == 0) {
-        [self completeEnrichmentForKey:key response:nil error:[self errorNoProviders]];
+- (void)task:(TIEnrichmentTask *)task didReceiveResult:(TIResult *)result error:(NSError *)error {
+    // Answers that arrive after the timeout were cached above and are dropped here
+    if (task.state != TIEnrichmentTaskStateQuerying) {
         return;
     }
-
-    // Wait for all providers (with timeout)
-    dispatch_time_t timeout = dispatch_time(DISPATCH_TIME_NOW, (int64_t)(10.0 * NSEC_PER_SEC));
-    BOOL didTimeout = dispatch_group_wait(group, timeout) != 0;
-    if (didTimeout) {
-        @synchronized(results) {
-            timedOut = YES;
-        }
+    if (result) {
+        [task.results addObject:result];
+    } else if (error) {
+        [task.errors addObject:error];
     }
-
-    NSArray<TIResult *> *resultsSnapshot = nil;
-    NSArray<NSError *> *errorsSnapshot = nil;
-    @synchronized(results) {
-        resultsSnapshot = [results copy];
-        errorsSnapshot = [errors copy];
+    if (task.pendingProviders > 0) {
+        task.pendingProviders--;
     }
+    if (task.pendingProviders == 0) {
+        [self finishQueryingTask:task timedOut:NO];
+    }
+}
+
+- (void)finishQueryingTask:(TIEnrichmentTask *)task timedOut:(BOOL)timedOut {
+    TIIndicator *indicator = task.indicator;
+    NSArray<TIResult *> *results = [task.results copy];
+    NSArray<NSError *> *errors = [task.errors copy];
 
     // Calculate scoring
-    TIScoringResult *scoringResult = [self calculateScoringForResults:resultsSnapshot indicator:indicator];
+    TIScoringResult *scoringResult = [self calculateScoringForResults:results indicator:indicator];
 
     // Build response
     TIEnrichmentResponse *response = [[TIEnrichmentResponse alloc] init];
     response.indicator = indicator;
-    response.providerResults = resultsSnapshot;
+    response.providerResults = results;
     response.scoringResult = scoringResult;
-    response.duration = [[NSDate date] timeIntervalSinceDate:startTime];
-    response.cacheHits = cacheHits;
+    response.duration = (double)(TIMonotonicNs() - task.startedNs) / NSEC_PER_SEC;
+    response.cacheHits = task.cacheHits;
+    response.deferredProviders = task.deferredProviders.count > 0 ? [task.deferredProviders copy] : nil;
 
     SNBLogThreatIntelDebug("Enrichment completed for %{" SNB_IP_PRIVACY "}@ - %lu providers, %ld hits, score=%ld, verdict=%{public}@",
-           indicator.value, (unsigned long)results.count, (long)cacheHits,
+           indicator.value, (unsigned long)results.count, (long)task.cacheHits,
            (long)scoringResult.finalScore, [scoringResult verdictString]);
 
     NSError *finalError = nil;
-    if (didTimeout) {
-        finalError = [self errorTimeoutWithProviderErrors:errorsSnapshot];
-    } else if (resultsSnapshot.count == 0 && errorsSnapshot.count > 0) {
-        finalError = [self errorProvidersFailedWithErrors:errorsSnapshot];
+    if (timedOut) {
+        finalError = [self errorTimeoutWithProviderErrors:errors];
+    } else if (results.count == 0 && errors.count > 0) {
+        finalError = [self errorProvidersFailedWithErrors:errors];
+    } else if (results.count == 0 && task.deferredProviders.count > 0) {
+        // Nothing to score yet; the deferred answers arrive through the cache
+        [self completeTask:task response:nil error:[self errorDeferredForProviders:task.deferredProviders]];
+        return;
     }
 
     // Store to database (storeResponse handles async via dbQueue internally)
@@ -327,24 +548,276 @@ static NSString *const kProviderRetryAfterKey = @"retry_after";
         [self.store storeResponse:response];
     }
 
-    [self completeEnrichmentForKey:key response:response error:finalError];
+    [self completeTask:task response:response error:finalError];
 }
 
-- (void)completeEnrichmentForKey:(NSString *)key
-                        response:(TIEnrichmentResponse *)response
-                           error:(NSError *)error {
-    NSArray *callbacks = nil;
-
-    @synchronized(self.inFlightRequests) {
-        callbacks = [self.inFlightRequests[key] copy];
-        [self.inFlightRequests removeObjectForKey:key];
+- (void)completeTask:(TIEnrichmentTask *)task
+            response:(TIEnrichmentResponse *)response
+               error:(NSError *)error {
+    BOOL wasInFlight = task.state == TIEnrichmentTaskStateQuerying;
+    task.state = TIEnrichmentTaskStateFinished;
+    if (task.timeoutTimer) {
+        dispatch_source_cancel(task.timeoutTimer);
+        task.timeoutTimer = nil;
+    }
+    if (self.tasksByKey[task.key] == task) {
+        [self.tasksByKey removeObjectForKey:task.key];
     }
 
+    NSArray<TIEnrichmentCompletion> *callbacks = [task.callbacks copy];
+    [task.callbacks removeAllObjects];
     dispatch_async(dispatch_get_main_queue(), ^{
         for (TIEnrichmentCompletion completion in callbacks) {
             completion(response, error);
         }
     });
+
+    if (wasInFlight) {
+        _inFlightCount--;
+        _completedCount++;
+        _totalQueryNs += TIMonotonicNs() - task.startedNs;
+        [self startQueuedTasks];
+    }
+}
+
+- (void)cancelIndicatorsNotIn:(NSSet<NSString *> *)activeValues {
+    NSMutableArray<TIEnrichmentTask *> *cancelled = [NSMutableArray array];
+    for (NSNumber *slot in self.queuedTasksBySlot.allKeys) {
+        TIEnrichmentTask *task = self.queuedTasksBySlot[slot];
+        if (![activeValues containsObject:task.indicator.value]) {
+            SNBRequestQueueRemove(_taskQueue, slot.unsignedIntValue);
+            [self.queuedTasksBySlot removeObjectForKey:slot];
+            [cancelled addObject:task];
+        }
+    }
+    for (TIEnrichmentTask *task in cancelled) {
+        [self completeTask:task response:nil error:[self errorCancelled]];
+    }
+    _cancelledCount += cancelled.count;
+
+    for (TIProviderLane *lane in self.lanes.allValues) {
+        for (NSNumber *slot in lane.lookupsBySlot.allKeys) {
+            TIDeferredLookup *lookup = lane.lookupsBySlot[slot];
+            if (![activeValues containsObject:lookup.indicator.value]) {
+                [self removeDeferredLookupAtSlot:slot.unsignedIntValue fromLane:lane];
+                _cancelledCount++;
+            }
+        }
+    }
+}
+
+// MARK: - Provider Budgets
+
+// Each provider has a token budget and a queue of lookups deferred until the
+// budget refills. Lookups waiting in the queue are served before any new one
+// of equal or lower priority, so a busy destination seen later still gets
+// ahead of quiet ones seen earlier, and the queue drains on a single timer.
+
+- (TIProviderLane *)laneForProvider:(id<ThreatIntelProvider>)provider {
+    uint64_t now = TIMonotonicNs();
+    TIProviderLane *lane = self.lanes[provider.name];
+    if (!lane) {
+        lane = [[TIProviderLane alloc] initWithProvider:provider nowNs:now];
+        if (!lane) {
+            return nil;
+        }
+        self.lanes[provider.name] = lane;
+    }
+    // Limits are read on every use so configuration changes apply without a restart
+    NSInteger perMinute = [provider respondsToSelector:@selector(maxRequestsPerMin)] ? provider.maxRequestsPerMin : 0;
+    NSInteger perDay = [provider respondsToSelector:@selector(maxRequestsPerDay)] ? provider.maxRequestsPerDay : 0;
+    SNBRequestBudgetSetLimits([lane budget],
+                              (uint32_t)MIN(MAX(perMinute, 0), (NSInteger)UINT32_MAX),
+                              (uint32_t)MIN(MAX(perDay, 0), (NSInteger)UINT32_MAX),
+                              now);
+    return lane;
+}
+
+- (BOOL)takeRequestBudgetForProvider:(id<ThreatIntelProvider>)provider
+                            priority:(double)priority
+                                 key:(NSString *)key {
+    TIProviderLane *lane = [self laneForProvider:provider];
+    if (!lane) {
+        return YES;
+    }
+    uint32_t next = SNBRequestQueuePeek(lane.queue);
+    if (next != SNB_REQUEST_QUEUE_NO_SLOT && SNBRequestQueuePriority(lane.queue, next) >= priority) {
+        return NO;
+    }
+    if (!SNBRequestBudgetTryTake([lane budget], TIMonotonicNs())) {
+        return NO;
+    }
+    lane.immediateCount++;
+    NSNumber *queuedSlot = lane.slotsByKey[key];
+    if (queuedSlot) {
+        [self removeDeferredLookupAtSlot:queuedSlot.unsignedIntValue fromLane:lane];
+    }
+    return YES;
+}
+
+- (BOOL)deferLookupForIndicator:(TIIndicator *)indicator
+                            key:(NSString *)key
+                       provider:(id<ThreatIntelProvider>)provider
+                       priority:(double)priority {
+    TIProviderLane *lane = [self laneForProvider:provider];
+    if (!lane) {
+        return NO;
+    }
+    NSNumber *queuedSlot = lane.slotsByKey[key];
+    if (queuedSlot) {
+        uint32_t slot = queuedSlot.unsignedIntValue;
+        if (priority > SNBRequestQueuePriority(lane.queue, slot)) {
+            SNBRequestQueueUpdate(lane.queue, slot, priority);
+        }
+        return YES;
+    }
+    if (SNBRequestQueueCount(lane.queue) >= self.maxQueuedEnrichments) {
+        return NO;
+    }
+    uint32_t slot = SNBRequestQueuePush(lane.queue, priority);
+    if (slot == SNB_REQUEST_QUEUE_NO_SLOT) {
+        return NO;
+    }
+    TIDeferredLookup *lookup = [[TIDeferredLookup alloc] init];
+    lookup.indicator = indicator;
+    lookup.key = key;
+    lookup.enqueuedNs = TIMonotonicNs();
+    lane.lookupsBySlot[@(slot)] = lookup;
+    lane.slotsByKey[key] = @(slot);
+    lane.deferredCount++;
+    [self drainLane:lane];
+    return YES;
+}
+
+- (void)removeDeferredLookupAtSlot:(uint32_t)slot fromLane:(TIProviderLane *)lane {
+    TIDeferredLookup *lookup = lane.lookupsBySlot[@(slot)];
+    SNBRequestQueueRemove(lane.queue, slot);
+    [lane.lookupsBySlot removeObjectForKey:@(slot)];
+    if (lookup) {
+        [lane.slotsByKey removeObjectForKey:lookup.key];
+    }
+}
+
+- (void)drainLane:(TIProviderLane *)lane {
+    id<ThreatIntelProvider> provider = lane.provider;
+    while (SNBRequestQueueCount(lane.queue) > 0) {
+        uint64_t now = TIMonotonicNs();
+        if (![self isProviderAvailable:provider now:[NSDate date]]) {
+            NSTimeInterval remaining = 1.0;
+            @synchronized(self.providerDisabledUntil) {
+                NSDate *disabledUntil = self.providerDisabledUntil[provider.name];
+                if (disabledUntil) {
+                    remaining = MAX(1.0, disabledUntil.timeIntervalSinceNow);
+                }
+            }
+            [self armLane:lane afterNs:(uint64_t)(remaining * NSEC_PER_SEC)];
+            return;
+        }
+        uint64_t delayNs = SNBRequestBudgetDelayNs([lane budget], now);
+        if (delayNs > 0) {
+            [self armLane:lane afterNs:delayNs];
+            return;
+        }
+        SNBRequestBudgetTryTake([lane budget], now);
+
+        uint32_t slot = SNBRequestQueuePeek(lane.queue);
+        TIDeferredLookup *lookup = lane.lookupsBySlot[@(slot)];
+        [self removeDeferredLookupAtSlot:slot fromLane:lane];
+        lane.dispatchedDeferredCount++;
+        lane.totalDeferredWaitNs += now - lookup.enqueuedNs;
+
+        TIIndicator *indicator = lookup.indicator;
+        [provider enrichIndicator:indicator completion:^(TIResult *result, NSError *error) {
+            if (result) {
+                [self.cache setResult:result];
+                dispatch_async(dispatch_get_main_queue(), ^{
+                    [[NSNotificationCenter defaultCenter] postNotificationName:TIDeferredLookupDidCompleteNotification
+                                                                        object:self
+                                                                      userInfo:@{TIIndicatorUserInfoKey: indicator}];
+                });
+            } else if (error) {
+                [self markProviderUnavailable:provider error:error];
+            }
+        }];
+    }
+}
+
+- (void)armLane:(TIProviderLane *)lane afterNs:(uint64_t)delayNs {
+    if (!lane.timer) {
+        dispatch_source_t timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, self.enrichmentQueue);
+        __weak typeof(self) weakSelf = self;
+        __weak TIProviderLane *weakLane = lane;
+        dispatch_source_set_event_handler(timer, ^{
+            TIProviderLane *strongLane = weakLane;
+            if (strongLane) {
+                [weakSelf drainLane:strongLane];
+            }
+        });
+        dispatch_source_set_timer(timer, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, 0);
+        dispatch_resume(timer);
+        lane.timer = timer;
+    }
+    int64_t delta = (int64_t)MIN(delayNs, (uint64_t)INT64_MAX);
+    dispatch_source_set_timer(lane.timer, dispatch_time(DISPATCH_TIME_NOW, delta), DISPATCH_TIME_FOREVER, NSEC_PER_SEC / 10);
+}
+
+- (NSDictionary<NSString *, NSDictionary *> *)laneStats {
+    NSMutableDictionary<NSString *, NSDictionary *> *stats = [NSMutableDictionary dictionary];
+    uint64_t now = TIMonotonicNs();
+    for (NSString *name in self.lanes) {
+        TIProviderLane *lane = self.lanes[name];
+        double averageWaitMs = lane.dispatchedDeferredCount > 0
+            ? (double)lane.totalDeferredWaitNs / lane.dispatchedDeferredCount / 1e6 : 0.0;
+        uint32_t remaining = SNBRequestBudgetRemainingToday([lane budget], now);
+        stats[name] = @{
+            @"queued": @(SNBRequestQueueCount(lane.queue)),
+            @"immediate": @(lane.immediateCount),
+            @"deferred": @(lane.deferredCount),
+            @"dispatched": @(lane.dispatchedDeferredCount),
+            @"averageWaitMs": @(averageWaitMs),
+            @"remainingToday": remaining == UINT32_MAX ? @(-1) : @(remaining),
+            @"nextTokenMs": @((double)SNBRequestBudgetDelayNs([lane budget], now) / 1e6)
+        };
+    }
+    return stats;
+}
+
+- (NSDictionary<NSString *, id> *)engineStats {
+    __block NSDictionary<NSString *, id> *stats = nil;
+    dispatch_sync(self.enrichmentQueue, ^{
+        NSDictionary<NSString *, NSDictionary *> *lanes = [self laneStats];
+        uint64_t providerQueued = 0;
+        uint64_t providerDispatched = 0;
+        uint64_t providerWaitNs = 0;
+        for (TIProviderLane *lane in self.lanes.allValues) {
+            providerQueued += SNBRequestQueueCount(lane.queue);
+            providerDispatched += lane.dispatchedDeferredCount;
+            providerWaitNs += lane.totalDeferredWaitNs;
+        }
+        uint64_t started = self->_completedCount + self->_inFlightCount;
+        double averageWaitMs = started > 0 ? (double)self->_totalWaitNs / started / 1e6 : 0.0;
+        double averageQueryMs = self->_completedCount > 0
+            ? (double)self->_totalQueryNs / self->_completedCount / 1e6 : 0.0;
+        stats = @{
+            @"enrichmentQueued": @(SNBRequestQueueCount(self->_taskQueue)),
+            @"enrichmentInFlight": @(self->_inFlightCount),
+            @"enrichmentWindow": @(self.maxConcurrentEnrichments),
+            @"enrichmentQueueLimit": @(self.maxQueuedEnrichments),
+            @"enrichmentPeakQueued": @(self->_peakQueued),
+            @"enrichmentSubmitted": @(self->_submittedCount),
+            @"enrichmentCoalesced": @(self->_coalescedCount),
+            @"enrichmentRejected": @(self->_rejectedCount),
+            @"enrichmentCompleted": @(self->_completedCount),
+            @"enrichmentTimedOut": @(self->_timedOutCount),
+            @"enrichmentCancelled": @(self->_cancelledCount),
+            @"enrichmentAverageWaitMs": @(averageWaitMs),
+            @"enrichmentAverageQueryMs": @(averageQueryMs),
+            @"providerQueued": @(providerQueued),
+            @"providerAverageWaitMs": @(providerDispatched > 0 ? (double)providerWaitNs / providerDispatched / 1e6 : 0.0),
+            @"providerQueues": lanes
+        };
+    });
+    return stats;
 }
 
 - (NSArray<id<ThreatIntelProvider>> *)getApplicableProvidersForIndicator:(TIIndicator *)indicator {
@@ -529,7 +1002,8 @@ static NSString *const kProviderRetryAfterKey = @"retry_after";
         @"VirusTotal": @1.0,
         @"AbuseIPDB": @0.9,
         @"GreyNoise": @0.8,
-        @"Shodan": @0.7
+        @"Shodan": @0.7,
+        @"Blocklist": @0.9
     };
     NSSet<NSString *> *highRiskKeywords = [NSSet setWithArray:@[
         @"malware", @"trojan", @"phishing", @"scam", @"botnet", @"c2", @"command-and-control",
@@ -725,7 +1199,10 @@ static NSString *const kProviderRetryAfterKey = @"retry_after";
 // MARK: - Cache Management
 
 - (NSDictionary *)cacheStats {
-    return [self.cache statsSnapshot];
+    NSMutableDictionary *stats = [[self.cache statsSnapshot] mutableCopy];
+    [stats addEntriesFromDictionary:[self engineStats]];
+    [stats addEntriesFromDictionary:[self.store indicatorFilterStats]];
+    return stats;
 }
 
 - (void)clearCache {
@@ -744,6 +1221,25 @@ static NSString *const kProviderRetryAfterKey = @"retry_after";
                            userInfo:@{NSLocalizedDescriptionKey: @"No providers available for indicator type"}];
 }
 
+- (NSError *)errorQueueFull {
+    return [NSError errorWithDomain:TIErrorDomain
+                               code:TIErrorCodeQueueFull
+                           userInfo:@{NSLocalizedDescriptionKey: @"Too many threat intelligence requests waiting"}];
+}
+
+- (NSError *)errorCancelled {
+    return [NSError errorWithDomain:TIErrorDomain
+                               code:TIErrorCodeCancelled
+                           userInfo:@{NSLocalizedDescriptionKey: @"Indicator is no longer active"}];
+}
+
+- (NSError *)errorDeferredForProviders:(NSArray<NSString *> *)providerNames {
+    return [NSError errorWithDomain:TIErrorDomain
+                               code:TIErrorCodeRateLimited
+                           userInfo:@{NSLocalizedDescriptionKey: @"Waiting for provider request budget",
+                                      @"deferredProviders": [providerNames copy]}];
+}
+
 - (NSError *)errorTimeoutWithProviderErrors:(NSArray<NSError *> *)errors {
     NSMutableDictionary *userInfo = [NSMutableDictionary dictionary];
     userInfo[NSLocalizedDescriptionKey] = @"Threat intelligence request timed out";
@@ -794,6 +1290,16 @@ static NSString *const kProviderRetryAfterKey = @"retry_after";
 }
 
 - (void)shutdown {
+    // Waiting tasks would otherwise start against an empty provider list
+    dispatch_sync(self.enrichmentQueue, ^{
+        while (SNBRequestQueueCount(self->_taskQueue) > 0) {
+            NSNumber *slot = @(SNBRequestQueuePop(self->_taskQueue));
+            TIEnrichmentTask *task = self.queuedTasksBySlot[slot];
+            [self.queuedTasksBySlot removeObjectForKey:slot];
+            [self completeTask:task response:nil error:[self errorNoProviders]];
+        }
+        [self.lanes removeAllObjects];
+    });
     for (id<ThreatIntelProvider> provider in self.providers) {
         if ([provider respondsToSelector:@selector(shutdown)]) {
             [provider shutdown];
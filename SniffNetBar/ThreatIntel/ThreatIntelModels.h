@@ -113,6 +113,9 @@ typedef NS_ENUM(NSInteger, TIThreatVerdict) {
 @property (nonatomic, strong, nullable) TIScoringResult *scoringResult;
 @property (nonatomic, assign) NSTimeInterval duration;
 @property (nonatomic, assign) NSInteger cacheHits;
+/// Providers whose lookups are waiting for request budget; the facade posts
+/// TIDeferredLookupDidCompleteNotification as each of them is answered
+@property (nonatomic, copy, nullable) NSArray<NSString *> *deferredProviders;
 
 @end
 
@@ -127,7 +130,9 @@ typedef NS_ENUM(NSInteger, TIErrorCode) {
     TIErrorCodeNetworkError,
     TIErrorCodeUnsupportedIndicatorType,
     TIErrorCodeProviderUnavailable,
-    TIErrorCodeRateLimited
+    TIErrorCodeRateLimited,
+    TIErrorCodeQueueFull,
+    TIErrorCodeCancelled
 };
 
 NS_ASSUME_NONNULL_END
@@ -39,6 +39,12 @@ NS_ASSUME_NONNULL_BEGIN
 
 @optional
 
+/// Request budgets. The facade paces calls to stay within them, spending a
+/// token per call from a per-minute and a per-day bucket, and leaves other
+/// lookups queued by priority meanwhile. 0 or absent means no limit.
+@property (nonatomic, assign, readonly) NSInteger maxRequestsPerMin;
+@property (nonatomic, assign, readonly) NSInteger maxRequestsPerDay;
+
 /// Shutdown/cleanup
 - (void)shutdown;
 
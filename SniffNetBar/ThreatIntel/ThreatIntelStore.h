@@ -22,16 +22,49 @@ NS_ASSUME_NONNULL_BEGIN
 @interface ThreatIntelStore : NSObject
 
 - (instancetype)initWithTTLSeconds:(NSTimeInterval)ttlSeconds;
+/// Opens a database other than the one in Application Support, e.g. for tests
+- (instancetype)initWithPath:(NSString *)path TTLSeconds:(NSTimeInterval)ttlSeconds;
 
-/// Fetch a persisted response if not expired.
+/// Fetch a persisted response if not expired. Once the indicator filter is
+/// loaded, indicators it has never seen are answered without a query.
 - (TIEnrichmentResponse * _Nullable)responseForIndicator:(TIIndicator *)indicator;
 
+/// The same lookup without blocking the caller: the query runs on the
+/// store's queue and completion is called on queue with the response, or
+/// nil. Indicators the filter has never seen are answered without a query.
+- (void)responseForIndicator:(TIIndicator *)indicator
+                       queue:(dispatch_queue_t)queue
+                  completion:(void (^)(TIEnrichmentResponse * _Nullable response))completion;
+
+/// Unexpired responses for the given IPs whose score is at least
+/// minimumScore, keyed by IP. One statement is prepared and run for the
+/// whole set, and rows below the score are skipped without being decoded.
+- (NSDictionary<NSString *, TIEnrichmentResponse *> *)responsesForIPs:(NSSet<NSString *> *)ips
+                                                         minimumScore:(NSInteger)minimumScore;
+
+/// Scores of every unexpired indicator scoring at least minimumScore, keyed
+/// by value, read from an index without decoding any response. Lets callers
+/// join their own tables against the flagged indicators first.
+- (NSDictionary<NSString *, NSNumber *> *)scoresForIndicatorsWithMinimumScore:(NSInteger)minimumScore;
+
 /// Persist a response with TTL starting from now.
 - (void)storeResponse:(TIEnrichmentResponse *)response;
 
 /// Remove expired entries.
 - (void)purgeExpired;
 
+/// Loads the Bloom filter of stored indicators saved next to the database, or
+/// rebuilds it from the table when it is missing or was saved for other
+/// contents, on the store's queue. Until then lookups read the database. Only
+/// the store that writes responses should keep one, since rows written
+/// through another connection would be missing from it.
+- (void)loadIndicatorFilter;
+
+/// Lookups the filter answered alone and those it passed on, split into rows
+/// found and false positives, with the observed and estimated false-positive
+/// rates and the filter's size
+- (NSDictionary<NSString *, NSNumber *> *)indicatorFilterStats;
+
 /// Provider status management
 - (void)saveProviderStatus:(SNBProviderStatus *)status;
 - (SNBProviderStatus * _Nullable)getProviderStatus:(NSString *)providerName;
@@ -6,32 +6,67 @@
 //
 
 #import "ThreatIntelStore.h"
+#import "IndicatorFilter.h"
 #import "Logger.h"
+#import <os/lock.h>
 #import <sqlite3.h>
 
+// Sized for twice the stored indicators at this rate, and rebuilt once full
+static const double kIndicatorFilterFalsePositiveRate = 0.01;
+// Additions are saved this long after the first one, and when the store goes away
+static const NSTimeInterval kIndicatorFilterSaveDelay = 60.0;
+
+static uint64_t SNBIndicatorFilterHashForIndicator(TIIndicator *indicator) {
+    const char *value = indicator.value.UTF8String ?: "";
+    return SNBIndicatorFilterHash((int32_t)indicator.type, value, strlen(value));
+}
+
 @implementation SNBProviderStatus
 @end
 
-@interface ThreatIntelStore ()
+@interface ThreatIntelStore () {
+    // The filter is read on the caller's thread and added to from any thread
+    // under _filterLock; it is only replaced, saved and rebuilt on dbQueue
+    os_unfair_lock _filterLock;
+    SNBIndicatorFilter *_filter;
+    uint64_t _filterChecks;
+    uint64_t _filterSkipped;
+    uint64_t _filterStoredHits;
+    uint64_t _filterFalsePositives;
+    BOOL _filterDirty;
+    BOOL _filterSaveScheduled;
+}
 @property (nonatomic, assign) sqlite3 *db;
 @property (nonatomic, assign) NSTimeInterval ttlSeconds;
 @property (nonatomic, strong) dispatch_queue_t dbQueue;
+@property (nonatomic, copy) NSString *filterPath;
 @end
 
 @implementation ThreatIntelStore
 
 - (instancetype)initWithTTLSeconds:(NSTimeInterval)ttlSeconds {
+    return [self initWithPath:[[self class] defaultDatabasePath] TTLSeconds:ttlSeconds];
+}
+
+- (instancetype)initWithPath:(NSString *)path TTLSeconds:(NSTimeInterval)ttlSeconds {
     self = [super init];
     if (self) {
         _ttlSeconds = ttlSeconds;
+        _filterLock = OS_UNFAIR_LOCK_INIT;
+        _filterPath = [path stringByAppendingString:@"-filter"];
         _dbQueue = dispatch_queue_create("com.sniffnetbar.threatintel.store", DISPATCH_QUEUE_SERIAL);
-        [self openDatabase];
+        [self openDatabaseAtPath:path];
         [self ensureSchema];
     }
     return self;
 }
 
 - (void)dealloc {
+    // Blocks on dbQueue hold the store, so none is left to race with this
+    if (_filterDirty) {
+        [self saveIndicatorFilterLocked];
+    }
+    SNBIndicatorFilterDestroy(_filter);
     if (self.db) {
         sqlite3_close(self.db);
         self.db = NULL;
@@ -44,62 +79,181 @@
                               indicator, self.db);
         return nil;
     }
-
-    SNBLogThreatIntelDebug("Checking database cache for %{" SNB_IP_PRIVACY "}@", indicator.value);
+    BOOL filtered = NO;
+    if (![self indicatorFilterMayContain:indicator filtered:&filtered]) {
+        return nil;
+    }
 
     __block TIEnrichmentResponse *response = nil;
     dispatch_sync(self.dbQueue, ^{
-        const char *sql = "SELECT response_json, expires_at FROM threat_intel_cache "
-                          "WHERE indicator_type = ? AND ip = ? LIMIT 1;";
+        response = [self responseForIndicatorLocked:indicator filtered:filtered];
+    });
+    return response;
+}
 
-        sqlite3_stmt *stmt = NULL;
-        if (sqlite3_prepare_v2(self.db, sql, -1, &stmt, NULL) != SQLITE_OK) {
-            SNBLogThreatIntelError("SELECT prepare failed: %s", sqlite3_errmsg(self.db));
-            return;
-        }
+- (void)responseForIndicator:(TIIndicator *)indicator
+                       queue:(dispatch_queue_t)queue
+                  completion:(void (^)(TIEnrichmentResponse *response))completion {
+    BOOL filtered = NO;
+    if (!indicator || !self.db || ![self indicatorFilterMayContain:indicator filtered:&filtered]) {
+        dispatch_async(queue, ^{
+            completion(nil);
+        });
+        return;
+    }
+    dispatch_async(self.dbQueue, ^{
+        TIEnrichmentResponse *response = [self responseForIndicatorLocked:indicator filtered:filtered];
+        dispatch_async(queue, ^{
+            completion(response);
+        });
+    });
+}
 
-        sqlite3_bind_int(stmt, 1, (int)indicator.type);
-        sqlite3_bind_text(stmt, 2, indicator.value.UTF8String, -1, SQLITE_TRANSIENT);
+// Most indicators were never stored: answer those without the queue, the
+// query or the JSON decode. filtered is set when a loaded filter was asked.
+- (BOOL)indicatorFilterMayContain:(TIIndicator *)indicator filtered:(BOOL *)filtered {
+    uint64_t filterHash = SNBIndicatorFilterHashForIndicator(indicator);
+    os_unfair_lock_lock(&_filterLock);
+    *filtered = _filter != NULL;
+    BOOL mayContain = !*filtered || SNBIndicatorFilterMayContain(_filter, filterHash);
+    if (*filtered) {
+        _filterChecks++;
+        _filterSkipped += mayContain ? 0 : 1;
+    }
+    os_unfair_lock_unlock(&_filterLock);
+    if (!mayContain) {
+        SNBLogThreatIntelDebug("⊗ Cache MISS for %{" SNB_IP_PRIVACY "}@ - not in indicator filter",
+                               indicator.value);
+    }
+    return mayContain;
+}
 
-        int stepResult = sqlite3_step(stmt);
-        if (stepResult == SQLITE_ROW) {
-            const unsigned char *jsonText = sqlite3_column_text(stmt, 0);
-            sqlite3_int64 expiresAt = sqlite3_column_int64(stmt, 1);
-            NSTimeInterval now = [[NSDate date] timeIntervalSince1970];
-            NSTimeInterval remainingSeconds = (NSTimeInterval)expiresAt - now;
-
-            if (expiresAt > 0 && now > (NSTimeInterval)expiresAt) {
-                SNBLogThreatIntelInfo("⊗ Cache EXPIRED for %{" SNB_IP_PRIVACY "}@ (expired %.0f seconds ago) - deleting",
-                                     indicator.value, -remainingSeconds);
-                sqlite3_finalize(stmt);
-                [self deleteIndicatorLocked:indicator];
-                return;
+- (TIEnrichmentResponse *)responseForIndicatorLocked:(TIIndicator *)indicator filtered:(BOOL)filtered {
+    SNBLogThreatIntelDebug("Checking database cache for %{" SNB_IP_PRIVACY "}@", indicator.value);
+
+    const char *sql = "SELECT response_json, expires_at FROM threat_intel_cache "
+                      "WHERE indicator_type = ? AND ip = ? LIMIT 1;";
+
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(self.db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        SNBLogThreatIntelError("SELECT prepare failed: %s", sqlite3_errmsg(self.db));
+        return nil;
+    }
+
+    sqlite3_bind_int(stmt, 1, (int)indicator.type);
+    sqlite3_bind_text(stmt, 2, indicator.value.UTF8String, -1, SQLITE_TRANSIENT);
+
+    TIEnrichmentResponse *response = nil;
+    int stepResult = sqlite3_step(stmt);
+    if (filtered && (stepResult == SQLITE_ROW || stepResult == SQLITE_DONE)) {
+        [self noteFilterPositiveStored:stepResult == SQLITE_ROW];
+    }
+    if (stepResult == SQLITE_ROW) {
+        const unsigned char *jsonText = sqlite3_column_text(stmt, 0);
+        sqlite3_int64 expiresAt = sqlite3_column_int64(stmt, 1);
+        NSTimeInterval now = [[NSDate date] timeIntervalSince1970];
+        NSTimeInterval remainingSeconds = (NSTimeInterval)expiresAt - now;
+
+        if (expiresAt > 0 && now > (NSTimeInterval)expiresAt) {
+            SNBLogThreatIntelInfo("⊗ Cache EXPIRED for %{" SNB_IP_PRIVACY "}@ (expired %.0f seconds ago) - deleting",
+                                 indicator.value, -remainingSeconds);
+            sqlite3_finalize(stmt);
+            [self deleteIndicatorLocked:indicator];
+            return nil;
+        }
+
+        if (jsonText) {
+            NSString *jsonString = [NSString stringWithUTF8String:(const char *)jsonText];
+            size_t jsonSize = strlen((const char *)jsonText);
+            response = [self responseFromJSONString:jsonString];
+            if (response) {
+                SNBLogThreatIntelInfo("✓ Cache HIT for %{" SNB_IP_PRIVACY "}@ from DATABASE (expires in %.0f hours, json_size: %lu bytes)",
+                                     indicator.value, remainingSeconds / 3600.0, (unsigned long)jsonSize);
+            } else {
+                SNBLogThreatIntelError("Failed to deserialize cached result for %{" SNB_IP_PRIVACY "}@",
+                                      indicator.value);
             }
+        }
+    } else if (stepResult == SQLITE_DONE) {
+        SNBLogThreatIntelInfo("⊗ Cache MISS for %{" SNB_IP_PRIVACY "}@ - not in database",
+                             indicator.value);
+    } else {
+        SNBLogThreatIntelError("SELECT failed for %{" SNB_IP_PRIVACY "}@: %s (code: %d)",
+                              indicator.value, sqlite3_errmsg(self.db), stepResult);
+    }
 
-            if (jsonText) {
-                NSString *jsonString = [NSString stringWithUTF8String:(const char *)jsonText];
-                size_t jsonSize = strlen((const char *)jsonText);
-                response = [self responseFromJSONString:jsonString];
+    sqlite3_finalize(stmt);
+    return response;
+}
+
+- (NSDictionary<NSString *, TIEnrichmentResponse *> *)responsesForIPs:(NSSet<NSString *> *)ips
+                                                         minimumScore:(NSInteger)minimumScore {
+    if (ips.count == 0 || !self.db) {
+        return @{};
+    }
+
+    NSMutableDictionary<NSString *, TIEnrichmentResponse *> *responses = [NSMutableDictionary dictionary];
+    NSTimeInterval now = [[NSDate date] timeIntervalSince1970];
+    dispatch_sync(self.dbQueue, ^{
+        const char *sql = "SELECT response_json FROM threat_intel_cache "
+                          "WHERE ip = ? AND final_score >= ? AND (expires_at <= 0 OR expires_at >= ?) LIMIT 1;";
+        sqlite3_stmt *stmt = NULL;
+        if (sqlite3_prepare_v2(self.db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+            SNBLogThreatIntelError("Bulk SELECT prepare failed: %s", sqlite3_errmsg(self.db));
+            return;
+        }
+        // One read transaction, so the set is answered from a single snapshot
+        sqlite3_exec(self.db, "BEGIN;", NULL, NULL, NULL);
+        for (NSString *ip in ips) {
+            sqlite3_bind_text(stmt, 1, ip.UTF8String, -1, SQLITE_TRANSIENT);
+            sqlite3_bind_int64(stmt, 2, (sqlite3_int64)minimumScore);
+            sqlite3_bind_int64(stmt, 3, (sqlite3_int64)now);
+            if (sqlite3_step(stmt) == SQLITE_ROW) {
+                const unsigned char *jsonText = sqlite3_column_text(stmt, 0);
+                TIEnrichmentResponse *response = jsonText
+                    ? [self responseFromJSONString:[NSString stringWithUTF8String:(const char *)jsonText]]
+                    : nil;
                 if (response) {
-                    SNBLogThreatIntelInfo("✓ Cache HIT for %{" SNB_IP_PRIVACY "}@ from DATABASE (expires in %.0f hours, json_size: %lu bytes)",
-                                         indicator.value, remainingSeconds / 3600.0, (unsigned long)jsonSize);
-                } else {
-                    SNBLogThreatIntelError("Failed to deserialize cached result for %{" SNB_IP_PRIVACY "}@",
-                                          indicator.value);
+                    responses[ip] = response;
                 }
             }
-        } else if (stepResult == SQLITE_DONE) {
-            SNBLogThreatIntelInfo("⊗ Cache MISS for %{" SNB_IP_PRIVACY "}@ - not in database",
-                                 indicator.value);
-        } else {
-            SNBLogThreatIntelError("SELECT failed for %{" SNB_IP_PRIVACY "}@: %s (code: %d)",
-                                  indicator.value, sqlite3_errmsg(self.db), stepResult);
+            sqlite3_reset(stmt);
         }
-
+        sqlite3_exec(self.db, "COMMIT;", NULL, NULL, NULL);
         sqlite3_finalize(stmt);
     });
 
-    return response;
+    SNBLogThreatIntelDebug("Bulk lookup of %lu IPs found %lu scoring at least %ld",
+                           (unsigned long)ips.count, (unsigned long)responses.count, (long)minimumScore);
+    return responses;
+}
+
+- (NSDictionary<NSString *, NSNumber *> *)scoresForIndicatorsWithMinimumScore:(NSInteger)minimumScore {
+    if (!self.db) {
+        return @{};
+    }
+
+    NSMutableDictionary<NSString *, NSNumber *> *scores = [NSMutableDictionary dictionary];
+    NSTimeInterval now = [[NSDate date] timeIntervalSince1970];
+    dispatch_sync(self.dbQueue, ^{
+        const char *sql = "SELECT ip, final_score FROM threat_intel_cache "
+                          "WHERE final_score >= ? AND (expires_at <= 0 OR expires_at >= ?);";
+        sqlite3_stmt *stmt = NULL;
+        if (sqlite3_prepare_v2(self.db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+            SNBLogThreatIntelError("Score SELECT prepare failed: %s", sqlite3_errmsg(self.db));
+            return;
+        }
+        sqlite3_bind_int64(stmt, 1, (sqlite3_int64)minimumScore);
+        sqlite3_bind_int64(stmt, 2, (sqlite3_int64)now);
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            const unsigned char *ip = sqlite3_column_text(stmt, 0);
+            if (ip) {
+                scores[[NSString stringWithUTF8String:(const char *)ip]] = @(sqlite3_column_int64(stmt, 1));
+            }
+        }
+        sqlite3_finalize(stmt);
+    });
+    return scores;
 }
 
 - (void)storeResponse:(TIEnrichmentResponse *)response {
@@ -121,17 +275,22 @@
 
     NSString *ipAddress = response.indicator.value;
     TIIndicatorType indicatorType = response.indicator.type;
+    NSInteger finalScore = response.scoringResult.finalScore;
 
     SNBLogThreatIntelInfo("Storing threat intel result to database: %{" SNB_IP_PRIVACY "}@ (TTL: %.0f hours)",
                          ipAddress, self.ttlSeconds / 3600.0);
 
+    // Added before the row is queued, so a lookup never skips a pending write
+    uint64_t filterHash = SNBIndicatorFilterHashForIndicator(response.indicator);
+    [self addToIndicatorFilter:filterHash];
+
     dispatch_async(self.dbQueue, ^{
         // Use autocommit mode with WAL - no explicit transaction needed
         // WAL mode allows concurrent reads during writes
         const char *sql =
             "INSERT OR REPLACE INTO threat_intel_cache "
-            "(ip, indicator_type, evaluated_at, expires_at, response_json) "
-            "VALUES (?, ?, ?, ?, ?);";
+            "(ip, indicator_type, evaluated_at, expires_at, response_json, final_score) "
+            "VALUES (?, ?, ?, ?, ?, ?);";
 
         SNBLogThreatIntelDebug("Executing INSERT for %{" SNB_IP_PRIVACY "}@ [type=%d, now=%lld, expires=%lld, ttl_hours=%.1f]",
                               ipAddress, (int)indicatorType,
@@ -149,12 +308,16 @@
         sqlite3_bind_int64(stmt, 3, (sqlite3_int64)now);
         sqlite3_bind_int64(stmt, 4, (sqlite3_int64)expiresAt);
         sqlite3_bind_text(stmt, 5, jsonString.UTF8String, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int64(stmt, 6, (sqlite3_int64)finalScore);
 
         int result = sqlite3_step(stmt);
         int lastInsertRowId = (int)sqlite3_last_insert_rowid(self.db);
         sqlite3_finalize(stmt);
 
         if (result == SQLITE_DONE) {
+            // Again, in case the filter was rebuilt since the first addition
+            [self addToIndicatorFilter:filterHash];
+            [self indicatorFilterDidChangeLocked];
             SNBLogThreatIntelInfo("✓ Successfully stored %{" SNB_IP_PRIVACY "}@ to database (rowid: %d, json_size: %lu bytes)",
                                   ipAddress, lastInsertRowId, (unsigned long)jsonString.length);
         } else if (result == SQLITE_BUSY || result == SQLITE_LOCKED) {
@@ -176,19 +339,216 @@
     dispatch_async(self.dbQueue, ^{
         const char *sql = "DELETE FROM threat_intel_cache WHERE expires_at <= ?;";
         sqlite3_stmt *stmt = NULL;
+        uint64_t purged = 0;
         if (sqlite3_prepare_v2(self.db, sql, -1, &stmt, NULL) == SQLITE_OK) {
             sqlite3_bind_int64(stmt, 1, (sqlite3_int64)now);
-            sqlite3_step(stmt);
+            if (sqlite3_step(stmt) == SQLITE_DONE) {
+                purged = (uint64_t)sqlite3_changes(self.db);
+            }
             sqlite3_finalize(stmt);
         }
+        // Purged indicators stay in the filter as false positives; rebuild
+        // once they are a sizeable share of it
+        os_unfair_lock_lock(&self->_filterLock);
+        uint64_t filterCount = self->_filter ? SNBIndicatorFilterCount(self->_filter) : 0;
+        os_unfair_lock_unlock(&self->_filterLock);
+        if (filterCount > 0 && purged > filterCount / 4) {
+            [self rebuildIndicatorFilterLocked];
+        }
     });
 }
 
-#pragma mark - Database Setup
+#pragma mark - Indicator Filter
 
-- (void)openDatabase {
-    NSString *path = [[self class] defaultDatabasePath];
+- (void)loadIndicatorFilter {
+    if (!self.db) {
+        return;
+    }
+    dispatch_async(self.dbQueue, ^{
+        if (self->_filter) {
+            return;
+        }
+        uint64_t signature = 0;
+        SNBIndicatorFilter *loaded = [self indicatorFilterSignatureLocked:&signature rowCount:NULL]
+            ? SNBIndicatorFilterRead(self.filterPath.fileSystemRepresentation, signature)
+            : NULL;
+        if (!loaded) {
+            [self rebuildIndicatorFilterLocked];
+            return;
+        }
+        os_unfair_lock_lock(&self->_filterLock);
+        self->_filter = loaded;
+        os_unfair_lock_unlock(&self->_filterLock);
+        SNBLogThreatIntelInfo("Loaded indicator filter with %llu entries",
+                              (unsigned long long)SNBIndicatorFilterCount(loaded));
+    });
+}
+
+- (NSDictionary<NSString *, NSNumber *> *)indicatorFilterStats {
+    os_unfair_lock_lock(&_filterLock);
+    BOOL loaded = _filter != NULL;
+    uint64_t entries = loaded ? SNBIndicatorFilterCount(_filter) : 0;
+    uint64_t capacity = loaded ? SNBIndicatorFilterCapacity(_filter) : 0;
+    size_t bytes = loaded ? SNBIndicatorFilterMemoryBytes(_filter) : 0;
+    double estimated = loaded ? SNBIndicatorFilterEstimatedFalsePositiveRate(_filter) : 0.0;
+    uint64_t checks = _filterChecks;
+    uint64_t skipped = _filterSkipped;
+    uint64_t storedHits = _filterStoredHits;
+    uint64_t falsePositives = _filterFalsePositives;
+    os_unfair_lock_unlock(&_filterLock);
+
+    // Observed rate: of the lookups for indicators that were not stored, the
+    // share the filter still passed on to the database
+    uint64_t absent = skipped + falsePositives;
+    return @{
+        @"storeFilterLoaded": @(loaded),
+        @"storeFilterEntries": @(entries),
+        @"storeFilterCapacity": @(capacity),
+        @"storeFilterBytes": @(bytes),
+        @"storeFilterChecks": @(checks),
+        @"storeFilterSkipped": @(skipped),
+        @"storeFilterStoredHits": @(storedHits),
+        @"storeFilterFalsePositives": @(falsePositives),
+        @"storeFilterSkipRate": @(checks > 0 ? (double)skipped / (double)checks : 0.0),
+        @"storeFilterFalsePositiveRate": @(absent > 0 ? (double)falsePositives / (double)absent : 0.0),
+        @"storeFilterEstimatedFalsePositiveRate": @(estimated)
+    };
+}
 
+- (void)addToIndicatorFilter:(uint64_t)hash {
+    os_unfair_lock_lock(&_filterLock);
+    if (_filter && !SNBIndicatorFilterMayContain(_filter, hash)) {
+        SNBIndicatorFilterAdd(_filter, hash);
+    }
+    os_unfair_lock_unlock(&_filterLock);
+}
+
+- (void)noteFilterPositiveStored:(BOOL)stored {
+    os_unfair_lock_lock(&_filterLock);
+    if (stored) {
+        _filterStoredHits++;
+    } else {
+        _filterFalsePositives++;
+    }
+    os_unfair_lock_unlock(&_filterLock);
+}
+
+// Called on dbQueue after an addition: rebuilds a filter that outgrew its
+// size, and otherwise saves the additions a little later
+- (void)indicatorFilterDidChangeLocked {
+    os_unfair_lock_lock(&_filterLock);
+    BOOL full = _filter && SNBIndicatorFilterCount(_filter) > SNBIndicatorFilterCapacity(_filter);
+    BOOL loaded = _filter != NULL;
+    os_unfair_lock_unlock(&_filterLock);
+    if (!loaded) {
+        return;
+    }
+    if (full) {
+        [self rebuildIndicatorFilterLocked];
+        return;
+    }
+    _filterDirty = YES;
+    if (_filterSaveScheduled) {
+        return;
+    }
+    _filterSaveScheduled = YES;
+    __weak typeof(self) weakSelf = self;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(kIndicatorFilterSaveDelay * NSEC_PER_SEC)),
+                   self.dbQueue, ^{
+        ThreatIntelStore *strongSelf = weakSelf;
+        if (!strongSelf) {
+            return;
+        }
+        strongSelf->_filterSaveScheduled = NO;
+        if (strongSelf->_filterDirty) {
+            [strongSelf saveIndicatorFilterLocked];
+        }
+    });
+}
+
+// The row count and highest rowid identify the table's contents closely
+// enough: every write replaces its row under a new rowid, and deletes change
+// the count. A filter saved for other contents is rebuilt.
+- (BOOL)indicatorFilterSignatureLocked:(uint64_t *)signature rowCount:(uint64_t *)rowCount {
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(self.db, "SELECT COUNT(*), IFNULL(MAX(rowid), 0) FROM threat_intel_cache;",
+                           -1, &stmt, NULL) != SQLITE_OK) {
+        return NO;
+    }
+    BOOL found = sqlite3_step(stmt) == SQLITE_ROW;
+    if (found) {
+        uint64_t count = (uint64_t)sqlite3_column_int64(stmt, 0);
+        uint64_t maxRow = (uint64_t)sqlite3_column_int64(stmt, 1);
+        *signature = (count * 0x9e3779b97f4a7c15ULL) ^ maxRow;
+        if (rowCount) {
+            *rowCount = count;
+        }
+    }
+    sqlite3_finalize(stmt);
+    return found;
+}
+
+- (void)rebuildIndicatorFilterLocked {
+    uint64_t startNs = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+    uint64_t signature = 0;
+    uint64_t rowCount = 0;
+    if (![self indicatorFilterSignatureLocked:&signature rowCount:&rowCount]) {
+        SNBLogThreatIntelError("Indicator filter rebuild failed to count rows: %s", sqlite3_errmsg(self.db));
+        return;
+    }
+    SNBIndicatorFilter *filter = SNBIndicatorFilterCreate(rowCount * 2, kIndicatorFilterFalsePositiveRate);
+    sqlite3_stmt *stmt = NULL;
+    if (!filter ||
+        sqlite3_prepare_v2(self.db, "SELECT indicator_type, ip FROM threat_intel_cache;", -1, &stmt, NULL) != SQLITE_OK) {
+        SNBLogThreatIntelError("Indicator filter rebuild failed: %s", sqlite3_errmsg(self.db));
+        SNBIndicatorFilterDestroy(filter);
+        return;
+    }
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char *value = (const char *)sqlite3_column_text(stmt, 1);
+        if (value) {
+            SNBIndicatorFilterAdd(filter, SNBIndicatorFilterHash(sqlite3_column_int(stmt, 0), value,
+                                                                 (size_t)sqlite3_column_bytes(stmt, 1)));
+        }
+    }
+    sqlite3_finalize(stmt);
+
+    os_unfair_lock_lock(&_filterLock);
+    SNBIndicatorFilter *previous = _filter;
+    _filter = filter;
+    os_unfair_lock_unlock(&_filterLock);
+    SNBIndicatorFilterDestroy(previous);
+
+    SNBLogThreatIntelInfo("Rebuilt indicator filter from %llu stored indicators in %.1f ms",
+                          (unsigned long long)rowCount,
+                          (double)(clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - startNs) / 1e6);
+    [self saveIndicatorFilterLocked];
+}
+
+- (void)saveIndicatorFilterLocked {
+    // The signature is read first: every row it covers was added to the
+    // filter before being written, so the copy taken after holds them all
+    uint64_t signature = 0;
+    if (!self.db || ![self indicatorFilterSignatureLocked:&signature rowCount:NULL]) {
+        return;
+    }
+    os_unfair_lock_lock(&_filterLock);
+    SNBIndicatorFilter *snapshot = _filter ? SNBIndicatorFilterCopy(_filter) : NULL;
+    os_unfair_lock_unlock(&_filterLock);
+    if (!snapshot) {
+        return;
+    }
+    if (SNBIndicatorFilterWrite(snapshot, self.filterPath.fileSystemRepresentation, signature)) {
+        _filterDirty = NO;
+    } else {
+        SNBLogThreatIntelWarn("Failed to save indicator filter to %{public}@", self.filterPath);
+    }
+    SNBIndicatorFilterDestroy(snapshot);
+}
+
+#pragma mark - Database Setup
+
+- (void)openDatabaseAtPath:(NSString *)path {
     SNBLogThreatIntelInfo("Opening threat intel database at: %{public}@", path);
 
     NSString *directory = [path stringByDeletingLastPathComponent];
@@ -253,11 +613,15 @@
         "evaluated_at INTEGER NOT NULL, "
         "expires_at INTEGER NOT NULL, "
         "response_json TEXT NOT NULL, "
+        "final_score INTEGER NOT NULL DEFAULT 0, "
         "PRIMARY KEY (ip, indicator_type)"
         ");";
     sqlite3_exec(self.db, createTable, NULL, NULL, NULL);
+    [self addFinalScoreColumnIfNeeded];
     sqlite3_exec(self.db, "CREATE INDEX IF NOT EXISTS idx_threat_intel_expires ON threat_intel_cache (expires_at);",
                  NULL, NULL, NULL);
+    sqlite3_exec(self.db, "CREATE INDEX IF NOT EXISTS idx_threat_intel_score ON threat_intel_cache (final_score);",
+                 NULL, NULL, NULL);
 
     const char *createProviderStatusTable =
         "CREATE TABLE IF NOT EXISTS provider_status ("
@@ -273,6 +637,65 @@
                  NULL, NULL, NULL);
 }
 
+// Databases written before final_score existed get the column, filled in
+// once from the stored JSON
+- (void)addFinalScoreColumnIfNeeded {
+    BOOL hasColumn = NO;
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(self.db, "PRAGMA table_info(threat_intel_cache);", -1, &stmt, NULL) == SQLITE_OK) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            const unsigned char *name = sqlite3_column_text(stmt, 1);
+            if (name && strcmp((const char *)name, "final_score") == 0) {
+                hasColumn = YES;
+            }
+        }
+        sqlite3_finalize(stmt);
+    }
+    if (hasColumn) {
+        return;
+    }
+    if (sqlite3_exec(self.db, "ALTER TABLE threat_intel_cache ADD COLUMN final_score INTEGER NOT NULL DEFAULT 0;",
+                     NULL, NULL, NULL) != SQLITE_OK) {
+        SNBLogThreatIntelError("Failed to add final_score column: %s", sqlite3_errmsg(self.db));
+        return;
+    }
+
+    NSMutableDictionary<NSNumber *, NSNumber *> *scoresByRow = [NSMutableDictionary dictionary];
+    if (sqlite3_prepare_v2(self.db, "SELECT rowid, response_json FROM threat_intel_cache;", -1, &stmt, NULL) == SQLITE_OK) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            const void *json = sqlite3_column_blob(stmt, 1);
+            int length = sqlite3_column_bytes(stmt, 1);
+            if (!json || length <= 0) {
+                continue;
+            }
+            NSDictionary *dict = [NSJSONSerialization JSONObjectWithData:[NSData dataWithBytes:json length:(NSUInteger)length]
+                                                                 options:0
+                                                                   error:nil];
+            NSDictionary *scoring = [dict isKindOfClass:[NSDictionary class]] ? dict[@"scoring_result"] : nil;
+            NSNumber *score = [scoring isKindOfClass:[NSDictionary class]] ? scoring[@"final_score"] : nil;
+            if ([score isKindOfClass:[NSNumber class]] && score.integerValue != 0) {
+                scoresByRow[@(sqlite3_column_int64(stmt, 0))] = score;
+            }
+        }
+        sqlite3_finalize(stmt);
+    }
+    if (scoresByRow.count == 0) {
+        return;
+    }
+    if (sqlite3_prepare_v2(self.db, "UPDATE threat_intel_cache SET final_score = ? WHERE rowid = ?;", -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_exec(self.db, "BEGIN;", NULL, NULL, NULL);
+        for (NSNumber *row in scoresByRow) {
+            sqlite3_bind_int64(stmt, 1, scoresByRow[row].longLongValue);
+            sqlite3_bind_int64(stmt, 2, row.longLongValue);
+            sqlite3_step(stmt);
+            sqlite3_reset(stmt);
+        }
+        sqlite3_exec(self.db, "COMMIT;", NULL, NULL, NULL);
+        sqlite3_finalize(stmt);
+    }
+    SNBLogThreatIntelInfo("Filled in final_score for %lu stored responses", (unsigned long)scoresByRow.count);
+}
+
 + (NSString *)defaultDatabasePath {
     NSArray<NSString *> *paths = NSSearchPathForDirectoriesInDomains(NSApplicationSupportDirectory,
                                                                      NSUserDomainMask,
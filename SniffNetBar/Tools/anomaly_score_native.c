@@ -0,0 +1,85 @@
+//
+//  anomaly_score_native.c
+//  SniffNetBar
+//
+//  Scores feature rows with the native Isolation Forest evaluator, for the
+//  parity check against Scripts/anomaly_score.py. Reads comma-separated rows
+//  of unscaled features in the model's column order from stdin and prints
+//  one score per line with full precision:
+//
+//      make anomaly-parity ANOMALY_MODEL=~/Library/.../anomaly_model.joblib
+//      ./build/anomaly_score_native anomaly_model.iforest [--columns] < rows.csv
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "IsolationForest.h"
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s MODEL [--columns] < rows.csv\n", argv[0]);
+        return 2;
+    }
+    char error[256] = {0};
+    SNBIsolationForest *forest = SNBIsolationForestLoad(argv[1], error, sizeof(error));
+    if (!forest) {
+        fprintf(stderr, "%s\n", error);
+        return 1;
+    }
+    size_t columns = SNBIsolationForestColumnCount(forest);
+    if (argc > 2 && strcmp(argv[2], "--columns") == 0) {
+        for (size_t c = 0; c < columns; c++) {
+            printf("%s\n", SNBIsolationForestColumnName(forest, c));
+        }
+        SNBIsolationForestDestroy(forest);
+        return 0;
+    }
+
+    size_t capacity = 1024;
+    size_t rowCount = 0;
+    double *rows = malloc(capacity * columns * sizeof(double));
+    char line[4096];
+    while (rows && fgets(line, sizeof(line), stdin)) {
+        if (rowCount == capacity) {
+            capacity *= 2;
+            double *grown = realloc(rows, capacity * columns * sizeof(double));
+            if (!grown) {
+                free(rows);
+                rows = NULL;
+                break;
+            }
+            rows = grown;
+        }
+        char *cursor = line;
+        for (size_t c = 0; c < columns; c++) {
+            char *end = NULL;
+            rows[rowCount * columns + c] = strtod(cursor, &end);
+            if (end == cursor) {
+                fprintf(stderr, "row %zu: expected %zu values\n", rowCount + 1, columns);
+                free(rows);
+                SNBIsolationForestDestroy(forest);
+                return 1;
+            }
+            cursor = (*end == ',') ? end + 1 : end;
+        }
+        rowCount++;
+    }
+
+    double *scores = rows ? malloc((rowCount ? rowCount : 1) * sizeof(double)) : NULL;
+    if (!scores || !SNBIsolationForestScore(forest, rows, rowCount, scores, NULL)) {
+        fprintf(stderr, "out of memory\n");
+        free(rows);
+        free(scores);
+        SNBIsolationForestDestroy(forest);
+        return 1;
+    }
+    for (size_t r = 0; r < rowCount; r++) {
+        printf("%.17g\n", scores[r]);
+    }
+
+    free(rows);
+    free(scores);
+    SNBIsolationForestDestroy(forest);
+    return 0;
+}
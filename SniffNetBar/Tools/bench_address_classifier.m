@@ -0,0 +1,232 @@
+//
+//  bench_address_classifier.m
+//  SniffNetBar
+//
+//  Cost per address of classifying IPs as private or public. Times the
+//  string checks IPAddressUtilities used before the prefix table (kept here
+//  verbatim as LegacyIsPublic), the current +isPublicIPAddress: (one
+//  inet_pton plus a table walk) and the table alone on binary addresses, as
+//  the packet path calls it. Also counts the addresses where the legacy
+//  checks disagree with the table: IPv6 prefix-text cases such as "fcb::1"
+//  (0fcb::/16, public) taken for unique-local, and the carrier-grade NAT
+//  and documentation ranges the legacy checks did not know.
+//
+//      make bench-address-classifier && ./build/bench_address_classifier [options]
+//
+//  Options:
+//      --addresses N      distinct addresses (default 100000)
+//      --rounds N         passes over them (default 20)
+//      --networks N       user networks added to the table (default 64)
+//
+
+#import <Foundation/Foundation.h>
+#import <arpa/inet.h>
+#import <time.h>
+#import "AddressClassifier.h"
+#import "IPAddressUtilities.h"
+
+static uint64_t BenchMonotonicNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t BenchNextRandom(uint64_t *state) {
+    // xorshift64*: fixed seed, so every run classifies the same addresses
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545f4914f6cdd1dULL;
+}
+
+#pragma mark - Legacy string checks
+
+static BOOL LegacyIsPrivate(NSString *ip) {
+    if ([ip containsString:@"."]) {
+        if (![IPAddressUtilities isValidIPv4:ip]) {
+            return NO;
+        }
+        NSArray<NSString *> *octets = [ip componentsSeparatedByString:@"."];
+        NSInteger first = [octets[0] integerValue];
+        NSInteger second = [octets[1] integerValue];
+        return first == 10 || (first == 172 && second >= 16 && second <= 31) ||
+            (first == 192 && second == 168) || first == 127 || (first == 169 && second == 254);
+    }
+    if (![IPAddressUtilities isValidIPv6:ip]) {
+        return NO;
+    }
+    NSString *lowerIP = [ip lowercaseString];
+    return [lowerIP isEqualToString:@"::1"] || [lowerIP hasPrefix:@"::1/"] || [lowerIP hasPrefix:@"fe80:"] ||
+        [lowerIP hasPrefix:@"fc"] || [lowerIP hasPrefix:@"fd"] || [lowerIP isEqualToString:@"::"];
+}
+
+static BOOL LegacyIsPublic(NSString *ip) {
+    if ([ip containsString:@"."]) {
+        if (![IPAddressUtilities isValidIPv4:ip] || LegacyIsPrivate(ip)) {
+            return NO;
+        }
+        NSInteger first = [[ip componentsSeparatedByString:@"."][0] integerValue];
+        return !(first >= 224 || first == 0);
+    }
+    if ([ip containsString:@":"]) {
+        if (![IPAddressUtilities isValidIPv6:ip] || LegacyIsPrivate(ip)) {
+            return NO;
+        }
+        return ![[ip lowercaseString] hasPrefix:@"ff"];
+    }
+    return NO;
+}
+
+#pragma mark - Workload
+
+typedef struct {
+    uint8_t family;
+    uint8_t address[16];
+} BenchAddress;
+
+// Roughly what a home network sees: mostly public IPv4, a fifth private,
+// and a quarter IPv6 with some link-local, unique-local and multicast
+static void BenchMakeAddress(uint64_t *state, BenchAddress *address) {
+    uint64_t r = BenchNextRandom(state);
+    memset(address, 0, sizeof(*address));
+    if (r % 4 != 0) {
+        address->family = SNBAddressFamilyIPv4;
+        uint32_t value = (uint32_t)(BenchNextRandom(state) >> 32);
+        if (r % 5 == 1) {
+            value = 0xc0a80000u | (value & 0xffffu);          // 192.168/16
+        }
+        address->address[0] = (uint8_t)(value >> 24);
+        address->address[1] = (uint8_t)(value >> 16);
+        address->address[2] = (uint8_t)(value >> 8);
+        address->address[3] = (uint8_t)value;
+        return;
+    }
+    address->family = SNBAddressFamilyIPv6;
+    for (int i = 0; i < 16; i += 8) {
+        uint64_t bits = BenchNextRandom(state);
+        memcpy(&address->address[i], &bits, 8);
+    }
+    switch ((r >> 8) % 6) {
+        case 0:
+            address->address[0] = 0xfe;
+            address->address[1] = 0x80;
+            break;
+        case 1:
+            address->address[0] = 0xfd;
+            break;
+        case 2:
+            address->address[0] = 0xff;
+            address->address[1] = 0x02;
+            break;
+        case 3:
+            // A leading zero group: its text starts without the zero
+            address->address[0] = 0x0f;
+            break;
+        default:
+            address->address[0] = 0x20 | (address->address[0] & 0x0f);
+            break;
+    }
+}
+
+int main(int argc, const char *argv[]) {
+    @autoreleasepool {
+        NSUInteger addressCount = 100000;
+        NSUInteger rounds = 20;
+        NSUInteger networkCount = 64;
+        for (int i = 1; i + 1 < argc; i += 2) {
+            if (strcmp(argv[i], "--addresses") == 0) {
+                addressCount = (NSUInteger)strtoul(argv[i + 1], NULL, 10);
+            } else if (strcmp(argv[i], "--rounds") == 0) {
+                rounds = (NSUInteger)strtoul(argv[i + 1], NULL, 10);
+            } else if (strcmp(argv[i], "--networks") == 0) {
+                networkCount = (NSUInteger)strtoul(argv[i + 1], NULL, 10);
+            } else {
+                fprintf(stderr, "Unknown option %s\n", argv[i]);
+                return 1;
+            }
+        }
+        if (addressCount == 0 || rounds == 0) {
+            fprintf(stderr, "--addresses and --rounds must be positive\n");
+            return 1;
+        }
+
+        uint64_t state = 0x9e3779b97f4a7c15ULL;
+        NSMutableArray<NSString *> *networks = [NSMutableArray array];
+        for (NSUInteger i = 0; i < networkCount; i++) {
+            uint32_t value = (uint32_t)(BenchNextRandom(&state) >> 32);
+            [networks addObject:[NSString stringWithFormat:@"%u.%u.%u.0/24",
+                                 value >> 24, (value >> 16) & 0xff, (value >> 8) & 0xff]];
+        }
+        NSError *error = nil;
+        if (![IPAddressUtilities setUserNetworks:networks error:&error]) {
+            fprintf(stderr, "%s\n", error.localizedDescription.UTF8String);
+            return 1;
+        }
+        const SNBAddressClassifier *classifier = SNBAddressClassifierShared();
+
+        BenchAddress *addresses = calloc(addressCount, sizeof(BenchAddress));
+        NSMutableArray<NSString *> *strings = [NSMutableArray arrayWithCapacity:addressCount];
+        for (NSUInteger i = 0; i < addressCount; i++) {
+            BenchMakeAddress(&state, &addresses[i]);
+            char text[INET6_ADDRSTRLEN];
+            inet_ntop(addresses[i].family == SNBAddressFamilyIPv6 ? AF_INET6 : AF_INET,
+                      addresses[i].address, text, sizeof(text));
+            [strings addObject:@(text)];
+        }
+
+        NSUInteger legacyPublic = 0;
+        NSUInteger currentPublic = 0;
+        NSUInteger tablePublic = 0;
+        NSUInteger mismatches = 0;
+        for (NSUInteger i = 0; i < addressCount; i++) {
+            BOOL user = (SNBAddressClassify(classifier, addresses[i].family, addresses[i].address) &
+                         SNBAddressClassUser) != 0;
+            // User networks are new with the table; leave them out of the comparison
+            if (!user && LegacyIsPublic(strings[i]) != [IPAddressUtilities isPublicIPAddress:strings[i]]) {
+                mismatches++;
+            }
+        }
+
+        uint64_t start = BenchMonotonicNs();
+        for (NSUInteger round = 0; round < rounds; round++) {
+            @autoreleasepool {
+                for (NSString *ip in strings) {
+                    legacyPublic += LegacyIsPublic(ip);
+                }
+            }
+        }
+        uint64_t legacyNs = BenchMonotonicNs() - start;
+
+        start = BenchMonotonicNs();
+        for (NSUInteger round = 0; round < rounds; round++) {
+            @autoreleasepool {
+                for (NSString *ip in strings) {
+                    currentPublic += [IPAddressUtilities isPublicIPAddress:ip];
+                }
+            }
+        }
+        uint64_t currentNs = BenchMonotonicNs() - start;
+
+        start = BenchMonotonicNs();
+        for (NSUInteger round = 0; round < rounds; round++) {
+            for (NSUInteger i = 0; i < addressCount; i++) {
+                tablePublic += SNBAddressClassify(classifier, addresses[i].family, addresses[i].address) == 0;
+            }
+        }
+        uint64_t tableNs = BenchMonotonicNs() - start;
+
+        double lookups = (double)(addressCount * rounds);
+        printf("addresses %lu, rounds %lu, user networks %lu, table %.1f KB\n",
+               (unsigned long)addressCount, (unsigned long)rounds, (unsigned long)networkCount,
+               (double)SNBAddressClassifierMemoryBytes(classifier) / 1024.0);
+        printf("  legacy string checks   %8.1f ns/address  (%lu public)\n",
+               (double)legacyNs / lookups, (unsigned long)legacyPublic / rounds);
+        printf("  isPublicIPAddress:     %8.1f ns/address  (%lu public)\n",
+               (double)currentNs / lookups, (unsigned long)currentPublic / rounds);
+        printf("  binary table lookup    %8.1f ns/address  (%lu public)\n",
+               (double)tableNs / lookups, (unsigned long)tablePublic / rounds);
+        printf("  legacy misclassified   %lu addresses\n", (unsigned long)mismatches);
+        free(addresses);
+    }
+    return 0;
+}
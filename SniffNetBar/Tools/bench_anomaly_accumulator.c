@@ -0,0 +1,399 @@
+//
+//  bench_anomaly_accumulator.c
+//  SniffNetBar
+//
+//  Per-packet cost and memory per destination of the anomaly window state.
+//  Replays synthetic windows through the compact accumulators the detector
+//  keeps (AnomalyAccumulator.h) and through the layout they replaced: one
+//  flow table per destination plus shared tables for source ports, flows
+//  and destination ports, folded into the destinations when the window
+//  closes. Both are timed packet accounting plus the close, and their
+//  features are compared destination by destination. Three workloads:
+//
+//      mixed   a Zipf-like mix of busy and quiet destinations
+//      scan    one packet to each of many destinations
+//      fanin   a few destinations reached from many source ports
+//
+//  Builds on macOS and Linux:
+//
+//      make bench-anomaly-accumulator && ./build/bench_anomaly_accumulator [options]
+//
+//  Options:
+//      --packets N        packets per window (default 1000000)
+//      --windows N        windows per workload (default 5)
+//
+
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+
+#include <arpa/inet.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "AnomalyAccumulator.h"
+#include "FlowTable.h"
+
+static uint64_t BenchMonotonicNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t BenchNextRandom(uint64_t *state) {
+    // xorshift64*: fixed seed, so every run replays the same windows
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545f4914f6cdd1dULL;
+}
+
+// PacketProtocol of an IANA protocol number, as SNBPacketProtocolFromIPProtocol
+static int BenchProtocolClass(uint8_t ipProtocol) {
+    switch (ipProtocol) {
+        case IPPROTO_TCP:
+            return SNBAnomalyProtocolTCP;
+        case IPPROTO_UDP:
+            return SNBAnomalyProtocolUDP;
+        case IPPROTO_ICMP:
+        case IPPROTO_ICMPV6:
+            return SNBAnomalyProtocolICMP;
+        default:
+            return SNB_ANOMALY_PROTOCOL_COUNT - 1;
+    }
+}
+
+// MARK: - Synthetic windows
+
+typedef enum {
+    BenchWorkloadMixed,
+    BenchWorkloadScan,
+    BenchWorkloadFanIn,
+} BenchWorkload;
+
+static const char *BenchWorkloadName(BenchWorkload workload) {
+    switch (workload) {
+        case BenchWorkloadMixed:
+            return "mixed";
+        case BenchWorkloadScan:
+            return "scan";
+        case BenchWorkloadFanIn:
+            return "fanin";
+    }
+    return "?";
+}
+
+static void BenchSetIPv4(uint8_t *address, uint32_t value) {
+    memset(address, 0, 16);
+    address[0] = (uint8_t)(value >> 24);
+    address[1] = (uint8_t)(value >> 16);
+    address[2] = (uint8_t)(value >> 8);
+    address[3] = (uint8_t)value;
+}
+
+static void BenchFillWindow(SNBPacketRecord *records, size_t count, BenchWorkload workload, uint64_t *state) {
+    static const uint16_t servicePorts[] = {443, 80, 53, 123, 8443, 5223, 993, 22};
+    static const uint8_t protocols[] = {IPPROTO_TCP, IPPROTO_TCP, IPPROTO_TCP, IPPROTO_UDP, IPPROTO_UDP, IPPROTO_ICMP};
+    memset(records, 0, count * sizeof(*records));
+    for (size_t i = 0; i < count; i++) {
+        SNBPacketRecord *record = &records[i];
+        uint64_t draw = BenchNextRandom(state);
+        uint32_t destination;
+        uint32_t flow;
+        switch (workload) {
+            case BenchWorkloadMixed:
+                // Squaring a uniform draw puts most packets on the low ids
+                destination = (uint32_t)((((draw >> 40) * (draw >> 40)) >> 24) % 20000);
+                flow = (uint32_t)((draw >> 8) % (destination < 64 ? 256 : 4));
+                break;
+            case BenchWorkloadScan:
+                destination = (uint32_t)i;
+                flow = (uint32_t)(draw % 4);
+                break;
+            case BenchWorkloadFanIn:
+            default:
+                destination = (uint32_t)(draw % 16);
+                flow = (uint32_t)((draw >> 8) % 60000);
+                break;
+        }
+        record->timestampNs = i * 1000;
+        record->length = 60 + (uint32_t)((draw >> 20) % 1400);
+        record->family = SNBAddressFamilyIPv4;
+        record->ipProtocol = protocols[(destination + flow / 64) % 6];
+        BenchSetIPv4(record->sourceAddress, 0xC0A80000u | (flow % 250));
+        BenchSetIPv4(record->destinationAddress, 0x5D000000u + destination);
+        if (record->ipProtocol != IPPROTO_ICMP) {
+            record->flags = SNBPacketRecordFlagHasPorts;
+            record->sourcePort = (uint16_t)(1024 + flow);
+            record->destinationPort = servicePorts[(destination + (draw >> 50) % 2) % 8];
+        }
+    }
+}
+
+// MARK: - Replaced layout
+
+typedef struct {
+    uint64_t totalBytes;
+    uint64_t totalPackets;
+    uint64_t uniqueSrcPorts;
+    uint64_t flowCount;
+    uint64_t protoCounts[SNB_ANOMALY_PROTOCOL_COUNT];
+    int64_t commonPort;
+    uint64_t commonPortCount;
+    uint64_t flowSamples;
+    double flowBytesMean;
+    double flowBytesM2;
+} BenchTableAccumulator;
+
+typedef struct {
+    SNBFlowTable *accumulators;
+    SNBFlowTable *sourcePorts;
+    SNBFlowTable *flows;
+    SNBFlowTable *destinationPorts;
+} BenchTables;
+
+static void BenchPortKeyMake(SNBFlowKey *key, const SNBPacketRecord *record, uint16_t port) {
+    SNBFlowKeyMakeAddress(key, record->family, record->destinationAddress);
+    if (record->flags & SNBPacketRecordFlagHasPorts) {
+        key->hasPorts = 1;
+        key->destinationPort = port;
+    }
+}
+
+static void BenchTablesAccount(BenchTables *tables, const SNBPacketRecord *records, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        const SNBPacketRecord *record = &records[i];
+        SNBFlowKey key;
+        SNBFlowKeyMakeAddress(&key, record->family, record->destinationAddress);
+        BenchTableAccumulator *acc = SNBFlowTableUpsert(tables->accumulators, &key, NULL);
+        if (!acc) {
+            continue;
+        }
+        acc->totalBytes += record->length;
+        acc->totalPackets += 1;
+
+        bool inserted = false;
+        if ((record->flags & SNBPacketRecordFlagHasPorts) && record->sourcePort > 0) {
+            BenchPortKeyMake(&key, record, record->sourcePort);
+            if (SNBFlowTableUpsert(tables->sourcePorts, &key, &inserted) && inserted) {
+                acc->uniqueSrcPorts++;
+            }
+        }
+
+        int protocol = BenchProtocolClass(record->ipProtocol);
+        SNBFlowKeyMakeRecord(&key, record);
+        key.ipProtocol = (uint8_t)protocol;
+        uint64_t *flowBytes = SNBFlowTableUpsert(tables->flows, &key, &inserted);
+        if (flowBytes) {
+            if (inserted) {
+                acc->flowCount++;
+            }
+            *flowBytes += record->length;
+        }
+
+        BenchPortKeyMake(&key, record, record->destinationPort);
+        uint64_t *portCount = SNBFlowTableUpsert(tables->destinationPorts, &key, NULL);
+        if (portCount) {
+            *portCount += 1;
+        }
+        acc->protoCounts[protocol] += 1;
+    }
+}
+
+// The flush-time fold the compact accumulators made unnecessary
+static void BenchTablesSummarize(BenchTables *tables) {
+    size_t cursor = 0;
+    const SNBFlowKey *key = NULL;
+    const uint64_t *value;
+    SNBFlowKey destinationKey;
+    while ((value = SNBFlowTableNext(tables->destinationPorts, &cursor, &key)) != NULL) {
+        SNBFlowKeyMakeAddress(&destinationKey, key->family, key->destinationAddress);
+        BenchTableAccumulator *acc = SNBFlowTableFind(tables->accumulators, &destinationKey);
+        if (acc && *value > acc->commonPortCount) {
+            acc->commonPortCount = *value;
+            acc->commonPort = key->hasPorts ? (int64_t)key->destinationPort : -1;
+        }
+    }
+    cursor = 0;
+    while ((value = SNBFlowTableNext(tables->flows, &cursor, &key)) != NULL) {
+        SNBFlowKeyMakeAddress(&destinationKey, key->family, key->destinationAddress);
+        BenchTableAccumulator *acc = SNBFlowTableFind(tables->accumulators, &destinationKey);
+        if (!acc) {
+            continue;
+        }
+        double bytes = (double)*value;
+        acc->flowSamples++;
+        double delta = bytes - acc->flowBytesMean;
+        acc->flowBytesMean += delta / (double)acc->flowSamples;
+        acc->flowBytesM2 += delta * (bytes - acc->flowBytesMean);
+    }
+}
+
+static size_t BenchTablesMemory(const BenchTables *tables) {
+    return SNBFlowTableMemoryBytes(tables->accumulators) + SNBFlowTableMemoryBytes(tables->sourcePorts) +
+           SNBFlowTableMemoryBytes(tables->flows) + SNBFlowTableMemoryBytes(tables->destinationPorts);
+}
+
+static void BenchTablesClear(BenchTables *tables) {
+    SNBFlowTableClear(tables->accumulators);
+    SNBFlowTableClear(tables->sourcePorts);
+    SNBFlowTableClear(tables->flows);
+    SNBFlowTableClear(tables->destinationPorts);
+}
+
+// MARK: - Compact accumulators
+
+static void BenchCompactAccount(SNBFlowTable *accumulators, SNBAnomalyArena *arena,
+                                const SNBPacketRecord *records, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        const SNBPacketRecord *record = &records[i];
+        SNBFlowKey key;
+        SNBFlowKeyMakeAddress(&key, record->family, record->destinationAddress);
+        SNBAnomalyAccumulator *acc = SNBFlowTableUpsert(accumulators, &key, NULL);
+        if (acc) {
+            SNBAnomalyAccumulatorAddPacket(acc, arena, record, BenchProtocolClass(record->ipProtocol));
+        }
+    }
+}
+
+// Every compact summary must match the replaced tables. The common port may
+// differ only when the destination saw more distinct ports than the top-K
+// holds, and then it must still be one of the busiest.
+static bool BenchCompare(SNBFlowTable *accumulators, BenchTables *tables, uint64_t *topPortMisses) {
+    size_t cursor = 0;
+    const SNBFlowKey *key = NULL;
+    const SNBAnomalyAccumulator *acc;
+    while ((acc = SNBFlowTableNext(accumulators, &cursor, &key)) != NULL) {
+        const BenchTableAccumulator *expected = SNBFlowTableFind(tables->accumulators, key);
+        if (!expected) {
+            return false;
+        }
+        SNBAnomalyWindowSummary summary;
+        SNBAnomalyAccumulatorSummarize(acc, &summary);
+        double burstiness = expected->flowSamples > 0 ? sqrt(expected->flowBytesM2 / (double)expected->flowSamples) : 0.0;
+        int protocol = 0;
+        for (int p = 1; p < SNB_ANOMALY_PROTOCOL_COUNT; p++) {
+            if (expected->protoCounts[p] > expected->protoCounts[protocol]) {
+                protocol = p;
+            }
+        }
+        if (summary.totalBytes != expected->totalBytes || summary.totalPackets != expected->totalPackets ||
+            summary.uniqueSrcPorts != expected->uniqueSrcPorts || summary.flowCount != expected->flowCount ||
+            summary.protocol != protocol || fabs(summary.burstiness - burstiness) > 1e-9 * fmax(1.0, burstiness)) {
+            return false;
+        }
+        if (summary.commonPort != expected->commonPort) {
+            SNBFlowKey portKey = *key;
+            if (summary.commonPort >= 0) {
+                portKey.hasPorts = 1;
+                portKey.destinationPort = (uint16_t)summary.commonPort;
+            }
+            const uint64_t *count = SNBFlowTableFind(tables->destinationPorts, &portKey);
+            if (!count) {
+                return false;
+            }
+            if (*count != expected->commonPortCount) {
+                (*topPortMisses)++;
+            }
+        }
+    }
+    return true;
+}
+
+// MARK: - Runner
+
+static void BenchRun(BenchWorkload workload, size_t packetCount, uint32_t windowCount, bool *ok) {
+    SNBPacketRecord *records = malloc(packetCount * sizeof(*records));
+    BenchTables tables = {
+        .accumulators = SNBFlowTableCreate(sizeof(BenchTableAccumulator), 256),
+        .sourcePorts = SNBFlowTableCreate(0, 1024),
+        .flows = SNBFlowTableCreate(sizeof(uint64_t), 1024),
+        .destinationPorts = SNBFlowTableCreate(sizeof(uint64_t), 256),
+    };
+    SNBFlowTable *accumulators = SNBFlowTableCreate(sizeof(SNBAnomalyAccumulator), 256);
+    SNBAnomalyArena arena;
+    SNBAnomalyArenaInit(&arena, 64 * 1024);
+    if (!records || !tables.accumulators || !tables.sourcePorts || !tables.flows ||
+        !tables.destinationPorts || !accumulators) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    uint64_t state = 0x9E3779B97F4A7C15ULL + (uint64_t)workload;
+    uint64_t tablesNs = 0;
+    uint64_t compactNs = 0;
+    size_t tablesBytes = 0;
+    size_t compactBytes = 0;
+    uint64_t destinations = 0;
+    uint64_t topPortMisses = 0;
+    for (uint32_t w = 0; w < windowCount; w++) {
+        BenchFillWindow(records, packetCount, workload, &state);
+
+        uint64_t start = BenchMonotonicNs();
+        BenchTablesAccount(&tables, records, packetCount);
+        BenchTablesSummarize(&tables);
+        tablesNs += BenchMonotonicNs() - start;
+
+        start = BenchMonotonicNs();
+        BenchCompactAccount(accumulators, &arena, records, packetCount);
+        compactNs += BenchMonotonicNs() - start;
+
+        // The tables and the arena keep their peak size, so the last window
+        // carries every earlier one's growth
+        destinations = SNBFlowTableCount(accumulators);
+        tablesBytes = BenchTablesMemory(&tables);
+        compactBytes = SNBFlowTableMemoryBytes(accumulators) + arena.reservedBytes;
+        if (!BenchCompare(accumulators, &tables, &topPortMisses)) {
+            fprintf(stderr, "%s: features differ in window %u\n", BenchWorkloadName(workload), w);
+            *ok = false;
+        }
+        BenchTablesClear(&tables);
+        SNBFlowTableClear(accumulators);
+        SNBAnomalyArenaReset(&arena);
+    }
+
+    double packets = (double)packetCount * windowCount;
+    printf("%-6s  %8llu destinations   tables %6.1f ns/pkt %7.0f B/dst   compact %6.1f ns/pkt %7.0f B/dst   "
+           "top-port misses %llu\n",
+           BenchWorkloadName(workload), (unsigned long long)destinations,
+           (double)tablesNs / packets, (double)tablesBytes / (double)destinations,
+           (double)compactNs / packets, (double)compactBytes / (double)destinations,
+           (unsigned long long)topPortMisses);
+
+    SNBFlowTableDestroy(tables.accumulators);
+    SNBFlowTableDestroy(tables.sourcePorts);
+    SNBFlowTableDestroy(tables.flows);
+    SNBFlowTableDestroy(tables.destinationPorts);
+    SNBFlowTableDestroy(accumulators);
+    SNBAnomalyArenaDestroy(&arena);
+    free(records);
+}
+
+int main(int argc, char **argv) {
+    size_t packetCount = 1000000;
+    uint32_t windowCount = 5;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--packets") == 0 && i + 1 < argc) {
+            packetCount = (size_t)strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--windows") == 0 && i + 1 < argc) {
+            windowCount = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else {
+            fprintf(stderr, "usage: %s [--packets N] [--windows N]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (packetCount == 0 || windowCount == 0) {
+        fprintf(stderr, "packets and windows must be non-zero\n");
+        return 1;
+    }
+
+    printf("window: %zu packets, %u windows, sizeof(SNBAnomalyAccumulator) = %zu\n",
+           packetCount, windowCount, sizeof(SNBAnomalyAccumulator));
+    bool ok = true;
+    BenchRun(BenchWorkloadMixed, packetCount, windowCount, &ok);
+    BenchRun(BenchWorkloadScan, packetCount, windowCount, &ok);
+    BenchRun(BenchWorkloadFanIn, packetCount, windowCount, &ok);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,249 @@
+//
+//  bench_blocklist.c
+//  SniffNetBar
+//
+//  Cost of an offline blocklist of a million prefixes, in the shape of the
+//  FireHOL and Spamhaus lists: mostly single addresses, some /24s and a few
+//  wide networks, split over several lists that overlap. Measures:
+//
+//      compile  parse the list files and flatten them into intervals
+//      map      map the compiled file written after the compile, which is
+//               what every start after the first does
+//      memory   size of the table and of its IPv4 index
+//      lookup   lookups/s for random addresses, a share of them listed
+//      tag      packets/s through SNBPacketRecordsMatchBlocklist in
+//               512-record batches, as on the capture queue
+//
+//  Builds on macOS and Linux:
+//
+//      make bench-blocklist && ./build/bench_blocklist [options]
+//
+//  Options:
+//      --prefixes N       prefixes over all lists (default 1000000)
+//      --lists N          source lists (default 4)
+//      --lookups N        addresses looked up (default 20000000)
+//      --hit PERCENT      share of lookups drawn from listed prefixes (default 5)
+//
+
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "Blocklist.h"
+
+#define BENCH_BATCH_RECORDS 512
+
+static uint64_t BenchMonotonicNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t BenchNextRandom(uint64_t *state) {
+    // xorshift64*: fixed seed, so every run sees the same lists
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545f4914f6cdd1dULL;
+}
+
+static uint32_t BenchPrefixLength(uint64_t random) {
+    unsigned bucket = (unsigned)(random % 1000);
+    if (bucket < 800) {
+        return 32;
+    }
+    if (bucket < 990) {
+        return 24;
+    }
+    return 16 + (unsigned)(random >> 16) % 8;
+}
+
+// Writes one list file per list with prefixCount lines spread over them,
+// and keeps every prefix's first address to draw listed lookups from
+static bool BenchWriteLists(const char *directory, unsigned lists, size_t prefixCount,
+                            uint32_t *listed, char paths[][256]) {
+    FILE *files[SNB_BLOCKLIST_MAX_LISTS];
+    for (unsigned list = 0; list < lists; list++) {
+        snprintf(paths[list], 256, "%s/list%u.netset", directory, list);
+        files[list] = fopen(paths[list], "w");
+        if (!files[list]) {
+            return false;
+        }
+        fprintf(files[list], "# Synthetic list %u\n; generated by bench_blocklist\n", list);
+    }
+    uint64_t state = 0x9e3779b97f4a7c15ULL;
+    for (size_t i = 0; i < prefixCount; i++) {
+        uint32_t length = BenchPrefixLength(BenchNextRandom(&state));
+        uint32_t address = (uint32_t)BenchNextRandom(&state);
+        // Lists overlap: a sixth of the entries repeat an earlier one on another list
+        if (i > 0 && BenchNextRandom(&state) % 6 == 0) {
+            address = listed[BenchNextRandom(&state) % i];
+        }
+        address &= length == 0 ? 0 : ~(uint32_t)0 << (32 - length);
+        listed[i] = address;
+        FILE *file = files[i % lists];
+        if (length == 32) {
+            fprintf(file, "%u.%u.%u.%u\n", address >> 24, (address >> 16) & 0xff, (address >> 8) & 0xff, address & 0xff);
+        } else {
+            fprintf(file, "%u.%u.%u.%u/%u ; SBL%zu\n", address >> 24, (address >> 16) & 0xff,
+                    (address >> 8) & 0xff, address & 0xff, length, i);
+        }
+    }
+    for (unsigned list = 0; list < lists; list++) {
+        fclose(files[list]);
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    size_t prefixCount = 1000000;
+    unsigned lists = 4;
+    size_t lookupCount = 20000000;
+    unsigned hitPercent = 5;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--prefixes") == 0 && i + 1 < argc) {
+            prefixCount = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--lists") == 0 && i + 1 < argc) {
+            lists = (unsigned)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--lookups") == 0 && i + 1 < argc) {
+            lookupCount = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--hit") == 0 && i + 1 < argc) {
+            hitPercent = (unsigned)strtoul(argv[++i], NULL, 10);
+        } else {
+            fprintf(stderr, "usage: %s [--prefixes N] [--lists N] [--lookups N] [--hit PERCENT]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (prefixCount == 0 || lists == 0 || lists > SNB_BLOCKLIST_MAX_LISTS || lookupCount == 0 || hitPercent > 100) {
+        fprintf(stderr, "prefixes and lookups must be positive, lists 1-%d and hit at most 100\n", SNB_BLOCKLIST_MAX_LISTS);
+        return 2;
+    }
+
+    char directory[] = "/tmp/bench_blocklist.XXXXXX";
+    if (!mkdtemp(directory)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    char paths[SNB_BLOCKLIST_MAX_LISTS][256];
+    uint32_t *listed = malloc(prefixCount * sizeof(uint32_t));
+    if (!listed || !BenchWriteLists(directory, lists, prefixCount, listed, paths)) {
+        fprintf(stderr, "could not write the lists\n");
+        return 1;
+    }
+    char compiledPath[300];
+    snprintf(compiledPath, sizeof(compiledPath), "%s/blocklist.compiled", directory);
+
+    uint64_t signature = SNB_BLOCKLIST_SIGNATURE_SEED;
+    for (unsigned list = 0; list < lists; list++) {
+        signature = SNBBlocklistSignatureAddFile(signature, paths[list]);
+    }
+
+    uint64_t parseStart = BenchMonotonicNs();
+    SNBBlocklistBuilder *builder = SNBBlocklistBuilderCreate();
+    size_t added = 0;
+    size_t rejected = 0;
+    for (unsigned list = 0; list < lists; list++) {
+        size_t listAdded = 0;
+        size_t listRejected = 0;
+        SNBBlocklistBuilderAddFile(builder, SNBBlocklistBuilderAddList(builder, paths[list]), paths[list],
+                                   &listAdded, &listRejected);
+        added += listAdded;
+        rejected += listRejected;
+    }
+    uint64_t flattenStart = BenchMonotonicNs();
+    SNBBlocklist *compiled = SNBBlocklistBuilderCompile(builder, signature);
+    uint64_t writeStart = BenchMonotonicNs();
+    SNBBlocklistBuilderDestroy(builder);
+    if (!compiled || !SNBBlocklistWrite(compiled, compiledPath)) {
+        fprintf(stderr, "compile failed\n");
+        return 1;
+    }
+    uint64_t writeEnd = BenchMonotonicNs();
+
+    uint64_t mapStart = BenchMonotonicNs();
+    SNBBlocklist *blocklist = SNBBlocklistMap(compiledPath, signature);
+    uint64_t mapEnd = BenchMonotonicNs();
+    if (!blocklist) {
+        fprintf(stderr, "map failed\n");
+        return 1;
+    }
+    if (blocklist->ipv4Count != compiled->ipv4Count) {
+        fprintf(stderr, "mapped table differs from the compiled one\n");
+        return 1;
+    }
+
+    printf("blocklist: %zu prefixes over %u lists (%zu rejected)\n", added, lists, rejected);
+    printf("  compile  parse %.1f ms, flatten %.1f ms, write %.1f ms\n",
+           (double)(flattenStart - parseStart) / 1e6, (double)(writeStart - flattenStart) / 1e6,
+           (double)(writeEnd - writeStart) / 1e6);
+    printf("  map      %.3f ms\n", (double)(mapEnd - mapStart) / 1e6);
+    printf("  memory   %.1f MB: %u IPv4 intervals at 12 bytes, %zu KB index\n",
+           (double)SNBBlocklistMemoryBytes(blocklist) / (1024.0 * 1024.0), blocklist->ipv4Count,
+           (size_t)SNB_BLOCKLIST_IPV4_INDEX_COUNT * sizeof(uint32_t) / 1024);
+
+    // Lookups: the first pass over the mapped table also faults its pages in
+    uint32_t *addresses = malloc(lookupCount * sizeof(uint32_t));
+    if (!addresses) {
+        return 1;
+    }
+    uint64_t state = 0x2545f4914f6cdd1dULL;
+    for (size_t i = 0; i < lookupCount; i++) {
+        uint64_t random = BenchNextRandom(&state);
+        addresses[i] = random % 100 < hitPercent ? listed[(random >> 8) % prefixCount] : (uint32_t)(random >> 32);
+    }
+    size_t hits = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        hits = 0;
+        uint64_t lookupStart = BenchMonotonicNs();
+        for (size_t i = 0; i < lookupCount; i++) {
+            hits += SNBBlocklistLookupIPv4(blocklist, addresses[i]) != 0;
+        }
+        uint64_t elapsed = BenchMonotonicNs() - lookupStart;
+        printf("  lookup   %s: %.1f M/s, %.1f ns each, %.1f%% listed\n", pass == 0 ? "cold" : "warm",
+               (double)lookupCount / ((double)elapsed / 1e9) / 1e6, (double)elapsed / (double)lookupCount,
+               100.0 * (double)hits / (double)lookupCount);
+    }
+
+    SNBPacketRecord *records = calloc(BENCH_BATCH_RECORDS, sizeof(SNBPacketRecord));
+    if (!records) {
+        return 1;
+    }
+    size_t tagged = 0;
+    uint64_t tagStart = BenchMonotonicNs();
+    for (size_t base = 0; base + BENCH_BATCH_RECORDS <= lookupCount; base += BENCH_BATCH_RECORDS) {
+        for (size_t i = 0; i < BENCH_BATCH_RECORDS; i++) {
+            uint32_t address = addresses[base + i];
+            records[i].family = SNBAddressFamilyIPv4;
+            records[i].length = 100;
+            records[i].flags = SNBPacketRecordFlagOutgoing;
+            records[i].destinationAddress[0] = (uint8_t)(address >> 24);
+            records[i].destinationAddress[1] = (uint8_t)(address >> 16);
+            records[i].destinationAddress[2] = (uint8_t)(address >> 8);
+            records[i].destinationAddress[3] = (uint8_t)address;
+        }
+        tagged += SNBPacketRecordsMatchBlocklist(blocklist, records, BENCH_BATCH_RECORDS);
+    }
+    uint64_t tagElapsed = BenchMonotonicNs() - tagStart;
+    size_t batched = lookupCount / BENCH_BATCH_RECORDS * BENCH_BATCH_RECORDS;
+    printf("  tag      %.1f M packets/s including record setup, %zu flagged\n",
+           (double)batched / ((double)tagElapsed / 1e9) / 1e6, tagged);
+
+    free(records);
+    free(addresses);
+    free(listed);
+    SNBBlocklistDestroy(compiled);
+    SNBBlocklistDestroy(blocklist);
+    for (unsigned list = 0; list < lists; list++) {
+        unlink(paths[list]);
+    }
+    unlink(compiledPath);
+    rmdir(directory);
+    return 0;
+}
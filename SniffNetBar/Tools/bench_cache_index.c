@@ -0,0 +1,319 @@
+//
+//  bench_cache_index.c
+//  SniffNetBar
+//
+//  Cost per operation of the LRU/TTL cache index (CacheIndex.h) at 100k
+//  entries, against the bookkeeping it replaced: a full scan for the least
+//  recently used entry on every insert into a full cache, and a scan of every
+//  timestamp on every cleanup. Keys are IPv4 hosts in a flow table mapping
+//  key to slot, as LRUCache.m maps keys with a dictionary. Two workloads:
+//
+//      lookup  Zipf-like lookups over more keys than fit; misses insert and
+//              evict. Both layouts must agree on every hit.
+//      expiry  entries with TTLs spread over a minute, swept every 100 ms of
+//              a simulated clock. Both layouts must expire the same entries.
+//
+//  Builds on macOS and Linux:
+//
+//      make bench-cache-index && ./build/bench_cache_index [options]
+//
+//  Options:
+//      --entries N        cache capacity (default 100000)
+//      --lookups N        lookups for the index (default 2000000)
+//      --scan-lookups N   lookups for the scanning layout (default 20000)
+//
+
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "CacheIndex.h"
+#include "FlowTable.h"
+
+static uint64_t BenchMonotonicNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t BenchNextRandom(uint64_t *state) {
+    // xorshift64*: fixed seed, so every run replays the same operations
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545f4914f6cdd1dULL;
+}
+
+static void BenchMakeKey(SNBFlowKey *key, uint32_t host) {
+    uint8_t address[16] = {0};
+    uint32_t value = 0x5D000000u + host;
+    address[0] = (uint8_t)(value >> 24);
+    address[1] = (uint8_t)(value >> 16);
+    address[2] = (uint8_t)(value >> 8);
+    address[3] = (uint8_t)value;
+    SNBFlowKeyMakeAddress(key, SNBAddressFamilyIPv4, address);
+}
+
+// Squaring a uniform draw puts most lookups on the low ids
+static uint32_t BenchDrawHost(uint64_t *state, uint32_t keySpace) {
+    uint64_t draw = BenchNextRandom(state) >> 40;
+    return (uint32_t)(((draw * draw) >> 24) % keySpace);
+}
+
+// MARK: - Cache index
+
+typedef struct {
+    SNBCacheIndex *index;
+    SNBFlowTable *slots;          // Key to uint32_t slot
+    SNBFlowKey *keys;             // Slot to key, to unmap evicted entries
+} BenchIndexCache;
+
+static bool BenchIndexCacheInit(BenchIndexCache *cache, uint32_t capacity, uint64_t tickNs) {
+    cache->index = SNBCacheIndexCreate(capacity, tickNs);
+    cache->slots = SNBFlowTableCreate(sizeof(uint32_t), capacity);
+    cache->keys = calloc(capacity, sizeof(SNBFlowKey));
+    return cache->index && cache->slots && cache->keys;
+}
+
+static void BenchIndexCacheFree(BenchIndexCache *cache) {
+    SNBCacheIndexDestroy(cache->index);
+    SNBFlowTableDestroy(cache->slots);
+    free(cache->keys);
+}
+
+static void BenchIndexUnmap(uint32_t slot, void *context) {
+    BenchIndexCache *cache = context;
+    SNBFlowTableRemove(cache->slots, &cache->keys[slot]);
+}
+
+// Returns true on a hit; a miss inserts the key
+static bool BenchIndexLookup(BenchIndexCache *cache, const SNBFlowKey *key, uint64_t nowNs, uint64_t ttlNs) {
+    uint32_t *mapped = SNBFlowTableFind(cache->slots, key);
+    if (mapped) {
+        uint32_t slot = *mapped;
+        if (SNBCacheIndexTouch(cache->index, slot, nowNs)) {
+            return true;
+        }
+        SNBFlowTableRemove(cache->slots, key);
+    } else {
+        SNBCacheIndexNoteMiss(cache->index);
+    }
+
+    bool evicted = false;
+    uint32_t slot = SNBCacheIndexInsert(cache->index, nowNs + ttlNs, &evicted);
+    if (evicted) {
+        BenchIndexUnmap(slot, cache);
+    }
+    cache->keys[slot] = *key;
+    bool inserted = false;
+    uint32_t *value = SNBFlowTableUpsert(cache->slots, key, &inserted);
+    if (value) {
+        *value = slot;
+    }
+    return false;
+}
+
+// MARK: - Replaced layout
+
+typedef struct {
+    uint64_t accessedNs;
+    uint64_t expiresNs;
+} BenchScanEntry;
+
+static bool BenchScanLookup(SNBFlowTable *table, size_t capacity, const SNBFlowKey *key,
+                            uint64_t nowNs, uint64_t ttlNs) {
+    BenchScanEntry *entry = SNBFlowTableFind(table, key);
+    if (entry && entry->expiresNs > nowNs) {
+        entry->accessedNs = nowNs;
+        return true;
+    }
+    if (!entry && SNBFlowTableCount(table) >= capacity) {
+        // The least recently accessed entry, found by visiting all of them
+        size_t cursor = 0;
+        const SNBFlowKey *entryKey = NULL;
+        SNBFlowKey oldestKey;
+        uint64_t oldestNs = UINT64_MAX;
+        BenchScanEntry *candidate;
+        while ((candidate = SNBFlowTableNext(table, &cursor, &entryKey))) {
+            if (candidate->accessedNs < oldestNs) {
+                oldestNs = candidate->accessedNs;
+                oldestKey = *entryKey;
+            }
+        }
+        SNBFlowTableRemove(table, &oldestKey);
+    }
+    bool inserted = false;
+    entry = SNBFlowTableUpsert(table, key, &inserted);
+    if (entry) {
+        entry->accessedNs = nowNs;
+        entry->expiresNs = nowNs + ttlNs;
+    }
+    return false;
+}
+
+static size_t BenchScanExpire(SNBFlowTable *table, uint64_t nowNs) {
+    size_t expired = 0;
+    size_t cursor = 0;
+    const SNBFlowKey *key = NULL;
+    BenchScanEntry *entry;
+    while ((entry = SNBFlowTableNext(table, &cursor, &key))) {
+        if (entry->expiresNs <= nowNs) {
+            SNBFlowTableRemoveCurrent(table, &cursor);
+            expired++;
+        }
+    }
+    return expired;
+}
+
+// MARK: - Workloads
+
+static const uint64_t kBenchHourNs = 3600ULL * 1000000000ULL;
+
+static bool BenchLookup(uint32_t capacity, uint64_t lookups, uint64_t scanLookups) {
+    uint32_t keySpace = capacity + capacity / 2;
+    BenchIndexCache cache;
+    SNBFlowTable *scanTable = SNBFlowTableCreate(sizeof(BenchScanEntry), capacity);
+    if (!BenchIndexCacheInit(&cache, capacity, 1000000000ULL) || !scanTable) {
+        fprintf(stderr, "allocation failed\n");
+        return false;
+    }
+
+    // Fill both, then check they agree on every lookup of a shared prefix
+    SNBFlowKey key;
+    for (uint32_t host = 0; host < capacity; host++) {
+        BenchMakeKey(&key, host);
+        BenchIndexLookup(&cache, &key, host + 1, kBenchHourNs);
+        BenchScanLookup(scanTable, capacity, &key, host + 1, kBenchHourNs);
+    }
+    uint64_t state = 0x9e3779b97f4a7c15ULL;
+    uint64_t clockNs = capacity + 1;
+    uint64_t scanHits = 0;
+    uint64_t scanStart = BenchMonotonicNs();
+    for (uint64_t i = 0; i < scanLookups; i++) {
+        BenchMakeKey(&key, BenchDrawHost(&state, keySpace));
+        scanHits += BenchScanLookup(scanTable, capacity, &key, clockNs + i, kBenchHourNs);
+    }
+    uint64_t scanNs = BenchMonotonicNs() - scanStart;
+
+    state = 0x9e3779b97f4a7c15ULL;
+    uint64_t indexHits = 0;
+    uint64_t prefixHits = 0;
+    uint64_t indexStart = BenchMonotonicNs();
+    for (uint64_t i = 0; i < lookups; i++) {
+        BenchMakeKey(&key, BenchDrawHost(&state, keySpace));
+        indexHits += BenchIndexLookup(&cache, &key, clockNs + i, kBenchHourNs);
+        if (i + 1 == scanLookups) {
+            prefixHits = indexHits;
+        }
+    }
+    uint64_t indexNs = BenchMonotonicNs() - indexStart;
+    if (scanLookups > lookups) {
+        prefixHits = indexHits;
+    }
+
+    SNBCacheIndexStats stats = SNBCacheIndexGetStats(cache.index);
+    printf("lookup: %u entries, %u keys\n", capacity, keySpace);
+    printf("  index  %10llu lookups  %8.1f ns/op  hit rate %5.1f%%  %llu evictions  %.1f MB\n",
+           (unsigned long long)lookups, lookups ? (double)indexNs / (double)lookups : 0.0,
+           lookups ? 100.0 * (double)indexHits / (double)lookups : 0.0,
+           (unsigned long long)stats.evictions,
+           (double)(SNBCacheIndexMemoryBytes(cache.index) + SNBFlowTableMemoryBytes(cache.slots) +
+                    capacity * sizeof(SNBFlowKey)) / (1024.0 * 1024.0));
+    printf("  scan   %10llu lookups  %8.1f ns/op  hit rate %5.1f%%\n",
+           (unsigned long long)scanLookups, scanLookups ? (double)scanNs / (double)scanLookups : 0.0,
+           scanLookups ? 100.0 * (double)scanHits / (double)scanLookups : 0.0);
+
+    bool ok = scanLookups > lookups || prefixHits == scanHits;
+    if (!ok) {
+        printf("  MISMATCH: index hit %llu of the first %llu lookups, scan hit %llu\n",
+               (unsigned long long)prefixHits, (unsigned long long)scanLookups,
+               (unsigned long long)scanHits);
+    }
+    BenchIndexCacheFree(&cache);
+    SNBFlowTableDestroy(scanTable);
+    return ok;
+}
+
+static bool BenchExpiry(uint32_t capacity) {
+    const uint64_t minuteNs = 60ULL * 1000000000ULL;
+    const uint64_t stepNs = 100000000ULL;
+    BenchIndexCache cache;
+    SNBFlowTable *scanTable = SNBFlowTableCreate(sizeof(BenchScanEntry), capacity);
+    if (!BenchIndexCacheInit(&cache, capacity, minuteNs / 256) || !scanTable) {
+        fprintf(stderr, "allocation failed\n");
+        return false;
+    }
+
+    uint64_t state = 0x2545f4914f6cdd1dULL;
+    uint64_t startNs = 1000000000ULL;
+    SNBFlowKey key;
+    for (uint32_t host = 0; host < capacity; host++) {
+        BenchMakeKey(&key, host);
+        uint64_t ttlNs = 1 + BenchNextRandom(&state) % minuteNs;
+        BenchIndexLookup(&cache, &key, startNs, ttlNs);
+        BenchScanLookup(scanTable, capacity, &key, startNs, ttlNs);
+    }
+
+    uint64_t sweeps = 0;
+    uint64_t indexNs = 0;
+    uint64_t scanNs = 0;
+    size_t indexExpired = 0;
+    size_t scanExpired = 0;
+    bool ok = true;
+    // Runs two ticks past the last expiry so the wheel has swept it
+    uint64_t endNs = startNs + minuteNs + 2 * (minuteNs / 256);
+    for (uint64_t nowNs = startNs + stepNs; nowNs <= endNs; nowNs += stepNs) {
+        uint64_t start = BenchMonotonicNs();
+        indexExpired += SNBCacheIndexExpire(cache.index, nowNs, BenchIndexUnmap, &cache);
+        uint64_t middle = BenchMonotonicNs();
+        scanExpired += BenchScanExpire(scanTable, nowNs);
+        scanNs += BenchMonotonicNs() - middle;
+        indexNs += middle - start;
+        sweeps++;
+        // The wheel sweeps completed ticks, so it may trail by one tick
+        if (scanExpired < indexExpired) {
+            ok = false;
+        }
+    }
+
+    printf("expiry: %u entries over 60 s, %llu sweeps\n", capacity, (unsigned long long)sweeps);
+    printf("  index  %10.1f us/sweep  %zu expired\n", (double)indexNs / (double)sweeps / 1000.0, indexExpired);
+    printf("  scan   %10.1f us/sweep  %zu expired\n", (double)scanNs / (double)sweeps / 1000.0, scanExpired);
+    if (indexExpired != scanExpired || SNBCacheIndexCount(cache.index) != 0 || !ok) {
+        printf("  MISMATCH: %u entries left in the index\n", SNBCacheIndexCount(cache.index));
+        ok = false;
+    }
+    BenchIndexCacheFree(&cache);
+    SNBFlowTableDestroy(scanTable);
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    uint32_t capacity = 100000;
+    uint64_t lookups = 2000000;
+    uint64_t scanLookups = 20000;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--entries") == 0 && i + 1 < argc) {
+            capacity = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--lookups") == 0 && i + 1 < argc) {
+            lookups = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--scan-lookups") == 0 && i + 1 < argc) {
+            scanLookups = strtoull(argv[++i], NULL, 10);
+        } else {
+            fprintf(stderr, "usage: %s [--entries N] [--lookups N] [--scan-lookups N]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (capacity == 0) {
+        fprintf(stderr, "entries must be non-zero\n");
+        return 1;
+    }
+
+    bool ok = BenchLookup(capacity, lookups, scanLookups);
+    ok = BenchExpiry(capacity) && ok;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,573 @@
+//
+//  bench_history_flush.c
+//  SniffNetBar
+//
+//  Write amplification of the daily history's flushes over one day of
+//  traffic, into a database that already holds the older days:
+//
+//      rewrite  every flush upserts every host and connection of the day,
+//               prepares its statements anew, counts the day's hosts and
+//               applies retention with DELETE ... NOT IN (SELECT ...), on
+//               rowid tables with a separate day index
+//      dirty    -[SNBStatisticsHistory persistToDatabase]: only the hosts
+//               and connections that saw packets since the last flush,
+//               with their deltas, through statements prepared once, on
+//               tables clustered by day; retention is a range delete when
+//               the day changes
+//
+//  Rows are counted as the statements write them and pages as the WAL grows.
+//  Both must end with the same totals. Builds on macOS and Linux:
+//
+//      make bench-history-flush && ./build/bench_history_flush [options]
+//
+//  Options:
+//      --hosts N          remote hosts seen in the day (default 20000)
+//      --connections N    connections seen in the day (default 100000)
+//      --active PERCENT   share of earlier hosts and connections active in
+//                         each five-minute interval (default 5)
+//      --history-days N   older days already stored (default 90)
+//      --history-rows N   connections per older day (default 20000)
+//
+
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sqlite3.h>
+
+#define BENCH_FLUSHES_PER_DAY 288       // kStatsFlushInterval is 300 s
+#define BENCH_MAX_STORED_DAYS 90        // kStatsMaxStoredDays
+
+static uint64_t BenchMonotonicNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t BenchNextRandom(uint64_t *state) {
+    // xorshift64*: fixed seed, so both modes see the same traffic
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545f4914f6cdd1dULL;
+}
+
+static bool BenchExec(sqlite3 *db, const char *sql) {
+    char *error = NULL;
+    if (sqlite3_exec(db, sql, NULL, NULL, &error) != SQLITE_OK) {
+        fprintf(stderr, "sqlite: %s\n", error ? error : "error");
+        sqlite3_free(error);
+        return false;
+    }
+    return true;
+}
+
+static void BenchHostAddress(uint32_t host, char *buffer, size_t length) {
+    uint32_t value = 0x5D000000u + host;
+    snprintf(buffer, length, "%u.%u.%u.%u", value >> 24, (value >> 16) & 0xFF, (value >> 8) & 0xFF, value & 0xFF);
+}
+
+static void BenchSourceAddress(uint32_t connection, char *buffer, size_t length) {
+    snprintf(buffer, length, "192.168.%u.%u", (connection >> 14) & 0xFF, 10 + ((connection >> 12) & 0x3));
+}
+
+static int BenchSourcePort(uint32_t connection) {
+    return 49152 + (int)(connection & 0xFFF);
+}
+
+// MARK: - Configuration
+
+typedef struct {
+    uint32_t hosts;
+    uint32_t connections;
+    uint32_t activePercent;
+    uint32_t historyDays;
+    uint32_t historyRows;
+} BenchConfig;
+
+typedef enum {
+    BenchModeRewrite,
+    BenchModeDirty
+} BenchMode;
+
+typedef struct {
+    uint64_t rows;
+    uint64_t pages;
+    uint64_t totalNs;
+    uint64_t maxNs;
+    uint64_t retentionNs;
+    uint64_t hostBytes;
+    uint64_t connectionBytes;
+    uint64_t uniqueHosts;
+} BenchResult;
+
+typedef struct {
+    sqlite3 *db;
+    uint64_t walPages;
+} BenchDatabase;
+
+static int BenchWalHook(void *context, sqlite3 *db, const char *name, int pages) {
+    (void)db;
+    (void)name;
+    ((BenchDatabase *)context)->walPages = (uint64_t)pages;
+    return SQLITE_OK;
+}
+
+// MARK: - Fixtures
+
+static bool BenchCreateSchema(sqlite3 *db, BenchMode mode) {
+    const char *clustered = mode == BenchModeDirty ? " WITHOUT ROWID" : "";
+    char hosts[512];
+    char connections[512];
+    snprintf(hosts, sizeof(hosts),
+             "CREATE TABLE stats_hosts (day TEXT NOT NULL, host TEXT NOT NULL, bytes INTEGER NOT NULL, "
+             "packets INTEGER NOT NULL, PRIMARY KEY (day, host))%s;", clustered);
+    snprintf(connections, sizeof(connections),
+             "CREATE TABLE stats_connections (day TEXT NOT NULL, src_addr TEXT NOT NULL, src_port INTEGER NOT NULL, "
+             "dst_addr TEXT NOT NULL, dst_port INTEGER NOT NULL, bytes INTEGER NOT NULL, packets INTEGER NOT NULL, "
+             "PRIMARY KEY (day, src_addr, src_port, dst_addr, dst_port))%s;", clustered);
+    if (!BenchExec(db, "PRAGMA journal_mode=WAL;") ||
+        !BenchExec(db, "PRAGMA synchronous=NORMAL;") ||
+        !BenchExec(db, "CREATE TABLE stats_days (day TEXT PRIMARY KEY, total_bytes INTEGER NOT NULL, "
+                       "unique_hosts INTEGER NOT NULL);") ||
+        !BenchExec(db, hosts) || !BenchExec(db, connections)) {
+        return false;
+    }
+    if (mode == BenchModeRewrite) {
+        return BenchExec(db, "CREATE INDEX stats_hosts_day_idx ON stats_hosts(day);") &&
+               BenchExec(db, "CREATE INDEX stats_connections_day_idx ON stats_connections(day);");
+    }
+    return true;
+}
+
+static void BenchDayString(uint32_t day, char *buffer, size_t length) {
+    snprintf(buffer, length, "2025-%02u-%02u", 1 + (day / 28) % 12, 1 + day % 28);
+}
+
+// The older days, oldest first, ending the day before the benchmarked one.
+// One more than the retention keeps, so the first flush has a day to drop.
+static bool BenchFillHistory(sqlite3 *db, const BenchConfig *config) {
+    sqlite3_stmt *day = NULL;
+    sqlite3_stmt *host = NULL;
+    sqlite3_stmt *connection = NULL;
+    bool ok = sqlite3_prepare_v2(db, "INSERT INTO stats_days VALUES (?, 0, 0);", -1, &day, NULL) == SQLITE_OK &&
+              sqlite3_prepare_v2(db, "INSERT OR IGNORE INTO stats_hosts VALUES (?, ?, 1, 1);", -1, &host, NULL) == SQLITE_OK &&
+              sqlite3_prepare_v2(db, "INSERT OR IGNORE INTO stats_connections VALUES (?, ?, ?, ?, 443, 1, 1);",
+                                 -1, &connection, NULL) == SQLITE_OK;
+    uint64_t random = 0x9E3779B97F4A7C15ULL;
+    BenchExec(db, "BEGIN;");
+    for (uint32_t d = 0; ok && d < config->historyDays; d++) {
+        char dayString[32];
+        BenchDayString(d, dayString, sizeof(dayString));
+        sqlite3_bind_text(day, 1, dayString, -1, SQLITE_TRANSIENT);
+        sqlite3_step(day);
+        sqlite3_reset(day);
+        for (uint32_t i = 0; i < config->historyRows; i++) {
+            char source[32];
+            char destination[32];
+            uint32_t remote = (uint32_t)(BenchNextRandom(&random) % config->hosts);
+            BenchSourceAddress(i, source, sizeof(source));
+            BenchHostAddress(remote, destination, sizeof(destination));
+            sqlite3_bind_text(connection, 1, dayString, -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(connection, 2, source, -1, SQLITE_TRANSIENT);
+            sqlite3_bind_int(connection, 3, BenchSourcePort(i));
+            sqlite3_bind_text(connection, 4, destination, -1, SQLITE_TRANSIENT);
+            sqlite3_step(connection);
+            sqlite3_reset(connection);
+            if (i % 4 == 0) {
+                sqlite3_bind_text(host, 1, dayString, -1, SQLITE_TRANSIENT);
+                sqlite3_bind_text(host, 2, destination, -1, SQLITE_TRANSIENT);
+                sqlite3_step(host);
+                sqlite3_reset(host);
+            }
+        }
+    }
+    BenchExec(db, "COMMIT;");
+    sqlite3_finalize(day);
+    sqlite3_finalize(host);
+    sqlite3_finalize(connection);
+    return ok;
+}
+
+// MARK: - Day
+
+// Per-item totals for the day and the part not yet flushed
+typedef struct {
+    uint64_t bytes;
+    uint64_t packets;
+    uint64_t pendingBytes;
+    uint64_t pendingPackets;
+} BenchCounters;
+
+static void BenchTouch(BenchCounters *counters, uint64_t *random) {
+    uint64_t bytes = 64 + BenchNextRandom(random) % 65536;
+    uint64_t packets = 1 + bytes / 1400;
+    counters->bytes += bytes;
+    counters->packets += packets;
+    counters->pendingBytes += bytes;
+    counters->pendingPackets += packets;
+}
+
+static const char *kBenchToday = "2025-12-31";
+
+static uint64_t BenchWriteRewrite(sqlite3 *db, const BenchConfig *config, BenchCounters *hosts, uint32_t seenHosts,
+                                  BenchCounters *connections, uint32_t seenConnections, BenchResult *result) {
+    uint64_t rows = 0;
+    sqlite3_stmt *stmt = NULL;
+    char source[32];
+    char destination[32];
+    if (sqlite3_prepare_v2(db, "INSERT INTO stats_hosts (day, host, bytes, packets) VALUES (?, ?, ?, ?) "
+                           "ON CONFLICT(day, host) DO UPDATE SET bytes=excluded.bytes, packets=excluded.packets;",
+                           -1, &stmt, NULL) == SQLITE_OK) {
+        for (uint32_t h = 0; h < seenHosts; h++) {
+            BenchHostAddress(h, destination, sizeof(destination));
+            sqlite3_bind_text(stmt, 1, kBenchToday, -1, SQLITE_STATIC);
+            sqlite3_bind_text(stmt, 2, destination, -1, SQLITE_TRANSIENT);
+            sqlite3_bind_int64(stmt, 3, (sqlite3_int64)hosts[h].bytes);
+            sqlite3_bind_int64(stmt, 4, (sqlite3_int64)hosts[h].packets);
+            sqlite3_step(stmt);
+            sqlite3_reset(stmt);
+            rows++;
+        }
+        sqlite3_finalize(stmt);
+    }
+    stmt = NULL;
+    if (sqlite3_prepare_v2(db, "INSERT INTO stats_connections (day, src_addr, src_port, dst_addr, dst_port, bytes, packets) "
+                           "VALUES (?, ?, ?, ?, 443, ?, ?) "
+                           "ON CONFLICT(day, src_addr, src_port, dst_addr, dst_port) DO UPDATE SET "
+                           "bytes=excluded.bytes, packets=excluded.packets;", -1, &stmt, NULL) == SQLITE_OK) {
+        for (uint32_t c = 0; c < seenConnections; c++) {
+            BenchSourceAddress(c, source, sizeof(source));
+            BenchHostAddress(c % config->hosts, destination, sizeof(destination));
+            sqlite3_bind_text(stmt, 1, kBenchToday, -1, SQLITE_STATIC);
+            sqlite3_bind_text(stmt, 2, source, -1, SQLITE_TRANSIENT);
+            sqlite3_bind_int(stmt, 3, BenchSourcePort(c));
+            sqlite3_bind_text(stmt, 4, destination, -1, SQLITE_TRANSIENT);
+            sqlite3_bind_int64(stmt, 5, (sqlite3_int64)connections[c].bytes);
+            sqlite3_bind_int64(stmt, 6, (sqlite3_int64)connections[c].packets);
+            sqlite3_step(stmt);
+            sqlite3_reset(stmt);
+            rows++;
+        }
+        sqlite3_finalize(stmt);
+    }
+    stmt = NULL;
+    if (sqlite3_prepare_v2(db, "SELECT COUNT(*) FROM stats_hosts WHERE day = ?;", -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, kBenchToday, -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            result->uniqueHosts = (uint64_t)sqlite3_column_int64(stmt, 0);
+        }
+        sqlite3_finalize(stmt);
+    }
+    return rows;
+}
+
+typedef struct {
+    sqlite3_stmt *insertHost;
+    sqlite3_stmt *updateHost;
+    sqlite3_stmt *upsertConnection;
+    sqlite3_stmt *upsertDay;
+} BenchStatements;
+
+static uint64_t BenchWriteDirty(sqlite3 *db, const BenchConfig *config, const BenchStatements *statements,
+                                BenchCounters *hosts, uint32_t seenHosts,
+                                BenchCounters *connections, uint32_t seenConnections, BenchResult *result) {
+    uint64_t rows = 0;
+    char source[32];
+    char destination[32];
+    // The app walks a table of just the pending rows; the scan over every
+    // item here stands in for that and is not a database cost
+    for (uint32_t h = 0; h < seenHosts; h++) {
+        if (hosts[h].pendingPackets == 0) {
+            continue;
+        }
+        BenchHostAddress(h, destination, sizeof(destination));
+        sqlite3_bind_text(statements->insertHost, 1, kBenchToday, -1, SQLITE_STATIC);
+        sqlite3_bind_text(statements->insertHost, 2, destination, -1, SQLITE_STATIC);
+        sqlite3_bind_int64(statements->insertHost, 3, (sqlite3_int64)hosts[h].pendingBytes);
+        sqlite3_bind_int64(statements->insertHost, 4, (sqlite3_int64)hosts[h].pendingPackets);
+        if (sqlite3_step(statements->insertHost) == SQLITE_DONE && sqlite3_changes(db) > 0) {
+            result->uniqueHosts++;
+        } else {
+            sqlite3_bind_text(statements->updateHost, 1, kBenchToday, -1, SQLITE_STATIC);
+            sqlite3_bind_text(statements->updateHost, 2, destination, -1, SQLITE_STATIC);
+            sqlite3_bind_int64(statements->updateHost, 3, (sqlite3_int64)hosts[h].pendingBytes);
+            sqlite3_bind_int64(statements->updateHost, 4, (sqlite3_int64)hosts[h].pendingPackets);
+            sqlite3_step(statements->updateHost);
+            sqlite3_reset(statements->updateHost);
+        }
+        sqlite3_reset(statements->insertHost);
+        hosts[h].pendingBytes = 0;
+        hosts[h].pendingPackets = 0;
+        rows++;
+    }
+    for (uint32_t c = 0; c < seenConnections; c++) {
+        if (connections[c].pendingPackets == 0) {
+            continue;
+        }
+        BenchSourceAddress(c, source, sizeof(source));
+        BenchHostAddress(c % config->hosts, destination, sizeof(destination));
+        sqlite3_stmt *stmt = statements->upsertConnection;
+        sqlite3_bind_text(stmt, 1, kBenchToday, -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, source, -1, SQLITE_STATIC);
+        sqlite3_bind_int(stmt, 3, BenchSourcePort(c));
+        sqlite3_bind_text(stmt, 4, destination, -1, SQLITE_STATIC);
+        sqlite3_bind_int64(stmt, 5, (sqlite3_int64)connections[c].pendingBytes);
+        sqlite3_bind_int64(stmt, 6, (sqlite3_int64)connections[c].pendingPackets);
+        sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+        connections[c].pendingBytes = 0;
+        connections[c].pendingPackets = 0;
+        rows++;
+    }
+    return rows;
+}
+
+static void BenchRetentionRewrite(sqlite3 *db) {
+    char sql[256];
+    snprintf(sql, sizeof(sql), "DELETE FROM stats_days WHERE day NOT IN "
+             "(SELECT day FROM stats_days ORDER BY day DESC LIMIT %d);", BENCH_MAX_STORED_DAYS);
+    BenchExec(db, sql);
+    BenchExec(db, "DELETE FROM stats_hosts WHERE day NOT IN (SELECT day FROM stats_days);");
+    BenchExec(db, "DELETE FROM stats_connections WHERE day NOT IN (SELECT day FROM stats_days);");
+}
+
+static void BenchRetentionDirty(sqlite3 *db) {
+    sqlite3_stmt *stmt = NULL;
+    char oldest[32] = "";
+    if (sqlite3_prepare_v2(db, "SELECT day FROM stats_days ORDER BY day DESC LIMIT 1 OFFSET ?;", -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_int(stmt, 1, BENCH_MAX_STORED_DAYS - 1);
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            snprintf(oldest, sizeof(oldest), "%s", (const char *)sqlite3_column_text(stmt, 0));
+        }
+        sqlite3_finalize(stmt);
+    }
+    if (oldest[0] == '\0') {
+        return;
+    }
+    const char *deletes[] = {
+        "DELETE FROM stats_days WHERE day < ?;",
+        "DELETE FROM stats_hosts WHERE day < ?;",
+        "DELETE FROM stats_connections WHERE day < ?;"
+    };
+    for (size_t i = 0; i < sizeof(deletes) / sizeof(deletes[0]); i++) {
+        if (sqlite3_prepare_v2(db, deletes[i], -1, &stmt, NULL) == SQLITE_OK) {
+            sqlite3_bind_text(stmt, 1, oldest, -1, SQLITE_STATIC);
+            sqlite3_step(stmt);
+            sqlite3_finalize(stmt);
+        }
+    }
+}
+
+static bool BenchRunDay(BenchDatabase *database, const BenchConfig *config, BenchMode mode, BenchResult *result) {
+    sqlite3 *db = database->db;
+    memset(result, 0, sizeof(*result));
+    BenchCounters *hosts = calloc(config->hosts, sizeof(BenchCounters));
+    BenchCounters *connections = calloc(config->connections, sizeof(BenchCounters));
+    BenchStatements statements = {0};
+    bool ok = hosts && connections;
+    if (ok && mode == BenchModeDirty) {
+        ok = sqlite3_prepare_v2(db, "INSERT OR IGNORE INTO stats_hosts (day, host, bytes, packets) VALUES (?, ?, ?, ?);",
+                                -1, &statements.insertHost, NULL) == SQLITE_OK &&
+             sqlite3_prepare_v2(db, "UPDATE stats_hosts SET bytes = bytes + ?3, packets = packets + ?4 "
+                                "WHERE day = ?1 AND host = ?2;", -1, &statements.updateHost, NULL) == SQLITE_OK &&
+             sqlite3_prepare_v2(db, "INSERT INTO stats_connections (day, src_addr, src_port, dst_addr, dst_port, bytes, packets) "
+                                "VALUES (?, ?, ?, ?, 443, ?, ?) "
+                                "ON CONFLICT(day, src_addr, src_port, dst_addr, dst_port) DO UPDATE SET "
+                                "bytes=stats_connections.bytes + excluded.bytes, "
+                                "packets=stats_connections.packets + excluded.packets;",
+                                -1, &statements.upsertConnection, NULL) == SQLITE_OK &&
+             sqlite3_prepare_v2(db, "INSERT INTO stats_days (day, total_bytes, unique_hosts) VALUES (?, ?, ?) "
+                                "ON CONFLICT(day) DO UPDATE SET total_bytes=excluded.total_bytes, "
+                                "unique_hosts=excluded.unique_hosts;", -1, &statements.upsertDay, NULL) == SQLITE_OK;
+    }
+
+    uint64_t random = 0xD1B54A32D192ED03ULL;
+    uint32_t seenHosts = 0;
+    uint32_t seenConnections = 0;
+    uint64_t dayBytes = 0;
+    for (uint32_t flush = 0; ok && flush < BENCH_FLUSHES_PER_DAY; flush++) {
+        // New hosts and connections arrive evenly through the day; a share
+        // of the earlier ones is active again in each interval
+        uint32_t nextHosts = (uint32_t)((uint64_t)config->hosts * (flush + 1) / BENCH_FLUSHES_PER_DAY);
+        uint32_t nextConnections = (uint32_t)((uint64_t)config->connections * (flush + 1) / BENCH_FLUSHES_PER_DAY);
+        for (uint32_t h = 0; h < nextHosts; h++) {
+            if (h >= seenHosts || BenchNextRandom(&random) % 100 < config->activePercent) {
+                BenchTouch(&hosts[h], &random);
+            }
+        }
+        for (uint32_t c = 0; c < nextConnections; c++) {
+            if (c >= seenConnections || BenchNextRandom(&random) % 100 < config->activePercent) {
+                uint64_t before = connections[c].bytes;
+                BenchTouch(&connections[c], &random);
+                dayBytes += connections[c].bytes - before;
+            }
+        }
+        seenHosts = nextHosts;
+        seenConnections = nextConnections;
+
+        uint64_t walBefore = database->walPages;
+        uint64_t start = BenchMonotonicNs();
+        BenchExec(db, "BEGIN IMMEDIATE;");
+        uint64_t rows;
+        if (mode == BenchModeRewrite) {
+            rows = BenchWriteRewrite(db, config, hosts, seenHosts, connections, seenConnections, result);
+        } else {
+            rows = BenchWriteDirty(db, config, &statements, hosts, seenHosts, connections, seenConnections, result);
+        }
+        sqlite3_stmt *day = statements.upsertDay;
+        bool preparedDay = day == NULL;
+        if (preparedDay) {
+            sqlite3_prepare_v2(db, "INSERT INTO stats_days (day, total_bytes, unique_hosts) VALUES (?, ?, ?) "
+                               "ON CONFLICT(day) DO UPDATE SET total_bytes=excluded.total_bytes, "
+                               "unique_hosts=excluded.unique_hosts;", -1, &day, NULL);
+        }
+        sqlite3_bind_text(day, 1, kBenchToday, -1, SQLITE_STATIC);
+        sqlite3_bind_int64(day, 2, (sqlite3_int64)dayBytes);
+        sqlite3_bind_int64(day, 3, (sqlite3_int64)result->uniqueHosts);
+        sqlite3_step(day);
+        sqlite3_reset(day);
+        if (preparedDay) {
+            sqlite3_finalize(day);
+        }
+
+        uint64_t retentionStart = BenchMonotonicNs();
+        if (mode == BenchModeRewrite) {
+            BenchRetentionRewrite(db);
+        } else if (flush == 0) {
+            BenchRetentionDirty(db);
+        }
+        result->retentionNs += BenchMonotonicNs() - retentionStart;
+        BenchExec(db, "COMMIT;");
+        uint64_t elapsed = BenchMonotonicNs() - start;
+
+        result->rows += rows + 1;
+        result->pages += database->walPages - walBefore;
+        result->totalNs += elapsed;
+        result->maxNs = elapsed > result->maxNs ? elapsed : result->maxNs;
+
+        // Outside the timing: empty the WAL so the next flush's pages are its own
+        sqlite3_wal_checkpoint_v2(db, NULL, SQLITE_CHECKPOINT_TRUNCATE, NULL, NULL);
+        database->walPages = 0;
+    }
+
+    sqlite3_stmt *sum = NULL;
+    if (ok && sqlite3_prepare_v2(db, "SELECT (SELECT SUM(bytes) FROM stats_hosts WHERE day = ?1), "
+                                 "(SELECT SUM(bytes) FROM stats_connections WHERE day = ?1);", -1, &sum, NULL) == SQLITE_OK) {
+        sqlite3_bind_text(sum, 1, kBenchToday, -1, SQLITE_STATIC);
+        if (sqlite3_step(sum) == SQLITE_ROW) {
+            result->hostBytes = (uint64_t)sqlite3_column_int64(sum, 0);
+            result->connectionBytes = (uint64_t)sqlite3_column_int64(sum, 1);
+        }
+        sqlite3_finalize(sum);
+    }
+    sqlite3_finalize(statements.insertHost);
+    sqlite3_finalize(statements.updateHost);
+    sqlite3_finalize(statements.upsertConnection);
+    sqlite3_finalize(statements.upsertDay);
+    free(hosts);
+    free(connections);
+    return ok;
+}
+
+// MARK: - Main
+
+static bool BenchRunMode(const BenchConfig *config, BenchMode mode, BenchResult *result) {
+    char path[] = "/tmp/snb-bench-flush-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        return false;
+    }
+    close(fd);
+
+    BenchDatabase database = {0};
+    bool ok = sqlite3_open(path, &database.db) == SQLITE_OK &&
+              BenchCreateSchema(database.db, mode) &&
+              BenchFillHistory(database.db, config) &&
+              BenchExec(database.db, "PRAGMA wal_autocheckpoint=0;");
+    if (ok) {
+        sqlite3_wal_checkpoint_v2(database.db, NULL, SQLITE_CHECKPOINT_TRUNCATE, NULL, NULL);
+        sqlite3_wal_hook(database.db, BenchWalHook, &database);
+        ok = BenchRunDay(&database, config, mode, result);
+    }
+    sqlite3_close(database.db);
+    const char *suffixes[] = {"", "-wal", "-shm"};
+    for (int i = 0; i < 3; i++) {
+        char file[64];
+        snprintf(file, sizeof(file), "%s%s", path, suffixes[i]);
+        unlink(file);
+    }
+    return ok;
+}
+
+static void BenchPrint(const char *name, const BenchResult *result) {
+    printf("  %-8s %9.0f rows/flush %8.0f pages/flush %8.2f ms/flush (max %7.2f, retention %8.1f ms total) %9.2f s/day\n",
+           name,
+           (double)result->rows / BENCH_FLUSHES_PER_DAY,
+           (double)result->pages / BENCH_FLUSHES_PER_DAY,
+           (double)result->totalNs / BENCH_FLUSHES_PER_DAY / 1e6,
+           (double)result->maxNs / 1e6,
+           (double)result->retentionNs / 1e6,
+           (double)result->totalNs / 1e9);
+}
+
+int main(int argc, char **argv) {
+    BenchConfig config = {
+        .hosts = 20000,
+        .connections = 100000,
+        .activePercent = 5,
+        .historyDays = 90,
+        .historyRows = 20000
+    };
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--hosts") == 0 && i + 1 < argc) {
+            config.hosts = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--connections") == 0 && i + 1 < argc) {
+            config.connections = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--active") == 0 && i + 1 < argc) {
+            config.activePercent = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--history-days") == 0 && i + 1 < argc) {
+            config.historyDays = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--history-rows") == 0 && i + 1 < argc) {
+            config.historyRows = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else {
+            fprintf(stderr, "usage: %s [--hosts N] [--connections N] [--active PERCENT] "
+                    "[--history-days N] [--history-rows N]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (config.hosts == 0 || config.connections == 0) {
+        fprintf(stderr, "hosts and connections must be non-zero\n");
+        return 1;
+    }
+
+    printf("%u hosts, %u connections, %u%% active per flush, %u flushes; %u older days of %u connections\n",
+           config.hosts, config.connections, config.activePercent, BENCH_FLUSHES_PER_DAY,
+           config.historyDays, config.historyRows);
+    BenchResult rewrite;
+    BenchResult dirty;
+    if (!BenchRunMode(&config, BenchModeRewrite, &rewrite) || !BenchRunMode(&config, BenchModeDirty, &dirty)) {
+        fprintf(stderr, "benchmark failed\n");
+        return 1;
+    }
+    BenchPrint("rewrite", &rewrite);
+    BenchPrint("dirty", &dirty);
+    printf("  rows %.1fx fewer, pages %.1fx fewer, flush time %.1fx less\n",
+           dirty.rows > 0 ? (double)rewrite.rows / (double)dirty.rows : 0.0,
+           dirty.pages > 0 ? (double)rewrite.pages / (double)dirty.pages : 0.0,
+           dirty.totalNs > 0 ? (double)rewrite.totalNs / (double)dirty.totalNs : 0.0);
+    if (rewrite.hostBytes != dirty.hostBytes || rewrite.connectionBytes != dirty.connectionBytes ||
+        rewrite.uniqueHosts != dirty.uniqueHosts) {
+        fprintf(stderr, "mismatch: the two modes stored different totals\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,892 @@
+//
+//  bench_pcap_replay.c
+//  SniffNetBar
+//
+//  Headless replay benchmark for the packet record pipeline. Reads a pcap or
+//  pcapng file with the built-in reader, decodes it into packet records, tags
+//  direction and runs the per-packet accounting of the three analytics
+//  consumers (traffic statistics, daily history, anomaly windows) on flow
+//  tables, all driven by packet timestamps. The Objective-C consumers need
+//  Foundation, so their hot loops are mirrored here on the same C primitives;
+//  the daily history flushes its deltas into an in-memory SQLite database as
+//  the app does, and its peak memory is reported.
+//  Without a file it replays a deterministic synthetic capture, and it prints
+//  a digest of the final aggregates so two runs can be compared. With
+//  --shards the capture is decoded up front and only the traffic statistics
+//  run, on that many worker threads with a periodic merge, to measure how
+//  the sharded accounting scales. Builds on macOS and Linux:
+//
+//      make bench-pcap-replay && ./build/bench_pcap_replay [options] [capture.pcap]
+//
+//  Options:
+//      --packets N        synthetic packet count (default 1000000)
+//      --flows N          synthetic flow count (default 4096)
+//      --pcapng           write the synthetic capture as pcapng
+//      --write PATH       keep the synthetic capture at PATH
+//      --local ADDRESS    local address for direction tagging (repeatable)
+//      --window SECONDS   anomaly window length (default 60)
+//      --original-timing  pace delivery by the capture timestamps
+//      --shards N         sharded traffic statistics on N worker threads
+//
+
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sqlite3.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "AnomalyAccumulator.h"
+#include "FlowTable.h"
+#include "PacketClock.h"
+#include "PacketDecoder.h"
+#include "PacketDirection.h"
+#include "PcapFileReader.h"
+#include "TimeSeries.h"
+#include "TrafficShards.h"
+
+#define BENCH_BATCH_SIZE 512
+// Ten times the app's merge rate, so the merge cost shows up in the numbers
+#define BENCH_MERGE_INTERVAL_NS 100000000ULL
+
+static uint64_t BenchMonotonicNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void BenchSleepNs(uint64_t ns) {
+    struct timespec ts = { (time_t)(ns / 1000000000ULL), (long)(ns % 1000000000ULL) };
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
+
+// MARK: - Synthetic capture
+
+static uint64_t BenchNextRandom(uint64_t *state) {
+    // xorshift64*: fixed seed, so every run writes the same bytes
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545f4914f6cdd1dULL;
+}
+
+static void BenchPutBE16(uint8_t *bytes, uint16_t value) {
+    bytes[0] = (uint8_t)(value >> 8);
+    bytes[1] = (uint8_t)value;
+}
+
+// Ethernet frames between 192.168.1.10 / fd00::10 and public hosts, a quarter
+// of them IPv6, alternating TCP and UDP, both directions, spread over a few
+// minutes of capture time so windows and second buckets roll over
+static size_t BenchBuildFrame(uint8_t *frame, uint32_t flow, uint64_t *random) {
+    bool ipv6 = (flow % 4) == 3;
+    bool tcp = (flow % 2) == 0;
+    bool outgoing = (BenchNextRandom(random) % 3) != 0;
+    uint16_t localPort = (uint16_t)(49152 + flow % 16384);
+    uint16_t remotePort = tcp ? 443 : 53;
+    size_t ipHeader = ipv6 ? 40 : 20;
+    size_t l4Header = tcp ? 20 : 8;
+    size_t length = 14 + ipHeader + l4Header;
+
+    memset(frame, 0, length);
+    BenchPutBE16(frame + 12, ipv6 ? 0x86dd : 0x0800);
+    uint8_t *ip = frame + 14;
+    uint8_t local[16] = {0};
+    uint8_t remote[16] = {0};
+    if (ipv6) {
+        local[0] = 0xfd; local[15] = 0x10;
+        remote[0] = 0x26; remote[1] = 0x06; remote[2] = 0x28; remote[3] = 0x00;
+        remote[14] = (uint8_t)(flow >> 8); remote[15] = (uint8_t)flow;
+        ip[0] = 0x60;
+        BenchPutBE16(ip + 4, (uint16_t)l4Header);
+        ip[6] = tcp ? 6 : 17;
+        ip[7] = 64;
+        memcpy(ip + 8, outgoing ? local : remote, 16);
+        memcpy(ip + 24, outgoing ? remote : local, 16);
+    } else {
+        local[0] = 192; local[1] = 168; local[2] = 1; local[3] = 10;
+        remote[0] = 93; remote[1] = 184; remote[2] = (uint8_t)(flow >> 8); remote[3] = (uint8_t)flow;
+        ip[0] = 0x45;
+        BenchPutBE16(ip + 2, (uint16_t)(ipHeader + l4Header));
+        ip[8] = 64;
+        ip[9] = tcp ? 6 : 17;
+        memcpy(ip + 12, outgoing ? local : remote, 4);
+        memcpy(ip + 16, outgoing ? remote : local, 4);
+    }
+    uint8_t *l4 = ip + ipHeader;
+    BenchPutBE16(l4, outgoing ? localPort : remotePort);
+    BenchPutBE16(l4 + 2, outgoing ? remotePort : localPort);
+    if (tcp) {
+        l4[12] = 0x50;
+    }
+    return length;
+}
+
+static bool BenchWriteSynthetic(const char *path, uint64_t packets, uint32_t flows, bool pcapng) {
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        perror(path);
+        return false;
+    }
+
+    if (pcapng) {
+        uint32_t section[7] = { 0x0a0d0d0a, 28, 0x1a2b3c4d, 0x00000001, 0xffffffff, 0xffffffff, 28 };
+        // Interface with nanosecond timestamps (if_tsresol = 9)
+        uint32_t interface[7] = { 0x00000001, 28, SNB_PCAP_LINKTYPE_ETHERNET, 65535, 0x00010009, 0x00000009, 28 };
+        fwrite(section, sizeof(section), 1, file);
+        fwrite(interface, sizeof(interface), 1, file);
+    } else {
+        uint32_t header[6] = { 0xa1b23c4d, 0x00040002, 0, 0, 65535, SNB_PCAP_LINKTYPE_ETHERNET };
+        fwrite(header, sizeof(header), 1, file);
+    }
+
+    uint64_t random = 0x9e3779b97f4a7c15ULL;
+    uint64_t timestampNs = 1700000000ULL * 1000000000ULL;
+    uint8_t frame[128];
+    static const uint8_t padding[4] = {0};
+    for (uint64_t i = 0; i < packets; i++) {
+        // Bursty flows: most packets stay on a small hot set
+        uint64_t draw = BenchNextRandom(&random);
+        uint32_t flow = (draw % 8 == 0) ? (uint32_t)((draw >> 8) % flows) : (uint32_t)((draw >> 8) % (flows / 16 + 1));
+        size_t captured = BenchBuildFrame(frame, flow, &random);
+        uint32_t wire = (uint32_t)(captured + (BenchNextRandom(&random) % 1400));
+        timestampNs += 20000 + BenchNextRandom(&random) % 400000;
+
+        if (pcapng) {
+            uint32_t paddedLength = (uint32_t)((captured + 3) & ~(size_t)3);
+            uint32_t total = 32 + paddedLength;
+            uint32_t block[7] = { 0x00000006, total, 0, (uint32_t)(timestampNs >> 32), (uint32_t)timestampNs,
+                                  (uint32_t)captured, wire };
+            fwrite(block, sizeof(block), 1, file);
+            fwrite(frame, captured, 1, file);
+            fwrite(padding, paddedLength - captured, 1, file);
+            fwrite(&total, sizeof(total), 1, file);
+        } else {
+            uint32_t record[4] = { (uint32_t)(timestampNs / 1000000000ULL), (uint32_t)(timestampNs % 1000000000ULL),
+                                   (uint32_t)captured, wire };
+            fwrite(record, sizeof(record), 1, file);
+            fwrite(frame, captured, 1, file);
+        }
+    }
+    return fclose(file) == 0;
+}
+
+// MARK: - Consumers
+
+typedef struct {
+    uint64_t bytes;
+    uint64_t packets;
+    uint64_t lastActivityNs;
+} BenchTrafficCounters;
+
+typedef struct {
+    uint64_t bytes;
+    uint64_t packets;
+    int64_t lastSecond;
+} BenchHistoryConnection;
+
+// StatisticsHistory's flush cadence and pending row limit
+#define BENCH_HISTORY_FLUSH_SECONDS 300
+#define BENCH_HISTORY_ROW_LIMIT 131072
+
+typedef struct {
+    // Traffic statistics, on the app's accounting code with a single shard
+    SNBTrafficDelta traffic;
+
+    // Daily history: rows pending since the last flush into an in-memory
+    // database with the app's schema, and the traffic rings
+    SNBFlowTable *historyHosts;
+    SNBFlowTable *historyConnections;
+    SNBTimeSeries series;
+    sqlite3 *historyDb;
+    sqlite3_stmt *upsertHost;
+    sqlite3_stmt *upsertConnection;
+    uint64_t currentSecond;
+    uint64_t nextFlushSecond;
+    uint64_t maxRate;
+    uint64_t maxConnections;
+    uint64_t historyFlushes;
+    size_t historyPeakBytes;
+
+    // Anomaly windows
+    SNBFlowTable *accumulators;
+    SNBAnomalyArena arena;
+    uint64_t windowNs;
+    uint64_t windowEndNs;
+    uint64_t windows;
+    uint64_t windowDestinations;
+
+    SNBPacketClock clock;
+} BenchPipeline;
+
+// PacketProtocol of an IANA protocol number, as SNBPacketProtocolFromIPProtocol
+static int BenchProtocolClass(uint8_t ipProtocol) {
+    switch (ipProtocol) {
+        case IPPROTO_TCP:
+            return SNBAnomalyProtocolTCP;
+        case IPPROTO_UDP:
+            return SNBAnomalyProtocolUDP;
+        case IPPROTO_ICMP:
+        case IPPROTO_ICMPV6:
+            return SNBAnomalyProtocolICMP;
+        default:
+            return SNB_ANOMALY_PROTOCOL_COUNT - 1;
+    }
+}
+
+static bool BenchHistoryOpen(BenchPipeline *pipeline) {
+    if (sqlite3_open(":memory:", &pipeline->historyDb) != SQLITE_OK) {
+        return false;
+    }
+    const char *schema =
+        "CREATE TABLE stats_hosts (day TEXT NOT NULL, host TEXT NOT NULL, bytes INTEGER NOT NULL, "
+        "packets INTEGER NOT NULL, PRIMARY KEY (day, host));"
+        "CREATE TABLE stats_connections (day TEXT NOT NULL, src_addr TEXT NOT NULL, src_port INTEGER NOT NULL, "
+        "dst_addr TEXT NOT NULL, dst_port INTEGER NOT NULL, bytes INTEGER NOT NULL, packets INTEGER NOT NULL, "
+        "PRIMARY KEY (day, src_addr, src_port, dst_addr, dst_port));";
+    const char *upsertHost =
+        "INSERT INTO stats_hosts (day, host, bytes, packets) VALUES ('replay', ?, ?, ?) "
+        "ON CONFLICT(day, host) DO UPDATE SET "
+        "bytes=stats_hosts.bytes + excluded.bytes, packets=stats_hosts.packets + excluded.packets;";
+    const char *upsertConnection =
+        "INSERT INTO stats_connections (day, src_addr, src_port, dst_addr, dst_port, bytes, packets) "
+        "VALUES ('replay', ?, ?, ?, ?, ?, ?) "
+        "ON CONFLICT(day, src_addr, src_port, dst_addr, dst_port) DO UPDATE SET "
+        "bytes=stats_connections.bytes + excluded.bytes, packets=stats_connections.packets + excluded.packets;";
+    return sqlite3_exec(pipeline->historyDb, schema, NULL, NULL, NULL) == SQLITE_OK &&
+           sqlite3_prepare_v2(pipeline->historyDb, upsertHost, -1, &pipeline->upsertHost, NULL) == SQLITE_OK &&
+           sqlite3_prepare_v2(pipeline->historyDb, upsertConnection, -1, &pipeline->upsertConnection, NULL) == SQLITE_OK;
+}
+
+static const char *BenchFormatAddress(uint8_t family, const uint8_t *address, char *buffer) {
+    return inet_ntop(family == SNBAddressFamilyIPv6 ? AF_INET6 : AF_INET, address, buffer, INET6_ADDRSTRLEN) ?: "";
+}
+
+// -[SNBStatisticsHistory persistToDatabase]: add the pending deltas to the
+// day's rows, then keep only connections active in the open hour
+static void BenchHistoryFlush(BenchPipeline *pipeline) {
+    size_t memory = SNBFlowTableMemoryBytes(pipeline->historyHosts) +
+                    SNBFlowTableMemoryBytes(pipeline->historyConnections) +
+                    SNBTimeSeriesMemoryBytes(&pipeline->series);
+    if (memory > pipeline->historyPeakBytes) {
+        pipeline->historyPeakBytes = memory;
+    }
+    pipeline->historyFlushes++;
+
+    char source[INET6_ADDRSTRLEN];
+    char destination[INET6_ADDRSTRLEN];
+    sqlite3_exec(pipeline->historyDb, "BEGIN;", NULL, NULL, NULL);
+    size_t cursor = 0;
+    const SNBFlowKey *key = NULL;
+    const BenchTrafficCounters *host;
+    while ((host = SNBFlowTableNext(pipeline->historyHosts, &cursor, &key)) != NULL) {
+        sqlite3_stmt *stmt = pipeline->upsertHost;
+        sqlite3_bind_text(stmt, 1, BenchFormatAddress(key->family, key->destinationAddress, destination), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int64(stmt, 2, (sqlite3_int64)host->bytes);
+        sqlite3_bind_int64(stmt, 3, (sqlite3_int64)host->packets);
+        sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+    }
+    SNBFlowTableClear(pipeline->historyHosts);
+
+    int64_t hourStart = SNBTimeSeriesBucketStart(&pipeline->series, SNBTimeSeriesHour, (int64_t)pipeline->currentSecond);
+    BenchHistoryConnection *connection;
+    cursor = 0;
+    while ((connection = SNBFlowTableNext(pipeline->historyConnections, &cursor, &key)) != NULL) {
+        if (connection->packets > 0) {
+            sqlite3_stmt *stmt = pipeline->upsertConnection;
+            sqlite3_bind_text(stmt, 1, BenchFormatAddress(key->family, key->sourceAddress, source), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_int(stmt, 2, key->hasPorts ? (int)key->sourcePort : -1);
+            sqlite3_bind_text(stmt, 3, BenchFormatAddress(key->family, key->destinationAddress, destination), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_int(stmt, 4, key->hasPorts ? (int)key->destinationPort : -1);
+            sqlite3_bind_int64(stmt, 5, (sqlite3_int64)connection->bytes);
+            sqlite3_bind_int64(stmt, 6, (sqlite3_int64)connection->packets);
+            sqlite3_step(stmt);
+            sqlite3_reset(stmt);
+            connection->bytes = 0;
+            connection->packets = 0;
+        }
+        if (connection->lastSecond < hourStart) {
+            SNBFlowTableRemoveCurrent(pipeline->historyConnections, &cursor);
+        }
+    }
+    if (SNBFlowTableCount(pipeline->historyConnections) >= BENCH_HISTORY_ROW_LIMIT / 2) {
+        SNBFlowTableClear(pipeline->historyConnections);
+    }
+    sqlite3_exec(pipeline->historyDb, "COMMIT;", NULL, NULL, NULL);
+}
+
+static uint64_t BenchHistoryCount(BenchPipeline *pipeline, const char *sql) {
+    sqlite3_stmt *stmt = NULL;
+    uint64_t count = 0;
+    if (sqlite3_prepare_v2(pipeline->historyDb, sql, -1, &stmt, NULL) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW) {
+        count = (uint64_t)sqlite3_column_int64(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    return count;
+}
+
+static void BenchCloseSecond(BenchPipeline *pipeline, uint64_t second) {
+    const SNBTimeSeriesBucket *bucket = SNBTimeSeriesFind(&pipeline->series, SNBTimeSeriesSecond,
+                                                          (int64_t)pipeline->currentSecond);
+    if (bucket) {
+        uint64_t rate = bucket->bytes[SNBTrafficIncoming] + bucket->bytes[SNBTrafficOutgoing];
+        uint64_t connections = (uint64_t)bucket->connections[SNBTrafficIncoming] + bucket->connections[SNBTrafficOutgoing];
+        if (rate > pipeline->maxRate) {
+            pipeline->maxRate = rate;
+        }
+        if (connections > pipeline->maxConnections) {
+            pipeline->maxConnections = connections;
+        }
+    }
+    pipeline->currentSecond = second;
+
+    if (pipeline->nextFlushSecond == 0) {
+        pipeline->nextFlushSecond = second + BENCH_HISTORY_FLUSH_SECONDS;
+    } else if (second >= pipeline->nextFlushSecond ||
+               SNBFlowTableCount(pipeline->historyHosts) >= BENCH_HISTORY_ROW_LIMIT ||
+               SNBFlowTableCount(pipeline->historyConnections) >= BENCH_HISTORY_ROW_LIMIT) {
+        BenchHistoryFlush(pipeline);
+        pipeline->nextFlushSecond = second + BENCH_HISTORY_FLUSH_SECONDS;
+    }
+}
+
+static void BenchCloseWindow(BenchPipeline *pipeline, uint64_t timestampNs) {
+    pipeline->windows++;
+    pipeline->windowDestinations += SNBFlowTableCount(pipeline->accumulators);
+    SNBFlowTableClear(pipeline->accumulators);
+    SNBAnomalyArenaReset(&pipeline->arena);
+    pipeline->windowEndNs = (timestampNs / pipeline->windowNs + 1) * pipeline->windowNs;
+}
+
+static void BenchProcessRecords(BenchPipeline *pipeline, const SNBPacketRecord *records, size_t count) {
+    SNBTrafficDeltaAccount(&pipeline->traffic, records, count, NULL, 0, SNBWallClockNs());
+
+    for (size_t i = 0; i < count; i++) {
+        const SNBPacketRecord *record = &records[i];
+        if (record->length == 0) {
+            continue;
+        }
+
+        uint64_t second = record->timestampNs / 1000000000ULL;
+        if (second > pipeline->currentSecond) {
+            BenchCloseSecond(pipeline, second);
+        }
+        SNBTrafficDirection direction = (record->flags & SNBPacketRecordFlagOutgoing) ? SNBTrafficOutgoing : SNBTrafficIncoming;
+        SNBTimeSeriesAddTraffic(&pipeline->series, (int64_t)pipeline->currentSecond, direction, record->length, 1);
+
+        if (pipeline->windowEndNs == 0) {
+            pipeline->windowEndNs = (record->timestampNs / pipeline->windowNs + 1) * pipeline->windowNs;
+        } else if (record->timestampNs >= pipeline->windowEndNs) {
+            BenchCloseWindow(pipeline, record->timestampNs);
+        }
+
+        if (record->family == SNBAddressFamilyNone) {
+            continue;
+        }
+
+        // Daily history: raw connections with per-second activity, remote hosts
+        SNBFlowKey key;
+        SNBFlowKeyMakeRecord(&key, record);
+        key.ipProtocol = 0;
+        BenchHistoryConnection *historyConnection = SNBFlowTableUpsert(pipeline->historyConnections, &key, NULL);
+        if (historyConnection) {
+            historyConnection->bytes += record->length;
+            historyConnection->packets++;
+            if (historyConnection->lastSecond != (int64_t)pipeline->currentSecond) {
+                SNBTimeSeriesAddConnection(&pipeline->series, (int64_t)pipeline->currentSecond, direction,
+                                           historyConnection->lastSecond);
+                historyConnection->lastSecond = (int64_t)pipeline->currentSecond;
+            }
+        }
+        if (!(record->flags & SNBPacketRecordFlagBothLocal)) {
+            SNBFlowKeyMakeAddress(&key, record->family, SNBPacketRecordRemoteAddress(record));
+            BenchTrafficCounters *historyHost = SNBFlowTableUpsert(pipeline->historyHosts, &key, NULL);
+            if (historyHost) {
+                historyHost->bytes += record->length;
+                historyHost->packets++;
+            }
+        }
+
+        // Anomaly windows: per public destination
+        if (SNBAddressIsPrivate(record->family, record->destinationAddress)) {
+            continue;
+        }
+        SNBFlowKeyMakeAddress(&key, record->family, record->destinationAddress);
+        SNBAnomalyAccumulator *acc = SNBFlowTableUpsert(pipeline->accumulators, &key, NULL);
+        if (acc) {
+            SNBAnomalyAccumulatorAddPacket(acc, &pipeline->arena, record, BenchProtocolClass(record->ipProtocol));
+        }
+    }
+}
+
+static uint64_t BenchHash(const uint64_t *values, size_t count) {
+    uint64_t hash = 1469598103934665603ULL;
+    const uint8_t *bytes = (const uint8_t *)values;
+    for (size_t i = 0; i < count * sizeof(uint64_t); i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+static uint64_t BenchDigest(const BenchPipeline *pipeline, uint64_t historyHosts, uint64_t historyConnections) {
+    const SNBTrafficDelta *traffic = &pipeline->traffic;
+    uint64_t values[] = {
+        traffic->totalBytes, traffic->incomingBytes, traffic->totalPackets,
+        SNBFlowTableCount(traffic->hosts), SNBFlowTableCount(traffic->connections),
+        historyHosts, historyConnections,
+        pipeline->maxRate, pipeline->maxConnections, pipeline->windows, pipeline->windowDestinations,
+        pipeline->clock.packetNs
+    };
+    return BenchHash(values, sizeof(values) / sizeof(values[0]));
+}
+
+// Order-independent digest of every host and connection counter, identical
+// for any shard count
+static uint64_t BenchTrafficDigest(const SNBFlowTable *hosts, const SNBFlowTable *connections,
+                                   uint64_t totalBytes, uint64_t totalPackets) {
+    uint64_t values[4] = { totalBytes, totalPackets, 0, 0 };
+    const SNBFlowTable *tables[2] = { hosts, connections };
+    for (int t = 0; t < 2; t++) {
+        size_t cursor = 0;
+        const SNBFlowKey *key = NULL;
+        const SNBTrafficCounters *counters;
+        while ((counters = SNBFlowTableNext(tables[t], &cursor, &key)) != NULL) {
+            uint64_t entry[3] = { SNBFlowKeyHash(key), counters->bytes, counters->packets };
+            values[2 + t] += BenchHash(entry, 3);
+        }
+    }
+    return BenchHash(values, 4);
+}
+
+// MARK: - Sharded traffic statistics
+
+struct BenchShards;
+
+typedef struct {
+    SNBTrafficDelta delta;
+    // Held while counting a batch and while the merge swaps the delta out,
+    // like the shard's serial queue in the app
+    pthread_mutex_t lock;
+    pthread_t thread;
+    unsigned index;
+    struct BenchShards *shards;
+} BenchShard;
+
+typedef struct BenchShards {
+    const SNBPacketRecord *records;
+    uint8_t *shardIndices;
+    size_t count;
+    atomic_size_t published;     // Records partitioned and visible to the workers
+    atomic_bool stopMerging;
+    unsigned shardCount;
+    BenchShard shard[SNB_TRAFFIC_MAX_SHARDS];
+
+    // Merged state, owned by whichever thread merges
+    SNBTrafficDelta spare;
+    SNBFlowTable *hosts;
+    SNBFlowTable *connections;
+    uint64_t totalBytes;
+    uint64_t incomingBytes;
+    uint64_t totalPackets;
+    uint64_t merges;
+} BenchShards;
+
+static void *BenchShardWorker(void *argument) {
+    BenchShard *shard = argument;
+    BenchShards *shards = shard->shards;
+    size_t cursor = 0;
+    while (cursor < shards->count) {
+        size_t published = atomic_load_explicit(&shards->published, memory_order_acquire);
+        if (published == cursor) {
+            sched_yield();
+            continue;
+        }
+        size_t end = cursor + BENCH_BATCH_SIZE < published ? cursor + BENCH_BATCH_SIZE : published;
+        pthread_mutex_lock(&shard->lock);
+        SNBTrafficDeltaAccount(&shard->delta, shards->records + cursor, end - cursor,
+                               shards->shardIndices + cursor, shard->index, SNBWallClockNs());
+        pthread_mutex_unlock(&shard->lock);
+        cursor = end;
+    }
+    return NULL;
+}
+
+static void BenchMergeShards(BenchShards *shards) {
+    for (unsigned i = 0; i < shards->shardCount; i++) {
+        BenchShard *shard = &shards->shard[i];
+        pthread_mutex_lock(&shard->lock);
+        SNBTrafficDeltaSwap(&shard->delta, &shards->spare);
+        pthread_mutex_unlock(&shard->lock);
+
+        SNBTrafficDeltaMerge(&shards->spare, shards->hosts, shards->connections, NULL, NULL);
+        shards->totalBytes += shards->spare.totalBytes;
+        shards->incomingBytes += shards->spare.incomingBytes;
+        shards->totalPackets += shards->spare.totalPackets;
+        SNBTrafficDeltaReset(&shards->spare);
+    }
+    shards->merges++;
+}
+
+static void *BenchShardMerger(void *argument) {
+    BenchShards *shards = argument;
+    while (!atomic_load(&shards->stopMerging)) {
+        BenchSleepNs(BENCH_MERGE_INTERVAL_NS);
+        BenchMergeShards(shards);
+    }
+    return NULL;
+}
+
+// The calling thread partitions batch by batch, as the capture delivery does
+// in the app, while the workers count and a merger folds their deltas.
+// Returns the elapsed time, or 0 if the threads could not be set up.
+static uint64_t BenchRunShards(BenchShards *shards) {
+    for (unsigned i = 0; i < shards->shardCount; i++) {
+        BenchShard *shard = &shards->shard[i];
+        shard->index = i;
+        shard->shards = shards;
+        if (!SNBTrafficDeltaInit(&shard->delta, 1024, 1024) || pthread_mutex_init(&shard->lock, NULL) != 0) {
+            return 0;
+        }
+    }
+
+    uint64_t start = BenchMonotonicNs();
+    pthread_t merger;
+    if (pthread_create(&merger, NULL, BenchShardMerger, shards) != 0) {
+        return 0;
+    }
+    for (unsigned i = 0; i < shards->shardCount; i++) {
+        if (pthread_create(&shards->shard[i].thread, NULL, BenchShardWorker, &shards->shard[i]) != 0) {
+            return 0;
+        }
+    }
+    for (size_t offset = 0; offset < shards->count; offset += BENCH_BATCH_SIZE) {
+        size_t count = shards->count - offset < BENCH_BATCH_SIZE ? shards->count - offset : BENCH_BATCH_SIZE;
+        SNBTrafficPartitionRecords(shards->records + offset, count, shards->shardCount, shards->shardIndices + offset);
+        atomic_store_explicit(&shards->published, offset + count, memory_order_release);
+    }
+    for (unsigned i = 0; i < shards->shardCount; i++) {
+        pthread_join(shards->shard[i].thread, NULL);
+    }
+    atomic_store(&shards->stopMerging, true);
+    pthread_join(merger, NULL);
+    BenchMergeShards(shards);
+    uint64_t elapsed = BenchMonotonicNs() - start;
+
+    for (unsigned i = 0; i < shards->shardCount; i++) {
+        SNBTrafficDeltaDestroy(&shards->shard[i].delta);
+        pthread_mutex_destroy(&shards->shard[i].lock);
+    }
+    return elapsed;
+}
+
+// Decoded records kept in memory for the sharded run
+typedef struct {
+    SNBPacketRecord *records;
+    size_t count;
+    size_t capacity;
+} BenchRecords;
+
+// Tags direction and hands a decoded batch to the consumers, or keeps it for
+// the sharded run when preload is set
+static bool BenchConsumeBatch(BenchPipeline *pipeline,
+                              BenchRecords *preload,
+                              const SNBLocalAddressSet *localAddresses,
+                              SNBPacketRecord *batch,
+                              size_t count) {
+    SNBPacketRecordsClassifyDirection(localAddresses, batch, count);
+    if (preload) {
+        if (preload->count + count > preload->capacity) {
+            size_t capacity = preload->capacity ? preload->capacity * 2 : 65536;
+            SNBPacketRecord *records = realloc(preload->records, capacity * sizeof(SNBPacketRecord));
+            if (!records) {
+                return false;
+            }
+            preload->records = records;
+            preload->capacity = capacity;
+        }
+        memcpy(preload->records + preload->count, batch, count * sizeof(SNBPacketRecord));
+        preload->count += count;
+    } else {
+        BenchProcessRecords(pipeline, batch, count);
+    }
+    SNBPacketClockAdvance(&pipeline->clock, batch, count, SNBWallClockNs());
+    return true;
+}
+
+// MARK: - Main
+
+static bool BenchAddLocalAddress(SNBLocalAddressSet *set, const char *string) {
+    uint8_t address[16] = {0};
+    if (inet_pton(AF_INET, string, address) == 1) {
+        return SNBLocalAddressSetAdd(set, SNBAddressFamilyIPv4, address);
+    }
+    if (inet_pton(AF_INET6, string, address) == 1) {
+        return SNBLocalAddressSetAdd(set, SNBAddressFamilyIPv6, address);
+    }
+    return false;
+}
+
+int main(int argc, char **argv) {
+    uint64_t syntheticPackets = 1000000;
+    uint32_t syntheticFlows = 4096;
+    bool pcapng = false;
+    bool originalTiming = false;
+    const char *writePath = NULL;
+    const char *inputPath = NULL;
+    uint64_t windowSeconds = 60;
+    unsigned shardCount = 0;
+    SNBLocalAddressSet localAddresses;
+    memset(&localAddresses, 0, sizeof(localAddresses));
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if (strcmp(arg, "--packets") == 0 && i + 1 < argc) {
+            syntheticPackets = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(arg, "--flows") == 0 && i + 1 < argc) {
+            syntheticFlows = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(arg, "--pcapng") == 0) {
+            pcapng = true;
+        } else if (strcmp(arg, "--write") == 0 && i + 1 < argc) {
+            writePath = argv[++i];
+        } else if (strcmp(arg, "--local") == 0 && i + 1 < argc) {
+            if (!BenchAddLocalAddress(&localAddresses, argv[++i])) {
+                fprintf(stderr, "bad local address: %s\n", argv[i]);
+                return 2;
+            }
+        } else if (strcmp(arg, "--window") == 0 && i + 1 < argc) {
+            windowSeconds = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(arg, "--original-timing") == 0) {
+            originalTiming = true;
+        } else if (strcmp(arg, "--shards") == 0 && i + 1 < argc) {
+            shardCount = (unsigned)strtoul(argv[++i], NULL, 10);
+        } else if (arg[0] != '-' && !inputPath) {
+            inputPath = arg;
+        } else {
+            fprintf(stderr, "usage: %s [--packets N] [--flows N] [--pcapng] [--write PATH] "
+                            "[--local ADDRESS]... [--window SECONDS] [--original-timing] [--shards N] [capture]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+    if (syntheticFlows < 16 || windowSeconds == 0) {
+        fprintf(stderr, "flows must be at least 16 and the window non-zero\n");
+        return 2;
+    }
+    if (shardCount > SNB_TRAFFIC_MAX_SHARDS || (shardCount > 0 && originalTiming)) {
+        fprintf(stderr, "shards must be at most %d and cannot be combined with original timing\n",
+                SNB_TRAFFIC_MAX_SHARDS);
+        return 2;
+    }
+
+    char syntheticPath[] = "/tmp/snb-replay-XXXXXX";
+    bool removeInput = false;
+    if (!inputPath) {
+        if (writePath) {
+            inputPath = writePath;
+        } else {
+            int fd = mkstemp(syntheticPath);
+            if (fd < 0) {
+                perror("mkstemp");
+                return 1;
+            }
+            close(fd);
+            inputPath = syntheticPath;
+            removeInput = true;
+        }
+        if (!BenchWriteSynthetic(inputPath, syntheticPackets, syntheticFlows, pcapng)) {
+            return 1;
+        }
+        BenchAddLocalAddress(&localAddresses, "192.168.1.10");
+        BenchAddLocalAddress(&localAddresses, "fd00::10");
+    } else if (localAddresses.count == 0) {
+        SNBLocalAddressSetLoad(&localAddresses);
+    }
+
+    char error[256];
+    SNBPcapFileReader *reader = SNBPcapFileReaderOpen(inputPath, error, sizeof(error));
+    if (!reader) {
+        fprintf(stderr, "%s\n", error);
+        return 1;
+    }
+
+    BenchPipeline pipeline;
+    memset(&pipeline, 0, sizeof(pipeline));
+    bool tables = SNBTrafficDeltaInit(&pipeline.traffic, 1024, 1024);
+    pipeline.historyHosts = SNBFlowTableCreate(sizeof(BenchTrafficCounters), 1024);
+    pipeline.historyConnections = SNBFlowTableCreate(sizeof(BenchHistoryConnection), 1024);
+    bool history = SNBTimeSeriesInit(&pipeline.series) && BenchHistoryOpen(&pipeline);
+    pipeline.accumulators = SNBFlowTableCreate(sizeof(SNBAnomalyAccumulator), 256);
+    SNBAnomalyArenaInit(&pipeline.arena, 64 * 1024);
+    pipeline.windowNs = windowSeconds * 1000000000ULL;
+    if (!tables || !history || !pipeline.historyHosts || !pipeline.historyConnections ||
+        !pipeline.accumulators) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    SNBPacketRecord batch[BENCH_BATCH_SIZE];
+    size_t batchCount = 0;
+    uint64_t packetsRead = 0;
+    uint64_t undecoded = 0;
+    uint64_t batches = 0;
+    uint64_t consumeNs = 0;
+    uint64_t firstPacketNs = 0;
+    uint64_t replayStartNs = 0;
+    BenchRecords preloaded = { NULL, 0, 0 };
+    BenchRecords *preload = shardCount > 0 ? &preloaded : NULL;
+    SNBPcapPacket packet;
+    SNBPcapReadResult result;
+    uint32_t decoderLinkType = SNB_LINKTYPE_ETHERNET;
+    SNBPacketDecodeFunction decode = SNBPacketDecodeEthernet;
+
+    uint64_t start = BenchMonotonicNs();
+    while ((result = SNBPcapFileReaderNext(reader, &packet)) == SNBPcapReadPacket) {
+        if (++packetsRead == 1) {
+            firstPacketNs = packet.timestampNs;
+            replayStartNs = BenchMonotonicNs();
+        }
+        if (originalTiming) {
+            uint64_t dueNs = replayStartNs + (packet.timestampNs > firstPacketNs ? packet.timestampNs - firstPacketNs : 0);
+            uint64_t nowNs = BenchMonotonicNs();
+            if (dueNs > nowNs + 1000000 && batchCount > 0) {
+                // Hand over what is due before waiting for the next packet
+                BenchConsumeBatch(&pipeline, NULL, &localAddresses, batch, batchCount);
+                batches++;
+                batchCount = 0;
+                nowNs = BenchMonotonicNs();
+            }
+            if (dueNs > nowNs) {
+                BenchSleepNs(dueNs - nowNs);
+            }
+        }
+
+        if (packet.linkType != decoderLinkType) {
+            decoderLinkType = packet.linkType;
+            decode = SNBPacketDecoderForLinkType(decoderLinkType);
+        }
+        if (!decode || !decode(packet.data, packet.capturedLength, packet.wireLength, packet.timestampNs,
+                               &batch[batchCount])) {
+            undecoded++;
+            continue;
+        }
+        if (++batchCount == BENCH_BATCH_SIZE) {
+            uint64_t consumeStart = BenchMonotonicNs();
+            if (!BenchConsumeBatch(&pipeline, preload, &localAddresses, batch, batchCount)) {
+                break;
+            }
+            consumeNs += BenchMonotonicNs() - consumeStart;
+            batches++;
+            batchCount = 0;
+        }
+    }
+    if (batchCount > 0 && BenchConsumeBatch(&pipeline, preload, &localAddresses, batch, batchCount)) {
+        batches++;
+    }
+    uint64_t elapsed = BenchMonotonicNs() - start;
+
+    int status = 0;
+    if (result == SNBPcapReadError) {
+        fprintf(stderr, "replay stopped: %s\n", SNBPcapFileReaderError(reader));
+        status = 1;
+    } else if (result == SNBPcapReadPacket) {
+        fprintf(stderr, "out of memory after %llu packets\n", (unsigned long long)packetsRead);
+        status = 1;
+    }
+
+    // Sharded run over the decoded records; the decode above is not timed
+    BenchShards shards;
+    memset(&shards, 0, sizeof(shards));
+    if (preload && status == 0) {
+        shards.records = preloaded.records;
+        shards.count = preloaded.count;
+        shards.shardCount = shardCount;
+        shards.shardIndices = malloc(preloaded.count ? preloaded.count : 1);
+        shards.hosts = SNBFlowTableCreate(sizeof(SNBTrafficCounters), 1024);
+        shards.connections = SNBFlowTableCreate(sizeof(SNBTrafficCounters), 1024);
+        if (!shards.shardIndices || !shards.hosts || !shards.connections ||
+            !SNBTrafficDeltaInit(&shards.spare, 1024, 1024) || (elapsed = BenchRunShards(&shards)) == 0) {
+            fprintf(stderr, "could not set up %u shards\n", shardCount);
+            status = 1;
+        }
+    }
+
+    double seconds = (double)elapsed / 1e9;
+    double captureSeconds = pipeline.clock.packetNs > firstPacketNs && firstPacketNs > 0
+        ? (double)(pipeline.clock.packetNs - firstPacketNs) / 1e9 : 0.0;
+    const SNBTrafficDelta *traffic = &pipeline.traffic;
+    const SNBFlowTable *hosts = preload ? shards.hosts : traffic->hosts;
+    const SNBFlowTable *connections = preload ? shards.connections : traffic->connections;
+    uint64_t totalBytes = preload ? shards.totalBytes : traffic->totalBytes;
+    uint64_t totalPackets = preload ? shards.totalPackets : traffic->totalPackets;
+    printf("input:        %s (%s)\n", inputPath, SNBPcapFileReaderIsPcapng(reader) ? "pcapng" : "pcap");
+    if (preload) {
+        printf("mode:         traffic statistics on %u shards, %llu merges\n",
+               shardCount, (unsigned long long)shards.merges);
+    } else {
+        printf("mode:         %s\n", originalTiming ? "original timing" : "as fast as possible");
+    }
+    printf("packets:      %llu read, %llu undecoded, %llu batches\n",
+           (unsigned long long)packetsRead, (unsigned long long)undecoded, (unsigned long long)batches);
+    if (hosts && connections) {
+        printf("traffic:      %llu bytes, %llu incoming, %zu hosts, %zu connections, digest %016llx\n",
+               (unsigned long long)totalBytes,
+               (unsigned long long)(preload ? shards.incomingBytes : traffic->incomingBytes),
+               SNBFlowTableCount(hosts), SNBFlowTableCount(connections),
+               (unsigned long long)BenchTrafficDigest(hosts, connections, totalBytes, totalPackets));
+    }
+    if (!preload) {
+        BenchHistoryFlush(&pipeline);
+        uint64_t historyHosts = BenchHistoryCount(&pipeline, "SELECT COUNT(*) FROM stats_hosts;");
+        uint64_t historyConnections = BenchHistoryCount(&pipeline, "SELECT COUNT(*) FROM stats_connections;");
+        printf("history:      %llu hosts, %llu connections, peak %llu B/s, peak %llu connections/s\n",
+               (unsigned long long)historyHosts, (unsigned long long)historyConnections,
+               (unsigned long long)pipeline.maxRate, (unsigned long long)pipeline.maxConnections);
+        printf("              %llu flushes, %zu KB peak in memory\n",
+               (unsigned long long)pipeline.historyFlushes, pipeline.historyPeakBytes / 1024);
+        printf("anomaly:      %llu closed windows, %llu destination windows\n",
+               (unsigned long long)pipeline.windows, (unsigned long long)pipeline.windowDestinations);
+        printf("digest:       %016llx\n", (unsigned long long)BenchDigest(&pipeline, historyHosts, historyConnections));
+    }
+    printf("elapsed:      %.3f s", seconds);
+    if (captureSeconds > 0) {
+        printf(" for %.3f s of capture", captureSeconds);
+    }
+    printf("\n");
+    if (seconds > 0) {
+        printf("throughput:   %.2f Mpps, %.2f Gbit/s of captured traffic\n",
+               (double)totalPackets / seconds / 1e6, (double)totalBytes * 8 / seconds / 1e9);
+    }
+    if (!originalTiming && !preload && totalPackets > 0) {
+        printf("consumers:    %.1f ns/packet (classify + analytics)\n", (double)consumeNs / (double)totalPackets);
+    }
+
+    SNBPcapFileReaderClose(reader);
+    SNBTrafficDeltaDestroy(&pipeline.traffic);
+    free(preloaded.records);
+    free(shards.shardIndices);
+    SNBFlowTableDestroy(shards.hosts);
+    SNBFlowTableDestroy(shards.connections);
+    SNBTrafficDeltaDestroy(&shards.spare);
+    SNBFlowTableDestroy(pipeline.historyHosts);
+    SNBFlowTableDestroy(pipeline.historyConnections);
+    SNBTimeSeriesDestroy(&pipeline.series);
+    sqlite3_finalize(pipeline.upsertHost);
+    sqlite3_finalize(pipeline.upsertConnection);
+    sqlite3_close(pipeline.historyDb);
+    SNBFlowTableDestroy(pipeline.accumulators);
+    SNBAnomalyArenaDestroy(&pipeline.arena);
+    if (removeInput) {
+        unlink(inputPath);
+    }
+    return status;
+}
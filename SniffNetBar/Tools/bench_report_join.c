@@ -0,0 +1,402 @@
+//
+//  bench_report_join.c
+//  SniffNetBar
+//
+//  Time to find the malicious connections of the daily report over 90 days
+//  of history, the per-IP way and the joined way. The history and threat
+//  intel databases are written to temporary files with the app's schemas:
+//
+//      per-ip  -[SNBStatisticsHistory maliciousConnectionsForDay:] before the
+//              join: every connection of every day is read, and each of its
+//              addresses is looked up with a freshly prepared point query,
+//              as -[ThreatIntelStore responseForIndicator:] does. The JSON
+//              of a hit is copied and its score read; Foundation's decode
+//              of every hit is not included, so this is a lower bound.
+//      join    -maliciousConnectionsByDay: the flagged IPs are read from the
+//              score index, copied into a temporary table and joined with
+//              stats_connections in one query; only the IPs that matched
+//              are looked up, with one prepared statement.
+//
+//  Both must find the same connections. Builds on macOS and Linux:
+//
+//      make bench-report-join && ./build/bench_report_join [options]
+//
+//  Options:
+//      --days N           days of history (default 90)
+//      --connections N    connections per day (default 5000)
+//      --hosts N          distinct remote hosts (default 50000)
+//      --flagged N        remote hosts with a positive score (default 500)
+//
+
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sqlite3.h>
+
+static uint64_t BenchMonotonicNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t BenchNextRandom(uint64_t *state) {
+    // xorshift64*: fixed seed, so every run builds the same history
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545f4914f6cdd1dULL;
+}
+
+static void BenchRemoteAddress(uint32_t host, char *buffer, size_t length) {
+    uint32_t value = 0x5D000000u + host;
+    snprintf(buffer, length, "%u.%u.%u.%u", value >> 24, (value >> 16) & 0xFF, (value >> 8) & 0xFF, value & 0xFF);
+}
+
+static bool BenchExec(sqlite3 *db, const char *sql) {
+    char *error = NULL;
+    if (sqlite3_exec(db, sql, NULL, NULL, &error) != SQLITE_OK) {
+        fprintf(stderr, "sqlite: %s\n", error ? error : "error");
+        sqlite3_free(error);
+        return false;
+    }
+    return true;
+}
+
+// MARK: - Fixtures
+
+typedef struct {
+    uint32_t days;
+    uint32_t connectionsPerDay;
+    uint32_t hosts;
+    uint32_t flagged;
+} BenchConfig;
+
+// StatisticsHistory.m's stats_connections
+static bool BenchBuildHistory(sqlite3 *db, const BenchConfig *config) {
+    if (!BenchExec(db, "PRAGMA journal_mode=WAL;") ||
+        !BenchExec(db, "CREATE TABLE stats_connections (day TEXT NOT NULL, src_addr TEXT NOT NULL, "
+                       "src_port INTEGER NOT NULL, dst_addr TEXT NOT NULL, dst_port INTEGER NOT NULL, "
+                       "bytes INTEGER NOT NULL, packets INTEGER NOT NULL, "
+                       "PRIMARY KEY (day, src_addr, src_port, dst_addr, dst_port));") ||
+        !BenchExec(db, "CREATE INDEX stats_connections_day_idx ON stats_connections(day);")) {
+        return false;
+    }
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(db, "INSERT OR IGNORE INTO stats_connections VALUES (?, ?, ?, ?, ?, ?, ?);",
+                           -1, &stmt, NULL) != SQLITE_OK) {
+        return false;
+    }
+    uint64_t random = 0x9E3779B97F4A7C15ULL;
+    BenchExec(db, "BEGIN;");
+    for (uint32_t day = 0; day < config->days; day++) {
+        char dayString[32];
+        snprintf(dayString, sizeof(dayString), "2025-%02u-%02u", 1 + day / 28, 1 + day % 28);
+        for (uint32_t i = 0; i < config->connectionsPerDay; i++) {
+            char source[32];
+            char destination[32];
+            snprintf(source, sizeof(source), "192.168.1.%u", 10 + (unsigned)(BenchNextRandom(&random) % 8));
+            BenchRemoteAddress((uint32_t)(BenchNextRandom(&random) % config->hosts), destination, sizeof(destination));
+            sqlite3_bind_text(stmt, 1, dayString, -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(stmt, 2, source, -1, SQLITE_TRANSIENT);
+            sqlite3_bind_int(stmt, 3, 49152 + (int)(BenchNextRandom(&random) % 16384));
+            sqlite3_bind_text(stmt, 4, destination, -1, SQLITE_TRANSIENT);
+            sqlite3_bind_int(stmt, 5, 443);
+            sqlite3_bind_int64(stmt, 6, (sqlite3_int64)(BenchNextRandom(&random) % 10000000));
+            sqlite3_bind_int64(stmt, 7, (sqlite3_int64)(BenchNextRandom(&random) % 10000));
+            sqlite3_step(stmt);
+            sqlite3_reset(stmt);
+        }
+    }
+    BenchExec(db, "COMMIT;");
+    sqlite3_finalize(stmt);
+    return true;
+}
+
+// ThreatIntelStore.m's threat_intel_cache: every remote host was enriched,
+// and the first `flagged` of them scored above zero
+static bool BenchBuildThreatIntel(sqlite3 *db, const BenchConfig *config) {
+    if (!BenchExec(db, "PRAGMA journal_mode=WAL;") ||
+        !BenchExec(db, "CREATE TABLE threat_intel_cache (ip TEXT NOT NULL, indicator_type INTEGER NOT NULL, "
+                       "evaluated_at INTEGER NOT NULL, expires_at INTEGER NOT NULL, response_json TEXT NOT NULL, "
+                       "final_score INTEGER NOT NULL DEFAULT 0, PRIMARY KEY (ip, indicator_type));") ||
+        !BenchExec(db, "CREATE INDEX idx_threat_intel_score ON threat_intel_cache (final_score);")) {
+        return false;
+    }
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(db, "INSERT INTO threat_intel_cache VALUES (?, 0, 0, 0, ?, ?);", -1, &stmt, NULL) != SQLITE_OK) {
+        return false;
+    }
+    // Roughly the size of a two-provider response with its score breakdown
+    char padding[1201];
+    memset(padding, 'x', sizeof(padding) - 1);
+    padding[sizeof(padding) - 1] = '\0';
+    BenchExec(db, "BEGIN;");
+    for (uint32_t host = 0; host < config->hosts; host++) {
+        char ip[32];
+        char json[1400];
+        int score = host < config->flagged ? 40 + (int)(host % 60) : 0;
+        BenchRemoteAddress(host, ip, sizeof(ip));
+        snprintf(json, sizeof(json), "{\"indicator\":{\"type\":0,\"value\":\"%s\"},\"provider_results\":\"%s\","
+                 "\"scoring_result\":{\"final_score\":%d}}", ip, padding, score);
+        sqlite3_bind_text(stmt, 1, ip, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, 2, json, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int(stmt, 3, score);
+        sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+    }
+    BenchExec(db, "COMMIT;");
+    sqlite3_finalize(stmt);
+    return true;
+}
+
+// MARK: - Report paths
+
+typedef struct {
+    uint64_t connectionsRead;
+    uint64_t lookups;
+    uint64_t malicious;
+    uint64_t maliciousBytes;
+    uint64_t scoreSum;
+} BenchResult;
+
+// The stand-in for decoding: copy the JSON out and read the score from it
+static int BenchScoreFromJSON(const unsigned char *json, int length) {
+    char *copy = malloc((size_t)length + 1);
+    if (!copy) {
+        return 0;
+    }
+    memcpy(copy, json, (size_t)length);
+    copy[length] = '\0';
+    const char *field = strstr(copy, "\"final_score\":");
+    int score = field ? atoi(field + strlen("\"final_score\":")) : 0;
+    free(copy);
+    return score;
+}
+
+static int BenchLookupScore(sqlite3 *db, sqlite3_stmt *stmt, const char *ip) {
+    int score = 0;
+    sqlite3_bind_text(stmt, 1, ip, -1, SQLITE_TRANSIENT);
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        score = BenchScoreFromJSON(sqlite3_column_text(stmt, 0), sqlite3_column_bytes(stmt, 0));
+    }
+    sqlite3_reset(stmt);
+    (void)db;
+    return score;
+}
+
+static void BenchCountConnection(BenchResult *result, int sourceScore, int destinationScore, uint64_t bytes) {
+    int best = destinationScore > sourceScore ? destinationScore : sourceScore;
+    if (best > 0) {
+        result->malicious++;
+        result->maliciousBytes += bytes;
+        result->scoreSum += (uint64_t)best;
+    }
+}
+
+static bool BenchPerIP(sqlite3 *history, sqlite3 *intel, uint32_t days, BenchResult *result) {
+    memset(result, 0, sizeof(*result));
+    sqlite3_stmt *dayList = NULL;
+    if (sqlite3_prepare_v2(history, "SELECT DISTINCT day FROM stats_connections ORDER BY day DESC;",
+                           -1, &dayList, NULL) != SQLITE_OK) {
+        return false;
+    }
+    uint32_t seenDays = 0;
+    while (sqlite3_step(dayList) == SQLITE_ROW && seenDays++ < days) {
+        sqlite3_stmt *connections = NULL;
+        if (sqlite3_prepare_v2(history, "SELECT src_addr, dst_addr, bytes FROM stats_connections "
+                               "WHERE day = ? ORDER BY bytes DESC;", -1, &connections, NULL) != SQLITE_OK) {
+            break;
+        }
+        sqlite3_bind_text(connections, 1, (const char *)sqlite3_column_text(dayList, 0), -1, SQLITE_TRANSIENT);
+        while (sqlite3_step(connections) == SQLITE_ROW) {
+            result->connectionsRead++;
+            const char *addresses[2] = {
+                (const char *)sqlite3_column_text(connections, 1),
+                (const char *)sqlite3_column_text(connections, 0)
+            };
+            int scores[2] = {0, 0};
+            for (int a = 0; a < 2; a++) {
+                sqlite3_stmt *lookup = NULL;
+                if (sqlite3_prepare_v2(intel, "SELECT response_json, expires_at FROM threat_intel_cache "
+                                       "WHERE indicator_type = ? AND ip = ? LIMIT 1;", -1, &lookup, NULL) != SQLITE_OK) {
+                    continue;
+                }
+                sqlite3_bind_int(lookup, 1, 0);
+                sqlite3_bind_text(lookup, 2, addresses[a], -1, SQLITE_TRANSIENT);
+                if (sqlite3_step(lookup) == SQLITE_ROW) {
+                    scores[a] = BenchScoreFromJSON(sqlite3_column_text(lookup, 0), sqlite3_column_bytes(lookup, 0));
+                }
+                sqlite3_finalize(lookup);
+                result->lookups++;
+            }
+            BenchCountConnection(result, scores[1], scores[0], (uint64_t)sqlite3_column_int64(connections, 2));
+        }
+        sqlite3_finalize(connections);
+    }
+    sqlite3_finalize(dayList);
+    return true;
+}
+
+static bool BenchJoin(sqlite3 *history, sqlite3 *intel, BenchResult *result) {
+    memset(result, 0, sizeof(*result));
+
+    // -scoresForIndicatorsWithMinimumScore: into the temporary table
+    sqlite3_stmt *flagged = NULL;
+    sqlite3_stmt *insert = NULL;
+    if (!BenchExec(history, "CREATE TEMP TABLE IF NOT EXISTS report_flagged (ip TEXT PRIMARY KEY) WITHOUT ROWID;") ||
+        sqlite3_prepare_v2(intel, "SELECT ip FROM threat_intel_cache WHERE final_score >= 1;", -1, &flagged, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(history, "INSERT OR IGNORE INTO temp.report_flagged (ip) VALUES (?);", -1, &insert, NULL) != SQLITE_OK) {
+        sqlite3_finalize(flagged);
+        return false;
+    }
+    BenchExec(history, "BEGIN;");
+    while (sqlite3_step(flagged) == SQLITE_ROW) {
+        sqlite3_bind_text(insert, 1, (const char *)sqlite3_column_text(flagged, 0), -1, SQLITE_TRANSIENT);
+        sqlite3_step(insert);
+        sqlite3_reset(insert);
+    }
+    sqlite3_finalize(flagged);
+    sqlite3_finalize(insert);
+
+    // The join, with -responsesForIPs:minimumScore: for each address that
+    // matched; the app collects the set first and looks each up once
+    sqlite3_stmt *join = NULL;
+    sqlite3_stmt *lookup = NULL;
+    const char *sql =
+        "SELECT day, src_addr, src_port, dst_addr, dst_port, bytes, packets FROM stats_connections "
+        "WHERE dst_addr IN (SELECT ip FROM temp.report_flagged) OR src_addr IN (SELECT ip FROM temp.report_flagged) "
+        "ORDER BY day DESC, bytes DESC;";
+    if (sqlite3_prepare_v2(history, sql, -1, &join, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(intel, "SELECT response_json FROM threat_intel_cache "
+                           "WHERE ip = ? AND final_score >= 1 LIMIT 1;", -1, &lookup, NULL) != SQLITE_OK) {
+        sqlite3_finalize(join);
+        BenchExec(history, "COMMIT;");
+        return false;
+    }
+    sqlite3_stmt *known = NULL;
+    BenchExec(history, "CREATE TEMP TABLE IF NOT EXISTS report_scores (ip TEXT PRIMARY KEY, score INTEGER) WITHOUT ROWID;");
+    sqlite3_prepare_v2(history, "SELECT score FROM temp.report_scores WHERE ip = ?;", -1, &known, NULL);
+    sqlite3_stmt *remember = NULL;
+    sqlite3_prepare_v2(history, "INSERT INTO temp.report_scores VALUES (?, ?);", -1, &remember, NULL);
+    while (sqlite3_step(join) == SQLITE_ROW) {
+        result->connectionsRead++;
+        int scores[2] = {0, 0};
+        for (int a = 0; a < 2; a++) {
+            const char *ip = (const char *)sqlite3_column_text(join, a == 0 ? 1 : 3);
+            sqlite3_bind_text(known, 1, ip, -1, SQLITE_TRANSIENT);
+            if (sqlite3_step(known) == SQLITE_ROW) {
+                scores[a] = sqlite3_column_int(known, 0);
+            } else {
+                scores[a] = BenchLookupScore(intel, lookup, ip);
+                result->lookups++;
+                sqlite3_bind_text(remember, 1, ip, -1, SQLITE_TRANSIENT);
+                sqlite3_bind_int(remember, 2, scores[a]);
+                sqlite3_step(remember);
+                sqlite3_reset(remember);
+            }
+            sqlite3_reset(known);
+        }
+        BenchCountConnection(result, scores[0], scores[1], (uint64_t)sqlite3_column_int64(join, 5));
+    }
+    sqlite3_finalize(join);
+    sqlite3_finalize(lookup);
+    sqlite3_finalize(known);
+    sqlite3_finalize(remember);
+    BenchExec(history, "DELETE FROM temp.report_flagged;");
+    BenchExec(history, "DELETE FROM temp.report_scores;");
+    BenchExec(history, "COMMIT;");
+    return true;
+}
+
+// MARK: - Main
+
+static void BenchPrint(const char *name, const BenchResult *result, uint64_t ns) {
+    printf("  %-7s %9.1f ms  %9llu rows read  %9llu lookups  %6llu malicious  %14llu bytes\n",
+           name, (double)ns / 1e6,
+           (unsigned long long)result->connectionsRead, (unsigned long long)result->lookups,
+           (unsigned long long)result->malicious, (unsigned long long)result->maliciousBytes);
+}
+
+int main(int argc, char **argv) {
+    BenchConfig config = {.days = 90, .connectionsPerDay = 5000, .hosts = 50000, .flagged = 500};
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--days") == 0 && i + 1 < argc) {
+            config.days = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--connections") == 0 && i + 1 < argc) {
+            config.connectionsPerDay = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--hosts") == 0 && i + 1 < argc) {
+            config.hosts = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--flagged") == 0 && i + 1 < argc) {
+            config.flagged = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else {
+            fprintf(stderr, "usage: %s [--days N] [--connections N] [--hosts N] [--flagged N]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (config.days == 0 || config.hosts == 0) {
+        fprintf(stderr, "days and hosts must be non-zero\n");
+        return 1;
+    }
+
+    char historyPath[] = "/tmp/snb-bench-history-XXXXXX";
+    char intelPath[] = "/tmp/snb-bench-intel-XXXXXX";
+    int historyFd = mkstemp(historyPath);
+    int intelFd = mkstemp(intelPath);
+    if (historyFd < 0 || intelFd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    close(historyFd);
+    close(intelFd);
+
+    sqlite3 *history = NULL;
+    sqlite3 *intel = NULL;
+    bool ok = sqlite3_open(historyPath, &history) == SQLITE_OK && sqlite3_open(intelPath, &intel) == SQLITE_OK;
+    uint64_t buildStart = BenchMonotonicNs();
+    ok = ok && BenchBuildHistory(history, &config) && BenchBuildThreatIntel(intel, &config);
+    if (!ok) {
+        fprintf(stderr, "failed to build the fixtures\n");
+    } else {
+        printf("%u days x %u connections, %u hosts of which %u flagged (built in %.1f s)\n",
+               config.days, config.connectionsPerDay, config.hosts, config.flagged,
+               (double)(BenchMonotonicNs() - buildStart) / 1e9);
+
+        BenchResult perIP;
+        BenchResult join;
+        uint64_t start = BenchMonotonicNs();
+        ok = BenchPerIP(history, intel, config.days, &perIP);
+        uint64_t perIPNs = BenchMonotonicNs() - start;
+        start = BenchMonotonicNs();
+        ok = BenchJoin(history, intel, &join) && ok;
+        uint64_t joinNs = BenchMonotonicNs() - start;
+
+        BenchPrint("per-ip", &perIP, perIPNs);
+        BenchPrint("join", &join, joinNs);
+        printf("  speedup %.1fx\n", joinNs > 0 ? (double)perIPNs / (double)joinNs : 0.0);
+        if (perIP.malicious != join.malicious || perIP.maliciousBytes != join.maliciousBytes ||
+            perIP.scoreSum != join.scoreSum) {
+            fprintf(stderr, "mismatch: the two paths found different connections\n");
+            ok = false;
+        }
+    }
+
+    sqlite3_close(history);
+    sqlite3_close(intel);
+    const char *suffixes[] = {"", "-wal", "-shm"};
+    for (int i = 0; i < 3; i++) {
+        char path[64];
+        snprintf(path, sizeof(path), "%s%s", historyPath, suffixes[i]);
+        unlink(path);
+        snprintf(path, sizeof(path), "%s%s", intelPath, suffixes[i]);
+        unlink(path);
+    }
+    return ok ? 0 : 1;
+}
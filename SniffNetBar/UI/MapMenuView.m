@@ -8,10 +8,11 @@
 #import "MapMenuView.h"
 #import "ByteFormatter.h"
 #import "ConfigurationManager.h"
-#import "ExpiringCache.h"
+#import "LRUCache.h"
 #import "IPAddressUtilities.h"
 #import "UserDefaultsKeys.h"
 #import "SNBLocationStore.h"
+#import "PassiveDNSCache.h"
 #import "SNBBadgeRegistry.h"
 #import "Logger.h"
 #import <WebKit/WebKit.h>
@@ -21,7 +22,7 @@
 @property (nonatomic, strong) WKWebView *webView;
 @property (nonatomic, strong) NSButton *zoomInButton;
 @property (nonatomic, strong) NSButton *zoomOutButton;
-@property (nonatomic, strong) SNBExpiringCache<NSString *, NSDictionary *> *locationCache;
+@property (nonatomic, strong) SNBLRUCache<NSString *, NSDictionary *> *locationCache;
 @property (nonatomic, strong) SNBLocationStore *locationStore;
 @property (nonatomic, strong) NSMutableSet<NSString *> *inFlightLookups;
 @property (nonatomic, strong) NSMutableSet<NSString *> *failedLookups;
@@ -103,8 +104,8 @@ static NSString *SNBLocationStoreDirectory(void) {
         [_zoomInButton setNeedsDisplay:YES];
         [_zoomOutButton setNeedsDisplay:YES];
 
-        _locationCache = [[SNBExpiringCache alloc] initWithMaxSize:[ConfigurationManager sharedManager].maxLocationCacheSize
-                                                expirationInterval:[ConfigurationManager sharedManager].locationCacheExpirationTime];
+        _locationCache = [[SNBLRUCache alloc] initWithCapacity:[ConfigurationManager sharedManager].maxLocationCacheSize
+                                                    timeToLive:[ConfigurationManager sharedManager].locationCacheExpirationTime];
         _inFlightLookups = [NSMutableSet set];
         _failedLookups = [NSMutableSet set];
         NSURLSessionConfiguration *sessionConfig = [NSURLSessionConfiguration ephemeralSessionConfiguration];
@@ -384,7 +385,7 @@ static NSString *SNBLocationStoreDirectory(void) {
     NSDate *now = [NSDate date];
     if (!self.lastCacheCleanupTime || [now timeIntervalSinceDate:self.lastCacheCleanupTime] > 5.0) {
         self.lastCacheCleanupTime = now;
-        NSUInteger expiredCount = [self.locationCache cleanupAndReturnExpiredCount];
+        NSUInteger expiredCount = [self.locationCache expireObjects];
         [self.locationStore cleanupExpiredEntries];
         if (expiredCount > 0) {
             SNBLogUIDebug(": cleaned up %lu expired location cache entries",
@@ -565,6 +566,7 @@ static NSString *SNBLocationStoreDirectory(void) {
         }
 
         NSMutableDictionary<NSString *, NSMutableArray<NSDictionary *> *> *pointsByCoord = [NSMutableDictionary dictionary];
+        SNBPassiveDNSCache *passiveDNS = [SNBPassiveDNSCache sharedCache];
         for (NSString *ip in targetIPs) {
             NSDictionary *value = locationByIP[ip];
             if (!value) {
@@ -578,7 +580,9 @@ static NSString *SNBLocationStoreDirectory(void) {
             }
             NSString *name = value[@"name"];
             NSString *isp = value[@"isp"];
-            NSString *locationPart = name.length > 0 ? [NSString stringWithFormat:@"%@ — %@", ip, name] : ip;
+            NSString *hostname = [passiveDNS hostnameForAddress:ip];
+            NSString *addressPart = hostname.length > 0 ? [NSString stringWithFormat:@"%@ (%@)", hostname, ip] : ip;
+            NSString *locationPart = name.length > 0 ? [NSString stringWithFormat:@"%@ — %@", addressPart, name] : addressPart;
             NSMutableDictionary *payload = [NSMutableDictionary dictionary];
             payload[@"lat"] = @(coord.latitude);
             payload[@"lon"] = @(coord.longitude);
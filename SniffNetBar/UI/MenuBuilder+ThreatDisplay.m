@@ -7,6 +7,7 @@
 
 #import "MenuBuilder+ThreatDisplay.h"
 #import "TrafficStatistics.h"
+#import "PassiveDNSCache.h"
 #import "ThreatIntelModels.h"
 #import "ByteFormatter.h"
 
@@ -185,15 +186,17 @@
     NSString *verdict = [scoring verdictString];
     ConnectionTraffic *conn = threat.primaryConnection;
 
-    // Line 1: IP + Port + Process
+    // Line 1: IP + Port + Process, led by the name the user looked up
     NSMutableString *line1 = [NSMutableString string];
+    NSString *hostname = [[SNBPassiveDNSCache sharedCache] hostnameForAddress:threat.ipAddress];
+    NSString *lead = hostname.length > 0 ? [NSString stringWithFormat:@"  %@ — ", hostname] : @"  ";
     if (conn) {
-        [line1 appendFormat:@"  %@:%ld", threat.ipAddress, (long)conn.destinationPort];
+        [line1 appendFormat:@"%@%@:%ld", lead, threat.ipAddress, (long)conn.destinationPort];
         if (conn.processName.length > 0) {
             [line1 appendFormat:@" ← %@ [%d]", conn.processName, conn.processPID];
         }
     } else {
-        [line1 appendFormat:@"  %@", threat.ipAddress];
+        [line1 appendFormat:@"%@%@", lead, threat.ipAddress];
     }
     if (!threat.isActive) {
         [line1 appendString:@" [CLOSED]"];
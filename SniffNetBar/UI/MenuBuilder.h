@@ -11,6 +11,7 @@
 @class TrafficStats;
 @class TIEnrichmentResponse;
 @class SNBNetworkAsset;
+@class SNBCaptureStats;
 
 @protocol MenuBuilderDelegate <NSObject>
 - (void)menuBuilderNeedsVisualizationRefresh:(id)sender;
@@ -31,6 +32,9 @@
 @property (nonatomic, assign) BOOL dailyStatsEnabled;
 @property (nonatomic, assign) BOOL statsReportAvailable;
 @property (nonatomic, strong) NSDate *captureStartDate;
+@property (nonatomic, copy) SNBCaptureStats *captureStats;
+// Devices captured alongside the selected one, checked in the interface menu
+@property (nonatomic, copy) NSArray<NSString *> *additionalCaptureDeviceNames;
 @property (nonatomic, copy, readonly) NSString *mapProviderName;
 @property (nonatomic, assign, readonly) BOOL menuIsOpen;
 
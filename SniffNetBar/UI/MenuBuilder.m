@@ -9,6 +9,8 @@
 #import "ConfigurationManager.h"
 #import "MapMenuView.h"
 #import "NetworkDevice.h"
+#import "PacketCaptureManager.h"
+#import "CaptureStats.h"
 #import "ThreatIntelModels.h"
 #import "TrafficStatistics.h"
 #import "UserDefaultsKeys.h"
@@ -108,6 +110,7 @@ static NSString *SNBStoredDeviceName(void) {
 static const CFAbsoluteTime kLocalIPCacheTTLSeconds = 60.0;
 
 static NSString * const SNBMenuItemKeyNetworkRate = @"networkRate";
+static NSString * const SNBMenuItemKeyNetworkInterfaces = @"networkInterfaces";
 static NSString * const SNBMenuItemKeyNetworkTotal = @"networkTotal";
 static NSString * const SNBMenuItemKeyActiveConnections = @"activeConnections";
 static NSString * const SNBMenuItemKeyHosts = @"hosts";
@@ -117,6 +120,7 @@ static NSString * const SNBMenuItemKeyDetailOutgoing = @"detailOutgoing";
 static NSString * const SNBMenuItemKeyDetailTotal = @"detailTotal";
 static NSString * const SNBMenuItemKeyDetailPackets = @"detailPackets";
 static NSString * const SNBMenuItemKeyCaptureStart = @"detailCaptureStart";
+static NSString * const SNBMenuItemKeyDetailDropped = @"detailDropped";
 
 static NSSet<NSString *> *SNBLocalIPAddresses(void) {
     static NSSet<NSString *> *cached = nil;
@@ -795,6 +799,31 @@ static NSSet<NSString *> *SNBLocalIPAddresses(void) {
     [self configureStatItem:item label:label value:value color:color];
 }
 
+- (NSString *)droppedPacketsDisplayValue {
+    SNBCaptureStats *captureStats = self.captureStats;
+    if (!captureStats) {
+        return @"—";
+    }
+    if (captureStats.totalDropped == 0) {
+        return @"0";
+    }
+    return [NSString stringWithFormat:@"%llu (kernel %llu, interface %llu, ring %llu)",
+            captureStats.totalDropped,
+            captureStats.kernelDropped,
+            captureStats.interfaceDropped,
+            captureStats.ringDropped];
+}
+
+// Throughput of each captured interface, e.g. "en0 1.2 MB/s, utun4 310 KB/s"
+- (NSString *)interfacesDisplayValueWithStats:(TrafficStats *)stats {
+    NSMutableArray<NSString *> *parts = [NSMutableArray arrayWithCapacity:stats.interfaces.count];
+    for (InterfaceTraffic *interface in stats.interfaces) {
+        NSString *rate = [SNBByteFormatter stringFromBytes:interface.bytesPerSecond];
+        [parts addObject:[NSString stringWithFormat:@"%@ %@/s", interface.name ?: @"other", rate]];
+    }
+    return parts.count > 0 ? [parts componentsJoinedByString:@", "] : @"—";
+}
+
 - (NSString *)captureStartDisplayValue {
     if (self.captureStartDate) {
         return [self.captureDateFormatter stringFromDate:self.captureStartDate];
@@ -1084,6 +1113,37 @@ static NSSet<NSString *> *SNBLocalIPAddresses(void) {
         [deviceSubmenu addItem:deviceItem];
     }
 
+    // Further interfaces captured at the same time, up to the helper's session limit
+    NSMutableArray<NetworkDevice *> *additionalCandidates = [NSMutableArray array];
+    for (NetworkDevice *device in deviceList) {
+        if (![device.name isEqualToString:uiSelectedDeviceName]) {
+            [additionalCandidates addObject:device];
+        }
+    }
+    if (additionalCandidates.count > 0) {
+        [deviceSubmenu addItem:[NSMenuItem separatorItem]];
+        NSMenuItem *additionalHeader = [[NSMenuItem alloc] initWithTitle:@"Also Capture On" action:nil keyEquivalent:@""];
+        additionalHeader.enabled = NO;
+        [deviceSubmenu addItem:additionalHeader];
+        NSUInteger additionalLimit = SNBPacketCaptureMaxSessions - 1;
+        NSUInteger additionalCount = 0;
+        for (NetworkDevice *device in additionalCandidates) {
+            additionalCount += [self.additionalCaptureDeviceNames containsObject:device.name];
+        }
+        for (NetworkDevice *device in additionalCandidates) {
+            NSMenuItem *additionalItem = [[NSMenuItem alloc] initWithTitle:[device displayName]
+                                                                    action:@selector(additionalDeviceToggled:)
+                                                             keyEquivalent:@""];
+            additionalItem.target = target;
+            additionalItem.representedObject = device;
+            additionalItem.indentationLevel = 1;
+            BOOL captured = [self.additionalCaptureDeviceNames containsObject:device.name];
+            additionalItem.state = captured ? NSControlStateValueOn : NSControlStateValueOff;
+            additionalItem.enabled = captured || additionalCount < additionalLimit;
+            [deviceSubmenu addItem:additionalItem];
+        }
+    }
+
     deviceMenu.submenu = deviceSubmenu;
     [settingsSubmenu addItem:deviceMenu];
     NSMenuItem *providerItem = [[NSMenuItem alloc] initWithTitle:@"GeoLocation Provider" action:nil keyEquivalent:@""];
@@ -1340,6 +1400,7 @@ static NSSet<NSString *> *SNBLocalIPAddresses(void) {
                          recentNewAssets:(NSArray<SNBNetworkAsset *> *)recentNewAssets {
     NSString *rateStr = [SNBByteFormatter stringFromBytes:stats.bytesPerSecond];
     [self updateStatItemForKey:SNBMenuItemKeyNetworkRate value:[NSString stringWithFormat:@"%@/s", rateStr]];
+    [self updateStatItemForKey:SNBMenuItemKeyNetworkInterfaces value:[self interfacesDisplayValueWithStats:stats]];
 
     NSString *totalBytesStr = [SNBByteFormatter stringFromBytes:stats.totalBytes];
     [self updateStatItemForKey:SNBMenuItemKeyNetworkTotal value:totalBytesStr];
@@ -1830,6 +1891,7 @@ static NSSet<NSString *> *SNBLocalIPAddresses(void) {
     [self updateDetailItemForKey:SNBMenuItemKeyDetailOutgoing value:[SNBByteFormatter stringFromBytes:stats.outgoingBytes]];
     [self updateDetailItemForKey:SNBMenuItemKeyDetailTotal value:[SNBByteFormatter stringFromBytes:stats.totalBytes]];
     [self updateDetailItemForKey:SNBMenuItemKeyDetailPackets value:[NSString stringWithFormat:@"%llu", stats.totalPackets]];
+    [self updateDetailItemForKey:SNBMenuItemKeyDetailDropped value:[self droppedPacketsDisplayValue]];
 }
 
 - (void)refreshMaliciousConnectionsSectionWithStats:(TrafficStats *)stats
@@ -2208,6 +2270,11 @@ static NSSet<NSString *> *SNBLocalIPAddresses(void) {
                                                       color:[NSColor labelColor]];
         [self cacheStatItem:rateItem label:@"Rate" color:[NSColor labelColor] forKey:SNBMenuItemKeyNetworkRate];
         [visualizationSubmenu addItem:rateItem];
+        NSMenuItem *interfacesItem = [self styledStatItemWithLabel:@"Interfaces"
+                                                             value:[self interfacesDisplayValueWithStats:stats]
+                                                             color:[NSColor labelColor]];
+        [self cacheStatItem:interfacesItem label:@"Interfaces" color:[NSColor labelColor] forKey:SNBMenuItemKeyNetworkInterfaces];
+        [visualizationSubmenu addItem:interfacesItem];
         NSString *totalBytesStr = [SNBByteFormatter stringFromBytes:stats.totalBytes];
         NSMenuItem *totalBytesItem = [self styledStatItemWithLabel:@"Total" value:totalBytesStr
                                                           color:[NSColor labelColor]];
@@ -2376,6 +2443,10 @@ static NSSet<NSString *> *SNBLocalIPAddresses(void) {
     [self cacheDetailItem:packetsItem label:@"Packets:" color:[NSColor labelColor] forKey:SNBMenuItemKeyDetailPackets];
     [detailsSubmenu addItem:packetsItem];
 
+    NSMenuItem *droppedItem = [self styledStatItemWithLabel:@"Dropped:" value:[self droppedPacketsDisplayValue] color:[NSColor labelColor]];
+    [self cacheDetailItem:droppedItem label:@"Dropped:" color:[NSColor labelColor] forKey:SNBMenuItemKeyDetailDropped];
+    [detailsSubmenu addItem:droppedItem];
+
     if (self.showTopHosts) {
         [detailsSubmenu addItem:[NSMenuItem separatorItem]];
         NSString *topHostsTitle = [NSString stringWithFormat:@"TOP %lu HOSTS by Traffic",
@@ -4,6 +4,7 @@
 //
 
 #import <Foundation/Foundation.h>
+#import "AddressClassifier.h"
 
 NS_ASSUME_NONNULL_BEGIN
 
@@ -17,6 +18,15 @@ NS_ASSUME_NONNULL_BEGIN
 + (BOOL)isValidIPv4:(NSString *)ipAddress;
 + (BOOL)isValidIPv6:(NSString *)ipAddress;
 
+// Binary classification through the shared prefix table; a mask of
+// SNBAddressClass values, 0 for public or unparsable addresses
++ (uint16_t)addressClassesForIPAddress:(NSString *)ipAddress;
+
+// Rebuilds the shared table with the default ranges plus networks, given as
+// CIDR strings and classified SNBAddressClassUser (and therefore private).
+// Leaves the current table in place and returns NO on a malformed entry.
++ (BOOL)setUserNetworks:(NSArray<NSString *> *)networks error:(NSError **)error;
+
 // Private/local address detection
 + (BOOL)isPrivateIPv4Address:(NSString *)ipAddress;
 + (BOOL)isPrivateIPv6Address:(NSString *)ipAddress;
@@ -5,6 +5,7 @@
 
 #import "IPAddressUtilities.h"
 #import <arpa/inet.h>
+#import <string.h>
 
 @implementation IPAddressUtilities
 
@@ -15,23 +16,9 @@
         return NO;
     }
 
-    NSArray<NSString *> *octets = [ipAddress componentsSeparatedByString:@"."];
-    if (octets.count != 4) {
-        return NO;
-    }
-
-    NSCharacterSet *nonDigits = [[NSCharacterSet decimalDigitCharacterSet] invertedSet];
-    for (NSString *octet in octets) {
-        if (octet.length == 0 || [octet rangeOfCharacterFromSet:nonDigits].location != NSNotFound) {
-            return NO;
-        }
-        NSInteger value = [octet integerValue];
-        if (value < 0 || value > 255) {
-            return NO;
-        }
-    }
-
-    return YES;
+    // Dotted-quad only, as inet_pton does not accept shorthand forms
+    struct in_addr addr;
+    return inet_pton(AF_INET, [ipAddress UTF8String], &addr) == 1;
 }
 
 + (BOOL)isValidIPv6:(NSString *)ipAddress {
@@ -44,214 +31,122 @@
     return inet_pton(AF_INET6, [ipAddress UTF8String], &addr) == 1;
 }
 
-#pragma mark - Private/Local Address Detection
+#pragma mark - Classification
 
-+ (BOOL)isPrivateIPv4Address:(NSString *)ipAddress {
-    if (![self isValidIPv4:ipAddress]) {
+// Parses a textual IPv4 or IPv6 address into the binary form the address
+// classifier walks. Addresses go through inet_pton once, so classification
+// never splits or prefix-matches strings.
+static BOOL SNBParseIPAddress(NSString *ipAddress, uint8_t *family, uint8_t address[16]) {
+    if (ipAddress.length == 0) {
         return NO;
     }
-
-    NSArray<NSString *> *octets = [ipAddress componentsSeparatedByString:@"."];
-    NSInteger first = [octets[0] integerValue];
-    NSInteger second = [octets[1] integerValue];
-
-    // RFC 1918 private ranges
-    if (first == 10) {  // 10.0.0.0/8
-        return YES;
-    }
-    if (first == 172 && second >= 16 && second <= 31) {  // 172.16.0.0/12
-        return YES;
-    }
-    if (first == 192 && second == 168) {  // 192.168.0.0/16
-        return YES;
+    const char *text = ipAddress.UTF8String;
+    if (!text) {
+        return NO;
     }
-
-    // Loopback
-    if (first == 127) {  // 127.0.0.0/8
-        return YES;
+    memset(address, 0, 16);
+    if (strchr(text, ':') != NULL) {
+        *family = SNBAddressFamilyIPv6;
+        return inet_pton(AF_INET6, text, address) == 1;
     }
+    *family = SNBAddressFamilyIPv4;
+    return inet_pton(AF_INET, text, address) == 1;
+}
 
-    // Link-local (APIPA)
-    if (first == 169 && second == 254) {  // 169.254.0.0/16
-        return YES;
+static uint16_t SNBClassesForIPAddress(NSString *ipAddress, uint8_t requiredFamily, BOOL *valid) {
+    uint8_t family = SNBAddressFamilyNone;
+    uint8_t address[16];
+    if (!SNBParseIPAddress(ipAddress, &family, address) ||
+        (requiredFamily != SNBAddressFamilyNone && family != requiredFamily)) {
+        *valid = NO;
+        return 0;
     }
+    *valid = YES;
+    return SNBAddressClassify(SNBAddressClassifierShared(), family, address);
+}
 
-    return NO;
++ (uint16_t)addressClassesForIPAddress:(NSString *)ipAddress {
+    BOOL valid = NO;
+    return SNBClassesForIPAddress(ipAddress, SNBAddressFamilyNone, &valid);
 }
 
-+ (BOOL)isPrivateIPv6Address:(NSString *)ipAddress {
-    if (![self isValidIPv6:ipAddress]) {
++ (BOOL)setUserNetworks:(NSArray<NSString *> *)networks error:(NSError **)error {
+    SNBAddressClassifier classifier;
+    if (!SNBAddressClassifierInit(&classifier) || !SNBAddressClassifierAddDefaults(&classifier)) {
+        SNBAddressClassifierDestroy(&classifier);
+        if (error) {
+            *error = [NSError errorWithDomain:@"IPAddressUtilities"
+                                         code:1
+                                     userInfo:@{NSLocalizedDescriptionKey: @"Failed to allocate address classifier"}];
+        }
         return NO;
     }
 
-    NSString *lowerIP = [ipAddress lowercaseString];
-
-    // Loopback (::1)
-    if ([lowerIP isEqualToString:@"::1"] || [lowerIP hasPrefix:@"::1/"]) {
-        return YES;
+    for (NSString *network in networks) {
+        char message[128];
+        if (!SNBAddressClassifierAddCIDR(&classifier, network.UTF8String ?: "", SNBAddressClassUser,
+                                         message, sizeof(message))) {
+            SNBAddressClassifierDestroy(&classifier);
+            if (error) {
+                *error = [NSError errorWithDomain:@"IPAddressUtilities"
+                                             code:2
+                                         userInfo:@{NSLocalizedDescriptionKey: @(message)}];
+            }
+            return NO;
+        }
     }
 
-    // Link-local (fe80::/10)
-    if ([lowerIP hasPrefix:@"fe80:"]) {
-        return YES;
+    if (!SNBAddressClassifierPublish(&classifier)) {
+        SNBAddressClassifierDestroy(&classifier);
+        if (error) {
+            *error = [NSError errorWithDomain:@"IPAddressUtilities"
+                                         code:1
+                                     userInfo:@{NSLocalizedDescriptionKey: @"Failed to allocate address classifier"}];
+        }
+        return NO;
     }
+    return YES;
+}
 
-    // Unique Local Addresses (fc00::/7 - includes fc00::/8 and fd00::/8)
-    if ([lowerIP hasPrefix:@"fc"] || [lowerIP hasPrefix:@"fd"]) {
-        return YES;
-    }
+#pragma mark - Private/Local Address Detection
 
-    // Unspecified address (::)
-    if ([lowerIP isEqualToString:@"::"]) {
-        return YES;
-    }
++ (BOOL)isPrivateIPv4Address:(NSString *)ipAddress {
+    BOOL valid = NO;
+    uint16_t classes = SNBClassesForIPAddress(ipAddress, SNBAddressFamilyIPv4, &valid);
+    return valid && (classes & SNBAddressClassLocalMask) != 0;
+}
 
-    return NO;
++ (BOOL)isPrivateIPv6Address:(NSString *)ipAddress {
+    BOOL valid = NO;
+    uint16_t classes = SNBClassesForIPAddress(ipAddress, SNBAddressFamilyIPv6, &valid);
+    return valid && (classes & SNBAddressClassLocalMask) != 0;
 }
 
 + (BOOL)isPrivateIPAddress:(NSString *)ipAddress {
-    if (!ipAddress || ipAddress.length == 0) {
-        return NO;
-    }
-
-    if ([ipAddress containsString:@"."]) {
-        return [self isPrivateIPv4Address:ipAddress];
-    } else if ([ipAddress containsString:@":"]) {
-        return [self isPrivateIPv6Address:ipAddress];
-    }
-
-    return NO;
+    return ([self addressClassesForIPAddress:ipAddress] & SNBAddressClassLocalMask) != 0;
 }
 
 #pragma mark - Public Address Detection
 
 + (BOOL)isPublicIPAddress:(NSString *)ipAddress {
-    if (!ipAddress || ipAddress.length == 0) {
-        return NO;
-    }
-
-    // IPv4
-    if ([ipAddress containsString:@"."]) {
-        if (![self isValidIPv4:ipAddress]) {
-            return NO;
-        }
-
-        // Check if it's private/local
-        if ([self isPrivateIPv4Address:ipAddress]) {
-            return NO;
-        }
-
-        NSArray<NSString *> *octets = [ipAddress componentsSeparatedByString:@"."];
-        NSInteger first = [octets[0] integerValue];
-
-        // Multicast (224.0.0.0/4)
-        if (first >= 224 && first <= 239) {
-            return NO;
-        }
-
-        // Reserved/experimental (240.0.0.0/4)
-        if (first >= 240) {
-            return NO;
-        }
-
-        // "This network" (0.0.0.0/8)
-        if (first == 0) {
-            return NO;
-        }
-
-        return YES;
-    }
-
-    // IPv6
-    if ([ipAddress containsString:@":"]) {
-        if (![self isValidIPv6:ipAddress]) {
-            return NO;
-        }
-
-        // Check if it's private/local
-        if ([self isPrivateIPv6Address:ipAddress]) {
-            return NO;
-        }
-
-        NSString *lowerIP = [ipAddress lowercaseString];
-
-        // Multicast (ff00::/8)
-        if ([lowerIP hasPrefix:@"ff"]) {
-            return NO;
-        }
-
-        return YES;
-    }
-
-    return NO;
+    // Public means routable on the internet: valid and in no special range
+    BOOL valid = NO;
+    uint16_t classes = SNBClassesForIPAddress(ipAddress, SNBAddressFamilyNone, &valid);
+    return valid && classes == 0;
 }
 
 #pragma mark - Special Address Ranges
 
 + (BOOL)isLoopbackAddress:(NSString *)ipAddress {
-    if (!ipAddress || ipAddress.length == 0) {
-        return NO;
-    }
-
-    if ([ipAddress containsString:@"."]) {
-        if (![self isValidIPv4:ipAddress]) {
-            return NO;
-        }
-        NSArray<NSString *> *octets = [ipAddress componentsSeparatedByString:@"."];
-        return [octets[0] integerValue] == 127;
-    }
-
-    if ([ipAddress containsString:@":"]) {
-        NSString *lowerIP = [ipAddress lowercaseString];
-        return [lowerIP isEqualToString:@"::1"] || [lowerIP hasPrefix:@"::1/"];
-    }
-
-    return NO;
+    return ([self addressClassesForIPAddress:ipAddress] & SNBAddressClassLoopback) != 0;
 }
 
 + (BOOL)isMulticastAddress:(NSString *)ipAddress {
-    if (!ipAddress || ipAddress.length == 0) {
-        return NO;
-    }
-
-    if ([ipAddress containsString:@"."]) {
-        if (![self isValidIPv4:ipAddress]) {
-            return NO;
-        }
-        NSArray<NSString *> *octets = [ipAddress componentsSeparatedByString:@"."];
-        NSInteger first = [octets[0] integerValue];
-        return first >= 224 && first <= 239;
-    }
-
-    if ([ipAddress containsString:@":"]) {
-        NSString *lowerIP = [ipAddress lowercaseString];
-        return [lowerIP hasPrefix:@"ff"];
-    }
-
-    return NO;
+    return ([self addressClassesForIPAddress:ipAddress] & SNBAddressClassMulticast) != 0;
 }
 
 + (BOOL)isLinkLocalAddress:(NSString *)ipAddress {
-    if (!ipAddress || ipAddress.length == 0) {
-        return NO;
-    }
-
-    if ([ipAddress containsString:@"."]) {
-        if (![self isValidIPv4:ipAddress]) {
-            return NO;
-        }
-        NSArray<NSString *> *octets = [ipAddress componentsSeparatedByString:@"."];
-        NSInteger first = [octets[0] integerValue];
-        NSInteger second = [octets[1] integerValue];
-        return first == 169 && second == 254;
-    }
-
-    if ([ipAddress containsString:@":"]) {
-        NSString *lowerIP = [ipAddress lowercaseString];
-        return [lowerIP hasPrefix:@"fe80:"];
-    }
-
-    return NO;
+    return ([self addressClassesForIPAddress:ipAddress] & SNBAddressClassLinkLocal) != 0;
 }
 
 @end
@@ -0,0 +1,54 @@
+//
+//  LRUCache.h
+//  SniffNetBar
+//
+//  Bounded least-recently-used cache with per-entry expiry
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+// Lookups, inserts, evictions and expiry are O(1) (CacheIndex.h) and time is
+// taken from the monotonic clock, so wall clock changes do not expire entries.
+// Thread-safe. Keys are copied when they conform to NSCopying. With more than
+// one shard, keys are spread by hash over independently locked shards so
+// concurrent readers rarely contend, and recency is tracked per shard.
+@interface SNBLRUCache<KeyType, ObjectType> : NSObject
+
+// timeToLive is the default lifetime of an entry; 0 keeps entries until they
+// are evicted. Small caches use fewer shards than asked for, so that each
+// shard's share of the capacity stays large enough to approximate LRU.
+- (instancetype)initWithCapacity:(NSUInteger)capacity
+                      timeToLive:(NSTimeInterval)timeToLive
+                      shardCount:(NSUInteger)shardCount NS_DESIGNATED_INITIALIZER;
+- (instancetype)initWithCapacity:(NSUInteger)capacity
+                      timeToLive:(NSTimeInterval)timeToLive;
+- (instancetype)init NS_UNAVAILABLE;
+
+// Counts a hit or a miss and marks the entry most recently used
+- (nullable ObjectType)objectForKey:(KeyType)key;
+- (void)setObject:(ObjectType)object forKey:(KeyType)key;
+// Overrides the default lifetime for this entry
+- (void)setObject:(ObjectType)object forKey:(KeyType)key timeToLive:(NSTimeInterval)timeToLive;
+- (void)removeObjectForKey:(KeyType)key;
+- (void)removeAllObjects;
+// The predicate runs under the shard's lock and must not call back into the cache
+- (NSUInteger)removeObjectsPassingTest:(BOOL (NS_NOESCAPE ^)(KeyType key, ObjectType object))predicate;
+
+// Seconds until the entry expires: 0 if there is none, HUGE_VAL if it has no
+// lifetime. Neither counts as a lookup nor changes recency.
+- (NSTimeInterval)timeToLiveRemainingForKey:(KeyType)key;
+
+// Drops entries whose lifetime has run out and returns how many. Inserts do
+// this as they go; call it to release memory in a cache that has gone quiet.
+- (NSUInteger)expireObjects;
+
+- (NSUInteger)count;
+- (NSUInteger)capacity;
+// hits, misses, insertions, evictions, expirations, count and capacity
+- (NSDictionary<NSString *, NSNumber *> *)statistics;
+
+@end
+
+NS_ASSUME_NONNULL_END
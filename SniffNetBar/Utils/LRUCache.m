@@ -0,0 +1,323 @@
+//
+//  LRUCache.m
+//  SniffNetBar
+//
+//  Bounded least-recently-used cache with per-entry expiry
+//
+
+#import "LRUCache.h"
+#import "CacheIndex.h"
+#import <math.h>
+#import <os/lock.h>
+#import <time.h>
+
+// Below this many entries per shard, extra shards cost more in LRU accuracy
+// than they save in contention
+static const NSUInteger kSNBLRUCacheMinShardCapacity = 256;
+// The wheel spans about two lifetimes at this many ticks per lifetime
+static const uint64_t kSNBLRUCacheTicksPerLifetime = 256;
+static const uint64_t kSNBLRUCacheMinTickNs = NSEC_PER_MSEC;
+static const uint64_t kSNBLRUCacheMaxTickNs = 60 * NSEC_PER_SEC;
+
+// The index hands out slots; the shard keeps what lives in them. keys and
+// objects hold one retain each, and the dictionary maps a key to its slot.
+typedef struct {
+    os_unfair_lock lock;
+    CFMutableDictionaryRef slots;
+    SNBCacheIndex *index;
+    uint32_t capacity;
+    CFTypeRef *keys;
+    CFTypeRef *objects;
+} SNBLRUCacheShard;
+
+static inline uint64_t SNBLRUCacheNowNs(void) {
+    // Keeps counting while the machine sleeps, like the lifetimes it measures
+    return clock_gettime_nsec_np(CLOCK_MONOTONIC);
+}
+
+static inline uint64_t SNBLRUCacheExpiry(uint64_t nowNs, NSTimeInterval timeToLive) {
+    if (timeToLive <= 0) {
+        return SNB_CACHE_INDEX_NEVER;
+    }
+    return nowNs + (uint64_t)(timeToLive * NSEC_PER_SEC);
+}
+
+static inline BOOL SNBLRUCacheFindSlot(SNBLRUCacheShard *shard, id key, uint32_t *slot) {
+    const void *value = NULL;
+    if (!CFDictionaryGetValueIfPresent(shard->slots, (__bridge const void *)key, &value)) {
+        return NO;
+    }
+    *slot = (uint32_t)(uintptr_t)value;
+    return YES;
+}
+
+// Releases what the shard kept in a slot the index is about to reuse or free
+static void SNBLRUCacheUnmap(uint32_t slot, void *context) {
+    SNBLRUCacheShard *shard = context;
+    CFDictionaryRemoveValue(shard->slots, shard->keys[slot]);
+    CFRelease(shard->keys[slot]);
+    CFRelease(shard->objects[slot]);
+    shard->keys[slot] = NULL;
+    shard->objects[slot] = NULL;
+}
+
+static void SNBLRUCacheShardRemoveAll(SNBLRUCacheShard *shard) {
+    for (uint32_t slot = 0; slot < shard->capacity; slot++) {
+        if (shard->keys[slot]) {
+            CFRelease(shard->keys[slot]);
+            CFRelease(shard->objects[slot]);
+            shard->keys[slot] = NULL;
+            shard->objects[slot] = NULL;
+        }
+    }
+    CFDictionaryRemoveAllValues(shard->slots);
+    SNBCacheIndexClear(shard->index);
+}
+
+@interface SNBLRUCache () {
+    SNBLRUCacheShard *_shards;
+    NSUInteger _shardCount;
+    NSUInteger _capacity;
+    NSTimeInterval _timeToLive;
+}
+@end
+
+@implementation SNBLRUCache
+
+- (instancetype)initWithCapacity:(NSUInteger)capacity timeToLive:(NSTimeInterval)timeToLive {
+    return [self initWithCapacity:capacity timeToLive:timeToLive shardCount:1];
+}
+
+- (instancetype)initWithCapacity:(NSUInteger)capacity
+                      timeToLive:(NSTimeInterval)timeToLive
+                      shardCount:(NSUInteger)shardCount {
+    self = [super init];
+    if (self) {
+        _capacity = MIN(MAX(capacity, (NSUInteger)1), (NSUInteger)UINT32_MAX - 1);
+        _timeToLive = timeToLive;
+        _shardCount = MAX(MIN(shardCount, _capacity / kSNBLRUCacheMinShardCapacity), (NSUInteger)1);
+
+        uint64_t tickNs = timeToLive > 0
+            ? (uint64_t)(timeToLive * NSEC_PER_SEC) / kSNBLRUCacheTicksPerLifetime
+            : NSEC_PER_SEC;
+        tickNs = MIN(MAX(tickNs, kSNBLRUCacheMinTickNs), kSNBLRUCacheMaxTickNs);
+
+        _shards = calloc(_shardCount, sizeof(SNBLRUCacheShard));
+        if (!_shards) {
+            return nil;
+        }
+        for (NSUInteger i = 0; i < _shardCount; i++) {
+            SNBLRUCacheShard *shard = &_shards[i];
+            // The shares add up to the capacity exactly
+            shard->capacity = (uint32_t)(_capacity / _shardCount + (i < _capacity % _shardCount ? 1 : 0));
+            shard->lock = OS_UNFAIR_LOCK_INIT;
+            shard->slots = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, NULL);
+            shard->index = SNBCacheIndexCreate(shard->capacity, tickNs);
+            shard->keys = calloc(shard->capacity, sizeof(CFTypeRef));
+            shard->objects = calloc(shard->capacity, sizeof(CFTypeRef));
+            if (!shard->slots || !shard->index || !shard->keys || !shard->objects) {
+                return nil;
+            }
+        }
+    }
+    return self;
+}
+
+- (void)dealloc {
+    for (NSUInteger i = 0; i < _shardCount && _shards; i++) {
+        SNBLRUCacheShard *shard = &_shards[i];
+        if (shard->slots && shard->index && shard->keys && shard->objects) {
+            SNBLRUCacheShardRemoveAll(shard);
+        }
+        if (shard->slots) {
+            CFRelease(shard->slots);
+        }
+        SNBCacheIndexDestroy(shard->index);
+        free(shard->keys);
+        free(shard->objects);
+    }
+    free(_shards);
+}
+
+- (SNBLRUCacheShard *)shardForKey:(id)key {
+    if (_shardCount == 1) {
+        return &_shards[0];
+    }
+    // -hash is often weak in its low bits (NSNumber, short strings)
+    uint64_t hash = (uint64_t)[key hash] * 0x9e3779b97f4a7c15ULL;
+    return &_shards[(hash >> 32) % _shardCount];
+}
+
+#pragma mark - Entries
+
+- (id)objectForKey:(id)key {
+    if (!key) {
+        return nil;
+    }
+    SNBLRUCacheShard *shard = [self shardForKey:key];
+    uint64_t nowNs = SNBLRUCacheNowNs();
+    id object = nil;
+    uint32_t slot = 0;
+    os_unfair_lock_lock(&shard->lock);
+    if (!SNBLRUCacheFindSlot(shard, key, &slot)) {
+        SNBCacheIndexNoteMiss(shard->index);
+    } else if (SNBCacheIndexTouch(shard->index, slot, nowNs)) {
+        object = (__bridge id)shard->objects[slot];
+    } else {
+        // Expired: the index has already freed the slot
+        SNBLRUCacheUnmap(slot, shard);
+    }
+    os_unfair_lock_unlock(&shard->lock);
+    return object;
+}
+
+- (void)setObject:(id)object forKey:(id)key {
+    [self setObject:object forKey:key timeToLive:_timeToLive];
+}
+
+- (void)setObject:(id)object forKey:(id)key timeToLive:(NSTimeInterval)timeToLive {
+    if (!key || !object) {
+        return;
+    }
+    // A mutable key changing under the dictionary would strand its entry
+    id storedKey = [key conformsToProtocol:@protocol(NSCopying)] ? [key copy] : key;
+    SNBLRUCacheShard *shard = [self shardForKey:storedKey];
+    uint64_t nowNs = SNBLRUCacheNowNs();
+    uint64_t expiresNs = SNBLRUCacheExpiry(nowNs, timeToLive);
+
+    os_unfair_lock_lock(&shard->lock);
+    SNBCacheIndexExpire(shard->index, nowNs, SNBLRUCacheUnmap, shard);
+    uint32_t slot = 0;
+    if (SNBLRUCacheFindSlot(shard, storedKey, &slot)) {
+        SNBLRUCacheUnmap(slot, shard);
+        SNBCacheIndexRemove(shard->index, slot);
+    }
+    bool evicted = false;
+    slot = SNBCacheIndexInsert(shard->index, expiresNs, &evicted);
+    if (evicted) {
+        SNBLRUCacheUnmap(slot, shard);
+    }
+    shard->keys[slot] = CFBridgingRetain(storedKey);
+    shard->objects[slot] = CFBridgingRetain(object);
+    CFDictionarySetValue(shard->slots, shard->keys[slot], (const void *)(uintptr_t)slot);
+    os_unfair_lock_unlock(&shard->lock);
+}
+
+- (void)removeObjectForKey:(id)key {
+    if (!key) {
+        return;
+    }
+    SNBLRUCacheShard *shard = [self shardForKey:key];
+    uint32_t slot = 0;
+    os_unfair_lock_lock(&shard->lock);
+    if (SNBLRUCacheFindSlot(shard, key, &slot)) {
+        SNBLRUCacheUnmap(slot, shard);
+        SNBCacheIndexRemove(shard->index, slot);
+    }
+    os_unfair_lock_unlock(&shard->lock);
+}
+
+- (void)removeAllObjects {
+    for (NSUInteger i = 0; i < _shardCount; i++) {
+        SNBLRUCacheShard *shard = &_shards[i];
+        os_unfair_lock_lock(&shard->lock);
+        SNBLRUCacheShardRemoveAll(shard);
+        os_unfair_lock_unlock(&shard->lock);
+    }
+}
+
+- (NSUInteger)removeObjectsPassingTest:(BOOL (NS_NOESCAPE ^)(id key, id object))predicate {
+    NSUInteger removed = 0;
+    for (NSUInteger i = 0; i < _shardCount; i++) {
+        SNBLRUCacheShard *shard = &_shards[i];
+        os_unfair_lock_lock(&shard->lock);
+        for (uint32_t slot = 0; slot < shard->capacity; slot++) {
+            if (shard->keys[slot] &&
+                predicate((__bridge id)shard->keys[slot], (__bridge id)shard->objects[slot])) {
+                SNBLRUCacheUnmap(slot, shard);
+                SNBCacheIndexRemove(shard->index, slot);
+                removed++;
+            }
+        }
+        os_unfair_lock_unlock(&shard->lock);
+    }
+    return removed;
+}
+
+- (NSTimeInterval)timeToLiveRemainingForKey:(id)key {
+    if (!key) {
+        return 0;
+    }
+    SNBLRUCacheShard *shard = [self shardForKey:key];
+    uint64_t nowNs = SNBLRUCacheNowNs();
+    uint64_t expiresNs = 0;
+    uint32_t slot = 0;
+    os_unfair_lock_lock(&shard->lock);
+    if (SNBLRUCacheFindSlot(shard, key, &slot)) {
+        expiresNs = SNBCacheIndexExpiry(shard->index, slot);
+    }
+    os_unfair_lock_unlock(&shard->lock);
+
+    if (expiresNs == SNB_CACHE_INDEX_NEVER) {
+        return HUGE_VAL;
+    }
+    return expiresNs > nowNs ? (NSTimeInterval)(expiresNs - nowNs) / NSEC_PER_SEC : 0;
+}
+
+#pragma mark - Expiry
+
+- (NSUInteger)expireObjects {
+    uint64_t nowNs = SNBLRUCacheNowNs();
+    NSUInteger expired = 0;
+    for (NSUInteger i = 0; i < _shardCount; i++) {
+        SNBLRUCacheShard *shard = &_shards[i];
+        os_unfair_lock_lock(&shard->lock);
+        expired += SNBCacheIndexExpire(shard->index, nowNs, SNBLRUCacheUnmap, shard);
+        os_unfair_lock_unlock(&shard->lock);
+    }
+    return expired;
+}
+
+#pragma mark - Statistics
+
+- (NSUInteger)count {
+    NSUInteger count = 0;
+    for (NSUInteger i = 0; i < _shardCount; i++) {
+        SNBLRUCacheShard *shard = &_shards[i];
+        os_unfair_lock_lock(&shard->lock);
+        count += SNBCacheIndexCount(shard->index);
+        os_unfair_lock_unlock(&shard->lock);
+    }
+    return count;
+}
+
+- (NSUInteger)capacity {
+    return _capacity;
+}
+
+- (NSDictionary<NSString *, NSNumber *> *)statistics {
+    SNBCacheIndexStats total = {0};
+    for (NSUInteger i = 0; i < _shardCount; i++) {
+        SNBLRUCacheShard *shard = &_shards[i];
+        os_unfair_lock_lock(&shard->lock);
+        SNBCacheIndexStats stats = SNBCacheIndexGetStats(shard->index);
+        os_unfair_lock_unlock(&shard->lock);
+        total.hits += stats.hits;
+        total.misses += stats.misses;
+        total.insertions += stats.insertions;
+        total.evictions += stats.evictions;
+        total.expirations += stats.expirations;
+        total.count += stats.count;
+    }
+    return @{
+        @"hits": @(total.hits),
+        @"misses": @(total.misses),
+        @"insertions": @(total.insertions),
+        @"evictions": @(total.evictions),
+        @"expirations": @(total.expirations),
+        @"count": @(total.count),
+        @"capacity": @(_capacity)
+    };
+}
+
+@end
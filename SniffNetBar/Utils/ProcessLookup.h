@@ -31,6 +31,13 @@ NS_ASSUME_NONNULL_BEGIN
                              destinationPort:(NSInteger)destinationPort
                                   completion:(void (^)(ProcessInfo * _Nullable processInfo))completion;
 
+/// Lookup many connections in one helper round trip
+/// @param flowKeys Packed SNBFlowKey entries (FlowTable.h), local endpoint as the source
+/// @param completion Completion handler with a ProcessInfo or NSNull per key, in
+///        order (nil if the helper could not answer)
++ (void)lookupProcessesForFlowKeys:(NSData *)flowKeys
+                        completion:(void (^)(NSArray * _Nullable processInfos))completion;
+
 /// Synchronous version (use sparingly, may block)
 + (nullable ProcessInfo *)lookupProcessForConnectionWithSource:(NSString *)sourceAddress
                                                     sourcePort:(NSInteger)sourcePort
@@ -54,11 +61,17 @@ NS_ASSUME_NONNULL_END
 @interface ProcessLookup (Native)
 
 /// Native macOS API-based lookup using libproc (most reliable).
-/// Uses proc_listpids() and proc_pidfdinfo() to enumerate all process sockets
-/// and match connection details directly without text parsing.
+/// Answers from a socket index shared by all callers (SocketProcessIndex.h),
+/// rebuilt in one pass over proc_listpids()/proc_pidfdinfo() at a bounded
+/// rate, so a lookup is a table probe rather than a scan of every process.
+/// Without the helper's privileges only the user's own processes are seen.
 + (nullable ProcessInfo *)lookupUsingNativeAPIForSource:(NSString *)sourceAddress
                                              sourcePort:(NSInteger)sourcePort
                                             destination:(NSString *)destinationAddress
                                         destinationPort:(NSInteger)destinationPort;
 
+/// Batch form: packed SNBFlowKey entries in, a ProcessInfo or NSNull per key
+/// out, in order. The whole batch shares at most one index rebuild.
++ (NSArray *)lookupUsingNativeAPIForFlowKeys:(NSData *)flowKeys;
+
 @end
@@ -35,6 +35,21 @@
     }];
 }
 
++ (void)lookupProcessesForFlowKeys:(NSData *)flowKeys
+                        completion:(void (^)(NSArray * _Nullable processInfos))completion {
+    if (!completion) {
+        return;
+    }
+
+    [[SNBPrivilegedHelperClient sharedClient] lookupProcessesForConnections:flowKeys
+                                                                  completion:^(NSArray *processInfos, NSError *error) {
+        if (error) {
+            SNBLogDebug("ProcessLookup: batch error: %{public}@", error.localizedDescription);
+        }
+        completion(processInfos);
+    }];
+}
+
 + (nullable ProcessInfo *)lookupProcessForConnectionWithSource:(NSString *)sourceAddress
                                                     sourcePort:(NSInteger)sourcePort
                                                    destination:(NSString *)destinationAddress
@@ -10,6 +10,9 @@ NS_ASSUME_NONNULL_BEGIN
 @class NetworkDevice;
 @class ProcessInfo;
 @class PacketInfo;
+@class SNBPacketBatch;
+@class SNBCaptureStats;
+@class SNBCaptureOptions;
 
 @interface SNBPrivilegedHelperClient : NSObject
 
@@ -26,18 +29,46 @@ NS_ASSUME_NONNULL_BEGIN
 - (void)startCaptureOnDevice:(NSString *)deviceName
                   completion:(void (^)(NSString * _Nullable sessionID, NSError * _Nullable error))completion;
 
+// Nil options start the session with the helper's defaults
+- (void)startCaptureOnDevice:(NSString *)deviceName
+                     options:(nullable SNBCaptureOptions *)options
+                  completion:(void (^)(NSString * _Nullable sessionID, NSError * _Nullable error))completion;
+
 - (void)stopCaptureForSession:(NSString *)sessionID
                    completion:(void (^)(NSError * _Nullable error))completion;
 
 - (void)getNextPacketForSession:(NSString *)sessionID
                      completion:(void (^)(PacketInfo * _Nullable packet, NSError * _Nullable error))completion;
 
+- (void)getPacketBatchForSession:(NSString *)sessionID
+                      maxPackets:(NSUInteger)maxPackets
+                      maxLatency:(NSTimeInterval)maxLatency
+                      completion:(void (^)(SNBPacketBatch * _Nullable batch,
+                                           SNBCaptureStats * _Nullable stats,
+                                           NSError * _Nullable error))completion;
+
+- (void)openPacketRingForSession:(NSString *)sessionID
+                        capacity:(NSUInteger)capacity
+                      completion:(void (^)(NSFileHandle * _Nullable ringMemory,
+                                           NSFileHandle * _Nullable wakeup,
+                                           NSError * _Nullable error))completion;
+
+// The helper's shared passive DNS table, to attach read-only (PassiveDNS.h)
+- (void)openPassiveDNSTableWithCompletion:(void (^)(NSFileHandle * _Nullable tableMemory,
+                                                    NSError * _Nullable error))completion;
+
 - (void)lookupProcessWithSourceAddress:(NSString *)sourceAddress
                             sourcePort:(NSInteger)sourcePort
                        destinationAddr:(NSString *)destinationAddr
                        destinationPort:(NSInteger)destinationPort
                             completion:(void (^)(ProcessInfo * _Nullable processInfo, NSError * _Nullable error))completion;
 
+// Resolves packed SNBFlowKey connections in one round trip (see
+// SNBPrivilegedHelperProtocol.h). processInfos holds a ProcessInfo or NSNull
+// per connection, in order.
+- (void)lookupProcessesForConnections:(NSData *)connections
+                           completion:(void (^)(NSArray * _Nullable processInfos, NSError * _Nullable error))completion;
+
 @end
 
 NS_ASSUME_NONNULL_END
@@ -11,6 +11,12 @@
 #import "../XPC/ProcessInfo+Serialization.h"
 #import "PacketInfo.h"
 #import "../XPC/PacketInfo+Serialization.h"
+#import "PacketBatch.h"
+#import "CaptureStats.h"
+#import "../XPC/CaptureStats+Serialization.h"
+#import "CaptureOptions.h"
+#import "../XPC/CaptureOptions+Serialization.h"
+#import "FlowTable.h"
 #import "Logger.h"
 
 @interface SNBPrivilegedHelperClient ()
@@ -28,6 +34,10 @@ static void SNBConfigureHelperInterface(NSXPCInterface *interface) {
     NSSet *packetDictClasses = [NSSet setWithObjects:[NSDictionary class], [NSString class], [NSNumber class], nil];
     NSSet *processDictClasses = [NSSet setWithObjects:[NSDictionary class], [NSString class], [NSNumber class], nil];
     NSSet *deviceArrayClasses = [NSSet setWithObjects:[NSArray class], [NSDictionary class], [NSString class], nil];
+    NSSet *packetBatchClasses = [NSSet setWithObjects:[NSData class], nil];
+    NSSet *captureStatsClasses = [NSSet setWithObjects:[NSDictionary class], [NSString class], [NSNumber class], nil];
+    NSSet *fileHandleClasses = [NSSet setWithObjects:[NSFileHandle class], nil];
+    NSSet *captureOptionsClasses = [NSSet setWithObjects:[NSDictionary class], [NSString class], [NSNumber class], nil];
 
     [interface setClasses:stringClasses
               forSelector:@selector(getVersionWithReply:)
@@ -56,6 +66,23 @@ static void SNBConfigureHelperInterface(NSXPCInterface *interface) {
             argumentIndex:1
                   ofReply:YES];
 
+    [interface setClasses:stringClasses
+              forSelector:@selector(startCaptureOnDevice:options:withReply:)
+            argumentIndex:0
+                  ofReply:NO];
+    [interface setClasses:captureOptionsClasses
+              forSelector:@selector(startCaptureOnDevice:options:withReply:)
+            argumentIndex:1
+                  ofReply:NO];
+    [interface setClasses:sessionReplyClasses
+              forSelector:@selector(startCaptureOnDevice:options:withReply:)
+            argumentIndex:0
+                  ofReply:YES];
+    [interface setClasses:errorClasses
+              forSelector:@selector(startCaptureOnDevice:options:withReply:)
+            argumentIndex:1
+                  ofReply:YES];
+
     [interface setClasses:stringClasses
               forSelector:@selector(stopCaptureForSession:withReply:)
             argumentIndex:0
@@ -78,6 +105,49 @@ static void SNBConfigureHelperInterface(NSXPCInterface *interface) {
             argumentIndex:1
                   ofReply:YES];
 
+    [interface setClasses:stringClasses
+              forSelector:@selector(getPacketBatchForSession:maxPackets:maxLatencyMs:withReply:)
+            argumentIndex:0
+                  ofReply:NO];
+    [interface setClasses:packetBatchClasses
+              forSelector:@selector(getPacketBatchForSession:maxPackets:maxLatencyMs:withReply:)
+            argumentIndex:0
+                  ofReply:YES];
+    [interface setClasses:captureStatsClasses
+              forSelector:@selector(getPacketBatchForSession:maxPackets:maxLatencyMs:withReply:)
+            argumentIndex:1
+                  ofReply:YES];
+    [interface setClasses:errorClasses
+              forSelector:@selector(getPacketBatchForSession:maxPackets:maxLatencyMs:withReply:)
+            argumentIndex:2
+                  ofReply:YES];
+
+    [interface setClasses:stringClasses
+              forSelector:@selector(openPacketRingForSession:capacity:withReply:)
+            argumentIndex:0
+                  ofReply:NO];
+    [interface setClasses:fileHandleClasses
+              forSelector:@selector(openPacketRingForSession:capacity:withReply:)
+            argumentIndex:0
+                  ofReply:YES];
+    [interface setClasses:fileHandleClasses
+              forSelector:@selector(openPacketRingForSession:capacity:withReply:)
+            argumentIndex:1
+                  ofReply:YES];
+    [interface setClasses:errorClasses
+              forSelector:@selector(openPacketRingForSession:capacity:withReply:)
+            argumentIndex:2
+                  ofReply:YES];
+
+    [interface setClasses:fileHandleClasses
+              forSelector:@selector(openPassiveDNSTableWithReply:)
+            argumentIndex:0
+                  ofReply:YES];
+    [interface setClasses:errorClasses
+              forSelector:@selector(openPassiveDNSTableWithReply:)
+            argumentIndex:1
+                  ofReply:YES];
+
     [interface setClasses:stringClasses
               forSelector:@selector(lookupProcessWithSourceAddress:sourcePort:destinationAddress:destinationPort:withReply:)
             argumentIndex:0
@@ -102,6 +172,23 @@ static void SNBConfigureHelperInterface(NSXPCInterface *interface) {
               forSelector:@selector(lookupProcessWithSourceAddress:sourcePort:destinationAddress:destinationPort:withReply:)
             argumentIndex:1
                   ofReply:YES];
+
+    [interface setClasses:[NSSet setWithObjects:[NSData class], nil]
+              forSelector:@selector(lookupProcessesForConnections:withReply:)
+            argumentIndex:0
+                  ofReply:NO];
+    [interface setClasses:[NSSet setWithObjects:[NSData class], nil]
+              forSelector:@selector(lookupProcessesForConnections:withReply:)
+            argumentIndex:0
+                  ofReply:YES];
+    [interface setClasses:processDictClasses
+              forSelector:@selector(lookupProcessesForConnections:withReply:)
+            argumentIndex:1
+                  ofReply:YES];
+    [interface setClasses:errorClasses
+              forSelector:@selector(lookupProcessesForConnections:withReply:)
+            argumentIndex:2
+                  ofReply:YES];
 }
 
 + (instancetype)sharedClient {
@@ -303,6 +390,12 @@ static void SNBConfigureHelperInterface(NSXPCInterface *interface) {
 
 - (void)startCaptureOnDevice:(NSString *)deviceName
                   completion:(void (^)(NSString * _Nullable, NSError * _Nullable))completion {
+    [self startCaptureOnDevice:deviceName options:nil completion:completion];
+}
+
+- (void)startCaptureOnDevice:(NSString *)deviceName
+                     options:(SNBCaptureOptions *)options
+                  completion:(void (^)(NSString * _Nullable, NSError * _Nullable))completion {
     __block BOOL completed = NO;
     id<SNBPrivilegedHelperProtocol> helper = [self helperProxyWithErrorHandler:^(NSError *error) {
         if (completed) {
@@ -323,7 +416,7 @@ static void SNBConfigureHelperInterface(NSXPCInterface *interface) {
         return;
     }
 
-    [helper startCaptureOnDevice:deviceName withReply:^(NSString *sessionID, NSError *error) {
+    void (^reply)(NSString *, NSError *) = ^(NSString *sessionID, NSError *error) {
         if (completed) {
             return;
         }
@@ -331,7 +424,13 @@ static void SNBConfigureHelperInterface(NSXPCInterface *interface) {
         if (completion) {
             completion(sessionID, error);
         }
-    }];
+    };
+    // The options-less call also works with helpers older than 1.4
+    if (options) {
+        [helper startCaptureOnDevice:deviceName options:[options toDictionary] withReply:reply];
+    } else {
+        [helper startCaptureOnDevice:deviceName withReply:reply];
+    }
 }
 
 - (void)stopCaptureForSession:(NSString *)sessionID
@@ -412,6 +511,134 @@ static void SNBConfigureHelperInterface(NSXPCInterface *interface) {
     }];
 }
 
+- (void)getPacketBatchForSession:(NSString *)sessionID
+                      maxPackets:(NSUInteger)maxPackets
+                      maxLatency:(NSTimeInterval)maxLatency
+                      completion:(void (^)(SNBPacketBatch * _Nullable,
+                                           SNBCaptureStats * _Nullable,
+                                           NSError * _Nullable))completion {
+    __block BOOL completed = NO;
+    id<SNBPrivilegedHelperProtocol> helper = [self helperProxyWithErrorHandler:^(NSError *error) {
+        if (completed) {
+            return;
+        }
+        completed = YES;
+        if (completion) {
+            completion(nil, nil, error);
+        }
+    }];
+    if (!helper) {
+        if (completion) {
+            NSError *error = [NSError errorWithDomain:@"SNBHelperClient"
+                                                 code:1
+                                             userInfo:@{NSLocalizedDescriptionKey: @"Helper not connected"}];
+            completion(nil, nil, error);
+        }
+        return;
+    }
+
+    NSInteger latencyMs = (NSInteger)llround(maxLatency * 1000.0);
+    [helper getPacketBatchForSession:sessionID
+                          maxPackets:(NSInteger)maxPackets
+                        maxLatencyMs:latencyMs
+                           withReply:^(NSData *records, NSDictionary *stats, NSError *error) {
+        if (completed) {
+            return;
+        }
+        completed = YES;
+        if (error) {
+            if (completion) {
+                completion(nil, nil, error);
+            }
+            return;
+        }
+
+        SNBPacketBatch *batch = [SNBPacketBatch batchWithData:records ?: [NSData data]];
+        if (!batch) {
+            if (completion) {
+                completion(nil, nil, [NSError errorWithDomain:@"SNBHelperClient"
+                                                         code:2
+                                                     userInfo:@{NSLocalizedDescriptionKey: @"Malformed packet batch"}]);
+            }
+            return;
+        }
+
+        if (completion) {
+            completion(batch, stats ? [SNBCaptureStats fromDictionary:stats] : nil, nil);
+        }
+    }];
+}
+
+- (void)openPacketRingForSession:(NSString *)sessionID
+                        capacity:(NSUInteger)capacity
+                      completion:(void (^)(NSFileHandle * _Nullable,
+                                           NSFileHandle * _Nullable,
+                                           NSError * _Nullable))completion {
+    __block BOOL completed = NO;
+    id<SNBPrivilegedHelperProtocol> helper = [self helperProxyWithErrorHandler:^(NSError *error) {
+        if (completed) {
+            return;
+        }
+        completed = YES;
+        if (completion) {
+            completion(nil, nil, error);
+        }
+    }];
+    if (!helper) {
+        if (completion) {
+            NSError *error = [NSError errorWithDomain:@"SNBHelperClient"
+                                                 code:1
+                                             userInfo:@{NSLocalizedDescriptionKey: @"Helper not connected"}];
+            completion(nil, nil, error);
+        }
+        return;
+    }
+
+    [helper openPacketRingForSession:sessionID
+                            capacity:(NSInteger)capacity
+                           withReply:^(NSFileHandle *ringMemory, NSFileHandle *wakeup, NSError *error) {
+        if (completed) {
+            return;
+        }
+        completed = YES;
+        if (completion) {
+            completion(ringMemory, wakeup, error);
+        }
+    }];
+}
+
+- (void)openPassiveDNSTableWithCompletion:(void (^)(NSFileHandle * _Nullable, NSError * _Nullable))completion {
+    __block BOOL completed = NO;
+    id<SNBPrivilegedHelperProtocol> helper = [self helperProxyWithErrorHandler:^(NSError *error) {
+        if (completed) {
+            return;
+        }
+        completed = YES;
+        if (completion) {
+            completion(nil, error);
+        }
+    }];
+    if (!helper) {
+        if (completion) {
+            NSError *error = [NSError errorWithDomain:@"SNBHelperClient"
+                                                 code:1
+                                             userInfo:@{NSLocalizedDescriptionKey: @"Helper not connected"}];
+            completion(nil, error);
+        }
+        return;
+    }
+
+    [helper openPassiveDNSTableWithReply:^(NSFileHandle *tableMemory, NSError *error) {
+        if (completed) {
+            return;
+        }
+        completed = YES;
+        if (completion) {
+            completion(tableMemory, error);
+        }
+    }];
+}
+
 - (void)lookupProcessWithSourceAddress:(NSString *)sourceAddress
                             sourcePort:(NSInteger)sourcePort
                        destinationAddr:(NSString *)destinationAddr
@@ -464,4 +691,57 @@ static void SNBConfigureHelperInterface(NSXPCInterface *interface) {
     }];
 }
 
+- (void)lookupProcessesForConnections:(NSData *)connections
+                           completion:(void (^)(NSArray * _Nullable, NSError * _Nullable))completion {
+    __block BOOL completed = NO;
+    id<SNBPrivilegedHelperProtocol> helper = [self helperProxyWithErrorHandler:^(NSError *error) {
+        if (completed) {
+            return;
+        }
+        completed = YES;
+        if (completion) {
+            completion(nil, error);
+        }
+    }];
+    if (!helper) {
+        if (completion) {
+            completion(nil, nil);
+        }
+        return;
+    }
+
+    [helper lookupProcessesForConnections:connections
+                                withReply:^(NSData *pids, NSDictionary<NSNumber *, NSDictionary *> *processes, NSError *error) {
+        if (completed) {
+            return;
+        }
+        completed = YES;
+        NSUInteger count = connections.length / sizeof(SNBFlowKey);
+        if (error || pids.length != count * sizeof(int32_t)) {
+            if (completion) {
+                completion(nil, error);
+            }
+            return;
+        }
+
+        NSMutableDictionary<NSNumber *, id> *infoByPID = [NSMutableDictionary dictionary];
+        NSMutableArray *processInfos = [NSMutableArray arrayWithCapacity:count];
+        const int32_t *resolved = pids.bytes;
+        for (NSUInteger i = 0; i < count; i++) {
+            NSNumber *pid = @(resolved[i]);
+            id info = infoByPID[pid];
+            if (!info) {
+                NSDictionary *dictionary = [processes[pid] isKindOfClass:[NSDictionary class]] ? processes[pid] : nil;
+                info = (resolved[i] > 0 && dictionary) ? [ProcessInfo fromDictionary:dictionary] : nil;
+                info = info ?: [NSNull null];
+                infoByPID[pid] = info;
+            }
+            [processInfos addObject:info];
+        }
+        if (completion) {
+            completion(processInfos, nil);
+        }
+    }];
+}
+
 @end
@@ -0,0 +1,19 @@
+//
+//  CaptureOptions+Serialization.h
+//  SniffNetBar
+//
+
+#import <Foundation/Foundation.h>
+#import "CaptureOptions.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+@interface SNBCaptureOptions (Serialization)
+
+- (NSDictionary *)toDictionary;
+// Missing keys keep their defaults; values are clamped as by the setters
++ (nullable SNBCaptureOptions *)fromDictionary:(nullable NSDictionary *)dictionary;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,42 @@
+//
+//  CaptureOptions+Serialization.m
+//  SniffNetBar
+//
+
+#import "CaptureOptions+Serialization.h"
+
+@implementation SNBCaptureOptions (Serialization)
+
+- (NSDictionary *)toDictionary {
+    NSMutableDictionary *dictionary = [@{
+        @"snapshotLength": @(self.snapshotLength),
+        @"bufferSize": @(self.bufferSize)
+    } mutableCopy];
+    if (self.filterExpression.length > 0) {
+        dictionary[@"filterExpression"] = self.filterExpression;
+    }
+    return dictionary;
+}
+
++ (SNBCaptureOptions *)fromDictionary:(NSDictionary *)dictionary {
+    if (!dictionary) {
+        return nil;
+    }
+
+    SNBCaptureOptions *options = [[SNBCaptureOptions alloc] init];
+    id filter = dictionary[@"filterExpression"];
+    if ([filter isKindOfClass:[NSString class]]) {
+        options.filterExpression = filter;
+    }
+    id snapshotLength = dictionary[@"snapshotLength"];
+    if ([snapshotLength isKindOfClass:[NSNumber class]]) {
+        options.snapshotLength = [snapshotLength intValue];
+    }
+    id bufferSize = dictionary[@"bufferSize"];
+    if ([bufferSize isKindOfClass:[NSNumber class]]) {
+        options.bufferSize = [bufferSize unsignedIntegerValue];
+    }
+    return options;
+}
+
+@end
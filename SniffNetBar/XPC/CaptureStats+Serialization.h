@@ -0,0 +1,18 @@
+//
+//  CaptureStats+Serialization.h
+//  SniffNetBar
+//
+
+#import <Foundation/Foundation.h>
+#import "CaptureStats.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+@interface SNBCaptureStats (Serialization)
+
+- (NSDictionary *)toDictionary;
++ (nullable SNBCaptureStats *)fromDictionary:(NSDictionary *)dictionary;
+
+@end
+
+NS_ASSUME_NONNULL_END
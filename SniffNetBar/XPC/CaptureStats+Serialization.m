@@ -0,0 +1,42 @@
+//
+//  CaptureStats+Serialization.m
+//  SniffNetBar
+//
+
+#import "CaptureStats+Serialization.h"
+
+@implementation SNBCaptureStats (Serialization)
+
+- (NSDictionary *)toDictionary {
+    return @{
+        @"packetsReceived": @(self.packetsReceived),
+        @"kernelDropped": @(self.kernelDropped),
+        @"interfaceDropped": @(self.interfaceDropped),
+        @"ringDropped": @(self.ringDropped),
+        @"ringLag": @(self.ringLag),
+        @"packetsDelivered": @(self.packetsDelivered),
+        @"packetsUndecoded": @(self.packetsUndecoded),
+        @"batchCount": @(self.batchCount),
+        @"lastBatchSize": @(self.lastBatchSize)
+    };
+}
+
++ (SNBCaptureStats *)fromDictionary:(NSDictionary *)dictionary {
+    if (!dictionary) {
+        return nil;
+    }
+
+    SNBCaptureStats *stats = [[SNBCaptureStats alloc] init];
+    stats.packetsReceived = [dictionary[@"packetsReceived"] unsignedLongLongValue];
+    stats.kernelDropped = [dictionary[@"kernelDropped"] unsignedLongLongValue];
+    stats.interfaceDropped = [dictionary[@"interfaceDropped"] unsignedLongLongValue];
+    stats.ringDropped = [dictionary[@"ringDropped"] unsignedLongLongValue];
+    stats.ringLag = [dictionary[@"ringLag"] unsignedLongLongValue];
+    stats.packetsDelivered = [dictionary[@"packetsDelivered"] unsignedLongLongValue];
+    stats.packetsUndecoded = [dictionary[@"packetsUndecoded"] unsignedLongLongValue];
+    stats.batchCount = [dictionary[@"batchCount"] unsignedLongLongValue];
+    stats.lastBatchSize = [dictionary[@"lastBatchSize"] unsignedIntegerValue];
+    return stats;
+}
+
+@end
@@ -0,0 +1,296 @@
+//
+//  PacketRing.c
+//  SniffNetBar
+//
+//  Single-producer/single-consumer ring of SNBPacketRecord in shared memory
+//
+
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+
+#include "PacketRing.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+_Static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "Shared ring indices must be lock-free");
+
+// Layout of the mapping: one header followed by capacity records. The
+// producer-owned and consumer-owned indices sit on separate cache lines.
+typedef struct SNBPacketRingHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t recordSize;
+    uint32_t capacity;
+    uint32_t recordVersion;
+    _Atomic uint64_t dropped;
+    _Atomic uint64_t kernelReceived;
+    _Atomic uint64_t kernelDropped;
+    _Atomic uint64_t interfaceDropped;
+    uint8_t pad0[16];
+
+    _Atomic uint64_t head;
+    uint8_t pad1[56];
+
+    _Atomic uint64_t tail;
+    _Atomic uint32_t consumerWaiting;
+    uint8_t pad2[52];
+} SNBPacketRingHeader;
+
+_Static_assert(sizeof(SNBPacketRingHeader) == 192, "Ring header layout changed");
+
+struct SNBPacketRing {
+    SNBPacketRingHeader *header;
+    SNBPacketRecord *records;
+    size_t mappingSize;
+    uint64_t mask;
+    // Producer-private cursors
+    uint64_t writeIndex;
+    uint64_t cachedTail;
+    uint64_t pendingDrops;
+    // Consumer-private cursors
+    uint64_t readIndex;
+    uint64_t cachedHead;
+};
+
+uint32_t SNBPacketRingNormalizeCapacity(uint32_t capacity) {
+    if (capacity < SNB_PACKET_RING_MIN_CAPACITY) {
+        return SNB_PACKET_RING_MIN_CAPACITY;
+    }
+    if (capacity > SNB_PACKET_RING_MAX_CAPACITY) {
+        return SNB_PACKET_RING_MAX_CAPACITY;
+    }
+    uint32_t rounded = SNB_PACKET_RING_MIN_CAPACITY;
+    while (rounded < capacity) {
+        rounded <<= 1;
+    }
+    return rounded;
+}
+
+size_t SNBPacketRingMappingSize(uint32_t capacity) {
+    return sizeof(SNBPacketRingHeader) + (size_t)capacity * sizeof(SNBPacketRecord);
+}
+
+int SNBPacketRingCreateSharedMemory(uint32_t capacity) {
+    static _Atomic uint32_t sequence = 0;
+    capacity = SNBPacketRingNormalizeCapacity(capacity);
+
+    char name[32];
+    int fd = -1;
+    for (int attempt = 0; attempt < 8 && fd < 0; attempt++) {
+        snprintf(name, sizeof(name), "/snbring.%d.%u", (int)getpid(),
+                 (unsigned)atomic_fetch_add(&sequence, 1));
+        fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd < 0 && errno != EEXIST) {
+            return -1;
+        }
+    }
+    if (fd < 0) {
+        return -1;
+    }
+
+    // The object is only reachable through the descriptor from here on
+    shm_unlink(name);
+
+    if (ftruncate(fd, (off_t)SNBPacketRingMappingSize(capacity)) != 0) {
+        int savedErrno = errno;
+        close(fd);
+        errno = savedErrno;
+        return -1;
+    }
+    return fd;
+}
+
+static SNBPacketRing *SNBPacketRingMap(int fd, size_t size) {
+    void *memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (memory == MAP_FAILED) {
+        return NULL;
+    }
+
+    SNBPacketRing *ring = calloc(1, sizeof(SNBPacketRing));
+    if (!ring) {
+        munmap(memory, size);
+        return NULL;
+    }
+    ring->header = (SNBPacketRingHeader *)memory;
+    ring->records = (SNBPacketRecord *)((uint8_t *)memory + sizeof(SNBPacketRingHeader));
+    ring->mappingSize = size;
+    return ring;
+}
+
+SNBPacketRing *SNBPacketRingCreateProducer(int fd, uint32_t capacity) {
+    capacity = SNBPacketRingNormalizeCapacity(capacity);
+    SNBPacketRing *ring = SNBPacketRingMap(fd, SNBPacketRingMappingSize(capacity));
+    if (!ring) {
+        return NULL;
+    }
+
+    SNBPacketRingHeader *header = ring->header;
+    memset(header, 0, sizeof(*header));
+    header->version = SNB_PACKET_RING_VERSION;
+    header->recordSize = (uint16_t)sizeof(SNBPacketRecord);
+    header->capacity = capacity;
+    header->recordVersion = SNB_PACKET_RECORD_VERSION;
+    atomic_store_explicit(&header->head, 0, memory_order_relaxed);
+    atomic_store_explicit(&header->tail, 0, memory_order_relaxed);
+    // Magic last, so a consumer never accepts a half-initialized header
+    atomic_thread_fence(memory_order_release);
+    header->magic = SNB_PACKET_RING_MAGIC;
+
+    ring->mask = capacity - 1;
+    return ring;
+}
+
+SNBPacketRing *SNBPacketRingAttachConsumer(int fd) {
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(SNBPacketRingHeader)) {
+        return NULL;
+    }
+
+    SNBPacketRingHeader probe;
+    SNBPacketRing *headerOnly = SNBPacketRingMap(fd, sizeof(SNBPacketRingHeader));
+    if (!headerOnly) {
+        return NULL;
+    }
+    atomic_thread_fence(memory_order_acquire);
+    memcpy(&probe, headerOnly->header, sizeof(probe));
+    SNBPacketRingDestroy(headerOnly);
+
+    uint32_t capacity = probe.capacity;
+    if (probe.magic != SNB_PACKET_RING_MAGIC ||
+        probe.version != SNB_PACKET_RING_VERSION ||
+        probe.recordVersion != SNB_PACKET_RECORD_VERSION ||
+        probe.recordSize != sizeof(SNBPacketRecord) ||
+        capacity != SNBPacketRingNormalizeCapacity(capacity) ||
+        (size_t)info.st_size < SNBPacketRingMappingSize(capacity)) {
+        return NULL;
+    }
+
+    SNBPacketRing *ring = SNBPacketRingMap(fd, SNBPacketRingMappingSize(capacity));
+    if (!ring) {
+        return NULL;
+    }
+    ring->mask = capacity - 1;
+    ring->readIndex = atomic_load_explicit(&ring->header->tail, memory_order_relaxed);
+    ring->cachedHead = atomic_load_explicit(&ring->header->head, memory_order_acquire);
+    return ring;
+}
+
+void SNBPacketRingDestroy(SNBPacketRing *ring) {
+    if (!ring) {
+        return;
+    }
+    munmap(ring->header, ring->mappingSize);
+    free(ring);
+}
+
+// MARK: - Producer
+
+SNBPacketRecord *SNBPacketRingClaim(SNBPacketRing *ring) {
+    uint64_t capacity = ring->mask + 1;
+    if (ring->writeIndex - ring->cachedTail >= capacity) {
+        ring->cachedTail = atomic_load_explicit(&ring->header->tail, memory_order_acquire);
+        // The tail lives in memory the consumer can write; never trust it past
+        // what has actually been produced.
+        if (ring->cachedTail > ring->writeIndex) {
+            ring->cachedTail = ring->writeIndex;
+        }
+        if (ring->writeIndex - ring->cachedTail >= capacity) {
+            ring->pendingDrops++;
+            return NULL;
+        }
+    }
+    return &ring->records[ring->writeIndex & ring->mask];
+}
+
+void SNBPacketRingCommit(SNBPacketRing *ring) {
+    ring->writeIndex++;
+}
+
+bool SNBPacketRingPublish(SNBPacketRing *ring) {
+    SNBPacketRingHeader *header = ring->header;
+    if (ring->pendingDrops > 0) {
+        atomic_fetch_add_explicit(&header->dropped, ring->pendingDrops, memory_order_relaxed);
+        ring->pendingDrops = 0;
+    }
+    atomic_store_explicit(&header->head, ring->writeIndex, memory_order_release);
+
+    // Pairs with the fence in SNBPacketRingPrepareToWait: either the consumer
+    // sees the new head, or we see its waiting flag.
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&header->consumerWaiting, memory_order_relaxed) == 0) {
+        return false;
+    }
+    return atomic_exchange_explicit(&header->consumerWaiting, 0, memory_order_acq_rel) != 0;
+}
+
+void SNBPacketRingSetCaptureCounters(SNBPacketRing *ring,
+                                     uint64_t kernelReceived,
+                                     uint64_t kernelDropped,
+                                     uint64_t interfaceDropped) {
+    atomic_store_explicit(&ring->header->kernelReceived, kernelReceived, memory_order_relaxed);
+    atomic_store_explicit(&ring->header->kernelDropped, kernelDropped, memory_order_relaxed);
+    atomic_store_explicit(&ring->header->interfaceDropped, interfaceDropped, memory_order_relaxed);
+}
+
+// MARK: - Consumer
+
+const SNBPacketRecord *SNBPacketRingPeek(SNBPacketRing *ring, size_t *count) {
+    if (ring->readIndex == ring->cachedHead) {
+        ring->cachedHead = atomic_load_explicit(&ring->header->head, memory_order_acquire);
+    }
+
+    uint64_t available = ring->cachedHead - ring->readIndex;
+    if (available > ring->mask + 1) {
+        // Producer state is inconsistent with ours; resynchronize
+        ring->readIndex = ring->cachedHead;
+        atomic_store_explicit(&ring->header->tail, ring->readIndex, memory_order_release);
+        available = 0;
+    }
+
+    uint64_t offset = ring->readIndex & ring->mask;
+    uint64_t contiguous = (ring->mask + 1) - offset;
+    *count = (size_t)(available < contiguous ? available : contiguous);
+    return &ring->records[offset];
+}
+
+void SNBPacketRingRelease(SNBPacketRing *ring, size_t count) {
+    ring->readIndex += count;
+    atomic_store_explicit(&ring->header->tail, ring->readIndex, memory_order_release);
+}
+
+bool SNBPacketRingPrepareToWait(SNBPacketRing *ring) {
+    SNBPacketRingHeader *header = ring->header;
+    atomic_store_explicit(&header->consumerWaiting, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    ring->cachedHead = atomic_load_explicit(&header->head, memory_order_acquire);
+    if (ring->cachedHead != ring->readIndex) {
+        atomic_store_explicit(&header->consumerWaiting, 0, memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+// MARK: - Shared
+
+SNBPacketRingStats SNBPacketRingGetStats(const SNBPacketRing *ring) {
+    SNBPacketRingHeader *header = ring->header;
+    SNBPacketRingStats stats;
+    stats.produced = atomic_load_explicit(&header->head, memory_order_acquire);
+    stats.consumed = atomic_load_explicit(&header->tail, memory_order_acquire);
+    stats.dropped = atomic_load_explicit(&header->dropped, memory_order_relaxed);
+    stats.kernelReceived = atomic_load_explicit(&header->kernelReceived, memory_order_relaxed);
+    stats.kernelDropped = atomic_load_explicit(&header->kernelDropped, memory_order_relaxed);
+    stats.interfaceDropped = atomic_load_explicit(&header->interfaceDropped, memory_order_relaxed);
+    stats.lag = stats.produced >= stats.consumed ? stats.produced - stats.consumed : 0;
+    stats.capacity = header->capacity;
+    return stats;
+}
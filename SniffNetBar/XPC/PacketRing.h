@@ -0,0 +1,89 @@
+//
+//  PacketRing.h
+//  SniffNetBar
+//
+//  Single-producer/single-consumer ring of SNBPacketRecord in shared memory
+//
+
+#ifndef SNB_PACKET_RING_H
+#define SNB_PACKET_RING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "PacketRecord.h"
+
+// The helper creates the mapping and owns the producer side; the app maps the
+// same file descriptor (handed over XPC) and owns the consumer side. Only the
+// head and tail indices are shared state, so each side must be driven from a
+// single thread or serial queue.
+
+#define SNB_PACKET_RING_MAGIC 0x534E4252u  // "SNBR"
+#define SNB_PACKET_RING_VERSION 1
+#define SNB_PACKET_RING_MIN_CAPACITY 1024u
+#define SNB_PACKET_RING_MAX_CAPACITY (1u << 22)
+
+typedef struct SNBPacketRing SNBPacketRing;
+
+typedef struct SNBPacketRingStats {
+    uint64_t produced;          // Records published by the producer
+    uint64_t consumed;          // Records released by the consumer
+    uint64_t dropped;           // Records discarded because the ring was full
+    uint64_t kernelReceived;    // Capture counters mirrored from pcap_stats
+    uint64_t kernelDropped;
+    uint64_t interfaceDropped;
+    uint64_t lag;               // Records published but not yet consumed
+    uint32_t capacity;
+} SNBPacketRingStats;
+
+// Rounds capacity to a power of two within the supported range
+uint32_t SNBPacketRingNormalizeCapacity(uint32_t capacity);
+size_t SNBPacketRingMappingSize(uint32_t capacity);
+
+// Creates an anonymous shared-memory object sized for capacity records.
+// Returns a file descriptor or -1 with errno set.
+int SNBPacketRingCreateSharedMemory(uint32_t capacity);
+
+// Maps fd and initializes the header. Producer side only.
+SNBPacketRing *SNBPacketRingCreateProducer(int fd, uint32_t capacity);
+
+// Maps fd and validates the header written by the producer. Returns NULL if
+// the mapping is missing, too small, or has an unexpected layout version.
+SNBPacketRing *SNBPacketRingAttachConsumer(int fd);
+
+void SNBPacketRingDestroy(SNBPacketRing *ring);
+
+// MARK: - Producer
+
+// Returns the next free slot to decode into, or NULL (and counts a drop) if
+// the ring is full. The slot is only made visible by Commit + Publish.
+SNBPacketRecord *SNBPacketRingClaim(SNBPacketRing *ring);
+void SNBPacketRingCommit(SNBPacketRing *ring);
+
+// Publishes committed records. Returns true if the consumer is parked and
+// must be woken up.
+bool SNBPacketRingPublish(SNBPacketRing *ring);
+
+void SNBPacketRingSetCaptureCounters(SNBPacketRing *ring,
+                                     uint64_t kernelReceived,
+                                     uint64_t kernelDropped,
+                                     uint64_t interfaceDropped);
+
+// MARK: - Consumer
+
+// Returns a pointer to up to *count contiguous readable records, read in place.
+// *count is 0 when the ring is empty.
+const SNBPacketRecord *SNBPacketRingPeek(SNBPacketRing *ring, size_t *count);
+
+// Hands count peeked records back to the producer
+void SNBPacketRingRelease(SNBPacketRing *ring, size_t count);
+
+// Announces that the consumer is about to sleep on the wakeup channel.
+// Returns false if records arrived in the meantime and it should keep reading.
+bool SNBPacketRingPrepareToWait(SNBPacketRing *ring);
+
+// MARK: - Shared
+
+SNBPacketRingStats SNBPacketRingGetStats(const SNBPacketRing *ring);
+
+#endif
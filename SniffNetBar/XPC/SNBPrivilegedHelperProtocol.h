@@ -8,6 +8,7 @@
 #import <Foundation/Foundation.h>
 
 #define kSNBPrivilegedHelperMachServiceName @"com.sniffnetbar.helper"
+#define kSNBProcessLookupMaxBatch 4096
 
 @protocol SNBPrivilegedHelperProtocol
 
@@ -21,12 +22,39 @@
 - (void)startCaptureOnDevice:(NSString *)deviceName
                    withReply:(void (^)(NSString *sessionID, NSError *error))reply;
 
+// Same, with a serialized SNBCaptureOptions (BPF filter, snapshot length,
+// kernel buffer size; see CaptureOptions+Serialization.h). An invalid filter
+// fails with code 11.
+- (void)startCaptureOnDevice:(NSString *)deviceName
+                     options:(NSDictionary *)options
+                   withReply:(void (^)(NSString *sessionID, NSError *error))reply;
+
 - (void)stopCaptureForSession:(NSString *)sessionID
                      withReply:(void (^)(NSError *error))reply;
 
 - (void)getNextPacketForSession:(NSString *)sessionID
                       withReply:(void (^)(NSDictionary *packetInfo, NSError *error))reply;
 
+// Batched packet streaming: one round trip returns up to maxPackets packets or
+// whatever arrived within maxLatencyMs as packed SNBPacketRecord entries (see
+// PacketRecord.h), plus cumulative capture/drop counters.
+- (void)getPacketBatchForSession:(NSString *)sessionID
+                      maxPackets:(NSInteger)maxPackets
+                    maxLatencyMs:(NSInteger)maxLatencyMs
+                       withReply:(void (^)(NSData *records, NSDictionary *stats, NSError *error))reply;
+
+// Zero-copy streaming: the helper writes SNBPacketRecord entries into a shared
+// ring (see PacketRing.h) and only hands over the mapping and a wakeup pipe.
+- (void)openPacketRingForSession:(NSString *)sessionID
+                        capacity:(NSInteger)capacity
+                       withReply:(void (^)(NSFileHandle *ringMemory, NSFileHandle *wakeup, NSError *error))reply;
+
+// Passive DNS: the helper learns address -> name bindings from DNS and mDNS
+// responses on the captured devices into shared memory (see PassiveDNS.h)
+// and hands over the mapping, which the app attaches read-only. Fails with
+// code 12 when the table could not be created.
+- (void)openPassiveDNSTableWithReply:(void (^)(NSFileHandle *tableMemory, NSError *error))reply;
+
 // Process lookup
 - (void)lookupProcessWithSourceAddress:(NSString *)sourceAddress
                             sourcePort:(NSInteger)sourcePort
@@ -34,4 +62,13 @@
                        destinationPort:(NSInteger)destinationPort
                              withReply:(void (^)(NSDictionary *processInfo, NSError *error))reply;
 
+// Batched process lookup: connections holds up to kSNBProcessLookupMaxBatch
+// packed SNBFlowKey entries (see FlowTable.h) with the local endpoint as the
+// source. The reply holds one int32_t pid per connection, 0 when no process
+// owns it, and the process dictionaries (ProcessInfo+Serialization.h) of the
+// pids found, keyed by pid. The whole batch is served from one pass over the
+// process table.
+- (void)lookupProcessesForConnections:(NSData *)connections
+                            withReply:(void (^)(NSData *pids, NSDictionary<NSNumber *, NSDictionary *> *processes, NSError *error))reply;
+
 @end
@@ -5,9 +5,16 @@
 
 #import <Foundation/Foundation.h>
 
+@class SNBCaptureOptions;
+
 @interface SNBHelperPacketCapture : NSObject
 
+// Same as options:nil, which uses SNBCaptureOptions defaults
+- (void)startCaptureOnDevice:(NSString *)deviceName
+                   withReply:(void (^)(NSString *sessionID, NSError *error))reply;
+
 - (void)startCaptureOnDevice:(NSString *)deviceName
+                     options:(SNBCaptureOptions *)options
                    withReply:(void (^)(NSString *sessionID, NSError *error))reply;
 
 - (void)stopCaptureForSession:(NSString *)sessionID
@@ -16,6 +23,23 @@
 - (void)getNextPacketForSession:(NSString *)sessionID
                       withReply:(void (^)(NSDictionary *packetInfo, NSError *error))reply;
 
+// Returns up to maxPackets packets, or whatever arrived within maxLatencyMs,
+// together with the session's cumulative capture counters.
+- (void)getPacketBatchForSession:(NSString *)sessionID
+                      maxPackets:(NSInteger)maxPackets
+                    maxLatencyMs:(NSInteger)maxLatencyMs
+                       withReply:(void (^)(NSData *records, NSDictionary *stats, NSError *error))reply;
+
+// Moves the session to the shared-memory ring: returns the ring mapping and the
+// read end of the wakeup pipe, then keeps the ring filled on the session queue.
+- (void)openPacketRingForSession:(NSString *)sessionID
+                        capacity:(NSInteger)capacity
+                       withReply:(void (^)(NSFileHandle *ringMemory, NSFileHandle *wakeup, NSError *error))reply;
+
+// The shared address -> name table learned from DNS responses on the
+// captured devices (see SNBHelperPassiveDNS.h)
+- (void)openPassiveDNSTableWithReply:(void (^)(NSFileHandle *tableMemory, NSError *error))reply;
+
 - (void)stopAllSessionsWithReply:(void (^)(void))reply;
 
 @end
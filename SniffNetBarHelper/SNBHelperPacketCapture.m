@@ -4,35 +4,73 @@
 //
 
 #import "SNBHelperPacketCapture.h"
+#import "SNBHelperPassiveDNS.h"
 #import "../SniffNetBar/Models/PacketInfo.h"
+#import "../SniffNetBar/Models/PacketBatch.h"
 #import "../SniffNetBar/XPC/PacketInfo+Serialization.h"
+#import "../SniffNetBar/Models/CaptureStats.h"
+#import "../SniffNetBar/XPC/CaptureStats+Serialization.h"
+#import "../SniffNetBar/Models/CaptureOptions.h"
+#import "../SniffNetBar/Network/CaptureHandle.h"
+#import "../SniffNetBar/Network/PacketBatchReader.h"
+#import "../SniffNetBar/XPC/PacketRing.h"
 #import <pcap/pcap.h>
-#import <net/ethernet.h>
-#import <netinet/ip.h>
-#import <netinet/tcp.h>
-#import <netinet/udp.h>
-#import <arpa/inet.h>
-
-static const int kPcapSnaplen = 65536;
-static const int kPcapPromiscuousMode = 0;
-static const int kPcapTimeoutMs = 500;
+#import <fcntl.h>
+
 static const NSUInteger kSNBMaxActiveCaptureSessions = 4;
+static const NSInteger kSNBMaxBatchLatencyMs = 1000;
+static const NSTimeInterval kSNBRingPumpInterval = 0.05;
 
 @interface SNBHelperCaptureSession : NSObject
 
 @property (nonatomic, assign) pcap_t *pcapHandle;
+@property (nonatomic, strong) SNBPacketBatchReader *reader;
+@property (nonatomic, assign) SNBPacketRing *ring;
+@property (nonatomic, assign) int wakeupDescriptor;
 @property (nonatomic, strong) dispatch_queue_t queue;
 @property (nonatomic, copy) NSString *deviceName;
 
 @end
 
 @implementation SNBHelperCaptureSession
+
+- (instancetype)init {
+    self = [super init];
+    if (self) {
+        _wakeupDescriptor = -1;
+    }
+    return self;
+}
+
+// Must run on the session queue
+- (void)closeRing {
+    if (self.ring) {
+        SNBPacketRingDestroy(self.ring);
+        self.ring = NULL;
+    }
+    if (self.wakeupDescriptor >= 0) {
+        close(self.wakeupDescriptor);
+        self.wakeupDescriptor = -1;
+    }
+}
+
+// Must run on the session queue
+- (void)close {
+    [self closeRing];
+    if (self.pcapHandle) {
+        pcap_close(self.pcapHandle);
+        self.pcapHandle = NULL;
+    }
+    self.reader = nil;
+}
+
 @end
 
 @interface SNBHelperPacketCapture ()
 
 @property (nonatomic, strong) NSMutableDictionary<NSString *, SNBHelperCaptureSession *> *sessions;
 @property (nonatomic, strong) dispatch_queue_t managementQueue;
+@property (nonatomic, strong) SNBHelperPassiveDNS *passiveDNS;
 
 @end
 
@@ -43,12 +81,19 @@ static const NSUInteger kSNBMaxActiveCaptureSessions = 4;
     if (self) {
         _sessions = [[NSMutableDictionary alloc] init];
         _managementQueue = dispatch_queue_create("com.sniffnetbar.helper.capture.management", DISPATCH_QUEUE_SERIAL);
+        _passiveDNS = [[SNBHelperPassiveDNS alloc] init];
     }
     return self;
 }
 
 - (void)startCaptureOnDevice:(NSString *)deviceName
                    withReply:(void (^)(NSString *sessionID, NSError *error))reply {
+    [self startCaptureOnDevice:deviceName options:nil withReply:reply];
+}
+
+- (void)startCaptureOnDevice:(NSString *)deviceName
+                     options:(SNBCaptureOptions *)options
+                   withReply:(void (^)(NSString *sessionID, NSError *error))reply {
     if (deviceName.length == 0) {
         NSError *error = [NSError errorWithDomain:@"SNBHelperPacketCapture"
                                              code:1
@@ -67,32 +112,34 @@ static const NSUInteger kSNBMaxActiveCaptureSessions = 4;
             return;
         }
 
-        char errbuf[PCAP_ERRBUF_SIZE];
-        pcap_t *handle = pcap_open_live(deviceName.UTF8String,
-                                        kPcapSnaplen,
-                                        kPcapPromiscuousMode,
-                                        kPcapTimeoutMs,
-                                        errbuf);
+        SNBCaptureOptions *captureOptions = options ? [options copy] : [SNBCaptureOptions defaultOptions];
+        NSError *openError = nil;
+        pcap_t *handle = SNBCaptureHandleOpen(deviceName, captureOptions, &openError);
         if (!handle) {
+            // Code 11 lets the app tell a bad filter from a device problem
+            NSInteger code = openError.code == SNBCaptureHandleErrorFilter ? 11 : 2;
             NSError *error = [NSError errorWithDomain:@"SNBHelperPacketCapture"
-                                                 code:2
+                                                 code:code
                                              userInfo:@{NSLocalizedDescriptionKey:
-                                                            [NSString stringWithUTF8String:errbuf]}];
+                                                            openError.localizedDescription ?: @"pcap open failed"}];
             reply(nil, error);
             return;
         }
 
-        if (pcap_setnonblock(handle, 1, errbuf) == -1) {
-            NSLog(@"Helper: Failed to set non-blocking mode: %s", errbuf);
-        }
-
         SNBHelperCaptureSession *session = [[SNBHelperCaptureSession alloc] init];
         session.pcapHandle = handle;
+        session.reader = [[SNBPacketBatchReader alloc] initWithPcapHandle:handle];
+        if (!session.reader.linkTypeSupported) {
+            NSLog(@"Helper: No decoder for link type %d on %@; packets will only be counted",
+                  session.reader.linkType, deviceName);
+        }
         session.deviceName = deviceName;
         session.queue = dispatch_queue_create("com.sniffnetbar.helper.capture.session", DISPATCH_QUEUE_SERIAL);
 
         NSString *sessionID = [NSUUID UUID].UUIDString;
         self.sessions[sessionID] = session;
+        [self.passiveDNS startObservingDevice:deviceName];
+        NSLog(@"Helper: Capture started on %@ (%@)", deviceName, captureOptions);
         reply(sessionID, nil);
     });
 }
@@ -114,12 +161,10 @@ static const NSUInteger kSNBMaxActiveCaptureSessions = 4;
         }
 
         dispatch_sync(session.queue, ^{
-            if (session.pcapHandle) {
-                pcap_close(session.pcapHandle);
-                session.pcapHandle = NULL;
-            }
+            [session close];
         });
 
+        [self.passiveDNS stopObservingDevice:session.deviceName];
         [self.sessions removeObjectForKey:sessionID];
         reply(nil);
     });
@@ -156,9 +201,7 @@ static const NSUInteger kSNBMaxActiveCaptureSessions = 4;
             int result = pcap_next_ex(session.pcapHandle, &header, &packet);
 
             if (result == 1) {
-                PacketInfo *info = [self parsePacket:packet
-                                       capturedLength:header->caplen
-                                         actualLength:header->len];
+                PacketInfo *info = SNBPacketInfoFromEthernetFrame(packet, header->caplen, header->len);
                 reply(info ? [info toDictionary] : nil, nil);
                 return;
             }
@@ -183,66 +226,149 @@ static const NSUInteger kSNBMaxActiveCaptureSessions = 4;
     });
 }
 
-- (PacketInfo *)parsePacket:(const u_char *)packet
-             capturedLength:(int)capturedLength
-               actualLength:(int)actualLength {
-    if (capturedLength < (int)sizeof(struct ether_header)) {
-        return nil;
+- (void)getPacketBatchForSession:(NSString *)sessionID
+                      maxPackets:(NSInteger)maxPackets
+                    maxLatencyMs:(NSInteger)maxLatencyMs
+                       withReply:(void (^)(NSData *records, NSDictionary *stats, NSError *error))reply {
+    if (sessionID.length == 0) {
+        reply(nil, nil, [NSError errorWithDomain:@"SNBHelperPacketCapture"
+                                            code:4
+                                        userInfo:@{NSLocalizedDescriptionKey: @"Invalid session ID"}]);
+        return;
     }
 
-    PacketInfo *info = [[PacketInfo alloc] init];
-    info.totalBytes = actualLength;
+    NSUInteger packetLimit = (NSUInteger)MAX((NSInteger)1, MIN(maxPackets, (NSInteger)kSNBPacketBatchMaxPackets));
+    NSTimeInterval latency = (NSTimeInterval)MAX((NSInteger)1, MIN(maxLatencyMs, kSNBMaxBatchLatencyMs)) / 1000.0;
 
-    struct ether_header *ethHeader = (struct ether_header *)packet;
-    uint16_t etherType = ntohs(ethHeader->ether_type);
+    dispatch_async(self.managementQueue, ^{
+        SNBHelperCaptureSession *session = self.sessions[sessionID];
+        if (!session) {
+            reply(nil, nil, [NSError errorWithDomain:@"SNBHelperPacketCapture"
+                                                code:5
+                                            userInfo:@{NSLocalizedDescriptionKey: @"Session not found"}]);
+            return;
+        }
+
+        dispatch_async(session.queue, ^{
+            if (!session.pcapHandle || !session.reader) {
+                reply(nil, nil, [NSError errorWithDomain:@"SNBHelperPacketCapture"
+                                                    code:8
+                                                userInfo:@{NSLocalizedDescriptionKey: @"Session closed"}]);
+                return;
+            }
 
-    const u_char *ipPacket = packet + sizeof(struct ether_header);
-    int ipLength = capturedLength - (int)sizeof(struct ether_header);
-    if (ipLength <= 0) {
-        return nil;
+            NSError *readError = nil;
+            SNBPacketBatch *batch = [session.reader readBatchWithMaxPackets:packetLimit
+                                                                 maxLatency:latency
+                                                                      error:&readError];
+            if (!batch) {
+                NSError *error = [NSError errorWithDomain:@"SNBHelperPacketCapture"
+                                                     code:6
+                                                 userInfo:@{NSLocalizedDescriptionKey:
+                                                                readError.localizedDescription ?: @"pcap read failed"}];
+                reply(nil, nil, error);
+                return;
+            }
+
+            reply(batch.data, [[session.reader currentStats] toDictionary], nil);
+        });
+    });
+}
+
+- (void)openPacketRingForSession:(NSString *)sessionID
+                        capacity:(NSInteger)capacity
+                       withReply:(void (^)(NSFileHandle *ringMemory, NSFileHandle *wakeup, NSError *error))reply {
+    if (sessionID.length == 0) {
+        reply(nil, nil, [NSError errorWithDomain:@"SNBHelperPacketCapture"
+                                            code:4
+                                        userInfo:@{NSLocalizedDescriptionKey: @"Invalid session ID"}]);
+        return;
     }
 
-    if (etherType == ETHERTYPE_IP) {
-        if (ipLength < (int)sizeof(struct ip)) {
-            return nil;
+    uint32_t ringCapacity = SNBPacketRingNormalizeCapacity((uint32_t)MAX((NSInteger)0, MIN(capacity, (NSInteger)UINT32_MAX)));
+
+    dispatch_async(self.managementQueue, ^{
+        SNBHelperCaptureSession *session = self.sessions[sessionID];
+        if (!session) {
+            reply(nil, nil, [NSError errorWithDomain:@"SNBHelperPacketCapture"
+                                                code:5
+                                            userInfo:@{NSLocalizedDescriptionKey: @"Session not found"}]);
+            return;
         }
 
-        struct ip *ipHeader = (struct ip *)ipPacket;
-        int ipHeaderLen = ipHeader->ip_hl * 4;
-        if (ipLength < ipHeaderLen) {
-            return nil;
+        dispatch_async(session.queue, ^{
+            if (!session.pcapHandle || !session.reader) {
+                reply(nil, nil, [NSError errorWithDomain:@"SNBHelperPacketCapture"
+                                                    code:8
+                                                userInfo:@{NSLocalizedDescriptionKey: @"Session closed"}]);
+                return;
+            }
+            if (session.ring) {
+                reply(nil, nil, [NSError errorWithDomain:@"SNBHelperPacketCapture"
+                                                    code:9
+                                                userInfo:@{NSLocalizedDescriptionKey: @"Packet ring already open"}]);
+                return;
+            }
+
+            int memoryFD = SNBPacketRingCreateSharedMemory(ringCapacity);
+            SNBPacketRing *ring = memoryFD >= 0 ? SNBPacketRingCreateProducer(memoryFD, ringCapacity) : NULL;
+            int wakeupFDs[2] = { -1, -1 };
+            if (!ring || pipe(wakeupFDs) != 0) {
+                NSString *reason = [NSString stringWithUTF8String:strerror(errno)];
+                if (ring) {
+                    SNBPacketRingDestroy(ring);
+                }
+                if (memoryFD >= 0) {
+                    close(memoryFD);
+                }
+                reply(nil, nil, [NSError errorWithDomain:@"SNBHelperPacketCapture"
+                                                    code:10
+                                                userInfo:@{NSLocalizedDescriptionKey:
+                                                               [NSString stringWithFormat:@"Failed to create packet ring: %@", reason]}]);
+                return;
+            }
+
+            // Never block or take SIGPIPE on the wakeup channel
+            fcntl(wakeupFDs[1], F_SETFL, O_NONBLOCK);
+            fcntl(wakeupFDs[1], F_SETNOSIGPIPE, 1);
+
+            session.ring = ring;
+            session.wakeupDescriptor = wakeupFDs[1];
+
+            NSFileHandle *memoryHandle = [[NSFileHandle alloc] initWithFileDescriptor:memoryFD closeOnDealloc:YES];
+            NSFileHandle *wakeupHandle = [[NSFileHandle alloc] initWithFileDescriptor:wakeupFDs[0] closeOnDealloc:YES];
+            NSLog(@"Helper: Packet ring opened for %@ (%u records)", session.deviceName, ringCapacity);
+            reply(memoryHandle, wakeupHandle, nil);
+
+            [self pumpRingForSession:session];
+        });
+    });
+}
+
+// Fills the ring in short slices so stop requests can interleave on the queue
+- (void)pumpRingForSession:(SNBHelperCaptureSession *)session {
+    dispatch_async(session.queue, ^{
+        if (!session.pcapHandle || !session.ring) {
+            return;
         }
 
-        char srcAddr[INET_ADDRSTRLEN];
-        char dstAddr[INET_ADDRSTRLEN];
-        inet_ntop(AF_INET, &ipHeader->ip_src, srcAddr, sizeof(srcAddr));
-        inet_ntop(AF_INET, &ipHeader->ip_dst, dstAddr, sizeof(dstAddr));
-        info.sourceAddress = [NSString stringWithUTF8String:srcAddr];
-        info.destinationAddress = [NSString stringWithUTF8String:dstAddr];
-
-        const u_char *transport = ipPacket + ipHeaderLen;
-        int transportLength = ipLength - ipHeaderLen;
-
-        if (ipHeader->ip_p == IPPROTO_TCP && transportLength >= (int)sizeof(struct tcphdr)) {
-            struct tcphdr *tcpHeader = (struct tcphdr *)transport;
-            info.sourcePort = ntohs(tcpHeader->th_sport);
-            info.destinationPort = ntohs(tcpHeader->th_dport);
-            info.protocol = PacketProtocolTCP;
-        } else if (ipHeader->ip_p == IPPROTO_UDP && transportLength >= (int)sizeof(struct udphdr)) {
-            struct udphdr *udpHeader = (struct udphdr *)transport;
-            info.sourcePort = ntohs(udpHeader->uh_sport);
-            info.destinationPort = ntohs(udpHeader->uh_dport);
-            info.protocol = PacketProtocolUDP;
-        } else if (ipHeader->ip_p == IPPROTO_ICMP) {
-            info.protocol = PacketProtocolICMP;
-        } else {
-            info.protocol = PacketProtocolUnknown;
+        NSError *error = nil;
+        if (![session.reader pumpIntoRing:session.ring
+                         wakeupDescriptor:session.wakeupDescriptor
+                               maxLatency:kSNBRingPumpInterval
+                                    error:&error]) {
+            NSLog(@"Helper: Packet ring capture failed: %@", error.localizedDescription);
+            // Closing the wakeup pipe tells the app the session is gone
+            [session closeRing];
+            return;
         }
-    } else {
-        info.protocol = PacketProtocolUnknown;
-    }
 
-    return info;
+        [self pumpRingForSession:session];
+    });
+}
+
+- (void)openPassiveDNSTableWithReply:(void (^)(NSFileHandle *tableMemory, NSError *error))reply {
+    [self.passiveDNS openTableWithReply:reply];
 }
 
 - (void)stopAllSessionsWithReply:(void (^)(void))reply {
@@ -252,11 +378,9 @@ static const NSUInteger kSNBMaxActiveCaptureSessions = 4;
 
         for (SNBHelperCaptureSession *session in activeSessions) {
             dispatch_sync(session.queue, ^{
-                if (session.pcapHandle) {
-                    pcap_close(session.pcapHandle);
-                    session.pcapHandle = NULL;
-                }
+                [session close];
             });
+            [self.passiveDNS stopObservingDevice:session.deviceName];
         }
 
         if (reply) {
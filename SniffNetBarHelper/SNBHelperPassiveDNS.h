@@ -0,0 +1,24 @@
+//
+//  SNBHelperPassiveDNS.h
+//  SniffNetBarHelper
+//
+
+#import <Foundation/Foundation.h>
+
+// Learns address -> name bindings from the DNS and mDNS responses on the
+// captured interfaces into a shared table (see PassiveDNS.h) that the app
+// maps read-only. Capture sessions run with a header-only snapshot, so each
+// observed device gets a second handle filtered down to DNS responses with
+// room for the whole message.
+@interface SNBHelperPassiveDNS : NSObject
+
+// Observation is reference counted per device, one per capture session
+- (void)startObservingDevice:(NSString *)deviceName;
+- (void)stopObservingDevice:(NSString *)deviceName;
+- (void)stopObservingAllDevices;
+
+// A descriptor for the table's shared memory; the table outlives sessions and
+// connections, so a reconnecting app keeps what was learned
+- (void)openTableWithReply:(void (^)(NSFileHandle *tableMemory, NSError *error))reply;
+
+@end
@@ -0,0 +1,182 @@
+//
+//  SNBHelperPassiveDNS.m
+//  SniffNetBarHelper
+//
+
+#import "SNBHelperPassiveDNS.h"
+#import "../SniffNetBar/Models/CaptureOptions.h"
+#import "../SniffNetBar/Network/CaptureHandle.h"
+#import "../SniffNetBar/Network/PacketDecoder.h"
+#import "../SniffNetBar/Network/PassiveDNS.h"
+#import <pcap/pcap.h>
+
+// Responses only: queries carry no bindings. mDNS announcements go to 5353
+// from 5353, so either port matches them.
+static NSString * const kSNBPassiveDNSFilter = @"udp src port 53 or udp port 5353";
+// Whole responses, including EDNS-sized ones
+static const int kSNBPassiveDNSSnapshotLength = 4096;
+static const NSUInteger kSNBPassiveDNSBufferSize = 512 * 1024;
+static const NSTimeInterval kSNBPassiveDNSDrainInterval = 0.1;
+
+@interface SNBHelperDNSObserver : NSObject
+@property (nonatomic, assign) pcap_t *pcapHandle;
+@property (nonatomic, assign) SNBPacketDecodeFunction decode;
+@property (nonatomic, assign) NSUInteger sessionCount;
+@end
+
+@implementation SNBHelperDNSObserver
+@end
+
+typedef struct {
+    SNBPassiveDNSTable *table;
+    SNBPacketDecodeFunction decode;
+} SNBPassiveDNSDrainContext;
+
+static void SNBPassiveDNSHandler(u_char *user, const struct pcap_pkthdr *header, const u_char *bytes) {
+    SNBPassiveDNSDrainContext *context = (SNBPassiveDNSDrainContext *)user;
+    uint64_t timestampNs = (uint64_t)header->ts.tv_sec * 1000000000ULL + (uint64_t)header->ts.tv_usec * 1000ULL;
+    SNBPacketRecord record;
+    if (context->decode(bytes, header->caplen, header->len, timestampNs, &record)) {
+        SNBPassiveDNSObserve(context->table, &record, bytes, header->caplen);
+    }
+}
+
+@interface SNBHelperPassiveDNS ()
+// The queue is the table's only writer
+@property (nonatomic, strong) dispatch_queue_t queue;
+@property (nonatomic, strong) dispatch_source_t drainTimer;
+@property (nonatomic, strong) NSMutableDictionary<NSString *, SNBHelperDNSObserver *> *observers;
+@property (nonatomic, assign) SNBPassiveDNSTable *table;
+@property (nonatomic, assign) int tableDescriptor;
+@end
+
+@implementation SNBHelperPassiveDNS
+
+- (instancetype)init {
+    self = [super init];
+    if (self) {
+        _queue = dispatch_queue_create("com.sniffnetbar.helper.passivedns", DISPATCH_QUEUE_SERIAL);
+        _observers = [[NSMutableDictionary alloc] init];
+        _tableDescriptor = SNBPassiveDNSCreateSharedMemory(SNB_PASSIVE_DNS_DEFAULT_CAPACITY);
+        _table = _tableDescriptor >= 0 ? SNBPassiveDNSCreateWriter(_tableDescriptor, SNB_PASSIVE_DNS_DEFAULT_CAPACITY) : NULL;
+        if (!_table) {
+            NSLog(@"Helper: Passive DNS table unavailable: %s", strerror(errno));
+        }
+    }
+    return self;
+}
+
+- (void)startObservingDevice:(NSString *)deviceName {
+    dispatch_async(self.queue, ^{
+        if (!self.table) {
+            return;
+        }
+        SNBHelperDNSObserver *observer = self.observers[deviceName];
+        if (observer) {
+            observer.sessionCount++;
+            return;
+        }
+
+        SNBCaptureOptions *options = [SNBCaptureOptions defaultOptions];
+        options.filterExpression = kSNBPassiveDNSFilter;
+        options.snapshotLength = kSNBPassiveDNSSnapshotLength;
+        options.bufferSize = kSNBPassiveDNSBufferSize;
+        NSError *error = nil;
+        pcap_t *handle = SNBCaptureHandleOpen(deviceName, options, &error);
+        SNBPacketDecodeFunction decode = handle ? SNBPacketDecoderForLinkType((uint32_t)pcap_datalink(handle)) : NULL;
+        if (!decode) {
+            // Hostnames then come from reverse lookups only
+            NSLog(@"Helper: Not observing DNS on %@: %@", deviceName,
+                  error.localizedDescription ?: @"unsupported link type");
+            if (handle) {
+                pcap_close(handle);
+            }
+            return;
+        }
+
+        observer = [[SNBHelperDNSObserver alloc] init];
+        observer.pcapHandle = handle;
+        observer.decode = decode;
+        observer.sessionCount = 1;
+        self.observers[deviceName] = observer;
+        [self startDrainTimer];
+        NSLog(@"Helper: Observing DNS responses on %@", deviceName);
+    });
+}
+
+- (void)stopObservingDevice:(NSString *)deviceName {
+    dispatch_async(self.queue, ^{
+        SNBHelperDNSObserver *observer = self.observers[deviceName];
+        if (!observer || --observer.sessionCount > 0) {
+            return;
+        }
+        [self closeObserverForDevice:deviceName];
+    });
+}
+
+- (void)stopObservingAllDevices {
+    dispatch_async(self.queue, ^{
+        for (NSString *deviceName in self.observers.allKeys) {
+            [self closeObserverForDevice:deviceName];
+        }
+    });
+}
+
+- (void)openTableWithReply:(void (^)(NSFileHandle *tableMemory, NSError *error))reply {
+    dispatch_async(self.queue, ^{
+        int descriptor = self.table ? dup(self.tableDescriptor) : -1;
+        if (descriptor < 0) {
+            reply(nil, [NSError errorWithDomain:@"SNBHelperPacketCapture"
+                                           code:12
+                                       userInfo:@{NSLocalizedDescriptionKey: @"Passive DNS table unavailable"}]);
+            return;
+        }
+        reply([[NSFileHandle alloc] initWithFileDescriptor:descriptor closeOnDealloc:YES], nil);
+    });
+}
+
+#pragma mark - Draining
+
+// Must run on the queue
+- (void)closeObserverForDevice:(NSString *)deviceName {
+    SNBHelperDNSObserver *observer = self.observers[deviceName];
+    if (observer.pcapHandle) {
+        pcap_close(observer.pcapHandle);
+        observer.pcapHandle = NULL;
+    }
+    [self.observers removeObjectForKey:deviceName];
+    if (self.observers.count == 0 && self.drainTimer) {
+        dispatch_source_cancel(self.drainTimer);
+        self.drainTimer = nil;
+    }
+}
+
+// Must run on the queue
+- (void)startDrainTimer {
+    if (self.drainTimer) {
+        return;
+    }
+    self.drainTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, self.queue);
+    uint64_t interval = (uint64_t)(kSNBPassiveDNSDrainInterval * NSEC_PER_SEC);
+    dispatch_source_set_timer(self.drainTimer, dispatch_time(DISPATCH_TIME_NOW, (int64_t)interval), interval, interval / 4);
+    __weak typeof(self) weakSelf = self;
+    dispatch_source_set_event_handler(self.drainTimer, ^{
+        [weakSelf drainObservers];
+    });
+    dispatch_resume(self.drainTimer);
+}
+
+// Must run on the queue
+- (void)drainObservers {
+    for (NSString *deviceName in self.observers.allKeys) {
+        SNBHelperDNSObserver *observer = self.observers[deviceName];
+        SNBPassiveDNSDrainContext context = { self.table, observer.decode };
+        // Non-blocking handle: returns once the kernel buffer is empty
+        if (pcap_dispatch(observer.pcapHandle, -1, SNBPassiveDNSHandler, (u_char *)&context) == PCAP_ERROR) {
+            NSLog(@"Helper: DNS observation on %@ failed: %s", deviceName, pcap_geterr(observer.pcapHandle));
+            [self closeObserverForDevice:deviceName];
+        }
+    }
+}
+
+@end
@@ -13,4 +13,7 @@
                        destinationPort:(NSInteger)destinationPort
                              withReply:(void (^)(NSDictionary *processInfo, NSError *error))reply;
 
+- (void)lookupProcessesForConnections:(NSData *)connections
+                            withReply:(void (^)(NSData *pids, NSDictionary<NSNumber *, NSDictionary *> *processes, NSError *error))reply;
+
 @end
@@ -6,149 +6,38 @@
 #import "SNBHelperProcessLookup.h"
 #import "../SniffNetBar/Utils/ProcessLookup.h"
 #import "../SniffNetBar/XPC/ProcessInfo+Serialization.h"
+#import "../SniffNetBar/XPC/SNBPrivilegedHelperProtocol.h"
+#import "../SniffNetBar/Network/ProcessSocketEnumerator.h"
+#import "../SniffNetBar/Network/SocketProcessIndex.h"
 #import <libproc.h>
 #import <sys/proc_info.h>
 #import <netinet/in.h>
-#import <netinet/tcp.h>
 #import <arpa/inet.h>
 #import <string.h>
+#import <time.h>
 
-static dispatch_queue_t SNBHelperProcessLookupQueue(void) {
-    static dispatch_queue_t queue;
-    static dispatch_once_t onceToken;
-    dispatch_once(&onceToken, ^{
-        queue = dispatch_queue_create("com.sniffnetbar.helper.processlookup", DISPATCH_QUEUE_SERIAL);
-    });
-    return queue;
-}
+// Sized for a busy desktop; the table grows if there are more sockets
+static const size_t kSNBHelperSocketIndexCapacity = 4096;
 
-static BOOL SNBMatchAddress(const struct in_sockinfo *info,
-                            BOOL matchLocal,
-                            const struct in_addr *addr4,
-                            const struct in6_addr *addr6,
-                            BOOL has4,
-                            BOOL has6) {
-    if (info->insi_vflag & INI_IPV4) {
-        if (!has4) {
-            return NO;
-        }
-        const struct in_addr *candidate = matchLocal
-            ? &info->insi_laddr.ina_46.i46a_addr4
-            : &info->insi_faddr.ina_46.i46a_addr4;
-        return memcmp(candidate, addr4, sizeof(struct in_addr)) == 0;
+static BOOL SNBHelperParseAddress(NSString *address, SNBFlowKey *key, uint8_t *bytes) {
+    if (address.length == 0) {
+        return YES;
     }
-    if (info->insi_vflag & INI_IPV6) {
-        if (!has6) {
-            return NO;
-        }
-        const struct in6_addr *candidate = matchLocal
-            ? &info->insi_laddr.ina_6
-            : &info->insi_faddr.ina_6;
-        return memcmp(candidate, addr6, sizeof(struct in6_addr)) == 0;
-    }
-    return NO;
-}
-
-static ProcessInfo *SNBHelperFindProcessForConnection(NSString *sourceAddress,
-                                                       NSInteger sourcePort,
-                                                       NSString *destinationAddress,
-                                                       NSInteger destinationPort) {
-    struct in_addr src4;
-    struct in_addr dst4;
-    struct in6_addr src6;
-    struct in6_addr dst6;
-    BOOL hasSrc4 = sourceAddress.length > 0 &&
-        inet_pton(AF_INET, sourceAddress.UTF8String, &src4) == 1;
-    BOOL hasDst4 = destinationAddress.length > 0 &&
-        inet_pton(AF_INET, destinationAddress.UTF8String, &dst4) == 1;
-    BOOL hasSrc6 = sourceAddress.length > 0 &&
-        inet_pton(AF_INET6, sourceAddress.UTF8String, &src6) == 1;
-    BOOL hasDst6 = destinationAddress.length > 0 &&
-        inet_pton(AF_INET6, destinationAddress.UTF8String, &dst6) == 1;
-
-    int pidCount = proc_listpids(PROC_ALL_PIDS, 0, NULL, 0);
-    if (pidCount <= 0) {
-        return nil;
-    }
-
-    pid_t *pids = malloc((size_t)pidCount);
-    if (!pids) {
-        return nil;
+    uint8_t parsed[16] = {0};
+    uint8_t family = SNBAddressFamilyNone;
+    if (inet_pton(AF_INET, address.UTF8String, parsed) == 1) {
+        family = SNBAddressFamilyIPv4;
+    } else if (inet_pton(AF_INET6, address.UTF8String, parsed) == 1) {
+        family = SNBAddressFamilyIPv6;
+    } else {
+        return NO;
     }
-
-    pidCount = proc_listpids(PROC_ALL_PIDS, 0, pids, pidCount);
-    int pidTotal = pidCount / (int)sizeof(pid_t);
-    ProcessInfo *result = nil;
-
-    for (int i = 0; i < pidTotal; i++) {
-        pid_t pid = pids[i];
-        if (pid <= 0) {
-            continue;
-        }
-
-        int fdSize = proc_pidinfo(pid, PROC_PIDLISTFDS, 0, NULL, 0);
-        if (fdSize <= 0) {
-            continue;
-        }
-
-        struct proc_fdinfo *fdInfos = malloc((size_t)fdSize);
-        if (!fdInfos) {
-            continue;
-        }
-
-        fdSize = proc_pidinfo(pid, PROC_PIDLISTFDS, 0, fdInfos, fdSize);
-        int fdCount = fdSize / (int)sizeof(struct proc_fdinfo);
-
-        for (int f = 0; f < fdCount; f++) {
-            if (fdInfos[f].proc_fdtype != PROX_FDTYPE_SOCKET) {
-                continue;
-            }
-
-            struct socket_fdinfo socketInfo;
-            int sockSize = proc_pidfdinfo(pid, fdInfos[f].proc_fd,
-                                          PROC_PIDFDSOCKETINFO,
-                                          &socketInfo,
-                                          sizeof(socketInfo));
-            if (sockSize <= 0) {
-                continue;
-            }
-
-            if (socketInfo.psi.soi_kind != SOCKINFO_TCP) {
-                continue;
-            }
-
-            const struct in_sockinfo *inInfo = &socketInfo.psi.soi_proto.pri_tcp.tcpsi_ini;
-            int localPort = ntohs((uint16_t)inInfo->insi_lport);
-            int remotePort = ntohs((uint16_t)inInfo->insi_fport);
-
-            if (localPort != sourcePort || remotePort != destinationPort) {
-                continue;
-            }
-
-            if (sourceAddress.length > 0 &&
-                !SNBMatchAddress(inInfo, YES, &src4, &src6, hasSrc4, hasSrc6)) {
-                continue;
-            }
-            if (destinationAddress.length > 0 &&
-                !SNBMatchAddress(inInfo, NO, &dst4, &dst6, hasDst4, hasDst6)) {
-                continue;
-            }
-
-            result = [[ProcessInfo alloc] init];
-            result.pid = pid;
-            result.processName = nil;
-            break;
-        }
-
-        free(fdInfos);
-
-        if (result) {
-            break;
-        }
+    if (key->family != SNBAddressFamilyNone && key->family != family) {
+        return NO;
     }
-
-    free(pids);
-    return result;
+    key->family = family;
+    memcpy(bytes, parsed, sizeof(parsed));
+    return YES;
 }
 
 static ProcessInfo *SNBHelperProcessInfoForPID(pid_t pid) {
@@ -173,33 +62,101 @@ static ProcessInfo *SNBHelperProcessInfoForPID(pid_t pid) {
     return info;
 }
 
-@implementation SNBHelperProcessLookup
+@implementation SNBHelperProcessLookup {
+    dispatch_queue_t _queue;
+    SNBProcessSocketEnumerator _enumerator;
+    SNBSocketProcessIndex _index;
+    BOOL _indexReady;
+}
+
+- (instancetype)init {
+    self = [super init];
+    if (self) {
+        _queue = dispatch_queue_create("com.sniffnetbar.helper.processlookup", DISPATCH_QUEUE_SERIAL);
+        _indexReady = SNBSocketProcessIndexInit(&_index, SNBProcessSocketEnumerate, &_enumerator,
+                                                kSNBHelperSocketIndexCapacity);
+    }
+    return self;
+}
+
+- (void)dealloc {
+    SNBSocketProcessIndexDestroy(&_index);
+    SNBProcessSocketEnumeratorDestroy(&_enumerator);
+}
+
+// Runs on _queue
+- (NSData *)resolveConnections:(const SNBFlowKey *)keys count:(NSUInteger)count {
+    NSMutableData *pids = [NSMutableData dataWithLength:count * sizeof(int32_t)];
+    if (_indexReady) {
+        SNBSocketProcessIndexResolve(&_index, keys, count, pids.mutableBytes,
+                                     clock_gettime_nsec_np(CLOCK_UPTIME_RAW));
+    }
+    return pids;
+}
 
 - (void)lookupProcessWithSourceAddress:(NSString *)sourceAddress
                             sourcePort:(NSInteger)sourcePort
                     destinationAddress:(NSString *)destinationAddress
                        destinationPort:(NSInteger)destinationPort
                              withReply:(void (^)(NSDictionary *processInfo, NSError *error))reply {
-    if (sourcePort <= 0 || destinationPort <= 0) {
+    if (sourcePort <= 0 || sourcePort > UINT16_MAX || destinationPort <= 0 || destinationPort > UINT16_MAX) {
         reply(nil, nil);
         return;
     }
 
-    __block ProcessInfo *result = nil;
-    dispatch_sync(SNBHelperProcessLookupQueue(), ^{
-        result = SNBHelperFindProcessForConnection(sourceAddress,
-                                                   sourcePort,
-                                                   destinationAddress,
-                                                   destinationPort);
+    // The single lookup has always been TCP; a missing address matches a
+    // socket that is unconnected or bound to every address
+    SNBFlowKey key;
+    memset(&key, 0, sizeof(key));
+    if (!SNBHelperParseAddress(sourceAddress, &key, key.sourceAddress) ||
+        !SNBHelperParseAddress(destinationAddress, &key, key.destinationAddress) ||
+        key.family == SNBAddressFamilyNone) {
+        reply(nil, nil);
+        return;
+    }
+    key.ipProtocol = IPPROTO_TCP;
+    key.hasPorts = 1;
+    key.sourcePort = (uint16_t)sourcePort;
+    key.destinationPort = (uint16_t)destinationPort;
+
+    __block int32_t pid = 0;
+    dispatch_sync(_queue, ^{
+        pid = *(const int32_t *)[self resolveConnections:&key count:1].bytes;
     });
 
-    if (!result) {
+    if (pid <= 0) {
         reply(nil, nil);
         return;
     }
 
-    ProcessInfo *info = SNBHelperProcessInfoForPID(result.pid);
+    ProcessInfo *info = SNBHelperProcessInfoForPID(pid);
     reply([info toDictionary], nil);
 }
 
+- (void)lookupProcessesForConnections:(NSData *)connections
+                            withReply:(void (^)(NSData *pids, NSDictionary<NSNumber *, NSDictionary *> *processes, NSError *error))reply {
+    NSUInteger count = connections.length / sizeof(SNBFlowKey);
+    if (connections.length % sizeof(SNBFlowKey) != 0 || count > kSNBProcessLookupMaxBatch) {
+        reply(nil, nil, [NSError errorWithDomain:@"SNBHelperProcessLookup"
+                                            code:1
+                                        userInfo:@{NSLocalizedDescriptionKey: @"Invalid connection batch"}]);
+        return;
+    }
+
+    __block NSData *pids = nil;
+    dispatch_sync(_queue, ^{
+        pids = [self resolveConnections:connections.bytes count:count];
+    });
+
+    // Connections of one process share its dictionary
+    NSMutableDictionary<NSNumber *, NSDictionary *> *processes = [NSMutableDictionary dictionary];
+    const int32_t *resolved = pids.bytes;
+    for (NSUInteger i = 0; i < count; i++) {
+        if (resolved[i] > 0 && !processes[@(resolved[i])]) {
+            processes[@(resolved[i])] = [SNBHelperProcessInfoForPID(resolved[i]) toDictionary];
+        }
+    }
+    reply(pids, processes, nil);
+}
+
 @end
@@ -10,10 +10,11 @@
 #import "SNBHelperPacketCapture.h"
 #import "SNBHelperProcessLookup.h"
 #import "SNBHelperDeviceEnumerator.h"
+#import "../SniffNetBar/XPC/CaptureOptions+Serialization.h"
 
 #import "../SniffNetBar/XPC/SNBPrivilegedHelperProtocol.h"
 
-#define kSNBPrivilegedHelperVersion @"1.0"
+#define kSNBPrivilegedHelperVersion @"1.6"
 
 @interface SNBPrivilegedHelperService () <NSXPCListenerDelegate, SNBPrivilegedHelperProtocol>
 
@@ -34,6 +35,10 @@ static void SNBConfigureHelperInterface(NSXPCInterface *interface) {
     NSSet *packetDictClasses = [NSSet setWithObjects:[NSDictionary class], [NSString class], [NSNumber class], nil];
     NSSet *processDictClasses = [NSSet setWithObjects:[NSDictionary class], [NSString class], [NSNumber class], nil];
     NSSet *deviceArrayClasses = [NSSet setWithObjects:[NSArray class], [NSDictionary class], [NSString class], nil];
+    NSSet *packetBatchClasses = [NSSet setWithObjects:[NSData class], nil];
+    NSSet *captureStatsClasses = [NSSet setWithObjects:[NSDictionary class], [NSString class], [NSNumber class], nil];
+    NSSet *fileHandleClasses = [NSSet setWithObjects:[NSFileHandle class], nil];
+    NSSet *captureOptionsClasses = [NSSet setWithObjects:[NSDictionary class], [NSString class], [NSNumber class], nil];
 
     [interface setClasses:stringClasses
               forSelector:@selector(getVersionWithReply:)
@@ -62,6 +67,23 @@ static void SNBConfigureHelperInterface(NSXPCInterface *interface) {
             argumentIndex:1
                   ofReply:YES];
 
+    [interface setClasses:stringClasses
+              forSelector:@selector(startCaptureOnDevice:options:withReply:)
+            argumentIndex:0
+                  ofReply:NO];
+    [interface setClasses:captureOptionsClasses
+              forSelector:@selector(startCaptureOnDevice:options:withReply:)
+            argumentIndex:1
+                  ofReply:NO];
+    [interface setClasses:sessionReplyClasses
+              forSelector:@selector(startCaptureOnDevice:options:withReply:)
+            argumentIndex:0
+                  ofReply:YES];
+    [interface setClasses:errorClasses
+              forSelector:@selector(startCaptureOnDevice:options:withReply:)
+            argumentIndex:1
+                  ofReply:YES];
+
     [interface setClasses:stringClasses
               forSelector:@selector(stopCaptureForSession:withReply:)
             argumentIndex:0
@@ -84,6 +106,49 @@ static void SNBConfigureHelperInterface(NSXPCInterface *interface) {
             argumentIndex:1
                   ofReply:YES];
 
+    [interface setClasses:stringClasses
+              forSelector:@selector(getPacketBatchForSession:maxPackets:maxLatencyMs:withReply:)
+            argumentIndex:0
+                  ofReply:NO];
+    [interface setClasses:packetBatchClasses
+              forSelector:@selector(getPacketBatchForSession:maxPackets:maxLatencyMs:withReply:)
+            argumentIndex:0
+                  ofReply:YES];
+    [interface setClasses:captureStatsClasses
+              forSelector:@selector(getPacketBatchForSession:maxPackets:maxLatencyMs:withReply:)
+            argumentIndex:1
+                  ofReply:YES];
+    [interface setClasses:errorClasses
+              forSelector:@selector(getPacketBatchForSession:maxPackets:maxLatencyMs:withReply:)
+            argumentIndex:2
+                  ofReply:YES];
+
+    [interface setClasses:stringClasses
+              forSelector:@selector(openPacketRingForSession:capacity:withReply:)
+            argumentIndex:0
+                  ofReply:NO];
+    [interface setClasses:fileHandleClasses
+              forSelector:@selector(openPacketRingForSession:capacity:withReply:)
+            argumentIndex:0
+                  ofReply:YES];
+    [interface setClasses:fileHandleClasses
+              forSelector:@selector(openPacketRingForSession:capacity:withReply:)
+            argumentIndex:1
+                  ofReply:YES];
+    [interface setClasses:errorClasses
+              forSelector:@selector(openPacketRingForSession:capacity:withReply:)
+            argumentIndex:2
+                  ofReply:YES];
+
+    [interface setClasses:fileHandleClasses
+              forSelector:@selector(openPassiveDNSTableWithReply:)
+            argumentIndex:0
+                  ofReply:YES];
+    [interface setClasses:errorClasses
+              forSelector:@selector(openPassiveDNSTableWithReply:)
+            argumentIndex:1
+                  ofReply:YES];
+
     [interface setClasses:stringClasses
               forSelector:@selector(lookupProcessWithSourceAddress:sourcePort:destinationAddress:destinationPort:withReply:)
             argumentIndex:0
@@ -108,6 +173,23 @@ static void SNBConfigureHelperInterface(NSXPCInterface *interface) {
               forSelector:@selector(lookupProcessWithSourceAddress:sourcePort:destinationAddress:destinationPort:withReply:)
             argumentIndex:1
                   ofReply:YES];
+
+    [interface setClasses:[NSSet setWithObjects:[NSData class], nil]
+              forSelector:@selector(lookupProcessesForConnections:withReply:)
+            argumentIndex:0
+                  ofReply:NO];
+    [interface setClasses:[NSSet setWithObjects:[NSData class], nil]
+              forSelector:@selector(lookupProcessesForConnections:withReply:)
+            argumentIndex:0
+                  ofReply:YES];
+    [interface setClasses:processDictClasses
+              forSelector:@selector(lookupProcessesForConnections:withReply:)
+            argumentIndex:1
+                  ofReply:YES];
+    [interface setClasses:errorClasses
+              forSelector:@selector(lookupProcessesForConnections:withReply:)
+            argumentIndex:2
+                  ofReply:YES];
 }
 
 static NSString *SNBTeamIdentifierForSelf(void) {
@@ -250,6 +332,14 @@ static NSString *SNBTeamIdentifierForSelf(void) {
     [self.packetCapture startCaptureOnDevice:deviceName withReply:reply];
 }
 
+- (void)startCaptureOnDevice:(NSString *)deviceName
+                     options:(NSDictionary *)options
+                   withReply:(void (^)(NSString *sessionID, NSError *error))reply {
+    [self.packetCapture startCaptureOnDevice:deviceName
+                                     options:[SNBCaptureOptions fromDictionary:options]
+                                   withReply:reply];
+}
+
 - (void)stopCaptureForSession:(NSString *)sessionID
                      withReply:(void (^)(NSError *error))reply {
     [self.packetCapture stopCaptureForSession:sessionID withReply:reply];
@@ -260,6 +350,26 @@ static NSString *SNBTeamIdentifierForSelf(void) {
     [self.packetCapture getNextPacketForSession:sessionID withReply:reply];
 }
 
+- (void)getPacketBatchForSession:(NSString *)sessionID
+                      maxPackets:(NSInteger)maxPackets
+                    maxLatencyMs:(NSInteger)maxLatencyMs
+                       withReply:(void (^)(NSData *records, NSDictionary *stats, NSError *error))reply {
+    [self.packetCapture getPacketBatchForSession:sessionID
+                                      maxPackets:maxPackets
+                                    maxLatencyMs:maxLatencyMs
+                                       withReply:reply];
+}
+
+- (void)openPacketRingForSession:(NSString *)sessionID
+                        capacity:(NSInteger)capacity
+                       withReply:(void (^)(NSFileHandle *ringMemory, NSFileHandle *wakeup, NSError *error))reply {
+    [self.packetCapture openPacketRingForSession:sessionID capacity:capacity withReply:reply];
+}
+
+- (void)openPassiveDNSTableWithReply:(void (^)(NSFileHandle *tableMemory, NSError *error))reply {
+    [self.packetCapture openPassiveDNSTableWithReply:reply];
+}
+
 - (void)lookupProcessWithSourceAddress:(NSString *)sourceAddress
                             sourcePort:(NSInteger)sourcePort
                     destinationAddress:(NSString *)destinationAddress
@@ -272,4 +382,9 @@ static NSString *SNBTeamIdentifierForSelf(void) {
                                              withReply:reply];
 }
 
+- (void)lookupProcessesForConnections:(NSData *)connections
+                            withReply:(void (^)(NSData *pids, NSDictionary<NSNumber *, NSDictionary *> *processes, NSError *error))reply {
+    [self.processLookup lookupProcessesForConnections:connections withReply:reply];
+}
+
 @end